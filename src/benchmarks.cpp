@@ -0,0 +1,1126 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "benchmarks.h"
+
+#include "cat_sorting.h"
+#include "catalog.h"
+#include "catalog_cache.h"
+#include "catalog_diff.h"
+#include "catalog_po.h"
+#include "concurrency.h"
+#include "configuration.h"
+#include "edframe.h"
+#include "editing_area.h"
+#include "errors.h"
+#include "pretranslate.h"
+#include "sidebar.h"
+#include "str_helpers.h"
+#include "text_control.h"
+#include "utility.h"
+#include "extractors/extractor.h"
+#include "tm/transmem.h"
+#include "tm/tmx_io.h"
+
+#include <wx/app.h>
+#include <wx/evtloop.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/tokenzr.h>
+
+#ifdef __WXMSW__
+    #include <wx/msw/wrapwin.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+/// Parsed "key=value,..." options of the benchmarks
+class BenchmarkOptions
+{
+public:
+    explicit BenchmarkOptions(const wxString& options)
+    {
+        wxStringTokenizer tkn(options, ",");
+        while (tkn.HasMoreTokens())
+        {
+            auto kv = tkn.GetNextToken();
+            if (kv.Contains("="))
+                m_values[kv.BeforeFirst('=').Trim().Trim(false)] = kv.AfterFirst('=').Trim().Trim(false);
+            else
+                wxLogWarning("Invalid benchmark option \"%s\".", kv);
+        }
+    }
+
+    int Get(const wxString& key, int defaultValue) const
+    {
+        auto i = m_values.find(key);
+        if (i == m_values.end())
+            return defaultValue;
+        long value;
+        if (!i->second.ToLong(&value))
+        {
+            wxLogWarning("Invalid value of benchmark option \"%s\".", key);
+            return defaultValue;
+        }
+        return (int)value;
+    }
+
+    wxString GetString(const wxString& key) const
+    {
+        auto i = m_values.find(key);
+        return i != m_values.end() ? i->second : wxString();
+    }
+
+private:
+    std::map<wxString, wxString> m_values;
+};
+
+
+size_t GetPeakMemoryUsage()
+{
+#ifdef __WXMSW__
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+  #ifdef __WXOSX__
+    return (size_t)usage.ru_maxrss; // in bytes
+  #else
+    return (size_t)usage.ru_maxrss * 1024; // in kilobytes
+  #endif
+#endif
+}
+
+
+/**
+    Measures and reports the duration of benchmarked operations.
+
+    Every operation is run the given number of times and the best and mean
+    times are reported, together with throughput in @a units per second.
+ */
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(int iterations) : m_iterations(std::max(1, iterations))
+    {
+        wxPrintf("%-40s %10s %10s %14s %10s\n", "benchmark", "best ms", "mean ms", "throughput", "peak MB");
+    }
+
+    void Run(const wxString& name, size_t units, const char *unitName, const std::function<void()>& func)
+    {
+        Run(name, m_iterations, units, unitName, func);
+    }
+
+    /// @a setup, if provided, is called before every iteration and isn't measured
+    void Run(const wxString& name, int iterations, size_t units, const char *unitName,
+             const std::function<void()>& func, const std::function<void()>& setup = nullptr)
+    {
+        typedef std::chrono::steady_clock Clock;
+        double best = 0, total = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            if (setup)
+                setup();
+            const auto start = Clock::now();
+            func();
+            const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            total += ms;
+            if (i == 0 || ms < best)
+                best = ms;
+        }
+
+        const double perSecond = best > 0 ? units / (best / 1000.0) : 0;
+        wxPrintf("%-40s %10.2f %10.2f %9.0f %-4s %10.1f\n",
+                 name, best, total / iterations, perSecond, unitName,
+                 GetPeakMemoryUsage() / (1024.0 * 1024.0));
+    }
+
+    /// Reports percentiles of durations of @a count calls to @a func
+    void RunLatency(const wxString& name, size_t count, const std::function<void(size_t)>& func)
+    {
+        typedef std::chrono::steady_clock Clock;
+        std::vector<double> times;
+        times.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto start = Clock::now();
+            func(i);
+            times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        if (times.empty())
+            return;
+
+        std::sort(times.begin(), times.end());
+        auto percentile = [&times](double p){ return times[std::min(times.size() - 1, size_t(p * times.size()))]; };
+        wxPrintf("%-40s p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                 name, percentile(0.50), percentile(0.90), percentile(0.99), times.back());
+    }
+
+private:
+    int m_iterations;
+};
+
+
+/// Deterministic generator of synthetic texts
+class TextGenerator
+{
+public:
+    TextGenerator() : m_rng(42) {}
+
+    int Number(int max) { return std::uniform_int_distribution<int>(0, max - 1)(m_rng); }
+    bool Chance(int percent) { return Number(100) < percent; }
+
+    std::string Source(int minWords, int maxWords) { return Words(s_source, minWords, maxWords); }
+    std::string Translation(int minWords, int maxWords) { return Words(s_translation, minWords, maxWords); }
+
+private:
+    std::string Words(const std::vector<std::string>& vocabulary, int minWords, int maxWords)
+    {
+        std::string s;
+        const int count = minWords + Number(maxWords - minWords + 1);
+        for (int i = 0; i < count; i++)
+        {
+            if (i)
+                s += ' ';
+            s += vocabulary[Number((int)vocabulary.size())];
+        }
+        return s;
+    }
+
+    std::mt19937 m_rng;
+    static const std::vector<std::string> s_source, s_translation;
+};
+
+const std::vector<std::string> TextGenerator::s_source =
+{
+    "file", "open", "save", "the", "a", "document", "translation", "cannot", "be", "is",
+    "project", "settings", "window", "error", "while", "reading", "of", "new", "all", "items",
+    "select", "language", "source", "text", "to", "from", "update", "with", "your", "changes"
+};
+
+const std::vector<std::string> TextGenerator::s_translation =
+{
+    u8"soubor", u8"otevřít", u8"uložit", u8"dokument", u8"překlad", u8"nelze", u8"je", u8"projekt",
+    u8"nastavení", u8"okno", u8"chyba", u8"při", u8"čtení", u8"nový", u8"všechny", u8"položky",
+    u8"vyberte", u8"jazyk", u8"zdrojový", u8"text", u8"do", u8"ze", u8"aktualizovat", u8"změnami"
+};
+
+
+/// Configuration of generated catalogs, see BenchmarkOptions
+struct CatalogSpec
+{
+    explicit CatalogSpec(const BenchmarkOptions& o)
+        : entries(o.Get("entries", 20000)),
+          pluralsPercent(o.Get("plurals", 10)),
+          commentsPercent(o.Get("comments", 50)),
+          untranslatedPercent(o.Get("untranslated", 10)),
+          fuzzyPercent(o.Get("fuzzy", 5))
+    {}
+
+    int entries, pluralsPercent, commentsPercent, untranslatedPercent, fuzzyPercent;
+};
+
+
+void WriteFile(const wxString& filename, const std::string& data)
+{
+    wxFFile f(filename, "wb");
+    if (!f.IsOpened() || f.Write(data.data(), data.size()) != data.size() || !f.Close())
+        throw Exception(wxString::Format("Failed to write %s.", filename));
+}
+
+
+std::string GeneratePO(const CatalogSpec& spec)
+{
+    TextGenerator gen;
+    std::string out;
+    out.reserve(spec.entries * 200);
+
+    out += "msgid \"\"\n"
+           "msgstr \"\"\n"
+           "\"Project-Id-Version: Poedit benchmark\\n\"\n"
+           "\"Language: cs\\n\"\n"
+           "\"MIME-Version: 1.0\\n\"\n"
+           "\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+           "\"Content-Transfer-Encoding: 8bit\\n\"\n"
+           "\"Plural-Forms: nplurals=3; plural=(n==1) ? 0 : (n>=2 && n<=4) ? 1 : 2;\\n\"\n";
+
+    for (int i = 0; i < spec.entries; i++)
+    {
+        out += '\n';
+        if (gen.Chance(spec.commentsPercent))
+            out += "#. " + gen.Source(3, 12) + "\n";
+        out += "#: src/module" + std::to_string(gen.Number(200)) + ".cpp:" + std::to_string(gen.Number(3000) + 1) + "\n";
+
+        const bool untranslated = gen.Chance(spec.untranslatedPercent);
+        const bool fuzzy = !untranslated && gen.Chance(spec.fuzzyPercent);
+        const bool format = gen.Chance(20);
+        if (fuzzy || format)
+        {
+            out += "#,";
+            if (fuzzy)
+                out += " fuzzy,";
+            if (format)
+                out += " c-format";
+            if (out.back() == ',')
+                out.pop_back();
+            out += '\n';
+        }
+
+        // make every msgid unique:
+        const std::string id = " " + std::to_string(i);
+        const std::string arg = format ? " %d" : "";
+        if (gen.Chance(5))
+            out += "msgctxt \"" + gen.Source(1, 2) + "\"\n";
+        out += "msgid \"" + gen.Source(1, 15) + arg + id + "\"\n";
+        if (gen.Chance(spec.pluralsPercent))
+        {
+            out += "msgid_plural \"" + gen.Source(1, 15) + arg + id + "\"\n";
+            for (int n = 0; n < 3; n++)
+            {
+                out += "msgstr[" + std::to_string(n) + "] \"";
+                if (!untranslated)
+                    out += gen.Translation(1, 15) + arg;
+                out += "\"\n";
+            }
+        }
+        else
+        {
+            out += "msgstr \"";
+            if (!untranslated)
+                out += gen.Translation(1, 15) + arg;
+            out += "\"\n";
+        }
+    }
+
+    return out;
+}
+
+
+std::string GenerateXLIFF(const CatalogSpec& spec)
+{
+    TextGenerator gen;
+    std::string out;
+    out.reserve(spec.entries * 200);
+
+    out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<xliff version=\"1.2\" xmlns=\"urn:oasis:names:tc:xliff:document:1.2\">\n"
+           "  <file original=\"benchmark\" source-language=\"en\" target-language=\"cs\" datatype=\"plaintext\">\n"
+           "    <body>\n";
+
+    for (int i = 0; i < spec.entries; i++)
+    {
+        out += "      <trans-unit id=\"" + std::to_string(i) + "\">\n";
+        out += "        <source>" + gen.Source(1, 15) + "</source>\n";
+        if (!gen.Chance(spec.untranslatedPercent))
+        {
+            const char *state = gen.Chance(spec.fuzzyPercent) ? "needs-review-translation" : "translated";
+            out += std::string("        <target state=\"") + state + "\">" + gen.Translation(1, 15) + "</target>\n";
+        }
+        if (gen.Chance(spec.commentsPercent))
+            out += "        <note>" + gen.Source(3, 12) + "</note>\n";
+        out += "      </trans-unit>\n";
+    }
+
+    out += "    </body>\n"
+           "  </file>\n"
+           "</xliff>\n";
+    return out;
+}
+
+
+void BenchmarkCatalogFormat(BenchmarkRunner& runner, TempDirectory& tmpdir,
+                            const wxString& format, const std::string& data, size_t entries)
+{
+    auto filename = tmpdir.CreateFileName("benchmark." + format);
+    WriteFile(filename, data);
+    const wxString prefix = format + ": ";
+
+    CatalogPtr cat;
+    runner.Run(prefix + "Catalog::Create", entries, "e/s", [&]
+    {
+        cat = Catalog::Create(filename);
+        if (!cat || !cat->IsOk())
+            throw Exception(wxString::Format("Failed to load %s.", filename));
+    });
+
+    auto mem = cat->GetMemoryUsage();
+    auto MB = [](size_t bytes){ return bytes / (1024.0 * 1024.0); };
+    wxPrintf("%-40s %.1f MB: items %.1f, strings %.1f, translations %.1f, references %.1f, "
+             "comments %.1f, document %.1f, deleted %.1f, indexes %.1f\n",
+             prefix + "memory usage", MB(mem.Total()),
+             MB(mem.items), MB(mem.strings), MB(mem.translations), MB(mem.references),
+             MB(mem.comments), MB(mem.document), MB(mem.deletedItems), MB(mem.indexes));
+
+    runner.Run(prefix + "GetStatistics", entries, "e/s", [&]
+    {
+        int all, fuzzy, badtokens, untranslated, unfinished;
+        cat->GetStatistics(&all, &fuzzy, &badtokens, &untranslated, &unfinished);
+    });
+
+    // word counts are cached in items, so the cost of counting is measured directly:
+    const auto srclang = cat->GetSourceLanguage();
+    runner.Run(prefix + "CountText", entries, "e/s", [&]
+    {
+        for (auto& i: cat->items())
+            CountText(srclang, i->GetStringUTF8());
+    });
+
+    cat->PrecomputeTextCounts();
+    runner.Run(prefix + "GetTextStatistics (cached)", entries, "e/s", [&]
+    {
+        cat->GetTextStatistics();
+    });
+
+    // the same work as PoeditListCtrl::Model::CreateSortMap() does:
+    for (auto by: {SortOrder::By_Source, SortOrder::By_Translation})
+    {
+        SortOrder order;
+        order.by = by;
+        runner.Run(prefix + (by == SortOrder::By_Source ? "CreateSortMap (source)" : "CreateSortMap (translation)"),
+                   entries, "e/s", [&]
+        {
+            CatalogItemsComparator comparator(*cat, order);
+            std::vector<int> map(cat->GetCount());
+            for (size_t i = 0; i < map.size(); i++)
+                map[i] = (int)i;
+            dispatch::parallel_sort(map.begin(), map.end(), std::cref(comparator));
+        });
+    }
+
+    runner.Run(prefix + "SaveToBuffer", entries, "e/s", [&]
+    {
+        cat->SaveToBuffer();
+    });
+
+    runner.Run(prefix + "ExportToHTML", entries, "e/s", [&]
+    {
+        std::ostringstream html;
+        cat->ExportToHTML(html);
+    });
+
+    auto outfile = tmpdir.CreateFileName("saved." + format);
+    runner.Run(prefix + "Save", entries, "e/s", [&]
+    {
+        Catalog::ValidationResults validation;
+        Catalog::CompilationStatus mo;
+        if (!cat->Save(outfile, /*save_mo=*/false, validation, mo))
+            throw Exception(wxString::Format("Failed to save %s.", outfile));
+    });
+
+    runner.Run(prefix + "Validate", entries, "e/s", [&]
+    {
+        cat->Validate();
+    });
+}
+
+
+void BenchmarkCatalogs(const BenchmarkOptions& options)
+{
+    const CatalogSpec spec(options);
+    wxPrintf("catalogs: %d entries, %d%% plurals, %d%% comments, %d%% untranslated, %d%% fuzzy\n",
+             spec.entries, spec.pluralsPercent, spec.commentsPercent, spec.untranslatedPercent, spec.fuzzyPercent);
+    // if enabled, repeated loads of PO files are served from the cache:
+    wxPrintf("PO cache: %s\n\n", POCatalogCache::IsEnabled() ? "enabled" : "disabled");
+
+    TempDirectory tmpdir;
+    if (!tmpdir.IsOk())
+        throw Exception("Failed to create temporary directory.");
+
+    BenchmarkRunner runner(options.Get("iterations", 3));
+    BenchmarkCatalogFormat(runner, tmpdir, "po", GeneratePO(spec), spec.entries);
+    BenchmarkCatalogFormat(runner, tmpdir, "xlf", GenerateXLIFF(spec), spec.entries);
+}
+
+
+/// Collects source texts from the TM to use as search queries
+class TMQueryCollector : public TranslationMemory::IOInterface
+{
+public:
+    explicit TMQueryCollector(size_t maxCount) : m_maxCount(maxCount) {}
+
+    void Insert(const Language& srclang_, const Language& lang_,
+                const std::wstring& source, const std::wstring& /*trans*/, time_t /*creationTime*/) override
+    {
+        // only the language pair seen first is used, searches are per-pair
+        if (sources.empty())
+        {
+            srclang = srclang_;
+            lang = lang_;
+        }
+        if (sources.size() < m_maxCount && srclang_ == srclang && lang_ == lang)
+            sources.push_back(source);
+    }
+
+    Language srclang, lang;
+    std::vector<std::wstring> sources;
+
+private:
+    size_t m_maxCount;
+};
+
+
+/// Modifies one word of @a source so that it only has fuzzy matches
+std::wstring MakeFuzzyQuery(const std::wstring& source, TextGenerator& gen)
+{
+    std::vector<std::wstring> words;
+    wxStringTokenizer tkn(source, " ");
+    while (tkn.HasMoreTokens())
+        words.push_back(tkn.GetNextToken().ToStdWstring());
+
+    if (words.size() < 2)
+        return source + L" changed";
+
+    words[gen.Number((int)words.size())] = L"changed";
+    std::wstring out;
+    for (auto& w: words)
+    {
+        if (!out.empty())
+            out += L' ';
+        out += w;
+    }
+    return out;
+}
+
+
+std::string GenerateUntranslatedPO(const Language& lang, const std::vector<std::wstring>& sources)
+{
+    std::string out;
+    out += "msgid \"\"\n"
+           "msgstr \"\"\n"
+           "\"Project-Id-Version: Poedit benchmark\\n\"\n"
+           "\"Language: " + lang.Code() + "\\n\"\n"
+           "\"MIME-Version: 1.0\\n\"\n"
+           "\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+           "\"Content-Transfer-Encoding: 8bit\\n\"\n";
+
+    std::set<std::wstring> seen;
+    for (auto& s: sources)
+    {
+        // msgids must be unique in PO files:
+        if (!seen.insert(s).second)
+            continue;
+        out += "\nmsgid \"" + EscapeCString(str::to_utf8(s)) + "\"\n"
+               "msgstr \"\"\n";
+    }
+    return out;
+}
+
+
+void BenchmarkTM(const BenchmarkOptions& options)
+{
+    const int entries = options.Get("entries", 50000);
+    const int queries = options.Get("queries", 1000);
+    const int maxThreads = options.Get("threads", std::max(1, (int)std::thread::hardware_concurrency()));
+    const wxString tmxFile = options.GetString("tmx");
+
+    TempDirectory tmpdir;
+    if (!tmpdir.IsOk())
+        throw Exception("Failed to create temporary directory.");
+
+    // don't touch the user's TM, populate a new one instead:
+    TranslationMemory::UseDatabaseDir(tmpdir.CreateFileName("TranslationMemory").ToStdWstring());
+    auto& tm = TranslationMemory::Get();
+    // close the database before the temporary directory is removed:
+    struct TMCloser { ~TMCloser() { TranslationMemory::CleanUp(); } } closeTM;
+
+    BenchmarkRunner runner(options.Get("iterations", 3));
+
+    if (!tmxFile.empty())
+    {
+        wxPrintf("TM: populated from %s\n\n", tmxFile);
+        const auto size = wxFileName::GetSize(tmxFile);
+        if (size == wxInvalidSize)
+            throw Exception(wxString::Format("Failed to open %s.", tmxFile));
+        runner.Run("TMX::ImportFromFile", 1, size_t(size.GetValue() / 1024), "KB/s", [&]
+        {
+            std::ifstream f(tmxFile.fn_str(), std::ios::binary);
+            TMX::ImportFromFile(f, tm);
+        });
+    }
+    else
+    {
+        wxPrintf("TM: %d synthetic entries\n\n", entries);
+        std::vector<std::pair<std::wstring, std::wstring>> corpus;
+        corpus.reserve(entries);
+        TextGenerator gen;
+        for (int i = 0; i < entries; i++)
+            corpus.emplace_back(str::to_wstring(gen.Source(1, 15)), str::to_wstring(gen.Translation(1, 15)));
+
+        const auto srclang = Language::English();
+        const auto lang = Language::TryParse("cs");
+        runner.Run("Writer::Insert + Commit", 1, corpus.size(), "e/s", [&]
+        {
+            auto writer = tm.GetWriter();
+            for (auto& e: corpus)
+                writer->Insert(srclang, lang, e.first, e.second);
+            writer->Commit();
+        });
+    }
+
+    TMQueryCollector collector(queries);
+    tm.ExportData(collector);
+    if (collector.sources.empty())
+        throw Exception("The TM is empty, there's nothing to search.");
+    const auto srclang = collector.srclang;
+    const auto lang = collector.lang;
+
+    TextGenerator gen;
+    auto& exact = collector.sources;
+    std::vector<std::wstring> fuzzy, mixed;
+    for (auto& s: exact)
+    {
+        fuzzy.push_back(MakeFuzzyQuery(s, gen));
+        mixed.push_back(gen.Chance(50) ? s : fuzzy.back());
+    }
+
+    runner.RunLatency("Search (exact)", exact.size(), [&](size_t i){ tm.Search(srclang, lang, exact[i]); });
+    runner.RunLatency("Search (fuzzy)", fuzzy.size(), [&](size_t i){ tm.Search(srclang, lang, fuzzy[i]); });
+
+    // concurrent queries, as when several windows ask for suggestions at once:
+    for (int threadsCount = 1; threadsCount <= maxThreads; threadsCount *= 2)
+    {
+        runner.Run(wxString::Format("SuggestTranslation (%d threads)", threadsCount), mixed.size(), "q/s", [&]
+        {
+            std::vector<std::thread> threads;
+            std::vector<std::exception_ptr> errors(threadsCount);
+            for (int t = 0; t < threadsCount; t++)
+            {
+                threads.emplace_back([&, t]
+                {
+                    try
+                    {
+                        for (size_t i = t; i < mixed.size(); i += threadsCount)
+                            tm.SuggestTranslation(SuggestionQuery{srclang, lang, mixed[i]}, dispatch::cancellation_token()).get();
+                    }
+                    catch (...)
+                    {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+            for (auto& t: threads)
+                t.join();
+            for (auto& e: errors)
+            {
+                if (e)
+                    std::rethrow_exception(e);
+            }
+        });
+    }
+
+    // pre-translation uses settings from preferences, don't override them:
+    if (!Config::UseTM() || Config::UseCompactTM())
+    {
+        wxPrintf("%-40s skipped, TM disabled or compact TM used in preferences\n", "PreTranslateCatalog");
+        return;
+    }
+
+    auto pofile = tmpdir.CreateFileName("pretranslate.po");
+    WriteFile(pofile, GenerateUntranslatedPO(lang, mixed));
+    CatalogPtr cat;
+    int matches = 0;
+    runner.Run("PreTranslateCatalog", options.Get("iterations", 3), mixed.size(), "e/s",
+    [&]{
+        PreTranslateCatalogHeadless(cat, 0, &matches);
+    },
+    [&]{
+        cat = Catalog::Create(pofile);
+        if (!cat || !cat->IsOk())
+            throw Exception(wxString::Format("Failed to load %s.", pofile));
+    });
+    wxPrintf("%-40s %d of %d entries\n", "PreTranslateCatalog matches", matches, (int)cat->GetCount());
+}
+
+
+/// Writes a tree of C and Python sources with translatable strings to @a root
+int GenerateSourceTree(const wxString& root, int filesCount, int stringsPerFile)
+{
+    TextGenerator gen;
+    int total = 0;
+    for (int f = 0; f < filesCount; f++)
+    {
+        auto dir = wxString::Format("%s%cmodule%d", root, wxFILE_SEP_PATH, f / 50);
+        if (!wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL))
+            throw Exception(wxString::Format("Failed to create %s.", dir));
+
+        const bool python = gen.Chance(25);
+        std::string out;
+        if (python)
+            out += "from gettext import gettext as _, ngettext\n\n";
+        else
+            out += "#include <stdio.h>\n#include <libintl.h>\n\n#define _(s) gettext(s)\n\n";
+
+        for (int s = 0; s < stringsPerFile; s++, total++)
+        {
+            // most strings are unique, but some are repeated across files:
+            auto text = gen.Source(1, 12);
+            if (gen.Chance(80))
+                text += " " + std::to_string(f) + "." + std::to_string(s);
+
+            const bool comment = gen.Chance(20);
+            const bool plural = gen.Chance(10);
+            if (python)
+            {
+                out += "def function_" + std::to_string(s) + "(n):\n";
+                if (comment)
+                    out += "    # TRANSLATORS: " + gen.Source(3, 8) + "\n";
+                if (plural)
+                    out += "    print(ngettext(\"%d " + text + "\", \"%d " + text + "s\", n) % n)\n";
+                else
+                    out += "    print(_(\"" + text + "\"))\n";
+                out += "    log.debug(\"internal message %d\", n)\n\n";
+            }
+            else
+            {
+                out += "void function_" + std::to_string(s) + "(int n)\n{\n";
+                if (comment)
+                    out += "    /* TRANSLATORS: " + gen.Source(3, 8) + " */\n";
+                if (plural)
+                    out += "    printf(ngettext(\"%d " + text + "\", \"%d " + text + "s\", n), n);\n";
+                else if (gen.Chance(5))
+                    out += "    puts(pgettext(\"" + gen.Source(1, 2) + "\", \"" + text + "\"));\n";
+                else
+                    out += "    puts(_(\"" + text + "\"));\n";
+                out += "    log_debug(\"internal message %d\", n);\n}\n\n";
+            }
+        }
+
+        WriteFile(wxString::Format("%s%cfile%d.%s", dir, wxFILE_SEP_PATH, f, python ? "py" : "c"), out);
+    }
+    return total;
+}
+
+
+void BenchmarkExtraction(const BenchmarkOptions& options)
+{
+    const int filesCount = options.Get("files", 1000);
+    const int stringsPerFile = options.Get("strings", 20);
+
+    TempDirectory tmpdir;
+    if (!tmpdir.IsOk())
+        throw Exception("Failed to create temporary directory.");
+
+    auto root = tmpdir.CreateFileName("sources");
+    const int stringsCount = GenerateSourceTree(root, filesCount, stringsPerFile);
+    wxPrintf("sources: %d files, %d strings\n\n", filesCount, stringsCount);
+
+    SourceCodeSpec spec;
+    spec.BasePath = root + wxFILE_SEP_PATH;
+    spec.SearchPaths.push_back(".");
+
+    BenchmarkRunner runner(options.Get("iterations", 3));
+
+    Extractor::FilesList files;
+    runner.Run("Extractor::CollectAllFiles", filesCount, "f/s", [&]
+    {
+        files = Extractor::CollectAllFiles(spec);
+    });
+
+    // The extraction cache is disabled by X-Poedit-Flags-xgettext that don't
+    // change the output, so that every iteration extracts everything and the
+    // user's cache isn't filled with temporary projects. The native extractor
+    // doesn't support --msgid-bugs-address, which makes gettext handle the files.
+    const std::vector<std::pair<const char*, const char*>> pipelines =
+    {
+        { "ExtractWithAll (native)",  "-F" },
+        { "ExtractWithAll (gettext)", "-F --msgid-bugs-address=benchmark@example.com" }
+    };
+    for (auto& p: pipelines)
+    {
+        spec.XHeaders["X-Poedit-Flags-xgettext"] = p.second;
+        try
+        {
+            runner.Run(p.first, filesCount, "f/s", [&]
+            {
+                TempDirectory extractionDir;
+                if (Extractor::ExtractWithAll(extractionDir, spec, files).empty())
+                    throw ExtractionException(ExtractionError::Unspecified);
+            });
+        }
+        catch (const ExtractionException&)
+        {
+            wxPrintf("%-40s failed, see errors above\n", p.first);
+        }
+    }
+}
+
+
+/// Writes a translated catalog and a POT with some of its strings modified, removed or added
+void GenerateMergeCatalogs(int entries, int changedPercent, const wxString& poFile, const wxString& potFile)
+{
+    TextGenerator gen;
+    const std::string header =
+           "msgid \"\"\n"
+           "msgstr \"\"\n"
+           "\"Project-Id-Version: Poedit benchmark\\n\"\n"
+           "\"MIME-Version: 1.0\\n\"\n"
+           "\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+           "\"Content-Transfer-Encoding: 8bit\\n\"\n";
+    std::string po = header + "\"Language: cs\\n\"\n";
+    std::string pot = header;
+
+    auto addEntry = [&gen](std::string& out, const std::string& source, const std::string& translation)
+    {
+        out += "\n#: src/module" + std::to_string(gen.Number(200)) + ".cpp:" + std::to_string(gen.Number(3000) + 1) + "\n";
+        out += "msgid \"" + source + "\"\n";
+        out += "msgstr \"" + translation + "\"\n";
+    };
+
+    for (int i = 0; i < entries; i++)
+    {
+        const auto source = gen.Source(2, 12) + " " + std::to_string(i);
+        addEntry(po, source, gen.Translation(2, 12));
+
+        // the POT has roughly the same number of removed and new strings:
+        const int change = gen.Number(100);
+        if (change < changedPercent / 4)
+        {
+            // removed
+        }
+        else if (change < changedPercent / 2)
+        {
+            addEntry(pot, source, "");
+            addEntry(pot, gen.Source(2, 12) + " new " + std::to_string(i), "");
+        }
+        else if (change < changedPercent)
+        {
+            // modified, so that it matches fuzzily:
+            addEntry(pot, gen.Source(1, 2) + " " + source, "");
+        }
+        else
+        {
+            addEntry(pot, source, "");
+        }
+    }
+
+    WriteFile(poFile, po);
+    WriteFile(potFile, pot);
+}
+
+
+void BenchmarkMerge(const BenchmarkOptions& options)
+{
+    const int entries = options.Get("entries", 20000);
+    const int changedPercent = options.Get("changed", 10);
+    wxPrintf("catalogs: up to %d entries, %d%% changed in POT\n\n", entries, changedPercent);
+
+    TempDirectory tmpdir;
+    if (!tmpdir.IsOk())
+        throw Exception("Failed to create temporary directory.");
+
+    BenchmarkRunner runner(options.Get("iterations", 3));
+    const int iterations = options.Get("iterations", 3);
+
+    // to see how merging scales with the catalog's size:
+    for (int size: {entries / 4, entries / 2, entries})
+    {
+        auto poFile = tmpdir.CreateFileName("merge.po");
+        auto potFile = tmpdir.CreateFileName("merge.pot");
+        GenerateMergeCatalogs(size, changedPercent, poFile, potFile);
+
+        POCatalogPtr cat, pot;
+        auto load = [&]
+        {
+            cat = std::make_shared<POCatalog>(poFile);
+            pot = std::make_shared<POCatalog>(potFile, Catalog::CreationFlag_IgnoreHeader);
+            if (!cat->IsOk() || !pot->IsOk())
+                throw Exception("Failed to load generated catalogs.");
+        };
+
+        runner.Run(wxString::Format("POCatalog::UpdateFromPOT (%d)", size), iterations, size, "e/s",
+        [&]{
+            if (!cat->UpdateFromPOT(potFile))
+                throw Exception("Updating from POT failed.");
+        }, load);
+
+        runner.Run(wxString::Format("POCatalog::Merge (%d)", size), iterations, size, "e/s",
+        [&]{
+            if (!cat->Merge(pot, MergeConfirmation(), MergeProgress()))
+                throw Exception("Merging failed.");
+        }, load);
+    }
+}
+
+
+void BenchmarkDiff(const BenchmarkOptions& options)
+{
+    const int entries = options.Get("entries", 100000);
+    const int changedPercent = options.Get("changed", 10);
+    wxPrintf("catalogs: up to %d entries, %d%% changed\n\n", entries, changedPercent);
+
+    TempDirectory tmpdir;
+    if (!tmpdir.IsOk())
+        throw Exception("Failed to create temporary directory.");
+
+    BenchmarkRunner runner(options.Get("iterations", 3));
+
+    for (int size: {entries / 4, entries / 2, entries})
+    {
+        // the POT is only generated to get another version of the strings:
+        auto poFile = tmpdir.CreateFileName("diff.po");
+        auto potFile = tmpdir.CreateFileName("diff.pot");
+        GenerateMergeCatalogs(size, changedPercent, poFile, potFile);
+
+        auto oldCat = std::make_shared<POCatalog>(poFile);
+        auto newCat = std::make_shared<POCatalog>(poFile);
+        if (!oldCat->IsOk() || !newCat->IsOk())
+            throw Exception("Failed to load generated catalogs.");
+
+        TextGenerator gen;
+        for (auto& item: newCat->items())
+        {
+            if (gen.Chance(changedPercent))
+                item->SetTranslation(wxString::FromUTF8(gen.Translation(2, 12)));
+        }
+
+        size_t found = 0;
+        runner.Run(wxString::Format("CatalogDiff::Compute (%d)", size), size, "e/s",
+        [&]{
+            found = CatalogDiff::Compute(*oldCat, *newCat).entries().size();
+        });
+        if (!found && changedPercent > 0)
+            throw Exception("No differences found.");
+    }
+}
+
+
+/// Runs @a loop until @a done returns true; throws if it doesn't happen in time
+void ProcessEventsUntil(wxEventLoopBase& loop, const std::function<bool()>& done)
+{
+    typedef std::chrono::steady_clock Clock;
+    const auto timeout = Clock::now() + std::chrono::seconds(30);
+    for (;;)
+    {
+        loop.Yield();
+        wxTheApp->ProcessIdle();
+        if (done())
+            return;
+        if (Clock::now() > timeout)
+            throw Exception("Timed out waiting for the UI to finish updating.");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+
+/**
+    Replays scripted interactions with a real PoeditFrame showing a synthetic
+    catalog and reports latency percentiles of what the user would perceive:
+    the time from selecting an item until its suggestions are shown, from
+    scrolling the list until it's repainted and from a keystroke until the
+    (syntax highlighted) text is updated on screen.
+ */
+void BenchmarkUI(const BenchmarkOptions& options)
+{
+    CatalogSpec spec(options);
+    const int steps = options.Get("steps", 200);
+    const int tmEntries = options.Get("tm", 5000);
+    wxPrintf("catalog: %d entries, %d steps per interaction, %d TM entries\n", spec.entries, steps, tmEntries);
+    if (Config::UseMachineTranslation())
+        wxPrintf("note: machine translation is enabled, suggestions include network latency\n");
+    wxPrintf("\n");
+
+    TempDirectory tmpdir;
+    if (!tmpdir.IsOk())
+        throw Exception("Failed to create temporary directory.");
+
+    auto filename = tmpdir.CreateFileName("benchmark.po");
+    WriteFile(filename, GeneratePO(spec));
+
+    // don't touch the user's TM, fill a new one with the catalog's translations
+    // so that selected items have suggestions to show:
+    TranslationMemory::UseDatabaseDir(tmpdir.CreateFileName("TranslationMemory").ToStdWstring());
+    struct TMCloser { ~TMCloser() { TranslationMemory::CleanUp(); } } closeTM;
+    {
+        auto cat = Catalog::Create(filename);
+        if (!cat || !cat->IsOk())
+            throw Exception(wxString::Format("Failed to load %s.", filename));
+        auto writer = TranslationMemory::Get().GetWriter();
+        int count = 0;
+        for (auto& item: cat->items())
+        {
+            if (count >= tmEntries)
+                break;
+            if (!item->IsTranslated() || item->IsFuzzy() || item->HasPlural())
+                continue;
+            writer->Insert(cat->GetSourceLanguage(), cat->GetLanguage(),
+                           item->GetString().ToStdWstring(), item->GetTranslation().ToStdWstring());
+            count++;
+        }
+        writer->Commit();
+    }
+
+    wxGUIEventLoop loop;
+    wxEventLoopActivator activateLoop(&loop);
+
+    auto frame = PoeditFrame::Create(filename);
+    if (!frame)
+        throw Exception(wxString::Format("Failed to open %s.", filename));
+    // the frame is destroyed without saving, typed text is thrown away:
+    struct FrameDestroyer
+    {
+        FrameDestroyer(PoeditFrame *f, wxEventLoopBase& l) : frame(f), loop(l) {}
+        ~FrameDestroyer()
+        {
+            // let pending queries finish, they use the TM:
+            auto sidebar = frame->GetSidebar();
+            try
+            {
+                ProcessEventsUntil(loop, [=]{ return !sidebar || !sidebar->IsBusy(); });
+            }
+            catch (...) {}
+            frame->Destroy();
+            loop.Yield();
+            wxTheApp->ProcessIdle();
+        }
+        PoeditFrame *frame;
+        wxEventLoopBase& loop;
+    } destroyFrame(frame, loop);
+
+    auto list = frame->GetListCtrl();
+    auto sidebar = frame->GetSidebar();
+    if (!list)
+        throw Exception("The catalog isn't shown in a list.");
+    auto idle = [&]{ return !wxTheApp->HasPendingEvents() && (!sidebar || !sidebar->IsShown() || !sidebar->IsBusy()); };
+    ProcessEventsUntil(loop, idle);
+
+    BenchmarkRunner runner(1);
+    TextGenerator gen;
+    const int count = list->GetItemCount();
+
+    // mostly moving to the next item, as when translating, with occasional jumps:
+    int row = 0;
+    runner.RunLatency("select item -> suggestions shown", steps, [&](size_t)
+    {
+        row = gen.Chance(80) ? (row + 1) % count : gen.Number(count);
+        list->SelectAndFocus(row);
+        ProcessEventsUntil(loop, idle);
+    });
+
+    runner.RunLatency("scroll list -> repainted", steps, [&](size_t)
+    {
+        list->EnsureVisible(list->CatalogIndexToListItem(gen.Number(count)));
+        list->Update();
+    });
+
+    list->SelectAndFocus(0);
+    ProcessEventsUntil(loop, idle);
+    auto text = frame->GetEditingArea()->Ctrl_Translation();
+    text->SetFocus();
+    text->SetInsertionPointEnd();
+    const std::string keys = "abc %s \\n <b>x</b> %d ";
+    runner.RunLatency("keystroke -> translation repainted", steps, [&](size_t i)
+    {
+        text->WriteText(wxString(keys[i % keys.size()]));
+        ProcessEventsUntil(loop, []{ return !wxTheApp->HasPendingEvents(); });
+        text->Update();
+    });
+}
+
+
+typedef std::function<void(const BenchmarkOptions&)> BenchmarkSuite;
+
+const std::vector<std::pair<wxString, BenchmarkSuite>>& GetSuites()
+{
+    static const std::vector<std::pair<wxString, BenchmarkSuite>> s_suites =
+    {
+        { "catalog",    BenchmarkCatalogs },
+        { "tm",         BenchmarkTM },
+        { "extraction", BenchmarkExtraction },
+        { "merge",      BenchmarkMerge },
+        { "diff",       BenchmarkDiff },
+        { "ui",         BenchmarkUI },
+    };
+    return s_suites;
+}
+
+} // anonymous namespace
+
+
+int RunBenchmarks(const wxString& suite, const wxString& options)
+{
+    const BenchmarkOptions opts(options);
+
+    bool found = false;
+    for (auto& s: GetSuites())
+    {
+        if (suite != "all" && suite != s.first)
+            continue;
+        // opens windows, so it must be requested explicitly:
+        if (suite == "all" && s.first == "ui")
+            continue;
+        found = true;
+
+        wxPrintf("== %s\n", s.first);
+        try
+        {
+            s.second(opts);
+        }
+        catch (const Exception& e)
+        {
+            wxLogError("%s", e.What());
+            return 1;
+        }
+        catch (const std::exception& e)
+        {
+            wxLogError("%s", e.what());
+            return 1;
+        }
+        wxPrintf("\n");
+    }
+
+    if (!found)
+    {
+        wxString names;
+        for (auto& s: GetSuites())
+            names << " " << s.first;
+        wxLogError("Unknown benchmark suite \"%s\", available suites are:%s and all.", suite, names);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_benchmarks_h
+#define Poedit_benchmarks_h
+
+#include <wx/string.h>
+
+/**
+    Runs built-in performance benchmarks and prints results to stdout.
+
+    This is used by the --benchmark=<suite> command line option for evaluating
+    performance regressions between releases. Unless an option points to
+    existing data (e.g. "tmx=<file>" of the "tm" suite), all data the
+    benchmarks use are generated synthetically, in a temporary directory,
+    with a fixed seed so that results of different builds are comparable.
+    The user's own data, such as the translation memory, are never used.
+
+    The "ui" suite opens a window and replays scripted interactions in it; it
+    isn't included in "all".
+
+    @a suite is the name of the suite to run, or "all". @a options is a comma
+    separated list of "key=value" pairs that configure the suite's data set
+    (e.g. "entries=50000,plurals=20"); unknown keys are ignored.
+
+    Returns the process exit code.
+ */
+int RunBenchmarks(const wxString& suite, const wxString& options);
+
+#endif // Poedit_benchmarks_h
@@ -27,6 +27,7 @@
 #include "cat_sorting.h"
 
 #include <unicode/unistr.h>
+#include "concurrency.h"
 #include "str_helpers.h"
 
 #include <wx/config.h>
@@ -107,6 +108,64 @@ CatalogItemsComparator::CatalogItemsComparator(const Catalog& catalog, const Sor
     {
         // Case-insensitive comparison:
         m_collator->setStrength(icu::Collator::SECONDARY);
+        PrecomputeKeys();
+    }
+}
+
+
+namespace
+{
+
+inline wxString StripAccelerators(wxString s)
+{
+    s.Replace("&", "");
+    s.Replace("_", "");
+    return s;
+}
+
+std::string MakeCollationKey(const icu::Collator& collator, const wxString& text)
+{
+    const auto str = str::to_icu(StripAccelerators(text));
+
+    std::string key;
+    key.resize(str.length() * 2 + 16);
+    int32_t len = collator.getSortKey(str, reinterpret_cast<uint8_t*>(&key[0]), (int32_t)key.size());
+    if (len > (int32_t)key.size())
+    {
+        key.resize(len);
+        len = collator.getSortKey(str, reinterpret_cast<uint8_t*>(&key[0]), (int32_t)key.size());
+    }
+    // the key is zero-terminated, but it's harmless to keep the terminator in it:
+    key.resize(len);
+    return key;
+}
+
+} // anonymous namespace
+
+
+void CatalogItemsComparator::PrecomputeKeys()
+{
+    const size_t count = m_catalog.GetCount();
+    const auto& collator = *m_collator;  // const methods are thread-safe
+
+    dispatch::parallel_options options;
+    options.min_chunk_size = 256;
+
+    m_textKeys = dispatch::parallel_transform(0, count, [this,&collator](size_t i)
+    {
+        const CatalogItem& item = Item((int)i);
+        return MakeCollationKey(collator, m_order.by == SortOrder::By_Source
+                                          ? item.GetString()
+                                          : item.GetTranslation());
+    }, options);
+
+    if (m_order.groupByContext)
+    {
+        m_contextKeys = dispatch::parallel_transform(0, count, [this,&collator](size_t i)
+        {
+            const CatalogItem& item = Item((int)i);
+            return item.HasContext() ? MakeCollationKey(collator, item.GetContext()) : std::string();
+        }, options);
     }
 }
 
@@ -155,7 +214,9 @@ bool CatalogItemsComparator::operator()(int i, int j) const
             return false;
         else if ( a.HasContext() && b.HasContext() )
         {
-            int r = CompareStrings(a.GetContext(), b.GetContext());
+            int r = !m_contextKeys.empty()
+                    ? m_contextKeys[i].compare(m_contextKeys[j])
+                    : CompareStrings(a.GetContext(), b.GetContext());
             if ( r != 0 )
                 return r < 0;
         }
@@ -170,7 +231,9 @@ bool CatalogItemsComparator::operator()(int i, int j) const
 
         case SortOrder::By_Source:
         {
-            int r = CompareStrings(a.GetString(), b.GetString());
+            int r = !m_textKeys.empty()
+                    ? m_textKeys[i].compare(m_textKeys[j])
+                    : CompareStrings(a.GetString(), b.GetString());
             if ( r != 0 )
                 return r < 0;
             break;
@@ -178,7 +241,9 @@ bool CatalogItemsComparator::operator()(int i, int j) const
 
         case SortOrder::By_Translation:
         {
-            int r = CompareStrings(a.GetTranslation(), b.GetTranslation());
+            int r = !m_textKeys.empty()
+                    ? m_textKeys[i].compare(m_textKeys[j])
+                    : CompareStrings(a.GetTranslation(), b.GetTranslation());
             if ( r != 0 )
                 return r < 0;
             break;
@@ -194,11 +259,8 @@ bool CatalogItemsComparator::operator()(int i, int j) const
 
 int CatalogItemsComparator::CompareStrings(wxString a, wxString b) const
 {
-    a.Replace("&", "");
-    a.Replace("_", "");
-
-    b.Replace("&", "");
-    b.Replace("_", "");
+    a = StripAccelerators(a);
+    b = StripAccelerators(b);
 
     if (m_collator)
     {
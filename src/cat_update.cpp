@@ -25,18 +25,24 @@
 
 #include "cat_update.h"
 
+#include "concurrency.h"
+#include "configuration.h"
+#include "edapp.h"
 #include "extractors/extractor.h"
 #include "progressinfo.h"
 #include "utility.h"
 
-#include <wx/config.h>
 #include <wx/dialog.h>
 #include <wx/intl.h>
 #include <wx/listbox.h>
 #include <wx/log.h>
 #include <wx/stattext.h>
+#include <wx/time.h>
 #include <wx/xrc/xmlres.h>
 
+#include <algorithm>
+#include <map>
+
 
 namespace
 {
@@ -63,6 +69,7 @@ class MergeSummaryDialog : public wxDialog
 
 MergeSummaryDialog::MergeSummaryDialog(wxWindow *parent)
 {
+    wxGetApp().LoadXmlResources("summary.xrc");
     wxXmlResource::Get()->LoadDialog(this, parent, "summary");
 
     RestoreWindowState(this, wxDefaultSize, WinState_Size);
@@ -100,64 +107,22 @@ void MergeSummaryDialog::TransferTo(const wxArrayString& snew, const wxArrayStri
 }
 
 
-inline wxString ItemMergeSummary(const CatalogItemPtr& item)
-{
-    wxString s = item->GetString();
-    if ( item->HasPlural() )
-        s += "|" + item->GetPluralString();
-    if ( item->HasContext() )
-        s += wxString::Format(" [%s]", item->GetContext());
-
-    return s;
-}
-
-/** Returns list of strings that are new in reference catalog
-    (compared to this one) and that are not present in \a refcat
-    (i.e. are obsoleted).
-
-    \see ShowMergeSummary
- */
-void GetMergeSummary(CatalogPtr po, CatalogPtr refcat,
-                     wxArrayString& snew, wxArrayString& sobsolete)
-{
-    wxASSERT( snew.empty() );
-    wxASSERT( sobsolete.empty() );
-
-    std::set<wxString> strsThis, strsRef;
-
-    for (auto& i: po->items())
-        strsThis.insert(ItemMergeSummary(i));
-    for (auto& i: refcat->items())
-        strsRef.insert(ItemMergeSummary(i));
-
-    for (auto& i: strsThis)
-    {
-        if (strsRef.find(i) == strsRef.end())
-            sobsolete.Add(i);
-    }
-
-    for (auto& i: strsRef)
-    {
-        if (strsThis.find(i) == strsThis.end())
-            snew.Add(i);
-    }
-}
-
-/** Shows a dialog with merge summary.
-    \see GetMergeSummary, Merge
+/** Returns confirmation callback for merging that shows a dialog with
+    merge summary, if enabled in preferences (or nothing if not).
 
-    \return true if the merge was OK'ed by the user, false otherwise
+    The dialog returns true if the merge was OK'ed by the user.
  */
-bool ShowMergeSummary(wxWindow *parent, ProgressInfo *progress, CatalogPtr po, CatalogPtr refcat, bool *cancelledByUser)
+MergeConfirmation MergeSummaryConfirmation(wxWindow *parent, ProgressInfo *progress, bool *cancelledByUser)
 {
     if (cancelledByUser)
         *cancelledByUser = false;
-    if (wxConfig::Get()->ReadBool("show_summary", false))
+    if (!Config::Current()->showSummary)
+        return MergeConfirmation();
+
+    return [=](const MergeSummary& summary)
     {
-        wxArrayString snew, sobsolete;
-        GetMergeSummary(po, refcat, snew, sobsolete);
         MergeSummaryDialog sdlg(parent);
-        sdlg.TransferTo(snew, sobsolete);
+        sdlg.TransferTo(summary.newStrings, summary.obsoleteStrings);
 
         if (progress)
             progress->Hide();
@@ -168,9 +133,39 @@ bool ShowMergeSummary(wxWindow *parent, ProgressInfo *progress, CatalogPtr po, C
         if (cancelledByUser)
             *cancelledByUser = !ok;
         return ok;
+    };
+}
+
+
+/// Shows @a done out of @a total in the gauge, or indeterminate progress if the total isn't known
+void ShowProgress(ProgressInfo& progress, size_t done, size_t total)
+{
+    if (total)
+    {
+        progress.SetGaugeMax(int(total));
+        progress.ResetGauge(int(std::min(done, total)));
     }
     else
-        return true;
+    {
+        progress.PulseGauge();
+    }
+}
+
+
+UpdateResultReason ReasonFor(const ExtractionException& e)
+{
+    switch (e.error)
+    {
+        case ExtractionError::Unspecified:
+            return UpdateResultReason::Unspecified;
+        case ExtractionError::NoSourcesFound:
+            return UpdateResultReason::NoSourcesFound;
+        case ExtractionError::PermissionDenied:
+            return UpdateResultReason::PermissionDenied;
+        case ExtractionError::Cancelled:
+            return UpdateResultReason::CancelledByUser;
+    }
+    return UpdateResultReason::Unspecified;
 }
 
 } // anonymous namespace
@@ -179,7 +174,9 @@ bool ShowMergeSummary(wxWindow *parent, ProgressInfo *progress, CatalogPtr po, C
 bool PerformUpdateFromSources(wxWindow *parent,
                               POCatalogPtr catalog,
                               UpdateResultReason& reason,
-                              int flags)
+                              int flags,
+                              POCatalogPtr stagedPOT,
+                              const std::vector<wxString> *changedSourcesStaged)
 {
     const bool skipSummary = (flags & Update_DontShowSummary);
 
@@ -196,77 +193,177 @@ bool PerformUpdateFromSources(wxWindow *parent,
         return false;
     }
 
-    POCatalogPtr pot = nullptr;
-
-    progress.PulseGauge();
-    progress.UpdateMessage(_(L"Collecting source files…"));
-
-    try
+    // Sources are only extracted if there's no up to date POT already:
+    POCatalogPtr pot = stagedPOT;
+    Extractor::FilesList changedSourcesList;
+    const Extractor::FilesList *changedSources = changedSourcesStaged;
+    if (!pot)
     {
-        auto files = Extractor::CollectAllFiles(*spec);
-
         progress.PulseGauge();
-        progress.UpdateMessage(_(L"Extracting translatable strings…"));
+        progress.UpdateMessage(_(L"Collecting source files…"));
+
+        // Both stages run in the background and can be cancelled at any time,
+        // including terminating running xgettext processes:
+        auto monitor = std::make_shared<dispatch::progress_monitor>();
+        progress.Monitor(monitor);
 
-        if (!files.empty())
+        try
         {
-            TempDirectory tmpdir;
-            auto potFile = Extractor::ExtractWithAll(tmpdir, *spec, files);
-            if (!potFile.empty())
+            auto files = progress.RunInBackground([&spec, monitor]
+            {
+                return Extractor::CollectAllFiles(*spec, monitor.get());
+            });
+
+            progress.PulseGauge();
+            progress.UpdateMessage(_(L"Extracting translatable strings…"));
+
+            if (!files.empty())
             {
-                pot = std::make_shared<POCatalog>(potFile, Catalog::CreationFlag_IgnoreHeader);
-                if (!pot->IsOk())
+                TempDirectory tmpdir;
+                pot = progress.RunInBackground([&tmpdir, &spec, &files, monitor, &changedSourcesList]() -> POCatalogPtr
+                {
+                    auto potFile = Extractor::ExtractWithAll(tmpdir, *spec, files, monitor.get(), &changedSourcesList);
+                    if (potFile.empty())
+                        return nullptr;
+                    return std::make_shared<POCatalog>(potFile, Catalog::CreationFlag_IgnoreHeader);
+                });
+                if (pot)
                 {
-                    wxLogError(_("Failed to load extracted catalog."));
-                    reason = UpdateResultReason::Unspecified;
-                    pot.reset();
+                    if (!pot->IsOk())
+                    {
+                        wxLogError(_("Failed to load extracted catalog."));
+                        reason = UpdateResultReason::Unspecified;
+                        pot.reset();
+                    }
                 }
             }
+            else
+            {
+                reason = UpdateResultReason::NoSourcesFound;
+            }
+
+            if (progress.Cancelled())
+            {
+                reason = UpdateResultReason::CancelledByUser;
+                return false;
+            }
+
+            if (!pot)
+                return false;
+            changedSources = &changedSourcesList;
+            progress.Monitor(nullptr);
         }
-        else
+        catch (ExtractionException& e)
         {
-            reason = UpdateResultReason::NoSourcesFound;
+            reason = ReasonFor(e);
+            return false;
         }
+    }
+
+    progress.UpdateMessage(_(L"Merging differences…"));
+
+    // Merging runs here, because it may need to show the summary dialog;
+    // the progress is reported from the work done in parallel:
+    wxLongLong lastUpdate = 0;
+    auto mergeProgress = [&progress, &lastUpdate](size_t done, size_t total)
+    {
+        const wxLongLong now = wxGetLocalTimeMillis();
+        if (now - lastUpdate < 50)
+            return !progress.Cancelled();
+        lastUpdate = now;
+        ShowProgress(progress, done, total);
+        return progress.ProcessEvents();
+    };
+
+    bool cancelledByUser = false;
+    auto confirm = skipSummary ? MergeConfirmation() : MergeSummaryConfirmation(parent, &progress, &cancelledByUser);
+    bool succ = catalog->UpdateFromPOT(pot, /*replace_header=*/false, confirm, mergeProgress, changedSources);
+
+    if (cancelledByUser || progress.Cancelled())
+        reason = UpdateResultReason::CancelledByUser;
+
+    return succ;
+}
+
 
-        if (progress.Cancelled())
+std::vector<bool> PerformUpdateFromSourcesHeadless(const std::vector<POCatalogPtr>& catalogs,
+                                                   std::vector<UpdateResultReason>& reasons)
+{
+    std::vector<bool> updated(catalogs.size(), false);
+    reasons.assign(catalogs.size(), UpdateResultReason::Unspecified);
+
+    // group catalogs that can share extracted strings:
+    std::map<std::string, std::vector<size_t>> groups;
+    std::vector<std::shared_ptr<SourceCodeSpec>> specs(catalogs.size());
+    for (size_t i = 0; i < catalogs.size(); i++)
+    {
+        if (!catalogs[i]->IsOk())
+            continue;
+        specs[i] = catalogs[i]->GetSourceCodeSpec();
+        if (!specs[i])
         {
-            reason = UpdateResultReason::CancelledByUser;
-            return false;
+            reasons[i] = UpdateResultReason::NoSourcesFound;
+            continue;
         }
-
-        if (!pot)
-            return false;
+        groups[specs[i]->GetExtractionKey()].push_back(i);
     }
-    catch (ExtractionException& e)
+
+    for (auto& g: groups)
     {
-        switch (e.error)
+        auto& members = g.second;
+        auto& spec = *specs[members.front()];
+
+        POCatalogPtr pot;
+        Extractor::FilesList changedSources;
+        UpdateResultReason reason = UpdateResultReason::Unspecified;
+        try
         {
-            case ExtractionError::Unspecified:
-                reason = UpdateResultReason::Unspecified;
-                break;
-            case ExtractionError::NoSourcesFound:
+            auto files = Extractor::CollectAllFiles(spec);
+            if (files.empty())
+            {
                 reason = UpdateResultReason::NoSourcesFound;
-                break;
-            case ExtractionError::PermissionDenied:
-                reason = UpdateResultReason::PermissionDenied;
-                break;
+            }
+            else
+            {
+                TempDirectory tmpdir;
+                auto potFile = Extractor::ExtractWithAll(tmpdir, spec, files, nullptr, &changedSources);
+                if (!potFile.empty())
+                {
+                    pot = std::make_shared<POCatalog>(potFile, Catalog::CreationFlag_IgnoreHeader);
+                    if (!pot->IsOk())
+                    {
+                        wxLogError(_("Failed to load extracted catalog."));
+                        pot.reset();
+                    }
+                }
+            }
+        }
+        catch (ExtractionException& e)
+        {
+            reason = ReasonFor(e);
         }
-        return false;
-    }
 
-    progress.UpdateMessage(_(L"Merging differences…"));
+        if (!pot)
+        {
+            for (auto i: members)
+                reasons[i] = reason;
+            continue;
+        }
 
-    bool succ = false;
-    bool cancelledByUser = false;
-    if (skipSummary || ShowMergeSummary(parent, &progress, catalog, pot, &cancelledByUser))
-    {
-        succ = catalog->UpdateFromPOT(pot);
-    }
+        // Merging only reads the POT, so all catalogs can use it at once
+        // (the results are ints, because vector<bool> isn't thread-safe):
+        dispatch::parallel_options options;
+        options.chunk_size = 1;
+        auto results = dispatch::parallel_transform(0, members.size(), [&](size_t m)
+        {
+            return catalogs[members[m]]->UpdateFromPOT(pot, /*replace_header=*/false, MergeConfirmation(), MergeProgress(), &changedSources) ? 1 : 0;
+        }, options);
 
-    if (cancelledByUser)
-        reason = UpdateResultReason::CancelledByUser;
+        for (size_t m = 0; m < members.size(); m++)
+            updated[members[m]] = results[m] != 0;
+    }
 
-    return succ;
+    return updated;
 }
 
 
@@ -288,9 +385,9 @@ bool PerformUpdateFromPOT(wxWindow *parent,
     }
 
     bool cancelledByUser = false;
-    if (ShowMergeSummary(parent, nullptr, catalog, pot, &cancelledByUser))
+    if (catalog->UpdateFromPOT(pot, /*replace_header=*/false, MergeSummaryConfirmation(parent, nullptr, &cancelledByUser)))
     {
-        return catalog->UpdateFromPOT(pot);
+        return true;
     }
     else
     {
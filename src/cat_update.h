@@ -28,6 +28,8 @@
 
 #include "catalog_po.h"
 
+#include <vector>
+
 class WXDLLIMPEXP_FWD_CORE wxWindow;
 
 
@@ -48,11 +50,31 @@ enum UpdateFlags
 /**
     Update catalog from source code, if configured, and provide UI
     during the operation.
+
+    If @a stagedPOT is provided, it is used instead of extracting strings
+    from the sources again (see SourcesWatcher); @a changedSourcesStaged are
+    then the files changed since the last extraction, if known.
  */
 bool PerformUpdateFromSources(wxWindow *parent,
                               POCatalogPtr catalog,
                               UpdateResultReason& reason,
-                              int flags = 0);
+                              int flags = 0,
+                              POCatalogPtr stagedPOT = nullptr,
+                              const std::vector<wxString> *changedSourcesStaged = nullptr);
+
+/**
+    Updates all @a catalogs from source code without any UI, e.g. when run
+    from the command line.
+
+    Catalogs with the same source code configuration, typically translations
+    of one project, share a single extraction, and are then merged with its
+    result in parallel.
+
+    Returns whether each catalog was updated, in the same order; @a reasons
+    are set for those that weren't.
+ */
+std::vector<bool> PerformUpdateFromSourcesHeadless(const std::vector<POCatalogPtr>& catalogs,
+                                                   std::vector<UpdateResultReason>& reasons);
 
 /**
     Similarly for updating from a POT file.
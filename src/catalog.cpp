@@ -25,15 +25,20 @@
 
 #include "catalog.h"
 
+#include "catalog_mo.h"
 #include "catalog_po.h"
+#include "catalog_translation_index.h"
 #include "catalog_xliff.h"
 
+#include "concurrency.h"
 #include "configuration.h"
 #include "errors.h"
 #include "extractors/extractor.h"
+#include "format_placeholders.h"
 #include "gexecute.h"
 #include "qa_checks.h"
 #include "str_helpers.h"
+#include "tracing.h"
 #include "utility.h"
 #include "version.h"
 #include "language.h"
@@ -53,6 +58,12 @@
 
 #include <set>
 #include <algorithm>
+#include <climits>
+#include <mutex>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 
 // ----------------------------------------------------------------------
@@ -84,14 +95,26 @@ wxString FixBrokenSearchPathValue(wxString p)
 
 void Catalog::HeaderData::FromString(const wxString& str)
 {
-    wxStringTokenizer tkn(str, "\n");
-    wxString ln;
-
     m_entries.clear();
+    m_index.clear();
+    m_serializedValid = false;
 
-    while (tkn.HasMoreTokens())
+    size_t start = 0;
+    const size_t len = str.length();
+    while (start < len)
     {
-        ln = tkn.GetNextToken();
+        size_t end = str.find('\n', start);
+        if (end == wxString::npos)
+            end = len;
+        if (end == start)
+        {
+            start++;
+            continue; // empty lines are skipped, as with wxStringTokenizer
+        }
+
+        wxString ln(str, start, end - start);
+        start = end + 1;
+
         size_t pos = ln.find(_T(':'));
         if (pos == wxString::npos)
         {
@@ -103,9 +126,11 @@ void Catalog::HeaderData::FromString(const wxString& str)
             en.Key = wxString(ln.substr(0, pos)).Strip(wxString::both);
             en.Value = wxString(ln.substr(pos + 1)).Strip(wxString::both);
 
-            m_entries.push_back(en);
             wxLogTrace("poedit.header",
                        "%s='%s'", en.Key.c_str(), en.Value.c_str());
+            // later duplicates are kept, but lookups find the first one:
+            m_index.emplace(en.Key, m_entries.size());
+            m_entries.push_back(std::move(en));
         }
     }
 
@@ -116,11 +141,18 @@ wxString Catalog::HeaderData::ToString(const wxString& line_delim)
 {
     UpdateDict();
 
+    if (m_serializedValid && m_serializedDelim == line_delim)
+        return m_serialized;
+
     wxString hdr;
     for (auto& e: m_entries)
     {
         hdr << EscapeCString(e.Key) << ": " << EscapeCString(e.Value) << "\\n" << line_delim;
     }
+
+    m_serialized = hdr;
+    m_serializedDelim = line_delim;
+    m_serializedValid = true;
     return hdr;
 }
 
@@ -376,18 +408,23 @@ bool Catalog::HeaderData::HasHeader(const wxString& key) const
 
 void Catalog::HeaderData::SetHeader(const wxString& key, const wxString& value)
 {
-    Entry *e = (Entry*) Find(key);
-    if (e)
+    auto i = m_index.find(key);
+    if (i != m_index.end())
     {
-        e->Value = value;
+        auto& e = m_entries[i->second];
+        if (e.Value == value)
+            return;
+        e.Value = value;
     }
     else
     {
         Entry en;
         en.Key = key;
         en.Value = value;
-        m_entries.push_back(en);
+        m_index.emplace(key, m_entries.size());
+        m_entries.push_back(std::move(en));
     }
+    m_serializedValid = false;
 }
 
 void Catalog::HeaderData::SetHeaderNotEmpty(const wxString& key,
@@ -401,31 +438,28 @@ void Catalog::HeaderData::SetHeaderNotEmpty(const wxString& key,
 
 void Catalog::HeaderData::DeleteHeader(const wxString& key)
 {
-    if (HasHeader(key))
-    {
-        Entries enew;
-
-        for (Entries::const_iterator i = m_entries.begin();
-                i != m_entries.end(); i++)
-        {
-            if (i->Key != key)
-                enew.push_back(*i);
-        }
-
-        m_entries = enew;
-    }
+    if (!HasHeader(key))
+        return;
+
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+                                   [&key](const Entry& e){ return e.Key == key; }),
+                    m_entries.end());
+    RebuildIndex();
+    m_serializedValid = false;
 }
 
 const Catalog::HeaderData::Entry *
 Catalog::HeaderData::Find(const wxString& key) const
 {
-    size_t size = m_entries.size();
-    for (size_t i = 0; i < size; i++)
-    {
-        if (m_entries[i].Key == key)
-            return &(m_entries[i]);
-    }
-    return NULL;
+    auto i = m_index.find(key);
+    return i != m_index.end() ? &m_entries[i->second] : nullptr;
+}
+
+void Catalog::HeaderData::RebuildIndex()
+{
+    m_index.clear();
+    for (size_t i = 0; i < m_entries.size(); i++)
+        m_index.emplace(m_entries[i].Key, i);
 }
 
 
@@ -437,6 +471,8 @@ Catalog::Catalog(Type type)
 {
     m_sourceLanguage = Language::English();
     m_fileType = type;
+    m_itemsArena = std::make_shared<MemoryArena>();
+    m_statusIndex = std::make_shared<CatalogStatusIndex>();
 
     m_isOk = true;
     m_header.BasePath = wxEmptyString;
@@ -513,6 +549,50 @@ void Catalog::CreateNewHeader(const Catalog::HeaderData& pot_header)
 }
 
 
+namespace
+{
+
+// key identifying an entry, as used by gettext tools:
+inline std::string SourceKey(const CatalogItem& item)
+{
+    if (!item.HasContext())
+        return item.GetStringUTF8();
+    std::string key(item.GetContextUTF8());
+    key += '\x04';
+    key += item.GetStringUTF8();
+    return key;
+}
+
+} // anonymous namespace
+
+const Catalog::LookupIndexes& Catalog::GetLookupIndexes() const
+{
+    if (!m_lookupIndexes)
+    {
+        auto idx = std::make_shared<LookupIndexes>();
+        idx->lines.reserve(m_items.size());
+        idx->sources.reserve(m_items.size());
+
+        int maxLine = INT_MIN;
+        int index = 0;
+        for (auto& i: m_items)
+        {
+            maxLine = std::max(maxLine, i->GetLineNumber());
+            idx->lines.push_back(maxLine);
+
+            auto key = SourceKey(*i);
+            if (!idx->sources.emplace(std::move(key), index).second)
+                idx->hasDuplicates = true;
+            index++;
+        }
+
+        m_lookupIndexes = idx;
+    }
+
+    return *m_lookupIndexes;
+}
+
+
 CatalogItemPtr Catalog::FindItemByLine(int lineno)
 {
     int i = FindItemIndexByLine(lineno);
@@ -521,16 +601,93 @@ CatalogItemPtr Catalog::FindItemByLine(int lineno)
 
 int Catalog::FindItemIndexByLine(int lineno)
 {
-    int last = -1;
+    // the item preceding the first one that starts after the line:
+    auto& lines = GetLookupIndexes().lines;
+    auto after = std::upper_bound(lines.begin(), lines.end(), lineno);
+    return int(after - lines.begin()) - 1;
+}
 
-    for (auto& i: m_items)
+int Catalog::FindItemIndexBySource(const CatalogItem& item) const
+{
+    auto& sources = GetLookupIndexes().sources;
+    auto i = sources.find(SourceKey(item));
+    return i == sources.end() ? -1 : i->second;
+}
+
+wxString Catalog::GetReferenceFile(const wxString& ref)
+{
+    // strip the line number, if any, and normalize the path the way
+    // xgettext writes it, so that the same file is always the same key:
+    wxString file(ref);
+    auto colon = file.find_last_of(':');
+    if (colon != wxString::npos && colon + 1 < file.length() &&
+        file.find_first_not_of(wxS("0123456789"), colon + 1) == wxString::npos)
     {
-        if (i->GetLineNumber() > lineno)
-            return last;
-        last++;
+        file.erase(colon);
+    }
+    file.Replace(wxS("\\"), wxS("/"));
+    while (file.StartsWith(wxS("./")))
+        file.erase(0, 2);
+    return file;
+}
+
+const Catalog::ReferencesIndex& Catalog::GetReferencesIndex() const
+{
+    if (!m_referencesIndex)
+    {
+        TRACE_SCOPE("Catalog::GetReferencesIndex");
+
+        auto idx = std::make_shared<ReferencesIndex>();
+        int index = 0;
+        for (auto& i: m_items)
+        {
+            for (auto& ref: i->GetReferences())
+            {
+                auto& items = (*idx)[GetReferenceFile(ref).ToStdWstring()];
+                // an item may reference the same file many times:
+                if (items.empty() || items.back() != index)
+                    items.push_back(index);
+            }
+            index++;
+        }
+
+        m_referencesIndex = idx;
     }
 
-    return last;
+    return *m_referencesIndex;
+}
+
+const std::vector<int>& Catalog::FindItemsReferencingFile(const wxString& file) const
+{
+    static const std::vector<int> s_none;
+    auto& refs = GetReferencesIndex();
+    auto i = refs.find(GetReferenceFile(file).ToStdWstring());
+    return i == refs.end() ? s_none : i->second;
+}
+
+std::vector<wxString> Catalog::GetReferencedFiles() const
+{
+    auto& refs = GetReferencesIndex();
+    std::vector<wxString> files;
+    files.reserve(refs.size());
+    for (auto& r: refs)
+        files.emplace_back(r.first);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::shared_ptr<CatalogTranslationIndex> Catalog::GetTranslationIndex()
+{
+    if (!m_translationIndex)
+        m_translationIndex = std::make_shared<CatalogTranslationIndex>(*this);
+    return m_translationIndex;
+}
+
+void Catalog::ItemTranslationChanged(const CatalogItem& item)
+{
+    // nothing to update if the index wasn't needed yet:
+    if (m_translationIndex)
+        m_translationIndex->ItemChanged(item);
 }
 
 int Catalog::SetBookmark(int id, Bookmark bookmark)
@@ -575,6 +732,15 @@ wxString MaskForType(Catalog::Type t)
 
 } // anonymous namespace
 
+std::string Catalog::SaveToBuffer()
+{
+    std::string out;
+    if (!WriteToBuffer(out))
+        return std::string();
+    return out;
+}
+
+
 wxString Catalog::GetTypesFileMask(std::initializer_list<Type> types)
 {
     if (types.size() == 0)
@@ -592,9 +758,11 @@ wxString Catalog::GetTypesFileMask(std::initializer_list<Type> types)
 
 wxString Catalog::GetAllTypesFileMask()
 {
-    return MaskForType("*.po;*.pot;*.xlf;*.xliff", _("All Translation Files"), /*showExt=*/false) +
+    return MaskForType("*.po;*.pot;*.xlf;*.xliff;*.mo", _("All Translation Files"), /*showExt=*/false) +
+           "|" +
+           GetTypesFileMask({Type::PO, Type::POT, Type::XLIFF}) +
            "|" +
-           GetTypesFileMask({Type::PO, Type::POT, Type::XLIFF});
+           MaskForType("*.mo", _("MO Compiled Translations"));
 }
 
 
@@ -814,41 +982,188 @@ void Catalog::SetLanguage(Language lang)
 void Catalog::GetStatistics(int *all, int *fuzzy, int *badtokens,
                             int *untranslated, int *unfinished)
 {
-    if (all) *all = 0;
-    if (fuzzy) *fuzzy = 0;
-    if (badtokens) *badtokens = 0;
-    if (untranslated) *untranslated = 0;
-    if (unfinished) *unfinished = 0;
+    typedef CatalogStatusIndex S;
+    auto& index = *m_statusIndex;
+
+    if (all)
+        *all = index.Count([](unsigned){ return true; });
+    if (fuzzy)
+        *fuzzy = index.Count([](unsigned s){ return (s & S::Fuzzy) != 0; });
+    if (badtokens)
+        *badtokens = index.Count([](unsigned s){ return (s & S::Error) != 0; });
+    if (untranslated)
+        *untranslated = index.Count([](unsigned s){ return (s & S::Translated) == 0; });
+    if (unfinished)
+        *unfinished = index.Count([](unsigned s){ return (s & (S::Fuzzy | S::Error)) || !(s & S::Translated); });
+}
+
 
+Catalog::TextStatistics Catalog::GetTextStatistics() const
+{
+    TextStatistics stats;
+    const auto srclang = GetSourceLanguage();
     for (auto& i: m_items)
     {
-        bool ok = true;
+        const auto counts = i->GetSourceTextCounts(srclang);
+        const bool fuzzy = i->IsFuzzy();
+        const bool untranslated = !i->IsTranslated();
+        stats.all += counts;
+        if (fuzzy)
+            stats.fuzzy += counts;
+        if (untranslated)
+            stats.untranslated += counts;
+        if (fuzzy || untranslated || i->HasError())
+            stats.unfinished += counts;
+    }
+    return stats;
+}
+
+
+void Catalog::PrecomputeTextCounts() const
+{
+    TRACE_SCOPE("Catalog::PrecomputeTextCounts");
 
-        if (all)
-            (*all)++;
+    const auto srclang = GetSourceLanguage();
+    auto& items = m_items;
 
-        if (i->IsFuzzy())
+    dispatch::parallel_options options;
+    options.min_chunk_size = 256;
+    options.prio = dispatch::priority::bulk;
+    dispatch::parallel_for(0, items.size(), [&items,&srclang](size_t i)
+    {
+        items[i]->GetSourceTextCounts(srclang);
+    }, options);
+}
+
+
+bool Catalog::HasItemsNeedingAttention() const
+{
+    typedef CatalogStatusIndex S;
+    return m_statusIndex->Count([](unsigned s){ return (s & (S::Fuzzy | S::Issue)) || !(s & S::Translated); }) > 0;
+}
+
+
+namespace
+{
+
+inline int LowestBitIndex(uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+} // anonymous namespace
+
+
+std::shared_ptr<const CatalogStatusBitmaps> Catalog::GetStatusBitmaps() const
+{
+    const unsigned generation = m_statusIndex->GetGeneration();
+
+    auto bitmaps = std::atomic_load(&m_statusBitmaps);
+    if (bitmaps && bitmaps->GetGeneration() == generation && bitmaps->GetCount() == m_items.size())
+        return bitmaps;
+
+    auto fresh = std::make_shared<CatalogStatusBitmaps>(m_items.size(), generation);
+    size_t index = 0;
+    for (auto& i: m_items)
+        fresh->Set(index++, i->GetStatus());
+
+    std::atomic_store(&m_statusBitmaps, std::shared_ptr<const CatalogStatusBitmaps>(fresh));
+    return fresh;
+}
+
+
+CatalogMemoryUsage Catalog::GetMemoryUsage() const
+{
+    CatalogMemoryUsage usage;
+    usage.items += m_items.capacity() * sizeof(CatalogItemPtr);
+    for (auto& i: m_items)
+        i->AddMemoryUsage(usage);
+
+    if (m_lookupIndexes)
+    {
+        auto& idx = *m_lookupIndexes;
+        usage.indexes += sizeof(LookupIndexes) + idx.lines.capacity() * sizeof(int) +
+                         idx.sources.bucket_count() * sizeof(void*);
+        for (auto& s: idx.sources)
         {
-            if (fuzzy)
-                (*fuzzy)++;
-            ok = false;
+            // a hash node with the key, value, cached hash and next pointer:
+            usage.indexes += sizeof(s) + 2 * sizeof(void*) + s.first.capacity() + 1;
         }
-        if (i->HasError())
+    }
+
+    if (m_referencesIndex)
+    {
+        auto& idx = *m_referencesIndex;
+        usage.indexes += sizeof(ReferencesIndex) + idx.bucket_count() * sizeof(void*);
+        for (auto& r: idx)
+            usage.indexes += sizeof(r) + 2 * sizeof(void*) + (r.first.capacity() + 1) * sizeof(wchar_t) + r.second.capacity() * sizeof(int);
+    }
+
+    auto bitmaps = std::atomic_load(&m_statusBitmaps);
+    if (bitmaps)
+        usage.indexes += bitmaps->GetMemoryUsage();
+
+    return usage;
+}
+
+
+CatalogStatusBitmaps::CatalogStatusBitmaps(size_t count, unsigned generation)
+    : m_count(count), m_generation(generation)
+{
+    const size_t words = (count + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    for (auto& b: m_bits)
+        b.resize(words, 0);
+}
+
+
+std::vector<int> CatalogStatusBitmaps::Select(unsigned anyOf, unsigned anyNotOf) const
+{
+    std::vector<int> selected;
+    const size_t words = m_bits[0].size();
+    if (!words)
+        return selected;
+
+    // bits past the last item are garbage after negation, mask them out:
+    const unsigned tail = m_count % BITS_PER_WORD;
+    const Word lastMask = tail ? (Word(1) << tail) - 1 : ~Word(0);
+
+    for (size_t w = 0; w < words; w++)
+    {
+        Word match = 0;
+        for (unsigned flag = 0; flag < FLAGS_COUNT; flag++)
         {
-            if (badtokens)
-                (*badtokens)++;
-            ok = false;
+            if (anyOf & (1 << flag))
+                match |= m_bits[flag][w];
+            if (anyNotOf & (1 << flag))
+                match |= ~m_bits[flag][w];
         }
-        if (!i->IsTranslated())
+        if (w == words - 1)
+            match &= lastMask;
+
+        const int base = int(w * BITS_PER_WORD);
+        while (match)
         {
-            if (untranslated)
-                (*untranslated)++;
-            ok = false;
+            selected.push_back(base + LowestBitIndex(match));
+            match &= match - 1;
         }
-
-        if ( !ok && unfinished )
-            (*unfinished)++;
     }
+
+    return selected;
+}
+
+
+void Catalog::RebuildStatusIndex()
+{
+    m_statusIndex = std::make_shared<CatalogStatusIndex>();
+    for (auto& i: m_items)
+        i->AttachToStatusIndex(m_statusIndex);
+    InvalidateLookupIndexes();
 }
 
 
@@ -856,17 +1171,22 @@ void CatalogItem::SetFlags(const wxString& flags)
 {
     static const wxString flag_fuzzy(wxS(", fuzzy"));
 
-    m_moreFlags = flags;
-
     if (flags.find(flag_fuzzy) != wxString::npos)
     {
         m_isFuzzy = true;
-        m_moreFlags.Replace(flag_fuzzy, wxString());
+        wxString moreFlags(flags);
+        moreFlags.Replace(flag_fuzzy, wxString());
+        m_moreFlags = moreFlags;
     }
     else
     {
         m_isFuzzy = false;
+        m_moreFlags = flags;
     }
+
+    InvalidateSourcePlaceholders(); // format may have changed
+    UpdateStatus();
+    Touch();
 }
 
 
@@ -878,7 +1198,7 @@ wxString CatalogItem::GetFlags() const
         if (m_moreFlags.empty())
             return flag_fuzzy;
         else
-            return flag_fuzzy + m_moreFlags;
+            return flag_fuzzy + m_moreFlags.get();
     }
     else
     {
@@ -888,24 +1208,76 @@ wxString CatalogItem::GetFlags() const
 
 wxString CatalogItem::GetFormatFlag() const
 {
-    auto pos = m_moreFlags.find(wxS("-format"));
+    const wxString& moreFlags = m_moreFlags;
+    auto pos = moreFlags.find(wxS("-format"));
     if (pos == wxString::npos)
         return wxString();
-    auto space = m_moreFlags.find_last_of(" \t", pos);
+    auto space = moreFlags.find_last_of(" \t", pos);
     auto format = (space == wxString::npos)
-                    ? m_moreFlags.substr(0, pos)
-                    : m_moreFlags.substr(space+1, pos-space-1);
+                    ? moreFlags.substr(0, pos)
+                    : moreFlags.substr(space+1, pos-space-1);
     if (format.StartsWith("no-"))
         return wxString();
     return format;
 }
 
+std::shared_ptr<const SourcePlaceholders> CatalogItem::GetSourcePlaceholders() const
+{
+    auto cached = std::atomic_load(&m_sourcePlaceholders);
+    if (cached)
+        return cached;
+
+    // may be computed concurrently on several threads, but the result is
+    // always the same, so it doesn't matter which one is stored
+    auto p = std::make_shared<SourcePlaceholders>();
+    p->syntaxes = GetPlaceholderSyntaxes(GetFormatFlag());
+    const wxString source = m_string.str();
+    ExtractPlaceholders(source, p->syntaxes, p->singular);
+    if (m_hasPlural)
+        ExtractPlaceholders(m_plural.str(), p->syntaxes, p->plural);
+
+    const auto buf = source.wc_str();
+    const wchar_t *str = buf;
+    for (unsigned syntax: {Placeholders_C, Placeholders_PHP, Placeholders_Common})
+    {
+        if (!(p->syntaxes & syntax))
+            continue;
+        size_t pos, length;
+        PlaceholderTokenizer tokenizer(syntax, str, str + wxWcslen(str));
+        if (tokenizer.Next(pos, length))
+            p->found |= syntax;
+    }
+
+    std::atomic_store(&m_sourcePlaceholders, std::shared_ptr<const SourcePlaceholders>(p));
+    return p;
+}
+
+void CatalogItem::AddMemoryUsage(CatalogMemoryUsage& usage) const
+{
+    // flags and status are stored in the object, but its shared_ptr's
+    // control block is allocated with it too:
+    usage.items += sizeof(CatalogItem) + 2 * sizeof(long);
+
+    usage.strings += CatalogMemoryUsage::Of(m_string) +
+                     CatalogMemoryUsage::Of(m_plural) +
+                     CatalogMemoryUsage::Of(m_context);
+    usage.translations += CatalogMemoryUsage::Of(m_translations);
+    usage.comments += CatalogMemoryUsage::Of(m_comment) +
+                      CatalogMemoryUsage::Of(m_extractedComments) +
+                      CatalogMemoryUsage::Of(m_oldMsgid) +
+                      CatalogMemoryUsage::Of(m_moreFlags);
+}
+
+
 void CatalogItem::SetFuzzy(bool fuzzy)
 {
+    EnsureMetadataLoaded();
     if (!fuzzy && m_isFuzzy)
         m_oldMsgid.clear();
     m_isFuzzy = fuzzy;
 
+    UpdateStatus();
+    Touch();
     UpdateInternalRepresentation();
 }
 
@@ -919,14 +1291,14 @@ wxString CatalogItem::GetTranslation(unsigned idx) const
 
 void CatalogItem::SetTranslation(const wxString &t, unsigned idx)
 {
-    while (idx >= m_translations.GetCount())
-        m_translations.Add(wxEmptyString);
+    if (idx >= m_translations.size())
+        m_translations.resize(idx + 1);
     m_translations[idx] = t;
 
     ClearIssue();
 
     m_isTranslated = true;
-    for (size_t i = 0; i < m_translations.GetCount(); i++)
+    for (size_t i = 0; i < m_translations.size(); i++)
     {
         if (m_translations[i].empty())
         {
@@ -935,17 +1307,19 @@ void CatalogItem::SetTranslation(const wxString &t, unsigned idx)
         }
     }
 
+    UpdateStatus();
+    Touch();
     UpdateInternalRepresentation();
 }
 
-void CatalogItem::SetTranslations(const wxArrayString &t)
+void CatalogItem::SetTranslations(SmallStringArray t)
 {
-    m_translations = t;
+    m_translations = std::move(t);
 
     ClearIssue();
 
     m_isTranslated = true;
-    for (size_t i = 0; i < m_translations.GetCount(); i++)
+    for (size_t i = 0; i < m_translations.size(); i++)
     {
         if (m_translations[i].empty())
         {
@@ -954,6 +1328,8 @@ void CatalogItem::SetTranslations(const wxArrayString &t)
         }
     }
 
+    UpdateStatus();
+    Touch();
     UpdateInternalRepresentation();
 }
 
@@ -964,26 +1340,30 @@ void CatalogItem::SetTranslationFromSource()
     m_isPreTranslated = false;
     m_isTranslated = true;
 
+    const wxString source = m_string.str();
     auto iter = m_translations.begin();
-    if (*iter != m_string)
+    if (*iter != source)
     {
-        *iter = m_string;
+        *iter = source;
         m_isModified = true;
     }
 
     if (m_hasPlural)
     {
+        const wxString plural = m_plural.str();
         ++iter;
         for ( ; iter != m_translations.end(); ++iter )
         {
-            if (*iter != m_plural)
+            if (*iter != plural)
             {
-                *iter = m_plural;
+                *iter = plural;
                 m_isModified = true;
             }
         }
     }
 
+    UpdateStatus();
+    Touch();
     UpdateInternalRepresentation();
 }
 
@@ -999,9 +1379,32 @@ void CatalogItem::ClearTranslation()
         t.clear();
     }
 
+    UpdateStatus();
+    Touch();
     UpdateInternalRepresentation();
 }
 
+TextCounts CatalogItem::GetSourceTextCounts(const Language& srclang) const
+{
+    const uint64_t version = m_version;
+    if (m_textCounts.version.load(std::memory_order_acquire) == version)
+    {
+        const uint64_t packed = m_textCounts.packed.load(std::memory_order_relaxed);
+        TextCounts counts;
+        counts.words = uint32_t(packed >> 32);
+        counts.chars = uint32_t(packed);
+        return counts;
+    }
+
+    auto counts = CountText(srclang, m_string.utf8());
+    if (m_hasPlural)
+        counts += CountText(srclang, m_plural.utf8());
+
+    m_textCounts.packed.store((uint64_t(counts.words) << 32) | counts.chars, std::memory_order_relaxed);
+    m_textCounts.version.store(version, std::memory_order_release);
+    return counts;
+}
+
 unsigned CatalogItem::GetPluralFormsCount() const
 {
     unsigned trans = GetNumberOfTranslations();
@@ -1011,10 +1414,46 @@ unsigned CatalogItem::GetPluralFormsCount() const
     return trans - 1;
 }
 
+uint64_t NextCatalogVersion()
+{
+    static std::atomic<uint64_t> s_counter(0);
+    return ++s_counter;
+}
+
+std::shared_ptr<CatalogItem::Issue> CatalogItem::Issue::Shared(Severity s, const wchar_t *text)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<Severity, const wchar_t*>, std::shared_ptr<Issue>> issues;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& issue = issues[std::make_pair(s, text)];
+    if (!issue)
+        issue = std::make_shared<Issue>(s, text);
+    return issue;
+}
+
+wxString CatalogItem::Issue::GetMessage() const
+{
+    if (!m_text)
+        return m_message;
+
+    const wxString text = wxGetTranslation(m_text);
+    switch (m_args.size())
+    {
+        case 0:
+            return text;
+        case 1:
+            return wxString::Format(text, m_args[0]);
+        default:
+            wxASSERT( m_args.size() == 2 );
+            return wxString::Format(text, m_args[0], m_args[1]);
+    }
+}
+
 wxString CatalogItem::GetOldMsgid() const
 {
     wxString s;
-    for (auto line: m_oldMsgid)
+    for (auto line: GetOldMsgidRaw())
     {
         if (line.length() < 2)
             continue;
@@ -1066,6 +1505,10 @@ CatalogPtr Catalog::Create(const wxString& filename, int flags)
     {
         cat = XLIFFCatalog::Open(filename);
     }
+    else if (MOCatalog::CanLoadFile(ext))
+    {
+        cat = std::make_shared<MOCatalog>(filename);
+    }
 
     if (!cat)
         throw Exception(wxString::Format(_(L"File “%s” is in unsupported format."), filename));
@@ -1082,5 +1525,6 @@ CatalogPtr Catalog::Create(const wxString& filename, int flags)
 bool Catalog::CanLoadFile(const wxString& extension)
 {
     return POCatalog::CanLoadFile(extension) ||
-           XLIFFCatalog::CanLoadFile(extension);
+           XLIFFCatalog::CanLoadFile(extension) ||
+           MOCatalog::CanLoadFile(extension);
 }
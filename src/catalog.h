@@ -26,20 +26,32 @@
 #ifndef Poedit_catalog_h
 #define Poedit_catalog_h
 
+#include "compact_string.h"
 #include "language.h"
+#include "memory_arena.h"
+#include "small_string_array.h"
+#include "string_pool.h"
+#include "word_count.h"
 
 #include <wx/encconv.h>
 #include <wx/arrstr.h>
+#include <wx/hashmap.h>
 #include <wx/textfile.h>
 
+#include <atomic>
+#include <cstdint>
 #include <initializer_list>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 class CloudSyncDestination;
+class CatalogTranslationIndex;
 struct SourceCodeSpec;
+struct SourcePlaceholders;
 
 class Catalog;
 class CatalogItem;
@@ -65,6 +77,194 @@ typedef enum
 } Bookmark;
 
 
+/**
+    Counts of a catalog's items in every combination of their states.
+
+    Items report changes in their status as they happen, so that statistics
+    can be obtained without iterating over the whole catalog. Updates are
+    atomic, because items may be modified from background threads (e.g.
+    when validating them).
+ */
+/**
+    Returns a new value of the process-wide, monotonically increasing counter
+    used for CatalogItem::GetVersion() and Catalog::GetEpoch().
+
+    Values are unique across all catalogs and items, so that a cached value
+    is never mistaken for current one after an item was replaced by another.
+ */
+uint64_t NextCatalogVersion();
+
+
+class CatalogStatusIndex
+{
+public:
+    /// Bits of an item's status
+    enum Flags
+    {
+        Translated    = 0x01,
+        Fuzzy         = 0x02,
+        Error         = 0x04,
+        Issue         = 0x08,  // error or warning
+        PreTranslated = 0x10,
+        Modified      = 0x20
+    };
+    static const unsigned STATES_COUNT = 0x40;
+
+    CatalogStatusIndex() : m_generation(0), m_epoch(NextCatalogVersion())
+    {
+        for (auto& c: m_counts)
+            c = 0;
+    }
+    CatalogStatusIndex(const CatalogStatusIndex&) = delete;
+    CatalogStatusIndex& operator=(const CatalogStatusIndex&) = delete;
+
+    void Add(unsigned status) { ++m_counts[status]; ++m_generation; }
+    void Remove(unsigned status) { --m_counts[status]; ++m_generation; }
+
+    /// Changes whenever any item's status changes
+    unsigned GetGeneration() const { return m_generation; }
+
+    /// Highest version of any change to the counted items, see Catalog::GetEpoch()
+    uint64_t GetEpoch() const { return m_epoch.load(std::memory_order_acquire); }
+
+    /// Records change with @a version (keeps the epoch monotonic)
+    void Touch(uint64_t version)
+    {
+        auto epoch = m_epoch.load(std::memory_order_relaxed);
+        while (epoch < version && !m_epoch.compare_exchange_weak(epoch, version, std::memory_order_acq_rel))
+        {}
+    }
+
+    /// Returns number of items for whose status @a pred returns true
+    template<typename Pred>
+    int Count(Pred pred) const
+    {
+        int total = 0;
+        for (unsigned status = 0; status < STATES_COUNT; status++)
+        {
+            if (pred(status))
+                total += m_counts[status];
+        }
+        return total;
+    }
+
+private:
+    std::atomic<int> m_counts[STATES_COUNT];
+    std::atomic<unsigned> m_generation;
+    std::atomic<uint64_t> m_epoch;
+};
+
+
+/**
+    Items' status flags as bitmaps, with one bit per item in catalog order.
+
+    Allows computing the set of items in some state (e.g. for filtering the
+    list) with bitwise operations over whole words, instead of examining
+    every item.
+ */
+class CatalogStatusBitmaps
+{
+public:
+    typedef uint64_t Word;
+    static const unsigned BITS_PER_WORD = 64;
+    static const unsigned FLAGS_COUNT = 6;
+
+    CatalogStatusBitmaps(size_t count, unsigned generation);
+
+    size_t GetCount() const { return m_count; }
+    unsigned GetGeneration() const { return m_generation; }
+
+    /// Records status of the item at @a index; only used when building
+    void Set(size_t index, unsigned status)
+    {
+        const Word bit = Word(1) << (index % BITS_PER_WORD);
+        for (unsigned flag = 0; flag < FLAGS_COUNT; flag++)
+        {
+            if (status & (1 << flag))
+                m_bits[flag][index / BITS_PER_WORD] |= bit;
+        }
+    }
+
+    /**
+        Returns indexes of items, in ascending order, that have any of the
+        @a anyOf flags set or any of @a anyNotOf flags unset.
+
+        For example, unfinished items are Select(Fuzzy | Error, Translated).
+     */
+    std::vector<int> Select(unsigned anyOf, unsigned anyNotOf) const;
+
+    /// Returns approximate memory used by the bitmaps
+    size_t GetMemoryUsage() const
+        { return sizeof(*this) + FLAGS_COUNT * m_bits[0].capacity() * sizeof(Word); }
+
+private:
+    size_t m_count;
+    unsigned m_generation;
+    std::vector<Word> m_bits[FLAGS_COUNT];
+};
+
+
+/**
+    Approximate memory used by a catalog, in bytes, by kind of data.
+
+    Item objects themselves are counted in @a items, the other categories
+    only count data allocated separately (e.g. strings' content). Values
+    shared by several items are split among them.
+ */
+struct CatalogMemoryUsage
+{
+    size_t items = 0;         ///< Item objects and the list of them
+    size_t strings = 0;       ///< Source texts, plurals and contexts
+    size_t translations = 0;
+    size_t references = 0;
+    size_t comments = 0;      ///< Translator's and extracted comments, flags and old msgids
+    size_t document = 0;      ///< Format specific data, e.g. XLIFF DOM or PO file's content
+    size_t deletedItems = 0;
+    size_t indexes = 0;       ///< Lookup indexes and status bitmaps
+
+    size_t Total() const
+    {
+        return items + strings + translations + references + comments + document + deletedItems + indexes;
+    }
+
+    /// Heap memory used by content of the string
+    static size_t Of(const wxString& s)
+    {
+        return s.empty() ? 0 : (s.length() + 1) * sizeof(wxStringCharType);
+    }
+
+    static size_t Of(const CompactString& s)
+    {
+        return s.heap_size();
+    }
+
+    /// Heap memory used by the array, including its strings' content
+    static size_t Of(const wxArrayString& a)
+    {
+        size_t size = a.size() * sizeof(wxString);
+        for (auto& s: a)
+            size += Of(s);
+        return size;
+    }
+
+    static size_t Of(const SmallStringArray& a)
+    {
+        size_t size = a.heap_size();
+        for (auto& s: a)
+            size += Of(s);
+        return size;
+    }
+
+    /// Share of the interned value's memory attributable to one of its holders
+    template<typename T>
+    static size_t Of(const Interned<T>& value)
+    {
+        const long holders = value.use_count();
+        return holders ? (sizeof(T) + Of(value.get())) / holders : 0;
+    }
+};
+
+
 /** This class holds information about one particular string.
     This includes source string and its occurrences in source code
     (so-called references), translation and translation's status
@@ -78,18 +278,20 @@ class CatalogItem
         /// Ctor. Initializes the object with source string and translation.
         CatalogItem()
                 : m_id(0),
+                  m_lineNum(0),
+                  m_bookmark(NO_BOOKMARK),
                   m_hasPlural(false),
                   m_hasContext(false),
                   m_isFuzzy(false),
                   m_isTranslated(false),
                   m_isModified(false),
                   m_isPreTranslated(false),
-                  m_lineNum(0),
-                  m_bookmark(NO_BOOKMARK) {}
+                  m_version(NextCatalogVersion()) {}
 
-        CatalogItem(const CatalogItem&) = delete;
+        // only for subclasses, to create independent copies of items:
+        CatalogItem(const CatalogItem&) = default;
 
-        virtual ~CatalogItem() {}
+        virtual ~CatalogItem() { DetachFromStatusIndex(); }
 
     public:
         // -------------------------------------------------------------------
@@ -100,20 +302,40 @@ class CatalogItem
         int GetId() const { return m_id; }
 
         /// Returns the source string.
-        const wxString& GetString() const { return m_string; }
+        wxString GetString() const { return m_string.str(); }
+        /// Returns the source string as UTF-8, without any conversion.
+        const std::string& GetStringUTF8() const { return m_string.utf8(); }
 
         /// Does this entry have a msgid_plural?
         bool HasPlural() const { return m_hasPlural; }
 
         /// Returns the plural string.
-        const wxString& GetPluralString() const { return m_plural; }
+        wxString GetPluralString() const { return m_plural.str(); }
+        const std::string& GetPluralStringUTF8() const { return m_plural.utf8(); }
 
         /// Does this entry have a msgctxt?
         bool HasContext() const { return m_hasContext; }
 
         /// Returns context string (can only be called if HasContext() returns
         /// true and empty string is accepted value).
-        const wxString& GetContext() const { return m_context; }
+        wxString GetContext() const { return m_context.str(); }
+        const std::string& GetContextUTF8() const { return m_context.utf8(); }
+
+        /** Returns the item's version, which increases with every change
+            made to it using any of the setters, including auxiliary data
+            such as issues. Unlike IsModified(), it is never reset, so it
+            can be used to validate data derived from the item.
+         */
+        uint64_t GetVersion() const { return m_version; }
+
+        /** Returns word and character counts of the source text, including
+            the plural form, in language @a srclang (see CountText()).
+
+            They are counted on first use and cached until the item changes,
+            so that statistics can be computed quickly. May be called from
+            any thread.
+         */
+        TextCounts GetSourceTextCounts(const Language& srclang) const;
 
         /// How many translations (plural forms) do we have?
         unsigned GetNumberOfTranslations() const
@@ -128,7 +350,7 @@ class CatalogItem
         wxString GetTranslation(unsigned n = 0) const;
 
         /// Returns all translations.
-        const wxArrayString& GetTranslations() const { return m_translations; }
+        const SmallStringArray& GetTranslations() const { return m_translations; }
 
         /// Returns array of all occurrences of this string in source code,
         /// parsed into individual references
@@ -138,13 +360,13 @@ class CatalogItem
         const wxString& GetComment() const { return m_comment; }
 
         /// Returns array of all auto comments.
-        const wxArrayString& GetExtractedComments() const { return m_extractedComments; }
+        const wxArrayString& GetExtractedComments() const { EnsureMetadataLoaded(); return m_extractedComments.get(); }
 
         /// Convenience function: does this entry has a comment?
         bool HasComment() const { return !m_comment.empty(); }
 
         /// Convenience function: does this entry has auto comments?
-        bool HasExtractedComments() const { return !m_extractedComments.empty(); }
+        bool HasExtractedComments() const { EnsureMetadataLoaded(); return !m_extractedComments.empty(); }
 
         /// Gets gettext flags. \see SetFlags
         wxString GetFlags() const;
@@ -153,6 +375,10 @@ class CatalogItem
         // empty string otherwise
         wxString GetFormatFlag() const;
 
+        /// Returns placeholders used in the source text, as appropriate for
+        /// the item's format. Computed on first use and cached.
+        std::shared_ptr<const SourcePlaceholders> GetSourcePlaceholders() const;
+
         /// Gets value of fuzzy flag.
         bool IsFuzzy() const { return m_isFuzzy; }
         /// Gets value of translated flag.
@@ -164,15 +390,41 @@ class CatalogItem
         /// Get line number of this entry.
         int GetLineNumber() const { return m_lineNum; }
 
-        const wxArrayString& GetOldMsgidRaw() const { return m_oldMsgid; }
+        const SmallStringArray& GetOldMsgidRaw() const { EnsureMetadataLoaded(); return m_oldMsgid; }
         wxString GetOldMsgid() const;
-        bool HasOldMsgid() const { return !m_oldMsgid.empty(); }
+        bool HasOldMsgid() const { EnsureMetadataLoaded(); return !m_oldMsgid.empty(); }
 
         /// Returns the bookmark for the item
         Bookmark GetBookmark() const {return m_bookmark;}
         /// Returns true if the item has a bookmark
         bool HasBookmark() const {return (GetBookmark() != NO_BOOKMARK);}
 
+        /**
+            Adds approximate memory used by the item to @a usage.
+
+            Deferred metadata are only counted if they were loaded already.
+         */
+        virtual void AddMemoryUsage(CatalogMemoryUsage& usage) const;
+
+        /// Returns combination of CatalogStatusIndex::Flags for the item
+        unsigned GetStatus() const
+        {
+            unsigned status = 0;
+            if (m_isTranslated)
+                status |= CatalogStatusIndex::Translated;
+            if (m_isFuzzy)
+                status |= CatalogStatusIndex::Fuzzy;
+            if (m_issue)
+                status |= CatalogStatusIndex::Issue;
+            if (HasError())
+                status |= CatalogStatusIndex::Error;
+            if (m_isPreTranslated)
+                status |= CatalogStatusIndex::PreTranslated;
+            if (m_isModified)
+                status |= CatalogStatusIndex::Modified;
+            return status;
+        }
+
 
         // -------------------------------------------------------------------
         // Setters for user-editable values:
@@ -184,7 +436,7 @@ class CatalogItem
         void SetTranslation(const wxString& t, unsigned index = 0);
 
         /// Sets all translations.
-        void SetTranslations(const wxArrayString& t);
+        void SetTranslations(SmallStringArray t);
 
         /// Set translations to equal source text.
         void SetTranslationFromSource();
@@ -195,16 +447,16 @@ class CatalogItem
         /// Sets fuzzy flag.
         void SetFuzzy(bool fuzzy);
         /// Sets translated flag.
-        void SetTranslated(bool t) { m_isTranslated = t; }
+        void SetTranslated(bool t) { m_isTranslated = t; UpdateStatus(); Touch(); }
         /// Sets modified flag.
-        void SetModified(bool modified) { m_isModified = modified; }
+        void SetModified(bool modified) { m_isModified = modified; UpdateStatus(); Touch(); }
         /// Sets pre-translated translation flag.
-        void SetPreTranslated(bool pre) { m_isPreTranslated = pre; }
+        void SetPreTranslated(bool pre) { m_isPreTranslated = pre; UpdateStatus(); Touch(); }
         /// Sets the bookmark
-        void SetBookmark(Bookmark bookmark) {m_bookmark = bookmark;}
+        void SetBookmark(Bookmark bookmark) { m_bookmark = bookmark; Touch(); }
 
         /// Sets the comment.
-        void SetComment(const wxString& c) { m_comment = c; }
+        void SetComment(const wxString& c) { m_comment = c; Touch(); }
 
 
         // -------------------------------------------------------------------
@@ -212,6 +464,15 @@ class CatalogItem
         // is done in base class only, because they don't affect the saved output.
         // -------------------------------------------------------------------
 
+        /**
+            Problem found in the item.
+
+            The same few messages are typically reported for many items, so
+            an issue may keep its message untranslated (as marked with
+            wxTRANSLATE()) with optional "%s" arguments and only format it
+            when GetMessage() is called to show it. Issues without arguments
+            can be shared by all items, see Shared().
+         */
         struct Issue
         {
             enum Severity
@@ -221,57 +482,137 @@ class CatalogItem
             };
 
             Severity severity;
-            wxString message;
 
-            Issue(Severity s, const wxString& m) : severity(s), message(m) {}
+            /// Issue with already translated and formatted message
+            Issue(Severity s, const wxString& m) : severity(s), m_text(nullptr), m_message(m) {}
+
+            /// Issue with untranslated @a text and @a args to format it with
+            Issue(Severity s, const wchar_t *text, SmallStringArray args = SmallStringArray())
+                : severity(s), m_text(text), m_args(std::move(args)) {}
+
+            /// Returns shared instance of the issue with untranslated @a text
+            static std::shared_ptr<Issue> Shared(Severity s, const wchar_t *text);
+
+            /// Returns translated, user-visible message
+            wxString GetMessage() const;
+
+        private:
+            const wchar_t *m_text;
+            SmallStringArray m_args;
+            wxString m_message;
         };
 
         bool HasIssue() const { return m_issue != nullptr; }
         bool HasError() const { return m_issue && m_issue->severity == Issue::Error; }
         const Issue& GetIssue() const { return *m_issue; }
 
-        void ClearIssue() { m_issue.reset(); }
-        void SetIssue(std::shared_ptr<Issue> issue) { m_issue = issue; }
-        void SetIssue(const Issue& issue) { m_issue = std::make_shared<Issue>(issue); }
-        void SetIssue(Issue::Severity severity, const wxString& message) { m_issue = std::make_shared<Issue>(severity, message); }
+        void ClearIssue() { m_issue.reset(); UpdateStatus(); Touch(); }
+        void SetIssue(std::shared_ptr<Issue> issue) { m_issue = issue; UpdateStatus(); Touch(); }
+        void SetIssue(const Issue& issue) { m_issue = std::make_shared<Issue>(issue); UpdateStatus(); Touch(); }
+        void SetIssue(Issue::Severity severity, const wxString& message) { m_issue = std::make_shared<Issue>(severity, message); UpdateStatus(); Touch(); }
 
     protected:
         // API for subclasses:
         virtual void UpdateInternalRepresentation() = 0;
 
+        /// Must be called after any change to the item, to update its version
+        void Touch()
+        {
+            m_version = NextCatalogVersion();
+            if (m_statusIndex.index)
+                m_statusIndex.index->Touch(m_version);
+        }
+
+        /// Must be called after changing any of the values GetStatus() uses
+        void UpdateStatus()
+        {
+            if (m_statusIndex.index)
+            {
+                auto status = GetStatus();
+                if (status != m_statusIndex.status)
+                {
+                    m_statusIndex.index->Remove(m_statusIndex.status);
+                    m_statusIndex.index->Add(status);
+                    m_statusIndex.status = status;
+                }
+            }
+        }
+
+        /// Makes the item counted in @a index, instead of any previous one
+        void AttachToStatusIndex(const std::shared_ptr<CatalogStatusIndex>& index)
+        {
+            if (m_statusIndex.index == index)
+                return;
+            DetachFromStatusIndex();
+            m_statusIndex.index = index;
+            m_statusIndex.status = GetStatus();
+            index->Add(m_statusIndex.status);
+            index->Touch(NextCatalogVersion());
+        }
+
+        void DetachFromStatusIndex()
+        {
+            if (m_statusIndex.index)
+            {
+                m_statusIndex.index->Remove(m_statusIndex.status);
+                m_statusIndex.index->Touch(NextCatalogVersion());
+                m_statusIndex.index.reset();
+            }
+        }
+
+        /** Subclasses may defer decoding of references, extracted comments
+            and old msgids until they are first needed, by setting
+            m_metadataDeferred and overriding LoadDeferredMetadata().
+         */
+        void EnsureMetadataLoaded() const
+        {
+            if (m_metadataDeferred.value.load(std::memory_order_acquire))
+                LoadDeferredMetadata();
+        }
+
+        /// Decodes the metadata and resets m_metadataDeferred; must be thread-safe
+        virtual void LoadDeferredMetadata() const {}
+
+        friend class Catalog;
+
     protected:
         // -------------------------------------------------------------------
         // Private data setters only for internal use:
         // -------------------------------------------------------------------
 
-        void SetId(int id) { m_id = id; }
+        void SetId(int id) { m_id = id; Touch(); }
 
-        void SetString(const wxString& s)
+        void SetString(CompactString s)
         {
-            m_string = s;
-            ClearIssue();
+            m_string = std::move(s);
+            InvalidateSourcePlaceholders();
+            ClearIssue(); // touches the item too
         }
 
-        void SetPluralString(const wxString& p)
+        void SetPluralString(CompactString p)
         {
-            m_plural = p;
+            m_plural = std::move(p);
             m_hasPlural = true;
+            InvalidateSourcePlaceholders();
+            Touch();
         }
 
-        void SetContext(const wxString& context)
+        void SetContext(CompactString context)
         {
             m_hasContext = true;
-            m_context = context;
+            m_context = std::move(context);
+            Touch();
         }
 
-        void SetLineNumber(int line) { m_lineNum = line; }
+        void SetLineNumber(int line) { m_lineNum = line; Touch(); }
 
         void AddExtractedComments(const wxString& com)
         {
-            m_extractedComments.Add(com);
+            m_extractedComments.modify().Add(com);
+            Touch();
         }
 
-        void SetOldMsgid(const wxArrayString& data) { m_oldMsgid = data; }
+        void SetOldMsgid(SmallStringArray data) { m_oldMsgid = std::move(data); Touch(); }
 
         /** Sets gettext flags directly in string format. It may be
             either empty string or ", fuzzy", ", c-format",
@@ -283,23 +624,79 @@ class CatalogItem
     protected:
         int m_id;
 
-        wxString m_string, m_plural;
-        bool m_hasPlural;
+        // source texts are only read after loading, so they are kept compact:
+        CompactString m_string, m_plural;
+        CompactString m_context;
 
-        bool m_hasContext;
-        wxString m_context;
+        // typically just one translation, stored inline:
+        SmallStringArray m_translations;
 
-        wxArrayString m_translations;
-
-        wxArrayString m_extractedComments;
-        wxArrayString m_oldMsgid;
-        bool m_isFuzzy, m_isTranslated, m_isModified, m_isPreTranslated;
-        wxString m_moreFlags;
+        // metadata that is typically repeated across many items is interned:
+        Interned<wxArrayString> m_extractedComments;
+        SmallStringArray m_oldMsgid;
+        Interned<wxString> m_moreFlags;
         wxString m_comment;
         int m_lineNum;
         Bookmark m_bookmark;
 
+        bool m_hasPlural : 1;
+        bool m_hasContext : 1;
+        bool m_isFuzzy : 1;
+        bool m_isTranslated : 1;
+        bool m_isModified : 1;
+        bool m_isPreTranslated : 1;
+
+        // see GetVersion(); copies keep the version of the original
+        uint64_t m_version;
+
         std::shared_ptr<Issue> m_issue;
+
+        // copyable atomic flag, because the metadata may be first needed
+        // on several threads at once
+        struct AtomicFlag
+        {
+            AtomicFlag() : value(false) {}
+            AtomicFlag(const AtomicFlag& other) : value(other.value.load()) {}
+            AtomicFlag& operator=(const AtomicFlag& other) { value = other.value.load(); return *this; }
+
+            std::atomic<bool> value;
+        };
+        mutable AtomicFlag m_metadataDeferred;
+
+        // cache for GetSourceTextCounts(), valid if computed for the current version
+        struct TextCountsCache
+        {
+            TextCountsCache() : version(0), packed(0) {}
+            TextCountsCache(const TextCountsCache& other) : version(other.version.load()), packed(other.packed.load()) {}
+            TextCountsCache& operator=(const TextCountsCache& other)
+                { version = other.version.load(); packed = other.packed.load(); return *this; }
+
+            std::atomic<uint64_t> version;
+            // words in the upper and characters in the lower 32 bits:
+            std::atomic<uint64_t> packed;
+        };
+        mutable TextCountsCache m_textCounts;
+
+        /// Must be called when source text or flags change
+        void InvalidateSourcePlaceholders()
+            { std::atomic_store(&m_sourcePlaceholders, std::shared_ptr<const SourcePlaceholders>()); }
+
+    private:
+        // cache for GetSourcePlaceholders(), accessed atomically
+        mutable std::shared_ptr<const SourcePlaceholders> m_sourcePlaceholders;
+
+        // the catalog's index the item is counted in; copies of an item
+        // don't belong to any catalog until they are added to one
+        struct StatusIndexLink
+        {
+            StatusIndexLink() : status(0) {}
+            StatusIndexLink(const StatusIndexLink&) : status(0) {}
+            StatusIndexLink& operator=(const StatusIndexLink&) { return *this; }
+
+            std::shared_ptr<CatalogStatusIndex> index;
+            unsigned status;
+        };
+        StatusIndexLink m_statusIndex;
 };
 
 
@@ -344,7 +741,10 @@ class Catalog
             void FromString(const wxString& str);
 
             /** Converts the header into string representation that can be
-                directly written to .po file as msgid "". */
+                directly written to .po file as msgid "".
+
+                The result is cached and only re-serialized if some entry
+                changed since the last call. */
             wxString ToString(const wxString& line_delim = wxEmptyString);
 
             /// Updates headers list from parsed values entries below
@@ -391,8 +791,15 @@ class Catalog
 
         protected:
             Entries m_entries;
+            // positions of entries in m_entries, by key:
+            std::unordered_map<wxString, size_t, wxStringHash, wxStringEqual> m_index;
+
+            // output of the last ToString() call, valid until entries change:
+            wxString m_serialized, m_serializedDelim;
+            bool m_serializedValid = false;
 
             const Entry *Find(const wxString& key) const;
+            void RebuildIndex();
         };
 
         enum CreationFlags
@@ -455,7 +862,31 @@ class Catalog
             
             Returns empty string in case of failure.
          */
-        virtual std::string SaveToBuffer() = 0;
+        std::string SaveToBuffer();
+
+        /**
+            Like SaveToBuffer(), but appends the content to @a out. This lets
+            callers serialize the catalog directly into a larger buffer, e.g.
+            a HTTP request's body, without copying it.
+
+            Returns false in case of failure; @a out may be partially written.
+         */
+        virtual bool WriteToBuffer(std::string& out) = 0;
+
+        /**
+            Creates an independent copy of the catalog for use by background
+            tasks such as saving, uploading or TM harvesting. Unlike the
+            catalog itself, the snapshot isn't modified while the user
+            continues editing, so it provides a consistent view of the
+            content at the time it was taken.
+
+            Items' texts and metadata are shared with the catalog rather than
+            copied, so this is cheap even for large files.
+
+            Returns nullptr if the file type doesn't support snapshots; the
+            caller must use the catalog itself then.
+         */
+        virtual CatalogPtr CreateSnapshot() const { return nullptr; }
 
         /// File mask for opening/saving this catalog's file type
         wxString GetFileMask() const { return GetTypesFileMask({m_fileType}); }
@@ -463,9 +894,29 @@ class Catalog
         static wxString GetTypesFileMask(std::initializer_list<Type> types);
         static wxString GetAllTypesFileMask();
 
-        /// Exports the catalog to HTML format
+        /**
+            Exports the catalog to HTML format.
+
+            Rows of large catalogs are rendered in parallel and written to
+            @a output in big chunks, so it doesn't need to be buffered.
+         */
         void ExportToHTML(std::ostream& output);
 
+        /// Statistics of the whole file, see ExportPreviewToHTML()
+        struct ExportStatistics
+        {
+            int all = 0, fuzzy = 0, untranslated = 0, unfinished = 0;
+            /// Words in all and in unfinished source texts, -1 if not known
+            int words = -1, unfinishedWords = -1;
+        };
+
+        /**
+            Exports the (partially loaded, see POCatalog::CreatePreview())
+            catalog to HTML as a preview of a file with @a fileStats,
+            noting how many entries were omitted.
+         */
+        void ExportPreviewToHTML(std::ostream& output, const ExportStatistics& fileStats);
+
         Type GetFileType() const { return m_fileType; }
 
         wxString GetFileName() const { return m_fileName; }
@@ -516,6 +967,49 @@ class Catalog
         void GetStatistics(int *all, int *fuzzy, int *badtokens,
                            int *untranslated, int *unfinished);
 
+        /// Word and character counts of source texts, see GetTextStatistics()
+        struct TextStatistics
+        {
+            TextCounts all, fuzzy, untranslated, unfinished;
+        };
+
+        /**
+            Gets word and character counts of items' source texts, grouped
+            the same way as GetStatistics() does.
+
+            The counts are cached in items (see CatalogItem::GetSourceTextCounts()),
+            so only items changed since the last call are counted again.
+            Counting all of them for the first time is slow for big catalogs,
+            so UI code should call PrecomputeTextCounts() in the background
+            before using this.
+         */
+        TextStatistics GetTextStatistics() const;
+
+        /**
+            Counts items' source texts for GetTextStatistics(), using all
+            cores. Unlike GetTextStatistics(), this can be called on a
+            background thread while the items are edited, but not while items
+            are added or removed.
+         */
+        void PrecomputeTextCounts() const;
+
+        /// Are there any untranslated or fuzzy items or items with issues?
+        bool HasItemsNeedingAttention() const;
+
+        /** Returns bitmaps of current items' statuses.
+
+            They are built on first use and then reused until some item's
+            status changes or items are added or removed.
+         */
+        std::shared_ptr<const CatalogStatusBitmaps> GetStatusBitmaps() const;
+
+        /** Returns the catalog's epoch, which increases whenever any of its
+            items changes (see CatalogItem::GetVersion()) or items are added
+            or removed. Data derived from the whole catalog can compare it
+            cheaply before checking individual items' versions.
+         */
+        uint64_t GetEpoch() const { return m_statusIndex->GetEpoch(); }
+
         /// Gets n-th item in the catalog (read-write access).
         CatalogItemPtr operator[](unsigned n) { return m_items[n]; }
 
@@ -555,6 +1049,14 @@ class Catalog
         bool IsFromCrowdin() const
             { return m_header.HasHeader("X-Crowdin-Project") && m_header.HasHeader("X-Crowdin-File"); }
 
+        /**
+            Returns approximate memory used by the catalog's data.
+
+            Examines all items, so it shouldn't be called too often; it must
+            not be used concurrently with modifications of the catalog.
+         */
+        virtual CatalogMemoryUsage GetMemoryUsage() const;
+
         /// Returns true if the catalog contains obsolete entries (~.*)
         virtual bool HasDeletedItems() const = 0;
 
@@ -567,6 +1069,41 @@ class Catalog
         /// Finds catalog index by line number
         int FindItemIndexByLine(int lineno);
 
+        /** Finds index of the first item with the same source text and
+            context as @a item (which may be this item). Returns -1 if
+            there's none.
+         */
+        int FindItemIndexBySource(const CatalogItem& item) const;
+
+        /** Returns indexes of items with a reference to @a file, in the
+            catalog's order. The file is given as in references, i.e.
+            usually relative to the sources' base path.
+
+            The index of references is built on first use; like
+            FindItemIndexBySource(), this must not be used concurrently
+            with modifications of the catalog.
+         */
+        const std::vector<int>& FindItemsReferencingFile(const wxString& file) const;
+
+        /// Returns all files referenced by items, normalized as with GetReferenceFile()
+        std::vector<wxString> GetReferencedFiles() const;
+
+        /// Returns the file part of a reference (e.g. "src/foo.c" for "src/foo.c:123")
+        static wxString GetReferenceFile(const wxString& ref);
+
+        /** Returns index of finished translations in the catalog by source
+            text, see CatalogTranslationIndex. It is built on first use and
+            must not be used concurrently with modifications of the catalog,
+            except for queries through the returned object.
+         */
+        std::shared_ptr<CatalogTranslationIndex> GetTranslationIndex();
+
+        /// Must be called after translation or flags of @a item were edited
+        void ItemTranslationChanged(const CatalogItem& item);
+
+        /// Must be called after translations of many items changed at once
+        void InvalidateTranslationIndex() { m_translationIndex.reset(); }
+
         /// Sets the given item to have the given bookmark and returns the index
         /// of the item that previously had this bookmark (or -1)
         int SetBookmark(int id, Bookmark bookmark);
@@ -582,14 +1119,98 @@ class Catalog
         /// Returns number of errors (i.e. 0 if no errors).
         virtual ValidationResults Validate(bool wasJustLoaded = false) = 0;
 
+        /** Re-validates a single item, e.g. after it was edited, without
+            checking the rest of the catalog. Runs the same per-item checks
+            as Validate() does and sets or clears the item's issue.
+            Returns true if the item has an issue.
+         */
+        virtual bool ValidateItem(const CatalogItemPtr& item) = 0;
+
+        /** Validates items [begin, end) (indexes into items()) as Validate()
+            would, but without checks of the catalog as a whole, such as of
+            its header. Used to validate large catalogs in parts, see
+            IncrementalValidator.
+         */
+        virtual ValidationResults ValidateItems(size_t begin, size_t end) = 0;
+
         void AttachCloudSync(std::shared_ptr<CloudSyncDestination> c) { m_cloudSync = c; }
         std::shared_ptr<CloudSyncDestination> GetCloudSync() const { return m_cloudSync; }
 
     protected:
         Catalog(Type type);
 
+        /// Implementation of ExportToHTML() and ExportPreviewToHTML()
+        void DoExportToHTML(std::ostream& output, const ExportStatistics& stats, int omitted);
+
+        /// Creates a new item in the catalog's items arena (doesn't add it)
+        template<typename T, typename... Args>
+        std::shared_ptr<T> CreateItem(Args&&... args)
+        {
+            return std::allocate_shared<T>(ArenaAllocator<T>(m_itemsArena), std::forward<Args>(args)...);
+        }
+
+        /// Adds the item at the end of the catalog
+        void AddItem(const CatalogItemPtr& item)
+        {
+            m_items.push_back(item);
+            item->AttachToStatusIndex(m_statusIndex);
+            InvalidateLookupIndexes();
+        }
+
+        /// Makes the item counted in this catalog's statistics; used when
+        /// moving items into m_items from elsewhere
+        void AttachItem(const CatalogItemPtr& item)
+        {
+            item->AttachToStatusIndex(m_statusIndex);
+            InvalidateLookupIndexes();
+        }
+
+        /// Recreates statistics after changing m_items wholesale
+        void RebuildStatusIndex();
+
+        /// Indexes for looking up items, built on first use
+        struct LookupIndexes
+        {
+            LookupIndexes() : hasDuplicates(false) {}
+
+            // running maximum of items' line numbers, for binary search
+            std::vector<int> lines;
+            // index of the first item with given msgctxt+msgid
+            std::unordered_map<std::string, int> sources;
+            // are there items with the same msgctxt+msgid?
+            bool hasDuplicates;
+        };
+
+        const LookupIndexes& GetLookupIndexes() const;
+
+        /// Items referencing each source file, built on first use
+        typedef std::unordered_map<std::wstring, std::vector<int>> ReferencesIndex;
+        const ReferencesIndex& GetReferencesIndex() const;
+
+        /// Must be called after adding or removing items or changing
+        /// their line numbers
+        void InvalidateLookupIndexes()
+        {
+            m_lookupIndexes.reset();
+            m_referencesIndex.reset();
+            m_translationIndex.reset();
+            std::atomic_store(&m_statusBitmaps, std::shared_ptr<const CatalogStatusBitmaps>());
+        }
+
     protected:
         CatalogItemArray m_items;
+        // storage for items, so that they are contiguous in memory in load order:
+        std::shared_ptr<MemoryArena> m_itemsArena;
+        // counts of m_items' states, kept up to date by the items:
+        std::shared_ptr<CatalogStatusIndex> m_statusIndex;
+        // like m_items, must not be used concurrently with modifications:
+        mutable std::shared_ptr<const LookupIndexes> m_lookupIndexes;
+        // separate from m_lookupIndexes, because it needs items' metadata:
+        mutable std::shared_ptr<const ReferencesIndex> m_referencesIndex;
+        // status bitmaps, accessed atomically:
+        mutable std::shared_ptr<const CatalogStatusBitmaps> m_statusBitmaps;
+        // built on first use by GetTranslationIndex():
+        std::shared_ptr<CatalogTranslationIndex> m_translationIndex;
 
         bool m_isOk;
         Type m_fileType;
@@ -0,0 +1,453 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "catalog_cache.h"
+
+#include "catalog_po.h"
+#include "concurrency.h"
+#include "configuration.h"
+#include "utility.h"
+#include "version.h"
+
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/ffile.h>
+#include <wx/log.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+// Bump whenever the layout of the cached data changes:
+const uint32_t CACHE_MAGIC = 0x50454f50; // "POEP"
+const uint32_t CACHE_FORMAT_VERSION = 2;
+
+
+uint64_t HashBytes(const char *data, size_t size)
+{
+    // 64bit FNV-1a; fast, and good enough to detect a changed file
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+wxString GetCacheFileName(const wxString& po_file)
+{
+    const wxScopedCharBuffer path = wxFileName(po_file).GetAbsolutePath().utf8_str();
+    return wxString::Format("%s%c%016llx.cache",
+                            GetUserCacheDir("Catalogs"), wxFILE_SEP_PATH,
+                            (unsigned long long)HashBytes(path.data(), path.length()));
+}
+
+
+/// Identification of the file the cache entry was created from
+struct FileStamp
+{
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+
+    static FileStamp For(const wxString& po_file, const char *data, size_t size)
+    {
+        FileStamp s;
+        s.path = wxFileName(po_file).GetAbsolutePath().utf8_str().data();
+        s.size = size;
+        wxFileName fn(po_file);
+        if (fn.FileExists())
+            s.mtime = fn.GetModificationTime().GetValue().GetValue();
+        s.hash = HashBytes(data, size);
+        return s;
+    }
+};
+
+
+class CacheWriter
+{
+public:
+    void U32(uint32_t v) { Raw(&v, sizeof(v)); }
+    void U64(uint64_t v) { Raw(&v, sizeof(v)); }
+    void Bool(bool v) { m_data.push_back(v ? 1 : 0); }
+
+    void Str(const std::string& s)
+    {
+        U32(uint32_t(s.size()));
+        m_data.append(s);
+    }
+
+    void Str(const wxString& s)
+    {
+        const wxScopedCharBuffer utf8 = s.utf8_str();
+        U32(uint32_t(utf8.length()));
+        m_data.append(utf8.data(), utf8.length());
+    }
+
+    template<typename Strings>
+    void Strs(const Strings& a)
+    {
+        U32(uint32_t(a.size()));
+        for (auto& s: a)
+            Str(s);
+    }
+
+    void Raw(const POEntryRawText& raw)
+    {
+        U64(raw.offset);
+        U64(raw.length);
+        U64(raw.lines);
+    }
+
+    const std::string& data() const { return m_data; }
+
+private:
+    void Raw(const void *p, size_t size) { m_data.append(static_cast<const char*>(p), size); }
+
+    std::string m_data;
+};
+
+
+/// Bounds-checked reading of cached data; any problem makes the reader bad
+class CacheReader
+{
+public:
+    CacheReader(const char *data, size_t size) : m_pos(data), m_end(data + size), m_ok(true) {}
+
+    bool IsOk() const { return m_ok; }
+    bool AtEnd() const { return m_pos == m_end; }
+
+    uint32_t U32() { uint32_t v = 0; Raw(&v, sizeof(v)); return v; }
+    uint64_t U64() { uint64_t v = 0; Raw(&v, sizeof(v)); return v; }
+
+    bool Bool()
+    {
+        char v = 0;
+        Raw(&v, 1);
+        return v != 0;
+    }
+
+    std::string StdStr()
+    {
+        const size_t len = U32();
+        if (!Check(len))
+            return std::string();
+        std::string s(m_pos, len);
+        m_pos += len;
+        return s;
+    }
+
+    wxString Str()
+    {
+        const size_t len = U32();
+        if (!Check(len))
+            return wxString();
+        wxString s = wxString::FromUTF8Unchecked(m_pos, len);
+        m_pos += len;
+        return s;
+    }
+
+    wxArrayString Strs()
+    {
+        wxArrayString a;
+        const size_t count = U32();
+        // every string takes at least 4 bytes, don't trust bogus counts:
+        if (!Check(count * 4))
+            return a;
+        a.reserve(count);
+        for (size_t i = 0; i < count && m_ok; i++)
+            a.push_back(Str());
+        return a;
+    }
+
+    POEntryRawText Raw()
+    {
+        POEntryRawText raw;
+        raw.offset = size_t(U64());
+        raw.length = size_t(U64());
+        raw.lines = size_t(U64());
+        return raw;
+    }
+
+private:
+    bool Check(size_t len)
+    {
+        if (!m_ok || size_t(m_end - m_pos) < len)
+            m_ok = false;
+        return m_ok;
+    }
+
+    void Raw(void *p, size_t size)
+    {
+        if (!Check(size))
+            return;
+        memcpy(p, m_pos, size);
+        m_pos += size;
+    }
+
+    const char *m_pos, *m_end;
+    bool m_ok;
+};
+
+
+void WriteStamp(CacheWriter& w, const FileStamp& stamp)
+{
+    w.U32(CACHE_MAGIC);
+    w.U32(CACHE_FORMAT_VERSION);
+    w.Str(std::string(POEDIT_VERSION));
+    w.Str(stamp.path);
+    w.U64(stamp.size);
+    w.U64(uint64_t(stamp.mtime));
+    w.U64(stamp.hash);
+}
+
+bool ReadAndCheckStamp(CacheReader& r, const FileStamp& stamp)
+{
+    return r.U32() == CACHE_MAGIC &&
+           r.U32() == CACHE_FORMAT_VERSION &&
+           r.StdStr() == POEDIT_VERSION &&
+           r.StdStr() == stamp.path &&
+           r.U64() == stamp.size &&
+           int64_t(r.U64()) == stamp.mtime &&
+           r.U64() == stamp.hash &&
+           r.IsOk();
+}
+
+} // anonymous namespace
+
+
+bool POCatalogCache::IsEnabled()
+{
+    return Config::UseCatalogCache();
+}
+
+
+void POCatalogCache::Store(const POCatalog& catalog, const wxString& po_file,
+                           const char *fileData, size_t fileSize)
+{
+    CacheWriter w;
+    WriteStamp(w, FileStamp::For(po_file, fileData, fileSize));
+
+    auto& header = catalog.m_header;
+    w.Str(header.Charset);
+    w.Str(header.Comment);
+    auto& entries = header.GetAllHeaders();
+    w.U32(uint32_t(entries.size()));
+    for (auto& e: entries)
+    {
+        w.Str(e.Key);
+        w.Str(e.Value);
+    }
+
+    w.Str(catalog.m_sourceLanguage.Code());
+    w.U32(uint32_t(catalog.m_fileWrappingWidth));
+
+    w.U32(uint32_t(catalog.m_items.size()));
+    for (auto& i: catalog.m_items)
+    {
+        auto& item = static_cast<const POCatalogItem&>(*i);
+        // Stored as loaded, without decoding deferred metadata, see
+        // POCatalogItem::LoadDeferredMetadata():
+        const bool deferred = item.m_metadataDeferred.value;
+        w.Str(item.m_string.utf8());
+        w.Bool(item.m_hasPlural);
+        if (item.m_hasPlural)
+            w.Str(item.m_plural.utf8());
+        w.Bool(item.m_hasContext);
+        if (item.m_hasContext)
+            w.Str(item.m_context.utf8());
+        w.Strs(item.m_translations);
+        w.Str(item.GetFlags());
+        w.Str(item.m_comment);
+        w.U32(uint32_t(item.m_lineNum));
+        w.Strs(item.m_references);
+        w.Strs(item.m_extractedComments);
+        w.Strs(item.m_oldMsgid);
+        w.Raw(item.m_rawText);
+        w.Bool(deferred);
+    }
+
+    w.U32(uint32_t(catalog.m_deletedItems.size()));
+    for (auto& d: catalog.m_deletedItems)
+    {
+        // deferred entries are stored undecoded, as for items:
+        const bool deferred = d.IsContentDeferred();
+        w.Bool(deferred);
+        if (!deferred)
+        {
+            w.Strs(d.GetDeletedLines());
+            w.Str(d.GetFlags());
+            w.Str(d.GetComment());
+            w.Strs(d.GetExtractedComments());
+        }
+        w.U32(uint32_t(d.GetLineNumber()));
+        w.Raw(d.GetRawText());
+    }
+
+    // Writing is done in the background, the user doesn't have to wait for it;
+    // failures are harmless, the file will be simply parsed next time.
+    auto filename = GetCacheFileName(po_file);
+    dispatch::async(dispatch::priority::bulk, [filename, data = w.data()]
+    {
+        wxLogNull null;
+        wxFileName fn(filename);
+        if (!fn.DirExists())
+            wxFileName::Mkdir(fn.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+        // write atomically, so that a concurrently running Poedit instance
+        // never sees incomplete data:
+        wxString tmp = filename + ".tmp";
+        bool written = false;
+        {
+            wxFFile f(tmp, "wb");
+            if (f.IsOpened())
+            {
+                written = f.Write(data.data(), data.size()) == data.size();
+                written = f.Close() && written;
+            }
+        }
+        if (!written || !wxRenameFile(tmp, filename, /*overwrite=*/true))
+            wxRemoveFile(tmp);
+    });
+}
+
+
+bool POCatalogCache::Load(POCatalog& catalog, const wxString& po_file,
+                          const char *fileData, size_t fileSize)
+{
+    auto filename = GetCacheFileName(po_file);
+    if (!wxFileName::FileExists(filename))
+        return false;
+
+    wxLogNull null;
+    MemoryMappedFile cached(filename);
+    if (!cached.IsOk())
+        return false;
+
+    CacheReader r(cached.data(), cached.size());
+    if (!ReadAndCheckStamp(r, FileStamp::For(po_file, fileData, fileSize)))
+        return false;
+
+    const wxString charset = r.Str();
+    const wxString comment = r.Str();
+    wxString headerText;
+    const size_t headersCount = r.U32();
+    for (size_t i = 0; i < headersCount && r.IsOk(); i++)
+    {
+        headerText << r.Str() << ": ";
+        headerText << r.Str() << '\n';
+    }
+
+    const auto sourceLang = r.StdStr();
+    const int wrappingWidth = int(r.U32());
+    if (!r.IsOk())
+        return false;
+
+    // Items are read into a temporary catalog first, so that the real one is
+    // left intact if the data turns out to be corrupted:
+    POCatalog loaded(catalog.GetFileType());
+    loaded.m_stringPool = catalog.m_stringPool;
+
+    const size_t itemsCount = r.U32();
+    for (size_t i = 0; i < itemsCount && r.IsOk(); i++)
+    {
+        auto d = loaded.CreateItem<POCatalogItem>();
+        d->SetId(int(i + 1));
+        d->SetString(CompactString::FromUTF8(r.StdStr()));
+        if (r.Bool())
+            d->SetPluralString(CompactString::FromUTF8(r.StdStr()));
+        if (r.Bool())
+            d->SetContext(CompactString::FromUTF8(r.StdStr()));
+        d->SetTranslations(r.Strs());
+        auto flags = r.Str();
+        if (!flags.empty())
+            d->SetFlags(flags);
+        d->SetComment(r.Str());
+        d->SetLineNumber(int(r.U32()));
+        d->SetRawReferences(r.Strs());
+        for (auto& c: r.Strs())
+            d->AddExtractedComments(c);
+        d->SetOldMsgid(r.Strs());
+        auto raw = r.Raw();
+        if (raw.offset + raw.length > fileSize)
+            return false;
+        d->SetRawText(raw);
+        if (r.Bool())
+            d->DeferMetadata();
+        d->InternStrings(*loaded.m_stringPool);
+        loaded.AddItem(d);
+    }
+
+    const size_t deletedCount = r.U32();
+    for (size_t i = 0; i < deletedCount && r.IsOk(); i++)
+    {
+        POCatalogDeletedData d;
+        const bool deferred = r.Bool();
+        if (!deferred)
+        {
+            d.SetDeletedLines(r.Strs());
+            auto flags = r.Str();
+            if (!flags.empty())
+                d.SetFlags(flags);
+            d.SetComment(r.Str());
+            for (auto& c: r.Strs())
+                d.AddExtractedComments(c);
+        }
+        d.SetLineNumber(int(r.U32()));
+        auto raw = r.Raw();
+        if (raw.offset + raw.length > fileSize)
+            return false;
+        d.SetRawText(raw);
+        if (deferred)
+            d.DeferContent();
+        loaded.AddDeletedItem(d);
+    }
+
+    if (!r.IsOk() || !r.AtEnd())
+        return false;
+
+    catalog.m_header.FromString(headerText);
+    catalog.m_header.Charset = charset;
+    catalog.m_header.Comment = comment;
+    catalog.m_sourceLanguage = sourceLang.empty() ? Language() : Language::TryParse(sourceLang);
+    catalog.m_fileWrappingWidth = wrappingWidth;
+
+    for (auto& i: loaded.m_items)
+    {
+        catalog.AttachItem(i);
+        catalog.m_items.push_back(std::move(i));
+    }
+    loaded.m_items.clear();
+    catalog.m_deletedItems = std::move(loaded.m_deletedItems);
+    catalog.InvalidateLookupIndexes();
+
+    return true;
+}
@@ -0,0 +1,72 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_catalog_cache_h
+#define Poedit_catalog_cache_h
+
+#include <wx/string.h>
+
+class POCatalog;
+
+
+/**
+    Opt-in on-disk cache of parsed PO files.
+
+    The cache stores the state of a POCatalog as it was right after parsing
+    the file in a compact versioned binary format, so that reopening large
+    files doesn't need to parse them again. Entries are keyed by the file's
+    path and validated against its size, modification time and a hash of
+    its content; anything stale or unreadable is ignored and the file is
+    parsed normally.
+
+    Only clean loads (without CreationFlags or errors) should be cached.
+ */
+class POCatalogCache
+{
+public:
+    /// Is the cache enabled in preferences?
+    static bool IsEnabled();
+
+    /** Fills freshly cleared @a catalog from the cache, if it has up to date
+        data for @a po_file, whose content is @a fileData.
+
+        The caller is responsible for finishing loading (attaching file's
+        content to entries, bookmarks etc.) as if the file was parsed.
+
+        @return true if loaded, false if not cached or stale.
+     */
+    static bool Load(POCatalog& catalog, const wxString& po_file,
+                     const char *fileData, size_t fileSize);
+
+    /** Stores just parsed @a catalog into the cache.
+
+        Must be called before the catalog is further modified. The data is
+        serialized immediately, but written asynchronously in the background.
+     */
+    static void Store(const POCatalog& catalog, const wxString& po_file,
+                      const char *fileData, size_t fileSize);
+};
+
+#endif // Poedit_catalog_cache_h
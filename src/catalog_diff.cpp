@@ -0,0 +1,162 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "catalog_diff.h"
+
+#include <unordered_map>
+
+
+namespace
+{
+
+// Key referencing the item's strings, so that they don't have to be copied
+// for hashing
+struct ItemKey
+{
+    const CatalogItem *item;
+
+    bool operator==(const ItemKey& other) const
+    {
+        return item->HasContext() == other.item->HasContext() &&
+               item->GetStringUTF8() == other.item->GetStringUTF8() &&
+               (!item->HasContext() || item->GetContextUTF8() == other.item->GetContextUTF8());
+    }
+};
+
+struct ItemKeyHash
+{
+    size_t operator()(const ItemKey& k) const
+    {
+        std::hash<std::string> h;
+        size_t value = h(k.item->GetStringUTF8());
+        if (k.item->HasContext())
+            value ^= h(k.item->GetContextUTF8()) + 0x9e3779b9 + (value << 6) + (value >> 2);
+        return value;
+    }
+};
+
+// flags except for fuzzy, which is compared separately
+wxString OtherFlags(const CatalogItem& item)
+{
+    auto flags = item.GetFlags();
+    if (item.IsFuzzy())
+    {
+        // see CatalogItem::GetFlags():
+        static const wxString flag_fuzzy(wxS(", fuzzy"));
+        if (flags.StartsWith(flag_fuzzy))
+            flags.erase(0, flag_fuzzy.length());
+    }
+    return flags;
+}
+
+unsigned CompareItems(const CatalogItem& a, const CatalogItem& b)
+{
+    unsigned changes = 0;
+    if (a.GetTranslations() != b.GetTranslations())
+        changes |= CatalogDiff::TranslationChanged;
+    if (a.IsFuzzy() != b.IsFuzzy())
+        changes |= CatalogDiff::FuzzyChanged;
+    if (OtherFlags(a) != OtherFlags(b))
+        changes |= CatalogDiff::FlagsChanged;
+    if (a.GetComment() != b.GetComment())
+        changes |= CatalogDiff::CommentChanged;
+    return changes;
+}
+
+} // anonymous namespace
+
+
+CatalogDiff CatalogDiff::Compute(const Catalog& oldCatalog, const Catalog& newCatalog)
+{
+    auto& oldItems = oldCatalog.items();
+    auto& newItems = newCatalog.items();
+
+    // Index of the first new item with given key; the rest of items with
+    // the same key are linked through nextSame:
+    std::unordered_map<ItemKey, int, ItemKeyHash> index;
+    index.reserve(newItems.size());
+    std::vector<int> nextSame(newItems.size(), -1);
+    std::vector<int> lastSame(newItems.size(), -1);
+    for (int i = 0; i < (int)newItems.size(); i++)
+    {
+        auto r = index.emplace(ItemKey{newItems[i].get()}, i);
+        if (r.second)
+        {
+            lastSame[i] = i;
+        }
+        else
+        {
+            const int first = r.first->second;
+            nextSame[lastSame[first]] = i;
+            lastSame[first] = i;
+        }
+    }
+
+    CatalogDiff diff;
+    std::vector<bool> matched(newItems.size(), false);
+
+    for (auto& oldItem: oldItems)
+    {
+        auto found = index.find(ItemKey{oldItem.get()});
+        if (found == index.end())
+        {
+            diff.m_entries.push_back({Removed, oldItem, nullptr});
+            continue;
+        }
+
+        // pair with the next unmatched item with this key, if any:
+        int& n = found->second;
+        const int match = n;
+        n = nextSame[n];
+        if (n == -1)
+            index.erase(found);
+
+        matched[match] = true;
+        auto& newItem = newItems[match];
+        const unsigned changes = CompareItems(*oldItem, *newItem);
+        if (changes)
+            diff.m_entries.push_back({changes, oldItem, newItem});
+    }
+
+    for (size_t i = 0; i < newItems.size(); i++)
+    {
+        if (!matched[i])
+            diff.m_entries.push_back({Added, nullptr, newItems[i]});
+    }
+
+    return diff;
+}
+
+
+int CatalogDiff::CountOf(Change c) const
+{
+    int count = 0;
+    for (auto& e: m_entries)
+    {
+        if (e.Has(c))
+            count++;
+    }
+    return count;
+}
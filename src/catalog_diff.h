@@ -0,0 +1,86 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_catalog_diff_h
+#define Poedit_catalog_diff_h
+
+#include "catalog.h"
+
+#include <vector>
+
+
+/**
+    Differences between two versions of a catalog, e.g. a local and a remote
+    one when resolving sync conflicts, or a file and its older version.
+
+    Items are aligned by their context and source text, as gettext tools do,
+    using a hash map, so computing the diff takes linear time. Items with the
+    same key (which are invalid in PO files, but can happen in other formats)
+    are paired in order of appearance.
+ */
+class CatalogDiff
+{
+public:
+    /// Kinds of differences, combined in Entry::changes
+    enum Change
+    {
+        Added              = 0x01, ///< only in the new catalog
+        Removed            = 0x02, ///< only in the old catalog
+        TranslationChanged = 0x04,
+        FuzzyChanged       = 0x08,
+        FlagsChanged       = 0x10, ///< flags other than fuzzy (e.g. c-format)
+        CommentChanged     = 0x20  ///< translator's comment
+    };
+
+    struct Entry
+    {
+        unsigned changes;
+        /// The item in either catalog; nullptr for added or removed items
+        CatalogItemPtr oldItem, newItem;
+
+        bool Has(Change c) const { return (changes & c) != 0; }
+    };
+
+    /** Compares @a oldCatalog with @a newCatalog. Neither may be modified
+        while this runs, but the items are only read, so the diff can be
+        computed on a background thread.
+     */
+    static CatalogDiff Compute(const Catalog& oldCatalog, const Catalog& newCatalog);
+
+    /** Changed and removed items in the old catalog's order, followed by
+        items added in the new one, in its order.
+     */
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+    bool empty() const { return m_entries.empty(); }
+
+    /// Number of entries with change @a c
+    int CountOf(Change c) const;
+
+private:
+    std::vector<Entry> m_entries;
+};
+
+#endif // Poedit_catalog_diff_h
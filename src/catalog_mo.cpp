@@ -0,0 +1,309 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "catalog_mo.h"
+
+#include "concurrency.h"
+#include "errors.h"
+#include "str_helpers.h"
+#include "utility.h"
+
+#include <wx/filename.h>
+#include <wx/intl.h>
+#include <wx/log.h>
+#include <wx/strconv.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+
+namespace
+{
+
+const uint32_t MO_MAGIC = 0x950412de;
+const uint32_t MO_MAGIC_SWAPPED = 0xde120495;
+const size_t MO_HEADER_SIZE = 7 * sizeof(uint32_t);
+// revision 1 extension: number of system-dependent strings
+const size_t MO_SYSDEP_STRINGS_OFFSET = 9 * sizeof(uint32_t);
+
+/// Reads the MO file's fields, in whichever byte order it was written
+class MOReader
+{
+public:
+    MOReader(const char *data, size_t size) : m_data(data), m_size(size), m_swapped(false) {}
+
+    size_t size() const { return m_size; }
+
+    bool ReadMagic()
+    {
+        if (m_size < MO_HEADER_SIZE)
+            return false;
+        const uint32_t magic = Raw(0);
+        if (magic == MO_MAGIC_SWAPPED)
+            m_swapped = true;
+        return magic == MO_MAGIC || magic == MO_MAGIC_SWAPPED;
+    }
+
+    uint32_t U32(size_t offset) const
+    {
+        const uint32_t v = Raw(offset);
+        if (!m_swapped)
+            return v;
+        return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+    }
+
+    /** Gets n-th string from the table at @a tableOffset, which must be
+        known to be inside the file. Returns false if the string isn't.
+     */
+    bool String(size_t tableOffset, size_t n, const char*& str, size_t& length) const
+    {
+        const size_t entry = tableOffset + n * 2 * sizeof(uint32_t);
+        length = U32(entry);
+        const size_t offset = U32(entry + sizeof(uint32_t));
+        if (offset > m_size || length > m_size - offset)
+            return false;
+        str = m_data + offset;
+        return true;
+    }
+
+private:
+    uint32_t Raw(size_t offset) const
+    {
+        uint32_t v;
+        memcpy(&v, m_data + offset, sizeof(v));
+        return v;
+    }
+
+    const char *m_data;
+    size_t m_size;
+    bool m_swapped;
+};
+
+
+/// An entry decoded from the MO file, before it's made into an item
+struct MOEntry
+{
+    bool ok = true;
+    bool hasContext = false, hasPlural = false;
+    CompactString context, msgid, plural;
+    SmallStringArray translations;
+};
+
+
+/// Converts strings from the file's charset
+class MODecoder
+{
+public:
+    explicit MODecoder(const wxString& charset)
+    {
+        auto cs = charset.Lower();
+        m_utf8 = cs.empty() || cs == "utf-8" || cs == "utf8" || cs == "ascii" || cs == "us-ascii" || cs == "charset";
+        if (!m_utf8)
+            m_conv.reset(new wxCSConv(charset));
+    }
+
+    bool IsUTF8() const { return m_utf8; }
+
+    CompactString Compact(const char *str, size_t length) const
+    {
+        if (m_utf8)
+            return CompactString::FromUTF8(std::string(str, length));
+        return CompactString(Wx(str, length));
+    }
+
+    wxString Wx(const char *str, size_t length) const
+    {
+        if (m_utf8)
+            return wxString::FromUTF8Unchecked(str, length);
+        return wxString(str, *m_conv, length);
+    }
+
+private:
+    bool m_utf8;
+    std::unique_ptr<wxCSConv> m_conv;
+};
+
+
+MOEntry DecodeEntry(const char *msgid, size_t msgidLength, const char *trans, size_t transLength,
+                    const MODecoder& decoder)
+{
+    MOEntry e;
+
+    if (decoder.IsUTF8() && (!str::is_valid_utf8(msgid, msgidLength) || !str::is_valid_utf8(trans, transLength)))
+    {
+        e.ok = false;
+        return e;
+    }
+
+    // msgid is "[msgctxt \x04] msgid [\0 msgid_plural]":
+    const char *end = msgid + msgidLength;
+    auto ctxEnd = (const char*)memchr(msgid, '\x04', msgidLength);
+    if (ctxEnd)
+    {
+        e.hasContext = true;
+        e.context = decoder.Compact(msgid, ctxEnd - msgid);
+        msgid = ctxEnd + 1;
+    }
+    auto idEnd = (const char*)memchr(msgid, '\0', end - msgid);
+    if (idEnd)
+    {
+        e.hasPlural = true;
+        e.plural = decoder.Compact(idEnd + 1, end - idEnd - 1);
+        end = idEnd;
+    }
+    e.msgid = decoder.Compact(msgid, end - msgid);
+
+    // plural forms of the translation are separated with \0 too:
+    const char *transEnd = trans + transLength;
+    for (;;)
+    {
+        auto formEnd = (const char*)memchr(trans, '\0', transEnd - trans);
+        if (!formEnd || !e.hasPlural)
+        {
+            e.translations.push_back(decoder.Wx(trans, transEnd - trans));
+            break;
+        }
+        e.translations.push_back(decoder.Wx(trans, formEnd - trans));
+        trans = formEnd + 1;
+    }
+
+    return e;
+}
+
+} // anonymous namespace
+
+
+MOCatalog::MOCatalog(const wxString& mo_file) : POCatalog(Type::PO)
+{
+    LoadMO(mo_file);
+}
+
+
+void MOCatalog::LoadMO(const wxString& mo_file)
+{
+    auto invalid = [&mo_file]() -> Exception
+    {
+        return Exception(wxString::Format(_(L"“%s” is not a valid MO file."), mo_file));
+    };
+
+    MemoryMappedFile data(mo_file);
+    if (!data.IsOk())
+        throw Exception(wxString::Format(_(L"Couldn’t open file %s."), mo_file));
+
+    MOReader r(data.data(), data.size());
+    if (!r.ReadMagic())
+        throw invalid();
+
+    const uint32_t revision = r.U32(4);
+    const size_t count = r.U32(8);
+    const size_t origTable = r.U32(12);
+    const size_t transTable = r.U32(16);
+    if ((revision >> 16) != 0)
+        throw invalid();
+
+    const size_t tableSize = count * 2 * sizeof(uint32_t);
+    if (count > r.size() / (2 * sizeof(uint32_t)) ||
+        origTable > r.size() || tableSize > r.size() - origTable ||
+        transTable > r.size() || tableSize > r.size() - transTable)
+    {
+        throw invalid();
+    }
+
+    // The header, if present, is the first entry, because it has the
+    // empty msgid; it's needed to know the charset of the rest:
+    size_t first = 0;
+    const char *msgid, *trans;
+    size_t msgidLength, transLength;
+    if (count > 0 && r.String(origTable, 0, msgid, msgidLength) && msgidLength == 0)
+    {
+        if (!r.String(transTable, 0, trans, transLength))
+            throw invalid();
+        // the charset is ASCII, so find it first and then decode the rest:
+        m_header.FromString(wxString::From8BitData(trans, transLength));
+        first = 1;
+    }
+
+    const MODecoder decoder(m_header.Charset);
+    if (first && (!decoder.IsUTF8() || str::is_valid_utf8(trans, transLength)))
+        m_header.FromString(decoder.Wx(trans, transLength));
+
+    // Entries are decoded in parallel, straight from the mapped file:
+    std::vector<MOEntry> entries(count - first);
+    dispatch::parallel_options options;
+    options.min_chunk_size = 1000;
+    dispatch::parallel_for(0, entries.size(), [&](size_t i)
+    {
+        const char *id, *tr;
+        size_t idLength, trLength;
+        if (!r.String(origTable, first + i, id, idLength) || !r.String(transTable, first + i, tr, trLength))
+        {
+            entries[i].ok = false;
+            return;
+        }
+        entries[i] = DecodeEntry(id, idLength, tr, trLength, decoder);
+    }, options);
+
+    m_items.reserve(entries.size());
+    int id = 1;
+    for (auto& e: entries)
+    {
+        if (!e.ok)
+            throw invalid();
+
+        auto d = CreateItem<POCatalogItem>();
+        d->SetId(id++);
+        d->SetString(std::move(e.msgid));
+        if (e.hasPlural)
+            d->SetPluralString(std::move(e.plural));
+        if (e.hasContext)
+            d->SetContext(std::move(e.context));
+        d->SetTranslations(std::move(e.translations));
+        AddItem(d);
+    }
+
+    // revision 1 files may have system-dependent strings (e.g. with <PRIu64>),
+    // in separate tables, which aren't supported:
+    if ((revision & 0xffff) >= 1 && r.size() >= MO_SYSDEP_STRINGS_OFFSET + sizeof(uint32_t) && r.U32(MO_SYSDEP_STRINGS_OFFSET) > 0)
+        wxLogTrace("poedit", "ignoring system-dependent strings in %s", mo_file);
+
+    // MO files are always valid UTF-8 after loading:
+    m_header.Charset = "UTF-8";
+    m_fileName = mo_file;
+    m_isOk = true;
+}
+
+
+bool MOCatalog::Save(const wxString& filename, bool save_mo,
+                     ValidationResults& validation_results,
+                     CompilationStatus& mo_compilation_status)
+{
+    if (wxFileName(filename).GetExt().Lower() != "mo")
+        return POCatalog::Save(filename, save_mo, validation_results, mo_compilation_status);
+
+    // saving the MO file itself compiles the translations into it again:
+    return CompileToMO(filename, validation_results, mo_compilation_status);
+}
@@ -0,0 +1,60 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_catalog_mo_h
+#define Poedit_catalog_mo_h
+
+#include "catalog_po.h"
+
+
+/**
+    Compiled gettext MO file, opened for inspecting or converting to PO.
+
+    The file is memory-mapped and its string tables are decoded directly
+    from the mapping, in parallel chunks. There's no text to parse, so even
+    huge files open almost instantly.
+
+    MO files only contain translated entries, without comments, references
+    or flags, so that's all the catalog has. Saving it into a file with the
+    .mo extension compiles it again; any other name (typically .po, via
+    Save As) writes a PO file.
+ */
+class MOCatalog : public POCatalog
+{
+public:
+    /// Loads @a mo_file; throws Exception if it isn't a valid MO file
+    explicit MOCatalog(const wxString& mo_file);
+
+    static bool CanLoadFile(const wxString& extension) { return extension == "mo"; }
+
+    bool Save(const wxString& filename, bool save_mo,
+              ValidationResults& validation_results,
+              CompilationStatus& mo_compilation_status) override;
+
+private:
+    void LoadMO(const wxString& mo_file);
+};
+
+#endif // Poedit_catalog_mo_h
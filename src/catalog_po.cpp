@@ -24,16 +24,23 @@
  */
 
 #include "catalog_po.h"
+#include "catalog_cache.h"
 
+#include "concurrency.h"
 #include "configuration.h"
 #include "errors.h"
 #include "extractors/extractor.h"
 #include "gexecute.h"
+#include "gettext_validation.h"
+#include "json_bundle_writer.h"
+#include "mo_writer.h"
 #include "qa_checks.h"
 #include "str_helpers.h"
+#include "tracing.h"
 #include "utility.h"
 #include "version.h"
 #include "language.h"
+#include "tm/fuzzy_match.h"
 
 #include <stdio.h>
 #include <wx/utils.h>
@@ -41,15 +48,21 @@
 #include <wx/log.h>
 #include <wx/intl.h>
 #include <wx/datetime.h>
-#include <wx/config.h>
 #include <wx/textfile.h>
 #include <wx/stdpaths.h>
 #include <wx/strconv.h>
 #include <wx/memtext.h>
 #include <wx/filename.h>
+#include <wx/file.h>
+#include <wx/ffile.h>
+#include <wx/thread.h>
 
-#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
+#include <mutex>
+#include <thread>
+#include <climits>
 
 #ifdef __WXOSX__
 #import <Foundation/Foundation.h>
@@ -67,28 +80,67 @@
 namespace
 {
 
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline boost::string_view TrimRight(boost::string_view s)
+{
+    while (!s.empty() && IsSpace(s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+inline boost::string_view Strip(boost::string_view s)
+{
+    while (!s.empty() && IsSpace(s.front()))
+        s.remove_prefix(1);
+    return TrimRight(s);
+}
+
+// Removes the last character (i.e. closing quote) of a quoted value
+inline boost::string_view RemoveLast(boost::string_view s)
+{
+    if (!s.empty())
+        s.remove_suffix(1);
+    return s;
+}
+
+// Number of characters (code points) in an UTF-8 string
+inline size_t CountChars(boost::string_view s)
+{
+    size_t count = 0;
+    for (auto c: s)
+    {
+        if ((c & 0xC0) != 0x80)
+            count++;
+    }
+    return count;
+}
+
 // If input begins with pattern, fill output with end of input (without
 // pattern; strips trailing spaces) and return true.  Return false otherwise
 // and don't touch output. Is permissive about whitespace in the input:
 // a space (' ') in pattern will match any number of any whitespace characters
 // on that position in input.
-bool ReadParam(const wxString& input, const wxString& pattern, wxString& output)
+bool ReadParam(boost::string_view input, boost::string_view pattern, boost::string_view& output)
 {
     if (input.size() < pattern.size())
         return false;
 
-    unsigned in_pos = 0;
-    unsigned pat_pos = 0;
+    size_t in_pos = 0;
+    size_t pat_pos = 0;
     while (pat_pos < pattern.size() && in_pos < input.size())
     {
-        const wxChar pat = pattern[pat_pos++];
+        const char pat = pattern[pat_pos++];
 
-        if (pat == _T(' '))
+        if (pat == ' ')
         {
-            if (!wxIsspace(input[in_pos++]))
+            if (!IsSpace(input[in_pos++]))
                 return false;
 
-            while (wxIsspace(input[in_pos]))
+            while (in_pos < input.size() && IsSpace(input[in_pos]))
             {
                 in_pos++;
                 if (in_pos == input.size())
@@ -106,56 +158,364 @@ bool ReadParam(const wxString& input, const wxString& pattern, wxString& output)
     if (pat_pos < pattern.size()) // pattern not fully matched
         return false;
 
-    output = input.Mid(in_pos);
-    output.Trim(true); // trailing whitespace
+    output = TrimRight(input.substr(in_pos));
     return true;
 }
 
+// Prefixes of entries' metadata lines, whose decoding may be deferred:
+const boost::string_view prefix_autocomments("#. ");
+const boost::string_view prefix_autocomments2("#."); // account for empty auto comments
+const boost::string_view prefix_references("#: ");
+const boost::string_view prefix_prev_msgid("#| ");
 
-// Checks if the file was loaded correctly, i.e. that non-empty lines
-// ended up non-empty in memory, after doing charset conversion in
-// wxTextFile. This detects for example files that claim they are in UTF-8
-// while in fact they are not.
-bool VerifyFileCharset(const wxTextFile& f, const wxString& filename,
-                       const wxString& charset)
+
+// Types of lines in PO files, as recognized by LexLine()
+enum class POLineType
 {
-    wxTextFile f2;
+    Other,              // unrecognized, skipped
+    Comment,            // any other line starting with '#', e.g. translator's comment
+    Flags,              // #, flags
+    ExtractedComment,   // #. comment
+    Reference,          // #: reference
+    PrevMsgid,          // #| msgid "previous"
+    Deleted,            // #~ obsolete entry's line
+    Msgctxt,            // msgctxt "...
+    Msgid,              // msgid "...
+    MsgidPlural,        // msgid_plural "...
+    Msgstr,             // msgstr "...
+    MsgstrPlural        // msgstr[...
+};
 
-    if (!f2.Open(filename, wxConvISO8859_1))
-        return false;
+struct POLine
+{
+    POLineType type;
+    // rest of the line after the keyword, as returned by ReadParam(); for
+    // quoted values, this is the string including the closing quote
+    boost::string_view value;
+};
+
+// Classifies a (stripped) line of a PO file. Only the keyword the line can
+// possibly start with, as determined from its first bytes, is compared, with
+// the same result as trying ReadParam() with all of them in turn would have.
+POLine LexLine(boost::string_view line)
+{
+    static const boost::string_view prefix_flags("#, ");
+    static const boost::string_view prefix_msgctxt("msgctxt \"");
+    static const boost::string_view prefix_msgid("msgid \"");
+    static const boost::string_view prefix_msgid_plural("msgid_plural \"");
+    static const boost::string_view prefix_msgstr("msgstr \"");
+    static const boost::string_view prefix_msgstr_plural("msgstr[");
+
+    POLine out {POLineType::Other, boost::string_view()};
+    auto match = [&out, line](POLineType type, boost::string_view pattern)
+    {
+        if (!ReadParam(line, pattern, out.value))
+            return false;
+        out.type = type;
+        return true;
+    };
+
+    if (line.empty())
+        return out;
 
-    if (f.GetLineCount() != f2.GetLineCount())
+    if (line[0] == '#')
     {
-        int linesCount = (int)f2.GetLineCount() - (int)f.GetLineCount();
-        wxLogError(wxPLURAL(L"%i line of file “%s” was not loaded correctly.",
-                            L"%i lines of file “%s” were not loaded correctly.",
-                            linesCount),
-                   linesCount,
-                   filename.c_str());
+        out.type = POLineType::Comment; // unless it's something more specific
+        if (line.size() < 2)
+            return out;
+        switch (line[1])
+        {
+            case ',':
+                match(POLineType::Flags, prefix_flags);
+                break;
+            case '.':
+                match(POLineType::ExtractedComment, prefix_autocomments) ||
+                match(POLineType::ExtractedComment, prefix_autocomments2);
+                break;
+            case ':':
+                match(POLineType::Reference, prefix_references);
+                break;
+            case '|':
+                match(POLineType::PrevMsgid, prefix_prev_msgid);
+                break;
+            case '~':
+                out.type = POLineType::Deleted;
+                out.value = TrimRight(line.substr(2));
+                break;
+            default:
+                break;
+        }
+    }
+    else if (line[0] == 'm' && line.size() >= prefix_msgid.size())
+    {
+        // "msgctxt", "msgid", "msgid_plural", "msgstr" and "msgstr[" differ here:
+        switch (line[3])
+        {
+            case 'c':
+                match(POLineType::Msgctxt, prefix_msgctxt);
+                break;
+            case 'i':
+                if (line[5] == '_')
+                    match(POLineType::MsgidPlural, prefix_msgid_plural);
+                else
+                    match(POLineType::Msgid, prefix_msgid);
+                break;
+            case 's':
+                if (line[6] == '[')
+                    match(POLineType::MsgstrPlural, prefix_msgstr_plural);
+                else
+                    match(POLineType::Msgstr, prefix_msgstr);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return out;
+}
+
+// Given the value of a POLineType::MsgstrPlural line, i.e. the text after
+// "msgstr[", reads the quoted string following the index into @a value.
+bool ReadPluralMsgstr(boost::string_view afterKeyword, boost::string_view& value)
+{
+    static const boost::string_view prefix_after_index(" \"");
+
+    const auto bracket = afterKeyword.find(']');
+    if (bracket == boost::string_view::npos)
         return false;
+    return ReadParam(afterKeyword.substr(bracket + 1), prefix_after_index, value);
+}
+
+
+// Extracted comments of msgcat's conflicting entries, see POLoadParser::OnEntry
+inline bool IsMsgcatConflictMarker(boost::string_view s)
+{
+    static const boost::string_view marker("#-#-#-#-#");
+    return s.starts_with(marker) && s.ends_with(marker);
+}
+
+
+// Appends C-unescaped content of a quoted PO string to out.
+// Works on UTF-8 bytes, which is safe because escapes are pure ASCII.
+void AppendUnescaped(std::string& out, boost::string_view str)
+{
+    auto backslash = str.find('\\');
+    if (backslash == boost::string_view::npos)
+    {
+        out.append(str.data(), str.size());
+        return;
+    }
+
+    out.reserve(out.size() + str.size());
+    size_t runStart = 0;
+    while (backslash != boost::string_view::npos)
+    {
+        // copy everything up to the escape sequence at once:
+        out.append(str.data() + runStart, backslash - runStart);
+        if (backslash + 1 == str.size())
+        {
+            out += '\\';
+            return;
+        }
+
+        const char e = str[backslash + 1];
+        switch (e)
+        {
+            case 'a': out += '\a'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'v': out += '\v'; break;
+            case '\\':
+            case '"':
+            case '\'':
+            case '?':
+                out += e;
+                break;
+            default:
+                out += '\\';
+                out += e;
+                break;
+        }
+        runStart = backslash + 2;
+        backslash = str.find('\\', runStart);
     }
+    out.append(str.data() + runStart, str.size() - runStart);
+}
+
+
+// Conversions of parsed UTF-8 data into the types used by Catalog:
+
+inline wxString ToWx(boost::string_view s)
+{
+    // most entries are ASCII, which doesn't need UTF-8 decoding:
+    if (str::is_ascii(s.data(), s.size()))
+        return wxString::FromAscii(s.data(), s.size());
+    return wxString::FromUTF8Unchecked(s.data(), s.size());
+}
+
+template<typename T>
+inline wxArrayString ToWxArray(const std::vector<T>& items)
+{
+    wxArrayString out;
+    out.reserve(items.size());
+    for (auto& i: items)
+        out.push_back(ToWx(i));
+    return out;
+}
+
+
+// Reports lines that weren't decoded correctly by POFileReader, i.e. non-empty
+// lines whose charset conversion failed. This detects for example files that
+// claim they are in UTF-8 while in fact they are not.
+bool VerifyFileCharset(const std::vector<size_t>& corruptedLines, const wxString& filename,
+                       const wxString& charset)
+{
+    for (auto i: corruptedLines)
+    {
+        wxLogError(
+            _(L"Line %d of file “%s” is corrupted (not valid %s data)."),
+            int(i), filename.c_str(), charset.c_str());
+    }
+
+    return corruptedLines.empty();
+}
+
+
+// Splitting of large files into chunks that can be parsed independently:
+
+// Don't bother with parallel parsing of chunks smaller than this:
+const size_t MIN_PARSING_CHUNK_SIZE = 1024 * 1024;
+
+struct POChunk
+{
+    const char *begin;
+    const char *end;
+};
+
+// Returns the beginning of the line after the one at p
+inline const char *NextLineStart(const char *p, const char *end)
+{
+    while (p < end && *p != '\n' && *p != '\r')
+        ++p;
+    if (p < end)
+    {
+        if (*p == '\r' && p + 1 < end && p[1] == '\n')
+            p += 2;
+        else
+            p++;
+    }
+    return p;
+}
+
+// Counts lines the same way POFileReader splits them
+size_t CountLines(const char *begin, const char *end)
+{
+    size_t count = 0;
+    for (auto p = begin; p < end; p = NextLineStart(p, end))
+        count++;
+    return count;
+}
+
+// Finds the first entry that begins after pos and can be parsed on its own,
+// i.e. one that is preceded by a blank line and a complete entry (one that
+// ended with msgstr or was obsolete), so that no state carries over to it.
+// Returns end if there's no such place.
+const char *FindEntryBoundary(const char *pos, const char *end)
+{
+    enum { Unknown, Complete, Incomplete } state = Unknown;
+    bool sawBlank = false;
 
-    bool ok = true;
-    size_t cnt = f.GetLineCount();
-    for (size_t i = 0; i < cnt; i++)
+    for (pos = NextLineStart(pos, end); pos < end; )
     {
-        if (f[i].empty() && !f2[i].empty()) // wxMBConv conversion failed
+        const char *next = NextLineStart(pos, end);
+        const auto line = Strip(boost::string_view(pos, next - pos));
+
+        if (line.empty())
         {
-            wxLogError(
-                _(L"Line %d of file “%s” is corrupted (not valid %s data)."),
-                int(i), filename.c_str(), charset.c_str());
-            ok = false;
+            sawBlank = true;
         }
+        else if (line[0] != '"') // continuation lines don't change anything
+        {
+            // Obsolete entries must start with "#~ msgid" line, otherwise the
+            // lines would be included into the previous obsolete entry:
+            const bool canStartEntry = line[0] == '#'
+                                       ? (!line.starts_with("#~") || line.starts_with("#~ msgid"))
+                                       : (line.starts_with("msgid") || line.starts_with("msgctxt"));
+            if (sawBlank && state == Complete && canStartEntry)
+                return pos;
+
+            state = (line.starts_with("msgstr") || line.starts_with("#~")) ? Complete : Incomplete;
+            sawBlank = false;
+        }
+
+        pos = next;
+    }
+
+    return end;
+}
+
+// Splits file data into chunks for parallel parsing, if it's large enough
+std::vector<POChunk> SplitIntoParsingChunks(const char *data, size_t length)
+{
+    const char *end = data + length;
+
+    size_t count = std::min(size_t(std::thread::hardware_concurrency()), length / MIN_PARSING_CHUNK_SIZE);
+    if (count < 2)
+        return {{data, end}};
+
+    const size_t chunkSize = length / count;
+    std::vector<POChunk> chunks;
+    const char *begin = data;
+    for (size_t i = 1; i < count && begin < end; i++)
+    {
+        const char *target = data + i * chunkSize;
+        if (target <= begin)
+            continue;
+        const char *boundary = FindEntryBoundary(target, end);
+        chunks.push_back({begin, boundary});
+        begin = boundary;
     }
+    if (begin < end)
+        chunks.push_back({begin, end});
 
-    return ok;
+    return chunks;
 }
 
 
-wxTextFileType GetFileCRLFFormat(wxTextFile& po_file)
+wxTextFileType GetFileCRLFFormat(const char *data, size_t len)
 {
-    wxLogNull null;
-    auto crlf = po_file.GuessType();
+    // This mirrors wxTextBuffer::GuessType(), but works on raw data:
+    size_t nDos = 0, nUnix = 0, nMac = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] == '\n')
+        {
+            nUnix++;
+        }
+        else if (data[i] == '\r')
+        {
+            if (i + 1 < len && data[i + 1] == '\n')
+            {
+                nDos++;
+                i++;
+            }
+            else
+            {
+                nMac++;
+            }
+        }
+    }
+
+    auto crlf = wxTextBuffer::typeDefault;
+    if (nDos > nUnix && nDos > nMac)
+        crlf = wxTextFileType_Dos;
+    else if (nUnix > nDos && nUnix > nMac)
+        crlf = wxTextFileType_Unix;
+    else if (nMac > nDos && nMac > nUnix)
+        crlf = wxTextFileType_Mac;
 
     // Discard any unsupported setting. In particular, we ignore "Mac"
     // line endings, because the ancient OS 9 systems aren't used anymore,
@@ -169,16 +529,35 @@ wxTextFileType GetFileCRLFFormat(wxTextFile& po_file)
     return crlf;
 }
 
+int GetDesiredWrappingWidth(int existingWrapping)
+{
+    auto settings = Config::Current();
+
+    int wrapping = POCatalog::DEFAULT_WRAPPING;
+    if (settings->keepCRLF)
+        wrapping = existingWrapping;
+
+    if (wrapping == POCatalog::DEFAULT_WRAPPING)
+    {
+        if (settings->wrapPOFiles)
+            wrapping = settings->wrapPOFilesWidth;
+        else
+            wrapping = POCatalog::NO_WRAPPING;
+    }
+
+    return wrapping;
+}
+
 wxTextFileType GetDesiredCRLFFormat(wxTextFileType existingCRLF)
 {
-    if (existingCRLF != wxTextFileType_None && wxConfigBase::Get()->ReadBool("keep_crlf", true))
+    auto settings = Config::Current();
+    if (existingCRLF != wxTextFileType_None && settings->keepCRLF)
     {
         return existingCRLF;
     }
     else
     {
-        wxString format = wxConfigBase::Get()->Read("crlf_format", "unix");
-        if (format == "win")
+        if (settings->crlfWindows)
             return wxTextFileType_Dos;
         else /* "unix" or obsolete settings */
             return wxTextFileType_Unix;
@@ -188,139 +567,230 @@ wxTextFileType GetDesiredCRLFFormat(wxTextFileType existingCRLF)
 } // anonymous namespace
 
 
+// ----------------------------------------------------------------------
+// POFileReader
+// ----------------------------------------------------------------------
+
+POFileReader::POFileReader(const char *data, size_t length, const wxString& charset)
+    : m_begin(data), m_end(data + length), m_next(data),
+      m_lineBegin(data), m_lineEnd(data),
+      m_currentLine(0)
+{
+    // skip UTF-8 BOM, if present:
+    if (length >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+        m_begin = m_next = m_lineBegin = m_lineEnd = data + 3;
+
+    const wxString cs = charset.Lower();
+    m_isUTF8 = (cs == "utf-8" || cs == "utf8");
+    if (!m_isUTF8)
+    {
+        std::unique_ptr<wxCSConv> conv(new wxCSConv(charset));
+        if (conv->IsOk())
+            m_conv = std::move(conv);
+    }
+}
+
+boost::string_view POFileReader::GetFirstLine()
+{
+    m_next = m_lineBegin = m_lineEnd = m_begin;
+    m_currentLine = 0;
+    m_corruptedLines.clear();
+    m_convertedLines.clear();
+    if (IsEmpty())
+        return boost::string_view();
+
+    // Pretend we're just before the first line:
+    m_currentLine = (size_t)-1;
+    return GetNextLine();
+}
+
+boost::string_view POFileReader::GetNextLine()
+{
+    if (m_next == m_end)
+        return boost::string_view();
+
+    const char *start = m_next;
+    const char *end = start;
+    while (end < m_end && *end != '\n' && *end != '\r')
+        ++end;
+
+    // skip the line terminator, handling all of \n, \r\n and \r:
+    m_next = end;
+    if (m_next < m_end)
+    {
+        if (*m_next == '\r' && m_next + 1 < m_end && m_next[1] == '\n')
+            m_next += 2;
+        else
+            m_next++;
+    }
+
+    m_lineBegin = start;
+    m_lineEnd = end;
+    m_currentLine++;
+    return DecodeLine(start, end);
+}
+
+boost::string_view POFileReader::DecodeLine(const char *start, const char *end)
+{
+    const size_t length = end - start;
+    if (length == 0)
+        return boost::string_view();
+
+    if (m_isUTF8)
+    {
+        // no conversion needed, just point into the file's data:
+        if (str::is_valid_utf8(start, length))
+            return boost::string_view(start, length);
+    }
+    else
+    {
+        // Pure ASCII lines are the same in all charsets usable in PO files,
+        // only convert those that aren't:
+        if (std::all_of(start, end, [](char c){ return (c & 0x80) == 0; }))
+            return boost::string_view(start, length);
+
+        wxString s(start, *m_conv, length);
+        if (!s.empty())
+        {
+            m_convertedLines.emplace_back(s.utf8_str());
+            return m_convertedLines.back();
+        }
+    }
+
+    // conversion failed:
+    m_corruptedLines.push_back(m_currentLine);
+    return boost::string_view();
+}
+
+
 // ----------------------------------------------------------------------
 // Parsers
 // ----------------------------------------------------------------------
 
 bool POCatalogParser::Parse()
 {
-    static const wxString prefix_flags(wxS("#, "));
-    static const wxString prefix_autocomments(wxS("#. "));
-    static const wxString prefix_autocomments2(wxS("#.")); // account for empty auto comments
-    static const wxString prefix_references(wxS("#: "));
-    static const wxString prefix_prev_msgid(wxS("#| "));
-    static const wxString prefix_msgctxt(wxS("msgctxt \""));
-    static const wxString prefix_msgid(wxS("msgid \""));
-    static const wxString prefix_msgid_plural(wxS("msgid_plural \""));
-    static const wxString prefix_msgstr(wxS("msgstr \""));
-    static const wxString prefix_msgstr_plural(wxS("msgstr["));
-    static const wxString prefix_deleted(wxS("#~"));
-    static const wxString prefix_deleted_msgid(wxS("#~ msgid"));
-
-    if (m_textFile->GetLineCount() == 0)
+    static const boost::string_view prefix_deleted("#~");
+    static const boost::string_view prefix_deleted_msgid("#~ msgid");
+
+    if (m_reader.IsEmpty())
         return false;
 
-    wxString line, dummy;
-    wxString mflags, mstr, msgid_plural, mcomment;
-    wxArrayString mrefs, mextractedcomments, mtranslations;
-    wxArrayString msgid_old;
+    // Everything is kept as UTF-8 data (mostly pointing directly into the
+    // file's content) and only converted to wxString when passing an entry
+    // to OnEntry() or OnDeletedEntry().
+    boost::string_view line, dummy;
+    std::string mflags, mstr, msgid_plural, mcomment;
+    std::vector<boost::string_view> mrefs, mextractedcomments, msgid_old;
+    std::vector<std::string> mtranslations;
     bool has_plural = false;
     bool has_context = false;
-    wxString msgctxt;
+    std::string msgctxt;
     unsigned mlinenum = 0;
 
-    line = m_textFile->GetFirstLine();
+    // Entries' metadata are converted only if they won't be decoded lazily
+    // from the entry's raw text, see POCatalogItem::LoadDeferredMetadata():
+    auto metadata = [this](const std::vector<boost::string_view>& lines)
+    {
+        return m_entryMetadataDeferred ? wxArrayString() : ToWxArray(lines);
+    };
+    auto canDeferMetadata = [this](const std::vector<boost::string_view>& extractedComments)
+    {
+        if (!m_deferMetadata || m_ignoreTranslations)
+            return false;
+        for (auto& c: extractedComments)
+        {
+            if (IsMsgcatConflictMarker(c))
+                return false;  // not the original content, can't be reused
+        }
+        return true;
+    };
+
+    line = m_reader.GetFirstLine();
     if (line.empty()) line = ReadTextLine();
 
+    // raw text of an entry spans from its first line to the last line read
+    // before the one following it, see GetEntryRawText()
+    auto startEntry = [=]{
+        m_entryRawBegin = m_reader.GetCurrentLineRawBegin();
+        m_entryFirstLine = m_reader.GetCurrentLine();
+    };
+    auto finishEntry = [=]{ m_entryRawBegin = nullptr; };
+
     while (!line.empty())
     {
+        if (!m_entryRawBegin)
+            startEntry();
+
         // ignore empty special tags (except for extracted comments which we
         // DO want to preserve):
-        while (line.length() == 2 && *line.begin() == '#' && (line[1] == ',' || line[1] == ':' || line[1] == '|'))
+        while (line.length() == 2 && line[0] == '#' && (line[1] == ',' || line[1] == ':' || line[1] == '|'))
             line = ReadTextLine();
 
+        auto token = LexLine(line);
+
         // flags:
         // Can't we have more than one flag, now only the last is kept ...
-        if (ReadParam(line, prefix_flags, dummy))
+        if (token.type == POLineType::Flags)
         {
-            static wxString prefix_flags_partial(wxS(", "));
-            mflags = prefix_flags_partial + dummy;
+            mflags = ", ";
+            mflags.append(token.value.data(), token.value.size());
             line = ReadTextLine();
+            token = LexLine(line);
         }
 
         // auto comments:
-        if (ReadParam(line, prefix_autocomments, dummy) || ReadParam(line, prefix_autocomments2, dummy))
+        if (token.type == POLineType::ExtractedComment)
         {
-            mextractedcomments.Add(dummy);
+            mextractedcomments.push_back(token.value);
             line = ReadTextLine();
         }
 
         // references:
-        else if (ReadParam(line, prefix_references, dummy))
+        else if (token.type == POLineType::Reference)
         {
             // Just store the references unmodified, we don't modify this
             // data anywhere.
-            mrefs.push_back(dummy);
+            mrefs.push_back(token.value);
             line = ReadTextLine();
         }
 
         // previous msgid value:
-        else if (ReadParam(line, prefix_prev_msgid, dummy))
+        else if (token.type == POLineType::PrevMsgid)
         {
-            msgid_old.Add(dummy);
+            msgid_old.push_back(token.value);
             line = ReadTextLine();
         }
 
         // msgctxt:
-        else if (ReadParam(line, prefix_msgctxt, dummy))
+        else if (token.type == POLineType::Msgctxt)
         {
             has_context = true;
-            msgctxt = UnescapeCString(dummy.RemoveLast());
-            while (!(line = ReadTextLine()).empty())
-            {
-                if (line[0u] == _T('\t'))
-                    line.Remove(0, 1);
-                if (line[0u] == _T('"') && line.Last() == _T('"'))
-                {
-                    msgctxt += UnescapeCString(line.Mid(1, line.Length() - 2));
-                    PossibleWrappedLine();
-                }
-                else
-                    break;
-            }
+            msgctxt.clear();
+            AppendUnescaped(msgctxt, RemoveLast(token.value));
+            line = ReadContinuationLines(msgctxt);
         }
 
         // msgid:
-        else if (ReadParam(line, prefix_msgid, dummy))
+        else if (token.type == POLineType::Msgid)
         {
-            mstr = UnescapeCString(dummy.RemoveLast());
-            mlinenum = unsigned(m_textFile->GetCurrentLine() + 1);
-            while (!(line = ReadTextLine()).empty())
-            {
-                if (line[0u] == wxS('\t'))
-                    line.Remove(0, 1);
-                if (line[0u] == wxS('"') && line.Last() == wxS('"'))
-                {
-                    mstr += UnescapeCString(line.Mid(1, line.Length() - 2));
-                    PossibleWrappedLine();
-                }
-                else
-                    break;
-            }
+            mstr.clear();
+            AppendUnescaped(mstr, RemoveLast(token.value));
+            mlinenum = unsigned(m_reader.GetCurrentLine() + 1);
+            line = ReadContinuationLines(mstr);
         }
 
         // msgid_plural:
-        else if (ReadParam(line, prefix_msgid_plural, dummy))
+        else if (token.type == POLineType::MsgidPlural)
         {
-            msgid_plural = UnescapeCString(dummy.RemoveLast());
+            msgid_plural.clear();
+            AppendUnescaped(msgid_plural, RemoveLast(token.value));
             has_plural = true;
-            mlinenum = unsigned(m_textFile->GetCurrentLine() + 1);
-            while (!(line = ReadTextLine()).empty())
-            {
-                if (line[0u] == _T('\t'))
-                    line.Remove(0, 1);
-                if (line[0u] == _T('"') && line.Last() == _T('"'))
-                {
-                    msgid_plural += UnescapeCString(line.Mid(1, line.Length() - 2));
-                    PossibleWrappedLine();
-                }
-                else
-                    break;
-            }
+            mlinenum = unsigned(m_reader.GetCurrentLine() + 1);
+            line = ReadContinuationLines(msgid_plural);
         }
 
         // msgstr:
-        else if (ReadParam(line, prefix_msgstr, dummy))
+        else if (token.type == POLineType::Msgstr)
         {
             if (has_plural)
             {
@@ -328,20 +798,10 @@ bool POCatalogParser::Parse()
                 return false;
             }
 
-            wxString str = UnescapeCString(dummy.RemoveLast());
-            while (!(line = ReadTextLine()).empty())
-            {
-                if (line[0u] == _T('\t'))
-                    line.Remove(0, 1);
-                if (line[0u] == _T('"') && line.Last() == _T('"'))
-                {
-                    str += UnescapeCString(line.Mid(1, line.Length() - 2));
-                    PossibleWrappedLine();
-                }
-                else
-                    break;
-            }
-            mtranslations.Add(str);
+            std::string str;
+            AppendUnescaped(str, RemoveLast(token.value));
+            line = ReadContinuationLines(str);
+            mtranslations.push_back(std::move(str));
 
             bool shouldIgnore = m_ignoreHeader && (mstr.empty() && !has_context);
             if ( shouldIgnore )
@@ -353,26 +813,33 @@ bool POCatalogParser::Parse()
                 if (!mstr.empty() && m_ignoreTranslations)
                     mtranslations.clear();
 
-                if (!OnEntry(mstr, wxEmptyString, false,
-                             has_context, msgctxt,
-                             mtranslations,
-                             mflags, mrefs, mcomment, mextractedcomments, msgid_old,
+                m_entryMetadataDeferred = canDeferMetadata(mextractedcomments);
+                if (!OnEntry(ToWx(mstr), wxEmptyString, false,
+                             has_context, ToWx(msgctxt),
+                             ToWxArray(mtranslations),
+                             ToWx(mflags), metadata(mrefs), ToWx(mcomment),
+                             metadata(mextractedcomments), metadata(msgid_old),
                              mlinenum))
                 {
                     return false;
                 }
             }
 
-            mcomment = mstr = msgid_plural = msgctxt = mflags = wxEmptyString;
+            mcomment.clear();
+            mstr.clear();
+            msgid_plural.clear();
+            msgctxt.clear();
+            mflags.clear();
             has_plural = has_context = false;
-            mrefs.Clear();
-            mextractedcomments.Clear();
-            mtranslations.Clear();
-            msgid_old.Clear();
+            mrefs.clear();
+            mextractedcomments.clear();
+            mtranslations.clear();
+            msgid_old.clear();
+            finishEntry();
         }
 
         // msgstr[i]:
-        else if (ReadParam(line, prefix_msgstr_plural, dummy))
+        else if (token.type == POLineType::MsgstrPlural)
         {
             if (!has_plural)
             {
@@ -380,93 +847,92 @@ bool POCatalogParser::Parse()
                 return false;
             }
 
-            wxString idx = dummy.BeforeFirst(wxS(']'));
-            wxString label_prefix = prefix_msgstr_plural + idx + wxS("] \"");
-
-            while (ReadParam(line, label_prefix, dummy))
+            boost::string_view value;
+            while (token.type == POLineType::MsgstrPlural && ReadPluralMsgstr(token.value, value))
             {
-                wxString str = UnescapeCString(dummy.RemoveLast());
-
-                while (!(line=ReadTextLine()).empty())
-                {
-                    line.Trim(/*fromRight=*/false);
-                    if (line[0u] == wxS('"') && line.Last() == wxS('"'))
-                    {
-                        str += UnescapeCString(line.Mid(1, line.Length() - 2));
-                        PossibleWrappedLine();
-                    }
-                    else
-                    {
-                        if (ReadParam(line, prefix_msgstr_plural, dummy))
-                        {
-                            idx = dummy.BeforeFirst(wxS(']'));
-                            label_prefix = prefix_msgstr_plural + idx + wxS("] \"");
-                        }
-                        break;
-                    }
-                }
-                mtranslations.Add(str);
+                std::string str;
+                AppendUnescaped(str, RemoveLast(value));
+                line = ReadContinuationLines(str);
+                token = LexLine(line);
+                mtranslations.push_back(std::move(str));
             }
 
-            if (!OnEntry(mstr, msgid_plural, true,
-                         has_context, msgctxt,
-                         mtranslations,
-                         mflags, mrefs, mcomment, mextractedcomments, msgid_old,
+            m_entryMetadataDeferred = canDeferMetadata(mextractedcomments);
+            if (!OnEntry(ToWx(mstr), ToWx(msgid_plural), true,
+                         has_context, ToWx(msgctxt),
+                         ToWxArray(mtranslations),
+                         ToWx(mflags), metadata(mrefs), ToWx(mcomment),
+                         metadata(mextractedcomments), metadata(msgid_old),
                          mlinenum))
             {
                 return false;
             }
 
-            mcomment = mstr = msgid_plural = msgctxt = mflags = wxEmptyString;
+            mcomment.clear();
+            mstr.clear();
+            msgid_plural.clear();
+            msgctxt.clear();
+            mflags.clear();
             has_plural = has_context = false;
-            mrefs.Clear();
-            mextractedcomments.Clear();
-            mtranslations.Clear();
-            msgid_old.Clear();
+            mrefs.clear();
+            mextractedcomments.clear();
+            mtranslations.clear();
+            msgid_old.clear();
+            finishEntry();
         }
 
         // deleted lines:
-        else if (ReadParam(line, prefix_deleted, dummy))
+        else if (token.type == POLineType::Deleted)
         {
-            wxArrayString deletedLines;
-            deletedLines.Add(line);
-            mlinenum = unsigned(m_textFile->GetCurrentLine() + 1);
+            std::vector<boost::string_view> deletedLines;
+            deletedLines.push_back(line);
+            mlinenum = unsigned(m_reader.GetCurrentLine() + 1);
             while (!(line = ReadTextLine()).empty())
             {
                 // if line does not start with "#~" anymore, stop reading
-                if (!ReadParam(line, prefix_deleted, dummy))
+                if (!line.starts_with(prefix_deleted))
                     break;
                 // if the line starts with "#~ msgid", we skipped an empty line
                 // and it's a new entry, so stop reading too (see bug #329)
                 if (ReadParam(line, prefix_deleted_msgid, dummy))
                     break;
 
-                deletedLines.Add(line);
+                deletedLines.push_back(line);
             }
-            if (!OnDeletedEntry(deletedLines,
-                                mflags, mrefs, mcomment, mextractedcomments, mlinenum))
-            {
+            // obsolete entries are rarely needed, so they are only decoded from
+            // the raw text when they are, see POCatalogDeletedData::DeferContent():
+            m_entryMetadataDeferred = m_deferMetadata && !m_ignoreTranslations;
+            const bool ok = m_entryMetadataDeferred
+                            ? OnDeletedEntry(wxArrayString(), wxString(), wxArrayString(), wxString(), wxArrayString(), mlinenum)
+                            : OnDeletedEntry(ToWxArray(deletedLines),
+                                             ToWx(mflags), ToWxArray(mrefs), ToWx(mcomment),
+                                             ToWxArray(mextractedcomments), mlinenum);
+            if (!ok)
                 return false;
-            }
 
-            mcomment = mstr = msgid_plural = mflags = wxEmptyString;
+            mcomment.clear();
+            mstr.clear();
+            msgid_plural.clear();
+            mflags.clear();
             has_plural = false;
-            mrefs.Clear();
-            mextractedcomments.Clear();
-            mtranslations.Clear();
-            msgid_old.Clear();
+            mrefs.clear();
+            mextractedcomments.clear();
+            mtranslations.clear();
+            msgid_old.clear();
+            finishEntry();
         }
 
-        // comment:
-        else if (line[0u] == wxS('#'))
+        // comment (or a repeated flags line, which is skipped here):
+        else if (token.type == POLineType::Comment || token.type == POLineType::Flags)
         {
             bool readNewLine = false;
 
             while (!line.empty() &&
-                    line[0u] == wxS('#') &&
-                   (line.Length() < 2 || (line[1u] != wxS(',') && line[1u] != wxS(':') && line[1u] != wxS('.') && line[1u] != wxS('~') )))
+                    line[0] == '#' &&
+                   (line.length() < 2 || (line[1] != ',' && line[1] != ':' && line[1] != '.' && line[1] != '~' )))
             {
-                mcomment << line << wxS('\n');
+                mcomment.append(line.data(), line.size());
+                mcomment += '\n';
                 readNewLine = true;
                 line = ReadTextLine();
             }
@@ -485,29 +951,49 @@ bool POCatalogParser::Parse()
 }
 
 
-wxString POCatalogParser::ReadTextLine()
+boost::string_view POCatalogParser::ReadContinuationLines(std::string& str)
+{
+    boost::string_view line;
+    while (!(line = ReadTextLine()).empty())
+    {
+        if (line[0] != '"' || line.back() != '"')
+            break;
+
+        if (line.size() >= 2)
+            AppendUnescaped(str, line.substr(1, line.size() - 2));
+        PossibleWrappedLine();
+    }
+    return line;
+}
+
+
+boost::string_view POCatalogParser::ReadTextLine()
 {
+    // the line read previously is the last one consumed by the parser so far:
+    m_lastLineRawEnd = m_reader.GetCurrentLineRawEnd();
+    m_lastLineIndex = m_reader.GetCurrentLine();
+
     m_previousLineHardWrapped = m_lastLineHardWrapped;
     m_lastLineHardWrapped = false;
 
-    static const wxString msgid_alone(wxS("msgid \"\""));
-    static const wxString msgstr_alone(wxS("msgstr \"\""));
+    static const boost::string_view msgid_alone("msgid \"\"");
+    static const boost::string_view msgstr_alone("msgstr \"\"");
 
     for (;;)
     {
-        if (m_textFile->Eof())
-            return wxString();
+        if (m_reader.Eof())
+            return boost::string_view();
 
         // read next line and strip insignificant whitespace from it:
-        const auto& ln = m_textFile->GetNextLine();
+        const auto ln = m_reader.GetNextLine();
         if (ln.empty())
             continue;
 
         // gettext tools don't include (extracted) comments in wrapping, so they can't
         // be reliably used to detect file's wrapping either; just skip them.
-        if (!ln.StartsWith(wxS("#. ")) && !ln.StartsWith(wxS("# ")))
+        if (!ln.starts_with("#. ") && !ln.starts_with("# "))
         {
-            if (ln.EndsWith(wxS("\\n\"")))
+            if (ln.ends_with("\\n\""))
             {
                 // Similarly, lines ending with \n are always wrapped, so skip that too.
                 m_lastLineHardWrapped = true;
@@ -523,26 +1009,17 @@ wxString POCatalogParser::ReadTextLine()
                 // That "2" is to account for unwrappable comment lines: "#: somethinglong"
                 // See https://github.com/vslavik/poedit/issues/135
                 auto space = ln.find_last_of(' ');
-                if (space != wxString::npos && space > 2)
+                if (space != boost::string_view::npos && space > 2)
                 {
-                    m_detectedLineWidth = std::max(m_detectedLineWidth, (int)ln.size());
+                    m_detectedLineWidth = std::max(m_detectedLineWidth, (int)CountChars(ln));
                 }
             }
         }
 
-        if (wxIsspace(ln[0]) || wxIsspace(ln.Last()))
-        {
-            auto s = ln.Strip(wxString::both);
-            if (!s.empty())
-                return s;
-        }
-        else
-        {
-            return ln;
-        }
+        auto s = Strip(ln);
+        if (!s.empty())
+            return s;
     }
-
-    return wxString();
 }
 
 int POCatalogParser::GetWrappingWidth() const
@@ -558,8 +1035,8 @@ int POCatalogParser::GetWrappingWidth() const
 class POCharsetInfoFinder : public POCatalogParser
 {
     public:
-        POCharsetInfoFinder(wxTextFile *f)
-                : POCatalogParser(f), m_charset("UTF-8") {}
+        POCharsetInfoFinder(POFileReader& reader)
+                : POCatalogParser(reader), m_charset("UTF-8") {}
         wxString GetCharset() const { return m_charset; }
 
     protected:
@@ -594,36 +1071,139 @@ class POCharsetInfoFinder : public POCatalogParser
 
 
 
-class POLoadParser : public POCatalogParser
+class POStatisticsScanner : public POCatalogParser
 {
     public:
-        POLoadParser(POCatalog& c, wxTextFile *f)
-              : POCatalogParser(f),
-                FileIsValid(false),
-                m_catalog(c), m_nextId(1), m_seenHeaderAlready(false), m_collectMsgidText(true) {}
-
-        // true if the file is valid, i.e. has at least some data
-        bool FileIsValid;
-
-        Language GetMsgidLanguage()
+        POStatisticsScanner(POFileReader& reader, POCatalog::Statistics& stats)
+                : POCatalogParser(reader), m_stats(stats)
         {
-            auto lang = GetSpecifiedMsgidLanguage();
-            if (lang.IsValid())
-                return lang;
-
-            auto utf8 = m_allMsgidText.utf8_str();
-            lang = Language::TryDetectFromText(utf8.data(), utf8.length());
-            if (!lang.IsValid())
-                lang = Language::English();  // gettext historically assumes English
-            return lang;
+            m_deferMetadata = true;
         }
 
     protected:
-        Language GetSpecifiedMsgidLanguage()
-        {
-            auto x_srclang = m_catalog.Header().GetHeader("X-Source-Language");
-            if (x_srclang.empty())
-                x_srclang = m_catalog.m_header.GetHeader("X-Loco-Source-Locale");
+        POCatalog::Statistics& m_stats;
+
+        virtual bool OnEntry(const wxString& msgid,
+                             const wxString& msgid_plural,
+                             bool has_plural,
+                             bool has_context,
+                             const wxString& /*context*/,
+                             const wxArrayString& mtranslations,
+                             const wxString& flags,
+                             const wxArrayString& /*references*/,
+                             const wxString& /*comment*/,
+                             const wxArrayString& /*extractedComments*/,
+                             const wxArrayString& /*msgid_old*/,
+                             unsigned /*lineNumber*/)
+        {
+            if (msgid.empty() && !has_context)
+            {
+                // gettext header:
+                Catalog::HeaderData hdr;
+                hdr.FromString(mtranslations[0]);
+                m_stats.revisionDate = hdr.RevisionDate;
+                return true;
+            }
+
+            m_stats.all++;
+            // same logic as in CatalogItem::SetFlags() and SetTranslations():
+            const bool fuzzy = flags.find(wxS(", fuzzy")) != wxString::npos;
+            bool untranslated = false;
+            for (auto& t: mtranslations)
+            {
+                if (t.empty())
+                {
+                    untranslated = true;
+                    break;
+                }
+            }
+            if (fuzzy)
+                m_stats.fuzzy++;
+            if (untranslated)
+                m_stats.untranslated++;
+            // the source language isn't known without loading the file, so
+            // words are counted using language-neutral rules:
+            int words = (int)CountText(Language(), str::to_utf8(msgid)).words;
+            if (has_plural)
+                words += (int)CountText(Language(), str::to_utf8(msgid_plural)).words;
+            m_stats.words += words;
+
+            if (fuzzy || untranslated)
+            {
+                m_stats.unfinished++;
+                m_stats.unfinishedWords += words;
+            }
+            return true;
+        }
+};
+
+
+bool POCatalog::ScanStatistics(const wxString& po_file, Statistics& stats)
+{
+    stats = Statistics();
+
+    MemoryMappedFile data(po_file);
+    if (!data.IsOk())
+        return false;
+
+    wxLogNull null;
+
+    wxString charset;
+    {
+        POFileReader headerReader(data.data(), data.size(), "ISO-8859-1");
+        POCharsetInfoFinder charsetFinder(headerReader);
+        charsetFinder.Parse();
+        charset = charsetFinder.GetCharset();
+    }
+
+    POFileReader reader(data.data(), data.size(), charset);
+    POStatisticsScanner scanner(reader, stats);
+    return scanner.Parse();
+}
+
+
+
+class POLoadParser : public POCatalogParser
+{
+    public:
+        /// @param fileData Start of the whole file's data, for computing
+        ///                 offsets of entries' raw text.
+        POLoadParser(POCatalog& c, POFileReader& reader, const char *fileData)
+              : POCatalogParser(reader),
+                FileIsValid(false),
+                m_catalog(c), m_fileData(fileData),
+                m_nextId(1), m_seenHeaderAlready(false), m_collectMsgidText(true)
+        {
+            m_deferMetadata = true;
+        }
+
+        // true if the file is valid, i.e. has at least some data
+        bool FileIsValid;
+
+        Language GetMsgidLanguage()
+        {
+            auto lang = GetSpecifiedMsgidLanguage();
+            if (lang.IsValid())
+                return lang;
+
+            auto utf8 = m_allMsgidText.utf8_str();
+            lang = Language::TryDetectFromText(utf8.data(), utf8.length());
+            if (!lang.IsValid())
+                lang = Language::English();  // gettext historically assumes English
+            return lang;
+        }
+
+        /// Appends results of (independently) parsing the next chunk of the
+        /// same file, renumbering its entries to follow the ones parsed so far.
+        /// @param lineOffset Line number of the chunk's first line in the file.
+        void AppendChunk(POLoadParser& chunk, int lineOffset);
+
+    protected:
+        Language GetSpecifiedMsgidLanguage()
+        {
+            auto x_srclang = m_catalog.Header().GetHeader("X-Source-Language");
+            if (x_srclang.empty())
+                x_srclang = m_catalog.m_header.GetHeader("X-Loco-Source-Locale");
             if (!x_srclang.empty())
             {
                 auto parsed = Language::TryParse(str::to_utf8(x_srclang));
@@ -634,6 +1214,19 @@ class POLoadParser : public POCatalogParser
         }
 
         POCatalog& m_catalog;
+        const char *m_fileData;
+
+        // Location of the current entry in the file; its content is filled
+        // in only after the whole file is loaded.
+        POEntryRawText GetEntryLocation() const
+        {
+            const char *begin, *end;
+            POEntryRawText raw;
+            GetEntryRawText(begin, end, raw.lines);
+            raw.offset = begin - m_fileData;
+            raw.length = end - begin;
+            return raw;
+        }
 
         virtual bool OnEntry(const wxString& msgid,
                              const wxString& msgid_plural,
@@ -698,7 +1291,7 @@ bool POLoadParser::OnEntry(const wxString& msgid,
     }
     else
     {
-        auto d = std::make_shared<POCatalogItem>();
+        auto d = m_catalog.CreateItem<POCatalogItem>();
         d->SetId(m_nextId++);
         if (!flags.empty())
             d->SetFlags(flags);
@@ -712,6 +1305,8 @@ bool POLoadParser::OnEntry(const wxString& msgid,
         d->SetLineNumber(lineNumber);
         d->SetRawReferences(references);
 
+        // the original text can be reused only if it matches the loaded data
+        bool reusableText = !m_ignoreTranslations;
         for (auto i: extractedComments)
         {
             // Sometimes, msgcat produces conflicts in extracted comments; see the gory details:
@@ -719,10 +1314,18 @@ bool POLoadParser::OnEntry(const wxString& msgid,
             // As a workaround, just filter them out.
             // FIXME: Fix this properly... but not using msgcat in the first place
             if (i.StartsWith(MSGCAT_CONFLICT_MARKER) && i.EndsWith(MSGCAT_CONFLICT_MARKER))
+            {
+                reusableText = false;
                 continue;
+            }
             d->AddExtractedComments(i);
         }
         d->SetOldMsgid(msgid_old);
+        if (reusableText)
+            d->SetRawText(GetEntryLocation());
+        if (m_entryMetadataDeferred)
+            d->DeferMetadata();
+        d->InternStrings(*m_catalog.m_stringPool);
         m_catalog.AddItem(d);
 
         // collect text for language detection:
@@ -740,6 +1343,36 @@ bool POLoadParser::OnEntry(const wxString& msgid,
     return true;
 }
 
+void POLoadParser::AppendChunk(POLoadParser& chunk, int lineOffset)
+{
+    FileIsValid = FileIsValid || chunk.FileIsValid;
+    MergeWrappingInfo(chunk);
+
+    auto& items = m_catalog.m_items;
+    items.reserve(items.size() + chunk.m_catalog.m_items.size());
+    for (auto& i: chunk.m_catalog.m_items)
+    {
+        auto& item = static_cast<POCatalogItem&>(*i);
+        item.SetId(m_nextId++);
+        item.SetLineNumber(item.GetLineNumber() + lineOffset);
+        m_catalog.AttachItem(i);
+        items.push_back(std::move(i));
+    }
+    chunk.m_catalog.m_items.clear();
+
+    for (auto& d: chunk.m_catalog.m_deletedItems)
+    {
+        d.SetLineNumber(d.GetLineNumber() + lineOffset);
+        m_catalog.m_deletedItems.push_back(std::move(d));
+    }
+    chunk.m_catalog.m_deletedItems.clear();
+
+    // the header is always in the first chunk, chunk's own m_collectMsgidText
+    // is therefore meaningless:
+    if (m_collectMsgidText)
+        m_allMsgidText.append(chunk.m_allMsgidText);
+}
+
 bool POLoadParser::OnDeletedEntry(const wxArrayString& deletedLines,
                                 const wxString& flags,
                                 const wxArrayString& /*references*/,
@@ -756,6 +1389,9 @@ bool POLoadParser::OnDeletedEntry(const wxArrayString& deletedLines,
     d.SetLineNumber(lineNumber);
     for (size_t i = 0; i < extractedComments.GetCount(); i++)
       d.AddExtractedComments(extractedComments[i]);
+    d.SetRawText(GetEntryLocation());
+    if (m_entryMetadataDeferred)
+        d.DeferContent();
     m_catalog.AddDeletedItem(d);
 
     return true;
@@ -772,9 +1408,10 @@ wxArrayString POCatalogItem::GetReferences() const
     // Each reference is in the form "path_name:line_number"
     // (path_name may contain spaces)
 
+    EnsureMetadataLoaded();
     wxArrayString refs;
 
-    for ( wxArrayString::const_iterator i = m_references.begin(); i != m_references.end(); ++i )
+    for ( wxArrayString::const_iterator i = m_references.get().begin(); i != m_references.get().end(); ++i )
     {
         wxString line = *i;
 
@@ -794,6 +1431,213 @@ wxArrayString POCatalogItem::GetReferences() const
 }
 
 
+void POCatalogItem::MergeDuplicate(const POCatalogItem& dup)
+{
+    EnsureMetadataLoaded();
+    dup.EnsureMetadataLoaded();
+
+    // references, converted back into a single line of previously unseen ones:
+    auto refs = GetReferences();
+    wxString newRefs;
+    for (auto& r: dup.GetReferences())
+    {
+        if (refs.Index(r) != wxNOT_FOUND)
+            continue;
+        refs.push_back(r);
+        if (!newRefs.empty())
+            newRefs += ' ';
+        newRefs += r;
+    }
+    if (!newRefs.empty())
+        m_references.modify().push_back(newRefs);
+
+    for (auto& c: dup.GetExtractedComments())
+    {
+        if (GetExtractedComments().Index(c) == wxNOT_FOUND)
+            m_extractedComments.modify().push_back(c);
+    }
+
+    // translator comments are stored as complete '\n'-terminated lines:
+    wxStringTokenizer commentLines(dup.m_comment, "\n", wxTOKEN_STRTOK);
+    while (commentLines.HasMoreTokens())
+    {
+        auto line = commentLines.GetNextToken() + '\n';
+        if (m_comment.find(line) == wxString::npos)
+            m_comment += line;
+    }
+
+    // flags are stored as ", flag1, flag2":
+    wxStringTokenizer flags(dup.m_moreFlags.get(), ", ", wxTOKEN_STRTOK);
+    while (flags.HasMoreTokens())
+    {
+        auto flag = wxS(", ") + flags.GetNextToken();
+        if ((m_moreFlags.get() + ",").find(flag + ",") == wxString::npos)
+            m_moreFlags.modify() += flag;
+    }
+    InvalidateSourcePlaceholders();
+
+    if (!HasOldMsgid() && dup.HasOldMsgid())
+        m_oldMsgid = dup.m_oldMsgid;
+
+    if (!HasPlural() && dup.HasPlural())
+        SetPluralString(dup.m_plural);
+
+    if (!m_isTranslated)
+    {
+        if (dup.m_isTranslated)
+        {
+            m_translations = dup.m_translations;
+            m_isTranslated = true;
+            m_isFuzzy = dup.m_isFuzzy;
+        }
+    }
+    else if (dup.m_isTranslated)
+    {
+        // Instead of inserting msgcat-style conflict markers into the text,
+        // keep the first translation and let the translator review it:
+        if (m_translations != dup.m_translations)
+            m_isFuzzy = true;
+        else if (!dup.m_isFuzzy)
+            m_isFuzzy = false;
+    }
+
+    if (!HasBookmark())
+        m_bookmark = dup.m_bookmark;
+
+    ClearIssue();
+    UpdateStatus();
+    Touch();
+    m_rawText.Invalidate();
+}
+
+
+void POCatalogItem::AddMemoryUsage(CatalogMemoryUsage& usage) const
+{
+    CatalogItem::AddMemoryUsage(usage);
+    usage.items += sizeof(POCatalogItem) - sizeof(CatalogItem);
+    usage.references += CatalogMemoryUsage::Of(m_references);
+}
+
+
+void POCatalogItem::InternStrings(StringPool& pool)
+{
+    m_string.Intern(pool);
+    m_plural.Intern(pool);
+    m_context.Intern(pool);
+    pool.Intern(m_moreFlags);
+    pool.Intern(m_extractedComments);
+    pool.Intern(m_references);
+}
+
+
+void POCatalogItem::LoadDeferredMetadata() const
+{
+    // first access may happen concurrently, but it is rare enough to not
+    // warrant per-item locks:
+    static std::mutex s_mutex;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (!m_metadataDeferred.value.load())
+        return;  // already decoded by another thread
+
+    // The object isn't really const, this only caches the decoded data:
+    auto self = const_cast<POCatalogItem*>(this);
+
+    if (m_rawText.IsValid())
+    {
+        wxArrayString references, extractedComments, oldMsgid;
+
+        auto& raw = m_rawText;
+        POFileReader reader(raw.content->data.data() + raw.offset, raw.length, raw.content->charset);
+        // metadata are in comments preceding msgctxt/msgid, as parsed by POCatalogParser::Parse():
+        for (auto line = reader.GetFirstLine(); ; line = reader.GetNextLine())
+        {
+            line = Strip(line);
+            if (!line.empty())
+            {
+                if (line[0] != '#')
+                    break;
+
+                auto token = LexLine(line);
+                if (token.type == POLineType::ExtractedComment)
+                    extractedComments.push_back(ToWx(token.value));
+                else if (token.type == POLineType::Reference)
+                    references.push_back(ToWx(token.value));
+                else if (token.type == POLineType::PrevMsgid)
+                    oldMsgid.push_back(ToWx(token.value));
+            }
+            if (reader.Eof())
+                break;
+        }
+
+        self->m_references = references;
+        self->m_extractedComments = extractedComments;
+        self->m_oldMsgid = oldMsgid;
+    }
+
+    m_metadataDeferred.value.store(false, std::memory_order_release);
+}
+
+
+// ----------------------------------------------------------------------
+// POCatalogDeletedData class
+// ----------------------------------------------------------------------
+
+void POCatalogDeletedData::LoadDeferredContent() const
+{
+    static const boost::string_view prefix_flags("#, ");
+    static const boost::string_view prefix_deleted("#~");
+
+    // The object isn't really const, this only caches the decoded data:
+    auto self = const_cast<POCatalogDeletedData*>(this);
+    self->m_deferred = false;
+
+    if (!m_rawText.IsValid())
+        return;
+
+    // decoded in the same way POCatalogParser::Parse() does it; references
+    // of obsolete entries aren't kept:
+    std::string flags, comment;
+    std::vector<boost::string_view> deletedLines, extractedComments;
+
+    auto& raw = m_rawText;
+    POFileReader reader(raw.content->data.data() + raw.offset, raw.length, raw.content->charset);
+    for (auto line = reader.GetFirstLine(); ; line = reader.GetNextLine())
+    {
+        line = Strip(line);
+        boost::string_view value;
+        if (line.empty() || (line.length() == 2 && line[0] == '#' && (line[1] == ',' || line[1] == ':' || line[1] == '|')))
+        {
+            // ignore empty special tags
+        }
+        else if (ReadParam(line, prefix_flags, value))
+        {
+            flags = ", ";
+            flags.append(value.data(), value.size());
+        }
+        else if (ReadParam(line, prefix_autocomments, value) || ReadParam(line, prefix_autocomments2, value))
+        {
+            extractedComments.push_back(value);
+        }
+        else if (ReadParam(line, prefix_deleted, value))
+        {
+            deletedLines.push_back(line);
+        }
+        else if (line[0] == '#' && (line.length() < 2 || (line[1] != ',' && line[1] != ':' && line[1] != '.' && line[1] != '|')))
+        {
+            comment.append(line.data(), line.size());
+            comment += '\n';
+        }
+        if (reader.Eof())
+            break;
+    }
+
+    self->m_deletedLines = ToWxArray(deletedLines);
+    self->m_extractedComments = ToWxArray(extractedComments);
+    self->m_flags = ToWx(flags);
+    self->m_comment = ToWx(comment);
+}
+
+
 // ----------------------------------------------------------------------
 // POCatalog class
 // ----------------------------------------------------------------------
@@ -802,12 +1646,14 @@ POCatalog::POCatalog(Type type) : Catalog(type)
 {
     m_fileCRLF = wxTextFileType_None;
     m_fileWrappingWidth = DEFAULT_WRAPPING;
+    m_stringPool = StringPool::Shared();
 }
 
 POCatalog::POCatalog(const wxString& po_file, int flags) : Catalog(Type::PO)
 {
     m_fileCRLF = wxTextFileType_None;
     m_fileWrappingWidth = DEFAULT_WRAPPING;
+    m_stringPool = StringPool::Shared();
 
     m_isOk = Load(po_file, flags);
 }
@@ -832,6 +1678,44 @@ bool POCatalog::CanLoadFile(const wxString& extension)
 }
 
 
+CatalogMemoryUsage POCatalog::GetMemoryUsage() const
+{
+    auto usage = Catalog::GetMemoryUsage();
+
+    for (auto& d: m_deletedItems)
+    {
+        // don't decode them just to measure them:
+        if (d.IsContentDeferred())
+        {
+            usage.deletedItems += sizeof(POCatalogDeletedData);
+            continue;
+        }
+        usage.deletedItems += sizeof(POCatalogDeletedData) +
+                              CatalogMemoryUsage::Of(d.GetDeletedLines()) +
+                              CatalogMemoryUsage::Of(d.GetRawReferences()) +
+                              CatalogMemoryUsage::Of(d.GetExtractedComments()) +
+                              CatalogMemoryUsage::Of(d.GetFlags()) +
+                              CatalogMemoryUsage::Of(d.GetComment());
+    }
+
+    // items' raw texts point into the file's content, possibly into older
+    // versions of it if the catalog was saved since:
+    std::unordered_set<const POFileContent*> contents;
+    if (m_fileContent)
+        contents.insert(m_fileContent.get());
+    for (auto& i: m_items)
+    {
+        auto& raw = static_cast<const POCatalogItem&>(*i).GetRawText();
+        if (raw.IsValid())
+            contents.insert(raw.content.get());
+    }
+    for (auto c: contents)
+        usage.document += sizeof(POFileContent) + c->data.capacity();
+
+    return usage;
+}
+
+
 wxString POCatalog::GetPreferredExtension() const
 {
     switch (m_fileType)
@@ -857,8 +1741,32 @@ static inline wxString GetCurrentTimeString()
 
 bool POCatalog::Load(const wxString& po_file, int flags)
 {
-    wxTextFile f;
+    TRACE_SCOPE("POCatalog::Load");
+
+    // The file is mapped into memory and parsed in place; the charset is
+    // detected from the header entry at its beginning. UTF-8 content is used
+    // as-is without any copying, other charsets are converted on the fly.
+    MemoryMappedFile data(po_file);
+    const bool useCache = (flags == 0) && POCatalogCache::IsEnabled();
+    return DoLoad(po_file, data.IsOk() ? data.data() : nullptr, data.IsOk() ? data.size() : 0, flags, useCache);
+}
+
+
+POCatalogPtr POCatalog::CreateFromBuffer(const wxString& po_file, const std::string& data, int flags)
+{
+    TRACE_SCOPE("POCatalog::CreateFromBuffer");
 
+    auto cat = std::make_shared<POCatalog>();
+    // the cache is for files opened repeatedly, not for downloaded data:
+    cat->m_isOk = cat->DoLoad(po_file, data.data(), data.size(), flags, /*useCache=*/false);
+    if (!cat->IsOk())
+        return nullptr;
+    return cat;
+}
+
+
+bool POCatalog::DoLoad(const wxString& po_file, const char *fileData, size_t fileSize, int flags, bool useCache)
+{
     Clear();
     m_isOk = false;
     m_fileName = po_file;
@@ -873,39 +1781,34 @@ bool POCatalog::Load(const wxString& po_file, int flags)
 
     /* Load the .po file: */
 
-    if (!f.Open(po_file, wxConvISO8859_1))
+    if (!fileData)
         return false;
 
     {
         wxLogNull null; // don't report parsing errors from here, report them later
-        POCharsetInfoFinder charsetFinder(&f);
+        POFileReader headerReader(fileData, fileSize, "ISO-8859-1");
+        POCharsetInfoFinder charsetFinder(headerReader);
         charsetFinder.Parse();
         m_header.Charset = charsetFinder.GetCharset();
     }
 
-    f.Close();
-    wxCSConv encConv(m_header.Charset);
-    if (!f.Open(po_file, encConv))
-        return false;
-
-    if (!VerifyFileCharset(f, po_file, m_header.Charset))
+    bool fileIsValid = false;
+    if (useCache && POCatalogCache::Load(*this, po_file, fileData, fileSize))
     {
-        wxLogError(_("There were errors when loading the catalog. Some data may be missing or corrupted as the result."));
+        wxLogTrace("poedit", "loaded '%s' from cache", po_file);
+        fileIsValid = true;
     }
-
-    POLoadParser parser(*this, &f);
-    parser.IgnoreHeader(flags & CreationFlag_IgnoreHeader);
-    parser.IgnoreTranslations(flags & CreationFlag_IgnoreTranslations);
-    if (!parser.Parse())
+    else
     {
-        wxLogError(
-            wxString::Format(
-                _(L"Couldn’t load file %s, it is probably corrupted."),
-                po_file.c_str()));
-        return false;
-    }
+        bool charsetOk = false;
+        if (!DoParse(po_file, fileData, fileSize, flags, fileIsValid, charsetOk))
+            return false;
 
-    m_sourceLanguage = parser.GetMsgidLanguage();
+        // Only cleanly loaded files are cached, so that any problems are
+        // reported again when reopening them:
+        if (useCache && fileIsValid && charsetOk)
+            POCatalogCache::Store(*this, po_file, fileData, fileSize);
+    }
 
     // now that the catalog is loaded, update its items with the bookmarks
     for (unsigned i = BOOKMARK_0; i < BOOKMARK_LAST; i++)
@@ -924,18 +1827,18 @@ bool POCatalog::Load(const wxString& po_file, int flags)
         }
     }
 
-    m_fileCRLF = GetFileCRLFFormat(f);
-    m_fileWrappingWidth = parser.GetWrappingWidth();
-    wxLogTrace("poedit", "detect line wrapping: %d", m_fileWrappingWidth);
+    m_fileCRLF = GetFileCRLFFormat(fileData, fileSize);
+
+    // Keep the file's content so that entries that aren't modified can be
+    // saved back exactly as they were:
+    KeepFileContent(fileData, fileSize);
 
     // If we didn't find any entries, the file must be invalid:
-    if (!parser.FileIsValid)
+    if (!fileIsValid)
         return false;
 
     m_isOk = true;
 
-    f.Close();
-
     FixupCommonIssues();
 
     if ( flags & CreationFlag_IgnoreHeader )
@@ -945,51 +1848,244 @@ bool POCatalog::Load(const wxString& po_file, int flags)
 }
 
 
-void POCatalog::FixupCommonIssues()
+void POCatalog::KeepFileContent(const char *fileData, size_t fileSize)
 {
-    if (m_header.Project == "PACKAGE VERSION")
-        m_header.Project.clear();
-
-    // All the following fixups are specific to POs and should *not* be done in POTs:
-    if (m_fileType == Type::POT)
-        return;
+    auto content = std::make_shared<POFileContent>();
+    content->data.assign(fileData, fileSize);
+    content->charset = m_header.Charset;
+    content->crlf = m_fileCRLF;
+    content->wrapping = m_fileWrappingWidth;
+    m_fileContent = content;
 
-    if (!m_header.Lang.IsValid())
+    for (auto& i: m_items)
     {
-        if (!m_fileName.empty())
-        {
-            m_header.Lang = Language::TryGuessFromFilename(m_fileName);
-            wxLogTrace("poedit", "guessed language from filename '%s': %s", m_fileName, m_header.Lang.Code());
-        }
-
-        if (!m_header.Lang.IsValid())
-        {
-            // If all else fails, try to detect the language from content
-            wxString allText;
-            for (auto& i: items())
-            {
-                for (auto& s: i->GetTranslations())
-                {
-                    if (s.empty())
-                        continue;
-                    allText.append(s);
-                    allText.append('\n');
-                }
-            }
-            if (!allText.empty())
-            {
-                auto utf8 = allText.utf8_str();
-                m_header.Lang = Language::TryDetectFromText(utf8.data(), utf8.length());
-            }
-        }
+        auto& item = static_cast<POCatalogItem&>(*i);
+        POEntryRawText raw = item.GetRawText();
+        if (raw.lines == 0)
+            continue; // not recorded by the parser
+        raw.content = content;
+        item.SetRawText(raw);
     }
-
-    wxLogTrace("poedit", "catalog lang is '%s'", GetLanguage().Code());
-
-    if (m_header.GetHeader("Language-Team") == "LANGUAGE <LL@li.org>")
+    for (auto& d: m_deletedItems)
     {
-        m_header.DeleteHeader("Language-Team");
-        m_header.LanguageTeam.clear();
+        POEntryRawText raw = d.GetRawText();
+        raw.content = content;
+        d.SetRawText(raw);
+    }
+}
+
+
+POCatalogPtr POCatalog::CreatePreview(const wxString& po_file, size_t maxItems)
+{
+    auto cat = std::make_shared<POCatalog>();
+    if (!cat->LoadPreview(po_file, maxItems))
+        return nullptr;
+    return cat;
+}
+
+
+bool POCatalog::LoadPreview(const wxString& po_file, size_t maxItems)
+{
+    TRACE_SCOPE("POCatalog::LoadPreview");
+
+    Clear();
+    m_isOk = false;
+    m_fileName = po_file;
+    m_header.BasePath = wxEmptyString;
+
+    wxString ext;
+    wxFileName::SplitPath(po_file, nullptr, nullptr, &ext);
+    m_fileType = (ext.CmpNoCase("pot") == 0) ? Type::POT : Type::PO;
+
+    MemoryMappedFile data(po_file);
+    if (!data.IsOk())
+        return false;
+
+    wxLogNull null;
+
+    {
+        POFileReader headerReader(data.data(), data.size(), "ISO-8859-1");
+        POCharsetInfoFinder charsetFinder(headerReader);
+        charsetFinder.Parse();
+        m_header.Charset = charsetFinder.GetCharset();
+    }
+
+    // Only parse the header entry and maxItems entries that follow it; the
+    // entry boundaries are found without parsing, so this is fast even for
+    // huge files:
+    const char *end = data.data() + data.size();
+    const char *prefixEnd = data.data();
+    for (size_t i = 0; i <= maxItems && prefixEnd < end; i++)
+        prefixEnd = FindEntryBoundary(prefixEnd, end);
+    const size_t prefixSize = prefixEnd - data.data();
+
+    POFileReader reader(data.data(), prefixSize, m_header.Charset);
+    if (!reader.IsOk())
+        return false;
+
+    POLoadParser parser(*this, reader, data.data());
+    if (!parser.Parse() || !parser.FileIsValid)
+        return false;
+
+    m_sourceLanguage = parser.GetMsgidLanguage();
+    m_fileWrappingWidth = parser.GetWrappingWidth();
+    m_fileCRLF = GetFileCRLFFormat(data.data(), prefixSize);
+
+    // needed for deferred metadata of entries, e.g. extracted comments:
+    KeepFileContent(data.data(), prefixSize);
+
+    m_isOk = true;
+    return true;
+}
+
+
+bool POCatalog::DoParse(const wxString& po_file, const char *fileData, size_t fileSize, int flags,
+                        bool& fileIsValid, bool& charsetOk)
+{
+    // Large files are split at entry boundaries into chunks that are parsed
+    // in parallel, each into its own temporary catalog, and then joined in
+    // order. This is only done when loading from the main thread, so that a
+    // load running on a background thread can't exhaust the threads pool by
+    // waiting for its own tasks.
+    auto chunks = wxThread::IsMain()
+                  ? SplitIntoParsingChunks(fileData, fileSize)
+                  : std::vector<POChunk>{{fileData, fileData + fileSize}};
+
+    struct ChunkParsing
+    {
+        ChunkParsing(const POChunk& chunk, const char *fileData, const wxString& charset, int flags,
+                     std::shared_ptr<StringPool> pool)
+            : reader(chunk.begin, chunk.end - chunk.begin, charset),
+              parser(catalog, reader, fileData),
+              ok(false), lineCount(0)
+        {
+            catalog.m_stringPool = pool;
+            parser.IgnoreHeader(flags & CreationFlag_IgnoreHeader);
+            parser.IgnoreTranslations(flags & CreationFlag_IgnoreTranslations);
+        }
+
+        POCatalog catalog;
+        POFileReader reader;
+        POLoadParser parser;
+        bool ok;
+        size_t lineCount;
+    };
+
+    POFileReader reader(chunks[0].begin, chunks[0].end - chunks[0].begin, m_header.Charset);
+    if (!reader.IsOk())
+        return false;
+
+    std::vector<std::shared_ptr<ChunkParsing>> otherChunks;
+    std::vector<dispatch::future<void>> otherChunksDone;
+    for (size_t i = 1; i < chunks.size(); i++)
+    {
+        auto c = std::make_shared<ChunkParsing>(chunks[i], fileData, m_header.Charset, flags, m_stringPool);
+        otherChunks.push_back(c);
+        otherChunksDone.push_back(dispatch::async([c, chunk = chunks[i]]{
+            c->ok = c->parser.Parse();
+            c->lineCount = CountLines(chunk.begin, chunk.end);
+        }));
+    }
+
+    // The first chunk is parsed on this thread, directly into this catalog:
+    POLoadParser parser(*this, reader, fileData);
+    parser.IgnoreHeader(flags & CreationFlag_IgnoreHeader);
+    parser.IgnoreTranslations(flags & CreationFlag_IgnoreTranslations);
+    bool parsedOk = parser.Parse();
+
+    // The tasks use the file's data, so they must all finish before returning:
+    for (auto& f: otherChunksDone)
+        f.wait();
+
+    auto corruptedLines = reader.GetCorruptedLines();
+    size_t lineOffset = chunks.size() > 1 ? CountLines(chunks[0].begin, chunks[0].end) : 0;
+    for (size_t i = 0; i < otherChunks.size(); i++)
+    {
+        otherChunksDone[i].get(); // propagate exceptions, if any
+        auto& c = *otherChunks[i];
+        if (!c.ok)
+            parsedOk = false;
+        if (!parsedOk)
+            break;
+
+        parser.AppendChunk(c.parser, int(lineOffset));
+        for (auto line: c.reader.GetCorruptedLines())
+            corruptedLines.push_back(line + lineOffset);
+        lineOffset += c.lineCount;
+    }
+
+    charsetOk = VerifyFileCharset(corruptedLines, po_file, m_header.Charset);
+    if (!charsetOk)
+    {
+        wxLogError(_("There were errors when loading the catalog. Some data may be missing or corrupted as the result."));
+    }
+
+    if (!parsedOk)
+    {
+        wxLogError(
+            wxString::Format(
+                _(L"Couldn’t load file %s, it is probably corrupted."),
+                po_file.c_str()));
+        return false;
+    }
+
+    m_sourceLanguage = parser.GetMsgidLanguage();
+    m_fileWrappingWidth = parser.GetWrappingWidth();
+    wxLogTrace("poedit", "detect line wrapping: %d", m_fileWrappingWidth);
+
+    fileIsValid = parser.FileIsValid;
+    return true;
+}
+
+
+void POCatalog::FixupCommonIssues()
+{
+    if (m_header.Project == "PACKAGE VERSION")
+        m_header.Project.clear();
+
+    // All the following fixups are specific to POs and should *not* be done in POTs:
+    if (m_fileType == Type::POT)
+        return;
+
+    if (!m_header.Lang.IsValid())
+    {
+        if (!m_fileName.empty())
+        {
+            m_header.Lang = Language::TryGuessFromFilename(m_fileName);
+            wxLogTrace("poedit", "guessed language from filename '%s': %s", m_fileName, m_header.Lang.Code());
+        }
+
+        if (!m_header.Lang.IsValid())
+        {
+            // If all else fails, try to detect the language from content;
+            // a sample of translations is enough for that in large files:
+            wxString allText;
+            const size_t count = items().size();
+            const size_t step = std::max<size_t>(1, count / 2000);
+            for (size_t idx = 0; idx < count; idx += step)
+            {
+                for (auto& s: items()[idx]->GetTranslations())
+                {
+                    if (s.empty())
+                        continue;
+                    allText.append(s);
+                    allText.append('\n');
+                }
+            }
+            if (!allText.empty())
+            {
+                auto utf8 = allText.utf8_str();
+                m_header.Lang = Language::TryDetectFromText(utf8.data(), utf8.length());
+            }
+        }
+    }
+
+    wxLogTrace("poedit", "catalog lang is '%s'", GetLanguage().Code());
+
+    if (m_header.GetHeader("Language-Team") == "LANGUAGE <LL@li.org>")
+    {
+        m_header.DeleteHeader("Language-Team");
+        m_header.LanguageTeam.clear();
     }
 
     if (m_header.GetHeader("Last-Translator") == "FULL NAME <EMAIL@ADDRESS>")
@@ -1037,6 +2133,11 @@ void POCatalog::Clear()
 
     // PO-specific fields:
     m_deletedItems.clear();
+    m_fileContent.reset();
+    m_stringPool = StringPool::Shared();
+    m_itemsArena = std::make_shared<MemoryArena>();
+    m_statusIndex = std::make_shared<CatalogStatusIndex>();
+    InvalidateLookupIndexes();
 }
 
 
@@ -1044,28 +2145,50 @@ void POCatalog::Clear()
 namespace
 {
 
-inline bool CanEncodeStringToCharset(const wxString& s, wxMBConv& conv)
-{
-    if (s.empty())
-        return true;
-    const wxCharBuffer converted(s.mb_str(conv));
-    if ( converted.length() == 0 )
-        return false;
-    return true;
-}
+/**
+    Encodes all lines of @a f, including line endings, into @a out.
 
-bool CanEncodeToCharset(const wxTextBuffer& f, const wxString& charset)
+    This both checks that the text can be represented in @a charset and
+    produces the file's content, so that the (possibly expensive for legacy
+    charsets) conversion is only done once. Returns false if some line can't
+    be encoded and sets @a failedLine to its index.
+ */
+bool EncodeToCharset(const wxTextBuffer& f, wxTextFileType crlf, const wxString& charset,
+                     std::string& out, size_t& failedLine)
 {
-    if (charset.Lower() == "utf-8" || charset.Lower() == "utf8")
-        return true;
+    const wxString charsetLower = charset.Lower();
+    const bool isUTF8 = (charsetLower == "utf-8" || charsetLower == "utf8");
+    wxCSConv conv(isUTF8 ? wxString("UTF-8") : charset);
 
-    wxCSConv conv(charset);
+    out.clear();
 
     const size_t lines = f.GetLineCount();
     for ( size_t i = 0; i < lines; i++ )
     {
-        if ( !CanEncodeStringToCharset(f.GetLine(i), conv) )
-            return false;
+        const wxString& line = f.GetLine(i);
+        // ASCII is the same in all charsets allowed in PO files:
+        if (str::is_ascii(line))
+        {
+            out += str::to_utf8(line);
+        }
+        else if (isUTF8)
+        {
+            const auto utf8 = line.utf8_str();
+            out.append(utf8.data(), utf8.length());
+        }
+        else
+        {
+            const wxCharBuffer converted(line.mb_str(conv));
+            if (converted.length() == 0)
+            {
+                failedLine = i;
+                return false;
+            }
+            out.append(converted.data(), converted.length());
+        }
+
+        for (auto eol = wxTextBuffer::GetEOL(crlf == wxTextFileType_None ? f.GetLineType(i) : crlf); *eol; ++eol)
+            out += char(*eol);
     }
 
     return true;
@@ -1099,26 +2222,216 @@ void SaveMultiLines(wxTextBuffer &f, const wxString& text)
     });
 }
 
-/** Adds \n characters as necessary for good-looking output
- */
-wxString FormatStringForFile(const wxString& text)
+
+// Wrapping of strings into lines, compatible with how gettext tools do it.
+// gettext uses the Unicode line breaking algorithm (UAX #14); this is its
+// subset sufficient for the text usually found in PO files.
+
+// Line breaking class of a character, simplified
+enum class BreakClass
 {
-    wxString s;
-    s.reserve(text.length() + 16);
+    Space,       // break is possible after a run of spaces
+    Hyphen,      // break is possible after it, but not before
+    Open,        // opening punctuation, no break after it
+    Close,       // closing punctuation, no break before it
+    Numeric,
+    Ideographic, // break is possible before and after it
+    Other
+};
 
-    static wxString quoted_newline(wxS("\"\n\""));
+inline bool IsLowSurrogate(unsigned c) { return c >= 0xDC00 && c <= 0xDFFF; }
+
+inline bool IsIdeographic(unsigned c)
+{
+    return (c >= 0x2E80 && c <= 0x2FFF) ||   // CJK radicals
+           (c >= 0x3040 && c <= 0x30FF) ||   // kana
+           (c >= 0x3400 && c <= 0x4DBF) ||   // CJK ext. A
+           (c >= 0x4E00 && c <= 0x9FFF) ||   // CJK unified ideographs
+           (c >= 0xA000 && c <= 0xA4CF) ||   // Yi
+           (c >= 0xAC00 && c <= 0xD7A3) ||   // Hangul syllables
+           (c >= 0xF900 && c <= 0xFAFF) ||   // CJK compatibility
+           (c >= 0xFF00 && c <= 0xFFEF) ||   // fullwidth forms
+           (c >= 0xD840 && c <= 0xD87F) ||   // high surrogates of planes 2 and 3 (UTF-16)
+           (c >= 0x20000 && c <= 0x3FFFD);
+}
 
-    SplitIntoLines(text, [&s](wxString&& piece, bool last)
+BreakClass GetBreakClass(unsigned c)
+{
+    switch (c)
     {
-        if (!s.empty())
-            s += quoted_newline;
-        if (!last)
-            piece += '\n';
-        EscapeCStringInplace(piece);
-        s += piece;
-    });
+        case ' ':
+            return BreakClass::Space;
+        case '-':
+            return BreakClass::Hyphen;
+        case '(': case '[': case '{':
+        case 0x3008: case 0x300A: case 0x300C: case 0x300E: case 0x3010:
+        case 0xFF08: case 0xFF3B: case 0xFF5B:
+            return BreakClass::Open;
+        case ')': case ']': case '}': case '!': case '?':
+        case ',': case '.': case ':': case ';': case '/':
+        case 0x3001: case 0x3002: case 0x3005: case 0x3009: case 0x300B:
+        case 0x300D: case 0x300F: case 0x3011: case 0x30FC:
+        case 0xFF01: case 0xFF09: case 0xFF0C: case 0xFF0E: case 0xFF1A:
+        case 0xFF1B: case 0xFF1F: case 0xFF3D: case 0xFF5D:
+            return BreakClass::Close;
+        default:
+            break;
+    }
 
-    return s;
+    if (c >= '0' && c <= '9')
+        return BreakClass::Numeric;
+    if (IsIdeographic(c))
+        return BreakClass::Ideographic;
+    return BreakClass::Other;
+}
+
+// Width of the character in columns
+inline int GetCharWidth(unsigned c)
+{
+    if (IsLowSurrogate(c))
+        return 0; // counted as part of the high surrogate
+    if (c >= 0x0300 && c <= 0x036F)
+        return 0; // combining diacritical marks
+    if (IsIdeographic(c) || (c >= 0x1100 && c <= 0x115F) || (c >= 0x3000 && c <= 0x303F))
+        return 2;
+    return 1;
+}
+
+// For each character of escaped string, determines if a line break would be
+// permitted before it.
+std::vector<bool> FindBreakOpportunities(const std::wstring& s, bool endsWithNewline)
+{
+    const size_t len = s.length();
+    std::vector<bool> breaks(len, false);
+    if (len == 0)
+        return breaks;
+
+    BreakClass prev = GetBreakClass(s[0]);
+    BreakClass beforeSpaces = prev; // last non-space class before the current run of spaces
+    bool inEscape = s[0] == '\\';
+
+    for (size_t i = 1; i < len; i++)
+    {
+        const unsigned c = s[i];
+        const BreakClass next = GetBreakClass(c);
+
+        bool canBreak;
+        if (inEscape || IsLowSurrogate(c))
+            canBreak = false; // never split escape sequences or surrogate pairs
+        else if (next == BreakClass::Space || next == BreakClass::Close || next == BreakClass::Hyphen)
+            canBreak = false;
+        else if (prev == BreakClass::Space)
+            canBreak = beforeSpaces != BreakClass::Open;
+        else if (prev == BreakClass::Open)
+            canBreak = false;
+        else if (prev == BreakClass::Hyphen)
+            canBreak = next != BreakClass::Numeric;
+        else
+            canBreak = next == BreakClass::Ideographic || prev == BreakClass::Ideographic;
+
+        breaks[i] = canBreak;
+
+        if (next != BreakClass::Space)
+            beforeSpaces = next;
+        prev = next;
+        inEscape = !inEscape && c == '\\';
+    }
+
+    // Don't break immediately before the "\n" at the end:
+    if (endsWithNewline && len >= 2)
+        breaks[len - 2] = false;
+
+    return breaks;
+}
+
+// Greedily selects line breaks so that no line is wider than width, if
+// possible. Returns positions in s before which the line should be broken.
+std::vector<size_t> WrapString(const std::wstring& s, const std::vector<bool>& opportunities,
+                               int width, int startColumn)
+{
+    std::vector<size_t> lineBreaks;
+
+    const size_t npos = size_t(-1);
+    size_t lastOpportunity = npos;
+    int lastColumn = startColumn;
+    int pieceWidth = 0;
+    for (size_t i = 0; i < s.length(); i++)
+    {
+        if (opportunities[i])
+        {
+            // an unbreakable piece of text ends here
+            if (lastOpportunity != npos && lastColumn + pieceWidth > width)
+            {
+                lineBreaks.push_back(lastOpportunity);
+                lastColumn = 0;
+            }
+            lastOpportunity = i;
+            lastColumn += pieceWidth;
+            pieceWidth = 0;
+        }
+        pieceWidth += GetCharWidth(s[i]);
+    }
+
+    if (lastOpportunity != npos && lastColumn + pieceWidth > width)
+        lineBreaks.push_back(lastOpportunity);
+
+    return lineBreaks;
+}
+
+/** Writes keyword with its (escaped) string value, split into lines at \n
+    characters and wrapped to wrappingWidth columns (or not wrapped if it is
+    NO_WRAPPING), the same way as gettext tools format it.
+ */
+void FormatStringForFile(wxTextBuffer& f, const wxString& keyword, const wxString& text, int wrappingWidth)
+{
+    // room for the quotes:
+    const int width = wrappingWidth == POCatalog::NO_WRAPPING ? INT_MAX - 1 : wrappingWidth - 2;
+
+    const std::wstring str = text.ToStdWstring();
+    bool firstLine = true;
+    size_t pos = 0;
+    do
+    {
+        // Process the string in portions delimited by \n (included in it):
+        size_t portionEnd = str.find('\n', pos);
+        portionEnd = (portionEnd == std::wstring::npos) ? str.length() : portionEnd + 1;
+        const bool endsWithNewline = portionEnd > pos && str[portionEnd - 1] == '\n';
+        const bool morePortions = portionEnd < str.length();
+
+        std::wstring portion(str, pos, portionEnd - pos);
+        EscapeCStringInplace(portion);
+        const auto opportunities = FindBreakOpportunities(portion, endsWithNewline);
+
+        int startColumn = firstLine ? int(keyword.length()) + 1 : 0;
+        auto lineBreaks = WrapString(portion, opportunities, width, startColumn);
+
+        // If the string has multiple lines or needs wrapping, gettext puts
+        // empty string on the keyword's line and the content after it:
+        if (firstLine && !portion.empty() && (morePortions || startColumn > width || !lineBreaks.empty()))
+        {
+            f.AddLine(keyword + wxS(" \"\""));
+            firstLine = false;
+            lineBreaks = WrapString(portion, opportunities, width, 0);
+        }
+
+        wxString line = firstLine ? keyword + wxS(" \"") : wxString(wxS("\""));
+        size_t lineStart = 0;
+        for (auto b: lineBreaks)
+        {
+            line.append(portion.substr(lineStart, b - lineStart));
+            line += '"';
+            f.AddLine(line);
+            line = wxS("\"");
+            lineStart = b;
+        }
+        line.append(portion.substr(lineStart));
+        line += '"';
+        f.AddLine(line);
+
+        firstLine = false;
+        pos = portionEnd;
+    }
+    while (pos < str.length());
 }
 
 } // anonymous namespace
@@ -1143,6 +2456,8 @@ wxString FormatStringForFile(const wxString& text)
 bool POCatalog::Save(const wxString& po_file, bool save_mo,
                      ValidationResults& validation_results, CompilationStatus& mo_compilation_status)
 {
+    TRACE_SCOPE("POCatalog::Save");
+
     mo_compilation_status = CompilationStatus::NotDone;
 
     if ( wxFileExists(po_file) && !wxFile::Access(po_file, wxFile::write) )
@@ -1176,154 +2491,144 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
     TempOutputFileFor po_file_temp_obj(po_file);
     const wxString po_file_temp = po_file_temp_obj.FileName();
 
-    wxTextFileType outputCrlf = GetDesiredCRLFFormat(m_fileCRLF);
-    // Save into Unix line endings first and only if Windows is required,
-    // reformat the file later. This is because msgcat cannot handle DOS
-    // input particularly well.
-
-    if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
+    // The file is written in its final form, wrapped the same way gettext
+    // tools would do it, directly:
+    if ( !DoSaveOnly(po_file_temp, GetDesiredCRLFFormat(m_fileCRLF)) )
     {
         wxLogError(_(L"Couldn’t save file %s."), po_file.c_str());
         return false;
     }
 
-    try
-    {
-        validation_results = DoValidate(po_file_temp);
-    }
-    catch (...)
-    {
-        // DoValidate may fail catastrophically if app bundle is damaged, but
-        // that shouldn't prevent Poedit from trying to save user's file.
-        wxLogError("%s", DescribeCurrentException());
-    }
+    /* If the user wants it, compile .mo file right now. This is independent
+       of validation, so both run concurrently: */
 
-    // Now that the file was written, run msgcat to re-format it according
-    // to the usual format. This is a (barely) passable fix for #25 until
-    // proper preservation of formatting is implemented.
+    bool compileMO = save_mo && m_fileType == Type::PO;
+    if (!Config::Current()->compileMO)
+        compileMO = false;
 
-    int msgcat_ok = false;
+    const wxString mo_file = wxFileName::StripExtension(po_file) + ".mo";
+    std::unique_ptr<TempOutputFileFor> mo_file_temp_ptr;
+    dispatch::future<CompilationStatus> mo_compilation;
+    if (compileMO)
     {
-        int wrapping = DEFAULT_WRAPPING;
-        if (wxConfig::Get()->ReadBool("keep_crlf", true))
-            wrapping = m_fileWrappingWidth;
+        mo_file_temp_ptr.reset(new TempOutputFileFor(mo_file));
+        const wxString mo_file_temp = mo_file_temp_ptr->FileName();
 
-        wxString wrappingFlag;
-        if (wrapping == DEFAULT_WRAPPING)
+        mo_compilation = dispatch::async([this, mo_file_temp, po_file_temp]
         {
-            if (wxConfig::Get()->ReadBool("wrap_po_files", true))
+            auto status = DoCompileMO(mo_file_temp);
+            if (status != CompilationStatus::NotDone)
+                return status;
+
+            // Ignore msgfmt errors output (but not exit code), because it
+            // complains about things DoValidate() already complains about.
+            wxLogNull null;
+
+            if ( ExecuteGettext
+                  (
+                      wxString::Format("msgfmt -o %s %s",
+                                       QuoteCmdlineArg(mo_file_temp),
+                                       QuoteCmdlineArg(CliSafeFileName(po_file_temp)))
+                  ) )
             {
-                wrapping = (int)wxConfig::Get()->ReadLong("wrap_po_files_width", 79);
+                return CompilationStatus::Success;
             }
+
+            // Don't report errors, they were reported as part of validation
+            // step.  Notice that we run msgfmt *without* the -c flag
+            // here to create the MO file in as many cases as possible, even if
+            // it has some errors.
+            //
+            // Still, msgfmt has the ugly habit of sometimes returning non-zero
+            // exit code, reporting "fatal errors" and *still* producing a usable
+            // .mo file. If this happens, don't pretend the file wasn't created.
+            if (wxFileName::FileExists(mo_file_temp))
+                return CompilationStatus::Success;
             else
-            {
-                wrapping = NO_WRAPPING;
-            }
-        }
+                return CompilationStatus::Error;
+        });
+    }
 
-        if (wrapping == NO_WRAPPING)
-            wrappingFlag = " --no-wrap";
-        else if (wrapping != DEFAULT_WRAPPING)
-            wrappingFlag.Printf(" --width=%d", wrapping);
-
-        TempOutputFileFor po_file_temp2_obj(po_file_temp);
-        const wxString po_file_temp2 = po_file_temp2_obj.FileName();
-        auto msgcatCmd = wxString::Format("msgcat --force-po%s -o %s %s",
-                                          wrappingFlag,
-                                          QuoteCmdlineArg(po_file_temp2),
-                                          QuoteCmdlineArg(po_file_temp));
-        wxLogTrace("poedit", "formatting file with %s", msgcatCmd);
-
-        // Ignore msgcat errors output (but not exit code), because it
-        //   a) complains about things DoValidate() already complained above
-        //   b) issues warnings about source-extraction things (e.g. using non-ASCII
-        //      msgids) that, while correct, are not something a *translator* can
-        //      do anything about.
-        wxLogNull null;
-        msgcat_ok = ExecuteGettext(msgcatCmd) &&
-                    wxFileExists(po_file_temp2);
+    // JSON bundles for web apps are written from the items too, alongside MO:
+    JSONBundleWriter::Format jsonFormat;
+    const wxString jsonFormatName = m_header.GetHeader("X-Poedit-JSON-Format");
+    bool writeJSON = m_fileType == Type::PO && !jsonFormatName.empty();
+    if (writeJSON && !JSONBundleWriter::ParseFormat(jsonFormatName, jsonFormat))
+    {
+        wxLogWarning(_(L"Unknown JSON format “%s”, JSON file wasn’t saved."), jsonFormatName);
+        writeJSON = false;
+    }
 
-        // msgcat always outputs Unix line endings, so we need to reformat the file
-        if (msgcat_ok && outputCrlf == wxTextFileType_Dos)
-        {
-            wxCSConv conv(m_header.Charset);
-            wxTextFile finalFile(po_file_temp2);
-            if (finalFile.Open(conv))
-                finalFile.Write(outputCrlf, conv);
-        }
+    const wxString json_file = wxFileName::StripExtension(po_file) + ".json";
+    std::unique_ptr<TempOutputFileFor> json_file_temp_ptr;
+    dispatch::future<bool> json_writing;
+    if (writeJSON)
+    {
+        json_file_temp_ptr.reset(new TempOutputFileFor(json_file));
+        const wxString json_file_temp = json_file_temp_ptr->FileName();
 
-        if (!TempOutputFileFor::ReplaceFile(po_file_temp2, po_file))
-            msgcat_ok = false;
+        json_writing = dispatch::async([this, jsonFormat, json_file_temp]
+        {
+            JSONBundleWriter writer(jsonFormat, GetLanguage().Code(),
+                                    str::to_utf8(m_header.GetHeader("Plural-Forms")),
+                                    GetPluralFormsCount());
+            for (auto& item: m_items)
+                writer.Add(*item);
+            return writer.Save(json_file_temp);
+        });
     }
 
-    if ( msgcat_ok )
+    try
     {
-        wxRemoveFile(po_file_temp);
+        validation_results = DoValidate();
     }
-    else
+    catch (...)
+    {
+        // Validation failures shouldn't prevent Poedit from trying to save
+        // user's file.
+        wxLogError("%s", DescribeCurrentException());
+    }
+
+    // msgfmt may be reading the temporary PO file, so wait for it first:
+    if (compileMO)
     {
-        if ( !po_file_temp_obj.Commit() )
+        try
         {
-            wxLogError(_(L"Couldn’t save file %s."), po_file.c_str());
+            mo_compilation_status = mo_compilation.get();
         }
-        else
+        catch (...)
         {
-            // Only shows msgcat's failure warning if we don't also get
-            // validation errors, because if we do, the cause is likely the
-            // same.
-            if ( !validation_results.errors )
-            {
-                wxLogWarning(_("There was a problem formatting the file nicely (but it was saved all right)."));
-            }
+            wxLogError("%s", DescribeCurrentException());
+            mo_compilation_status = CompilationStatus::Error;
         }
     }
 
-    
-    /* If the user wants it, compile .mo file right now: */
+    bool jsonWritten = false;
+    if (writeJSON)
+    {
+        try
+        {
+            jsonWritten = json_writing.get();
+        }
+        catch (...)
+        {
+            wxLogError("%s", DescribeCurrentException());
+        }
+    }
 
-    bool compileMO = save_mo;
-    if (!wxConfig::Get()->Read("compile_mo", (long)true))
-        compileMO = false;
+    if ( !po_file_temp_obj.Commit() )
+    {
+        wxLogError(_(L"Couldn’t save file %s."), po_file.c_str());
+        return false;
+    }
 
-    if (m_fileType == Type::PO && compileMO)
+    if (compileMO)
     {
-        const wxString mo_file = wxFileName::StripExtension(po_file) + ".mo";
-        TempOutputFileFor mo_file_temp_obj(mo_file);
+        TempOutputFileFor& mo_file_temp_obj = *mo_file_temp_ptr;
         const wxString mo_file_temp = mo_file_temp_obj.FileName();
 
-        {
-            // Ignore msgfmt errors output (but not exit code), because it
-            // complains about things DoValidate() already complained above.
-            wxLogNull null;
-
-            if ( ExecuteGettext
-                  (
-                      wxString::Format("msgfmt -o %s %s",
-                                       QuoteCmdlineArg(mo_file_temp),
-                                       QuoteCmdlineArg(CliSafeFileName(po_file)))
-                  ) )
-            {
-                mo_compilation_status = CompilationStatus::Success;
-            }
-            else
-            {
-                // Don't report errors, they were reported as part of validation
-                // step above.  Notice that we run msgfmt *without* the -c flag
-                // here to create the MO file in as many cases as possible, even if
-                // it has some errors.
-                //
-                // Still, msgfmt has the ugly habit of sometimes returning non-zero
-                // exit code, reporting "fatal errors" and *still* producing a usable
-                // .mo file. If this happens, don't pretend the file wasn't created.
-                if (wxFileName::FileExists(mo_file_temp))
-                    mo_compilation_status = CompilationStatus::Success;
-                else
-                    mo_compilation_status = CompilationStatus::Error;
-            }
-        }
-
-        // Move the MO from temporary location to the final one, if it was created
-        if (mo_compilation_status == CompilationStatus::Success)
+        // Move the MO from temporary location to the final one, if it was created
+        if (mo_compilation_status == CompilationStatus::Success)
         {
 #ifdef __WXOSX__
             NSURL *mofileUrl = [NSURL fileURLWithPath:str::to_NS(mo_file)];
@@ -1367,38 +2672,23 @@ bool POCatalog::Save(const wxString& po_file, bool save_mo,
         }
     }
 
+    if (writeJSON)
+    {
+        if (!jsonWritten || !json_file_temp_ptr->Commit())
+            wxLogError(_(L"Couldn’t save file %s."), json_file.c_str());
+    }
+
     m_fileName = po_file;
 
     return true;
 }
 
 
-std::string POCatalog::SaveToBuffer()
+bool POCatalog::WriteToBuffer(std::string& out)
 {
-    class StringSerializer : public wxMemoryText
-    {
-    public:
-        bool OnWrite(wxTextFileType typeNew, const wxMBConv& conv) override
-        {
-            size_t cnt = GetLineCount();
-            for (size_t n = 0; n < cnt; n++)
-            {
-                auto ln = GetLine(n) +
-                          GetEOL(typeNew == wxTextFileType_None ? GetLineType(n) : typeNew);
-                auto buf = ln.mb_str(conv);
-                buffer.append(buf.data(), buf.length());
-            }
-            return true;
-        }
+    TRACE_SCOPE("POCatalog::WriteToBuffer");
 
-        std::string buffer;
-    };
-
-    StringSerializer f;
-
-    if (!DoSaveOnly(f, wxTextFileType_Unix))
-        return std::string();
-    return f.buffer;
+    return DoSaveOnly(out, wxTextFileType_Unix);
 }
 
 
@@ -1408,23 +2698,26 @@ bool POCatalog::CompileToMO(const wxString& mo_file,
 {
     mo_compilation_status = CompilationStatus::NotDone;
 
-    TempDirectory tmpdir;
-    if ( !tmpdir.IsOk() )
-        return false;
-    wxString po_file_temp = tmpdir.CreateFileName("output.po");
-
-    if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
-    {
-        wxLogError(_(L"Couldn’t save file %s."), po_file_temp.c_str());
-        return false;
-    }
-
-    validation_results = DoValidate(po_file_temp);
+    validation_results = DoValidate();
 
     TempOutputFileFor mo_file_temp_obj(mo_file);
     const wxString mo_file_temp = mo_file_temp_obj.FileName();
 
+    // The catalog only needs to be written to disk if msgfmt has to be used,
+    // which is rare:
+    if (DoCompileMO(mo_file_temp) == CompilationStatus::NotDone)
     {
+        TempDirectory tmpdir;
+        if ( !tmpdir.IsOk() )
+            return false;
+        wxString po_file_temp = tmpdir.CreateFileName("output.po");
+
+        if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
+        {
+            wxLogError(_(L"Couldn’t save file %s."), po_file_temp.c_str());
+            return false;
+        }
+
         // Ignore msgfmt errors output (but not exit code), because it
         // complains about things DoValidate() already complained above.
         wxLogNull null;
@@ -1459,76 +2752,197 @@ bool POCatalog::CompileToMO(const wxString& mo_file,
 
 
 
-bool POCatalog::DoSaveOnly(const wxString& po_file, wxTextFileType crlf)
+Catalog::CompilationStatus POCatalog::DoCompileMO(const wxString& mo_file)
 {
-    wxTextFile f;
-    if (!f.Create(po_file))
-        return false;
+    const wxString charset = (!m_header.Charset || m_header.Charset == "CHARSET") ? wxString("UTF-8") : m_header.Charset;
+    const bool isUTF8 = charset.CmpNoCase("utf-8") == 0 || charset.CmpNoCase("utf8") == 0;
+    std::unique_ptr<wxCSConv> conv;
+    if (!isUTF8)
+    {
+        conv.reset(new wxCSConv(charset));
+        if (!conv->IsOk())
+            return CompilationStatus::NotDone;
+    }
 
-    return DoSaveOnly(f, crlf);
-}
+    // Encodes the string into the catalog's charset:
+    auto encode = [&](const wxString& s, std::string& out) -> bool
+    {
+        if (s.empty())
+            return true;
+        if (isUTF8)
+        {
+            out += s.utf8_str();
+            return true;
+        }
+        auto buf = s.mb_str(*conv);
+        if (buf.length() == 0)
+            return false;
+        out.append(buf.data(), buf.length());
+        return true;
+    };
 
-bool POCatalog::DoSaveOnly(wxTextBuffer& f, wxTextFileType crlf)
-{
-    /* Save .po file: */
-    if (!m_header.Charset || m_header.Charset == "CHARSET")
-        m_header.Charset = "UTF-8";
+    MOWriter mo;
 
-    SaveMultiLines(f, m_header.Comment);
-    if (m_fileType == Type::POT)
-        f.AddLine(wxS("#, fuzzy"));
-    f.AddLine(wxS("msgid \"\""));
-    f.AddLine(wxS("msgstr \"\""));
-    wxString pohdr = wxString(wxS("\"")) + m_header.ToString(wxS("\"\n\""));
-    pohdr.RemoveLast();
-    SaveMultiLines(f, pohdr);
-    f.AddLine(wxEmptyString);
+    std::string header;
+    if (!encode(UnescapeCString(m_header.ToString(wxEmptyString)), header))
+        return CompilationStatus::NotDone;
+    mo.Add(std::string(), header);
 
-    auto pluralsCount = GetPluralFormsCount();
+    const auto pluralsCount = GetPluralFormsCount();
 
-    for (auto& data_: m_items)
+    for (auto& item: m_items)
     {
-        auto data = std::static_pointer_cast<POCatalogItem>(data_);
+        // Same as msgfmt, skip fuzzy and untranslated entries:
+        if (item->IsFuzzy() || item->GetTranslation(0).empty())
+            continue;
 
-        data->SetLineNumber(int(f.GetLineCount()+1));
-        SaveMultiLines(f, data->GetComment());
-        for (unsigned i = 0; i < data->GetExtractedComments().GetCount(); i++)
-        {
-            if (data->GetExtractedComments()[i].empty())
-              f.AddLine(wxS("#."));
-            else
-              f.AddLine(wxS("#. ") + data->GetExtractedComments()[i]);
-        }
-        for (unsigned i = 0; i < data->GetRawReferences().GetCount(); i++)
-            f.AddLine(wxS("#: ") + data->GetRawReferences()[i]);
-        wxString dummy = data->GetFlags();
-        if (!dummy.empty())
-            f.AddLine(wxS("#") + dummy);
-        for (unsigned i = 0; i < data->GetOldMsgidRaw().GetCount(); i++)
-            f.AddLine(wxS("#| ") + data->GetOldMsgidRaw()[i]);
-        if ( data->HasContext() )
+        // System-dependent strings (using <inttypes.h> macros) require the
+        // extended format that only msgfmt can produce:
+        if (item->GetString().Contains("<PRI") || item->GetPluralString().Contains("<PRI"))
+            return CompilationStatus::NotDone;
+
+        std::string msgid, msgstr;
+        if (item->HasContext())
         {
-            SaveMultiLines(f, wxS("msgctxt \"") + FormatStringForFile(data->GetContext()) + wxS("\""));
+            if (!encode(item->GetContext(), msgid))
+                return CompilationStatus::NotDone;
+            msgid += '\x04';
         }
-        dummy = FormatStringForFile(data->GetString());
-        SaveMultiLines(f, wxS("msgid \"") + dummy + wxS("\""));
-        if (data->HasPlural())
+        if (!encode(item->GetString(), msgid))
+            return CompilationStatus::NotDone;
+
+        if (item->HasPlural())
         {
-            dummy = FormatStringForFile(data->GetPluralString());
-            SaveMultiLines(f, wxS("msgid_plural \"") + dummy + wxS("\""));
+            msgid += '\0';
+            if (!encode(item->GetPluralString(), msgid))
+                return CompilationStatus::NotDone;
 
             for (unsigned i = 0; i < pluralsCount; i++)
             {
-                dummy = FormatStringForFile(data->GetTranslation(i));
-                wxString hdr = wxString::Format(wxS("msgstr[%u] \""), i);
-                SaveMultiLines(f, hdr + dummy + wxS("\""));
+                if (i > 0)
+                    msgstr += '\0';
+                if (!encode(item->GetTranslation(i), msgstr))
+                    return CompilationStatus::NotDone;
             }
         }
         else
         {
-            dummy = FormatStringForFile(data->GetTranslation());
-            SaveMultiLines(f, wxS("msgstr \"") + dummy + wxS("\""));
+            if (!encode(item->GetTranslation(), msgstr))
+                return CompilationStatus::NotDone;
+        }
+
+        mo.Add(msgid, msgstr);
+    }
+
+    if (!mo.Save(mo_file))
+    {
+        wxLogError(_(L"Couldn’t save file %s."), mo_file.c_str());
+        return CompilationStatus::Error;
+    }
+
+    return CompilationStatus::Success;
+}
+
+
+void POCatalog::SaveHeader(wxTextBuffer& f, int wrapping) const
+{
+    SaveMultiLines(f, m_header.Comment);
+    if (m_fileType == Type::POT)
+        f.AddLine(wxS("#, fuzzy"));
+    f.AddLine(wxS("msgid \"\""));
+    FormatStringForFile(f, wxS("msgstr"), UnescapeCString(m_header.ToString(wxEmptyString)), wrapping);
+}
+
+void POCatalog::SaveItem(wxTextBuffer& f, const POCatalogItem& item, int wrapping, unsigned pluralsCount)
+{
+    SaveMultiLines(f, item.GetComment());
+    for (unsigned i = 0; i < item.GetExtractedComments().GetCount(); i++)
+    {
+        if (item.GetExtractedComments()[i].empty())
+          f.AddLine(wxS("#."));
+        else
+          f.AddLine(wxS("#. ") + item.GetExtractedComments()[i]);
+    }
+    for (unsigned i = 0; i < item.GetRawReferences().GetCount(); i++)
+        f.AddLine(wxS("#: ") + item.GetRawReferences()[i]);
+    wxString dummy = item.GetFlags();
+    if (!dummy.empty())
+        f.AddLine(wxS("#") + dummy);
+    for (unsigned i = 0; i < item.GetOldMsgidRaw().size(); i++)
+        f.AddLine(wxS("#| ") + item.GetOldMsgidRaw()[i]);
+    if ( item.HasContext() )
+    {
+        FormatStringForFile(f, wxS("msgctxt"), item.GetContext(), wrapping);
+    }
+    FormatStringForFile(f, wxS("msgid"), item.GetString(), wrapping);
+    if (item.HasPlural())
+    {
+        FormatStringForFile(f, wxS("msgid_plural"), item.GetPluralString(), wrapping);
+
+        for (unsigned i = 0; i < pluralsCount; i++)
+        {
+            FormatStringForFile(f, wxString::Format(wxS("msgstr[%u]"), i), item.GetTranslation(i), wrapping);
         }
+    }
+    else
+    {
+        FormatStringForFile(f, wxS("msgstr"), item.GetTranslation(), wrapping);
+    }
+}
+
+void POCatalog::SaveDeletedItem(wxTextBuffer& f, const POCatalogDeletedData& item)
+{
+    SaveMultiLines(f, item.GetComment());
+    for (unsigned i = 0; i < item.GetExtractedComments().GetCount(); i++)
+        f.AddLine(wxS("#. ") + item.GetExtractedComments()[i]);
+    for (unsigned i = 0; i < item.GetRawReferences().GetCount(); i++)
+        f.AddLine(wxS("#: ") + item.GetRawReferences()[i]);
+    wxString dummy = item.GetFlags();
+    if (!dummy.empty())
+        f.AddLine(wxS("#") + dummy);
+
+    for (size_t j = 0; j < item.GetDeletedLines().GetCount(); j++)
+        f.AddLine(item.GetDeletedLines()[j]);
+}
+
+
+bool POCatalog::DoSaveOnly(const wxString& po_file, wxTextFileType crlf)
+{
+    if (DoSaveIncrementally(po_file, crlf))
+        return true;
+
+    std::string data;
+    if (!DoSaveOnly(data, crlf))
+        return false;
+
+    wxFFile f(po_file, "wb");
+    return f.IsOpened() && f.Write(data.data(), data.size()) == data.size() && f.Close();
+}
+
+bool POCatalog::DoSaveOnly(std::string& out, wxTextFileType crlf)
+{
+    wxMemoryText f;
+
+    // items' line numbers are about to change:
+    InvalidateLookupIndexes();
+
+    /* Save .po file: */
+    if (!m_header.Charset || m_header.Charset == "CHARSET")
+        m_header.Charset = "UTF-8";
+
+    const int wrapping = GetDesiredWrappingWidth(m_fileWrappingWidth);
+
+    SaveHeader(f, wrapping);
+    f.AddLine(wxEmptyString);
+
+    auto pluralsCount = GetPluralFormsCount();
+
+    for (auto& data_: m_items)
+    {
+        auto& data = static_cast<POCatalogItem&>(*data_);
+
+        data.SetLineNumber(int(f.GetLineCount()+1));
+        SaveItem(f, data, wrapping, pluralsCount);
         f.AddLine(wxEmptyString);
     }
 
@@ -1540,146 +2954,352 @@ bool POCatalog::DoSaveOnly(wxTextBuffer& f, wxTextFileType crlf)
 
         POCatalogDeletedData& deletedItem = m_deletedItems[itemIdx];
         deletedItem.SetLineNumber(int(f.GetLineCount()+1));
-        SaveMultiLines(f, deletedItem.GetComment());
-        for (unsigned i = 0; i < deletedItem.GetExtractedComments().GetCount(); i++)
-            f.AddLine(wxS("#. ") + deletedItem.GetExtractedComments()[i]);
-        for (unsigned i = 0; i < deletedItem.GetRawReferences().GetCount(); i++)
-            f.AddLine(wxS("#: ") + deletedItem.GetRawReferences()[i]);
-        wxString dummy = deletedItem.GetFlags();
-        if (!dummy.empty())
-            f.AddLine(wxS("#") + dummy);
-
-        for (size_t j = 0; j < deletedItem.GetDeletedLines().GetCount(); j++)
-            f.AddLine(deletedItem.GetDeletedLines()[j]);
+        SaveDeletedItem(f, deletedItem);
     }
 
-    if (!CanEncodeToCharset(f, m_header.Charset))
+    size_t failedLine = 0;
+    if (!EncodeToCharset(f, crlf, m_header.Charset, out, failedLine))
     {
-#if wxUSE_GUI
         wxString msg;
         msg.Printf(_(L"The catalog couldn’t be saved in “%s” charset as specified in catalog settings.\n\nIt was saved in UTF-8 instead and the setting was modified accordingly."),
                    m_header.Charset.c_str());
-        wxMessageBox(msg, _("Error saving catalog"),
-                     wxOK | wxICON_EXCLAMATION);
+        msg += "\n\n";
+        msg += wxString::Format(_(L"Line %d can’t be represented in it: %s"),
+                                int(failedLine + 1), f.GetLine(failedLine).Strip(wxString::both));
+#if wxUSE_GUI
+        // the catalog may be saved in the background, only show UI from the main thread
+        if (wxThread::IsMain())
+            wxMessageBox(msg, _("Error saving catalog"),
+                         wxOK | wxICON_EXCLAMATION);
+        else
 #endif
+            wxLogWarning("%s", msg);
         m_header.Charset = "UTF-8";
 
         // Re-do the save again because we modified a header:
-        f.Clear();
-        return DoSaveOnly(f, crlf);
+        return DoSaveOnly(out, crlf);
     }
 
-    // Otherwise everything can be safely saved:
-    return f.Write(crlf, wxCSConv(m_header.Charset));
+    return true;
 }
 
-
-bool POCatalog::HasDuplicateItems() const
+bool POCatalog::DoSaveIncrementally(const wxString& po_file, wxTextFileType crlf)
 {
-    typedef std::pair<wxString, wxString> MsgId;
-    std::set<MsgId> ids;
-    for (auto& item: m_items)
+    if (!m_fileContent)
+        return false;
+
+    if (!m_header.Charset || m_header.Charset == "CHARSET")
+        m_header.Charset = "UTF-8";
+
+    // The original text is only usable if it would be formatted the same:
+    const int wrapping = GetDesiredWrappingWidth(m_fileWrappingWidth);
+    if (m_fileContent->charset.CmpNoCase(m_header.Charset) != 0 ||
+        m_fileContent->wrapping != wrapping ||
+        m_fileContent->crlf != crlf)
     {
-        if (!ids.emplace(std::make_pair(item->GetContext(), item->GetString())).second)
-            return true;
+        return false;
     }
-    return false;
-}
 
-bool POCatalog::FixDuplicateItems()
-{
-    auto oldname = m_fileName;
+    const wxString charsetLower = m_header.Charset.Lower();
+    const bool isUTF8 = (charsetLower == "utf-8" || charsetLower == "utf8");
+    wxCSConv conv(m_header.Charset);
 
-    TempDirectory tmpdir;
-    if ( !tmpdir.IsOk() )
-        return false;
+    // items' line numbers are about to change:
+    InvalidateLookupIndexes();
 
-    wxString ext;
-    wxFileName::SplitPath(m_fileName, nullptr, nullptr, &ext);
-    wxString po_file_temp = tmpdir.CreateFileName("catalog." + ext);
-    wxString po_file_fixed = tmpdir.CreateFileName("fixed." + ext);
+    auto content = std::make_shared<POFileContent>();
+    content->charset = m_header.Charset;
+    content->crlf = crlf;
+    content->wrapping = wrapping;
+    std::string& out = content->data;
+    out.reserve(m_fileContent->data.size());
 
-    if ( !DoSaveOnly(po_file_temp, wxTextFileType_Unix) )
+    const std::string eol(wxString(wxTextBuffer::GetEOL(crlf)).ToStdString());
+    size_t lineCount = 0;
+
+    // Modified entries are serialized into this buffer and then encoded:
+    wxMemoryText buf;
+    auto writeBuffer = [&](POEntryRawText& raw) -> bool
+    {
+        raw.offset = out.size();
+        raw.lines = buf.GetLineCount();
+        for (size_t i = 0; i < buf.GetLineCount(); i++)
+        {
+            const wxString& line = buf.GetLine(i);
+            if (isUTF8)
+            {
+                const auto utf8 = line.utf8_str();
+                out.append(utf8.data(), utf8.length());
+            }
+            else if (!line.empty())
+            {
+                const wxCharBuffer converted(line.mb_str(conv));
+                if (converted.length() == 0)
+                    return false;
+                out.append(converted.data(), converted.length());
+            }
+            out.append(eol);
+        }
+        raw.length = out.size() - raw.offset - (raw.lines ? eol.size() : 0);
+        lineCount += raw.lines;
+        buf.Clear();
+        return true;
+    };
+
+    // Unmodified entries are copied from the original text:
+    auto writeOriginal = [&](POEntryRawText& raw, const POEntryRawText& original)
+    {
+        raw.offset = out.size();
+        raw.length = original.length;
+        raw.lines = original.lines;
+        out.append(original.content->data, original.offset, original.length);
+        out.append(eol);
+        lineCount += raw.lines;
+    };
+
+    auto writeEmptyLine = [&]
     {
-        wxLogError(_(L"Couldn’t save file %s."), po_file_temp.c_str());
+        out.append(eol);
+        lineCount++;
+    };
+
+    POEntryRawText headerRaw;
+    SaveHeader(buf, wrapping);
+    if (!writeBuffer(headerRaw))
         return false;
+    writeEmptyLine();
+
+    const unsigned pluralsCount = GetPluralFormsCount();
+
+    std::vector<POEntryRawText> itemsRaw(m_items.size());
+    for (size_t idx = 0; idx < m_items.size(); idx++)
+    {
+        auto& item = static_cast<POCatalogItem&>(*m_items[idx]);
+        const auto& original = item.GetRawText();
+
+        item.SetLineNumber(int(lineCount + 1));
+        if (!item.IsModified() && original.content == m_fileContent &&
+            (!item.HasPlural() || item.GetNumberOfTranslations() == pluralsCount))
+        {
+            writeOriginal(itemsRaw[idx], original);
+        }
+        else
+        {
+            SaveItem(buf, item, wrapping, pluralsCount);
+            if (!writeBuffer(itemsRaw[idx]))
+                return false;
+        }
+        writeEmptyLine();
     }
 
-    ExecuteGettext(wxString::Format("msguniq -o %s %s",
-                                    QuoteCmdlineArg(po_file_fixed),
-                                    QuoteCmdlineArg(po_file_temp)));
+    std::vector<POEntryRawText> deletedRaw(m_deletedItems.size());
+    for (size_t idx = 0; idx < m_deletedItems.size(); idx++)
+    {
+        if (idx != 0)
+            writeEmptyLine();
+
+        auto& item = m_deletedItems[idx];
+        const auto& original = item.GetRawText();
+
+        item.SetLineNumber(int(lineCount + 1));
+        if (original.content == m_fileContent)
+        {
+            writeOriginal(deletedRaw[idx], original);
+        }
+        else
+        {
+            SaveDeletedItem(buf, item);
+            if (!writeBuffer(deletedRaw[idx]))
+                return false;
+        }
+    }
 
-    if (!wxFileName::FileExists(po_file_fixed))
+    wxFFile f(po_file, "wb");
+    if (!f.IsOpened() || f.Write(out.data(), out.size()) != out.size() || !f.Close())
         return false;
 
-    bool ok = Load(po_file_fixed);
-    m_fileName = oldname;
-    return ok;
+    // Entries' text now lives in the newly written file:
+    for (size_t idx = 0; idx < m_items.size(); idx++)
+    {
+        itemsRaw[idx].content = content;
+        static_cast<POCatalogItem&>(*m_items[idx]).SetRawText(itemsRaw[idx]);
+    }
+    for (size_t idx = 0; idx < m_deletedItems.size(); idx++)
+    {
+        deletedRaw[idx].content = content;
+        m_deletedItems[idx].SetRawText(deletedRaw[idx]);
+    }
+    m_fileContent = content;
+
+    return true;
 }
 
 
-Catalog::ValidationResults POCatalog::Validate(bool wasJustLoaded)
+namespace
 {
-    if (!HasCapability(Catalog::Cap::Translations))
-        return ValidationResults();  // no errors in POT files
 
-    if (wasJustLoaded)
+// key identifying an entry, as used by gettext tools:
+inline std::wstring DuplicatesKey(const CatalogItem& item)
+{
+    if (!item.HasContext())
+        return item.GetString().ToStdWstring();
+    std::wstring key(item.GetContext().ToStdWstring());
+    key += L'\x04';
+    key += item.GetString().ToStdWstring();
+    return key;
+}
+
+// entry as shown in the merge summary:
+inline wxString ItemMergeSummary(const CatalogItem& item)
+{
+    wxString s = item.GetString();
+    if ( item.HasPlural() )
+        s += "|" + item.GetPluralString();
+    if ( item.HasContext() )
+        s += wxString::Format(" [%s]", item.GetContext());
+
+    return s;
+}
+
+} // anonymous namespace
+
+bool POCatalog::HasDuplicateItems() const
+{
+    return GetLookupIndexes().hasDuplicates;
+}
+
+bool POCatalog::FixDuplicateItems()
+{
+    // index of the first occurrence of every key:
+    std::unordered_map<std::wstring, size_t> firstOccurrence;
+    firstOccurrence.reserve(m_items.size());
+
+    CatalogItemArray unique;
+    unique.reserve(m_items.size());
+
+    for (auto& item: m_items)
     {
-        return DoValidate(GetFileName());
+        auto inserted = firstOccurrence.emplace(DuplicatesKey(*item), unique.size());
+        if (inserted.second)
+        {
+            unique.push_back(item);
+        }
+        else
+        {
+            auto& first = static_cast<POCatalogItem&>(*unique[inserted.first->second]);
+            first.MergeDuplicate(static_cast<const POCatalogItem&>(*item));
+        }
     }
-    else
+
+    if (unique.size() == m_items.size())
+        return true;
+
+    m_items.swap(unique);
+    RebuildStatusIndex();
+
+    // IDs and bookmarks refer to positions in the catalog, which have changed:
+    for (int i = BOOKMARK_0; i < BOOKMARK_LAST; i++)
+        m_header.Bookmarks[i] = -1;
+    for (size_t i = 0; i < m_items.size(); i++)
     {
-        TempDirectory tmpdir;
-        if ( !tmpdir.IsOk() )
-            return ValidationResults();
+        auto& item = static_cast<POCatalogItem&>(*m_items[i]);
+        item.SetId(int(i + 1));
+        if (item.HasBookmark())
+        {
+            if (m_header.Bookmarks[item.GetBookmark()] == -1)
+                m_header.Bookmarks[item.GetBookmark()] = int(i);
+            else
+                item.SetBookmark(NO_BOOKMARK);
+        }
+    }
 
-        wxString tmp_po = tmpdir.CreateFileName("validated.po");
-        if ( !DoSaveOnly(tmp_po, wxTextFileType_Unix) )
-            return ValidationResults();
+    return true;
+}
 
-        return DoValidate(tmp_po);
+
+void POCatalog::AppendCatalog(POCatalog& other)
+{
+    m_items.reserve(m_items.size() + other.m_items.size());
+    for (auto& i: other.m_items)
+    {
+        static_cast<POCatalogItem&>(*i).SetId(int(m_items.size() + 1));
+        Catalog::AddItem(i);
     }
+    other.m_items.clear();
+    other.RebuildStatusIndex();
 }
 
-Catalog::ValidationResults POCatalog::DoValidate(const wxString& po_file)
+
+Catalog::ValidationResults POCatalog::Validate(bool /*wasJustLoaded*/)
 {
-    ValidationResults res;
+    if (!HasCapability(Catalog::Cap::Translations))
+        return ValidationResults();  // no errors in POT files
+
+    // The checks are done on the items directly, so it doesn't matter if the
+    // file on disk is up to date or not:
+    return DoValidate();
+}
 
-    GettextErrors err;
-    ExecuteGettextAndParseOutput
-    (
-        wxString::Format("msgfmt -o /dev/null -c %s", QuoteCmdlineArg(CliSafeFileName(po_file))),
-        err
-    );
+
+Catalog::ValidationResults POCatalog::DoValidate()
+{
+    TRACE_SCOPE("POCatalog::DoValidate");
+
+    ValidationResults res;
 
     for (auto& i: m_items)
         i->ClearIssue();
 
-    res.errors = (int)err.size();
-
+    // QA warnings are less important than errors and so are overridden by them:
     if (Config::ShowWarnings())
         res.warnings = QAChecker::GetFor(*this)->Check(*this);
 
-    for ( GettextErrors::const_iterator i = err.begin(); i != err.end(); ++i )
-    {
-        if ( i->line != -1 )
-        {
-            auto item = FindItemByLine(i->line);
-            if ( item )
-            {
-                item->SetIssue(CatalogItem::Issue::Error, i->text);
-                continue;
-            }
-        }
-        // if not matched to an item:
-        wxLogError(i->text);
-    }
+    res.errors = GettextValidator(*this).Check();
 
     return res;
 }
 
 
-bool POCatalog::UpdateFromPOT(const wxString& pot_file, bool replace_header)
+Catalog::ValidationResults POCatalog::ValidateItems(size_t begin, size_t end)
+{
+    ValidationResults res;
+    if (!HasCapability(Catalog::Cap::Translations))
+        return res;
+
+    end = std::min(end, m_items.size());
+    for (size_t i = begin; i < end; i++)
+        m_items[i]->ClearIssue();
+
+    // same order as in DoValidate(), errors override warnings:
+    if (Config::ShowWarnings())
+        res.warnings = QAChecker::GetFor(*this)->Check(*this, begin, end);
+
+    res.errors = GettextValidator(*this).Check(begin, end);
+
+    return res;
+}
+
+
+bool POCatalog::ValidateItem(const CatalogItemPtr& item)
+{
+    item->ClearIssue();
+
+    if (!HasCapability(Catalog::Cap::Translations))
+        return false;
+
+    // same order as in DoValidate(), errors override warnings:
+    if (Config::ShowWarnings())
+        QAChecker::GetFor(*this)->Check(item);
+
+    GettextValidator(*this).Check(item);
+
+    return item->HasIssue();
+}
+
+
+bool POCatalog::UpdateFromPOT(const wxString& pot_file, bool replace_header,
+                              const MergeConfirmation& confirm,
+                              const MergeProgress& progress)
 {
     POCatalogPtr pot = std::make_shared<POCatalog>(pot_file, CreationFlag_IgnoreTranslations);
     if (!pot->IsOk())
@@ -1688,22 +3308,51 @@ bool POCatalog::UpdateFromPOT(const wxString& pot_file, bool replace_header)
         return false;
     }
 
-    return UpdateFromPOT(pot, replace_header);
+    return UpdateFromPOT(pot, replace_header, confirm, progress);
 }
 
-bool POCatalog::UpdateFromPOT(POCatalogPtr pot, bool replace_header)
+bool POCatalog::UpdateFromPOT(POCatalogPtr pot, bool replace_header,
+                              const MergeConfirmation& confirm,
+                              const MergeProgress& progress,
+                              const std::vector<wxString> *changedSources)
 {
     switch (m_fileType)
     {
         case Type::PO:
         {
-            if (!Merge(pot))
+            if (!Merge(pot, confirm, progress, changedSources))
                 return false;
             break;
         }
         case Type::POT:
         {
+            if (confirm)
+            {
+                // nothing to merge, the entries are simply replaced:
+                std::unordered_set<std::wstring> keysThis, keysRef;
+                for (auto& i: m_items)
+                    keysThis.insert(DuplicatesKey(*i));
+                for (auto& i: pot->m_items)
+                    keysRef.insert(DuplicatesKey(*i));
+
+                MergeSummary summary;
+                for (auto& i: pot->m_items)
+                {
+                    if (keysThis.find(DuplicatesKey(*i)) == keysThis.end())
+                        summary.newStrings.push_back(ItemMergeSummary(*i));
+                }
+                for (auto& i: m_items)
+                {
+                    if (keysRef.find(DuplicatesKey(*i)) == keysRef.end())
+                        summary.obsoleteStrings.push_back(ItemMergeSummary(*i));
+                }
+                summary.newStrings.Sort();
+                summary.obsoleteStrings.Sort();
+                if (!confirm(summary))
+                    return false;
+            }
             m_items = pot->m_items;
+            RebuildStatusIndex();
             break;
         }
 
@@ -1727,52 +3376,648 @@ POCatalogPtr POCatalog::CreateFromPOT(POCatalogPtr pot)
         return nullptr;
 }
 
-bool POCatalog::Merge(const POCatalogPtr& refcat)
+CatalogPtr POCatalog::CreateSnapshot() const
 {
-    wxString oldname = m_fileName;
+    auto snapshot = std::make_shared<POCatalog>(*this);
+    // the snapshot is short-lived, don't let its items stay in our arena:
+    snapshot->m_itemsArena = std::make_shared<MemoryArena>();
+    for (auto& i: snapshot->m_items)
+        i = snapshot->CreateItem<POCatalogItem>(static_cast<const POCatalogItem&>(*i));
+    snapshot->RebuildStatusIndex();
+    return snapshot;
+}
 
-    TempDirectory tmpdir;
-    if ( !tmpdir.IsOk() )
-        return false;
+void POCatalog::AdoptSavedSnapshot(const POCatalog& saved)
+{
+    InvalidateLookupIndexes();
+    m_fileName = saved.m_fileName;
+    m_header.RevisionDate = saved.m_header.RevisionDate;
+    m_header.CreationDate = saved.m_header.CreationDate;
+    m_header.Charset = saved.m_header.Charset;
+
+    // Items can only be matched if the catalog's structure didn't change:
+    if (m_items.size() == saved.m_items.size())
+    {
+        for (size_t idx = 0; idx < m_items.size(); idx++)
+        {
+            auto& item = static_cast<POCatalogItem&>(*m_items[idx]);
+            auto& savedItem = static_cast<const POCatalogItem&>(*saved.m_items[idx]);
+            if (item.GetId() != savedItem.GetId())
+                continue;
+
+            item.SetLineNumber(savedItem.GetLineNumber());
+            if (savedItem.HasIssue())
+                item.SetIssue(savedItem.GetIssue());
+            else
+                item.ClearIssue();
+
+            // The saved text is only valid for items that weren't changed
+            // since the snapshot was taken (which would invalidate it):
+            if (item.GetRawText().IsValid() && item.GetRawText().content == m_fileContent)
+                item.SetRawText(savedItem.GetRawText());
+        }
+    }
+
+    if (m_deletedItems.size() == saved.m_deletedItems.size())
+    {
+        for (size_t idx = 0; idx < m_deletedItems.size(); idx++)
+        {
+            auto& d = m_deletedItems[idx];
+            d.SetLineNumber(saved.m_deletedItems[idx].GetLineNumber());
+            if (d.GetRawText().IsValid() && d.GetRawText().content == m_fileContent)
+                d.SetRawText(saved.m_deletedItems[idx].GetRawText());
+        }
+    }
+
+    m_fileContent = saved.m_fileContent;
+}
+
+namespace
+{
+
+// Minimal similarity of source texts for reusing a translation as fuzzy, the
+// same as msgmerge's FUZZY_THRESHOLD:
+const double MERGE_FUZZY_THRESHOLD = 0.6;
+
+// How many of the most promising candidates to compare with a string:
+const size_t MAX_FUZZY_CANDIDATES = 16;
+
+/// Entry of the old catalog, current or obsolete, whose translation
+/// may be reused for an entry of the reference catalog.
+struct MergeCandidate
+{
+    bool hasContext = false;
+    wxString context;
+    wxString msgid;
+    bool hasPlural = false;
+    wxString plural;
+    SmallStringArray translations;
+    wxString comment;
+    wxString flags;
+    SmallStringArray oldMsgid;
+    Bookmark bookmark = NO_BOOKMARK;
+
+    // index into the catalog's items or obsolete items
+    bool obsolete = false;
+    size_t index = 0;
+
+    bool IsFuzzy() const { return flags.find(wxS(", fuzzy")) != wxString::npos; }
+    bool HasTranslation() const { return !translations.empty() && !translations[0].empty(); }
+
+    std::wstring Key() const
+    {
+        if (!hasContext)
+            return msgid.ToStdWstring();
+        std::wstring key(context.ToStdWstring());
+        key += L'\x04';
+        key += msgid.ToStdWstring();
+        return key;
+    }
+};
+
+
+/// Decodes the text of an obsolete entry, i.e. its "#~ " lines
+bool ParseObsoleteEntry(const POCatalogDeletedData& data, MergeCandidate& c)
+{
+    enum { None, Context, Msgid, Plural, Msgstr } target = None;
+    bool hasMsgid = false;
+
+    for (auto line: data.GetDeletedLines())
+    {
+        wxString rest;
+        if (!line.StartsWith(wxS("#~"), &rest))
+            continue;
+        line = rest;
+        if (line.StartsWith(wxS("|")))
+        {
+            c.oldMsgid.push_back(line.Mid(1).Trim(false));
+            continue;
+        }
+        line.Trim(false).Trim(true);
+
+        wxString value;
+        if (line.StartsWith(wxS("\"")))
+        {
+            value = line;
+        }
+        else
+        {
+            const wxString keyword = line.BeforeFirst(' ', &value);
+            value.Trim(false);
+            if (keyword == wxS("msgctxt"))
+            {
+                target = Context;
+                c.hasContext = true;
+            }
+            else if (keyword == wxS("msgid"))
+            {
+                target = Msgid;
+                hasMsgid = true;
+            }
+            else if (keyword == wxS("msgid_plural"))
+            {
+                target = Plural;
+                c.hasPlural = true;
+            }
+            else if (keyword.StartsWith(wxS("msgstr")))
+            {
+                target = Msgstr;
+                c.translations.push_back(wxString());
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (value.length() < 2 || value[0] != '"' || value.Last() != '"')
+            return false;
+        value = UnescapeCString(value.Mid(1, value.length() - 2));
+
+        switch (target)
+        {
+            case Context: c.context += value;                break;
+            case Msgid:   c.msgid += value;                  break;
+            case Plural:  c.plural += value;                 break;
+            case Msgstr:  c.translations.back() += value;    break;
+            case None:    return false;
+        }
+    }
+
+    c.comment = data.GetComment();
+    c.flags = data.GetFlags();
+    return hasMsgid;
+}
+
+
+/**
+    Index of candidates' source texts by character trigrams, used to find
+    the few candidates worth comparing with a string that has no exact match,
+    instead of comparing it with all of them.
+ */
+class TrigramIndex
+{
+public:
+    typedef std::vector<uint64_t> Trigrams;
+
+    /// Returns unique trigrams of @a text, specific to the context
+    static Trigrams Get(bool hasContext, const wxString& context, const wxString& text)
+    {
+        // boundary markers make short texts indexable too:
+        std::wstring s;
+        s.reserve(text.length() + 2);
+        s += L'\x02';
+        s += text.ToStdWstring();
+        s += L'\x03';
+
+        // fuzzy matches must have the same context, so make it part of the key:
+        const uint64_t ctx = hasContext ? (std::hash<std::wstring>()(context.ToStdWstring()) | 1) * 1099511628211ULL : 0;
+
+        Trigrams grams;
+        grams.reserve(s.length());
+        for (size_t i = 0; i + 2 < s.length(); i++)
+        {
+            // code points have at most 21 bits:
+            const uint64_t g = (uint64_t(s[i] & 0x1FFFFF) << 42) | (uint64_t(s[i+1] & 0x1FFFFF) << 21) | uint64_t(s[i+2] & 0x1FFFFF);
+            grams.push_back(g ^ ctx);
+        }
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    void Add(uint32_t id, const Trigrams& grams)
+    {
+        for (auto g: grams)
+            m_postings[g].push_back(id);
+        m_size++;
+    }
+
+    /// Returns IDs of candidates sharing the most trigrams with @a grams, best first
+    std::vector<uint32_t> Find(const Trigrams& grams, size_t maxResults) const
+    {
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (auto g: grams)
+        {
+            auto i = m_postings.find(g);
+            if (i != m_postings.end())
+                lists.push_back(&i->second);
+        }
+        if (lists.empty())
+            return {};
+
+        // Very common trigrams carry little information and would make the
+        // search as slow as comparing with everything; skip them unless
+        // there's nothing else:
+        std::sort(lists.begin(), lists.end(),
+                  [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b){ return a->size() < b->size(); });
+        const size_t maxPostings = std::max(size_t(1000), m_size / 10);
+
+        std::unordered_map<uint32_t, uint32_t> shared;
+        for (auto list: lists)
+        {
+            if (list->size() > maxPostings && !shared.empty())
+                break;
+            for (auto id: *list)
+                shared[id]++;
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>> best(shared.begin(), shared.end());
+        const size_t count = std::min(maxResults, best.size());
+        std::partial_sort(best.begin(), best.begin() + count, best.end(),
+                          [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b)
+                          {
+                              return a.second > b.second || (a.second == b.second && a.first < b.first);
+                          });
+
+        std::vector<uint32_t> out;
+        out.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            out.push_back(best[i].first);
+        return out;
+    }
+
+private:
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_postings;
+    size_t m_size = 0;
+};
+
+
+inline FuzzyMatcher::Tokens CharsOf(const wxString& text)
+{
+    FuzzyMatcher::Tokens tokens;
+    tokens.reserve(text.length());
+    for (auto c: text.ToStdWstring())
+        tokens.emplace_back(1, c);
+    return tokens;
+}
+
+
+/// Formats msgctxt, msgid and msgstr lines of an entry the way they would be written to the file
+wxArrayString FormatEntryText(const MergeCandidate& c, const wxString& prefix, int wrapping)
+{
+    wxMemoryText f;
+    if (c.hasContext)
+        FormatStringForFile(f, wxS("msgctxt"), c.context, wrapping);
+    FormatStringForFile(f, wxS("msgid"), c.msgid, wrapping);
+    if (c.hasPlural)
+    {
+        FormatStringForFile(f, wxS("msgid_plural"), c.plural, wrapping);
+        for (size_t i = 0; i < c.translations.size(); i++)
+            FormatStringForFile(f, wxString::Format(wxS("msgstr[%u]"), unsigned(i)), c.translations[i], wrapping);
+    }
+    else
+    {
+        FormatStringForFile(f, wxS("msgstr"), c.translations.empty() ? wxString() : c.translations[0], wrapping);
+    }
+
+    wxArrayString lines;
+    for (size_t i = 0; i < f.GetLineCount(); i++)
+        lines.push_back(prefix + f.GetLine(i));
+    return lines;
+}
+
+} // anonymous namespace
+
+
+bool POCatalog::Merge(const POCatalogPtr& refcat, const MergeConfirmation& confirm,
+                      const MergeProgress& progress,
+                      const std::vector<wxString> *changedSources)
+{
+    TRACE_SCOPE("POCatalog::Merge");
+
+    // This is done in-process the same way msgmerge --previous merges the
+    // old catalog with the reference POT: entries are taken from the POT,
+    // translations from the old entry with the same msgctxt and msgid, if
+    // any; other entries get a similar old entry's translation marked as
+    // fuzzy. Unused translations become obsolete.
+    const bool fuzzyMatching = Config::MergeBehavior() != Merge_None;
+    const int wrapping = GetDesiredWrappingWidth(m_fileWrappingWidth);
+
+    std::vector<MergeCandidate> candidates;
+    candidates.reserve(m_items.size() + m_deletedItems.size());
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        auto& item = static_cast<POCatalogItem&>(*m_items[i]);
+        MergeCandidate c;
+        c.hasContext = item.HasContext();
+        c.context = item.GetContext();
+        c.msgid = item.GetString();
+        c.hasPlural = item.HasPlural();
+        c.plural = item.GetPluralString();
+        c.translations = item.GetTranslations();
+        c.comment = item.GetComment();
+        c.flags = item.GetFlags();
+        c.oldMsgid = item.GetOldMsgidRaw();
+        c.bookmark = item.GetBookmark();
+        c.index = i;
+        candidates.push_back(std::move(c));
+    }
+    for (size_t i = 0; i < m_deletedItems.size(); i++)
+    {
+        MergeCandidate c;
+        if (!ParseObsoleteEntry(m_deletedItems[i], c))
+            continue;
+        c.obsolete = true;
+        c.index = i;
+        candidates.push_back(std::move(c));
+    }
+
+    // exact matches, preferring current entries to obsolete ones:
+    std::unordered_map<std::wstring, size_t> exact;
+    exact.reserve(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+        exact.emplace(candidates[i].Key(), i);
+
+    auto& refItems = refcat->m_items;
+    std::vector<int> matches(refItems.size(), -1);
+    std::vector<size_t> unmatched;
+    std::vector<bool> used(candidates.size(), false);
+    for (size_t i = 0; i < refItems.size(); i++)
+    {
+        auto m = exact.find(DuplicatesKey(*refItems[i]));
+        if (m != exact.end())
+        {
+            matches[i] = int(m->second);
+            used[m->second] = true;
+        }
+        else if (fuzzyMatching && !refItems[i]->GetStringUTF8().empty())
+        {
+            unmatched.push_back(i);
+        }
+    }
+
+    // the summary only compares current entries, revived obsolete ones count as new:
+    if (confirm)
+    {
+        MergeSummary summary;
+        for (size_t i = 0; i < refItems.size(); i++)
+        {
+            if (matches[i] == -1 || candidates[matches[i]].obsolete)
+                summary.newStrings.push_back(ItemMergeSummary(*refItems[i]));
+        }
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            if (!candidates[i].obsolete && !used[i])
+                summary.obsoleteStrings.push_back(ItemMergeSummary(*m_items[candidates[i].index]));
+        }
+        summary.newStrings.Sort();
+        summary.obsoleteStrings.Sort();
+        if (!confirm(summary))
+            return false;
+    }
+
+    // fuzzy matching of the rest against translated entries, in parallel:
+    std::vector<bool> isFuzzyMatch(refItems.size(), false);
+    if (!unmatched.empty())
+    {
+        TrigramIndex index;
+        std::vector<FuzzyMatcher::Tokens> candidateChars(candidates.size());
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            auto& c = candidates[i];
+            if (!c.HasTranslation() || c.msgid.empty())
+                continue;
+            index.Add(uint32_t(i), TrigramIndex::Get(c.hasContext, c.context, c.msgid));
+            candidateChars[i] = CharsOf(c.msgid);
+        }
+
+        // exactly matched entries are done already:
+        const size_t exactlyMatched = refItems.size() - unmatched.size();
+        if (progress && !progress(exactlyMatched, refItems.size()))
+            return false;
+
+        dispatch::parallel_options options;
+        options.min_chunk_size = 16;
+        if (progress)
+        {
+            options.progress = [&](size_t done, size_t /*total*/)
+            {
+                return progress(exactlyMatched + done, refItems.size());
+            };
+        }
+
+        auto fuzzy = dispatch::parallel_transform(0, unmatched.size(), [&](size_t u)
+        {
+            auto& item = *refItems[unmatched[u]];
+            const FuzzyMatcher matcher(CharsOf(item.GetString()));
+
+            int best = -1;
+            double bestSimilarity = MERGE_FUZZY_THRESHOLD;
+            for (auto id: index.Find(TrigramIndex::Get(item.HasContext(), item.GetContext(), item.GetString()), MAX_FUZZY_CANDIDATES))
+            {
+                auto& c = candidates[id];
+                if (c.hasContext != item.HasContext() || c.context != item.GetContext())
+                    continue;  // hash collision
+                const double similarity = matcher.Similarity(candidateChars[id], bestSimilarity);
+                if (similarity < bestSimilarity)
+                    continue;
+                // prefer the earliest of equally good candidates:
+                if (best == -1 || similarity > bestSimilarity || int(id) < best)
+                {
+                    best = int(id);
+                    bestSimilarity = similarity;
+                }
+            }
+            return best;
+        }, options);
+
+        if (options.token.is_cancelled())
+            return false;
+
+        for (size_t u = 0; u < unmatched.size(); u++)
+        {
+            if (fuzzy[u] == -1)
+                continue;
+            matches[unmatched[u]] = fuzzy[u];
+            isFuzzyMatch[unmatched[u]] = true;
+            used[fuzzy[u]] = true;
+        }
+    }
 
-    wxString tmp1 = tmpdir.CreateFileName("ref.pot");
-    wxString tmp2 = tmpdir.CreateFileName("input.po");
-    wxString tmp3 = tmpdir.CreateFileName("output.po");
+    // Entries that don't come from changed source files were merged before
+    // and are kept as they are, if extracted the same way again; this has to
+    // be verified, because the extraction cache may be shared with another
+    // catalog and the files changed since this one was updated:
+    static const wxString fuzzyFlag(wxS(", fuzzy"));
+    auto extractedFlags = [](const CatalogItem& item)
+    {
+        auto flags = item.GetFlags();
+        if (item.IsFuzzy())
+            flags.erase(0, fuzzyFlag.length());
+        return flags;
+    };
+    auto canKeep = [&](const POCatalogItem& item, const POCatalogItem& refItem)
+    {
+        return item.HasPlural() == refItem.HasPlural() &&
+               item.GetPluralString() == refItem.GetPluralString() &&
+               (item.IsFuzzy() || item.GetOldMsgidRaw().empty()) &&
+               item.GetRawReferences() == refItem.GetRawReferences() &&
+               item.GetExtractedComments() == refItem.GetExtractedComments() &&
+               extractedFlags(item) == extractedFlags(refItem);
+    };
 
-    refcat->DoSaveOnly(tmp1, wxTextFileType_Unix);
-    DoSaveOnly(tmp2, wxTextFileType_Unix);
+    std::vector<bool> affected, kept;
+    if (changedSources)
+    {
+        affected.assign(m_items.size(), false);
+        kept.assign(m_items.size(), false);
+        for (auto& file: *changedSources)
+        {
+            for (auto i: FindItemsReferencingFile(file))
+                affected[i] = true;
+        }
+    }
 
-    wxString flags("-q --force-po --previous");
-    if (Config::MergeBehavior() == Merge_None)
+    // build the merged catalog:
+    CatalogItemArray merged;
+    merged.reserve(refItems.size());
+    size_t keptCount = 0;
+    for (size_t i = 0; i < refItems.size(); i++)
     {
-        flags += " --no-fuzzy-matching";
+        auto& refItem = static_cast<POCatalogItem&>(*refItems[i]);
+        refItem.EnsureMetadataLoaded();
+
+        if (changedSources && matches[i] != -1 && !isFuzzyMatch[i])
+        {
+            auto& c = candidates[matches[i]];
+            if (!c.obsolete && !affected[c.index] && !kept[c.index])
+            {
+                auto& item = static_cast<POCatalogItem&>(*m_items[c.index]);
+                if (canKeep(item, refItem))
+                {
+                    // reset it the same way merged entries are:
+                    item.m_rawText.Invalidate();
+                    if (item.GetId() != int(i + 1))
+                        item.SetId(int(i + 1));
+                    if (item.GetLineNumber() != 0)
+                        item.SetLineNumber(0);
+                    if (item.IsModified())
+                        item.SetModified(false);
+                    if (item.IsPreTranslated())
+                        item.SetPreTranslated(false);
+                    kept[c.index] = true;
+                    keptCount++;
+                    merged.push_back(m_items[c.index]);
+                    continue;
+                }
+            }
+        }
+
+        auto item = CreateItem<POCatalogItem>(refItem);
+        item->m_rawText.Invalidate();
+        item->SetId(int(i + 1));
+        item->SetLineNumber(0);
+        item->SetModified(false);
+        item->SetPreTranslated(false);
+        item->SetBookmark(NO_BOOKMARK);
+        item->SetOldMsgid(SmallStringArray());
+
+        if (matches[i] == -1)
+        {
+            merged.push_back(item);
+            continue;
+        }
+
+        auto& c = candidates[matches[i]];
+        bool fuzzy = c.IsFuzzy() || isFuzzyMatch[i];
+        SmallStringArray oldMsgid = c.oldMsgid;
+
+        // plural forms can't be reused as-is if the singular/plural kind changed:
+        SmallStringArray translations = c.translations;
+        const bool pluralChanged = c.hasPlural != refItem.HasPlural() ||
+                                   (c.hasPlural && c.plural != refItem.GetPluralString());
+        if (pluralChanged)
+        {
+            fuzzy = true;
+            if (!refItem.HasPlural())
+                translations.resize(std::min(translations.size(), size_t(1)));
+            else if (!c.hasPlural)
+                translations.resize(std::max(size_t(GetPluralFormsCount()), size_t(2)));
+        }
+
+        // keep the source text this fuzzy translation was for:
+        if (isFuzzyMatch[i] || pluralChanged)
+        {
+            wxMemoryText f;
+            FormatStringForFile(f, wxS("msgid"), c.msgid, wrapping);
+            if (c.hasPlural)
+                FormatStringForFile(f, wxS("msgid_plural"), c.plural, wrapping);
+            oldMsgid.clear();
+            for (size_t l = 0; l < f.GetLineCount(); l++)
+                oldMsgid.push_back(f.GetLine(l));
+        }
+
+        item->SetComment(c.comment);
+        item->SetTranslations(translations);
+        item->SetFuzzy(fuzzy);
+        if (fuzzy)
+            item->SetOldMsgid(oldMsgid);
+        item->SetBookmark(c.bookmark);
+        merged.push_back(item);
     }
 
-    bool succ = ExecuteGettext
-                (
-                    wxString::Format
-                    (
-                        "msgmerge %s -o %s %s %s",
-                        flags,
-                        QuoteCmdlineArg(tmp3),
-                        QuoteCmdlineArg(tmp2),
-                        QuoteCmdlineArg(tmp1)
-                    )
-                );
+    // obsolete entries: no longer used translations followed by previously obsolete ones
+    POCatalogDeletedDataArray obsolete;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        auto& c = candidates[i];
+        if (c.obsolete || used[i] || !c.HasTranslation())
+            continue;
+        POCatalogDeletedData data(FormatEntryText(c, wxS("#~ "), wrapping));
+        if (!c.oldMsgid.empty())
+        {
+            wxArrayString lines;
+            for (auto& l: c.oldMsgid)
+                lines.push_back(wxS("#~| ") + l);
+            for (auto& l: data.GetDeletedLines())
+                lines.push_back(l);
+            data.SetDeletedLines(lines);
+        }
+        data.SetComment(c.comment);
+        data.SetFlags(c.flags);
+        obsolete.push_back(data);
+    }
+    std::vector<bool> resurrected(m_deletedItems.size(), false);
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (candidates[i].obsolete && used[i])
+            resurrected[candidates[i].index] = true;
+    }
+    for (size_t i = 0; i < m_deletedItems.size(); i++)
+    {
+        if (!resurrected[i])
+            obsolete.push_back(m_deletedItems[i]);
+    }
 
-    if (succ)
+    if (changedSources)
     {
-        const wxString charset = m_header.Charset;
+        wxLogTrace("poedit", "merge: %d changed source files, %d of %d entries kept as they were",
+                   (int)changedSources->size(), (int)keptCount, (int)merged.size());
+    }
 
-        Load(tmp3);
+    m_items.swap(merged);
+    m_deletedItems.swap(obsolete);
+    RebuildStatusIndex();
 
-        // msgmerge doesn't always preserve the charset, it tends to pick
-        // the most generic one of the charsets used, so if we are merging with
-        // UTF-8 catalog, it will become UTF-8. Some people hate this.
-        m_header.Charset = charset;
+    // bookmarks refer to positions in the catalog, which have changed:
+    for (int i = BOOKMARK_0; i < BOOKMARK_LAST; i++)
+        m_header.Bookmarks[i] = -1;
+    for (size_t i = 0; i < m_items.size(); i++)
+    {
+        auto& item = *m_items[i];
+        if (item.HasBookmark())
+        {
+            if (m_header.Bookmarks[item.GetBookmark()] == -1)
+                m_header.Bookmarks[item.GetBookmark()] = int(i);
+            else
+                item.SetBookmark(NO_BOOKMARK);
+        }
     }
 
-    m_fileName = oldname;
+    // like msgmerge, take the POT's creation date:
+    if (!refcat->Header().CreationDate.empty())
+        m_header.CreationDate = refcat->Header().CreationDate;
 
-    return succ;
+    return true;
 }
@@ -28,12 +28,45 @@
 
 #include "catalog.h"
 
+#include <wx/strconv.h>
+
+#include <boost/utility/string_view.hpp>
+
+#include <deque>
+#include <functional>
+
 class POCatalogItem;
 class POCatalog;
 typedef std::shared_ptr<POCatalogItem> POCatalogItemPtr;
 typedef std::shared_ptr<POCatalog> POCatalogPtr;
 
 
+/// Raw content of a PO file, kept for saving unchanged entries verbatim.
+struct POFileContent
+{
+    std::string data;
+    wxString charset;
+    wxTextFileType crlf;
+    int wrapping;
+};
+
+/** Location of an entry's text in the file it was loaded from (or last saved
+    to). As long as the entry isn't modified, this text can be written back
+    as-is instead of re-serializing the entry.
+ */
+struct POEntryRawText
+{
+    POEntryRawText() : offset(0), length(0), lines(0) {}
+
+    bool IsValid() const { return content != nullptr; }
+    void Invalidate() { content.reset(); }
+
+    std::shared_ptr<const POFileContent> content;
+    size_t offset, length;
+    size_t lines;
+};
+
+
 class POCatalogItem : public CatalogItem
 {
 public:
@@ -42,17 +75,43 @@ public:
 
     wxArrayString GetReferences() const override;
 
+    void AddMemoryUsage(CatalogMemoryUsage& usage) const override;
+
 protected:
-    const wxArrayString& GetRawReferences() const { return m_references; }
-    void SetRawReferences(const wxArrayString& ref) { m_references = ref; }
+    const wxArrayString& GetRawReferences() const { EnsureMetadataLoaded(); return m_references.get(); }
+    void SetRawReferences(const wxArrayString& ref) { m_references = ref; Touch(); }
+
+    const POEntryRawText& GetRawText() const { return m_rawText; }
+    void SetRawText(const POEntryRawText& raw) { m_rawText = raw; }
+
+    /// Merges metadata of another entry with the same msgid into this one,
+    /// the way msguniq does (used by POCatalog::FixDuplicateItems)
+    void MergeDuplicate(const POCatalogItem& dup);
 
-    void UpdateInternalRepresentation() override {}
+    /// Makes the item share its source texts and repetitive metadata with
+    /// other items (possibly of other catalogs) in @a pool
+    void InternStrings(StringPool& pool);
+
+    /// Decode references, extracted comments and old msgid from the raw
+    /// text only when needed; the raw text must be set and valid.
+    void DeferMetadata() { m_metadataDeferred.value = true; }
+    void LoadDeferredMetadata() const override;
+
+    // any change to the content makes the original text obsolete:
+    void UpdateInternalRepresentation() override
+    {
+        EnsureMetadataLoaded();  // still needs the raw text
+        m_rawText.Invalidate();
+    }
 
     friend class POLoadParser;
     friend class POCatalog;
+    friend class POCatalogCache;
+    friend class MOCatalog;
 
 protected:
-    wxArrayString m_references;
+    Interned<wxArrayString> m_references;
+    POEntryRawText m_rawText;
 };
 
 
@@ -67,10 +126,10 @@ class POCatalogDeletedData
 public:
     /// Ctor.
     POCatalogDeletedData()
-            : m_lineNum(0) {}
+            : m_lineNum(0), m_deferred(false) {}
     POCatalogDeletedData(const wxArrayString& deletedLines)
             : m_deletedLines(deletedLines),
-              m_lineNum(0) {}
+              m_lineNum(0), m_deferred(false) {}
 
     POCatalogDeletedData(const POCatalogDeletedData& dt)
             : m_deletedLines(dt.m_deletedLines),
@@ -78,50 +137,60 @@ public:
               m_extractedComments(dt.m_extractedComments),
               m_flags(dt.m_flags),
               m_comment(dt.m_comment),
-              m_lineNum(dt.m_lineNum) {}
+              m_lineNum(dt.m_lineNum),
+              m_rawText(dt.m_rawText),
+              m_deferred(dt.m_deferred) {}
 
     /// Returns the deleted lines.
-    const wxArrayString& GetDeletedLines() const { return m_deletedLines; }
+    const wxArrayString& GetDeletedLines() const { EnsureLoaded(); return m_deletedLines; }
 
     /// Returns references (#:) lines for the entry
-    const wxArrayString& GetRawReferences() const { return m_references; }
+    const wxArrayString& GetRawReferences() const { EnsureLoaded(); return m_references; }
 
     /// Returns comment added by the translator to this entry
-    const wxString& GetComment() const { return m_comment; }
+    const wxString& GetComment() const { EnsureLoaded(); return m_comment; }
 
     /// Returns array of all auto comments.
-    const wxArrayString& GetExtractedComments() const { return m_extractedComments; }
+    const wxArrayString& GetExtractedComments() const { EnsureLoaded(); return m_extractedComments; }
 
     /// Convenience function: does this entry has a comment?
-    bool HasComment() const { return !m_comment.empty(); }
+    bool HasComment() const { EnsureLoaded(); return !m_comment.empty(); }
 
     /// Adds new reference to the entry (used by SourceDigger).
     void AddReference(const wxString& ref)
     {
+        EnsureLoaded();
         if (m_references.Index(ref) == wxNOT_FOUND)
+        {
             m_references.Add(ref);
+            m_rawText.Invalidate();
+        }
     }
 
     /// Sets the string.
     void SetDeletedLines(const wxArrayString& a)
     {
+        EnsureLoaded();
         m_deletedLines = a;
+        m_rawText.Invalidate();
     }
 
     /// Sets the comment.
     void SetComment(const wxString& c)
     {
+        EnsureLoaded();
         m_comment = c;
+        m_rawText.Invalidate();
     }
 
     /** Sets gettext flags directly in string format. It may be
         either empty string or "#, fuzzy", "#, c-format",
         "#, fuzzy, c-format" or others (not understood by Poedit).
      */
-    void SetFlags(const wxString& flags) {m_flags = flags;};
+    void SetFlags(const wxString& flags) { EnsureLoaded(); m_flags = flags; m_rawText.Invalidate(); }
 
     /// Gets gettext flags. \see SetFlags
-    wxString GetFlags() const {return m_flags;};
+    wxString GetFlags() const { EnsureLoaded(); return m_flags; }
 
     /// Sets the number of the line this entry occurs on.
     void SetLineNumber(int line) { m_lineNum = line; }
@@ -131,21 +200,65 @@ public:
     /// Adds new extracted comments (#. )
     void AddExtractedComments(const wxString& com)
     {
+        EnsureLoaded();
         m_extractedComments.Add(com);
+        m_rawText.Invalidate();
     }
 
+    /// Original text of the entry, see POEntryRawText
+    const POEntryRawText& GetRawText() const { return m_rawText; }
+    void SetRawText(const POEntryRawText& raw) { m_rawText = raw; }
+
+    /** Decode the entry's content from its raw text only when it's first
+        needed; the raw text must be set and valid. Obsolete entries are
+        rarely looked at, but there may be lots of them in old catalogs.
+
+        Unlike items' deferred metadata, this isn't thread-safe: deleted
+        items are only accessed by one thread at a time.
+     */
+    void DeferContent() { m_deferred = true; }
+    bool IsContentDeferred() const { return m_deferred; }
+
 private:
+    void EnsureLoaded() const
+    {
+        if (m_deferred)
+            LoadDeferredContent();
+    }
+    void LoadDeferredContent() const;
+
     wxArrayString m_deletedLines;
 
     wxArrayString m_references, m_extractedComments;
     wxString m_flags;
     wxString m_comment;
     int m_lineNum;
+    POEntryRawText m_rawText;
+    mutable bool m_deferred;
 };
 
 typedef std::vector<POCatalogDeletedData> POCatalogDeletedDataArray;
 
 
+/// Strings that updating a catalog from a POT adds or removes
+struct MergeSummary
+{
+    wxArrayString newStrings;
+    wxArrayString obsoleteStrings;
+};
+
+/** Called with the summary before the update is applied. Returning false
+    cancels the update and leaves the catalog unmodified.
+ */
+typedef std::function<bool(const MergeSummary&)> MergeConfirmation;
+
+/** Called on the merging thread with the number of processed and total
+    entries as merging progresses. Returning false cancels the update and
+    leaves the catalog unmodified.
+ */
+typedef std::function<bool(size_t done, size_t total)> MergeProgress;
+
+
 class POCatalog : public Catalog
 {
 public:
@@ -167,13 +280,57 @@ public:
     static bool CanLoadFile(const wxString& extension);
     wxString GetPreferredExtension() const override;
 
+    /// Basic statistics of a PO file, see ScanStatistics()
+    struct Statistics
+    {
+        int all = 0, fuzzy = 0, untranslated = 0;
+        /// Entries that are fuzzy or untranslated
+        int unfinished = 0;
+        /// Words in source texts of all and of unfinished entries, see CountText()
+        int words = 0, unfinishedWords = 0;
+        wxString revisionDate;
+    };
+
+    /**
+        Quickly computes statistics of @a po_file without loading it.
+
+        Only counts entries and looks at their translations and fuzzy flags,
+        no catalog items are created. Because the file isn't validated,
+        there's no count of entries with errors.
+
+        May be called from any thread. Returns false if the file couldn't
+        be read or parsed.
+     */
+    static bool ScanStatistics(const wxString& po_file, Statistics& stats);
+
+    /**
+        Loads only the header and the first @a maxItems entries of @a po_file,
+        without parsing the rest of it, e.g. for showing a quick preview of
+        a possibly huge file.
+
+        The result is for display only; it's not validated and can't be
+        saved. Errors aren't reported. Returns nullptr on failure.
+     */
+    static POCatalogPtr CreatePreview(const wxString& po_file, size_t maxItems);
+
+    /** Creates the catalog from @a data, the content of a PO file that is
+        already in memory, e.g. downloaded from the network, without reading
+        it from disk. @a po_file is used as the catalog's filename only and
+        doesn't have to exist.
+
+        Errors are reported as with a file; returns nullptr on failure.
+     */
+    static POCatalogPtr CreateFromBuffer(const wxString& po_file, const std::string& data, int flags = 0);
+
     bool Save(const wxString& po_file, bool save_mo,
               ValidationResults& validation_results,
               CompilationStatus& mo_compilation_status) override;
 
-    std::string SaveToBuffer() override;
+    bool WriteToBuffer(std::string& out) override;
 
     ValidationResults Validate(bool wasJustLoaded) override;
+    bool ValidateItem(const CatalogItemPtr& item) override;
+    ValidationResults ValidateItems(size_t begin, size_t end) override;
 
     /// Compiles the catalog into binary MO file.
     bool CompileToMO(const wxString& mo_file,
@@ -183,20 +340,62 @@ public:
     /// Detect a particular common breakage of catalogs.
     bool HasDuplicateItems() const;
 
-    /// Fixes a common invalid kind of entries, when msgids aren't unique.
+    /** Fixes a common invalid kind of entries, when msgids aren't unique.
+
+        Duplicates are merged into the first occurrence in-memory, keeping
+        all of their references and comments.
+     */
     bool FixDuplicateItems();
 
+    /** Moves all items of @a other to the end of this catalog. Used for
+        combining extracted POT files; call FixDuplicateItems() afterwards
+        to merge those with the same msgctxt and msgid the way msgcat does.
+     */
+    void AppendCatalog(POCatalog& other);
+
+    CatalogMemoryUsage GetMemoryUsage() const override;
+
     bool HasDeletedItems() const override
         { return !m_deletedItems.empty(); }
 
     void RemoveDeletedItems() override
         { m_deletedItems.clear(); }
 
-    /// Updates the catalog from POT file.
-    bool UpdateFromPOT(const wxString& pot_file, bool replace_header = false);
-    bool UpdateFromPOT(POCatalogPtr pot, bool replace_header = false);
+    /** Updates the catalog from POT file.
+
+        If @a confirm is set, it is called with the summary of changes,
+        which is computed as part of merging, before they are applied.
+        If @a progress is set, it is called as entries are merged.
+
+        If @a changedSources is set, it lists source files that changed
+        since they were last extracted (see Extractor::ExtractWithAll()).
+        Existing entries that don't reference any of them are kept as they
+        are if the POT's entry is the same, instead of being re-merged.
+     */
+    bool UpdateFromPOT(const wxString& pot_file, bool replace_header = false,
+                       const MergeConfirmation& confirm = MergeConfirmation(),
+                       const MergeProgress& progress = MergeProgress());
+    bool UpdateFromPOT(POCatalogPtr pot, bool replace_header = false,
+                       const MergeConfirmation& confirm = MergeConfirmation(),
+                       const MergeProgress& progress = MergeProgress(),
+                       const std::vector<wxString> *changedSources = nullptr);
     static POCatalogPtr CreateFromPOT(POCatalogPtr pot);
 
+    /** Creates an independent copy of the catalog that can be saved on
+        a background thread while this one continues to be edited.
+
+        Items are copied, but their (refcounted) texts are shared, so
+        this is considerably cheaper than saving. The returned catalog
+        is always a POCatalog.
+     */
+    CatalogPtr CreateSnapshot() const override;
+
+    /** Updates the catalog with the results of saving its @a saved snapshot:
+        file information, header fields updated when saving and validation
+        results of items that weren't added or removed in the meantime.
+     */
+    void AdoptSavedSnapshot(const POCatalog& saved);
+
 protected:
     /** Loads catalog from .po file.
         If file named po_file ".poedit" (e.g. "cs.po.poedit") exists,
@@ -209,12 +408,30 @@ protected:
      */
     bool Load(const wxString& po_file, int flags = 0);
 
+    /// Implements Load() for content already in memory
+    bool DoLoad(const wxString& po_file, const char *fileData, size_t fileSize, int flags, bool useCache);
+
+    /** Parses file's content into the catalog, reporting any errors.
+
+        @param fileIsValid Set to false if no entries were found in the file.
+        @param charsetOk   Set to false if some lines couldn't be decoded.
+        @return False if the file couldn't be parsed at all.
+     */
+    bool DoParse(const wxString& po_file, const char *fileData, size_t fileSize, int flags,
+                 bool& fileIsValid, bool& charsetOk);
+
+    /// Loads the beginning of the file, see CreatePreview()
+    bool LoadPreview(const wxString& po_file, size_t maxItems);
+
+    /// Keeps loaded file's data for saving unmodified entries and decoding deferred metadata
+    void KeepFileContent(const char *fileData, size_t fileSize);
+
     void Clear();
 
     /// Adds entry to the catalog (the catalog will take ownership of
     /// the object).
     void AddItem(const POCatalogItemPtr& data)
-        { m_items.push_back(data); }
+        { Catalog::AddItem(data); }
 
     /// Adds entry to the catalog (the catalog will take ownership of
     /// the object).
@@ -225,19 +442,47 @@ protected:
     /// Fix commonly encountered fixable problems with loaded files
     void FixupCommonIssues();
 
-    ValidationResults DoValidate(const wxString& po_file);
+    /// Validates the catalog as "msgfmt -c" would, see GettextValidator
+    ValidationResults DoValidate();
+
+    /** Compiles the catalog into MO file directly, without using msgfmt.
+        Returns CompilationStatus::NotDone if the catalog uses features
+        not supported by the native compiler, msgfmt must be used then.
+     */
+    CompilationStatus DoCompileMO(const wxString& mo_file);
     bool DoSaveOnly(const wxString& po_file, wxTextFileType crlf);
-    bool DoSaveOnly(wxTextBuffer& f, wxTextFileType crlf);
+    /// Serializes the catalog into @a out, in the header-specified charset
+    bool DoSaveOnly(std::string& out, wxTextFileType crlf);
+
+    /** Saves the file, writing unchanged entries as they were in the original
+        file and only re-serializing modified ones. Returns false if this
+        isn't possible (e.g. due to charset issues) and DoSaveOnly() must be
+        used instead.
+     */
+    bool DoSaveIncrementally(const wxString& po_file, wxTextFileType crlf);
+
+    // Serialization of individual parts of the file:
+    void SaveHeader(wxTextBuffer& f, int wrapping) const;
+    static void SaveItem(wxTextBuffer& f, const POCatalogItem& item, int wrapping, unsigned pluralsCount);
+    static void SaveDeletedItem(wxTextBuffer& f, const POCatalogDeletedData& item);
 
     /** Merges the catalog with reference catalog
         (in the sense of msgmerge -- this catalog is old one with
         translations, \a refcat is reference catalog created by Update().)
 
+        Done in-process: exact matches are looked up by msgctxt and msgid,
+        unmatched strings are fuzzy-matched in parallel unless disabled in
+        Config::MergeBehavior().
+
+        See UpdateFromPOT() for @a changedSources.
+
         \return true if the merge was successful, false otherwise.
                 Note that if it returns false, the catalog was
                 \em not modified!
      */
-    bool Merge(const POCatalogPtr& refcat);
+    bool Merge(const POCatalogPtr& refcat, const MergeConfirmation& confirm,
+               const MergeProgress& progress,
+               const std::vector<wxString> *changedSources = nullptr);
 
 protected:
     POCatalogDeletedDataArray m_deletedItems;
@@ -245,7 +490,71 @@ protected:
     wxTextFileType m_fileCRLF;
     int m_fileWrappingWidth;
 
+    // content of the file as last loaded or saved, entries' raw text points into it
+    std::shared_ptr<const POFileContent> m_fileContent;
+
+    // shared storage for items' source texts, flags, references and comments,
+    // normally StringPool::Shared(), so that catalogs of the same project share
+    // their source side
+    std::shared_ptr<StringPool> m_stringPool;
+
     friend class POLoadParser;
+    friend class POCatalogCache;
+};
+
+
+/** Internal class - provides lines of a PO file to the parser.
+
+    The file's raw content is split into lines lazily and the lines are
+    returned as UTF-8 views. For UTF-8 files, these point directly into the
+    file's data, which must therefore outlive any views obtained from the
+    reader. Lines in other charsets are converted to UTF-8 only when the
+    parser asks for them and are kept in the reader.
+ */
+class POFileReader
+{
+public:
+    /// Ctor. @a data must remain valid for the lifetime of the reader.
+    POFileReader(const char *data, size_t length, const wxString& charset);
+
+    /// Returns false if the charset isn't supported
+    bool IsOk() const { return m_isUTF8 || m_conv != nullptr; }
+
+    /// Is the file empty, i.e. without any lines?
+    bool IsEmpty() const { return m_begin == m_end; }
+
+    /// Returns true if the current line is the last one.
+    bool Eof() const { return m_next == m_end; }
+
+    /// Rewinds to the beginning of the file and returns the first line.
+    boost::string_view GetFirstLine();
+
+    /// Advances to the next line and returns it.
+    /// Corrupted lines are returned as empty.
+    boost::string_view GetNextLine();
+
+    /// Returns 0-based index of the current line.
+    size_t GetCurrentLine() const { return m_currentLine; }
+
+    /// Returns the raw (undecoded) data of the current line, without EOL.
+    const char *GetCurrentLineRawBegin() const { return m_lineBegin; }
+    const char *GetCurrentLineRawEnd() const { return m_lineEnd; }
+
+    /// Returns 0-based indexes of non-empty lines that couldn't be decoded
+    /// using the charset, i.e. that are corrupted.
+    const std::vector<size_t>& GetCorruptedLines() const { return m_corruptedLines; }
+
+private:
+    boost::string_view DecodeLine(const char *start, const char *end);
+
+    const char *m_begin, *m_end;
+    const char *m_next; // start of the line after the current one
+    const char *m_lineBegin, *m_lineEnd; // the current line
+    size_t m_currentLine;
+    bool m_isUTF8;
+    std::unique_ptr<wxMBConv> m_conv; // for non-UTF-8 input only
+    std::deque<std::string> m_convertedLines; // storage for converted lines
+    std::vector<size_t> m_corruptedLines;
 };
 
 
@@ -253,13 +562,17 @@ protected:
 class POCatalogParser
 {
 public:
-    POCatalogParser(wxTextFile *f)
-        : m_textFile(f),
+    POCatalogParser(POFileReader& reader)
+        : m_reader(reader),
+          m_entryRawBegin(nullptr), m_entryFirstLine(0),
+          m_lastLineRawEnd(nullptr), m_lastLineIndex(0),
           m_detectedLineWidth(0),
           m_detectedWrappedLines(false),
           m_lastLineHardWrapped(true), m_previousLineHardWrapped(true),
           m_ignoreHeader(false),
-          m_ignoreTranslations(false)
+          m_ignoreTranslations(false),
+          m_deferMetadata(false),
+          m_entryMetadataDeferred(false)
     {}
 
     virtual ~POCatalogParser() {}
@@ -280,8 +593,29 @@ public:
     int GetWrappingWidth() const;
 
 protected:
+    /// Combines wrapping detected in another part of the same file with ours
+    void MergeWrappingInfo(const POCatalogParser& other)
+    {
+        if (other.m_detectedLineWidth > m_detectedLineWidth)
+            m_detectedLineWidth = other.m_detectedLineWidth;
+        m_detectedWrappedLines = m_detectedWrappedLines || other.m_detectedWrappedLines;
+    }
+
     // Read one line from file, remove all \r and \n characters, ignore empty lines:
-    wxString ReadTextLine();
+    boost::string_view ReadTextLine();
+
+    // Read continuation lines of a string ("..."), appending unescaped content
+    // to str; returns the first line that isn't part of it.
+    boost::string_view ReadContinuationLines(std::string& str);
+
+    /// Returns the raw data and lines count of the entry being reported
+    /// to OnEntry() or OnDeletedEntry(); only valid in these callbacks.
+    void GetEntryRawText(const char *& begin, const char *& end, size_t& lines) const
+    {
+        begin = m_entryRawBegin;
+        end = m_lastLineRawEnd;
+        lines = m_lastLineIndex - m_entryFirstLine + 1;
+    }
 
     void PossibleWrappedLine()
     {
@@ -322,8 +656,15 @@ protected:
 
     virtual void OnIgnoredEntry() {}
 
-    /// Textfile being parsed.
-    wxTextFile *m_textFile;
+    /// File being parsed.
+    POFileReader& m_reader;
+
+    // the first line of the entry being parsed and the last line read
+    const char *m_entryRawBegin;
+    size_t m_entryFirstLine;
+    const char *m_lastLineRawEnd;
+    size_t m_lastLineIndex;
+
     int m_detectedLineWidth;
     bool m_detectedWrappedLines;
     bool m_lastLineHardWrapped, m_previousLineHardWrapped;
@@ -333,6 +674,15 @@ protected:
 
     /// Whether the translations should be ignored (as if it was a POT)
     bool m_ignoreTranslations;
+
+    /// Whether the subclass can decode entries' references, extracted comments
+    /// and old msgids from their raw text later, see OnEntry
+    bool m_deferMetadata;
+
+    /// For the entry being passed to OnEntry: are its metadata deferred, i.e.
+    /// passed as empty arrays? Only if m_deferMetadata and raw text is usable.
+    /// For OnDeletedEntry, all of the entry's content is passed empty then.
+    bool m_entryMetadataDeferred;
 };
 
 #endif // Poedit_catalog_po_h
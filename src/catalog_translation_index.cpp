@@ -0,0 +1,138 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "catalog_translation_index.h"
+
+#include <algorithm>
+
+
+CatalogTranslationIndex::CatalogTranslationIndex(const Catalog& catalog)
+{
+    for (auto& item: catalog.items())
+        Add(*item);
+}
+
+
+void CatalogTranslationIndex::ItemChanged(const CatalogItem& item)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    Remove(item.GetId());
+    Add(item);
+}
+
+
+void CatalogTranslationIndex::Add(const CatalogItem& item)
+{
+    if (!item.IsTranslated() || item.IsFuzzy())
+        return;
+
+    auto source = item.GetString().ToStdWstring();
+    if (source.empty())
+        return;
+
+    m_bySource[source].push_back({item.GetId(), item.GetContext(), item.GetPluralString(), item.HasPlural(), item.GetTranslations()});
+    m_sources[item.GetId()] = std::move(source);
+}
+
+
+void CatalogTranslationIndex::Remove(int id)
+{
+    auto s = m_sources.find(id);
+    if (s == m_sources.end())
+        return;
+
+    auto bucket = m_bySource.find(s->second);
+    if (bucket != m_bySource.end())
+    {
+        auto& matches = bucket->second;
+        matches.erase(std::remove_if(matches.begin(), matches.end(), [id](const Match& m){ return m.id == id; }),
+                      matches.end());
+        if (matches.empty())
+            m_bySource.erase(bucket);
+    }
+    m_sources.erase(s);
+}
+
+
+std::vector<CatalogTranslationIndex::Match> CatalogTranslationIndex::FindOthers(const CatalogItem& item) const
+{
+    std::vector<Match> results;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto bucket = m_bySource.find(item.GetString().ToStdWstring());
+    if (bucket == m_bySource.end())
+        return results;
+
+    const int id = item.GetId();
+    const wxString context = item.GetContext();
+    for (auto& m: bucket->second)
+    {
+        if (m.id != id)
+            results.push_back(m);
+    }
+    std::stable_partition(results.begin(), results.end(), [&context](const Match& m){ return m.context == context; });
+
+    return results;
+}
+
+
+SuggestionsList CatalogTranslationIndex::SuggestionsFor(const CatalogItem& item) const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return MakeSuggestions(item.GetString().ToStdWstring(), item.GetId());
+}
+
+
+dispatch::future<SuggestionsList> CatalogTranslationIndex::SuggestTranslation(const SuggestionQuery&& q,
+                                                                              const dispatch::cancellation_token&)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return dispatch::make_ready_future(MakeSuggestions(q.source, -1));
+}
+
+
+SuggestionsList CatalogTranslationIndex::MakeSuggestions(const std::wstring& source, int excludedId) const
+{
+    SuggestionsList results;
+
+    auto bucket = m_bySource.find(source);
+    if (bucket == m_bySource.end())
+        return results;
+
+    for (auto& m: bucket->second)
+    {
+        if (m.id == excludedId || m.translations.empty())
+            continue;
+        auto text = m.translations[0].ToStdWstring();
+        if (text.empty())
+            continue;
+        auto found = std::find_if(results.begin(), results.end(), [&text](const Suggestion& s){ return s.text == text; });
+        if (found != results.end())
+            continue;
+        results.emplace_back(text, 1.0, 0, Suggestion::Source::CurrentFile);
+    }
+
+    return results;
+}
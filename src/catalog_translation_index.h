@@ -0,0 +1,100 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_catalog_translation_index_h
+#define Poedit_catalog_translation_index_h
+
+#include "catalog.h"
+#include "tm/suggestions.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+    Finished (translated and not fuzzy) translations of a catalog's items,
+    indexed by their source text.
+
+    It makes translations of strings that occur more than once in the same
+    file (in different contexts, or as duplicates after a merge) available
+    to the other occurrences right away, without waiting for them to be
+    added to the TM when the file is saved.
+
+    Use Catalog::GetTranslationIndex() to get the index of a catalog; it is
+    kept up to date by Catalog::ItemTranslationChanged().
+
+    As a SuggestionsBackend, it only ever contains translations for the
+    catalog's languages and doesn't check languages of queries. Queries are
+    answered immediately.
+ */
+class CatalogTranslationIndex : public SuggestionsBackend
+{
+public:
+    /// Finished translation of another item with the same source text
+    struct Match
+    {
+        int id;
+        wxString context;
+        wxString plural;
+        bool hasPlural;
+        SmallStringArray translations;
+    };
+
+    /// Creates index of @a catalog's current translations
+    explicit CatalogTranslationIndex(const Catalog& catalog);
+
+    /// Must be called after @a item's translation or flags changed
+    void ItemChanged(const CatalogItem& item);
+
+    /** Returns translations of items with the same source text as @a item,
+        except for @a item itself.
+
+        Matches with the same context come first.
+     */
+    std::vector<Match> FindOthers(const CatalogItem& item) const;
+
+    /// Like SuggestTranslation(), but without @a item's own translation
+    SuggestionsList SuggestionsFor(const CatalogItem& item) const;
+
+    // SuggestionsBackend API:
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token) override;
+    void Delete(const std::string&) override {}
+
+private:
+    void Add(const CatalogItem& item);
+    void Remove(int id);
+    SuggestionsList MakeSuggestions(const std::wstring& source, int excludedId) const;
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, std::vector<Match>> m_bySource;
+    // source text each indexed item is stored under:
+    std::unordered_map<int, std::wstring> m_sources;
+};
+
+#endif // Poedit_catalog_translation_index_h
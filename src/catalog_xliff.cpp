@@ -26,17 +26,25 @@
 #include "catalog_xliff.h"
 
 #include "qa_checks.h"
+#include "concurrency.h"
 #include "configuration.h"
 #include "str_helpers.h"
 #include "utility.h"
+#include "xml_stream.h"
 
+#include <wx/ffile.h>
+#include <wx/filename.h>
 #include <wx/intl.h>
 #include <wx/log.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/stream.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <memory>
-#include <mutex>
 #include <set>
 #include <sstream>
 
@@ -46,9 +54,92 @@ using namespace pugi;
 namespace
 {
 
-// FIXME: This should be per-document mutex in XLIFFCatalog, but that is
-//        currently not accessible from XLIFFCatalogItem, hence a global.
-std::mutex gs_documentMutex;
+constexpr auto XLIFF_PARSE_FLAGS = parse_full | parse_ws_pcdata | parse_fragment;
+
+// Files larger than this are loaded with XLIFF1StreamedCatalog:
+const uint64_t STREAMING_THRESHOLD = 64 * 1024 * 1024;
+
+// Number of trans-units parsed together when streaming:
+const size_t STREAMING_BATCH_SIZE = 1024;
+
+/// pugi::xml_writer appending to a string, which the caller then owns
+class string_xml_writer : public xml_writer
+{
+public:
+    explicit string_xml_writer(std::string& out) : m_out(out) {}
+
+    void write(const void *data, size_t size) override
+    {
+        m_out.append(static_cast<const char*>(data), size);
+    }
+
+private:
+    std::string& m_out;
+};
+
+
+/// pugi::xml_writer writing to a file in large blocks
+class file_xml_writer : public xml_writer
+{
+public:
+    explicit file_xml_writer(wxFFile& file) : m_file(file), m_ok(true)
+    {
+        m_buffer.reserve(BUFFER_SIZE);
+    }
+
+    void write(const void *data, size_t size) override
+    {
+        if (m_buffer.size() + size > BUFFER_SIZE)
+            Flush();
+        if (size >= BUFFER_SIZE)
+            DoWrite(data, size);
+        else
+            m_buffer.append(static_cast<const char*>(data), size);
+    }
+
+    /// Writes out buffered data, returns false if any writing failed
+    bool Flush()
+    {
+        if (!m_buffer.empty())
+        {
+            DoWrite(m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+        }
+        return m_ok;
+    }
+
+private:
+    static const size_t BUFFER_SIZE = 1024 * 1024;
+
+    void DoWrite(const void *data, size_t size)
+    {
+        if (m_ok && m_file.Write(data, size) != size)
+            m_ok = false;
+    }
+
+    wxFFile& m_file;
+    std::string m_buffer;
+    bool m_ok;
+};
+
+
+/**
+    Creates items for all @a nodes, in order, with IDs starting at 1.
+
+    Extracting text and metadata from inline markup is the bulk of
+    loading XLIFF files, so the items are created in parallel. This is
+    safe, because the items only read the tree.
+ */
+template<typename F>
+std::vector<CatalogItemPtr> create_items_in_parallel(const std::vector<xml_node>& nodes, F&& create)
+{
+    dispatch::parallel_options options;
+    options.min_chunk_size = 64;
+    return dispatch::parallel_transform(0, nodes.size(), [&](size_t i) -> CatalogItemPtr
+    {
+        return create(int(i + 1), nodes[i]);
+    }, options);
+}
 
 
 inline bool has_child_elements(xml_node node)
@@ -381,10 +472,15 @@ bool XLIFFCatalog::CanLoadFile(const wxString& extension)
 
 std::shared_ptr<XLIFFCatalog> XLIFFCatalog::Open(const wxString& filename)
 {
-    constexpr auto parse_flags = parse_full | parse_ws_pcdata | parse_fragment;
+    if (wxFileName::GetSize(filename).GetValue() >= STREAMING_THRESHOLD)
+    {
+        auto streamed = OpenStreamed(filename);
+        if (streamed)
+            return streamed;
+    }
 
     xml_document doc;
-    auto result = doc.load_file(filename.fn_str(), parse_flags);
+    auto result = doc.load_file(filename.fn_str(), XLIFF_PARSE_FLAGS);
     if (!result)
         throw XLIFFReadException(filename, result.description());
 
@@ -422,9 +518,21 @@ bool XLIFFCatalog::Save(const wxString& filename, bool /*save_mo*/,
 
     TempOutputFileFor tempfile(filename);
 
-    m_doc.save_file(tempfile.FileName().fn_str(), "\t", format_raw);
+    bool written = false;
+    {
+        wxFFile file;
+        if (file.Open(tempfile.FileName(), "wb"))
+        {
+            file_xml_writer writer(file);
+            {
+                boost::shared_lock<boost::shared_mutex> lock(*m_documentLock);
+                m_doc.save(writer, "\t", format_raw);
+            }
+            written = writer.Flush() && file.Close();
+        }
+    }
 
-    if ( !tempfile.Commit() )
+    if ( !written || !tempfile.Commit() )
     {
         wxLogError(_(L"Couldn’t save file %s."), filename.c_str());
         return false;
@@ -435,11 +543,16 @@ bool XLIFFCatalog::Save(const wxString& filename, bool /*save_mo*/,
 }
 
 
-std::string XLIFFCatalog::SaveToBuffer()
+bool XLIFFCatalog::WriteToBuffer(std::string& out)
 {
-    std::ostringstream s;
-    m_doc.save(s, "\t", format_raw);
-    return s.str();
+    // the original file's size is a good guess of the output's size:
+    if (!m_fileName.empty() && wxFileExists(m_fileName))
+        out.reserve(out.size() + size_t(wxFileName::GetSize(m_fileName).GetValue()));
+
+    string_xml_writer writer(out);
+    boost::shared_lock<boost::shared_mutex> lock(*m_documentLock);
+    m_doc.save(writer, "\t", format_raw);
+    return true;
 }
 
 
@@ -461,14 +574,147 @@ Catalog::ValidationResults XLIFFCatalog::Validate(bool)
 }
 
 
+Catalog::ValidationResults XLIFFCatalog::ValidateItems(size_t begin, size_t end)
+{
+    ValidationResults res;
+
+    end = std::min(end, m_items.size());
+    for (size_t i = begin; i < end; i++)
+        m_items[i]->ClearIssue();
+
+    if (Config::ShowWarnings())
+        res.warnings = QAChecker::GetFor(*this)->Check(*this, begin, end);
+
+    return res;
+}
+
+
+bool XLIFFCatalog::ValidateItem(const CatalogItemPtr& item)
+{
+    item->ClearIssue();
+
+    if (Config::ShowWarnings())
+        QAChecker::GetFor(*this)->Check(item);
+
+    return item->HasIssue();
+}
+
+
+
+
+
+
+namespace
+{
+
+std::unique_ptr<xml_document> load_streamed_unit(const XLIFFStreamedFile& file, uint64_t offset, uint64_t length)
+{
+    // offsets are meaningless if somebody else changed the file:
+    if (wxFileName::GetSize(file.filename).GetValue() != file.size)
+        throw XLIFFReadException(file.filename, _("the file was modified by another program"));
+
+    std::string markup;
+    try
+    {
+        markup = XMLStreamReadRange(file.filename, offset, size_t(length));
+    }
+    catch (const Exception& e)
+    {
+        throw XLIFFReadException(file.filename, e.What());
+    }
+
+    std::unique_ptr<xml_document> doc(new xml_document);
+    auto result = doc->load_buffer(markup.data(), markup.size(), XLIFF_PARSE_FLAGS, encoding_utf8);
+    if (!result)
+        throw XLIFFReadException(file.filename, result.description());
+    return doc;
+}
+
+inline xml_node first_element(const xml_document& doc)
+{
+    return doc.find_child([](xml_node n){ return n.type() == node_element; });
+}
+
+/// Estimates memory used by pugixml's representation of the tree
+class DOMMemoryEstimator : public xml_tree_walker
+{
+public:
+    // sizes of pugixml's internal node and attribute structures:
+    static const size_t NODE_SIZE = 8 * sizeof(void*);
+    static const size_t ATTRIBUTE_SIZE = 5 * sizeof(void*);
+
+    DOMMemoryEstimator() : size(NODE_SIZE) {}
+
+    bool for_each(xml_node& node) override
+    {
+        size += NODE_SIZE + strlen(node.name()) + strlen(node.value()) + 2;
+        for (auto a: node.attributes())
+            size += ATTRIBUTE_SIZE + strlen(a.name()) + strlen(a.value()) + 2;
+        return true;
+    }
+
+    size_t size;
+};
+
+size_t EstimateDOMMemory(const xml_document& doc)
+{
+    DOMMemoryEstimator estimator;
+    const_cast<xml_document&>(doc).traverse(estimator);
+    return estimator.size;
+}
+
+} // anonymous namespace
+
+
+CatalogMemoryUsage XLIFFCatalog::GetMemoryUsage() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(*m_documentLock);
+    auto usage = Catalog::GetMemoryUsage();
+    if (m_doc.first_child())
+        usage.document += EstimateDOMMemory(m_doc);
+    return usage;
+}
+
+
+void XLIFFCatalogItem::AddMemoryUsage(CatalogMemoryUsage& usage) const
+{
+    CatalogItem::AddMemoryUsage(usage);
+    usage.items += sizeof(XLIFFCatalogItem) - sizeof(CatalogItem);
+
+    for (auto& s: m_metadata.substitutions)
+        usage.document += sizeof(s) + s.placeholder.capacity() + s.markup.capacity();
+    if (m_streamedDoc)
+        usage.document += EstimateDOMMemory(*m_streamedDoc);
+}
+
+
+xml_node XLIFFCatalogItem::GetNodeForReading(std::unique_ptr<pugi::xml_document>& tmp) const
+{
+    if (m_node || !m_streamedFile)
+        return m_node;
+
+    tmp = load_streamed_unit(*m_streamedFile, m_streamedOffset, m_streamedLength);
+    return first_element(*tmp);
+}
+
 
+xml_node XLIFFCatalogItem::GetNodeForWriting()
+{
+    if (!m_node && m_streamedFile)
+    {
+        m_streamedDoc = load_streamed_unit(*m_streamedFile, m_streamedOffset, m_streamedLength);
+        m_node = first_element(*m_streamedDoc);
+    }
+    return m_node;
+}
 
 
 
 class XLIFF12CatalogItem : public XLIFFCatalogItem
 {
 public:
-    XLIFF12CatalogItem(int itemId, xml_node node) : XLIFFCatalogItem(itemId, node)
+    XLIFF12CatalogItem(int itemId, xml_node node, XLIFFDocumentLock lock)
+        : XLIFFCatalogItem(itemId, node, lock)
     {
         auto source = node.child("source");
 
@@ -476,13 +722,13 @@ public:
         source.traverse(extractor);
         m_metadata = std::move(extractor.metadata);
 
-        m_string = str::to_wx(extractor.extractedText);
+        m_string = CompactString::FromUTF8(extractor.extractedText);
 
         // TODO: switch to textual IDs in CatalogItem
         std::string id = node.attribute("id").value();
         // some tools (e.g. Xcode, tool-id="com.apple.dt.xcode") use ID same as text
-        if (!id.empty() && id != m_string)
-            m_extractedComments.push_back("ID: " + str::to_wx(id));
+        if (!id.empty() && id != m_string.utf8())
+            m_extractedComments.modify().push_back("ID: " + str::to_wx(id));
 
         auto target = node.child("target");
         if (target)
@@ -508,8 +754,8 @@ public:
                 continue;
 
             if (!m_extractedComments.empty())
-                m_extractedComments.push_back("");
-            m_extractedComments.push_back(str::to_wx(noteText));
+                m_extractedComments.modify().push_back("");
+            m_extractedComments.modify().push_back(str::to_wx(noteText));
         }
     }
 
@@ -518,17 +764,18 @@ public:
         wxASSERT( m_translations.size() == 1 ); // no plurals
 
         // modifications in the pugixml tree can affect other nodes, we must lock the entire document
-        std::lock_guard<std::mutex> lock(gs_documentMutex);
+        boost::unique_lock<boost::shared_mutex> lock(*m_documentLock);
 
-        auto target = m_node.child("target");
+        auto node = GetNodeForWriting();
+        auto target = node.child("target");
         if (!target)
         {
-            auto ws_after = m_node.first_child();
-            auto source = m_node.child("source");
-            target = m_node.insert_child_after("target", source);
+            auto ws_after = node.first_child();
+            auto source = node.child("source");
+            target = node.insert_child_after("target", source);
             // add appropriate padding:
             if (ws_after.type() == node_pcdata)
-                m_node.insert_child_after(node_pcdata, source).text() = ws_after.text().get();
+                node.insert_child_after(node_pcdata, source).text() = ws_after.text().get();
         }
 
         auto trans = GetTranslation();
@@ -537,7 +784,7 @@ public:
             if (!set_node_text_with_metadata(target, str::to_utf8(trans), m_metadata))
             {
                 // TRANSLATORS: Shown as error if a translation of XLIFF markup is not valid XML
-                SetIssue(Issue::Error, _("Broken markup in translation string."));
+                SetIssue(Issue::Shared(Issue::Error, wxTRANSLATE(L"Broken markup in translation string.")));
             }
         }
         else // no translation
@@ -562,7 +809,9 @@ public:
     wxArrayString GetReferences() const override
     {
         wxArrayString refs;
-        for (auto loc: m_node.select_nodes(".//context-group[@purpose='location']"))
+        std::unique_ptr<xml_document> tmp;
+        auto node = GetNodeForReading(tmp);
+        for (auto loc: node.select_nodes(".//context-group[@purpose='location']"))
         {
             wxString file, line;
             for (auto ctxt: loc.node().children("context"))
@@ -598,7 +847,7 @@ public:
 
 void XLIFF1Catalog::Parse(pugi::xml_node root)
 {
-    int id = 0;
+    std::vector<xml_node> nodes;
     for (auto file: root.children("file"))
     {
         m_sourceLanguage = Language::TryParse(file.attribute("source-language").value());
@@ -608,13 +857,19 @@ void XLIFF1Catalog::Parse(pugi::xml_node root)
             auto node = unit.node();
             if (strcmp(node.attribute("translate").value(), "no") == 0)
                 continue;
-
-            if (m_subversion == 0)
-                m_items.push_back(std::make_shared<XLIFF10CatalogItem>(++id, node));
-            else
-                m_items.push_back(std::make_shared<XLIFF12CatalogItem>(++id, node));
+            nodes.push_back(node);
         }
     }
+
+    auto items = create_items_in_parallel(nodes, [=](int id, xml_node node) -> CatalogItemPtr
+    {
+        if (m_subversion == 0)
+            return CreateItem<XLIFF10CatalogItem>(id, node, m_documentLock);
+        else
+            return CreateItem<XLIFF12CatalogItem>(id, node, m_documentLock);
+    });
+    for (auto& i: items)
+        AddItem(i);
 }
 
 
@@ -622,6 +877,7 @@ void XLIFF1Catalog::SetLanguage(Language lang)
 {
     XLIFFCatalog::SetLanguage(lang);
 
+    boost::unique_lock<boost::shared_mutex> lock(*m_documentLock);
     for (auto file: GetXMLRoot().children("file"))
     {
         attribute(file, "target-language") = lang.LanguageTag().c_str();
@@ -630,12 +886,325 @@ void XLIFF1Catalog::SetLanguage(Language lang)
 
 
 
+struct XLIFF1StreamedCatalog::Splice : public XMLStreamSplice
+{
+    // what is replaced, either an item or index into m_fileTags:
+    XLIFFCatalogItem *item;
+    size_t fileTag;
+};
+
+
+XLIFF1StreamedCatalog::XLIFF1StreamedCatalog(const wxString& filename, int subversion)
+    : XLIFF1Catalog(filename, xml_document(), subversion),
+      m_languageChanged(false)
+{
+    m_file = std::make_shared<XLIFFStreamedFile>();
+    m_file->filename = filename;
+    m_file->size = wxFileName::GetSize(filename).GetValue();
+}
+
+
+void XLIFF1StreamedCatalog::Load()
+{
+    XMLStreamScanner scanner(m_fileName);
+
+    struct Unit
+    {
+        uint64_t offset;
+        std::string markup;
+    };
+    std::vector<Unit> batch;
+    int lastId = 0;
+
+    auto flush = [&]
+    {
+        dispatch::parallel_options options;
+        options.min_chunk_size = 64;
+        auto items = dispatch::parallel_transform(0, batch.size(), [&](size_t i) -> std::shared_ptr<XLIFF12CatalogItem>
+        {
+            xml_document doc;
+            auto& unit = batch[i];
+            auto result = doc.load_buffer(unit.markup.data(), unit.markup.size(), XLIFF_PARSE_FLAGS, encoding_utf8);
+            if (!result)
+                throw XLIFFReadException(m_fileName, result.description());
+
+            const int id = lastId + int(i) + 1;
+            std::shared_ptr<XLIFF12CatalogItem> item;
+            if (m_subversion == 0)
+                item = CreateItem<XLIFF10CatalogItem>(id, first_element(doc), m_documentLock);
+            else
+                item = CreateItem<XLIFF12CatalogItem>(id, first_element(doc), m_documentLock);
+
+            // the node will be gone with the document, refer to the file instead:
+            XLIFFCatalogItem& base = *item;
+            base.m_node = xml_node();
+            base.m_streamedFile = m_file;
+            base.m_streamedOffset = unit.offset;
+            base.m_streamedLength = unit.markup.size();
+            return item;
+        }, options);
+
+        for (auto& i: items)
+            AddItem(i);
+        lastId += int(batch.size());
+        batch.clear();
+    };
+
+    try
+    {
+        XMLStreamScanner::Tag tag;
+        std::vector<std::pair<std::string, std::string>> attrs;
+        while (scanner.Next(tag))
+        {
+            if (tag.kind == XMLStreamScanner::Tag::End)
+                continue;
+
+            if (tag.name == "file")
+            {
+                attrs.clear();
+                XMLStreamScanner::ParseAttributes(tag.markup, attrs);
+                for (auto& a: attrs)
+                {
+                    if (a.first == "source-language")
+                        m_sourceLanguage = Language::TryParse(a.second);
+                    else if (a.first == "target-language")
+                        m_language = Language::TryParse(a.second);
+                }
+                m_fileTags.push_back({tag.offset, tag.markup});
+            }
+            else if (tag.name == "trans-unit")
+            {
+                auto markup = scanner.ReadElement(tag);
+
+                attrs.clear();
+                XMLStreamScanner::ParseAttributes(tag.markup, attrs);
+                auto translate = std::find_if(attrs.begin(), attrs.end(), [](const std::pair<std::string, std::string>& a){ return a.first == "translate"; });
+                if (translate != attrs.end() && translate->second == "no")
+                    continue;
+
+                batch.push_back({tag.offset, std::move(markup)});
+                if (batch.size() == STREAMING_BATCH_SIZE)
+                    flush();
+            }
+        }
+    }
+    catch (const XLIFFReadException&)
+    {
+        throw;
+    }
+    catch (const Exception& e)
+    {
+        throw XLIFFReadException(m_fileName, e.What());
+    }
+
+    flush();
+}
+
+
+std::vector<XLIFF1StreamedCatalog::Splice> XLIFF1StreamedCatalog::GetSplices() const
+{
+    std::vector<Splice> splices;
+
+    if (m_languageChanged)
+    {
+        for (size_t t = 0; t < m_fileTags.size(); t++)
+        {
+            auto& tag = m_fileTags[t];
+            xml_document doc;
+            std::string markup(tag.markup);
+            markup.insert(markup.size() - 1, "/");
+            if (!doc.load_buffer(markup.data(), markup.size(), parse_default | parse_fragment, encoding_utf8))
+                continue;
+            auto file = doc.first_child();
+            attribute(file, "target-language") = m_language.LanguageTag().c_str();
+
+            Splice s;
+            s.offset = tag.offset;
+            s.length = tag.markup.size();
+            s.replacement = get_node_markup(file);
+            // it's a start tag, not an empty element:
+            if (s.replacement.size() >= 2 && s.replacement[s.replacement.size() - 2] == '/')
+                s.replacement.erase(s.replacement.size() - 2, 1);
+            s.item = nullptr;
+            s.fileTag = t;
+            splices.push_back(std::move(s));
+        }
+    }
+
+    for (auto& i: m_items)
+    {
+        auto item = static_cast<XLIFFCatalogItem*>(i.get());
+        if (!item->m_streamedDoc)
+            continue;
+        Splice s;
+        s.offset = item->m_streamedOffset;
+        s.length = item->m_streamedLength;
+        s.replacement = get_node_markup(item->m_node);
+        s.item = item;
+        s.fileTag = 0;
+        splices.push_back(std::move(s));
+    }
+
+    std::sort(splices.begin(), splices.end(), [](const Splice& a, const Splice& b){ return a.offset < b.offset; });
+    return splices;
+}
+
+
+bool XLIFF1StreamedCatalog::Save(const wxString& filename, bool /*save_mo*/,
+                                 ValidationResults& /*validation_results*/,
+                                 CompilationStatus& /*mo_compilation_status*/)
+{
+    if ( wxFileExists(filename) && !wxFile::Access(filename, wxFile::write) )
+    {
+        wxLogError(_(L"File “%s” is read-only and cannot be saved.\nPlease save it under different name."),
+                   filename.c_str());
+        return false;
+    }
+
+    // modified items' nodes are released below, nothing may touch them meanwhile:
+    boost::unique_lock<boost::shared_mutex> lock(*m_documentLock);
+
+    TempOutputFileFor tempfile(filename);
+    auto splices = GetSplices();
+
+    try
+    {
+        std::ofstream out(tempfile.FileName().fn_str(), std::ios::binary);
+        XMLStreamCopyWithSplices(m_file->filename, splices, out);
+        out.close();
+        if (!out)
+            throw Exception(_("error writing the file"));
+    }
+    catch (const Exception& e)
+    {
+        wxLogError("%s", e.What());
+        wxLogError(_(L"Couldn’t save file %s."), filename.c_str());
+        return false;
+    }
+
+    if ( !tempfile.Commit() )
+    {
+        wxLogError(_(L"Couldn’t save file %s."), filename.c_str());
+        return false;
+    }
+
+    // The saved file is the one to read from now on, so update offsets of
+    // everything that follows any of the splices. Modified items' markup
+    // is in the file now and doesn't need to be kept in memory anymore.
+    std::vector<int64_t> shift(1, 0);
+    for (auto& sp: splices)
+        shift.push_back(shift.back() + int64_t(sp.replacement.size()) - int64_t(sp.length));
+
+    auto newOffset = [&splices, &shift](uint64_t offset)
+    {
+        auto k = std::lower_bound(splices.begin(), splices.end(), offset,
+                                  [](const Splice& sp, uint64_t o){ return sp.offset < o; }) - splices.begin();
+        return uint64_t(int64_t(offset) + shift[k]);
+    };
+
+    for (auto& i: m_items)
+    {
+        auto item = static_cast<XLIFFCatalogItem*>(i.get());
+        item->m_streamedOffset = newOffset(item->m_streamedOffset);
+    }
+    for (auto& tag: m_fileTags)
+        tag.offset = newOffset(tag.offset);
+
+    for (auto& sp: splices)
+    {
+        if (sp.item)
+        {
+            sp.item->m_streamedLength = sp.replacement.size();
+            sp.item->m_node = xml_node();
+            sp.item->m_streamedDoc.reset();
+        }
+        else
+        {
+            m_fileTags[sp.fileTag].markup = sp.replacement;
+        }
+    }
+
+    m_file->filename = filename;
+    m_file->size = wxFileName::GetSize(filename).GetValue();
+    m_languageChanged = false;
+
+    m_fileName = filename;
+    return true;
+}
+
+
+bool XLIFF1StreamedCatalog::WriteToBuffer(std::string& out)
+{
+    out.reserve(out.size() + size_t(m_file->size));
+
+    namespace io = boost::iostreams;
+    io::stream<io::back_insert_device<std::string>> s(out);
+    boost::shared_lock<boost::shared_mutex> lock(*m_documentLock);
+    XMLStreamCopyWithSplices(m_file->filename, GetSplices(), s);
+    s.flush();
+    return true;
+}
+
+
+void XLIFF1StreamedCatalog::SetLanguage(Language lang)
+{
+    XLIFFCatalog::SetLanguage(lang);
+    m_languageChanged = true;
+}
+
+
+std::shared_ptr<XLIFFCatalog> XLIFFCatalog::OpenStreamed(const wxString& filename)
+{
+    // Find the root element first to see if the file can be streamed; this
+    // won't work for non-UTF-8 files, which are loaded into the DOM instead:
+    int subversion = -1;
+    try
+    {
+        XMLStreamScanner scanner(filename);
+        XMLStreamScanner::Tag tag;
+        while (scanner.Next(tag))
+        {
+            if (tag.kind == XMLStreamScanner::Tag::End || tag.name != "xliff")
+                continue;
+
+            std::vector<std::pair<std::string, std::string>> attrs;
+            XMLStreamScanner::ParseAttributes(tag.markup, attrs);
+            for (auto& a: attrs)
+            {
+                if (a.first != "version")
+                    continue;
+                if (a.second == "1.0")
+                    subversion = 0;
+                else if (a.second == "1.1")
+                    subversion = 1;
+                else if (a.second == "1.2")
+                    subversion = 2;
+            }
+            break;
+        }
+    }
+    catch (const Exception&)
+    {
+        return nullptr; // let the DOM loader report errors
+    }
+
+    if (subversion == -1)
+        return nullptr;
+
+    auto cat = std::make_shared<XLIFF1StreamedCatalog>(filename, subversion);
+    cat->Load();
+    return cat;
+}
+
+
+
 
 
 class XLIFF2CatalogItem : public XLIFFCatalogItem
 {
 public:
-    XLIFF2CatalogItem(int itemId, xml_node node) : XLIFFCatalogItem(itemId, node)
+    XLIFF2CatalogItem(int itemId, xml_node node, XLIFFDocumentLock lock)
+        : XLIFFCatalogItem(itemId, node, lock)
     {
         auto source = node.child("source");
 
@@ -643,13 +1212,13 @@ public:
         source.traverse(extractor);
         m_metadata = std::move(extractor.metadata);
 
-        m_string = str::to_wx(extractor.extractedText);
+        m_string = CompactString::FromUTF8(extractor.extractedText);
 
         // TODO: switch to textual IDs in CatalogItem
         std::string id = unit().attribute("id").value();
         // some tools (e.g. Xcode, tool-id="com.apple.dt.xcode") use ID same as text
-        if (!id.empty() && id != m_string)
-            m_extractedComments.push_back("ID: " + str::to_wx(id));
+        if (!id.empty() && id != m_string.utf8())
+            m_extractedComments.modify().push_back("ID: " + str::to_wx(id));
 
         auto target = node.child("target");
         if (target)
@@ -672,8 +1241,8 @@ public:
             std::string noteText = note.node().text().get();
 
             if (!m_extractedComments.empty())
-                m_extractedComments.push_back("");
-            m_extractedComments.push_back(str::to_wx(noteText));
+                m_extractedComments.modify().push_back("");
+            m_extractedComments.modify().push_back(str::to_wx(noteText));
         }
     }
 
@@ -682,7 +1251,7 @@ public:
         wxASSERT( m_translations.size() == 1 ); // no plurals
 
         // modifications in the pugixml tree can affect other nodes, we must lock the entire document
-        std::lock_guard<std::mutex> lock(gs_documentMutex);
+        boost::unique_lock<boost::shared_mutex> lock(*m_documentLock);
 
         auto target = m_node.child("target");
         if (!target)
@@ -707,7 +1276,7 @@ public:
             if (!set_node_text_with_metadata(target, str::to_utf8(trans), m_metadata))
             {
                 // TRANSLATORS: Shown as error if a translation of XLIFF markup is not valid XML
-                SetIssue(Issue::Error, _("Broken markup in translation string."));
+                SetIssue(Issue::Shared(Issue::Error, wxTRANSLATE(L"Broken markup in translation string.")));
             }
         }
         else // no translation
@@ -739,20 +1308,28 @@ void XLIFF2Catalog::Parse(pugi::xml_node root)
     m_sourceLanguage = Language::TryParse(root.attribute("srcLang").value());
     m_language = Language::TryParse(root.attribute("trgLang").value());
 
-    int id = 0;
+    std::vector<xml_node> nodes;
     for (auto segment: root.select_nodes(".//segment"))
     {
         auto node = segment.node();
         if (strcmp(node.parent().attribute("translate").value(), "no") == 0)
             continue;
-
-        m_items.push_back(std::make_shared<XLIFF2CatalogItem>(++id, node));
+        nodes.push_back(node);
     }
+
+    auto items = create_items_in_parallel(nodes, [=](int id, xml_node node) -> CatalogItemPtr
+    {
+        return CreateItem<XLIFF2CatalogItem>(id, node, m_documentLock);
+    });
+    for (auto& i: items)
+        AddItem(i);
 }
 
 
 void XLIFF2Catalog::SetLanguage(Language lang)
 {
     XLIFFCatalog::SetLanguage(lang);
+
+    boost::unique_lock<boost::shared_mutex> lock(*m_documentLock);
     attribute(GetXMLRoot(), "trgLang") = lang.LanguageTag().c_str();
 }
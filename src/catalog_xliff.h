@@ -31,9 +31,24 @@
 
 #include "pugixml.h"
 
+#include <boost/thread/shared_mutex.hpp>
+
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 
+/// Lock guarding access to XLIFF document's DOM tree, shared by the catalog and its items
+typedef std::shared_ptr<boost::shared_mutex> XLIFFDocumentLock;
+
+/// The file streamed items' markup is read from, see XLIFF1StreamedCatalog
+struct XLIFFStreamedFile
+{
+    wxString filename;
+    uint64_t size;
+};
+
+
 class XLIFFException : public Exception
 {
 public:
@@ -70,13 +85,35 @@ struct XLIFFStringMetadata
 class XLIFFCatalogItem : public CatalogItem
 {
 public:
-    XLIFFCatalogItem(int id, pugi::xml_node node) : m_node(node)
+    XLIFFCatalogItem(int id, pugi::xml_node node, XLIFFDocumentLock lock)
+        : m_node(node), m_documentLock(lock)
         { m_id = id; }
     XLIFFCatalogItem(const CatalogItem&) = delete;
 
+    void AddMemoryUsage(CatalogMemoryUsage& usage) const override;
+
 protected:
+    /**
+        Returns the item's node for reading. For streamed items that weren't
+        modified, the node is parsed from the file into @a tmp, which must
+        be kept around while the node is used.
+     */
+    pugi::xml_node GetNodeForReading(std::unique_ptr<pugi::xml_document>& tmp) const;
+
+    /// Returns the item's node for modifying it; streamed items keep it in memory from now on
+    pugi::xml_node GetNodeForWriting();
+
     pugi::xml_node m_node;
+    XLIFFDocumentLock m_documentLock;
     XLIFFStringMetadata m_metadata;
+
+    // In streaming mode, there's no DOM of the whole document and m_node is
+    // only set once the item is modified, the markup is in the file otherwise:
+    std::shared_ptr<XLIFFStreamedFile> m_streamedFile;
+    uint64_t m_streamedOffset = 0, m_streamedLength = 0;
+    std::unique_ptr<pugi::xml_document> m_streamedDoc;
+
+    friend class XLIFF1StreamedCatalog;
 };
 
 
@@ -93,17 +130,27 @@ public:
 
     static std::shared_ptr<XLIFFCatalog> Open(const wxString& filename);
 
+private:
+    /// Opens the file with XLIFF1StreamedCatalog if possible, returns nullptr if not
+    static std::shared_ptr<XLIFFCatalog> OpenStreamed(const wxString& filename);
+
+public:
+
     bool Save(const wxString& filename, bool save_mo,
               ValidationResults& validation_results,
               CompilationStatus& mo_compilation_status) override;
 
-    std::string SaveToBuffer() override;
+    bool WriteToBuffer(std::string& out) override;
 
     ValidationResults Validate(bool wasJustLoaded) override;
+    bool ValidateItem(const CatalogItemPtr& item) override;
+    ValidationResults ValidateItems(size_t begin, size_t end) override;
 
     Language GetLanguage() const override { return m_language; }
     void SetLanguage(Language lang) override { m_language = lang; }
 
+    CatalogMemoryUsage GetMemoryUsage() const override;
+
     // FIXME: PO specific
     bool HasDeletedItems() const override { return false;}
     void RemoveDeletedItems() override {}
@@ -112,12 +159,19 @@ public:
 
 protected:
     XLIFFCatalog(const wxString& filename, pugi::xml_document&& doc)
-        : Catalog(Type::XLIFF), m_doc(std::move(doc)) { m_fileName = filename; }
+        : Catalog(Type::XLIFF),
+          m_doc(std::move(doc)),
+          m_documentLock(std::make_shared<boost::shared_mutex>())
+        { m_fileName = filename; }
 
     virtual void Parse(pugi::xml_node root) = 0;
 
 protected:
     pugi::xml_document m_doc;
+    // modifications in the pugixml tree can affect other nodes, so writers
+    // must lock the entire document; reading the tree (e.g. saving) only
+    // needs to exclude writers
+    XLIFFDocumentLock m_documentLock;
     Language m_language;
 };
 
@@ -139,6 +193,49 @@ protected:
 };
 
 
+/**
+    XLIFF 1.x catalog that doesn't keep the document in memory.
+
+    Used for very large files: trans-units are read one by one from the
+    file and only the items' texts are kept. Saving copies the original
+    file, replacing markup of modified trans-units (which are the only
+    ones loaded into memory) with their updated version.
+ */
+class XLIFF1StreamedCatalog : public XLIFF1Catalog
+{
+public:
+    XLIFF1StreamedCatalog(const wxString& filename, int subversion);
+
+    bool Save(const wxString& filename, bool save_mo,
+              ValidationResults& validation_results,
+              CompilationStatus& mo_compilation_status) override;
+
+    bool WriteToBuffer(std::string& out) override;
+
+    void SetLanguage(Language lang) override;
+
+    /// Loads the file's items, throws on errors
+    void Load();
+
+protected:
+    void Parse(pugi::xml_node) override {}
+
+private:
+    struct Splice;
+    std::vector<Splice> GetSplices() const;
+
+    struct FileTag
+    {
+        uint64_t offset;
+        std::string markup;
+    };
+
+    std::shared_ptr<XLIFFStreamedFile> m_file;
+    std::vector<FileTag> m_fileTags;
+    bool m_languageChanged;
+};
+
+
 class XLIFF2Catalog : public XLIFFCatalog
 {
 public:
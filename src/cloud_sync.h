@@ -63,6 +63,19 @@ public:
     /// Asynchronously uploads the file. Returned future throws on error.
     virtual dispatch::future<void> Upload(CatalogPtr file) = 0;
 
+    /// Can remote changes be retrieved with Download()?
+    virtual bool SupportsDownload() const { return false; }
+
+    /**
+        Asynchronously downloads the current remote version of the file,
+        e.g. to check for changes made by others in the background.
+
+        Returns loaded catalog or nullptr if the remote file didn't change
+        since the previous call. Returned future throws on error.
+     */
+    virtual dispatch::future<CatalogPtr> Download(CatalogPtr /*file*/)
+        { return dispatch::make_ready_future(CatalogPtr()); }
+
 
     /// Convenicence for creating a destination from a lambda.
     template<typename F>
@@ -114,7 +127,8 @@ public:
     ActivityIndicator *Activity;
 
     /// Show the window while performing background sync action. Show error if 
-    static void RunSync(wxWindow *parent, std::shared_ptr<CloudSyncDestination> dest, CatalogPtr file)
+    /// it fails; returns true on success.
+    static bool RunSync(wxWindow *parent, std::shared_ptr<CloudSyncDestination> dest, CatalogPtr file)
     {
         wxWindowPtr<CloudSyncProgressWindow> progress(new CloudSyncProgressWindow(parent, dest));
 #ifdef __WXOSX__
@@ -140,6 +154,7 @@ public:
         try
         {
             future.get();
+            return true;
         }
         catch (...)
         {
@@ -153,6 +168,7 @@ public:
                 ));
             err->SetExtendedMessage(DescribeCurrentException());
             err->ShowWindowModalThenDo([err](int){});
+            return false;
         }
     }
 };
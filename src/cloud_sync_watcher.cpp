@@ -0,0 +1,310 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "cloud_sync_watcher.h"
+
+#include "cloud_sync.h"
+#include "concurrency.h"
+#include "configuration.h"
+#include "errors.h"
+
+#include <wx/log.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace
+{
+
+// How often to check for remote changes, in milliseconds
+const int PULL_INTERVAL = 5 * 60 * 1000;
+
+std::string MakeKey(const CatalogItem& item)
+{
+    std::string key;
+    if (item.HasContext())
+    {
+        key += item.GetContextUTF8();
+        key += '\x04';
+    }
+    key += item.GetStringUTF8();
+    if (item.HasPlural())
+    {
+        key += '\0';
+        key += item.GetPluralStringUTF8();
+    }
+    return key;
+}
+
+} // anonymous namespace
+
+
+/// Translations of all items of a catalog at some point in time
+struct CloudSyncWatcher::Snapshot
+{
+    struct Item
+    {
+        int id;
+        SmallStringArray translations;
+        bool fuzzy;
+
+        bool SameAs(const Item& other) const
+            { return fuzzy == other.fuzzy && translations == other.translations; }
+
+        bool IsEmpty() const
+        {
+            for (auto& t: translations)
+            {
+                if (!t.empty())
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    std::unordered_map<std::string, Item> items;
+
+    static std::shared_ptr<Snapshot> Of(const Catalog& catalog)
+    {
+        auto s = std::make_shared<Snapshot>();
+        s->items.reserve(catalog.items().size());
+        for (auto& i: catalog.items())
+            s->items.emplace(MakeKey(*i), Item{i->GetId(), i->GetTranslations(), i->IsFuzzy()});
+        return s;
+    }
+};
+
+
+/// Result of merging remote changes, waiting to be applied
+struct CloudSyncWatcher::Update
+{
+    struct Change
+    {
+        Snapshot::Item local;
+        Snapshot::Item remote;
+    };
+
+    std::vector<Change> changes;
+    int conflicts = 0;
+
+    // becomes the new base once applied:
+    std::shared_ptr<Snapshot> remote;
+
+    static std::shared_ptr<Update> Merge(const Snapshot& base, const Snapshot& local, std::shared_ptr<Snapshot> remote)
+    {
+        auto u = std::make_shared<Update>();
+        u->remote = remote;
+
+        for (auto& l: local.items)
+        {
+            auto r = remote->items.find(l.first);
+            if (r == remote->items.end() || r->second.SameAs(l.second))
+                continue;
+
+            auto b = base.items.find(l.first);
+            if (b == base.items.end())
+            {
+                // new string, nothing to compare with, so only fill in missing translations:
+                if (l.second.IsEmpty())
+                    u->changes.push_back({l.second, r->second});
+                else
+                    u->conflicts++;
+                continue;
+            }
+
+            if (r->second.SameAs(b->second))
+                continue; // only changed locally
+            if (l.second.SameAs(b->second))
+                u->changes.push_back({l.second, r->second});
+            else
+                u->conflicts++; // changed on both sides, local version wins
+        }
+
+        return u;
+    }
+};
+
+
+CloudSyncWatcher::CloudSyncWatcher(UpdateHandler onUpdate)
+    : m_onUpdate(onUpdate), m_timer(this), m_generation(0), m_running(false)
+{
+    Bind(wxEVT_TIMER, &CloudSyncWatcher::OnTimer, this);
+}
+
+
+CloudSyncWatcher::~CloudSyncWatcher()
+{
+    Stop();
+}
+
+
+void CloudSyncWatcher::SetCatalog(const CatalogPtr& catalog)
+{
+    auto dest = catalog ? catalog->GetCloudSync() : nullptr;
+    if (!dest || !dest->SupportsDownload() || !Config::SyncCloudInBackground())
+    {
+        Stop();
+        return;
+    }
+
+    if (m_catalog.lock() == catalog)
+        return;
+
+    Stop();
+    m_catalog = catalog;
+    m_base = Snapshot::Of(*catalog);
+    m_timer.Start(PULL_INTERVAL);
+}
+
+
+void CloudSyncWatcher::CatalogSynced()
+{
+    auto catalog = m_catalog.lock();
+    if (!catalog)
+        return;
+
+    // any pending or running merge was computed against the old base:
+    m_generation++;
+    m_pendingUpdate.reset();
+    m_base = Snapshot::Of(*catalog);
+}
+
+
+int CloudSyncWatcher::ApplyUpdate()
+{
+    auto catalog = m_catalog.lock();
+    if (!catalog || !m_pendingUpdate)
+        return 0;
+
+    std::shared_ptr<Update> update;
+    update.swap(m_pendingUpdate);
+
+    auto& items = catalog->items();
+    int applied = 0;
+    for (auto& c: update->changes)
+    {
+        if (c.local.id < 1 || c.local.id > (int)items.size())
+            continue;
+        auto& item = items[c.local.id - 1];
+        // skip if the user edited the item after the merge was computed:
+        if (item->IsFuzzy() != c.local.fuzzy || item->GetTranslations() != c.local.translations)
+            continue;
+
+        item->SetTranslations(c.remote.translations);
+        item->SetFuzzy(c.remote.fuzzy);
+        item->SetModified(true);
+        applied++;
+    }
+
+    wxLogTrace("poedit.cloudsync", "applied %d of %d remote changes", applied, (int)update->changes.size());
+
+    m_generation++;
+    m_base = update->remote;
+    return applied;
+}
+
+
+void CloudSyncWatcher::Stop()
+{
+    m_timer.Stop();
+    m_catalog.reset();
+    m_base.reset();
+    m_pendingUpdate.reset();
+    m_generation++;
+}
+
+
+void CloudSyncWatcher::OnTimer(wxTimerEvent&)
+{
+    StartPull();
+}
+
+
+void CloudSyncWatcher::StartPull()
+{
+    auto catalog = m_catalog.lock();
+    if (m_running || !catalog || !m_base)
+        return;
+
+    auto dest = catalog->GetCloudSync();
+    if (!dest)
+        return;
+
+    const unsigned generation = m_generation;
+    auto base = m_base;
+    // taken on this thread, so that the UI doesn't modify items at the same time:
+    auto local = Snapshot::Of(*catalog);
+    m_running = true;
+
+    wxLogTrace("poedit.cloudsync", "checking %s for changes", dest->GetName());
+
+    dispatch::future<CatalogPtr> download;
+    try
+    {
+        download = dest->Download(catalog);
+    }
+    catch (...)
+    {
+        download = dispatch::make_exceptional_future_from_current<CatalogPtr>();
+    }
+
+    download
+        .then([base, local](dispatch::future<CatalogPtr> f) -> std::shared_ptr<Update>
+        {
+            try
+            {
+                auto remote = f.get();
+                if (!remote)
+                    return nullptr; // no changes since the last check
+                return Update::Merge(*base, *local, Snapshot::Of(*remote));
+            }
+            catch (...)
+            {
+                // errors are reported when the user syncs explicitly:
+                wxLogTrace("poedit.cloudsync", "checking for changes failed: %s", DescribeCurrentException());
+                return nullptr;
+            }
+        })
+        .then_on_window(this, [this, generation](std::shared_ptr<Update> update)
+        {
+            m_running = false;
+            if (!update || generation != m_generation)
+                return;
+            if (update->changes.empty())
+            {
+                // nothing to apply, but the remote state is the new reference
+                // for changes made there in the future:
+                if (!update->conflicts)
+                    m_base = update->remote;
+                return;
+            }
+            m_pendingUpdate = update;
+            if (m_onUpdate)
+                m_onUpdate((int)update->changes.size(), update->conflicts);
+        })
+        .catch_all([](dispatch::exception_ptr){});
+}
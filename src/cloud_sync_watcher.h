@@ -0,0 +1,98 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_cloud_sync_watcher_h
+#define Poedit_cloud_sync_watcher_h
+
+#include "catalog.h"
+
+#include <wx/event.h>
+#include <wx/timer.h>
+
+#include <functional>
+#include <memory>
+
+
+/**
+    Periodically pulls remote changes of a cloud-synced catalog (see
+    Catalog::AttachCloudSync()) in the background.
+
+    Downloaded translations are three-way merged with the local ones, using
+    the catalog's state at the time of the last sync as the common base, and
+    the result is kept ready until the user decides to apply it. Items that
+    changed both locally and remotely keep their local translations.
+
+    Watching is opt-in, see Config::SyncCloudInBackground().
+ */
+class CloudSyncWatcher : public wxEvtHandler
+{
+public:
+    /// Called on the main thread when there are remote changes to apply
+    typedef std::function<void(int changes, int conflicts)> UpdateHandler;
+
+    CloudSyncWatcher(UpdateHandler onUpdate);
+    ~CloudSyncWatcher();
+
+    /** Starts watching @a catalog, stopping watching the previous one. Does
+        nothing if @a catalog is already watched. Pass nullptr to stop.
+
+        The catalog's current state is used as the base for merging.
+     */
+    void SetCatalog(const CatalogPtr& catalog);
+
+    /// Must be called after the catalog was successfully synced explicitly
+    void CatalogSynced();
+
+    /** Applies remote changes reported to the update handler to the catalog.
+        Items modified by the user since are skipped.
+
+        Returns the number of updated items.
+     */
+    int ApplyUpdate();
+
+    struct Snapshot;
+    struct Update;
+
+private:
+    void Stop();
+    void OnTimer(wxTimerEvent& event);
+    void StartPull();
+
+private:
+    UpdateHandler m_onUpdate;
+    std::weak_ptr<Catalog> m_catalog;
+    wxTimer m_timer;
+
+    // state of the catalog when it was last synced:
+    std::shared_ptr<Snapshot> m_base;
+
+    // incremented when the watched catalog or its base changes:
+    unsigned m_generation;
+    bool m_running;
+
+    std::shared_ptr<Update> m_pendingUpdate;
+};
+
+#endif // Poedit_cloud_sync_watcher_h
@@ -30,10 +30,12 @@
 
 #include "catalog.h"
 #include "commentdlg.h"
+#include "edapp.h"
 
 
 CommentDialog::CommentDialog(wxWindow *parent, const wxString& comment) : wxDialog()
 {
+    wxGetApp().LoadXmlResources("comment.xrc");
     wxXmlResource::Get()->LoadDialog(this, parent, "comment_dlg");
 #ifndef __WXOSX__
     CenterOnParent();
@@ -0,0 +1,112 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_compact_string_h
+#define Poedit_compact_string_h
+
+#include "string_pool.h"
+
+#include <wx/string.h>
+
+#include <string>
+
+
+/**
+    Immutable string stored as UTF-8.
+
+    wxString uses wchar_t internally on most platforms, i.e. 4 bytes per
+    character on Linux and macOS, which adds up for catalogs-worth of mostly
+    ASCII text that is rarely accessed. CompactString keeps the text as UTF-8
+    and converts it to wxString only when asked to, typically for the UI.
+    Code that needs UTF-8 anyway (TM, caches, lookup keys) can use utf8()
+    without any conversion.
+
+    The text may be shared with other identical strings using StringPool,
+    e.g. by catalogs of several languages created from the same POT.
+ */
+class CompactString
+{
+public:
+    CompactString() {}
+    CompactString(const wxString& s) { *this = s; }
+
+    static CompactString FromUTF8(std::string utf8)
+    {
+        CompactString s;
+        utf8.shrink_to_fit();
+        s.m_utf8 = std::move(utf8);
+        return s;
+    }
+
+    CompactString& operator=(const wxString& s)
+    {
+        if (s.empty())
+        {
+            m_utf8 = std::string();
+        }
+        else
+        {
+            const wxScopedCharBuffer utf8 = s.utf8_str();
+            m_utf8 = std::string(utf8.data(), utf8.length());
+        }
+        return *this;
+    }
+
+    bool empty() const { return m_utf8.empty(); }
+
+    /// Converted value; prefer utf8() where UTF-8 is good enough
+    wxString str() const
+    {
+        auto& utf8 = m_utf8.get();
+        return utf8.empty() ? wxString() : wxString::FromUTF8Unchecked(utf8.data(), utf8.size());
+    }
+
+    const std::string& utf8() const { return m_utf8.get(); }
+
+    bool operator==(const CompactString& other) const { return m_utf8.get() == other.m_utf8.get(); }
+    bool operator!=(const CompactString& other) const { return m_utf8.get() != other.m_utf8.get(); }
+
+    /// Heap memory used by the content, split among strings sharing it
+    size_t heap_size() const
+    {
+        const long holders = m_utf8.use_count();
+        if (!holders)
+            return 0;
+        auto& utf8 = m_utf8.get();
+        // short strings are stored inline by std::string:
+        size_t size = sizeof(std::string) + 2 * sizeof(long);
+        if (utf8.capacity() > std::string().capacity())
+            size += utf8.capacity() + 1;
+        return size / holders;
+    }
+
+    /// Makes the string share its content with identical ones in @a pool
+    void Intern(StringPool& pool) { pool.Intern(m_utf8); }
+
+private:
+    Interned<std::string> m_utf8;
+};
+
+#endif // Poedit_compact_string_h
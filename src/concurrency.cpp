@@ -28,6 +28,12 @@
 #include "errors.h"
 #include <wx/log.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
 // All this is for rethrow_for_boost:
 #if defined(HAVE_HTTP_CLIENT) && !defined(__WXOSX__)
 #include <cpprest/http_msg.h>
@@ -79,6 +85,99 @@ exception_ptr dispatch::current_exception()
 }
 
 
+
+struct detail::shared_state_base::waiter
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+detail::shared_state_base::~shared_state_base()
+{
+    delete m_waiter.load();
+}
+
+void detail::shared_state_base::begin_set()
+{
+    if (m_flags.fetch_or(SATISFIED) & SATISFIED)
+        BOOST_THROW_EXCEPTION(boost::promise_already_satisfied());
+}
+
+void detail::shared_state_base::abandon()
+{
+    if (m_flags.fetch_or(SATISFIED) & SATISFIED)
+        return;
+    m_exception = boost::copy_exception(boost::broken_promise());
+    mark_ready();
+}
+
+void detail::shared_state_base::mark_ready()
+{
+    // Both this and waiting threads first publish their side and then check
+    // the other's, so that at least one of them sees both:
+    const unsigned flags = m_flags.fetch_or(READY);
+
+    if (auto w = m_waiter.load())
+    {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        w->cond.notify_all();
+    }
+
+    if (flags & CONTINUATION)
+        run_continuation();
+}
+
+void detail::shared_state_base::set_continuation(custom_executor *executor, boost::executors::work&& work)
+{
+    m_executor = executor;
+    m_continuation = std::move(work);
+    if (m_flags.fetch_or(CONTINUATION) & READY)
+        run_continuation();
+}
+
+void detail::shared_state_base::run_continuation()
+{
+    auto work = std::move(m_continuation);
+    if (m_executor)
+        m_executor->submit(std::move(work));
+    else
+        work();
+}
+
+detail::shared_state_base::waiter& detail::shared_state_base::get_waiter()
+{
+    auto w = m_waiter.load();
+    if (!w)
+    {
+        auto created = new waiter;
+        if (m_waiter.compare_exchange_strong(w, created))
+            w = created;
+        else
+            delete created; // another thread was faster
+    }
+    return *w;
+}
+
+void detail::shared_state_base::wait()
+{
+    if (is_ready())
+        return;
+
+    auto& w = get_waiter();
+    std::unique_lock<std::mutex> lock(w.mutex);
+    w.cond.wait(lock, [this]{ return (m_flags.load() & READY) != 0; });
+}
+
+bool detail::shared_state_base::wait_for(std::chrono::nanoseconds timeout)
+{
+    if (is_ready())
+        return true;
+
+    auto& w = get_waiter();
+    std::unique_lock<std::mutex> lock(w.mutex);
+    return w.cond.wait_for(lock, timeout, [this]{ return (m_flags.load() & READY) != 0; });
+}
+
 #if defined(HAVE_DISPATCH)
 
 #include <dispatch/dispatch.h>
@@ -91,8 +190,14 @@ void detail::dispatch_async_cxx(boost::executors::work&& f, detail::queue q)
         case detail::queue::main:
             dq = dispatch_get_main_queue();
             break;
+        case detail::queue::priority_interactive:
+            dq = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+            break;
         case detail::queue::priority_default:
-            dq = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+            dq = dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0);
+            break;
+        case detail::queue::priority_bulk:
+            dq = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
             break;
     }
 
@@ -110,25 +215,419 @@ void detail::dispatch_async_cxx(boost::executors::work&& f, detail::queue q)
     });
 }
 
-#endif // HAVE_DISPATCH
+dispatch::detail::background_queue_executor::background_queue_executor(priority p)
+{
+    switch (p)
+    {
+        case priority::interactive:
+            m_queue = queue::priority_interactive;
+            break;
+        case priority::normal:
+            m_queue = queue::priority_default;
+            break;
+        case priority::bulk:
+            m_queue = queue::priority_bulk;
+            break;
+    }
+}
+
+#elif defined(USE_PPL_DISPATCH)
+
+namespace
+{
+
+// Runs PPL tasks on a ConcRT scheduler whose threads have given priority
+class priority_scheduler : public pplx::scheduler_interface
+{
+public:
+    explicit priority_scheduler(int threadPriority)
+    {
+        Concurrency::SchedulerPolicy policy(1, Concurrency::ContextPriority, threadPriority);
+        m_scheduler = Concurrency::Scheduler::Create(policy);
+    }
+
+    ~priority_scheduler()
+    {
+        m_scheduler->Release();
+    }
+
+    void schedule(pplx::TaskProc_t proc, void *param) override
+    {
+        m_scheduler->ScheduleTask(proc, param);
+    }
+
+private:
+    Concurrency::Scheduler *m_scheduler;
+};
+
+pplx::task_options make_task_options(priority p)
+{
+    switch (p)
+    {
+        case priority::interactive:
+            return pplx::task_options(pplx::scheduler_ptr(std::make_shared<priority_scheduler>(THREAD_PRIORITY_ABOVE_NORMAL)));
+        case priority::bulk:
+            return pplx::task_options(pplx::scheduler_ptr(std::make_shared<priority_scheduler>(THREAD_PRIORITY_BELOW_NORMAL)));
+        case priority::normal:
+            break;
+    }
+    return pplx::task_options();
+}
+
+} // anonymous namespace
+
+dispatch::detail::background_queue_executor::background_queue_executor(priority p)
+    : m_options(make_task_options(p))
+{
+}
+
+#else // !HAVE_DISPATCH && !USE_PPL_DISPATCH
+
+#include <deque>
+#include <vector>
+
+namespace
+{
+
+unsigned pool_size(priority p)
+{
+    // Some tasks wait for subtasks queued in the same pool, so there must
+    // always be at least two workers, otherwise they could deadlock.
+    const unsigned cores = std::max(1U, std::thread::hardware_concurrency());
+    switch (p)
+    {
+        case priority::interactive:
+            // interactive tasks are few and short, don't need as many threads:
+            return std::max(2U, cores / 2);
+        case priority::normal:
+            break;
+        case priority::bulk:
+            // leave a core free for everything else:
+            return std::max(2U, cores - 1);
+    }
+    // one more than cores, so that a worker waiting for subtasks doesn't
+    // leave a core idle:
+    return cores + 1;
+}
+
+} // anonymous namespace
+
+
+class dispatch::detail::background_queue_executor::pool
+{
+public:
+    typedef boost::executors::work work;
+
+    explicit pool(unsigned size)
+        : m_queues(size), m_pending(0), m_sleeping(0), m_stop(false), m_nextQueue(0)
+    {
+        m_threads.reserve(size);
+        for (unsigned i = 0; i < size; i++)
+            m_threads.emplace_back([=]{ worker(i); });
+    }
+
+    ~pool()
+    {
+        stop();
+    }
+
+    // Stops the workers once all queued tasks are done
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_sleepMutex);
+            if (m_stop)
+                return;
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& t: m_threads)
+            t.join();
+    }
+
+    void submit(work&& w)
+    {
+        // Tasks submitted from a worker (e.g. continuations or subtasks) go
+        // to its own queue, where they are likely to be picked up while the
+        // data they use is still in the cache. Others are spread among the
+        // workers evenly.
+        size_t index;
+        if (ms_currentPool == this)
+            index = ms_currentWorker;
+        else
+            index = m_nextQueue++ % m_queues.size();
+
+        // counted first, so that m_pending never underflows:
+        m_pending++;
+        auto& q = m_queues[index];
+        {
+            std::lock_guard<std::mutex> guard(q.mutex);
+            q.tasks.push_back(std::move(w));
+        }
+
+        if (m_sleeping > 0)
+        {
+            // The lock orders this with workers checking m_pending before
+            // going to sleep, so that the wakeup can't get lost:
+            std::lock_guard<std::mutex> guard(m_sleepMutex);
+            m_wake.notify_one();
+        }
+    }
+
+    size_t pending() const { return m_pending; }
+
+    // Runs one queued task on the calling thread, if there's any
+    bool run_one(size_t preferredQueue)
+    {
+        work w;
+        if (!take(preferredQueue, w))
+            return false;
+        execute(w);
+        return true;
+    }
+
+private:
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<work> tasks;
+    };
+
+    // Takes the newest task from the worker's own queue or, if it's empty,
+    // steals the oldest one from another queue.
+    bool take(size_t own, work& w)
+    {
+        if (m_pending == 0)
+            return false;
+
+        const size_t count = m_queues.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            const size_t index = (own + i) % count;
+            auto& q = m_queues[index];
+            std::lock_guard<std::mutex> guard(q.mutex);
+            if (q.tasks.empty())
+                continue;
+            if (i == 0)
+            {
+                w = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+            else
+            {
+                w = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            m_pending--;
+            return true;
+        }
+        return false;
+    }
+
+    static void execute(work& w)
+    {
+        try
+        {
+            w();
+        }
+        catch (...)
+        {
+            // consistent with the other implementations, see dispatch_async_cxx()
+            wxLogDebug("uncaught exception: %s", DescribeCurrentException());
+        }
+    }
+
+    void worker(size_t index)
+    {
+        ms_currentPool = this;
+        ms_currentWorker = index;
+
+        for (;;)
+        {
+            work w;
+            if (take(index, w))
+            {
+                execute(w);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleeping++;
+            m_wake.wait(lock, [=]{ return m_stop || m_pending > 0; });
+            m_sleeping--;
+            if (m_stop && m_pending == 0)
+                return;
+        }
+    }
+
+    std::vector<queue> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<size_t> m_pending;
+    std::atomic<int> m_sleeping;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stop;
+
+    std::atomic<size_t> m_nextQueue;
+
+    static thread_local pool *ms_currentPool;
+    static thread_local size_t ms_currentWorker;
+};
+
+thread_local dispatch::detail::background_queue_executor::pool *dispatch::detail::background_queue_executor::pool::ms_currentPool = nullptr;
+thread_local size_t dispatch::detail::background_queue_executor::pool::ms_currentWorker = 0;
+
+
+dispatch::detail::background_queue_executor::background_queue_executor(priority p)
+    : m_pool(new pool(pool_size(p)))
+{
+}
+
+dispatch::detail::background_queue_executor::~background_queue_executor()
+{
+    close();
+}
+
+void dispatch::detail::background_queue_executor::close()
+{
+    custom_executor::close();
+    m_pool->stop();
+}
+
+void dispatch::detail::background_queue_executor::submit(work&& closure)
+{
+    m_pool->submit(std::move(closure));
+}
+
+bool dispatch::detail::background_queue_executor::try_executing_one()
+{
+    return m_pool->run_one(0);
+}
+
+size_t dispatch::detail::background_queue_executor::pending_count() const
+{
+    return m_pool->pending();
+}
+
+#endif // HAVE_DISPATCH etc.
 
 
 namespace
 {
 
-std::unique_ptr<detail::background_queue_executor> gs_background_executor;
+const int PRIORITIES_COUNT = 3;
+
+std::unique_ptr<detail::background_queue_executor> gs_background_executor[PRIORITIES_COUNT];
 std::unique_ptr<detail::main_thread_executor> gs_main_thread_executor;
-static std::once_flag gs_background_executor_flag, gs_main_thread_executor_flag;
+static std::once_flag gs_background_executor_flag[PRIORITIES_COUNT], gs_main_thread_executor_flag;
 
 }
 
 dispatch::detail::background_queue_executor&
-dispatch::detail::background_queue_executor::get()
+dispatch::detail::background_queue_executor::get(priority p)
 {
-    std::call_once(gs_background_executor_flag, []{
-        gs_background_executor.reset(new background_queue_executor);
+    const int index = static_cast<int>(p);
+    std::call_once(gs_background_executor_flag[index], [=]{
+        gs_background_executor[index].reset(new background_queue_executor(p));
     });
-    return *gs_background_executor;
+    return *gs_background_executor[index];
+}
+
+// Shared with posted drain calls, which may run after the executor was
+// destroyed during shutdown:
+struct dispatch::detail::main_thread_executor::queue_state
+{
+    queue_state() : scheduled(false) {}
+
+    std::mutex mutex;
+    std::deque<work> pending;
+    bool scheduled; // is drain() posted to the main thread?
+};
+
+namespace
+{
+
+// How long to run queued main thread work before letting the event loop
+// process other events:
+const auto MAIN_THREAD_TIME_BUDGET = std::chrono::milliseconds(20);
+
+} // anonymous namespace
+
+dispatch::detail::main_thread_executor::main_thread_executor()
+    : m_queue(std::make_shared<queue_state>())
+{
+}
+
+void dispatch::detail::main_thread_executor::submit(work&& closure)
+{
+    bool post;
+    {
+        std::lock_guard<std::mutex> lock(m_queue->mutex);
+        m_queue->pending.push_back(std::move(closure));
+        post = !m_queue->scheduled;
+        m_queue->scheduled = true;
+    }
+
+    if (post)
+        schedule_drain(m_queue);
+}
+
+void dispatch::detail::main_thread_executor::schedule_drain(std::shared_ptr<queue_state> q)
+{
+#ifdef HAVE_DISPATCH
+    dispatch_async_cxx(work([q]{ drain(q); }), queue::main);
+#else
+    wxTheApp->CallAfter([q]{ drain(q); });
+#endif
+}
+
+void dispatch::detail::main_thread_executor::drain(std::shared_ptr<queue_state> q)
+{
+    // Closures submitted while running the batch are left for the next
+    // wake-up, so that this never runs for more than a bit over the budget:
+    std::deque<work> batch;
+    {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        batch.swap(q->pending);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    while (!batch.empty())
+    {
+        if (std::chrono::steady_clock::now() - start > MAIN_THREAD_TIME_BUDGET)
+            break;
+
+        work w(std::move(batch.front()));
+        batch.pop_front();
+        try
+        {
+            w();
+        }
+        catch (...)
+        {
+            // consistent with dispatch_async_cxx() and the other executors
+            wxLogDebug("uncaught exception: %s", DescribeCurrentException());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        if (!batch.empty())
+        {
+            // unfinished work goes before anything submitted in the meantime:
+            for (auto& w: q->pending)
+                batch.push_back(std::move(w));
+            q->pending.swap(batch);
+        }
+        if (q->pending.empty())
+        {
+            q->scheduled = false;
+            return;
+        }
+    }
+
+    schedule_drain(q);
 }
 
 dispatch::detail::main_thread_executor&
@@ -140,13 +639,146 @@ dispatch::detail::main_thread_executor::get()
     return *gs_main_thread_executor;
 }
 
+bool dispatch::detail::parallel_for_chunks(size_t begin, size_t end,
+                                           const std::function<void(size_t, size_t)>& fn,
+                                           const parallel_options& options)
+{
+    if (begin >= end)
+        return !options.token.is_cancelled();
+
+    const size_t count = end - begin;
+    const size_t cores = std::max(1U, std::thread::hardware_concurrency());
+
+    // Use a few chunks per core, so that the load is balanced even if some
+    // chunks take longer than others:
+    size_t chunkSize = options.chunk_size;
+    if (!chunkSize)
+        chunkSize = std::max(options.min_chunk_size, (count + cores * 4 - 1) / (cores * 4));
+    chunkSize = std::max<size_t>(1, chunkSize);
+    const size_t chunks = (count + chunkSize - 1) / chunkSize;
+
+    // Shared with the helper tasks, which may outlive this call if they only
+    // get to run after all chunks were already processed:
+    struct state
+    {
+        state() : next(0), failed(false), doneChunks(0), doneItems(0) {}
+
+        std::atomic<size_t> next;
+        std::atomic<bool> failed;
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t doneChunks, doneItems;
+        std::exception_ptr error;
+    };
+    auto st = std::make_shared<state>();
+    auto token = options.token;
+    auto fnPtr = &fn;
+
+    // Processes chunks until there are none left; returns false if there
+    // weren't any. @a fn is only used while some chunk wasn't finished yet,
+    // i.e. before parallel_for_chunks() returns.
+    auto runOne = [st, token, fnPtr, chunks, chunkSize, begin, end]() -> bool
+    {
+        const size_t c = st->next++;
+        if (c >= chunks)
+            return false;
+
+        const size_t b = begin + c * chunkSize;
+        const size_t e = std::min(end, b + chunkSize);
+        if (!token.is_cancelled() && !st->failed)
+        {
+            try
+            {
+                (*fnPtr)(b, e);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(st->mutex);
+                if (!st->error)
+                    st->error = std::current_exception();
+                st->failed = true;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(st->mutex);
+            st->doneChunks++;
+            st->doneItems += e - b;
+        }
+        st->cond.notify_all();
+        return true;
+    };
+
+    auto& executor = background_queue_executor::get(options.prio);
+    const size_t helpers = std::min(cores, chunks) - 1;
+    for (size_t i = 0; i < helpers; i++)
+        executor.submit(boost::executors::work([runOne]{ while (runOne()) {} }));
+
+    auto reportProgress = [&]
+    {
+        if (!options.progress)
+            return;
+        size_t done;
+        {
+            std::lock_guard<std::mutex> guard(st->mutex);
+            done = st->doneItems;
+        }
+        if (!options.progress(done, count))
+            token.cancel();
+    };
+
+    while (runOne())
+        reportProgress();
+
+    // wait for chunks being processed by helpers:
+    {
+        std::unique_lock<std::mutex> lock(st->mutex);
+        while (st->doneChunks < chunks)
+        {
+            if (options.progress)
+            {
+                st->cond.wait_for(lock, std::chrono::milliseconds(100));
+                lock.unlock();
+                reportProgress();
+                lock.lock();
+            }
+            else
+            {
+                st->cond.wait(lock);
+            }
+        }
+    }
+    reportProgress();
+
+    if (st->error)
+        std::rethrow_exception(st->error);
+
+    return !token.is_cancelled();
+}
+
+
+int dispatch::queued_tasks_count(priority p)
+{
+#if defined(HAVE_DISPATCH) || defined(USE_PPL_DISPATCH)
+    (void)p;
+    return -1;
+#else
+    return (int)detail::background_queue_executor::get(p).pending_count();
+#endif
+}
+
+
 void dispatch::cleanup()
 {
-    if (gs_background_executor)
-        gs_background_executor->close();
+    for (auto& e: gs_background_executor)
+    {
+        if (e)
+            e->close();
+    }
     if (gs_main_thread_executor)
         gs_main_thread_executor->close();
 
-    gs_background_executor.reset();
+    for (auto& e: gs_background_executor)
+        e.reset();
     gs_main_thread_executor.reset();
 }
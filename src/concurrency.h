@@ -51,12 +51,9 @@
 #endif
 
 #include <boost/chrono/duration.hpp>
+#include <boost/optional.hpp>
 #include <boost/throw_exception.hpp>
 
-#if !defined(HAVE_DISPATCH) && !defined(USE_PPL_DISPATCH)
-    #include <boost/thread/executors/basic_thread_pool.hpp>
-#endif
-
 #if defined(HAVE_PPL)
     #if defined(_MSC_VER)
         #include <concrt.h>
@@ -67,8 +64,15 @@
     #endif
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include <wx/app.h>
 #include <wx/weakref.h>
@@ -83,6 +87,21 @@ template<typename T>
 class future;
 
 
+/**
+    Priority classes of background work.
+
+    Tasks are queued separately for each class, so that e.g. thousands of
+    bulk tasks queued by pre-translation don't delay sidebar queries made
+    in the meantime.
+ */
+enum class priority
+{
+    interactive, ///< the user is waiting for the result, e.g. suggestions
+    normal,      ///< regular background work; the default
+    bulk         ///< large batches or maintenance, e.g. pre-translation
+};
+
+
 // implementation details
 
 namespace detail
@@ -118,7 +137,9 @@ private:
 enum class queue
 {
     main,
-    priority_default
+    priority_interactive,
+    priority_default,
+    priority_bulk
 };
 
 extern void dispatch_async_cxx(boost::executors::work&& f, queue q = queue::priority_default);
@@ -126,12 +147,17 @@ extern void dispatch_async_cxx(boost::executors::work&& f, queue q = queue::prio
 class background_queue_executor : public custom_executor
 {
 public:
-    static background_queue_executor& get();
+    static background_queue_executor& get(priority p = priority::normal);
+
+    explicit background_queue_executor(priority p);
 
     void submit(work&& closure) override
     {
-        dispatch_async_cxx(std::forward<work>(closure));
+        dispatch_async_cxx(std::forward<work>(closure), m_queue);
     }
+
+private:
+    queue m_queue;
 };
 
 #elif defined(USE_PPL_DISPATCH)
@@ -139,38 +165,65 @@ public:
 class background_queue_executor : public custom_executor
 {
 public:
-    static background_queue_executor& get();
+    static background_queue_executor& get(priority p = priority::normal);
+
+    explicit background_queue_executor(priority p);
 
     void submit(work&& closure)
     {
-        pplx::create_task([f{std::move(closure)}]() mutable { f(); });
+        pplx::create_task([f{std::move(closure)}]() mutable { f(); }, m_options);
     }
+
+private:
+    pplx::task_options m_options;
 };
 
 #else // !HAVE_DISPATCH && !USE_PPL_DISPATCH
 
-class background_queue_executor : public boost::basic_thread_pool
+// Work-stealing thread pool: every worker has its own queue of tasks and
+// takes work from others' when it runs out, so that many fine-grained tasks
+// don't contend on a single shared queue.
+class background_queue_executor : public custom_executor
 {
 public:
-    static background_queue_executor& get();
+    static background_queue_executor& get(priority p = priority::normal);
+
+    explicit background_queue_executor(priority p);
+    ~background_queue_executor();
+
+    void close() override;
+    void submit(work&& closure) override;
+    bool try_executing_one() override;
+
+    size_t pending_count() const;
+
+private:
+    class pool;
+    std::unique_ptr<pool> m_pool;
 };
 
 #endif // HAVE_DISPATCH etc.
 
 
+// Runs work on the main thread. Instead of posting an event for every
+// closure, they are queued and many are run, in order, per wake-up of the
+// main thread -- but only for a limited time, so that the UI stays responsive
+// even when thousands of continuations complete at once.
 class main_thread_executor : public custom_executor
 {
 public:
     static main_thread_executor& get();
 
-    void submit(work&& closure)
-    {
-#ifdef HAVE_DISPATCH
-        dispatch_async_cxx(std::forward<work>(closure), queue::main);
-#else
-        wxTheApp->CallAfter(std::forward<work>(closure));
-#endif
-    }
+    main_thread_executor();
+
+    void submit(work&& closure) override;
+
+private:
+    struct queue_state;
+    static void schedule_drain(std::shared_ptr<queue_state> q);
+    static void drain(std::shared_ptr<queue_state> q);
+
+    std::shared_ptr<queue_state> m_queue;
 };
 
 
@@ -200,6 +253,153 @@ struct argument_type<Ret(C::*)(Args...) const>
     using arg0_type = typename std::tuple_element<0, std::tuple<Args...>>::type;
 };
 
+} // namespace detail
+
+
+// ----------------------------------------------------------------------
+// Tasks (aka futures)
+// ----------------------------------------------------------------------
+
+using boost::exception_ptr;
+using boost::future_status;
+
+exception_ptr current_exception();
+
+template<typename T> class promise;
+
+namespace detail
+{
+
+// Shared state of a future and its promise.
+//
+// Unlike boost::future's, it doesn't use a mutex: a future can only have one
+// continuation, so the result and the continuation are handed over using
+// atomic flags and whichever of them comes second runs the continuation.
+// Only threads blocking in wait() need a condition variable, which is
+// allocated when that happens.
+class shared_state_base
+{
+public:
+    shared_state_base() : m_flags(0), m_executor(nullptr), m_waiter(nullptr) {}
+    ~shared_state_base();
+
+    shared_state_base(const shared_state_base&) = delete;
+    shared_state_base& operator=(const shared_state_base&) = delete;
+
+    bool is_ready() const { return (m_flags.load(std::memory_order_acquire) & READY) != 0; }
+
+    void wait();
+    bool wait_for(std::chrono::nanoseconds timeout);
+
+    // Submits @a work to @a executor once the state is ready, or runs it
+    // on the thread that made it ready if @a executor is nullptr.
+    void set_continuation(custom_executor *executor, boost::executors::work&& work);
+
+    void set_exception(exception_ptr e)
+    {
+        begin_set();
+        m_exception = e;
+        mark_ready();
+    }
+
+    // Sets broken_promise error unless the result was already set
+    void abandon();
+
+protected:
+    void begin_set();
+    void mark_ready();
+    void rethrow_if_failed()
+    {
+        if (m_exception)
+            boost::rethrow_exception(m_exception);
+    }
+
+    exception_ptr m_exception;
+
+private:
+    struct waiter;
+    waiter& get_waiter();
+    void run_continuation();
+
+    enum
+    {
+        SATISFIED    = 1, // result is being set
+        READY        = 2, // result is available
+        CONTINUATION = 4  // continuation was set
+    };
+    std::atomic<unsigned> m_flags;
+
+    custom_executor *m_executor;
+    boost::executors::work m_continuation;
+
+    std::atomic<waiter*> m_waiter;
+};
+
+template<typename T>
+class shared_state : public shared_state_base
+{
+public:
+    template<typename U>
+    void set_value(U&& value)
+    {
+        begin_set();
+        m_value.emplace(std::forward<U>(value));
+        mark_ready();
+    }
+
+    T get()
+    {
+        wait();
+        rethrow_if_failed();
+        return std::move(*m_value);
+    }
+
+    // Passes the result, which must be ready, to @a other
+    void forward_to(shared_state<T>& other)
+    {
+        if (m_exception)
+            other.set_exception(m_exception);
+        else
+            other.set_value(std::move(*m_value));
+    }
+
+private:
+    boost::optional<T> m_value;
+};
+
+template<>
+class shared_state<void> : public shared_state_base
+{
+public:
+    void set_value()
+    {
+        begin_set();
+        mark_ready();
+    }
+
+    void get()
+    {
+        wait();
+        rethrow_if_failed();
+    }
+
+    void forward_to(shared_state<void>& other)
+    {
+        if (m_exception)
+            other.set_exception(m_exception);
+        else
+            other.set_value();
+    }
+};
+
+
+// Gives the implementation access to futures' shared state
+struct future_access
+{
+    template<typename T>
+    static std::shared_ptr<shared_state<T>> state(future<T>&& f) { return f.take_state(); }
+};
+
 
 // Helper for calling a continuation. Unpacks futures for continuations that
 // take the value as its argument and leaves it unmodified for those that take
@@ -207,34 +407,34 @@ struct argument_type<Ret(C::*)(Args...) const>
 template<typename T>
 struct continuation_calling_helper
 {
-    static T unpack_arg(boost::future<T>&& arg) { return arg.get(); }
+    template<typename S>
+    static auto unpack_arg(std::shared_ptr<S>& arg) -> decltype(arg->get()) { return arg->get(); }
 };
 
 template<typename T>
 struct continuation_calling_helper<dispatch::future<T>>
 {
-    static boost::future<T> unpack_arg(boost::future<T>&& arg) { return std::move(arg); }
+    static dispatch::future<T> unpack_arg(std::shared_ptr<shared_state<T>>& arg) { return dispatch::future<T>(std::move(arg)); }
 };
 
 template<>
 struct continuation_calling_helper<void>
 {
-    static void touch_arg(boost::future<void>& arg) { arg.get(); }
+    static void touch_arg(std::shared_ptr<shared_state<void>>& arg) { arg->get(); }
 };
 
 
-// Helper to unwrap dispatch::futures into boost::futures so that implicit
-// unwrapping of boost::future<boost::future<T>> into boost::future<T> works
+// Helper that sets the result of calling a function into a shared state,
+// unwrapping returned dispatch::future<T> into the resulting future<T>
 template<typename T>
 struct future_unwrapper
 {
     typedef T type;
-    typedef T return_type;
 
     template<typename F, typename... Args>
-    static return_type call_and_unwrap(F&& f, Args&&... args)
+    static void call_and_set(const std::shared_ptr<shared_state<T>>& result, F& f, Args&&... args)
     {
-        return f(std::forward<Args>(args)...);
+        result->set_value(f(std::forward<Args>(args)...));
     }
 };
 
@@ -242,12 +442,12 @@ template<>
 struct future_unwrapper<void>
 {
     typedef void type;
-    typedef void return_type;
 
     template<typename F, typename... Args>
-    static void call_and_unwrap(F&& f, Args&&... args)
+    static void call_and_set(const std::shared_ptr<shared_state<void>>& result, F& f, Args&&... args)
     {
         f(std::forward<Args>(args)...);
+        result->set_value();
     }
 };
 
@@ -255,44 +455,38 @@ template<typename T>
 struct future_unwrapper<dispatch::future<T>>
 {
     typedef T type;
-    typedef boost::future<T> return_type;
 
     template<typename F, typename... Args>
-    static return_type call_and_unwrap(F&& f, Args&&... args)
+    static void call_and_set(const std::shared_ptr<shared_state<T>>& result, F& f, Args&&... args)
     {
-        return f(std::forward<Args>(args)...).move_to_boost();
+        auto inner = future_access::state(f(std::forward<Args>(args)...));
+        inner->set_continuation(nullptr, boost::executors::work([inner, result]{ inner->forward_to(*result); }));
     }
 };
 
-template<typename F, typename... Args>
-inline auto call_and_unwrap_if_future(F&& f, Args&&... args) -> typename future_unwrapper<typename std::result_of<F(Args...)>::type>::return_type
-{
-    return future_unwrapper<typename std::result_of<F(Args...)>::type>::call_and_unwrap(std::forward<F>(f), std::forward<Args>(args)...);
-}
-
-} // namespace detail
-
+// Runs @a f on @a executor and returns future of its result
+template<typename F>
+auto run_on(custom_executor& executor, F&& f) -> future<typename future_unwrapper<typename std::result_of<F()>::type>::type>;
 
-// ----------------------------------------------------------------------
-// Tasks (aka futures)
-// ----------------------------------------------------------------------
+// Calls @a f with @a src on @a executor once @a src is ready and returns
+// future of its result
+template<typename T, typename F>
+auto continue_on(std::shared_ptr<shared_state<T>> src, custom_executor& executor, F&& f)
+    -> future<typename future_unwrapper<typename std::result_of<F&(std::shared_ptr<shared_state<T>>&)>::type>::type>;
 
-using boost::exception_ptr;
-using boost::future_status;
-template<typename T> using promise = boost::promise<T>;
+} // namespace detail
 
-exception_ptr current_exception();
 
-// Can't use std::current_exception with boost::promise, must use boost
-// version instead. This helper takes care of it.
+// Can't use std::current_exception with promise, because exception_ptr is
+// boost's, must use boost version instead. This helper takes care of it.
 template<typename T>
-void set_current_exception(boost::promise<T>& pr)
+void set_current_exception(promise<T>& pr)
 {
     pr.set_exception(current_exception());
 }
 
 template<typename T>
-void set_current_exception(std::shared_ptr<boost::promise<T>> pr) { set_current_exception(*pr); }
+void set_current_exception(std::shared_ptr<promise<T>> pr) { set_current_exception(*pr); }
 
 
 template<typename T, typename FutureType>
@@ -300,20 +494,21 @@ class future_base
 {
 public:
     future_base() {}
-    future_base(FutureType&& future) : f_(std::move(future.m_future)) {}
-
-    future_base(boost::future<T>&& future) : f_(std::move(future)) {}
-    future_base(boost::future<boost::future<T>>&& future) : f_(future.unwrap()) {}
+    explicit future_base(std::shared_ptr<detail::shared_state<T>> state) : s_(std::move(state)) {}
 
-    FutureType& operator=(FutureType&& other) { f_ = std::move(other.f_); }
-    FutureType& operator=(const FutureType& other) = delete;
+    future_base(future_base&&) = default;
+    future_base& operator=(future_base&&) = default;
 
-    void wait() const { f_.wait(); }
+    void wait() const { state()->wait(); }
 
     template<class Rep, class Period>
-    future_status wait_for(const boost::chrono::duration<Rep,Period>& timeout_duration) const { return f_.wait_for(timeout_duration); }
+    future_status wait_for(const boost::chrono::duration<Rep,Period>& timeout_duration) const
+    {
+        auto ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(timeout_duration).count();
+        return state()->wait_for(std::chrono::nanoseconds(ns)) ? future_status::ready : future_status::timeout;
+    }
 
-    bool valid() const { return f_.valid(); }
+    bool valid() const { return s_ != nullptr; }
 
     // Convenient async exception catching:
 
@@ -323,13 +518,28 @@ public:
     template<typename F>
     auto catch_all(F&& continuation) -> future<void>;
 
-    boost::future<T> move_to_boost() { return std::move(f_); }
-
 protected:
-    boost::future<T> f_;
+    const std::shared_ptr<detail::shared_state<T>>& state() const
+    {
+        if (!s_)
+            BOOST_THROW_EXCEPTION(boost::future_uninitialized());
+        return s_;
+    }
+
+    // Returns the state, leaving the future invalid, like get() or then() do
+    std::shared_ptr<detail::shared_state<T>> take_state()
+    {
+        auto s = state();
+        s_.reset();
+        return s;
+    }
+
+    std::shared_ptr<detail::shared_state<T>> s_;
+
+    friend struct detail::future_access;
 };
 
-/// More advanced wrapper around boost::future
+/// Future value, with support for continuations
 template<typename T>
 class future : public future_base<T, future<T>>
 {
@@ -341,7 +551,7 @@ public:
     future(pplx::task<T>&& task)
     {
         auto pr = std::make_shared<promise<T>>();
-        this->f_ = pr->get_future();
+        this->s_ = pr->get_future().take_state();
         task.then([pr](pplx::task<T> x) {
             try
             {
@@ -355,26 +565,26 @@ public:
     }
 #endif
 
-    T get() { return this->f_.get(); }
+    T get() { return this->take_state()->get(); }
 
     template<typename F>
     auto then(F&& continuation) -> future<typename detail::future_unwrapper<typename std::result_of<F(typename detail::argument_type<F>::arg0_type)>::type>::type>
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
-        return this->f_.then(detail::background_queue_executor::get(),
-                             [f{std::move(continuation)}](boost::future<T> x){
-                                 return detail::call_and_unwrap_if_future(f, cch::unpack_arg(std::move(x)));
-                             });
+        return detail::continue_on(this->take_state(), detail::background_queue_executor::get(),
+                                   [f{std::move(continuation)}](std::shared_ptr<detail::shared_state<T>>& x){
+                                       return f(cch::unpack_arg(x));
+                                   });
     }
 
     template<typename F>
     auto then_on_main(F&& continuation) -> future<typename detail::future_unwrapper<typename std::result_of<F(typename detail::argument_type<F>::arg0_type)>::type>::type>
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
-        return this->f_.then(detail::main_thread_executor::get(),
-                             [f{std::move(continuation)}](boost::future<T> x) {
-                                 return detail::call_and_unwrap_if_future(f, cch::unpack_arg(std::move(x)));
-                             });
+        return detail::continue_on(this->take_state(), detail::main_thread_executor::get(),
+                                   [f{std::move(continuation)}](std::shared_ptr<detail::shared_state<T>>& x){
+                                       return f(cch::unpack_arg(x));
+                                   });
     }
 
     template<typename Window, typename F>
@@ -382,13 +592,13 @@ public:
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
         wxWeakRef<Window> weak(self);
-        return this->f_.then(detail::main_thread_executor::get(),
-                             [weak, f{std::move(continuation)}](boost::future<T> x){
-                                 if (weak)
-                                     return detail::call_and_unwrap_if_future(f, cch::unpack_arg(std::move(x)));
-                                 else
-                                     BOOST_THROW_EXCEPTION(detail::window_dismissed());
-                             });
+        return detail::continue_on(this->take_state(), detail::main_thread_executor::get(),
+                                   [weak, f{std::move(continuation)}](std::shared_ptr<detail::shared_state<T>>& x){
+                                       if (weak)
+                                           return f(cch::unpack_arg(x));
+                                       else
+                                           BOOST_THROW_EXCEPTION(detail::window_dismissed());
+                                   });
     };
 
     template<typename Window>
@@ -412,7 +622,7 @@ public:
     future(pplx::task<void>&& task)
     {
         auto pr = std::make_shared<promise<void>>();
-        this->f_ = pr->get_future();
+        this->s_ = pr->get_future().take_state();
         task.then([pr](pplx::task<void> x) {
             try
             {
@@ -428,28 +638,28 @@ public:
     }
 #endif
 
-    void get() { this->f_.get(); }
+    void get() { this->take_state()->get(); }
 
     template<typename F>
     auto then(F&& continuation) -> future<typename detail::future_unwrapper<typename std::result_of<F()>::type>::type>
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
-        return this->f_.then(detail::background_queue_executor::get(),
-                             [f{std::move(continuation)}](boost::future<void> x){
-                                 cch::touch_arg(x);
-                                 return detail::call_and_unwrap_if_future(f);
-                             });
+        return detail::continue_on(this->take_state(), detail::background_queue_executor::get(),
+                                   [f{std::move(continuation)}](std::shared_ptr<detail::shared_state<void>>& x){
+                                       cch::touch_arg(x);
+                                       return f();
+                                   });
     }
 
     template<typename F>
     auto then_on_main(F&& continuation) -> future<typename detail::future_unwrapper<typename std::result_of<F()>::type>::type>
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
-        return this->f_.then(detail::main_thread_executor::get(),
-                             [f{std::move(continuation)}](boost::future<void> x){
-                                 cch::touch_arg(x);
-                                 detail::call_and_unwrap_if_future(f);
-                             });
+        return detail::continue_on(this->take_state(), detail::main_thread_executor::get(),
+                                   [f{std::move(continuation)}](std::shared_ptr<detail::shared_state<void>>& x){
+                                       cch::touch_arg(x);
+                                       return f();
+                                   });
 
     }
     template<typename Window, typename F>
@@ -457,17 +667,17 @@ public:
     {
         typedef detail::continuation_calling_helper<typename detail::argument_type<typename std::decay<F>::type>::arg0_type> cch;
         wxWeakRef<Window> weak(self);
-        return this->f_.then(detail::main_thread_executor::get(),
-                             [weak, f{std::move(continuation)}](boost::future<void> x){
-                                 if (weak)
-                                 {
-                                     cch::touch_arg(x);
-                                     detail::call_and_unwrap_if_future(f);
-                                 }
-                                 else
-                                     BOOST_THROW_EXCEPTION(detail::window_dismissed());
-
-                             });
+        return detail::continue_on(this->take_state(), detail::main_thread_executor::get(),
+                                   [weak, f{std::move(continuation)}](std::shared_ptr<detail::shared_state<void>>& x){
+                                       if (weak)
+                                       {
+                                           cch::touch_arg(x);
+                                           return f();
+                                       }
+                                       else
+                                           BOOST_THROW_EXCEPTION(detail::window_dismissed());
+
+                                   });
     };
 
     template<typename Window>
@@ -477,21 +687,130 @@ public:
             ((*self).*method)();
         });
     }
+};
+
+
+/// Promise of a value, fulfilled by whoever created it and read through its future
+template<typename T>
+class promise
+{
+public:
+    promise() : m_state(std::make_shared<detail::shared_state<T>>()), m_retrieved(false) {}
+    ~promise()
+    {
+        if (m_state)
+            m_state->abandon();
+    }
+
+    promise(promise&&) = default;
+    promise& operator=(promise&&) = default;
+
+    future<T> get_future()
+    {
+        if (m_retrieved)
+            BOOST_THROW_EXCEPTION(boost::future_already_retrieved());
+        m_retrieved = true;
+        return future<T>(m_state);
+    }
+
+    void set_value(const T& value) { m_state->set_value(value); }
+    void set_value(T&& value) { m_state->set_value(std::move(value)); }
+    void set_exception(exception_ptr e) { m_state->set_exception(e); }
 
 private:
-    boost::future<void> m_future;
+    std::shared_ptr<detail::shared_state<T>> m_state;
+    bool m_retrieved;
 };
 
+template<>
+class promise<void>
+{
+public:
+    promise() : m_state(std::make_shared<detail::shared_state<void>>()), m_retrieved(false) {}
+    ~promise()
+    {
+        if (m_state)
+            m_state->abandon();
+    }
+
+    promise(promise&&) = default;
+    promise& operator=(promise&&) = default;
+
+    future<void> get_future()
+    {
+        if (m_retrieved)
+            BOOST_THROW_EXCEPTION(boost::future_already_retrieved());
+        m_retrieved = true;
+        return future<void>(m_state);
+    }
+
+    void set_value() { m_state->set_value(); }
+    void set_exception(exception_ptr e) { m_state->set_exception(e); }
+
+private:
+    std::shared_ptr<detail::shared_state<void>> m_state;
+    bool m_retrieved;
+};
+
+
+namespace detail
+{
+
+template<typename F>
+auto run_on(custom_executor& executor, F&& f) -> future<typename future_unwrapper<typename std::result_of<F()>::type>::type>
+{
+    typedef typename std::result_of<F()>::type result_type;
+    typedef typename future_unwrapper<result_type>::type value_type;
+
+    auto result = std::make_shared<shared_state<value_type>>();
+    executor.submit(boost::executors::work([result, f{std::forward<F>(f)}]() mutable {
+        try
+        {
+            future_unwrapper<result_type>::call_and_set(result, f);
+        }
+        catch (...)
+        {
+            result->set_exception(dispatch::current_exception());
+        }
+    }));
+    return future<value_type>(result);
+}
+
+template<typename T, typename F>
+auto continue_on(std::shared_ptr<shared_state<T>> src, custom_executor& executor, F&& f)
+    -> future<typename future_unwrapper<typename std::result_of<F&(std::shared_ptr<shared_state<T>>&)>::type>::type>
+{
+    typedef typename std::result_of<F&(std::shared_ptr<shared_state<T>>&)>::type result_type;
+    typedef typename future_unwrapper<result_type>::type value_type;
+
+    auto result = std::make_shared<shared_state<value_type>>();
+    auto s = src.get();
+    // src keeps itself alive through the continuation until it runs:
+    s->set_continuation(&executor, boost::executors::work([src, result, f{std::forward<F>(f)}]() mutable {
+        try
+        {
+            future_unwrapper<result_type>::call_and_set(result, f, src);
+        }
+        catch (...)
+        {
+            result->set_exception(dispatch::current_exception());
+        }
+    }));
+    return future<value_type>(result);
+}
+
+} // namespace detail
 
 
 template<typename T, typename FutureType>
 template<typename Ex, typename F>
 auto future_base<T, FutureType>::catch_ex(F&& continuation) -> future<void>
 {
-    return f_.then(detail::main_thread_executor::get(), [f{std::forward<F>(continuation)}](boost::future<T> x) {
+    return detail::continue_on(take_state(), detail::main_thread_executor::get(),
+                               [f{std::forward<F>(continuation)}](std::shared_ptr<detail::shared_state<T>>& x) {
         try
         {
-            x.get();
+            x->get();
         }
         catch (Ex& ex)
         {
@@ -504,10 +823,11 @@ template<typename T, typename FutureType>
 template<typename F>
 auto future_base<T, FutureType>::catch_all(F&& continuation) -> future<void>
 {
-    return f_.then(detail::main_thread_executor::get(), [f{std::forward<F>(continuation)}](boost::future<T> x) {
+    return detail::continue_on(take_state(), detail::main_thread_executor::get(),
+                               [f{std::forward<F>(continuation)}](std::shared_ptr<detail::shared_state<T>>& x) {
         try
         {
-            x.get();
+            x->get();
         }
         catch (detail::window_dismissed&)
         {
@@ -524,14 +844,18 @@ auto future_base<T, FutureType>::catch_all(F&& continuation) -> future<void>
 
 /// Create ready future, i.e. with directly set value
 template<typename T>
-auto make_ready_future(T&& value) -> future<T>
+auto make_ready_future(T&& value) -> future<typename std::decay<T>::type>
 {
-  return boost::make_ready_future(std::forward<T>(value));
+    auto s = std::make_shared<detail::shared_state<typename std::decay<T>::type>>();
+    s->set_value(std::forward<T>(value));
+    return future<typename std::decay<T>::type>(s);
 }
 
 inline future<void> make_ready_future()
 {
-  return boost::make_ready_future();
+    auto s = std::make_shared<detail::shared_state<void>>();
+    s->set_value();
+    return future<void>(s);
 }
 
 template<typename T>
@@ -573,9 +897,14 @@ void fulfill_promise_from_future(std::shared_ptr<promise<T>> p, future<T>&& f)
 template<class F>
 inline auto async(F&& f) -> future<typename detail::future_unwrapper<typename std::result_of<F()>::type>::type>
 {
-    return {boost::async(detail::background_queue_executor::get(), [f{std::forward<F>(f)}]() {
-        return detail::call_and_unwrap_if_future(f);
-    })};
+    return detail::run_on(detail::background_queue_executor::get(), std::forward<F>(f));
+}
+
+/// Enqueue an operation for background processing with given priority.
+template<class F>
+inline auto async(priority p, F&& f) -> future<typename detail::future_unwrapper<typename std::result_of<F()>::type>::type>
+{
+    return detail::run_on(detail::background_queue_executor::get(p), std::forward<F>(f));
 }
 
 
@@ -583,16 +912,329 @@ inline auto async(F&& f) -> future<typename detail::future_unwrapper<typename st
 template<class F>
 inline auto on_main(F&& f) -> future<typename detail::future_unwrapper<typename std::result_of<F()>::type>::type>
 {
-    return {boost::async(detail::main_thread_executor::get(), [f{std::forward<F>(f)}]() {
-        return detail::call_and_unwrap_if_future(f);
-    })};
+    return detail::run_on(detail::main_thread_executor::get(), std::forward<F>(f));
+}
+
+
+/**
+    Cooperative cancellation of background operations.
+
+    The caller keeps the token and calls cancel() when the operation's result
+    is no longer needed; the operation checks is_cancelled() between its
+    steps and gives up early. Copies share the same state.
+ */
+class cancellation_token
+{
+public:
+    cancellation_token() : m_cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { m_cancelled->store(true); }
+    bool is_cancelled() const { return m_cancelled->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
+
+/**
+    Progress of an operation, reported by the (possibly background) threads
+    doing the work and polled by the thread presenting it, typically the UI
+    thread. It can also cancel the operation through token().
+
+    The total may be zero if it isn't known (yet).
+ */
+class progress_monitor
+{
+public:
+    progress_monitor() : m_done(0), m_total(0), m_results(0) {}
+
+    /// Starts a new stage of the operation with @a total steps
+    void reset(size_t total = 0) { m_done = 0; m_total = total; }
+    void advance(size_t count = 1) { m_done += count; }
+
+    size_t done() const { return m_done.load(); }
+    size_t total() const { return m_total.load(); }
+
+    /// Counts results of the whole operation, e.g. strings translated, that
+    /// may be shown along with the progress; not reset by reset()
+    void add_results(size_t count) { m_results += count; }
+    size_t results() const { return m_results.load(); }
+
+    void cancel() { m_token.cancel(); }
+    bool is_cancelled() const { return m_token.is_cancelled(); }
+    const cancellation_token& token() const { return m_token; }
+
+private:
+    std::atomic<size_t> m_done, m_total, m_results;
+    cancellation_token m_token;
+};
+
+
+/// Options for parallel_for(), parallel_for_chunks() and parallel_transform()
+struct parallel_options
+{
+    parallel_options() : chunk_size(0), min_chunk_size(1), prio(priority::normal) {}
+
+    /// Number of items processed by one task; 0 to choose automatically
+    size_t chunk_size;
+    /// Minimum size of automatically chosen chunks, for cheap per-item work
+    size_t min_chunk_size;
+    /// Priority of the background tasks
+    priority prio;
+    /// No more chunks are started once cancelled
+    cancellation_token token;
+    /**
+        Called on the calling thread as chunks complete, with the number of
+        processed and total items. Returning false cancels the loop.
+     */
+    std::function<bool(size_t done, size_t total)> progress;
+};
+
+namespace detail
+{
+bool parallel_for_chunks(size_t begin, size_t end,
+                         const std::function<void(size_t, size_t)>& chunk,
+                         const parallel_options& options);
+} // namespace detail
+
+/**
+    Calls @a fn(chunkBegin, chunkEnd) for subranges of [@a begin, @a end),
+    concurrently on background threads.
+
+    The calling thread processes chunks too and returns only after all started
+    chunks finished, so it is safe to call from background tasks: it never
+    waits for tasks that didn't get to run.
+
+    If @a fn throws, no more chunks are started and the exception is
+    rethrown from here.
+
+    @return false if cancelled, true if all items were processed.
+ */
+template<typename F>
+inline bool parallel_for_chunks(size_t begin, size_t end, F&& fn,
+                                const parallel_options& options = parallel_options())
+{
+    return detail::parallel_for_chunks(begin, end, std::forward<F>(fn), options);
+}
+
+/// Calls @a fn(i) for every i in [@a begin, @a end), see parallel_for_chunks().
+template<typename F>
+inline bool parallel_for(size_t begin, size_t end, F&& fn,
+                         const parallel_options& options = parallel_options())
+{
+    return detail::parallel_for_chunks(begin, end, [&fn](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; i++)
+            fn(i);
+    }, options);
+}
+
+/**
+    Returns results of calling @a fn(i) for every i in [@a begin, @a end),
+    in order, see parallel_for_chunks().
+
+    If cancelled, results for unprocessed items are default-constructed.
+ */
+template<typename F>
+inline auto parallel_transform(size_t begin, size_t end, F&& fn,
+                               const parallel_options& options = parallel_options())
+    -> std::vector<typename std::decay<typename std::result_of<F(size_t)>::type>::type>
+{
+    std::vector<typename std::decay<typename std::result_of<F(size_t)>::type>::type> results(end > begin ? end - begin : 0);
+    detail::parallel_for_chunks(begin, end, [&fn,&results,begin](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; i++)
+            results[i - begin] = fn(i);
+    }, options);
+    return results;
+}
+
+
+/**
+    Sorts [@a first, @a last) like std::sort(), but in parallel: chunks of
+    the range are sorted concurrently and then merged pairwise, with merges
+    of each round running concurrently as well.
+
+    @a comp is called from several threads at once and must be safe to do so.
+    Only @a options' priority is used, sorting can't be cancelled.
+ */
+template<typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp,
+                   const parallel_options& options = parallel_options())
+{
+    // Chunks smaller than this aren't worth the overhead:
+    const size_t MIN_CHUNK_SIZE = 2048;
+
+    const size_t count = size_t(last - first);
+    const size_t cores = std::max(1U, std::thread::hardware_concurrency());
+    const size_t chunks = std::min(cores * 2, count / std::max(MIN_CHUNK_SIZE, options.min_chunk_size));
+    if (chunks < 2)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    parallel_options opts;
+    opts.chunk_size = 1;
+    opts.prio = options.prio;
+
+    // bounds of sorted runs:
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= chunks; i++)
+        bounds.push_back(count * i / chunks);
+
+    parallel_for(0, chunks, [&](size_t i)
+    {
+        std::sort(first + bounds[i], first + bounds[i + 1], comp);
+    }, opts);
+
+    while (bounds.size() > 2)
+    {
+        parallel_for(0, (bounds.size() - 1) / 2, [&](size_t i)
+        {
+            std::inplace_merge(first + bounds[2*i], first + bounds[2*i + 1], first + bounds[2*i + 2], comp);
+        }, opts);
+
+        std::vector<size_t> merged;
+        for (size_t i = 0; i < bounds.size(); i += 2)
+            merged.push_back(bounds[i]);
+        if (merged.back() != bounds.back())
+            merged.push_back(bounds.back());
+        bounds.swap(merged);
+    }
 }
 
 
+/**
+    Returns the number of tasks of priority @a p waiting to be run, for
+    diagnostics, or -1 if it's unknown because the system's thread pool
+    is used.
+ */
+extern int queued_tasks_count(priority p);
+
 /// @internal Call on shutdown to terminate queues and close executors
 extern void cleanup();
 
 } // namespace dispatch
 
 
+// C++20 coroutines support: dispatch::future<T> can be returned from
+// coroutines and co_awaited. Poedit itself is built as C++14, so this is
+// only available to code compiled with coroutines enabled.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+
+namespace dispatch
+{
+
+namespace detail
+{
+
+// Awaits a future, resuming the coroutine on @a executor's thread(s)
+template<typename T>
+class future_awaiter
+{
+public:
+    future_awaiter(future<T>&& f, custom_executor& executor) : m_state(future_access::state(std::move(f))), m_executor(executor) {}
+
+    bool await_ready() const { return false; }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        // this awaiter must not be used once the continuation may have run and
+        // resumed (and destroyed) it:
+        auto s = m_state;
+        s->set_continuation(&m_executor, boost::executors::work([h]{ h.resume(); }));
+    }
+
+    T await_resume() { return m_state->get(); }
+
+private:
+    std::shared_ptr<shared_state<T>> m_state;
+    custom_executor& m_executor;
+};
+
+// Resumes the coroutine on @a Executor's thread(s)
+template<typename Executor>
+class executor_switch
+{
+public:
+    explicit executor_switch(Executor& executor) : m_executor(executor) {}
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) { m_executor.submit(boost::executors::work([h]{ h.resume(); })); }
+    void await_resume() {}
+
+private:
+    Executor& m_executor;
+};
+
+template<typename T>
+struct coroutine_promise_base
+{
+    promise<T> result;
+
+    future<T> get_return_object() { return result.get_future(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void unhandled_exception() { set_current_exception(result); }
+};
+
+template<typename T>
+struct coroutine_promise : public coroutine_promise_base<T>
+{
+    template<typename U>
+    void return_value(U&& value) { this->result.set_value(std::forward<U>(value)); }
+};
+
+template<>
+struct coroutine_promise<void> : public coroutine_promise_base<void>
+{
+    void return_void() { this->result.set_value(); }
+};
+
+} // namespace detail
+
+
+/**
+    Awaits @a f in a coroutine. The coroutine continues on a background
+    thread, like then() continuations do. Exceptions are rethrown.
+ */
+template<typename T>
+auto operator co_await(future<T>&& f)
+{
+    return detail::future_awaiter<T>(std::move(f), detail::background_queue_executor::get());
+}
+
+/// Awaits @a f in a coroutine that then continues on the main thread, like then_on_main() does
+template<typename T>
+auto resume_on_main(future<T>&& f)
+{
+    return detail::future_awaiter<T>(std::move(f), detail::main_thread_executor::get());
+}
+
+/// co_await switch_to_main() continues the coroutine on the main thread
+inline auto switch_to_main()
+{
+    return detail::executor_switch<detail::main_thread_executor>(detail::main_thread_executor::get());
+}
+
+/// co_await switch_to_background() continues the coroutine on a background thread
+inline auto switch_to_background(priority p = priority::normal)
+{
+    return detail::executor_switch<detail::background_queue_executor>(detail::background_queue_executor::get(p));
+}
+
+} // namespace dispatch
+
+template<typename T, typename... Args>
+struct std::coroutine_traits<dispatch::future<T>, Args...>
+{
+    using promise_type = dispatch::detail::coroutine_promise<T>;
+};
+
+#endif // __cpp_impl_coroutine
+
+
 #endif // Poedit_concurrency_h
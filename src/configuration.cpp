@@ -28,6 +28,7 @@
 #include <wx/config.h>
 #include <wx/thread.h>
 
+#include <atomic>
 #include <mutex>
 
 
@@ -201,6 +202,9 @@ struct CfgLock
     MTSafeConfig::Lock m_wxLock;
 };
 
+// only accessed with std::atomic_load() and std::atomic_store():
+std::shared_ptr<const SettingsSnapshot> g_snapshot;
+
 } // anonymous namespace
 
 
@@ -210,6 +214,53 @@ void Config::Initialize(const std::wstring& configFile)
     // and in wx itself, we must use a n MT-safe implementation.
     wxConfigBase::Set(new MTSafeConfig(configFile));
     wxConfigBase::Get()->SetExpandEnvVars(false);
+
+    Refresh();
+}
+
+
+std::shared_ptr<const SettingsSnapshot> Config::Current()
+{
+    auto s = std::atomic_load(&g_snapshot);
+    if (!s)
+    {
+        Refresh();
+        s = std::atomic_load(&g_snapshot);
+    }
+    return s;
+}
+
+
+void Config::Refresh()
+{
+    auto s = std::make_shared<SettingsSnapshot>();
+    {
+        CfgLock lock;
+        auto cfg = wxConfig::Get();
+
+        s->useTM = cfg->ReadBool("/use_tm", true);
+        s->useCompactTM = cfg->ReadBool("/use_compact_tm", false);
+        s->useMachineTranslation = cfg->ReadBool("/use_mt", false);
+        s->showWarnings = cfg->ReadBool("/show_warnings", true);
+        s->useCatalogCache = cfg->ReadBool("/use_catalog_cache", false);
+        s->watchSources = cfg->ReadBool("/watch_sources", false);
+        s->syncCloudInBackground = cfg->ReadBool("/background_cloud_sync", false);
+#ifdef __WXMSW__
+        s->useMemoryMappedTM = cfg->ReadBool("/use_mmap_tm", false);
+#else
+        s->useMemoryMappedTM = cfg->ReadBool("/use_mmap_tm", true);
+#endif
+
+        s->keepCRLF = cfg->ReadBool("/keep_crlf", true);
+        s->crlfWindows = cfg->Read("/crlf_format", "unix") == "win";
+        s->wrapPOFiles = cfg->ReadBool("/wrap_po_files", true);
+        s->wrapPOFilesWidth = (int)cfg->ReadLong("/wrap_po_files_width", 79);
+        s->compileMO = cfg->ReadBool("/compile_mo", true);
+        s->showSummary = cfg->ReadBool("/show_summary", false);
+
+        s->enableSpellchecking = cfg->ReadBool("/enable_spellchecking", true);
+    }
+    std::atomic_store(&g_snapshot, std::shared_ptr<const SettingsSnapshot>(s));
 }
 
 
@@ -255,8 +306,11 @@ bool Config::Read(const std::string& key, bool *out)
 
 void Config::Write(const std::string& key, bool value)
 {
-    CfgLock lock;
-    wxConfig::Get()->Write(key, value);
+    {
+        CfgLock lock;
+        wxConfig::Get()->Write(key, value);
+    }
+    Refresh();
 }
 
 
@@ -274,6 +328,60 @@ void Config::PretranslateSettings(::PretranslateSettings s)
     Write("/pretranslate/exact_not_fuzzy", s.exactNotFuzzy);
 }
 
+namespace
+{
+
+// lists of paths are stored as a single ';'-separated value
+std::vector<std::wstring> SplitPathsList(const std::wstring& value)
+{
+    std::vector<std::wstring> paths;
+    size_t start = 0;
+    while (start <= value.size())
+    {
+        auto end = value.find(L';', start);
+        if (end == std::wstring::npos)
+            end = value.size();
+        if (end > start)
+            paths.push_back(value.substr(start, end - start));
+        start = end + 1;
+    }
+    return paths;
+}
+
+std::wstring JoinPathsList(const std::vector<std::wstring>& paths)
+{
+    std::wstring value;
+    for (auto& p: paths)
+    {
+        if (!value.empty())
+            value += L';';
+        value += p;
+    }
+    return value;
+}
+
+} // anonymous namespace
+
+std::vector<std::wstring> Config::SharedTMPaths()
+{
+    return SplitPathsList(Read("/shared_tm_paths", std::wstring()));
+}
+
+void Config::SharedTMPaths(const std::vector<std::wstring>& paths)
+{
+    Write("/shared_tm_paths", JoinPathsList(paths));
+}
+
+std::vector<std::wstring> Config::GlossaryPaths()
+{
+    return SplitPathsList(Read("/glossary_paths", std::wstring()));
+}
+
+void Config::GlossaryPaths(const std::vector<std::wstring>& paths)
+{
+    Write("/glossary_paths", JoinPathsList(paths));
+}
+
 
 MergeBehavior Config::MergeBehavior()
 {
@@ -26,7 +26,9 @@
 #ifndef Poedit_configuration_h
 #define Poedit_configuration_h
 
+#include <memory>
 #include <string>
+#include <vector>
 
 // What to do during msgmerge
 enum MergeBehavior
@@ -44,19 +46,65 @@ struct PretranslateSettings
 };
 
 
+/**
+    Immutable copy of frequently read settings, see Config::Current().
+ */
+struct SettingsSnapshot
+{
+    bool useTM;
+    bool useCompactTM;
+    bool useMachineTranslation;
+    bool showWarnings;
+    bool useCatalogCache;
+    bool watchSources;
+    bool syncCloudInBackground;
+    bool useMemoryMappedTM;
+
+    // file format and saving:
+    bool keepCRLF;
+    bool crlfWindows;
+    bool wrapPOFiles;
+    int wrapPOFilesWidth;
+    bool compileMO;
+    bool showSummary;
+
+    bool enableSpellchecking;
+};
+
+
 /**
     High-level interface to configuration storage.
 
     Unlike wxConfig, this is thread-safe.
+
+    Boolean getters below don't access the storage at all, they read the
+    current SettingsSnapshot instead, so they are cheap to call from hot
+    paths and background threads.
  */
 class Config
 {
 public:
     static void Initialize(const std::wstring& configFile);
 
-    static bool UseTM() { return Read("/use_tm", true); }
+    /**
+        Returns the current snapshot of settings without taking any locks.
+
+        The snapshot is replaced (never modified) when settings are changed
+        via Config's setters or after Refresh() is called, so the returned
+        pointer can be kept for consistent values during a longer operation.
+     */
+    static std::shared_ptr<const SettingsSnapshot> Current();
+
+    /// Re-reads the snapshot; must be called after writing to wxConfig directly
+    static void Refresh();
+
+    static bool UseTM() { return Current()->useTM; }
     static void UseTM(bool use) { Write("/use_tm", use); }
 
+    /// Use CompactTranslationMemory for suggestions instead of the full TM?
+    static bool UseCompactTM() { return Current()->useCompactTM; }
+    static void UseCompactTM(bool use) { Write("/use_compact_tm", use); }
+
     static ::PretranslateSettings PretranslateSettings();
     static void PretranslateSettings(::PretranslateSettings s);
 
@@ -64,9 +112,42 @@ public:
     static ::MergeBehavior MergeBehavior();
     static void MergeBehavior(::MergeBehavior b);
 
-    static bool ShowWarnings() { return Read("/show_warnings", true); }
+    static bool ShowWarnings() { return Current()->showWarnings; }
     static void ShowWarnings(bool show) { Write("/show_warnings", show); }
 
+    /// Keep parsed copies of opened PO files for faster reopening?
+    static bool UseCatalogCache() { return Current()->useCatalogCache; }
+    static void UseCatalogCache(bool use) { Write("/use_catalog_cache", use); }
+
+    /// Watch sources of open catalogs and extract changes in the background?
+    static bool WatchSourcesForChanges() { return Current()->watchSources; }
+    static void WatchSourcesForChanges(bool watch) { Write("/watch_sources", watch); }
+
+    /// Periodically pull remote changes of cloud-synced catalogs in the background?
+    static bool SyncCloudInBackground() { return Current()->syncCloudInBackground; }
+    static void SyncCloudInBackground(bool sync) { Write("/background_cloud_sync", sync); }
+
+    /** Access TM indexes through memory-mapped files?
+
+        That is faster for searching, but on Windows, mapped files can't be
+        deleted when segments are merged, so it is off there by default.
+        Read-only shared TMs are always mapped.
+     */
+    static bool UseMemoryMappedTM() { return Current()->useMemoryMappedTM; }
+    static void UseMemoryMappedTM(bool use) { Write("/use_mmap_tm", use); }
+
+    /// Suggest machine translations (if an API key is set, see MachineTranslation)
+    static bool UseMachineTranslation() { return Current()->useMachineTranslation; }
+    static void UseMachineTranslation(bool use) { Write("/use_mt", use); }
+
+    /// Directories with read-only TMs searched in addition to the local one
+    static std::vector<std::wstring> SharedTMPaths();
+    static void SharedTMPaths(const std::vector<std::wstring>& paths);
+
+    /// Glossary files (TBX or CSV) used for term lookups, see Glossary
+    static std::vector<std::wstring> GlossaryPaths();
+    static void GlossaryPaths(const std::vector<std::wstring>& paths);
+
 private:
     template<typename T>
     static T Read(const std::string& key, T defval)
@@ -26,14 +26,22 @@
 
 #include "crowdin_client.h"
 
+#include "errors.h"
 #include "http_client.h"
 #include "keychain/keytar.h"
 #include "str_helpers.h"
+#include "utility.h"
 
+#include <algorithm>
+#include <climits>
+#include <ctime>
 #include <functional>
 #include <mutex>
 #include <boost/algorithm/string.hpp>
 
+#include <wx/file.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
 #include <wx/translation.h>
 #include <wx/utils.h>
 
@@ -61,6 +69,9 @@ namespace
 #define OAUTH_AUTHORIZE_URL "/oauth2/authorize?response_type=token&client_id=" OAUTH_CLIENT_ID
 #define OAUTH_URI_PREFIX    "poedit://auth/crowdin/"
 
+// Crowdin throttles clients with too many simultaneous requests
+const unsigned MAX_CONNECTIONS = 4;
+
 // Recursive extract files from /api/project/*/info response
 void ExtractFilesFromInfo(std::vector<std::wstring>& out, const json& r, const std::wstring& prefix)
 {
@@ -79,6 +90,35 @@ void ExtractFilesFromInfo(std::vector<std::wstring>& out, const json& r, const s
     }
 }
 
+std::vector<CrowdinClient::ProjectListing> ParseUserProjects(const json& r)
+{
+    std::vector<CrowdinClient::ProjectListing> all;
+    for (auto i : r["projects"])
+    {
+        all.push_back({
+            str::to_wstring(i["name"]),
+            i["identifier"],
+            (bool)i["downloadable"].get<int>()
+        });
+    }
+    return all;
+}
+
+CrowdinClient::ProjectInfo ParseProjectInfo(const json& r)
+{
+    CrowdinClient::ProjectInfo prj;
+    auto details = r["details"];
+    prj.name = str::to_wstring(details["name"]);
+    prj.identifier = details["identifier"];
+    for (auto i : r["languages"])
+    {
+        if (i["can_translate"].get<int>() != 0)
+            prj.languages.push_back(Language::TryParse(str::to_wstring(i["code"])));
+    }
+    ExtractFilesFromInfo(prj.files, r, L"/");
+    return prj;
+}
+
 } // anonymous namespace
 
 
@@ -95,8 +135,10 @@ class CrowdinClient::crowdin_http_client : public http_client
 {
 public:
     crowdin_http_client(CrowdinClient& owner)
-        : http_client("https://api.crowdin.com"), m_owner(owner)
-    {}
+        : http_client("https://api.crowdin.com", compress_requests), m_owner(owner)
+    {
+        set_max_connections(MAX_CONNECTIONS);
+    }
 
 protected:
     std::string parse_json_error(const json& response) const override
@@ -124,7 +166,173 @@ protected:
 };
 
 
-CrowdinClient::CrowdinClient() : m_api(new crowdin_http_client(*this))
+// Persistently remembers cache validators of downloaded files
+class CrowdinClient::downloads_cache
+{
+public:
+    downloads_cache()
+    {
+        auto dir = GetUserCacheDir("Crowdin");
+        m_filename = dir + wxFILE_SEP_PATH + "downloads.json";
+
+        wxFFile f;
+        wxString content;
+        if (!wxFileName::FileExists(m_filename) || !f.Open(m_filename, "rb") || !f.ReadAll(&content, wxConvUTF8))
+            return;
+        try
+        {
+            m_data = json::parse(content.utf8_str().data());
+        }
+        catch (...)
+        {
+            // broken cache is harmless, it only results in full downloads
+            m_data = json::object();
+        }
+    }
+
+    static std::string make_key(const std::string& project_id, const std::wstring& file, const Language& lang)
+    {
+        return project_id + "/" + lang.LanguageTag() + "/" + str::to_utf8(file);
+    }
+
+    static json to_json(const http_cache_validators& v)
+    {
+        return {{"etag", v.etag}, {"last_modified", v.last_modified}};
+    }
+
+    static http_cache_validators from_json(const json& j)
+    {
+        http_cache_validators v;
+        if (j.is_object())
+        {
+            v.etag = j.value("etag", "");
+            v.last_modified = j.value("last_modified", "");
+        }
+        return v;
+    }
+
+    /// Serialization of validators as opaque revision tokens
+    static std::string encode(const http_cache_validators& v) { return to_json(v).dump(); }
+
+    static http_cache_validators decode(const std::string& revision)
+    {
+        try
+        {
+            return from_json(json::parse(revision));
+        }
+        catch (...)
+        {
+            return http_cache_validators();
+        }
+    }
+
+    http_cache_validators get(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto i = m_data.find(key);
+        return i != m_data.end() ? from_json(*i) : http_cache_validators();
+    }
+
+    void set(const std::string& key, const http_cache_validators& v)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (v.empty())
+            m_data.erase(key);
+        else
+            m_data[key] = to_json(v);
+
+        auto dir = wxFileName(m_filename).GetPath();
+        if (!wxFileName::DirExists(dir))
+            wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        const std::string content = m_data.dump();
+        wxFFile f;
+        if (f.Open(m_filename, "wb"))
+            f.Write(content.data(), content.size());
+    }
+
+private:
+    std::mutex m_mutex;
+    wxString m_filename;
+    json m_data = json::object();
+};
+
+
+// Persistently caches responses to API calls that retrieve metadata
+class CrowdinClient::responses_cache
+{
+public:
+    /// Cached responses are used without revalidation for this long
+    static const int FRESH_FOR = 10 * 60;
+    /// ...and returned immediately, while refreshed in the background, for this long
+    static const int USABLE_FOR = 30 * 24 * 60 * 60;
+
+    responses_cache()
+    {
+        m_dir = GetUserCacheDir("Crowdin") + wxFILE_SEP_PATH + "api";
+    }
+
+    /// Retrieves cached response for @a url, returns its age in seconds (or INT_MAX if none)
+    int get(const std::string& url, json& out)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        wxFFile f;
+        wxString content;
+        const auto filename = filename_for(url);
+        if (!wxFileName::FileExists(filename) || !f.Open(filename, "rb") || !f.ReadAll(&content, wxConvUTF8))
+            return INT_MAX;
+        try
+        {
+            auto entry = json::parse(content.utf8_str().data());
+            if (entry.value("url", "") != url)
+                return INT_MAX; // hash collision
+            out = entry["response"];
+            const auto age = time(NULL) - entry["time"].get<time_t>();
+            return age < 0 ? INT_MAX : int(std::min<time_t>(age, INT_MAX));
+        }
+        catch (...)
+        {
+            return INT_MAX;
+        }
+    }
+
+    void set(const std::string& url, const json& response)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!wxFileName::DirExists(m_dir))
+            wxFileName::Mkdir(m_dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+        json entry = {{"url", url}, {"time", time(NULL)}, {"response", response}};
+        const std::string content = entry.dump();
+        wxFFile f;
+        if (f.Open(filename_for(url), "wb"))
+            f.Write(content.data(), content.size());
+    }
+
+    /// Removes all cached responses, e.g. because they belong to another user
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (wxFileName::DirExists(m_dir))
+            wxFileName::Rmdir(m_dir, wxPATH_RMDIR_RECURSIVE);
+    }
+
+private:
+    wxString filename_for(const std::string& url) const
+    {
+        return wxString::Format("%s%c%016llx.json", m_dir, wxFILE_SEP_PATH, (unsigned long long)std::hash<std::string>()(url));
+    }
+
+    std::mutex m_mutex;
+    wxString m_dir;
+};
+
+
+CrowdinClient::CrowdinClient()
+    : m_api(new crowdin_http_client(*this)),
+      m_downloads(new downloads_cache),
+      m_responses(new responses_cache),
+      m_tokenState(TokenState::NotLoaded),
+      m_signedIn(false)
 {
     SignInIfAuthorized();
 }
@@ -178,49 +386,108 @@ dispatch::future<CrowdinClient::UserInfo> CrowdinClient::GetUserInfo()
 }
 
 
-dispatch::future<std::vector<CrowdinClient::ProjectListing>> CrowdinClient::GetUserProjects()
+dispatch::future<std::vector<CrowdinClient::ProjectListing>>
+CrowdinClient::GetUserProjects(std::function<void(std::vector<ProjectListing>)> onUpdated)
 {
-    return m_api->get("/api/account/get-projects?json=&role=all")
+    return CachedGet("/api/account/get-projects?json=&role=all",
+                     onUpdated ? [onUpdated](const json& r){ onUpdated(ParseUserProjects(r)); } : JSONHandler())
         .then([](json r)
         {
-            std::vector<ProjectListing> all;
-            for (auto i : r["projects"])
-            {
-                all.push_back({
-                    str::to_wstring(i["name"]),
-                    i["identifier"],
-                    (bool)i["downloadable"].get<int>()
-                });
-            }
-            return all;
+            return ParseUserProjects(r);
         });
 }
 
 
-dispatch::future<CrowdinClient::ProjectInfo> CrowdinClient::GetProjectInfo(const std::string& project_id)
+dispatch::future<CrowdinClient::ProjectInfo>
+CrowdinClient::GetProjectInfo(const std::string& project_id, std::function<void(ProjectInfo)> onUpdated)
 {
     auto url = "/api/project/" + project_id + "/info?json=&project-identifier=" + project_id;
-    return m_api->get(url)
-        .then([](json r){
-            ProjectInfo prj;
-            auto details = r["details"];
-            prj.name = str::to_wstring(details["name"]);
-            prj.identifier = details["identifier"];
-            for (auto i : r["languages"])
-            {
-                if (i["can_translate"].get<int>() != 0)
-                    prj.languages.push_back(Language::TryParse(str::to_wstring(i["code"])));
-            }
-            ExtractFilesFromInfo(prj.files, r, L"/");
-            return prj;
+    return CachedGet(url,
+                     onUpdated ? [onUpdated](const json& r){ onUpdated(ParseProjectInfo(r)); } : JSONHandler())
+        .then([](json r)
+        {
+            return ParseProjectInfo(r);
         });
 }
 
 
+dispatch::future<json> CrowdinClient::CachedGet(const std::string& url, JSONHandler onUpdated)
+{
+    auto cache = m_responses.get();
+
+    json cached;
+    auto age = cache->get(url, cached);
+    if (age < responses_cache::FRESH_FOR)
+        return dispatch::make_ready_future(std::move(cached));
+
+    auto fetched = m_api->get(url).then([cache, url](json r)
+    {
+        cache->set(url, r);
+        return r;
+    });
+
+    if (age >= responses_cache::USABLE_FOR)
+        return fetched;
+
+    // Stale data are returned right away and refreshed in the background;
+    // the caller is only notified if anything changed:
+    fetched.then([cached, onUpdated](json r)
+    {
+        if (onUpdated && r != cached)
+            dispatch::on_main([=]{ onUpdated(r); });
+    })
+    .catch_all([](dispatch::exception_ptr){});
+
+    return dispatch::make_ready_future(std::move(cached));
+}
+
+
 dispatch::future<void> CrowdinClient::DownloadFile(const std::string& project_id,
                                                    const std::wstring& file,
                                                    const Language& lang,
                                                    const std::wstring& output_file)
+{
+    return DoDownloadFile(project_id, file, lang, output_file, /*conditional=*/false).then([](http_download_result){});
+}
+
+
+dispatch::future<bool> CrowdinClient::DownloadFileIfModified(const std::string& project_id,
+                                                             const std::wstring& file,
+                                                             const Language& lang,
+                                                             const std::wstring& output_file)
+{
+    return DoDownloadFile(project_id, file, lang, output_file, /*conditional=*/true)
+           .then([](http_download_result r){ return r.modified; });
+}
+
+
+dispatch::future<bool> CrowdinClient::DownloadFileIfModified(const std::string& project_id,
+                                                             const std::wstring& file,
+                                                             const Language& lang,
+                                                             const std::wstring& output_file,
+                                                             std::shared_ptr<std::string> revision)
+{
+    return DoDownloadFile(project_id, file, lang, output_file, /*conditional=*/true, revision)
+           .then([](http_download_result r){ return r.modified; });
+}
+
+
+dispatch::future<std::shared_ptr<const std::string>> CrowdinClient::FetchFileIfModified(const std::string& project_id,
+                                                                                       const std::wstring& file,
+                                                                                       const Language& lang,
+                                                                                       std::shared_ptr<std::string> revision)
+{
+    return DoDownloadFile(project_id, file, lang, std::wstring(), /*conditional=*/true, revision)
+           .then([](http_download_result r){ return r.body; });
+}
+
+
+dispatch::future<http_download_result> CrowdinClient::DoDownloadFile(const std::string& project_id,
+                                                                     const std::wstring& file,
+                                                                     const Language& lang,
+                                                                     const std::wstring& output_file,
+                                                                     bool conditional,
+                                                                     std::shared_ptr<std::string> revision)
 {
     // NB: "export_translated_only" means the translation is not filled with the source string
     //     if there's no translation, i.e. what Poedit wants.
@@ -229,7 +496,32 @@ dispatch::future<void> CrowdinClient::DownloadFile(const std::string& project_id
                    "&export_translated_only=1"
                    "&language=" + lang.LanguageTag() +
                    "&file=" + http_client::url_encode(file);
-    return m_api->download(url, output_file);
+
+    // Validators are remembered even for unconditional downloads, so that
+    // the next conditional one can use them:
+    auto key = downloads_cache::make_key(project_id, file, lang);
+    auto validators = conditional ? m_downloads->get(key) : http_cache_validators();
+    auto downloads = m_downloads.get();
+
+    // downloads of explicitly tracked revisions are independent of the above:
+    if (revision && !revision->empty())
+        validators = downloads_cache::decode(*revision);
+
+    auto download = output_file.empty()
+                    ? m_api->fetch_if_modified(url, validators)
+                    : m_api->download_if_modified(url, output_file, validators);
+    return download
+        .then([downloads, key, revision](http_download_result r)
+        {
+            if (r.modified)
+            {
+                if (revision)
+                    *revision = downloads_cache::encode(r.validators);
+                else
+                    downloads->set(key, r.validators);
+            }
+            return r;
+        });
 }
 
 
@@ -237,6 +529,15 @@ dispatch::future<void> CrowdinClient::UploadFile(const std::string& project_id,
                                                  const std::wstring& file,
                                                  const Language& lang,
                                                  const std::string& file_content)
+{
+    return UploadFile(project_id, file, lang, [&file_content](std::string& out){ out += file_content; });
+}
+
+
+dispatch::future<void> CrowdinClient::UploadFile(const std::string& project_id,
+                                                 const std::wstring& file,
+                                                 const Language& lang,
+                                                 const ContentWriter& write_content)
 {
     auto url = "/api/project/" + project_id + "/upload-translation";
 
@@ -245,24 +546,193 @@ dispatch::future<void> CrowdinClient::UploadFile(const std::string& project_id,
     data.add_value("language", lang.LanguageTag());
     data.add_value("import_duplicates", "0");
     data.add_value("import_eq_suggestions", "0");
-    data.add_file("files[" + str::to_utf8(file) + "]", "upload.po", file_content);
+    data.add_file("files[" + str::to_utf8(file) + "]", "upload.po", write_content);
 
     return m_api->post(url, data).then([](json){});
 }
 
 
-bool CrowdinClient::IsSignedIn() const
+dispatch::future<std::vector<CrowdinClient::SyncResult>>
+CrowdinClient::DownloadFiles(const std::string& project_id,
+                             const std::vector<SyncItem>& items,
+                             SyncProgress progress)
+{
+    return SyncFiles(items, [=](const SyncItem& i)
+    {
+        return DownloadFile(project_id, i.file, i.lang, i.localFile);
+    },
+    progress);
+}
+
+
+dispatch::future<std::vector<CrowdinClient::SyncResult>>
+CrowdinClient::UploadFiles(const std::string& project_id,
+                           const std::vector<SyncItem>& items,
+                           SyncProgress progress)
 {
-    std::string token;
-    return keytar::GetPassword("Crowdin", "", &token);
+    return SyncFiles(items, [=](const SyncItem& i)
+    {
+        // read the content in the background, not all files upfront:
+        return dispatch::async([=]
+        {
+            wxFile f;
+            if (!f.Open(i.localFile))
+                throw Exception(wxString::Format(_(L"Couldn’t open file %s."), i.localFile));
+            // read the file directly into the request's body:
+            return UploadFile(project_id, i.file, i.lang, [&f](std::string& out)
+            {
+                const size_t size = size_t(f.Length());
+                const size_t offset = out.size();
+                out.resize(offset + size);
+                if (size && f.Read(&out[offset], size) != (ssize_t)size)
+                    throw Exception(_("error reading the file"));
+            });
+        });
+    },
+    progress);
+}
+
+
+dispatch::future<std::vector<CrowdinClient::SyncResult>>
+CrowdinClient::SyncFiles(const std::vector<SyncItem>& items,
+                         SyncOperation operation,
+                         SyncProgress progress)
+{
+    struct State
+    {
+        std::vector<SyncResult> results;
+        std::mutex mutex;
+        size_t done = 0;
+        dispatch::promise<std::vector<SyncResult>> promise;
+    };
+
+    auto state = std::make_shared<State>();
+    const size_t total = items.size();
+    for (auto& i: items)
+    {
+        SyncResult r;
+        r.item = i;
+        state->results.push_back(r);
+    }
+
+    auto future = state->promise.get_future();
+    if (!total)
+    {
+        state->promise.set_value(state->results);
+        return future;
+    }
+
+    auto finished = [state, total, progress](size_t index, dispatch::exception_ptr error)
+    {
+        size_t done;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->results[index].error = error;
+            done = ++state->done;
+        }
+        if (progress)
+            progress(done, total);
+        if (done == total)
+            state->promise.set_value(std::move(state->results));
+    };
+
+    // The number of transfers running at once is limited by http_client's
+    // connection limit, so all of them are started immediately:
+    for (size_t index = 0; index < total; index++)
+    {
+        dispatch::future<void> f;
+        try
+        {
+            f = operation(state->results[index].item);
+        }
+        catch (...)
+        {
+            finished(index, dispatch::current_exception());
+            continue;
+        }
+        f.then([]{ return true; })
+         .then([finished, index](dispatch::future<bool> r)
+         {
+             try
+             {
+                 r.get();
+                 finished(index, dispatch::exception_ptr());
+             }
+             catch (...)
+             {
+                 finished(index, dispatch::current_exception());
+             }
+         });
+    }
+
+    return future;
+}
+
+
+dispatch::future<bool> CrowdinClient::IsSignedIn()
+{
+    std::lock_guard<std::mutex> lock(m_tokenMutex);
+    if (m_tokenState == TokenState::Loaded)
+        return dispatch::make_ready_future(bool(m_signedIn));
+
+    auto waiter = std::make_shared<dispatch::promise<bool>>();
+    m_signedInWaiters.push_back(waiter);
+    return waiter->get_future();
 }
 
 
 void CrowdinClient::SignInIfAuthorized()
 {
-    std::string token;
-    if (keytar::GetPassword("Crowdin", "", &token))
+    {
+        std::lock_guard<std::mutex> lock(m_tokenMutex);
+        if (m_tokenState != TokenState::NotLoaded)
+            return;
+        m_tokenState = TokenState::Loading;
+    }
+
+    // Keychain access can block for a long time (or show a prompt), so don't
+    // do it on the main thread:
+    dispatch::async([]
+    {
+        std::string token;
+        bool found = keytar::GetPassword("Crowdin", "", &token);
+        dispatch::on_main([=]
+        {
+            // the client may have been destroyed during shutdown in the meantime:
+            if (ms_instance)
+                ms_instance->OnTokenLoaded(found, token);
+        });
+    });
+}
+
+
+void CrowdinClient::OnTokenLoaded(bool found, const std::string& token)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tokenMutex);
+        // signing in or out while the keychain was read takes precedence:
+        if (m_tokenState == TokenState::Loaded)
+            return;
+    }
+
+    if (found)
         SetToken(token);
+    SetSignedIn(found);
+}
+
+
+void CrowdinClient::SetSignedIn(bool signedIn)
+{
+    std::vector<std::shared_ptr<dispatch::promise<bool>>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_tokenMutex);
+        m_tokenState = TokenState::Loaded;
+        m_signedIn = signedIn;
+        waiters.swap(m_signedInWaiters);
+    }
+
+    for (auto& w: waiters)
+        w->set_value(signedIn);
 }
 
 
@@ -274,14 +744,19 @@ void CrowdinClient::SetToken(const std::string& token)
 
 void CrowdinClient::SaveAndSetToken(const std::string& token)
 {
+    // the user may be different now
+    m_responses->clear();
     SetToken(token);
+    SetSignedIn(true);
     keytar::AddPassword("Crowdin", "", token);
 }
 
 
 void CrowdinClient::SignOut()
 {
+    m_responses->clear();
     m_api->set_authorization("");
+    SetSignedIn(false);
     keytar::DeletePassword("Crowdin", "");
 }
 
@@ -28,11 +28,17 @@
 
 #ifdef HAVE_HTTP_CLIENT
 
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "concurrency.h"
+#include "json.h"
 #include "language.h"
 
+struct http_download_result;
+
 
 /**
     Client to the Crowdin platform.
@@ -46,8 +52,14 @@ public:
     /// Destroys the singleton, must be called (only) on app shutdown.
     static void CleanUp();
 
-    /// Is the user currently signed into Crowdin?
-    bool IsSignedIn() const;
+    /**
+        Is the user currently signed into Crowdin?
+
+        The token is read from the keychain in the background on first use,
+        which may be slow or even prompt the user, and cached afterwards.
+        The returned future is always fulfilled on the main thread.
+     */
+    dispatch::future<bool> IsSignedIn();
 
     /// Wrap relative Crowdin link to absolute URL
     static std::string WrapLink(const std::string& page);
@@ -84,8 +96,15 @@ public:
         bool downloadable;
     };
 
-    /// Retrieve listing of projects accessible to the user
-    dispatch::future<std::vector<ProjectListing>> GetUserProjects();
+    /**
+        Retrieve listing of projects accessible to the user.
+
+        The listing is cached: recently retrieved data are returned without
+        contacting Crowdin at all and older cached data are returned
+        immediately and revalidated in the background. If the revalidated
+        data differ, @a onUpdated is called with them on the main thread.
+     */
+    dispatch::future<std::vector<ProjectListing>> GetUserProjects(std::function<void(std::vector<ProjectListing>)> onUpdated = nullptr);
 
     /// Project detailed information
     struct ProjectInfo
@@ -96,8 +115,9 @@ public:
         std::vector<std::wstring> files;
     };
 
-    /// Retrieve listing of projects accessible to the user
-    dispatch::future<ProjectInfo> GetProjectInfo(const std::string& project_id);
+    /// Retrieve details of a project; cached in the same way as GetUserProjects().
+    dispatch::future<ProjectInfo> GetProjectInfo(const std::string& project_id,
+                                                 std::function<void(ProjectInfo)> onUpdated = nullptr);
 
     /// Asynchronously download specific Crowdin file into @a output_file.
     dispatch::future<void> DownloadFile(const std::string& project_id,
@@ -105,25 +125,150 @@ public:
                                         const Language& lang,
                                         const std::wstring& output_file);
 
+    /**
+        Like DownloadFile(), but skips the transfer if the file didn't change
+        on Crowdin since Poedit last downloaded it, based on the ETag and
+        Last-Modified validators remembered from the previous download.
+
+        The returned value is false if the file is unchanged; @a output_file
+        isn't written to in that case.
+     */
+    dispatch::future<bool> DownloadFileIfModified(const std::string& project_id,
+                                                  const std::wstring& file,
+                                                  const Language& lang,
+                                                  const std::wstring& output_file);
+
+    /**
+        Like DownloadFileIfModified(), but compares with the version of the
+        file described by @a revision instead of the last download.
+
+        @a revision is an opaque token, updated after downloading a changed
+        file; if it's empty, the last download is used as the reference.
+        Such downloads don't affect DownloadFileIfModified(), which makes
+        them suitable for checking for remote changes in the background.
+     */
+    dispatch::future<bool> DownloadFileIfModified(const std::string& project_id,
+                                                  const std::wstring& file,
+                                                  const Language& lang,
+                                                  const std::wstring& output_file,
+                                                  std::shared_ptr<std::string> revision);
+
+    /**
+        Like DownloadFileIfModified() with @a revision, but returns the
+        file's content, instead of writing it to a file, so that it can be
+        loaded directly from memory. Returns nullptr if the file didn't
+        change.
+     */
+    dispatch::future<std::shared_ptr<const std::string>> FetchFileIfModified(const std::string& project_id,
+                                                                            const std::wstring& file,
+                                                                            const Language& lang,
+                                                                            std::shared_ptr<std::string> revision = nullptr);
+
     /// Asynchronously upload specific Crowdin file data.
     dispatch::future<void> UploadFile(const std::string& project_id,
                                       const std::wstring& file,
                                       const Language& lang,
                                       const std::string& file_content);
 
+    /// Writes file content by appending it to the passed string.
+    typedef std::function<void(std::string& out)> ContentWriter;
+
+    /**
+        Asynchronously upload specific Crowdin file, with the data written
+        by @a write_content directly into the request (e.g. by serializing
+        a catalog with Catalog::WriteToBuffer()) to avoid copying it.
+
+        @a write_content is called synchronously and may throw.
+     */
+    dispatch::future<void> UploadFile(const std::string& project_id,
+                                      const std::wstring& file,
+                                      const Language& lang,
+                                      const ContentWriter& write_content);
+
+    /// One (file, language) pair of a bulk sync operation
+    struct SyncItem
+    {
+        std::wstring file;
+        Language lang;
+        /// Local file to download into or to upload the content of
+        std::wstring localFile;
+    };
+
+    /// Outcome of a single SyncItem; @a error is null on success
+    struct SyncResult
+    {
+        SyncItem item;
+        dispatch::exception_ptr error;
+    };
+
+    /**
+        Progress callback of bulk operations, called with the number of
+        finished items after each one completes. May be called from any
+        thread.
+     */
+    typedef std::function<void(size_t done, size_t total)> SyncProgress;
+
+    /**
+        Asynchronously download many files at once, e.g. all languages of
+        a project. Transfers run in parallel, limited by the maximum number
+        of connections to Crowdin.
+
+        The returned future never fails because of individual items; their
+        errors are reported in results, which are in the order of @a items.
+     */
+    dispatch::future<std::vector<SyncResult>> DownloadFiles(const std::string& project_id,
+                                                            const std::vector<SyncItem>& items,
+                                                            SyncProgress progress = SyncProgress());
+
+    /// Like DownloadFiles(), but uploads content of the items' local files.
+    dispatch::future<std::vector<SyncResult>> UploadFiles(const std::string& project_id,
+                                                          const std::vector<SyncItem>& items,
+                                                          SyncProgress progress = SyncProgress());
+
 private:
+    typedef std::function<void(const json&)> JSONHandler;
+    dispatch::future<json> CachedGet(const std::string& url, JSONHandler onUpdated);
+
+    typedef std::function<dispatch::future<void>(const SyncItem&)> SyncOperation;
+    dispatch::future<std::vector<SyncResult>> SyncFiles(const std::vector<SyncItem>& items,
+                                                        SyncOperation operation,
+                                                        SyncProgress progress);
+
     CrowdinClient();
     ~CrowdinClient();
 
+    // downloads into memory if output_file is empty:
+    dispatch::future<http_download_result> DoDownloadFile(const std::string& project_id,
+                                                          const std::wstring& file,
+                                                          const Language& lang,
+                                                          const std::wstring& output_file,
+                                                          bool conditional,
+                                                          std::shared_ptr<std::string> revision = nullptr);
+
     void SignInIfAuthorized();
+    void OnTokenLoaded(bool found, const std::string& token);
+    void SetSignedIn(bool signedIn);
     void SetToken(const std::string& token);
     void SaveAndSetToken(const std::string& token);
 
     class crowdin_http_client;
     std::unique_ptr<crowdin_http_client> m_api;
 
+    class downloads_cache;
+    std::unique_ptr<downloads_cache> m_downloads;
+
+    class responses_cache;
+    std::unique_ptr<responses_cache> m_responses;
+
     std::shared_ptr<dispatch::promise<void>> m_authCallback;
 
+    // cached state of the token stored in the keychain:
+    enum class TokenState { NotLoaded, Loading, Loaded };
+    std::mutex m_tokenMutex;
+    TokenState m_tokenState;
+    bool m_signedIn;
+    std::vector<std::shared_ptr<dispatch::promise<bool>>> m_signedInWaiters;
+
     static CrowdinClient *ms_instance;
 };
 
@@ -29,6 +29,7 @@
 #include "crowdin_client.h"
 
 #include "catalog.h"
+#include "catalog_po.h"
 #include "cloud_sync.h"
 #include "colorscheme.h"
 #include "concurrency.h"
@@ -117,10 +118,17 @@ void CrowdinLoginPanel::EnsureInitialized()
     if (m_state != State::Uninitialized)
         return;
 
-    if (CrowdinClient::Get().IsSignedIn())
-        UpdateUserInfo();
-    else
-        ChangeState(State::SignedOut);
+    // reading the token from the keychain may take a while:
+    ChangeState(State::UpdatingInfo);
+
+    CrowdinClient::Get().IsSignedIn()
+        .then_on_window(this, [=](bool signedIn)
+        {
+            if (signedIn)
+                UpdateUserInfo();
+            else
+                ChangeState(State::SignedOut);
+        });
 }
 
 void CrowdinLoginPanel::ChangeState(State state)
@@ -347,10 +355,25 @@ private:
 
     void FetchProjects()
     {
+        wxWeakRef<CrowdinOpenDialog> self(this);
+
         m_activity->Start();
-        CrowdinClient::Get().GetUserProjects()
+        CrowdinClient::Get().GetUserProjects([self](std::vector<CrowdinClient::ProjectListing> prjs)
+            {
+                if (self)
+                    self->OnUpdatedProjects(prjs);
+            })
             .then_on_window(this, &CrowdinOpenDialog::OnFetchedProjects)
             .catch_all(m_activity->HandleError);
+
+        // Most likely, the user will pick the same project as the last time;
+        // fetch its details concurrently, instead of waiting for the listing:
+        m_prefetchedProject = wxConfigBase::Get()->Read("/crowdin_last_project", "").ToStdString();
+        if (!m_prefetchedProject.empty())
+        {
+            m_prefetchedInfo = std::make_shared<dispatch::future<CrowdinClient::ProjectInfo>>(
+                                   FetchProjectInfo(m_prefetchedProject));
+        }
     }
 
     void OnFetchedProjects(std::vector<CrowdinClient::ProjectListing> prjs)
@@ -366,13 +389,63 @@ private:
         else
             m_activity->Stop();
 
-        if (prjs.size() == 1)
+        int preselect = prjs.size() == 1 ? 1 : wxNOT_FOUND;
+        for (size_t i = 0; preselect == wxNOT_FOUND && i < prjs.size(); i++)
         {
-            m_project->SetSelection(1);
+            if (prjs[i].identifier == m_prefetchedProject)
+                preselect = int(i) + 1;
+        }
+
+        if (preselect != wxNOT_FOUND)
+        {
+            m_project->SetSelection(preselect);
             OnProjectSelected();
         }
     }
 
+    // Cached listing, shown by OnFetchedProjects(), was updated from Crowdin
+    void OnUpdatedProjects(std::vector<CrowdinClient::ProjectListing> prjs)
+    {
+        auto sel = m_project->GetSelection();
+        auto selected = sel > 0 ? m_projects[sel-1].identifier : std::string();
+
+        m_projects = prjs;
+        m_project->Clear();
+        m_project->Append("");
+        for (auto& p: prjs)
+            m_project->Append(p.name);
+        m_project->Enable(!prjs.empty());
+
+        for (size_t i = 0; i < prjs.size(); i++)
+        {
+            if (prjs[i].identifier == selected)
+            {
+                m_project->SetSelection(int(i) + 1);
+                return;
+            }
+        }
+
+        // the selected project is no longer available:
+        m_project->SetSelection(0);
+        m_info = CrowdinClient::ProjectInfo();
+        m_supportedFilesCount = 0;
+        m_language->Clear();
+        m_file->Clear();
+        m_language->Disable();
+        m_file->Disable();
+    }
+
+    dispatch::future<CrowdinClient::ProjectInfo> FetchProjectInfo(const std::string& id)
+    {
+        wxWeakRef<CrowdinOpenDialog> self(this);
+        return CrowdinClient::Get().GetProjectInfo(id, [self, id](CrowdinClient::ProjectInfo prj)
+        {
+            // only relevant if the user didn't switch to another project meanwhile:
+            if (self && self->m_info.identifier == id)
+                self->OnFetchedProjectInfo(prj);
+        });
+    }
+
     void OnProjectSelected()
     {
         auto sel = m_project->GetSelection();
@@ -380,7 +453,12 @@ private:
         {
             m_activity->Start();
             EnableAllChoices(false);
-            CrowdinClient::Get().GetProjectInfo(m_projects[sel-1].identifier)
+            auto& id = m_projects[sel-1].identifier;
+            auto info = (m_prefetchedInfo && id == m_prefetchedProject)
+                        ? std::move(*m_prefetchedInfo)
+                        : FetchProjectInfo(id);
+            m_prefetchedInfo.reset();
+            info
                 .then_on_window(this, &CrowdinOpenDialog::OnFetchedProjectInfo)
                 .catch_all(m_activity->HandleError);
         }
@@ -388,6 +466,11 @@ private:
 
     void OnFetchedProjectInfo(CrowdinClient::ProjectInfo prj)
     {
+        // if refreshing already shown info, preserve user's choices:
+        const bool refreshing = m_info.identifier == prj.identifier;
+        const auto prevLanguage = m_language->GetStringSelection();
+        const auto prevFile = m_file->GetStringSelection();
+
         m_info = prj;
         // Put supported files first in the list:
         std::vector<std::wstring> f_unsup;
@@ -453,6 +536,14 @@ private:
         if (m_supportedFilesCount == 1)
             m_file->SetSelection(1);
 
+        if (refreshing)
+        {
+            if (!prevLanguage.empty())
+                m_language->SetStringSelection(prevLanguage);
+            if (!prevFile.empty())
+                m_file->SetStringSelection(prevFile);
+        }
+
         if (m_supportedFilesCount == 0)
         {
             m_activity->StopWithError(_("This project has no files that can be translated in Poedit."));
@@ -485,17 +576,25 @@ private:
         auto crowdin_file = m_info.files[m_file->GetSelection() - 1];
         auto crowdin_lang = m_info.languages[m_language->GetSelection() - 1];
         LanguageDialog::SetLastChosen(crowdin_lang);
+        wxConfigBase::Get()->Write("/crowdin_last_project", wxString(crowdin_prj));
         OutLocalFilename = CreateLocalFilename(crowdin_file, crowdin_lang);
 
         m_activity->Start(_(L"Downloading latest translations…"));
 
+        // If we already have a local copy, only download the file if it changed:
         auto outfile = std::make_shared<TempOutputFileFor>(OutLocalFilename);
-        CrowdinClient::Get().DownloadFile(
-                crowdin_prj, crowdin_file, crowdin_lang,
-                outfile->FileName().ToStdWstring()
-            )
-            .then_on_window(this, [=]{
-                outfile->Commit();
+        auto download = wxFileName::FileExists(OutLocalFilename)
+                        ? CrowdinClient::Get().DownloadFileIfModified(
+                              crowdin_prj, crowdin_file, crowdin_lang,
+                              outfile->FileName().ToStdWstring())
+                        : CrowdinClient::Get().DownloadFile(
+                              crowdin_prj, crowdin_file, crowdin_lang,
+                              outfile->FileName().ToStdWstring())
+                          .then([]{ return true; });
+        download
+            .then_on_window(this, [=](bool modified){
+                if (modified)
+                    outfile->Commit();
                 AcceptAndClose();
             })
             .catch_all(m_activity->HandleError);
@@ -537,30 +636,64 @@ private:
 
     std::vector<CrowdinClient::ProjectListing> m_projects;
     CrowdinClient::ProjectInfo m_info;
+    // info about the last used project, requested in advance:
+    std::string m_prefetchedProject;
+    std::shared_ptr<dispatch::future<CrowdinClient::ProjectInfo>> m_prefetchedInfo;
     int m_supportedFilesCount;
 };
 
+// Serializes the catalog directly into the upload request. That happens on
+// a background thread, so a snapshot of the catalog taken now is used if
+// possible, to avoid racing with the user's edits.
+CrowdinClient::ContentWriter CatalogContentWriter(CatalogPtr catalog)
+{
+    if (auto snapshot = catalog->CreateSnapshot())
+        catalog = snapshot;
+
+    return [catalog](std::string& out)
+    {
+        if (!catalog->WriteToBuffer(out))
+            throw Exception(wxString::Format(_(L"Couldn’t save file %s."), catalog->GetFileName()));
+    };
+}
+
+/// Calls @a action if signed in, after letting the user sign in otherwise
+void EnsureSignedInThenDo(wxWindow *parent, std::function<void()> action)
+{
+    CrowdinClient::Get().IsSignedIn()
+        .then_on_window(parent, [=](bool signedIn)
+        {
+            if (signedIn)
+            {
+                action();
+                return;
+            }
+
+            wxWindowPtr<CrowdinLoginDialog> login(new CrowdinLoginDialog(parent));
+            login->ShowWindowModalThenDo([login,action](int retval){
+                if (retval == wxID_OK)
+                    action();
+            });
+        });
+}
+
+void DoSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
+                std::function<void(std::shared_ptr<Catalog>)> onDone);
+
 } // anonymous namespace
 
 
 void CrowdinOpenFile(wxWindow *parent, std::function<void(wxString)> onLoaded)
 {
-    if (!CrowdinClient::Get().IsSignedIn())
+    EnsureSignedInThenDo(parent, [=]
     {
-        wxWindowPtr<CrowdinLoginDialog> login(new CrowdinLoginDialog(parent));
-        login->ShowWindowModalThenDo([login,parent,onLoaded](int retval){
+        wxWindowPtr<CrowdinOpenDialog> dlg(new CrowdinOpenDialog(parent));
+
+        dlg->ShowWindowModalThenDo([dlg,onLoaded](int retval) {
+            dlg->Hide();
             if (retval == wxID_OK)
-                CrowdinOpenFile(parent, onLoaded);
+                onLoaded(dlg->OutLocalFilename);
         });
-        return;
-    }
-
-    wxWindowPtr<CrowdinOpenDialog> dlg(new CrowdinOpenDialog(parent));
-
-    dlg->ShowWindowModalThenDo([dlg,onLoaded](int retval) {
-        dlg->Hide();
-        if (retval == wxID_OK)
-            onLoaded(dlg->OutLocalFilename);
     });
 }
 
@@ -568,22 +701,23 @@ void CrowdinOpenFile(wxWindow *parent, std::function<void(wxString)> onLoaded)
 void CrowdinSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
                      std::function<void(std::shared_ptr<Catalog>)> onDone)
 {
-    if (!CrowdinClient::Get().IsSignedIn())
-    {
-        wxWindowPtr<CrowdinLoginDialog> login(new CrowdinLoginDialog(parent));
-        login->ShowWindowModalThenDo([login,parent,catalog,onDone](int retval){
-            if (retval == wxID_OK)
-                CrowdinSyncFile(parent, catalog, onDone);
-        });
-        return;
-    }
+    EnsureSignedInThenDo(parent, [=]{ DoSyncFile(parent, catalog, onDone); });
+}
+
+
+namespace
+{
 
+void DoSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
+                std::function<void(std::shared_ptr<Catalog>)> onDone)
+{
     const auto& header = catalog->Header();
     auto crowdin_prj = header.GetHeader("X-Crowdin-Project");
     auto crowdin_file = header.GetHeader("X-Crowdin-File");
     auto crowdin_lang = header.HasHeader("X-Crowdin-Language")
                         ? Language::TryParse(header.GetHeader("X-Crowdin-Language").ToStdWstring())
                         : catalog->GetLanguage();
+    const wxString filename = catalog->GetFileName();
 
     wxWindowPtr<CloudSyncProgressWindow> dlg(new CloudSyncProgressWindow(parent));
 
@@ -609,29 +743,31 @@ void CrowdinSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
     dlg->CallAfter([=]{
         CrowdinClient::Get().UploadFile(
                 str::to_utf8(crowdin_prj), str::to_wstring(crowdin_file), crowdin_lang,
-                catalog->SaveToBuffer()
+                CatalogContentWriter(catalog)
             )
             .then([=]{
-                auto tmpdir = std::make_shared<TempDirectory>();
-                auto outfile = tmpdir->CreateFileName("crowdin.po");
-
                 dispatch::on_main([=]{
                     dlg->Activity->Start(_(L"Downloading latest translations…"));
                 });
 
-                return CrowdinClient::Get().DownloadFile(
-                        str::to_utf8(crowdin_prj), str::to_wstring(crowdin_file), crowdin_lang,
-                        outfile.ToStdWstring()
+                // the downloaded file is parsed directly from memory, in the background:
+                return CrowdinClient::Get().FetchFileIfModified(
+                        str::to_utf8(crowdin_prj), str::to_wstring(crowdin_file), crowdin_lang
                     )
-                    .then_on_main([=]
+                    .then([filename](std::shared_ptr<const std::string> data) -> CatalogPtr
+                    {
+                        if (!data)
+                            return nullptr;
+                        auto newcat = POCatalog::CreateFromBuffer(filename, *data);
+                        if (!newcat)
+                            throw Exception(wxString::Format(_(L"Couldn’t load file %s, it is probably corrupted."), filename));
+                        return newcat;
+                    })
+                    .then_on_main([=](CatalogPtr newcat)
                     {
-                        auto newcat = Catalog::Create(outfile);
-                        newcat->SetFileName(catalog->GetFileName());
-
-                        tmpdir->Clear();
                         dlg->EndModal(wxID_OK);
-
-                        onDone(newcat);
+                        // nothing changed on Crowdin since the last download, no need to reload:
+                        onDone(newcat ? newcat : catalog);
                     })
                     .catch_all(handle_error);
             })
@@ -641,6 +777,8 @@ void CrowdinSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
     dlg->ShowWindowModal();
 }
 
+} // anonymous namespace
+
 
 dispatch::future<void> CrowdinSyncDestination::Upload(CatalogPtr file)
 {
@@ -653,6 +791,33 @@ dispatch::future<void> CrowdinSyncDestination::Upload(CatalogPtr file)
 
     return CrowdinClient::Get().UploadFile(
                 str::to_utf8(crowdin_prj), str::to_wstring(crowdin_file), crowdin_lang,
-                file->SaveToBuffer()
+                CatalogContentWriter(file)
             );
 }
+
+
+dispatch::future<CatalogPtr> CrowdinSyncDestination::Download(CatalogPtr file)
+{
+    const auto& header = file->Header();
+    auto crowdin_prj = header.GetHeader("X-Crowdin-Project");
+    auto crowdin_file = header.GetHeader("X-Crowdin-File");
+    auto crowdin_lang = header.HasHeader("X-Crowdin-Language")
+                        ? Language::TryParse(header.GetHeader("X-Crowdin-Language").ToStdWstring())
+                        : file->GetLanguage();
+
+    const wxString filename = file->GetFileName();
+
+    return CrowdinClient::Get().FetchFileIfModified(
+                str::to_utf8(crowdin_prj), str::to_wstring(crowdin_file), crowdin_lang,
+                m_downloadedRevision
+            )
+            .then([filename](std::shared_ptr<const std::string> data) -> CatalogPtr
+            {
+                if (!data)
+                    return nullptr;
+                auto cat = POCatalog::CreateFromBuffer(filename, *data);
+                if (!cat)
+                    throw Exception(wxString::Format(_(L"Couldn’t load file %s, it is probably corrupted."), filename));
+                return cat;
+            });
+}
@@ -85,6 +85,13 @@ public:
     wxString GetName() const override { return "Crowdin"; }
 
     dispatch::future<void> Upload(CatalogPtr file) override;
+
+    bool SupportsDownload() const override { return true; }
+    dispatch::future<CatalogPtr> Download(CatalogPtr file) override;
+
+private:
+    // version of the file last seen by Download():
+    std::shared_ptr<std::string> m_downloadedRevision = std::make_shared<std::string>();
 };
 
 
@@ -109,7 +116,8 @@ void CrowdinOpenFile(wxWindow *parent, std::function<void(wxString)> onLoaded);
 
     @param parent    PoeditFrame the UI should be shown under.
     @param catalog   Catalog to sync.
-    @param onDone    Called with the (new) updated catalog instance.
+    @param onDone    Called with the (new) updated catalog instance, or with
+                     @a catalog itself if it didn't change on Crowdin.
  */
 void CrowdinSyncFile(wxWindow *parent, std::shared_ptr<Catalog> catalog,
                      std::function<void(std::shared_ptr<Catalog>)> onDone);
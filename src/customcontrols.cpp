@@ -53,17 +53,82 @@
 #include "str_helpers.h"
 #include "unicode_helpers.h"
 
+#include <list>
 #include <map>
 #include <memory>
+#include <tuple>
 
 namespace
 {
 
-wxString WrapTextAtWidth(const wxString& text_, int width, Language lang, wxWindow *wnd)
+// Number of wrapped texts kept by WrapTextAtWidth(); the sidebar alone
+// shows a few dozen of them at most:
+const size_t MAX_CACHED_WRAPPED_TEXTS = 500;
+// Number of measured substrings kept by WrapTextAtWidth()
+const size_t MAX_CACHED_EXTENTS = 20000;
+
+/**
+    Results of WrapTextAtWidth() and measurements it made, because
+    wrapping is repeated for the same texts on every item change and
+    resize. Only used on the main thread.
+ */
+struct WrappingCache
 {
-    if (text_.empty())
-        return text_;
+    // text, width, font, language:
+    typedef std::tuple<wxString, int, wxString, std::string> Key;
+    typedef std::list<std::pair<Key, wxString>> LRUList;
+
+    // most recently used entries are at the front:
+    LRUList wrapped;
+    std::map<Key, LRUList::iterator> index;
+
+    // substrings' widths, by font:
+    std::map<std::pair<wxString, wxString>, int> extents;
+
+    static WrappingCache& Get()
+    {
+        static WrappingCache s_cache;
+        return s_cache;
+    }
 
+    const wxString *Find(const Key& key)
+    {
+        auto found = index.find(key);
+        if (found == index.end())
+            return nullptr;
+        wrapped.splice(wrapped.begin(), wrapped, found->second);
+        return &found->second->second;
+    }
+
+    void Put(const Key& key, const wxString& value)
+    {
+        wrapped.emplace_front(key, value);
+        index.emplace(key, wrapped.begin());
+        while (wrapped.size() > MAX_CACHED_WRAPPED_TEXTS)
+        {
+            index.erase(wrapped.back().first);
+            wrapped.pop_back();
+        }
+    }
+
+    int GetTextWidth(wxWindow *wnd, const wxString& font, const wxString& text)
+    {
+        auto key = std::make_pair(font, text);
+        auto found = extents.find(key);
+        if (found != extents.end())
+            return found->second;
+
+        if (extents.size() >= MAX_CACHED_EXTENTS)
+            extents.clear();
+        const int width = wnd->GetTextExtent(text).x;
+        extents.emplace(std::move(key), width);
+        return width;
+    }
+};
+
+
+wxString DoWrapTextAtWidth(const wxString& text_, int width, const Language& lang, wxWindow *wnd, const wxString& fontKey)
+{
 #ifdef BIDI_NEEDS_DIRECTION_ON_EACH_LINE
     wchar_t directionMark = 0;
     if (bidi::is_direction_mark(*text_.begin()))
@@ -101,7 +166,7 @@ wxString WrapTextAtWidth(const wxString& text_, int width, Language lang, wxWind
     {
         auto substr = str::to_wx(text.tempSubStringBetween(lineStart, pos));
 
-        if (wnd->GetTextExtent(substr).x > width)
+        if (WrappingCache::Get().GetTextWidth(wnd, fontKey, substr) > width)
         {
             auto previousPos = iter->previous();
             if (previousPos == lineStart || previousPos == icu::BreakIterator::DONE)
@@ -149,6 +214,25 @@ wxString WrapTextAtWidth(const wxString& text_, int width, Language lang, wxWind
 }
 
 
+wxString WrapTextAtWidth(const wxString& text, int width, Language lang, wxWindow *wnd)
+{
+    if (text.empty())
+        return text;
+
+    // the same font renders differently on displays with different scaling:
+    const wxString fontKey = wxString::Format("%g:", wnd->GetContentScaleFactor()) + wnd->GetFont().GetNativeFontInfoDesc();
+
+    auto& cache = WrappingCache::Get();
+    const WrappingCache::Key key(text, width, fontKey, lang.IcuLocaleName());
+    if (auto cached = cache.Find(key))
+        return *cached;
+
+    auto wrapped = DoWrapTextAtWidth(text, width, lang, wnd, fontKey);
+    cache.Put(key, wrapped);
+    return wrapped;
+}
+
+
 } // anonymous namespace
 
 
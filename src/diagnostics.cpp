@@ -0,0 +1,172 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "diagnostics.h"
+
+#include "concurrency.h"
+#include "hidpi.h"
+#include "tracing.h"
+#include "utility.h"
+
+#include <wx/sizer.h>
+#include <wx/textctrl.h>
+
+
+namespace
+{
+
+#ifdef __WXOSX__
+const int FRAME_STYLE = wxDEFAULT_FRAME_STYLE | wxFRAME_TOOL_WINDOW;
+#else
+const int FRAME_STYLE = wxDEFAULT_FRAME_STYLE;
+#endif
+
+const int REFRESH_INTERVAL_MS = 1000;
+
+inline double MB(size_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+wxString FormatQueueLength(int count)
+{
+    return count < 0 ? wxString("n/a") : wxString::Format("%d", count);
+}
+
+} // anonymous namespace
+
+
+DiagnosticsWindow *DiagnosticsWindow::ms_instance = nullptr;
+
+DiagnosticsWindow *DiagnosticsWindow::GetAndActivate()
+{
+    if (!ms_instance)
+        ms_instance = new DiagnosticsWindow;
+    ms_instance->Show();
+    if (ms_instance->IsIconized())
+        ms_instance->Iconize(false);
+    ms_instance->Raise();
+    return ms_instance;
+}
+
+
+DiagnosticsWindow::DiagnosticsWindow()
+    : wxFrame(nullptr, wxID_ANY, "Diagnostics", wxDefaultPosition, wxDefaultSize, FRAME_STYLE),
+      m_timer(this)
+{
+    SetName("diagnostics");
+
+    // only scopes finished from now on are counted:
+    Tracing::EnableStatistics();
+
+    m_text = new wxTextCtrl(this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize,
+                            wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP | wxBORDER_NONE);
+    m_text->SetFont(wxFont(wxFontInfo(m_text->GetFont().GetPointSize()).Family(wxFONTFAMILY_TELETYPE)));
+
+    auto sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(m_text, wxSizerFlags(1).Expand());
+    SetSizer(sizer);
+
+    RestoreWindowState(this, wxSize(PX(800), PX(500)));
+
+    Bind(wxEVT_TIMER, [=](wxTimerEvent&){ UpdateContent(); });
+
+    UpdateContent();
+    m_timer.Start(REFRESH_INTERVAL_MS);
+}
+
+
+DiagnosticsWindow::~DiagnosticsWindow()
+{
+    m_timer.Stop();
+    SaveWindowState(this);
+    ms_instance = nullptr;
+}
+
+
+void DiagnosticsWindow::UpdateContent()
+{
+    // don't waste time on updating hidden content:
+    if (!IsShownOnScreen())
+        return;
+
+    wxString out;
+
+    out += wxString::Format("Queued background tasks: interactive %s, normal %s, bulk %s\n",
+                            FormatQueueLength(dispatch::queued_tasks_count(dispatch::priority::interactive)),
+                            FormatQueueLength(dispatch::queued_tasks_count(dispatch::priority::normal)),
+                            FormatQueueLength(dispatch::queued_tasks_count(dispatch::priority::bulk)));
+
+    auto catalog = m_catalog.lock();
+    if (catalog)
+    {
+        auto mem = catalog->GetMemoryUsage();
+        out += wxString::Format("Catalog: %s, %d items, ~%.1f MB\n",
+                                catalog->GetFileName(), (int)catalog->GetCount(), MB(mem.Total()));
+        out += wxString::Format("  items %.1f, strings %.1f, translations %.1f, references %.1f, comments %.1f,\n"
+                                "  document %.1f, deleted items %.1f, indexes %.1f MB\n",
+                                MB(mem.items), MB(mem.strings), MB(mem.translations), MB(mem.references),
+                                MB(mem.comments), MB(mem.document), MB(mem.deletedItems), MB(mem.indexes));
+    }
+
+    long cacheHits = 0, cacheMisses = 0;
+    auto counters = Tracing::GetCounters();
+    for (auto& c: counters)
+    {
+        if (c.first == "SuggestionsCache hits")
+            cacheHits = c.second;
+        else if (c.first == "SuggestionsCache misses")
+            cacheMisses = c.second;
+    }
+    if (cacheHits + cacheMisses > 0)
+    {
+        out += wxString::Format("Suggestions cache hit rate: %.0f%% of %ld queries\n",
+                                100.0 * cacheHits / (cacheHits + cacheMisses), cacheHits + cacheMisses);
+    }
+
+    if (!counters.empty())
+    {
+        out += "\nCounters:\n";
+        for (auto& c: counters)
+            out += wxString::Format("  %-40s %10ld\n", c.first, c.second);
+    }
+
+    out += wxString::Format("\n%-34s %7s %9s %9s %9s", "Timings (ms)", "count", "last", "mean", "max");
+    for (int i = 0; i < Tracing::HISTOGRAM_BUCKETS - 1; i++)
+        out += wxString::Format(" %6s", wxString::Format("<=%g", Tracing::HISTOGRAM_LIMITS_MS[i]));
+    out += wxString::Format(" %6s\n", wxString::Format(">%g", Tracing::HISTOGRAM_LIMITS_MS[Tracing::HISTOGRAM_BUCKETS - 2]));
+
+    for (auto& s: Tracing::GetScopeStatistics())
+    {
+        out += wxString::Format("%-34s %7ld %9.1f %9.1f %9.1f",
+                                s.name, s.count, s.lastMs, s.totalMs / s.count, s.maxMs);
+        for (auto n: s.histogram)
+            out += wxString::Format(" %6ld", n);
+        out += "\n";
+    }
+
+    if (out != m_text->GetValue())
+        m_text->ChangeValue(out);
+}
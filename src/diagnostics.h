@@ -0,0 +1,69 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_diagnostics_h
+#define Poedit_diagnostics_h
+
+#include "catalog.h"
+
+#include <wx/frame.h>
+#include <wx/timer.h>
+
+#include <memory>
+
+class WXDLLIMPEXP_FWD_CORE wxTextCtrl;
+
+
+/**
+    Hidden window with live performance counters, for diagnosing slowness
+    reported by users.
+
+    It is opened with Ctrl+Alt+Shift+D in the editor and shows statistics
+    collected by Tracing (which is enabled when the window is first shown),
+    queued background tasks and the edited catalog's memory usage. Being
+    meant for developers, its content isn't translated.
+ */
+class DiagnosticsWindow : public wxFrame
+{
+public:
+    static DiagnosticsWindow *GetAndActivate();
+
+    /// Sets the catalog whose memory usage is shown
+    void SetCatalog(const CatalogPtr& catalog) { m_catalog = catalog; }
+
+private:
+    DiagnosticsWindow();
+    ~DiagnosticsWindow();
+
+    void UpdateContent();
+
+    wxTextCtrl *m_text;
+    wxTimer m_timer;
+    std::weak_ptr<Catalog> m_catalog;
+
+    static DiagnosticsWindow *ms_instance;
+};
+
+#endif // Poedit_diagnostics_h
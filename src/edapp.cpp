@@ -63,6 +63,8 @@
 #include <unicode/uclean.h>
 #include <unicode/putil.h>
 
+#include <fstream>
+
 #if !wxUSE_UNICODE
     #error "Unicode build of wxWidgets is required by Poedit"
 #endif
@@ -75,7 +77,12 @@
 #include "extractors/extractor_legacy.h"
 #include "manager.h"
 #include "prefsdlg.h"
+#include "pretranslate.h"
 #include "chooselang.h"
+#include "benchmarks.h"
+#include "cat_update.h"
+#include "catalog_diff.h"
+#include "catalog_po.h"
 #include "customcontrols.h"
 #include "gexecute.h"
 #include "hidpi.h"
@@ -83,11 +90,19 @@
 #include "icons.h"
 #include "version.h"
 #include "str_helpers.h"
+#include "tracing.h"
+#include "tm/compact_tm.h"
+#include "tm/glossary.h"
+#include "tm/machine_translation.h"
+#include "tm/tmx_io.h"
 #include "tm/transmem.h"
 #include "utility.h"
 #include "prefsdlg.h"
 #include "errors.h"
+#include "json.h"
 #include "language.h"
+#include "leverage.h"
+#include "qa_checks.h"
 #include "crowdin_client.h"
 
 #ifdef __WXOSX__
@@ -328,11 +343,46 @@ bool PoeditApp::CheckForBetaUpdates() const
 static wxArrayString gs_filesToOpen;
 #endif
 static int gs_lineToOpen = 0;
+static wxArrayString gs_filesToPreTranslate;
+static bool gs_preTranslateAndExit = false;
+static wxArrayString gs_pathsToImportIntoTM;
+static bool gs_importIntoTMAndExit = false;
+static wxArrayString gs_filesToCheck;
+static bool gs_checkAndExit = false, gs_compileMO = false;
+static wxArrayString gs_filesToUpdate;
+static bool gs_updateAndExit = false;
+static wxArrayString gs_filesToDiff;
+static wxArrayString gs_filesToAnalyze;
+static bool gs_analyzeLeverageAndExit = false;
+static wxArrayString gs_tmxToImport;
+static wxString gs_tmxToExport;
+static bool gs_manageTMAndExit = false, gs_tmStats = false, gs_tmCompact = false;
+static wxString gs_benchmarkSuite, gs_benchmarkOptions;
+static dispatch::future<void> gs_backgroundInit;
+
+// Initializes subsystems that aren't needed for showing the first window, so
+// that they are ready by the time they are first used (TM by suggestions,
+// display names of languages by TryParse() and languages pickers):
+static void InitializeInBackground()
+{
+    gs_backgroundInit = dispatch::async(dispatch::priority::bulk, []
+    {
+        // opening the index is slow; errors are kept and reported when the TM
+        // is actually used:
+        if (Config::UseTM())
+            TranslationMemory::Get();
+
+        Language::AllFormattedNames();
+    });
+}
 
 extern void InitXmlResource();
 
 bool PoeditApp::OnInit()
 {
+    // tracing is only enabled later, during command line parsing:
+    ScopedTrace traceInit("PoeditApp::OnInit", Tracing::Clock::now());
+
 #ifdef __WXMSW__
     // remove the current directory from the default DLL search order
     SetDllDirectory(L"");
@@ -369,7 +419,9 @@ bool PoeditApp::OnInit()
 #endif
 
 #ifndef __WXOSX__
-    m_remoteServer.reset(new RemoteServer(this));
+    if (!gs_preTranslateAndExit && !gs_importIntoTMAndExit && !gs_checkAndExit && !gs_manageTMAndExit &&
+        !gs_updateAndExit && gs_filesToDiff.empty() && !gs_analyzeLeverageAndExit && gs_benchmarkSuite.empty())
+        m_remoteServer.reset(new RemoteServer(this));
 #endif
 
     InitHiDPIHandling();
@@ -432,14 +484,12 @@ bool PoeditApp::OnInit()
     wxXmlResource::Get()->InitAllHandlers();
     wxXmlResource::Get()->AddHandler(new LearnMoreLinkXmlHandler);
 
-#if defined(__WXOSX__)
-    wxXmlResource::Get()->LoadAllFiles(wxStandardPaths::Get().GetResourcesDir());
-#elif defined(__WXMSW__)
+#ifdef __WXMSW__
     wxStandardPaths::Get().DontIgnoreAppSubDir();
-    wxXmlResource::Get()->LoadAllFiles(wxStandardPaths::Get().GetResourcesDir() + "\\Resources");
-#else
-    InitXmlResource();
 #endif
+    // the rest is loaded on demand by LoadXmlResources():
+    LoadXmlResources("menus.xrc");
+    LoadXmlResources("toolbar.xrc");
 
     SetDefaultCfg(wxConfig::Get());
 
@@ -453,6 +503,11 @@ bool PoeditApp::OnInit()
 
     SetupLanguage();
 
+    // the work is done in OnRun(), without creating any UI:
+    if (gs_preTranslateAndExit || gs_importIntoTMAndExit || gs_checkAndExit || gs_manageTMAndExit ||
+        gs_updateAndExit || !gs_filesToDiff.empty() || gs_analyzeLeverageAndExit || !gs_benchmarkSuite.empty())
+        return true;
+
 #ifdef __WXOSX__
     wxMenuBar *bar = wxXmlResource::Get()->LoadMenuBar("mainmenu_mac_global");
     TweakOSXMenuBar(bar);
@@ -517,9 +572,580 @@ bool PoeditApp::OnInit()
         return false;
 #endif
 
+    // don't delay showing the window, start after it was shown:
+    CallAfter(&InitializeInBackground);
+
     return true;
 }
 
+int PoeditApp::OnRun()
+{
+    if (gs_preTranslateAndExit)
+        return PreTranslateFilesAndExit(gs_filesToPreTranslate);
+
+    if (gs_importIntoTMAndExit)
+        return ImportIntoTMAndExit(gs_pathsToImportIntoTM);
+
+    if (gs_checkAndExit)
+        return CheckFilesAndExit(gs_filesToCheck, gs_compileMO);
+
+    if (gs_manageTMAndExit)
+        return ManageTMAndExit();
+
+    if (gs_updateAndExit)
+        return UpdateFilesAndExit(gs_filesToUpdate);
+
+    if (!gs_filesToDiff.empty())
+        return DiffFilesAndExit(gs_filesToDiff[0], gs_filesToDiff[1]);
+
+    if (gs_analyzeLeverageAndExit)
+        return AnalyzeLeverageAndExit(gs_filesToAnalyze);
+
+    if (!gs_benchmarkSuite.empty())
+    {
+        delete wxLog::SetActiveTarget(new wxLogStderr);
+        return RunBenchmarks(gs_benchmarkSuite, gs_benchmarkOptions);
+    }
+
+    return wxApp::OnRun();
+}
+
+
+int PoeditApp::PreTranslateFilesAndExit(const wxArrayString& files)
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    if (!Config::UseTM())
+    {
+        wxLogError(_("Translation memory is disabled in preferences."));
+        return 1;
+    }
+
+    int flags = 0;
+    auto settings = Config::PretranslateSettings();
+    if (settings.onlyExact)
+        flags |= PreTranslate_OnlyExact;
+    if (settings.exactNotFuzzy)
+        flags |= PreTranslate_ExactNotFuzzy;
+
+    struct FileResult
+    {
+        FileResult() : matches(0) {}
+        CatalogPtr catalog;
+        int matches;
+        wxString error;
+    };
+
+    // Loading and pre-translation are done for all files concurrently, all
+    // of them searching the same TM; saving is done here, one file at a time,
+    // because it may need to run msgfmt:
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    auto results = dispatch::parallel_transform(0, files.size(), [&files,flags](size_t i)
+    {
+        FileResult r;
+        try
+        {
+            auto cat = Catalog::Create(files[i]);
+            if (!cat || !cat->IsOk())
+                throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
+            PreTranslateCatalogHeadless(cat, flags, &r.matches);
+            r.catalog = cat;
+        }
+        catch (...)
+        {
+            r.error = DescribeCurrentException();
+        }
+        return r;
+    }, options);
+
+    int retval = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        auto& r = results[i];
+        if (r.catalog && r.matches > 0)
+        {
+            Catalog::ValidationResults validation_results;
+            Catalog::CompilationStatus mo_compilation_status = Catalog::CompilationStatus::NotDone;
+            if (!r.catalog->Save(files[i], true, validation_results, mo_compilation_status))
+                r.error = _("The file couldn't be saved.");
+        }
+
+        if (r.error.empty())
+        {
+            wxPrintf("%s: %s\n", files[i],
+                     wxString::Format(wxPLURAL("%d entry was pre-translated.",
+                                               "%d entries were pre-translated.",
+                                               r.matches), r.matches));
+        }
+        else
+        {
+            wxLogError("%s: %s", files[i], r.error);
+            retval = 1;
+        }
+    }
+
+    wxLog::FlushActive();
+    return retval;
+}
+
+
+int PoeditApp::ImportIntoTMAndExit(const wxArrayString& paths)
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    if (!Config::UseTM())
+    {
+        wxLogError(_("Translation memory is disabled in preferences."));
+        return 1;
+    }
+
+    std::vector<wxString> files;
+    for (auto& p: paths)
+    {
+        if (wxFileName::DirExists(p))
+        {
+            auto found = TranslationMemory::FindTranslationFiles(p);
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        else
+        {
+            files.push_back(p);
+        }
+    }
+
+    int retval = 0;
+    try
+    {
+        std::vector<wxString> failed;
+        auto imported = TranslationMemory::Get().ImportFiles(files, [&files](size_t done)
+        {
+            wxPrintf("\r%d/%d", (int)done, (int)files.size());
+            fflush(stdout);
+            return true;
+        },
+        &failed);
+        wxPrintf("\n");
+
+        for (auto& f: failed)
+        {
+            wxLogError("%s: %s", f, _("The file may be either corrupted or in a format not recognized by Poedit."));
+            retval = 1;
+        }
+
+        wxPrintf("%s\n", wxString::Format(wxPLURAL("Translations from %d file were imported.",
+                                                    "Translations from %d files were imported.",
+                                                    (int)imported), (int)imported));
+    }
+    catch (...)
+    {
+        wxLogError("%s", DescribeCurrentException());
+        retval = 1;
+    }
+
+    wxLog::FlushActive();
+    return retval;
+}
+
+
+namespace
+{
+
+// Validates a single file and possibly compiles it, describing the results
+// in JSON for consumption by scripts
+json CheckFileHeadless(const wxString& filename, bool compile)
+{
+    json r = { {"file", str::to_utf8(filename)} };
+
+    // errors are included in the output, don't print them too:
+    wxLogNull null;
+
+    try
+    {
+        auto cat = Catalog::Create(filename);
+        if (!cat || !cat->IsOk())
+            throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
+
+        Catalog::ValidationResults res;
+        auto mo = Catalog::CompilationStatus::NotDone;
+        auto po = std::dynamic_pointer_cast<POCatalog>(cat);
+        if (compile && po && po->HasCapability(Catalog::Cap::Translations))
+        {
+            wxFileName mofile(filename);
+            mofile.SetExt("mo");
+            po->CompileToMO(mofile.GetFullPath(), res, mo);
+        }
+        else
+        {
+            res = cat->Validate();
+        }
+
+        // QA checks are always done, even if disabled in the preferences, but
+        // only for items without errors, which take precedence:
+        if (!Config::ShowWarnings() && cat->HasCapability(Catalog::Cap::Translations))
+        {
+            auto qa = QAChecker::GetFor(*cat);
+            for (auto& item: cat->items())
+            {
+                if (!item->HasIssue())
+                    res.warnings += qa->Check(item);
+            }
+        }
+
+        auto issues = json::array();
+        for (auto& item: cat->items())
+        {
+            if (!item->HasIssue())
+                continue;
+            auto& issue = item->GetIssue();
+            issues.push_back({
+                {"line", item->GetLineNumber()},
+                {"severity", issue.severity == CatalogItem::Issue::Error ? "error" : "warning"},
+                {"message", str::to_utf8(issue.GetMessage())}
+            });
+        }
+
+        r["errors"] = res.errors;
+        r["warnings"] = res.warnings;
+        r["issues"] = issues;
+        if (compile)
+        {
+            switch (mo)
+            {
+                case Catalog::CompilationStatus::Success:
+                    r["mo"] = "success";
+                    break;
+                case Catalog::CompilationStatus::Error:
+                    r["mo"] = "error";
+                    break;
+                case Catalog::CompilationStatus::NotDone:
+                    r["mo"] = nullptr;
+                    break;
+            }
+        }
+    }
+    catch (...)
+    {
+        r["failure"] = str::to_utf8(DescribeCurrentException());
+    }
+
+    return r;
+}
+
+} // anonymous namespace
+
+
+int PoeditApp::CheckFilesAndExit(const wxArrayString& files, bool compile)
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    // All files are checked concurrently and the results printed in order,
+    // one JSON object per line:
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    auto results = dispatch::parallel_transform(0, files.size(), [&files,compile](size_t i)
+    {
+        return CheckFileHeadless(files[i], compile);
+    }, options);
+
+    int retval = 0;
+    for (auto& r: results)
+    {
+        if (r.count("failure") || r.value("errors", 0) > 0 || r.value("mo", std::string()) == "error")
+            retval = 1;
+        wxPrintf("%s\n", wxString::FromUTF8(r.dump()));
+    }
+
+    wxLog::FlushActive();
+    return retval;
+}
+
+
+int PoeditApp::DiffFilesAndExit(const wxString& oldFile, const wxString& newFile)
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    try
+    {
+        // both files are loaded concurrently:
+        auto load = [](const wxString& filename)
+        {
+            return dispatch::async([filename]
+            {
+                auto cat = Catalog::Create(filename);
+                if (!cat || !cat->IsOk())
+                    throw Exception(wxString::Format(_("The file %s may be either corrupted or in a format not recognized by Poedit."), filename));
+                return cat;
+            });
+        };
+        auto oldLoading = load(oldFile);
+        auto newLoading = load(newFile);
+        auto oldCat = oldLoading.get();
+        auto newCat = newLoading.get();
+
+        auto diff = CatalogDiff::Compute(*oldCat, *newCat);
+
+        auto describeItem = [](const CatalogItemPtr& item) -> json
+        {
+            if (!item)
+                return nullptr;
+            auto translations = json::array();
+            for (auto& t: item->GetTranslations())
+                translations.push_back(str::to_utf8(t));
+            return {
+                {"line", item->GetLineNumber()},
+                {"fuzzy", item->IsFuzzy()},
+                {"translations", translations}
+            };
+        };
+
+        static const std::pair<CatalogDiff::Change, const char*> changeNames[] =
+        {
+            { CatalogDiff::Added,              "added" },
+            { CatalogDiff::Removed,            "removed" },
+            { CatalogDiff::TranslationChanged, "translation" },
+            { CatalogDiff::FuzzyChanged,       "fuzzy" },
+            { CatalogDiff::FlagsChanged,       "flags" },
+            { CatalogDiff::CommentChanged,     "comment" },
+        };
+
+        auto entries = json::array();
+        for (auto& e: diff.entries())
+        {
+            auto& item = e.newItem ? e.newItem : e.oldItem;
+            auto changes = json::array();
+            for (auto& c: changeNames)
+            {
+                if (e.Has(c.first))
+                    changes.push_back(c.second);
+            }
+            json j = {
+                {"changes", changes},
+                {"msgid", item->GetStringUTF8()},
+                {"old", describeItem(e.oldItem)},
+                {"new", describeItem(e.newItem)}
+            };
+            if (item->HasContext())
+                j["msgctxt"] = item->GetContextUTF8();
+            entries.push_back(j);
+        }
+
+        json r = {
+            {"old", str::to_utf8(oldFile)},
+            {"new", str::to_utf8(newFile)},
+            {"added", diff.CountOf(CatalogDiff::Added)},
+            {"removed", diff.CountOf(CatalogDiff::Removed)},
+            {"changed", (int)diff.entries().size() - diff.CountOf(CatalogDiff::Added) - diff.CountOf(CatalogDiff::Removed)},
+            {"entries", entries}
+        };
+        wxPrintf("%s\n", wxString::FromUTF8(r.dump()));
+
+        wxLog::FlushActive();
+        // like diff(1), 1 means that the files differ:
+        return diff.empty() ? 0 : 1;
+    }
+    catch (...)
+    {
+        wxLogError("%s", DescribeCurrentException());
+        wxLog::FlushActive();
+        return 2;
+    }
+}
+
+
+int PoeditApp::AnalyzeLeverageAndExit(const wxArrayString& files)
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    auto describeCounts = [](const TMLeverage::Counts& c) -> json
+    {
+        return { {"strings", c.strings}, {"words", c.words} };
+    };
+
+    // Files are analyzed one by one, because the analysis itself uses all
+    // cores, and the results are printed as one JSON object per line:
+    int retval = 0;
+    for (auto& filename: files)
+    {
+        json r = { {"file", str::to_utf8(filename)} };
+        try
+        {
+            auto cat = Catalog::Create(filename);
+            if (!cat || !cat->IsOk())
+                throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
+            if (!cat->GetLanguage().IsValid())
+                throw Exception(_("The language of the file is unknown."));
+
+            auto leverage = TMLeverage::Compute(cat).get();
+
+            json bands = json::object();
+            for (int b = 0; b < TMLeverage::BandsCount; b++)
+                bands[TMLeverage::GetBandId(TMLeverage::Band(b))] = describeCounts(leverage.bands[b]);
+            r["bands"] = bands;
+            r["repetitions"] = describeCounts(leverage.repetitions);
+            r["total"] = describeCounts(leverage.GetTotal());
+        }
+        catch (...)
+        {
+            r["failure"] = str::to_utf8(DescribeCurrentException());
+            retval = 1;
+        }
+        wxPrintf("%s\n", wxString::FromUTF8(r.dump()));
+    }
+
+    wxLog::FlushActive();
+    return retval;
+}
+
+
+int PoeditApp::UpdateFilesAndExit(const wxArrayString& files)
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    std::vector<wxString> errors(files.size());
+    std::vector<POCatalogPtr> catalogs(files.size());
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    dispatch::parallel_for(0, files.size(), [&](size_t i)
+    {
+        try
+        {
+            auto cat = std::dynamic_pointer_cast<POCatalog>(Catalog::Create(files[i]));
+            if (!cat || !cat->IsOk())
+                throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
+            catalogs[i] = cat;
+        }
+        catch (...)
+        {
+            errors[i] = DescribeCurrentException();
+        }
+    }, options);
+
+    // files that failed to load are skipped:
+    std::vector<POCatalogPtr> loaded;
+    std::vector<size_t> loadedIndex;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (catalogs[i])
+        {
+            loaded.push_back(catalogs[i]);
+            loadedIndex.push_back(i);
+        }
+    }
+
+    std::vector<UpdateResultReason> reasons;
+    auto updated = PerformUpdateFromSourcesHeadless(loaded, reasons);
+    for (size_t l = 0; l < loaded.size(); l++)
+    {
+        const size_t i = loadedIndex[l];
+        if (updated[l])
+        {
+            Catalog::ValidationResults validation_results;
+            Catalog::CompilationStatus mo_compilation_status = Catalog::CompilationStatus::NotDone;
+            if (!loaded[l]->Save(files[i], true, validation_results, mo_compilation_status))
+                errors[i] = _("The file couldn't be saved.");
+            continue;
+        }
+
+        switch (reasons[l])
+        {
+            case UpdateResultReason::NoSourcesFound:
+                errors[i] = _("Source code not available.");
+                break;
+            case UpdateResultReason::PermissionDenied:
+                errors[i] = _("Permission denied.");
+                break;
+            case UpdateResultReason::CancelledByUser:
+            case UpdateResultReason::Unspecified:
+                errors[i] = _("Updating from sources failed.");
+                break;
+        }
+    }
+
+    int retval = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (errors[i].empty())
+        {
+            wxPrintf("%s: %s\n", files[i], _("Updated from sources."));
+        }
+        else
+        {
+            wxLogError("%s: %s", files[i], errors[i]);
+            retval = 1;
+        }
+    }
+
+    wxLog::FlushActive();
+    return retval;
+}
+
+
+int PoeditApp::ManageTMAndExit()
+{
+    delete wxLog::SetActiveTarget(new wxLogStderr);
+
+    int retval = 0;
+    try
+    {
+        auto& tm = TranslationMemory::Get();
+
+        // the operations are done in this order, so that e.g. importing
+        // and exporting in one go exports the imported data:
+        for (auto& p: gs_tmxToImport)
+        {
+            std::ifstream f;
+            f.open(p.fn_str(), std::ios::in | std::ios::binary);
+            if (!f.is_open())
+            {
+                wxLogError(_(L"Couldn’t open file %s."), p);
+                retval = 1;
+                continue;
+            }
+            wxPrintf("%s\n", wxString::Format(_(L"Importing translations from “%s”…"), p));
+            TMX::ImportFromFile(f, tm);
+        }
+
+        if (gs_tmCompact)
+        {
+            wxPrintf("%s\n", _(L"Compacting translation memory…"));
+            tm.Compact();
+        }
+
+        if (!gs_tmxToExport.empty())
+        {
+            std::ofstream f;
+            f.open(gs_tmxToExport.fn_str(), std::ios::out | std::ios::binary);
+            if (!f.is_open())
+                throw Exception(wxString::Format(_(L"Couldn’t save file %s."), gs_tmxToExport));
+            TMX::ExportToFile(tm, f);
+            f.close();
+            if (!f)
+                throw Exception(wxString::Format(_(L"Couldn’t save file %s."), gs_tmxToExport));
+        }
+
+        if (gs_tmStats)
+        {
+            // tab-separated, for easy processing by scripts:
+            for (auto& s: tm.GetLanguagePairStats())
+            {
+                wxPrintf("%s\t%s\t%ld\t%ld\t%ld\n",
+                         s.srclang.Code(), s.lang.Code(),
+                         s.numDocs, s.numDeletedDocs, s.fileSize);
+            }
+        }
+    }
+    catch (...)
+    {
+        wxLogError("%s", DescribeCurrentException());
+        retval = 1;
+    }
+
+    wxLog::FlushActive();
+    return retval;
+}
+
+
 int PoeditApp::OnExit()
 {
 #ifndef __WXOSX__
@@ -535,8 +1161,18 @@ int PoeditApp::OnExit()
     DeletePendingObjects();
 
     ColorScheme::CleanUp();
+    IconsCache::CleanUp();
 
+    // the TM can't be destroyed while it's still being initialized:
+    if (gs_backgroundInit.valid())
+        gs_backgroundInit.wait();
+
+    CompactTranslationMemory::CleanUp();
     TranslationMemory::CleanUp();
+    Glossary::CleanUp();
+#ifdef HAVE_HTTP_CLIENT
+    MachineTranslation::CleanUp();
+#endif
 
 #ifdef HAVE_HTTP_CLIENT
     CrowdinClient::CleanUp();
@@ -544,6 +1180,8 @@ int PoeditApp::OnExit()
 
     dispatch::cleanup();
 
+    Tracing::Finish();
+
 #ifdef USE_SPARKLE
     Sparkle_Cleanup();
 #endif // USE_SPARKLE
@@ -557,6 +1195,32 @@ int PoeditApp::OnExit()
 }
 
 
+void PoeditApp::LoadXmlResources(const wxString& file)
+{
+#if defined(__WXOSX__) || defined(__WXMSW__)
+    if (m_loadedXmlResources.Index(file) != wxNOT_FOUND)
+        return;
+    m_loadedXmlResources.push_back(file);
+
+  #ifdef __WXOSX__
+    const wxString dir = wxStandardPaths::Get().GetResourcesDir();
+  #else
+    const wxString dir = wxStandardPaths::Get().GetResourcesDir() + "\\Resources";
+  #endif
+    wxXmlResource::Get()->LoadFile(wxFileName(dir, file));
+#else
+    // All resources are compiled into the executable and are registered at
+    // once, which doesn't involve any I/O:
+    if (m_loadedXmlResources.empty())
+    {
+        InitXmlResource();
+        m_loadedXmlResources.push_back("*");
+    }
+    (void)file;
+#endif
+}
+
+
 static wxLayoutDirection g_layoutDirection = wxLayout_Default;
 
 void PoeditApp::SetupLanguage()
@@ -642,6 +1306,7 @@ void PoeditApp::OpenNewFile()
 void PoeditApp::OpenFiles(const wxArrayString& names, int lineno)
 {
     PoeditFrame *active = PoeditFrame::UnusedActiveWindow();
+    wxArrayString toCreate;
 
     for ( auto name: names )
     {
@@ -668,9 +1333,16 @@ void PoeditApp::OpenFiles(const wxArrayString& names, int lineno)
         }
         else
         {
-            PoeditFrame::Create(name, lineno);
+            toCreate.push_back(name);
         }
     }
+
+    // a single file is opened right away, as before; loading several of them
+    // at once is better done in parallel:
+    if (toCreate.size() == 1)
+        PoeditFrame::Create(toCreate[0], lineno);
+    else if (!toCreate.empty())
+        PoeditFrame::CreateInBackground(toCreate, lineno);
 }
 
 
@@ -698,8 +1370,22 @@ void PoeditApp::SetDefaultCfg(wxConfigBase *cfg)
 namespace
 {
 const char *CL_KEEP_TEMP_FILES = "keep-temp-files";
+const char *CL_TRACE = "trace";
 const char *CL_HANDLE_POEDIT_URI = "handle-poedit-uri";
 const char *CL_LINE = "line";
+const char *CL_PRETRANSLATE = "pretranslate";
+const char *CL_IMPORT_TM = "import-tm";
+const char *CL_VALIDATE = "validate";
+const char *CL_COMPILE_MO = "compile-mo";
+const char *CL_UPDATE = "update-from-sources";
+const char *CL_DIFF = "diff";
+const char *CL_TM_IMPORT = "tm-import";
+const char *CL_TM_EXPORT = "tm-export";
+const char *CL_TM_STATS = "tm-stats";
+const char *CL_TM_COMPACT = "tm-compact";
+const char *CL_TM_LEVERAGE = "tm-leverage";
+const char *CL_BENCHMARK = "benchmark";
+const char *CL_BENCHMARK_OPTIONS = "benchmark-options";
 }
 
 void PoeditApp::OnInitCmdLine(wxCmdLineParser& parser)
@@ -708,10 +1394,38 @@ void PoeditApp::OnInitCmdLine(wxCmdLineParser& parser)
 
     parser.AddSwitch("", CL_KEEP_TEMP_FILES,
                      _(L"don’t delete temporary files (for debugging)"));
+    parser.AddLongOption(CL_TRACE,
+                     _("write performance trace in Chrome's format to given file (for debugging)"), wxCMD_LINE_VAL_STRING);
     parser.AddLongOption(CL_HANDLE_POEDIT_URI,
                      _("handle a poedit:// URI"), wxCMD_LINE_VAL_STRING);
     parser.AddLongOption(CL_LINE,
                      _("go to item at given line number"), wxCMD_LINE_VAL_NUMBER);
+    parser.AddSwitch("", CL_PRETRANSLATE,
+                     _("pre-translate given files using the TM, save them and exit"));
+    parser.AddSwitch("", CL_IMPORT_TM,
+                     _("import translations from given files or folders into the TM and exit"));
+    parser.AddSwitch("", CL_VALIDATE,
+                     _("check given files for errors and QA issues, print the results as JSON and exit"));
+    parser.AddSwitch("", CL_COMPILE_MO,
+                     _("like --validate, but also compile the files into MO files"));
+    parser.AddSwitch("", CL_UPDATE,
+                     _("update given files from source code, save them and exit"));
+    parser.AddSwitch("", CL_DIFF,
+                     _("compare two given files, print the differences as JSON and exit"));
+    parser.AddLongOption(CL_TM_IMPORT,
+                     _("import given TMX file (and any other given files) into the TM and exit"), wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption(CL_TM_EXPORT,
+                     _("export the TM into given TMX file and exit"), wxCMD_LINE_VAL_STRING);
+    parser.AddSwitch("", CL_TM_STATS,
+                     _("print statistics of the TM's language pairs and exit"));
+    parser.AddSwitch("", CL_TM_COMPACT,
+                     _("remove superseded translations from the TM, compact it and exit"));
+    parser.AddSwitch("", CL_TM_LEVERAGE,
+                     _("analyze how much of given files the TM covers, print the results as JSON and exit"));
+    parser.AddLongOption(CL_BENCHMARK,
+                     _("run given performance benchmarks suite and exit (for debugging)"), wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption(CL_BENCHMARK_OPTIONS,
+                     _("options of the benchmarks, e.g. \"entries=50000,plurals=20\""), wxCMD_LINE_VAL_STRING);
     parser.AddParam("catalog.po", wxCMD_LINE_VAL_STRING,
                     wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE);
 }
@@ -728,6 +1442,162 @@ bool PoeditApp::OnCmdLineParsed(wxCmdLineParser& parser)
     if ( parser.Found(CL_KEEP_TEMP_FILES) )
         TempDirectory::KeepFiles();
 
+    wxString traceFile;
+    if (parser.Found(CL_TRACE, &traceFile))
+        Tracing::Enable(wxFileName(traceFile).GetAbsolutePath());
+
+    if (parser.Found(CL_BENCHMARK, &gs_benchmarkSuite))
+    {
+        // runs headless, without communicating with other instances:
+        parser.Found(CL_BENCHMARK_OPTIONS, &gs_benchmarkOptions);
+        return true;
+    }
+
+    if (parser.Found(CL_PRETRANSLATE))
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            wxLogError(_("No files to pre-translate were given."));
+            wxLog::FlushActive();
+            return false; // terminate program
+        }
+
+        // runs headless, without communicating with other instances:
+        gs_preTranslateAndExit = true;
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fn(parser.GetParam(i));
+            fn.MakeAbsolute();
+            gs_filesToPreTranslate.push_back(fn.GetFullPath());
+        }
+        return true;
+    }
+
+    if (parser.Found(CL_UPDATE))
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            wxLogError(_("No files to update were given."));
+            wxLog::FlushActive();
+            return false; // terminate program
+        }
+
+        // runs headless, without communicating with other instances:
+        gs_updateAndExit = true;
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fn(parser.GetParam(i));
+            fn.MakeAbsolute();
+            gs_filesToUpdate.push_back(fn.GetFullPath());
+        }
+        return true;
+    }
+
+    if (parser.Found(CL_DIFF))
+    {
+        if (parser.GetParamCount() != 2)
+        {
+            wxLogError(_("Exactly two files to compare must be given."));
+            wxLog::FlushActive();
+            return false; // terminate program
+        }
+
+        // runs headless, without communicating with other instances:
+        for (size_t i = 0; i < 2; i++)
+        {
+            wxFileName fn(parser.GetParam(i));
+            fn.MakeAbsolute();
+            gs_filesToDiff.push_back(fn.GetFullPath());
+        }
+        return true;
+    }
+
+    if (parser.Found(CL_TM_LEVERAGE))
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            wxLogError(_("No files to analyze were given."));
+            wxLog::FlushActive();
+            return false; // terminate program
+        }
+
+        // runs headless, without communicating with other instances:
+        gs_analyzeLeverageAndExit = true;
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fn(parser.GetParam(i));
+            fn.MakeAbsolute();
+            gs_filesToAnalyze.push_back(fn.GetFullPath());
+        }
+        return true;
+    }
+
+    wxString tmx;
+    if (parser.Found(CL_TM_IMPORT, &tmx) || parser.Found(CL_TM_EXPORT) ||
+        parser.Found(CL_TM_STATS) || parser.Found(CL_TM_COMPACT))
+    {
+        // runs headless, without communicating with other instances:
+        gs_manageTMAndExit = true;
+        auto absolute = [](const wxString& path)
+        {
+            wxFileName fn(path);
+            fn.MakeAbsolute();
+            return fn.GetFullPath();
+        };
+        if (!tmx.empty())
+        {
+            gs_tmxToImport.push_back(absolute(tmx));
+            for (size_t i = 0; i < parser.GetParamCount(); i++)
+                gs_tmxToImport.push_back(absolute(parser.GetParam(i)));
+        }
+        if (parser.Found(CL_TM_EXPORT, &gs_tmxToExport))
+            gs_tmxToExport = absolute(gs_tmxToExport);
+        gs_tmStats = parser.Found(CL_TM_STATS);
+        gs_tmCompact = parser.Found(CL_TM_COMPACT);
+        return true;
+    }
+
+    if (parser.Found(CL_VALIDATE) || parser.Found(CL_COMPILE_MO))
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            wxLogError(_("No files to check were given."));
+            wxLog::FlushActive();
+            return false; // terminate program
+        }
+
+        // runs headless, without communicating with other instances:
+        gs_checkAndExit = true;
+        gs_compileMO = parser.Found(CL_COMPILE_MO);
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fn(parser.GetParam(i));
+            fn.MakeAbsolute();
+            gs_filesToCheck.push_back(fn.GetFullPath());
+        }
+        return true;
+    }
+
+    if (parser.Found(CL_IMPORT_TM))
+    {
+        if (parser.GetParamCount() == 0)
+        {
+            wxLogError(_("No files to import were given."));
+            wxLog::FlushActive();
+            return false; // terminate program
+        }
+
+        // runs headless, without communicating with other instances:
+        gs_importIntoTMAndExit = true;
+        for (size_t i = 0; i < parser.GetParamCount(); i++)
+        {
+            wxFileName fn(parser.GetParam(i));
+            fn.MakeAbsolute();
+            gs_pathsToImportIntoTM.push_back(fn.GetFullPath());
+        }
+        return true;
+    }
+
 #ifndef __WXOSX__
     RemoteClient client(m_instanceChecker.get());
     switch (client.ConnectIfNeeded())
@@ -949,13 +1819,18 @@ void PoeditApp::OnOpenHist(wxCommandEvent& event)
     TRY_FORWARD_TO_ACTIVE_WINDOW( OnOpenHist(event) );
 
     wxString f(FileHistory().GetHistoryFile(event.GetId() - wxID_FILE1));
-    if ( !wxFileExists(f) )
-    {
-        wxLogError(_(L"File “%s” doesn’t exist."), f.c_str());
-        return;
-    }
 
-    OpenFiles(wxArrayString(1, &f));
+    // don't block the UI if the file is on an unresponsive network share:
+    dispatch::async([f]{ return wxFileExists(f); })
+    .then_on_main([=](bool exists)
+    {
+        if (!exists)
+        {
+            wxLogError(_(L"File “%s” doesn’t exist."), f.c_str());
+            return;
+        }
+        OpenFiles(wxArrayString(1, &f));
+    });
 }
 #endif // !__WXOSX__
 
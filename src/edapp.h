@@ -28,11 +28,13 @@
 #define _EDAPP_H_
 
 #include <wx/app.h>
+#include <wx/arrstr.h>
 #include <wx/string.h>
 #include <wx/intl.h>
 #include <wx/docview.h>
 
 #include "prefsdlg.h"
+#include "recent_files.h"
 
 class WXDLLIMPEXP_FWD_BASE wxConfigBase;
 class WXDLLIMPEXP_FWD_BASE wxSingleInstanceChecker;
@@ -50,6 +52,7 @@ class PoeditApp : public wxApp
             configuration entries to default values if they were missing.
          */
         virtual bool OnInit();
+        virtual int OnRun();
         virtual int OnExit();
 
         virtual wxLayoutDirection GetLayoutDirection() const;
@@ -66,7 +69,7 @@ class PoeditApp : public wxApp
         void OpenNewFile();
 
 #ifndef __WXOSX__
-        wxFileHistory& FileHistory() { return m_history; }
+        RecentFilesHistory& FileHistory() { return m_history; }
 #endif
 
 #ifdef __WXOSX__
@@ -77,6 +80,12 @@ class PoeditApp : public wxApp
 
         void EditPreferences();
 
+        /** Makes sure XRC resources from @a file (e.g. "summary.xrc") are
+            loaded. Only resources needed by the main window are loaded at
+            startup, call this before using any others.
+         */
+        void LoadXmlResources(const wxString& file);
+
         virtual bool OnExceptionInMainLoop();
 
         // Open page on poedit.net in the browser
@@ -108,6 +117,27 @@ class PoeditApp : public wxApp
 
         void SetupLanguage();
 
+        /// Implements --pretranslate, returns the process exit code
+        int PreTranslateFilesAndExit(const wxArrayString& files);
+
+        /// Implements --import-tm, returns the process exit code
+        int ImportIntoTMAndExit(const wxArrayString& paths);
+
+        /// Implements --validate and --compile-mo, returns the process exit code
+        int CheckFilesAndExit(const wxArrayString& files, bool compile);
+
+        /// Implements --tm-* operations, returns the process exit code
+        int ManageTMAndExit();
+
+        /// Implements --update-from-sources, returns the process exit code
+        int UpdateFilesAndExit(const wxArrayString& files);
+
+        /// Implements --diff, returns the process exit code
+        int DiffFilesAndExit(const wxString& oldFile, const wxString& newFile);
+
+        /// Implements --tm-leverage, returns the process exit code
+        int AnalyzeLeverageAndExit(const wxArrayString& files);
+
         // App-global menu commands:
         void OnNew(wxCommandEvent& event);
         void OnOpen(wxCommandEvent& event);
@@ -135,13 +165,15 @@ class PoeditApp : public wxApp
         class NativeMacAppData;
         std::unique_ptr<NativeMacAppData> m_nativeMacAppData;
 #else
-        wxFileHistory m_history;
+        RecentFilesHistory m_history;
 #endif
 
         std::unique_ptr<PoeditPreferencesEditor> m_preferences;
 
         std::unique_ptr<wxLocale> m_locale;
 
+        wxArrayString m_loadedXmlResources;
+
 #ifndef __WXOSX__
         class RemoteServer;
         class RemoteClient;
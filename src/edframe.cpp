@@ -65,6 +65,7 @@
 #include "configuration.h"
 #include "crowdin_gui.h"
 #include "customcontrols.h"
+#include "diagnostics.h"
 #include "edapp.h"
 #include "editing_area.h"
 #include "hidpi.h"
@@ -72,6 +73,7 @@
 #include "prefsdlg.h"
 #include "fileviewer.h"
 #include "findframe.h"
+#include "tm/suggestions.h"
 #include "tm/transmem.h"
 #include "language.h"
 #include "progressinfo.h"
@@ -218,6 +220,29 @@ private:
     int m_extraDraggableSpace;
 };
 
+// Loads the catalog, throwing if it isn't valid
+CatalogPtr LoadCatalogOrThrow(const wxString& filename)
+{
+    auto cat = Catalog::Create(filename);
+    if (!cat || !cat->IsOk())
+        throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
+    return cat;
+}
+
+// Must be called from a catch block
+void ShowOpenFileError(wxWindow *parent)
+{
+    wxMessageDialog dlg
+    (
+        parent,
+        _("The file cannot be opened."),
+        _("Invalid file"),
+        wxOK | wxICON_ERROR
+    );
+    dlg.SetExtendedMessage(DescribeCurrentException());
+    dlg.ShowModal();
+}
+
 } // anonymous namespace
 
 
@@ -232,8 +257,9 @@ const wxWindowID ID_POPUP_REFS   = ID_POEDIT_FIRST + 1*ID_POEDIT_STEP;
 const wxWindowID ID_POPUP_DUMMY  = ID_POEDIT_FIRST + 3*ID_POEDIT_STEP;
 const wxWindowID ID_BOOKMARK_GO  = ID_POEDIT_FIRST + 4*ID_POEDIT_STEP;
 const wxWindowID ID_BOOKMARK_SET = ID_POEDIT_FIRST + 5*ID_POEDIT_STEP;
+const wxWindowID ID_FILTER       = ID_POEDIT_FIRST + 6*ID_POEDIT_STEP;
 
-const wxWindowID ID_POEDIT_LAST  = ID_POEDIT_FIRST + 6*ID_POEDIT_STEP;
+const wxWindowID ID_POEDIT_LAST  = ID_POEDIT_FIRST + 7*ID_POEDIT_STEP;
 
 
 #ifdef __VISUALC__
@@ -286,44 +312,79 @@ bool g_focusToText = false;
     if (f)
     {
         f->Raise();
+        f->ShowWithInitialFocus(lineno);
+        return f;
     }
-    else
+
+    try
     {
-        // NB: duplicated in ReadCatalog()
-        try
-        {
-            auto cat = Catalog::Create(filename);
-            if (!cat || !cat->IsOk())
-                throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
+        return CreateWithCatalog(LoadCatalogOrThrow(filename), lineno);
+    }
+    catch (...)
+    {
+        ShowOpenFileError(nullptr);
+        return nullptr;
+    }
+}
 
-            f = new PoeditFrame();
-            f->Show(true);
-            f->ReadCatalog(cat);
-        }
-        catch (...)
+/*static*/ void PoeditFrame::CreateInBackground(const wxArrayString& filenames, int lineno)
+{
+    for (auto& filename: filenames)
+    {
+        PoeditFrame *f = PoeditFrame::Find(filename);
+        if (f)
         {
-            wxMessageDialog dlg
-            (
-                nullptr,
-                _("The file cannot be opened."),
-                _("Invalid file"),
-                wxOK | wxICON_ERROR
-            );
-            dlg.SetExtendedMessage(DescribeCurrentException());
-            dlg.ShowModal();
-            return nullptr;
+            f->Raise();
+            f->ShowWithInitialFocus(lineno);
+            continue;
         }
-    }
 
-    f->Show(true);
+        // Each file is parsed on the background executor,
+        // so that opening many files at once isn't limited by a single core
+        // and the frames of small files don't wait for the big ones:
+        dispatch::async([=]{ return LoadCatalogOrThrow(filename); })
+        .then_on_main([=](dispatch::future<CatalogPtr> cat)
+        {
+            try
+            {
+                CreateWithCatalog(cat.get(), lineno);
+            }
+            catch (...)
+            {
+                ShowOpenFileError(nullptr);
+            }
+        });
+    }
+}
 
-    // HACK: make sure this is called *after* the delayed call in PoeditListCtrl::CatalogChanged
-    if (f->m_list)
-        f->m_list->CallAfter([=]{ f->PlaceInitialFocus(lineno); });
+/*static*/ PoeditFrame *PoeditFrame::CreateWithCatalog(const CatalogPtr& catalog, int lineno)
+{
+    // the file may have been opened by the user while it was being loaded:
+    PoeditFrame *f = PoeditFrame::Find(catalog->GetFileName());
+    if (f)
+    {
+        f->Raise();
+    }
+    else
+    {
+        f = new PoeditFrame();
+        f->Show(true);
+        f->ReadCatalog(catalog);
+    }
 
+    f->ShowWithInitialFocus(lineno);
     return f;
 }
 
+void PoeditFrame::ShowWithInitialFocus(int lineno)
+{
+    Show(true);
+
+    // HACK: make sure this is called *after* the delayed call in PoeditListCtrl::CatalogChanged
+    if (m_list)
+        m_list->CallAfter([=]{ PlaceInitialFocus(lineno); });
+}
+
 /*static*/ PoeditFrame *PoeditFrame::CreateEmpty()
 {
     PoeditFrame *f = new PoeditFrame;
@@ -395,6 +456,7 @@ BEGIN_EVENT_TABLE(PoeditFrame, wxFrame)
    EVT_MENU           (XRCID("menu_find_prev"),   PoeditFrame::OnFindPrev)
    EVT_MENU           (XRCID("menu_comment"),     PoeditFrame::OnEditComment)
    EVT_BUTTON         (XRCID("menu_comment"),     PoeditFrame::OnEditComment)
+   EVT_MENU           (XRCID("show_diagnostics"), PoeditFrame::OnShowDiagnostics)
    EVT_MENU           (XRCID("go_done_and_next"),   PoeditFrame::OnDoneAndNext)
    EVT_MENU           (XRCID("go_prev"),            PoeditFrame::OnPrev)
    EVT_MENU           (XRCID("go_next"),            PoeditFrame::OnNext)
@@ -411,6 +473,7 @@ BEGIN_EVENT_TABLE(PoeditFrame, wxFrame)
                        PoeditFrame::OnGoToBookmark)
    EVT_MENU_RANGE     (ID_BOOKMARK_SET, ID_BOOKMARK_SET + 9,
                        PoeditFrame::OnSetBookmark)
+   EVT_MENU_RANGE     (ID_FILTER, ID_FILTER + 9, PoeditFrame::OnFilter)
    EVT_CLOSE          (                PoeditFrame::OnCloseWindow)
    EVT_SIZE           (PoeditFrame::OnSize)
 
@@ -520,8 +583,12 @@ PoeditFrame::PoeditFrame() :
     m_contentView(nullptr),
     m_catalog(nullptr),
     m_fileExistsOnDisk(false),
+    m_cloudSyncWatcher([=](int changes, int conflicts){ OnCloudSyncUpdate(changes, conflicts); }),
     m_list(nullptr),
     m_modified(false),
+    m_saveInProgress(false),
+    m_pendingUpdates(0),
+    m_textCountsReady(false),
     m_hasObsoleteItems(false),
     m_setSashPositionsWhenMaximized(false)
 {
@@ -538,6 +605,8 @@ PoeditFrame::PoeditFrame() :
                   "detected ID values conflict!" );
     wxRegisterId(ID_POEDIT_LAST);
 
+    Bind(wxEVT_IDLE, &PoeditFrame::OnIdle, this);
+
     wxConfigBase *cfg = wxConfig::Get();
 
     m_displayIDs = (bool)cfg->Read("display_lines", (long)false);
@@ -563,8 +632,16 @@ PoeditFrame::PoeditFrame() :
         m_menuForHistory = MenuBar->GetMenu(MenuBar->FindMenu(_("&File")));
         FileHistory().UseMenu(m_menuForHistory);
         FileHistory().AddFilesToMenu(m_menuForHistory);
+        Bind(wxEVT_MENU_OPEN, [=](wxMenuEvent& e)
+        {
+            // recent files may have become (un)available since the last check:
+            if (e.GetMenu() == m_menuForHistory)
+                FileHistory().RefreshInfo();
+            e.Skip();
+        });
 #endif
         AddBookmarksMenu(MenuBar->GetMenu(MenuBar->FindMenu(_("&Go"))));
+        AddFilterMenu(MenuBar->GetMenu(MenuBar->FindMenu(_("&View"))));
 #ifdef __WXOSX__
         wxGetApp().TweakOSXMenuBar(MenuBar);
 #endif
@@ -870,6 +947,7 @@ PoeditFrame::~PoeditFrame()
     // write all changes:
     cfg->Flush();
 
+    m_journal.SetCatalog(nullptr);
     m_catalog.reset();
     m_pendingHumanEditedItem.reset();
 
@@ -922,7 +1000,10 @@ void PoeditFrame::SetAccelerators()
         { wxACCEL_CTRL, WXK_NUMPAD_DOWN,        XRCID("go_next") },
 
         { wxACCEL_CTRL, WXK_RETURN,             XRCID("go_done_and_next") },
-        { wxACCEL_CTRL, WXK_NUMPAD_ENTER,       XRCID("go_done_and_next") }
+        { wxACCEL_CTRL, WXK_NUMPAD_ENTER,       XRCID("go_done_and_next") },
+
+        // hidden, for diagnosing performance problems:
+        { wxACCEL_CTRL | wxACCEL_ALT | wxACCEL_SHIFT, 'D', XRCID("show_diagnostics") }
     };
 
     wxAcceleratorTable accel(WXSIZEOF(entries), entries);
@@ -940,13 +1021,32 @@ void PoeditFrame::InitSpellchecker()
 
     Language lang = m_catalog->GetLanguage();
 
-    bool report_problem = false;
     bool enabled = m_catalog &&
                 #ifndef __WXMSW__ // language choice is automatic, per-keyboard on Windows
                    lang.IsValid() &&
                 #endif
-                   wxConfig::Get()->Read("enable_spellchecking",
-                                         (long)true);
+                   Config::Current()->enableSpellchecking;
+
+    if (!enabled)
+    {
+        DoInitSpellchecker(false, lang);
+        return;
+    }
+
+    // Loading the dictionary may take a while, so do it in the background and
+    // only enable spellchecking in the text controls once it's ready:
+    PreloadSpellcheckerDictionary(lang).then_on_window(this, [=]{
+        // ignore outdated requests if the language changed in the meantime:
+        if (!m_catalog || m_catalog->GetLanguage() != lang)
+            return;
+        DoInitSpellchecker(true, lang);
+    });
+}
+
+
+void PoeditFrame::DoInitSpellchecker(bool enabled, const Language& lang)
+{
+    bool report_problem = false;
     const bool enabledInitially = enabled;
 
 #ifdef __WXOSX__
@@ -1042,6 +1142,12 @@ bool PoeditFrame::NeedsToAskIfCanDiscardCurrentDoc() const
 template<typename TFunctor>
 void PoeditFrame::DoIfCanDiscardCurrentDoc(TFunctor completionHandler)
 {
+    if (m_saveInProgress)
+    {
+        DoAfterSaving([=]{ DoIfCanDiscardCurrentDoc(completionHandler); });
+        return;
+    }
+
     if ( !NeedsToAskIfCanDiscardCurrentDoc() )
     {
         completionHandler();
@@ -1117,6 +1223,14 @@ wxWindowPtr<wxMessageDialog> PoeditFrame::CreateAskAboutSavingDialog()
 
 void PoeditFrame::OnCloseWindow(wxCloseEvent& event)
 {
+    if (event.CanVeto() && m_saveInProgress)
+    {
+        // finish saving first, the user may continue editing meanwhile
+        event.Veto();
+        DoAfterSaving([=]{ Close(); });
+        return;
+    }
+
     if (event.CanVeto() && NeedsToAskIfCanDiscardCurrentDoc())
     {
 #ifdef __WXOSX__
@@ -1176,7 +1290,10 @@ void PoeditFrame::OnOpenFromCrowdin(wxCommandEvent&)
         CrowdinOpenFile(this, [=](wxString name){
             DoOpenFile(name);
             if (m_catalog)
+            {
                 m_catalog->AttachCloudSync(std::make_shared<CrowdinSyncDestination>());
+                m_cloudSyncWatcher.SetCatalog(m_catalog);
+            }
         });
     });
 }
@@ -1187,13 +1304,18 @@ void PoeditFrame::OnOpenFromCrowdin(wxCommandEvent&)
 void PoeditFrame::OnOpenHist(wxCommandEvent& event)
 {
     wxString f(FileHistory().GetHistoryFile(event.GetId() - wxID_FILE1));
-    if ( !wxFileExists(f) )
-    {
-        wxLogError(_(L"File “%s” doesn’t exist."), f.c_str());
-        return;
-    }
 
-    OpenFile(f);
+    // don't block the UI if the file is on an unresponsive network share:
+    dispatch::async([f]{ return wxFileExists(f); })
+    .then_on_window(this, [=](bool exists)
+    {
+        if (!exists)
+        {
+            wxLogError(_(L"File “%s” doesn’t exist."), f.c_str());
+            return;
+        }
+        OpenFile(f);
+    });
 }
 #endif // !__WXOSX__
 
@@ -1437,6 +1559,9 @@ void PoeditFrame::NewFromPOT(POCatalogPtr pot, Language language)
 
     m_catalog = catalog;
     m_pendingHumanEditedItem.reset();
+    m_sourcesWatcher.SetCatalog(nullptr);
+    m_cloudSyncWatcher.SetCatalog(nullptr);
+    m_journal.SetCatalog(m_catalog);
 
     m_fileExistsOnDisk = false;
     m_modified = true;
@@ -1506,6 +1631,9 @@ void PoeditFrame::NewFromScratch()
 
     m_catalog = catalog;
     m_pendingHumanEditedItem.reset();
+    m_sourcesWatcher.SetCatalog(nullptr);
+    m_cloudSyncWatcher.SetCatalog(nullptr);
+    m_journal.SetCatalog(m_catalog);
 
     m_fileExistsOnDisk = false;
     m_modified = true;
@@ -1549,7 +1677,9 @@ void PoeditFrame::EditCatalogProperties()
                     return;
 
                 dlg->TransferFrom(m_catalog);
+                m_sourcesWatcher.SetCatalog(std::dynamic_pointer_cast<POCatalog>(m_catalog));
                 m_modified = true;
+                m_validator.CatalogChanged(); // e.g. plural forms may have changed
                 RecreatePluralTextCtrls();
                 UpdateTitle();
                 UpdateMenu();
@@ -1577,6 +1707,7 @@ void PoeditFrame::EditCatalogProperties()
                 {
                     m_catalog->SetLanguage(dlg->GetLang());
                     m_modified = true;
+                    m_validator.CatalogChanged(); // QA checks are language-specific
                     RecreatePluralTextCtrls();
 
                     UpdateTextLanguage();
@@ -1603,6 +1734,7 @@ void PoeditFrame::EditCatalogPropertiesAndUpdateFromSources()
         {
             dlg->TransferFrom(m_catalog);
             m_modified = true;
+            m_validator.CatalogChanged(); // e.g. plural forms may have changed
             if (m_list)
                 RecreatePluralTextCtrls();
             UpdateTitle();
@@ -1629,6 +1761,9 @@ void PoeditFrame::UpdateAfterPreferencesChange()
     g_focusToText = (bool)wxConfig::Get()->Read("focus_to_text",
                                                  (long)false);
 
+    m_sourcesWatcher.SetCatalog(std::dynamic_pointer_cast<POCatalog>(m_catalog));
+    m_cloudSyncWatcher.SetCatalog(m_catalog);
+
     if (m_list)
     {
         SetCustomFonts();
@@ -1668,7 +1803,9 @@ bool PoeditFrame::UpdateCatalog(const wxString& pot_file)
     {
         if (cat->HasSourcesAvailable())
         {
-            succ = PerformUpdateFromSources(this, cat, reason);
+            std::vector<wxString> changedSources;
+            auto stagedPOT = m_sourcesWatcher.TakeStagedPOT(&changedSources);
+            succ = PerformUpdateFromSources(this, cat, reason, 0, stagedPOT, stagedPOT ? &changedSources : nullptr);
 
             locker.reset();
             EnsureAppropriateContentView();
@@ -1843,7 +1980,12 @@ void PoeditFrame::OnUpdateFromCrowdin(wxCommandEvent&)
 {
     DoIfCanDiscardCurrentDoc([=]{
         CrowdinSyncFile(this, m_catalog, [=](std::shared_ptr<Catalog> cat){
+            if (cat == m_catalog)
+                return; // unchanged on Crowdin, nothing to reload
             m_catalog = cat;
+            m_sourcesWatcher.SetCatalog(std::dynamic_pointer_cast<POCatalog>(m_catalog));
+            m_cloudSyncWatcher.SetCatalog(m_catalog);
+            m_journal.SetCatalog(m_catalog);
             EnsureAppropriateContentView();
             NotifyCatalogChanged(m_catalog);
             RefreshControls();
@@ -2011,6 +2153,9 @@ void PoeditFrame::OnListSel(wxDataViewEvent& event)
     if (m_pendingHumanEditedItem)
     {
         OnNewTranslationEntered(m_pendingHumanEditedItem);
+        m_validator.ItemChanged(m_pendingHumanEditedItem);
+        m_journal.ItemChanged(*m_pendingHumanEditedItem);
+        m_catalog->ItemTranslationChanged(*m_pendingHumanEditedItem);
         m_pendingHumanEditedItem.reset();
     }
 
@@ -2027,9 +2172,23 @@ void PoeditFrame::OnListSel(wxDataViewEvent& event)
     if (m_sidebar)
     {
         if (multipleSel)
+        {
             m_sidebar->SetMultipleSelection();
+        }
         else
+        {
+            // let the sidebar prepare suggestions for the items that follow:
+            std::vector<CatalogItemPtr> upcoming;
+            if (m_list)
+            {
+                const int count = m_list->GetItemCount();
+                const int current = m_list->GetCurrentItemListIndex();
+                for (int i = current + 1; current >= 0 && i < count && (int)upcoming.size() < Sidebar::UPCOMING_ITEMS_COUNT; i++)
+                    upcoming.push_back(m_list->ListIndexToCatalogItem(i));
+            }
+            m_sidebar->SetUpcomingItems(upcoming);
             m_sidebar->SetSelectedItem(m_catalog, GetCurrentItem()); // may be nullptr
+        }
     }
 
     if (hasTextFocus)
@@ -2091,13 +2250,19 @@ void PoeditFrame::OnFuzzyFlag(wxCommandEvent&)
             modified = true;
         }
     });
+    for (auto& i: m_list->GetSelectedCatalogItems())
+    {
+        m_validator.ItemChanged(i);
+        m_journal.ItemChanged(*i);
+        m_catalog->ItemTranslationChanged(*i);
+    }
 
     if (modified && !IsModified())
     {
         m_modified = true;
-        UpdateTitle();
+        ScheduleUpdate(Update_Title);
     }
-    UpdateStatusBar();
+    ScheduleUpdate(Update_StatusBar);
 
     UpdateToTextCtrl(EditingArea::UndoableEdit | EditingArea::DontTouchText);
 
@@ -2166,13 +2331,19 @@ void PoeditFrame::OnCopyFromSource(wxCommandEvent&)
         if (item.IsModified())
             modified = true;
     });
+    for (auto& i: m_list->GetSelectedCatalogItems())
+    {
+        m_validator.ItemChanged(i);
+        m_journal.ItemChanged(*i);
+        m_catalog->ItemTranslationChanged(*i);
+    }
 
     if (modified && !IsModified())
     {
         m_modified = true;
-        UpdateTitle();
+        ScheduleUpdate(Update_Title);
     }
-    UpdateStatusBar();
+    ScheduleUpdate(Update_StatusBar);
 
     UpdateToTextCtrl(EditingArea::UndoableEdit);
 }
@@ -2186,13 +2357,19 @@ void PoeditFrame::OnClearTranslation(wxCommandEvent&)
         if (item.IsModified())
             modified = true;
     });
+    for (auto& i: m_list->GetSelectedCatalogItems())
+    {
+        m_validator.ItemChanged(i);
+        m_journal.ItemChanged(*i);
+        m_catalog->ItemTranslationChanged(*i);
+    }
 
     if (modified && !IsModified())
     {
         m_modified = true;
-        UpdateTitle();
+        ScheduleUpdate(Update_Title);
     }
-    UpdateStatusBar();
+    ScheduleUpdate(Update_StatusBar);
 
     UpdateToTextCtrl(EditingArea::UndoableEdit);
 }
@@ -2245,21 +2422,67 @@ void PoeditFrame::OnUpdatedFromTextCtrl(CatalogItemPtr item, bool statsChanged)
     GetMenuBar()->Check(XRCID("menu_fuzzy"), item->IsFuzzy());
 
     m_pendingHumanEditedItem = item;
+    m_journal.ItemChanged(*item);
+    m_catalog->ItemTranslationChanged(*item);
 
     if (statsChanged)
     {
-        UpdateStatusBar();
+        ScheduleUpdate(Update_StatusBar);
     }
     // else: no point in recomputing stats
 
     if (!IsModified())
     {
         m_modified = true;
-        UpdateTitle();
+        ScheduleUpdate(Update_Title);
     }
 }
 
 
+void PoeditFrame::OnCloudSyncUpdate(int changes, int conflicts)
+{
+    if (!m_catalog || !m_catalog->GetCloudSync())
+        return;
+
+    AttentionMessage msg
+    (
+        "cloud-sync-update",
+        AttentionMessage::Info,
+        wxString::Format
+        (
+            // TRANSLATORS: %s is the name of the service, e.g. "Crowdin"
+            wxPLURAL("%d translation was updated on %s.",
+                     "%d translations were updated on %s.",
+                     changes),
+            changes, m_catalog->GetCloudSync()->GetName()
+        )
+    );
+    if (conflicts)
+    {
+        msg.SetExplanation(wxString::Format
+        (
+            wxPLURAL("%d entry was changed both here and remotely; your version of it is kept.",
+                     "%d entries were changed both here and remotely; your versions of them are kept.",
+                     conflicts),
+            conflicts
+        ));
+    }
+    msg.AddAction(_("Apply"), [=]{
+        if (!m_cloudSyncWatcher.ApplyUpdate())
+            return;
+        m_journal.CatalogModified();
+        m_catalog->InvalidateTranslationIndex();
+        if (!m_modified)
+        {
+            m_modified = true;
+            UpdateTitle();
+        }
+        RefreshControls();
+    });
+    m_attentionBar->ShowMessage(msg);
+}
+
+
 void PoeditFrame::OnNewTranslationEntered(const CatalogItemPtr& item)
 {
     if (item->IsFuzzy() || !item->IsTranslated())
@@ -2267,24 +2490,17 @@ void PoeditFrame::OnNewTranslationEntered(const CatalogItemPtr& item)
 
     if (Config::UseTM())
     {
-        auto srclang = m_catalog->GetSourceLanguage();
-        auto lang = m_catalog->GetLanguage();
-        dispatch::async([=](){
-            try
-            {
-                auto tm = TranslationMemory::Get().GetWriter();
-                tm->Insert(srclang, lang, item);
-                // Note: do *not* call tm->Commit() here, because Lucene commit is
-                // expensive. Instead, wait until the file is saved with committing
-                // the changes. This way TM updates are available immediately for use
-                // in further translations within the file, but per-item updates
-                // remain inexpensive.
-            }
-            catch (const Exception&)
-            {
-                // ignore failures here, they'll become apparent when saving the file
-            }
-        });
+        try
+        {
+            // The TM is updated in the background and the (expensive) Lucene
+            // commit is done only after a while, so this is inexpensive and
+            // still makes the translation available for use within the file.
+            TranslationMemory::Get().InsertLater(m_catalog->GetSourceLanguage(), m_catalog->GetLanguage(), item);
+        }
+        catch (const Exception&)
+        {
+            // ignore failures here, the TM isn't available
+        }
     }
 }
 
@@ -2308,26 +2524,13 @@ void PoeditFrame::ReadCatalog(const wxString& catalog)
 {
     wxBusyCursor bcur;
 
-    // NB: duplicated in PoeditFrame::Create()
     try
     {
-        auto cat = Catalog::Create(catalog);
-        if (!cat || !cat->IsOk())
-            throw Exception(_("The file may be either corrupted or in a format not recognized by Poedit."));
-
-        ReadCatalog(cat);
+        ReadCatalog(LoadCatalogOrThrow(catalog));
     }
     catch (...)
     {
-        wxMessageDialog dlg
-        (
-            this,
-            _("The file cannot be opened."),
-            _("Invalid file"),
-            wxOK | wxICON_ERROR
-        );
-        dlg.SetExtendedMessage(DescribeCurrentException());
-        dlg.ShowModal();
+        ShowOpenFileError(this);
     }
 }
 
@@ -2336,18 +2539,30 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
 {
     wxASSERT( cat && cat->IsOk() );
 
+    int recovered = 0;
+
     {
 #ifdef __WXMSW__
         wxWindowUpdateLocker no_updates(this);
 #endif
-        {
-            wxLogNull null;  // don't report non-item warnings
-            cat->Validate(/*wasJustLoaded:*/true);
-        }
+        // the current document, if any, was closed without saving its edits:
+        m_journal.SetCatalog(nullptr);
 
         m_catalog = cat;
         m_pendingHumanEditedItem.reset();
 
+        // recover unsaved edits if Poedit crashed while editing the file:
+        recovered = EditJournal::Recover(*m_catalog);
+        m_journal.SetCatalog(m_catalog);
+
+        // The catalog is shown right away and validated in batches when idle,
+        // with issues appearing in the list as they are found:
+        m_validator.SetCatalog(m_catalog);
+        m_validator.CatalogChanged();
+
+        m_sourcesWatcher.SetCatalog(std::dynamic_pointer_cast<POCatalog>(m_catalog));
+        m_cloudSyncWatcher.SetCatalog(m_catalog);
+
         if (m_catalog->empty())
         {
             EnsureContentView(Content::Empty_PO);
@@ -2363,7 +2578,7 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
         }
 
         m_fileExistsOnDisk = true;
-        m_modified = false;
+        m_modified = recovered > 0;
 
         RecreatePluralTextCtrls();
         RefreshControls(Refresh_NoCatalogChanged /*done right above*/);
@@ -2373,7 +2588,32 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
         NoteAsRecentFile();
 
         if (cat->HasCapability(Catalog::Cap::Translations))
+        {
             WarnAboutLanguageIssues();
+            WarmUpTM();
+        }
+
+        if (recovered)
+        {
+            AttentionMessage msg
+            (
+                "recovered-edits",
+                AttentionMessage::Info,
+                wxString::Format
+                (
+                    wxPLURAL("%d unsaved translation from a previous session was recovered.",
+                             "%d unsaved translations from a previous session were recovered.",
+                             recovered),
+                    recovered
+                )
+            );
+            const wxString filename = m_catalog->GetFileName();
+            msg.AddAction(_("Discard"), [=]{
+                // the journal is removed when the current catalog is replaced:
+                ReadCatalog(filename);
+            });
+            m_attentionBar->ShowMessage(msg);
+        }
     }
 
     // Can't do this with the window being frozen, because positioning the toolbar
@@ -2385,6 +2625,48 @@ void PoeditFrame::ReadCatalog(const CatalogPtr& cat)
     FixDuplicatesIfPresent();
 }
 
+void PoeditFrame::WarmUpTM()
+{
+    // How many items at the top of the list to prefetch suggestions for;
+    // the sidebar prefetches items following the selected one on its own
+    static const int WARMUP_ITEMS = 10;
+
+    if (!Config::UseTM() || !m_list)
+        return;
+
+    const auto srclang = m_catalog->GetSourceLanguage();
+    const auto lang = m_catalog->GetLanguage();
+    if (!srclang.IsValid() || !lang.IsValid() || srclang == lang)
+        return;
+
+    std::vector<std::wstring> sources;
+    const int count = std::min(m_list->GetItemCount(), WARMUP_ITEMS);
+    for (int i = 0; i < count; i++)
+        sources.push_back(m_list->ListIndexToCatalogItem(i)->GetString().ToStdWstring());
+
+    dispatch::async(dispatch::priority::bulk, [=]
+    {
+        try
+        {
+            if (!Config::UseCompactTM())
+                TranslationMemory::Get().Warmup(srclang, lang);
+
+            // The results end up in SuggestionsCache, where the sidebar finds them:
+            auto backend = SuggestionsBackendRegistry::Get(Suggestion::Source::LocalTM);
+            if (!backend)
+                return;
+            SuggestionsProvider provider;
+            for (auto& s: sources)
+                provider.SuggestTranslation(*backend, {srclang, lang, s}, dispatch::cancellation_token(), dispatch::priority::bulk);
+        }
+        catch (...)
+        {
+            // TM errors are reported when suggestions are shown
+        }
+    });
+}
+
+
 void PoeditFrame::FixDuplicatesIfPresent()
 {
     auto cat = std::dynamic_pointer_cast<POCatalog>(m_catalog);
@@ -2547,10 +2829,34 @@ void PoeditFrame::NoteAsRecentFile()
 }
 
 
-void PoeditFrame::MarkAsModified()
+void PoeditFrame::MarkAsModified(bool statsChanged)
 {
+    m_journal.CatalogModified();
+    m_catalog->InvalidateTranslationIndex();
     m_modified = true;
-    UpdateTitle();
+    ScheduleUpdate(statsChanged ? Update_Title | Update_StatusBar : Update_Title);
+}
+
+
+void PoeditFrame::ScheduleUpdate(int what)
+{
+    if (!m_pendingUpdates)
+        wxWakeUpIdle();
+    m_pendingUpdates |= what;
+}
+
+
+void PoeditFrame::PerformPendingUpdates()
+{
+    // the Update*() functions clear their bits themselves:
+    const int what = m_pendingUpdates;
+    if (what & Update_Title)
+        UpdateTitle();
+    if (what & Update_Menu)
+        UpdateMenu();
+    if (what & Update_StatusBar)
+        UpdateStatusBar();
+    m_pendingUpdates = 0;
 }
 
 
@@ -2566,6 +2872,7 @@ void PoeditFrame::RefreshControls(int flags)
         m_fileExistsOnDisk = false;
         UpdateMenu();
         UpdateTitle();
+        m_journal.SetCatalog(nullptr);
         m_catalog.reset();
         m_pendingHumanEditedItem.reset();
         NotifyCatalogChanged(nullptr);
@@ -2575,6 +2882,8 @@ void PoeditFrame::RefreshControls(int flags)
     wxBusyCursor bcur;
     UpdateMenu();
 
+    m_validator.SetCatalog(m_catalog);
+
     if (m_list)
     {
         // update catalog view, this may involve reordering the items...
@@ -2602,12 +2911,43 @@ void PoeditFrame::NotifyCatalogChanged(const CatalogPtr& cat)
 
 void PoeditFrame::UpdateStatusBar()
 {
+    m_pendingUpdates &= ~Update_StatusBar;
+
     auto bar = GetStatusBar();
     if (m_catalog && bar)
     {
         int all, fuzzy, untranslated, errors, unfinished;
         m_catalog->GetStatistics(&all, &fuzzy, &errors, &untranslated, &unfinished);
 
+        // Word counts are only shown after the catalog's texts were counted
+        // in the background, because doing it for the first time is slow for
+        // big files; after that, only changed items are counted again:
+        if (m_textCountsCatalog.lock() != m_catalog)
+        {
+            m_textCountsCatalog = m_catalog;
+            m_textCountsReady = false;
+            auto catalog = m_catalog;
+            dispatch::async(dispatch::priority::bulk, [catalog]{ catalog->PrecomputeTextCounts(); })
+            .then_on_window(this, [=]{
+                if (catalog != m_catalog)
+                    return;
+                m_textCountsReady = true;
+                UpdateStatusBar();
+            });
+        }
+        int words = -1;
+        if (m_textCountsReady)
+        {
+            auto textStats = m_catalog->GetTextStatistics();
+            words = int(m_catalog->HasCapability(Catalog::Cap::Translations) ? textStats.unfinished.words : textStats.all.words);
+        }
+        auto wordsSuffix = [words]() -> wxString
+        {
+            if (words < 0)
+                return wxString();
+            return " (" + wxString::Format(wxPLURAL("%d word", "%d words", words), words) + ")";
+        };
+
         wxString text;
         if (m_catalog->HasCapability(Catalog::Cap::Translations))
         {
@@ -2618,6 +2958,7 @@ void PoeditFrame::UpdateStatusBar()
             {
                 text += L"  •  ";
                 text += wxString::Format(_("Remaining: %d"), unfinished);
+                text += wordsSuffix();
             }
             if (errors > 0)
             {
@@ -2628,6 +2969,7 @@ void PoeditFrame::UpdateStatusBar()
         else
         {
             text.Printf(wxPLURAL("%d entry", "%d entries", all), all);
+            text += wordsSuffix();
         }
 
         bar->SetStatusText(text);
@@ -2637,6 +2979,8 @@ void PoeditFrame::UpdateStatusBar()
 
 void PoeditFrame::UpdateTitle()
 {
+    m_pendingUpdates &= ~Update_Title;
+
 #ifdef __WXOSX__
     OSXSetModified(IsModified());
 #endif
@@ -2690,6 +3034,8 @@ void PoeditFrame::UpdateTitle()
 
 void PoeditFrame::UpdateMenu()
 {
+    m_pendingUpdates &= ~Update_Menu;
+
     wxMenuBar *menubar = GetMenuBar();
 
     const bool hasCatalog = m_catalog != nullptr;
@@ -2716,6 +3062,9 @@ void PoeditFrame::UpdateMenu()
     menubar->Enable(XRCID("sort_untrans_first"), editable);
     menubar->Enable(XRCID("sort_errors_first"), editable);
 
+    for (int i = 0; i <= (int)PoeditListCtrl::Filter::Issues; i++)
+        menubar->Enable(ID_FILTER + i, editable);
+
     if (m_list)
         m_list->Enable(nonEmpty);
 
@@ -2732,6 +3081,30 @@ void PoeditFrame::UpdateMenu()
 }
 
 
+namespace
+{
+
+// Queues the catalog's translations for storing in the TM. That is done in
+// the background and doesn't have to be waited for when saving.
+void UpdateTMInBackground(const CatalogPtr& cat)
+{
+    try
+    {
+        TranslationMemory::Get().InsertLater(cat);
+    }
+    catch ( const Exception& e )
+    {
+        wxLogWarning(_("Failed to update translation memory: %s"), e.What());
+    }
+    catch ( ... )
+    {
+        wxLogWarning(_("Failed to update translation memory: %s"), "unknown error");
+    }
+}
+
+} // anonymous namespace
+
+
 void PoeditFrame::WriteCatalog(const wxString& catalog)
 {
     WriteCatalog(catalog, [](bool){});
@@ -2740,27 +3113,12 @@ void PoeditFrame::WriteCatalog(const wxString& catalog)
 template<typename TFunctor>
 void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandler)
 {
-    wxBusyCursor bcur;
-
-    dispatch::future<void> tmUpdateThread;
-    if (Config::UseTM() && m_catalog->HasCapability(Catalog::Cap::Translations))
+    if (m_saveInProgress)
     {
-        tmUpdateThread = dispatch::async([=]{
-            try
-            {
-                auto tm = TranslationMemory::Get().GetWriter();
-                tm->Insert(m_catalog);
-                tm->Commit();
-            }
-            catch ( const Exception& e )
-            {
-                wxLogWarning(_("Failed to update translation memory: %s"), e.What());
-            }
-            catch ( ... )
-            {
-                wxLogWarning(_("Failed to update translation memory: %s"), "unknown error");
-            }
-        });
+        // save again once the current save finishes, the file may have
+        // been modified in the meantime:
+        DoAfterSaving([=]{ WriteCatalog(catalog, completionHandler); });
+        return;
     }
 
     if (m_catalog->GetFileType() == Catalog::Type::PO)
@@ -2770,19 +3128,106 @@ void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandl
         dt.TranslatorEmail = wxConfig::Get()->Read("translator_email", dt.TranslatorEmail);
     }
 
+    m_journal.SaveStarted();
+
+    auto po = std::dynamic_pointer_cast<POCatalog>(m_catalog);
+    if (po)
+    {
+        WriteCatalogInBackground(po, catalog, completionHandler);
+        return;
+    }
+
+    wxBusyCursor bcur;
+
+    if (Config::UseTM() && m_catalog->HasCapability(Catalog::Cap::Translations))
+        UpdateTMInBackground(m_catalog);
+
     Catalog::ValidationResults validation_results;
     Catalog::CompilationStatus mo_compilation_status = Catalog::CompilationStatus::NotDone;
     if ( !m_catalog->Save(catalog, true, validation_results, mo_compilation_status) )
     {
-        if (tmUpdateThread.valid())
-            tmUpdateThread.wait();
         completionHandler(false);
         return;
     }
 
     m_catalog->SetFileName(catalog);
     m_modified = false;
+
+    OnCatalogWritten(validation_results, mo_compilation_status, completionHandler);
+}
+
+
+template<typename TFunctor>
+void PoeditFrame::WriteCatalogInBackground(const POCatalogPtr& po, const wxString& catalog, TFunctor completionHandler)
+{
+    struct SaveResult
+    {
+        bool ok = false;
+        Catalog::ValidationResults validation_results;
+        Catalog::CompilationStatus mo_compilation_status = Catalog::CompilationStatus::NotDone;
+    };
+
+    // The snapshot is independent of the catalog being edited, so the user
+    // can continue to work while it is saved. Any edits done in the meantime
+    // mark the document as modified again.
+    auto snapshot = std::static_pointer_cast<POCatalog>(po->CreateSnapshot());
+    const bool updateTM = Config::UseTM() && snapshot->HasCapability(Catalog::Cap::Translations);
+
+    m_saveInProgress = true;
+    m_modified = false;
+    UpdateTitle();
+
+    dispatch::async([snapshot, catalog, updateTM]
+    {
+        if (updateTM)
+            UpdateTMInBackground(snapshot);
+
+        SaveResult r;
+        try
+        {
+            r.ok = snapshot->Save(catalog, true, r.validation_results, r.mo_compilation_status);
+        }
+        catch (...)
+        {
+            wxLogError("%s", DescribeCurrentException());
+        }
+
+        return r;
+    })
+    .then_on_window(this, [=](SaveResult r)
+    {
+        m_saveInProgress = false;
+
+        if (!r.ok)
+        {
+            m_modified = true;
+            UpdateTitle();
+            completionHandler(false);
+        }
+        else
+        {
+            po->AdoptSavedSnapshot(*snapshot);
+            OnCatalogWritten(r.validation_results, r.mo_compilation_status, completionHandler);
+        }
+
+        auto actions = std::move(m_afterSaveActions);
+        m_afterSaveActions.clear();
+        for (auto& a: actions)
+            a();
+    });
+}
+
+
+template<typename TFunctor>
+void PoeditFrame::OnCatalogWritten(const Catalog::ValidationResults& validation_results,
+                                   Catalog::CompilationStatus mo_compilation_status,
+                                   TFunctor completionHandler)
+{
     m_fileExistsOnDisk = true;
+    m_journal.CatalogSaved();
+
+    // sources location is relative to the file, which may have moved:
+    m_sourcesWatcher.SetCatalog(std::dynamic_pointer_cast<POCatalog>(m_catalog));
 
 #ifndef __WXOSX__
     FileHistory().AddFileToHistory(GetFileName());
@@ -2799,12 +3244,10 @@ void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandl
 
     if (m_catalog->GetCloudSync())
     {
-        CloudSyncProgressWindow::RunSync(this, m_catalog->GetCloudSync(), m_catalog);
+        if (CloudSyncProgressWindow::RunSync(this, m_catalog->GetCloudSync(), m_catalog))
+            m_cloudSyncWatcher.CatalogSynced();
     }
 
-    if (tmUpdateThread.valid())
-        tmUpdateThread.wait();
-
     if (m_list && m_list->sortOrder().errorsFirst)
         m_list->Sort();
 
@@ -2826,6 +3269,23 @@ void PoeditFrame::WriteCatalog(const wxString& catalog, TFunctor completionHandl
 }
 
 
+void PoeditFrame::DoAfterSaving(std::function<void()> action)
+{
+    if (m_saveInProgress)
+        m_afterSaveActions.push_back(action);
+    else
+        action();
+}
+
+
+void PoeditFrame::OnShowDiagnostics(wxCommandEvent&)
+{
+    auto win = DiagnosticsWindow::GetAndActivate();
+    if (m_catalog)
+        win->SetCatalog(m_catalog);
+}
+
+
 void PoeditFrame::OnEditComment(wxCommandEvent& event)
 {
     auto firstItem = GetCurrentItem();
@@ -2906,6 +3366,9 @@ void PoeditFrame::OnSuggestion(wxCommandEvent& event)
     entry->SetTranslation(event.GetString());
     entry->SetFuzzy(false);
     entry->SetModified(true);
+    m_validator.ItemChanged(entry);
+    m_journal.ItemChanged(*entry);
+    m_catalog->ItemTranslationChanged(*entry);
 
     // FIXME: instead of this mess, use notifications of catalog change
     m_modified = true;
@@ -2920,6 +3383,8 @@ void PoeditFrame::OnSuggestion(wxCommandEvent& event)
 void PoeditFrame::OnPreTranslateAll(wxCommandEvent&)
 {
     PreTranslateWithUI(this, m_list, m_catalog,[=]{
+        m_journal.CatalogModified();
+        m_catalog->InvalidateTranslationIndex();
         if (!m_modified)
         {
             m_modified = true;
@@ -3075,6 +3540,42 @@ void PoeditFrame::RecreatePluralTextCtrls()
     UpdateToTextCtrl(EditingArea::ItemChanged);
 }
 
+void PoeditFrame::OnIdle(wxIdleEvent& event)
+{
+    event.Skip();
+
+    if (m_catalog && m_validator.HasPendingWork())
+    {
+        auto result = m_validator.ProcessPending();
+
+        if (m_list)
+        {
+            m_list->RefreshCatalogItems(result.batchBegin, result.batchEnd);
+            for (auto& i: result.items)
+                m_list->RefreshItem(m_list->CatalogIndexToListItem(i->GetId() - 1));
+
+            // issues are only known now, e.g. for a just opened catalog:
+            if (result.fullValidation && m_list->sortOrder().errorsFirst)
+                m_list->Sort();
+        }
+
+        auto current = GetCurrentItem();
+        if (current && m_editingArea && m_list && m_list->HasSingleSelection())
+            m_editingArea->UpdateToTextCtrl(current, EditingArea::DontTouchText);
+
+        m_pendingUpdates |= Update_StatusBar;
+
+        // keep validating large catalogs in batches:
+        if (m_validator.HasPendingWork())
+            event.RequestMore();
+    }
+
+    // done once for all changes made since the last idle time:
+    if (m_pendingUpdates)
+        PerformPendingUpdates();
+}
+
+
 void PoeditFrame::OnListRightClick(wxDataViewEvent& event)
 {
     auto item = event.GetItem();
@@ -3207,6 +3708,33 @@ void PoeditFrame::OnSetBookmark(wxCommandEvent& event)
 }
 
 
+void PoeditFrame::AddFilterMenu(wxMenu *parent)
+{
+    typedef PoeditListCtrl::Filter F;
+    wxMenu *menu = new wxMenu();
+
+    parent->AppendSeparator();
+    parent->AppendSubMenu(menu, _("&Filter"));
+
+    menu->AppendRadioItem(ID_FILTER + (int)F::All, MSW_OR_OTHER(_("All strings"), _("All Strings")));
+    menu->AppendSeparator();
+    menu->AppendRadioItem(ID_FILTER + (int)F::Unfinished, _("Unfinished"));
+    menu->AppendRadioItem(ID_FILTER + (int)F::Untranslated, _("Untranslated"));
+    menu->AppendRadioItem(ID_FILTER + (int)F::Fuzzy, MSW_OR_OTHER(_("Needs work"), _("Needs Work")));
+    menu->AppendRadioItem(ID_FILTER + (int)F::Issues, MSW_OR_OTHER(_("With issues"), _("With Issues")));
+}
+
+void PoeditFrame::OnFilter(wxCommandEvent& event)
+{
+    auto filter = static_cast<PoeditListCtrl::Filter>(event.GetId() - ID_FILTER);
+    m_list->SetFilter(filter);
+
+    // the previously current item may have been filtered out:
+    if (!m_list->GetCurrentItem().IsOk() && m_list->GetItemCount() > 0)
+        m_list->SelectAndFocus(0);
+}
+
+
 void PoeditFrame::OnSortByFileOrder(wxCommandEvent&)
 {
     m_list->sortOrder().by = SortOrder::By_FileOrder;
@@ -3451,6 +3979,9 @@ bool PoeditFrame::Navigate(int step, NavigatePredicate predicate, bool wrap)
 {
     if (!m_list)
         return false;
+    // don't scan the whole list if there's nothing to find:
+    if (predicate == Pred_UnfinishedItem && m_catalog && !m_catalog->HasItemsNeedingAttention())
+        return false;
     auto i = NavigateGetNextItem(m_list->GetCurrentItemListIndex(), step, predicate, wrap, nullptr);
     if (i == -1)
         return false;
@@ -3496,8 +4027,7 @@ void PoeditFrame::OnDoneAndNext(wxCommandEvent&)
         if (!IsModified())
         {
             m_modified = true;
-            UpdateTitle();
-            UpdateStatusBar();
+            ScheduleUpdate(Update_Title | Update_StatusBar);
         }
 
         // do additional processing of finished translations, such as adding it to the TM:
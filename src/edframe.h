@@ -26,8 +26,10 @@
 #ifndef _EDFRAME_H_
 #define _EDFRAME_H_
 
+#include <functional>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include <wx/frame.h>
 #include <wx/process.h>
@@ -40,6 +42,10 @@ class WXDLLIMPEXP_FWD_CORE wxSplitterEvent;
 #include "catalog.h"
 #include "catalog_po.h"
 #include "gexecute.h"
+#include "incremental_validation.h"
+#include "cloud_sync_watcher.h"
+#include "edit_journal.h"
+#include "sources_watcher.h"
 #include "edlistctrl.h"
 #include "edapp.h"
 
@@ -73,6 +79,12 @@ class PoeditFrame : public PoeditFrameBase
          */
         static PoeditFrame *Create(const wxString& catalog, int lineno = 0);
 
+        /** Opens several files, each in its own new frame, as Create() does.
+            The files are loaded concurrently in the background and frames
+            are created as they become ready, in no particular order.
+         */
+        static void CreateInBackground(const wxArrayString& catalogs, int lineno = 0);
+
         /** Public constructor functions. Creates and shows frame
             without catalog or other content.
          */
@@ -120,11 +132,14 @@ class PoeditFrame : public PoeditFrameBase
 
         void FixDuplicatesIfPresent();
         void WarnAboutLanguageIssues();
+        /// Prepares the TM for the catalog's language pair in the background
+        void WarmUpTM();
 
         /// Did the user modify the catalog?
         bool IsModified() const { return m_modified; }
 
-        void MarkAsModified();
+        /// Marks the catalog as modified, e.g. after direct changes to its items
+        void MarkAsModified(bool statsChanged = false);
 
         /** Updates catalog and sets m_modified flag. Updates from POT
             if \a pot_file is not empty and from sources otherwise.
@@ -187,6 +202,10 @@ class PoeditFrame : public PoeditFrameBase
 
         void PlaceInitialFocus(int lineno = 0);
 
+        /// Creates a frame for already loaded @a catalog, see Create()
+        static PoeditFrame *CreateWithCatalog(const CatalogPtr& catalog, int lineno);
+        void ShowWithInitialFocus(int lineno);
+
         typedef std::set<PoeditFrame*> PoeditFramesList;
         static PoeditFramesList ms_instances;
 
@@ -207,6 +226,21 @@ class PoeditFrame : public PoeditFrameBase
         bool NeedsToAskIfCanDiscardCurrentDoc() const;
         wxWindowPtr<wxMessageDialog> CreateAskAboutSavingDialog();
 
+        // Saves a snapshot of PO catalog on a background thread; used by
+        // WriteCatalog(), so that the user can continue editing meanwhile.
+        template<typename TFunctor>
+        void WriteCatalogInBackground(const POCatalogPtr& po, const wxString& catalog, TFunctor completionHandler);
+
+        // common handling of successfully saved catalog
+        template<typename TFunctor>
+        void OnCatalogWritten(const Catalog::ValidationResults& validation_results,
+                              Catalog::CompilationStatus mo_compilation_status,
+                              TFunctor completionHandler);
+
+        // runs the action immediately or, if the catalog is being saved,
+        // after the save finishes
+        void DoAfterSaving(std::function<void()> action);
+
         // implements opening of files, without asking user
         void DoOpenFile(const wxString& filename, int lineno = 0);
 
@@ -217,6 +251,20 @@ class PoeditFrame : public PoeditFrameBase
         /// Updates menu -- disables and enables items.
         void UpdateMenu();
 
+        /// What ScheduleUpdate() should update
+        enum
+        {
+            Update_StatusBar = 1,
+            Update_Title     = 2,
+            Update_Menu      = 4
+        };
+        /** Schedules UpdateStatusBar(), UpdateTitle() and/or UpdateMenu()
+            to be called in the next idle time, so that frequent or bulk
+            changes are reflected only once.
+         */
+        void ScheduleUpdate(int what);
+        void PerformPendingUpdates();
+
         // Called when catalog's language possibly changed
         void UpdateTextLanguage();
 
@@ -225,6 +273,7 @@ class PoeditFrame : public PoeditFrameBase
 
         // (Re)initializes spellchecker, if needed
         void InitSpellchecker();
+        void DoInitSpellchecker(bool enabled, const Language& lang);
 
         // navigation to another item in the list
         typedef bool (*NavigatePredicate)(const CatalogItemPtr& item);
@@ -240,6 +289,11 @@ class PoeditFrame : public PoeditFrameBase
         void OnPrevPluralForm(wxCommandEvent&);
         void OnNextPluralForm(wxCommandEvent&);
 
+public: // for UI benchmarks
+        PoeditListCtrl *GetListCtrl() const { return m_list; }
+        EditingArea *GetEditingArea() const { return m_editingArea; }
+        Sidebar *GetSidebar() const { return m_sidebar; }
+
         // Message handlers:
 public: // for PoeditApp
         void OnNew(wxCommandEvent& event);
@@ -272,6 +326,7 @@ private:
 
         void OnValidate(wxCommandEvent& event);
         void OnListSel(wxDataViewEvent& event);
+        void OnIdle(wxIdleEvent& event);
         void OnListRightClick(wxDataViewEvent& event);
         void OnListFocus(wxFocusEvent& event);
         void OnSplitterSashMoving(wxSplitterEvent& event);
@@ -294,6 +349,7 @@ private:
         void OnFindPrev(wxCommandEvent& event);
         void OnUpdateFind(wxUpdateUIEvent& event);
         void OnEditComment(wxCommandEvent& event);
+        void OnShowDiagnostics(wxCommandEvent& event);
         void OnSortByFileOrder(wxCommandEvent&);
         void OnSortBySource(wxCommandEvent&);
         void OnSortByTranslation(wxCommandEvent&);
@@ -329,6 +385,9 @@ private:
 
         void AddBookmarksMenu(wxMenu *menu);
 
+        void AddFilterMenu(wxMenu *menu);
+        void OnFilter(wxCommandEvent& event);
+
         void OnCompileMO(wxCommandEvent& event);
         void OnExport(wxCommandEvent& event);
         bool ExportCatalog(const wxString& filename);
@@ -344,11 +403,12 @@ private:
                                     TFunctor completionHandler);
 
 #ifndef __WXOSX__
-        wxFileHistory& FileHistory() { return wxGetApp().FileHistory(); }
+        RecentFilesHistory& FileHistory() { return wxGetApp().FileHistory(); }
 #endif
         void NoteAsRecentFile();
 
         void OnNewTranslationEntered(const CatalogItemPtr& item);
+        void OnCloudSyncUpdate(int changes, int conflicts);
 
         DECLARE_EVENT_TABLE()
 
@@ -363,6 +423,18 @@ private:
 
         CatalogItemPtr m_pendingHumanEditedItem;
 
+        // keeps issues of edited items up to date
+        IncrementalValidator m_validator;
+
+        // keeps POT extracted from changed sources ready, if enabled
+        SourcesWatcher m_sourcesWatcher;
+
+        // pulls remote changes of cloud-synced catalogs, if enabled
+        CloudSyncWatcher m_cloudSyncWatcher;
+
+        // keeps unsaved edits recoverable after a crash
+        EditJournal m_journal;
+
         EditingArea *m_editingArea;
         wxSplitterWindow *m_splitter;
         wxSplitterWindow *m_sidebarSplitter;
@@ -376,6 +448,12 @@ private:
         wxWeakRef<FindFrame> m_findWindow;
 
         bool m_modified;
+        bool m_saveInProgress;
+        int m_pendingUpdates; // see ScheduleUpdate()
+        // catalog whose source texts were counted in the background, see UpdateStatusBar()
+        std::weak_ptr<Catalog> m_textCountsCatalog;
+        bool m_textCountsReady;
+        std::vector<std::function<void()>> m_afterSaveActions;
         bool m_hasObsoleteItems;
         bool m_displayIDs;
         bool m_setSashPositionsWhenMaximized;
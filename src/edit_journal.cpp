@@ -0,0 +1,352 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "edit_journal.h"
+
+#include "errors.h"
+#include "json.h"
+#include "str_helpers.h"
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+
+#include <cstring>
+#include <vector>
+
+
+namespace
+{
+
+// How long to wait after a write before syncing the journal to disk, in
+// milliseconds; this batches syncs of quickly following edits:
+const int SYNC_DELAY = 1000;
+
+const int JOURNAL_VERSION = 1;
+
+wxString GetJournalFileName(const wxString& catalogFile)
+{
+    wxFileName fn(catalogFile);
+    fn.SetFullName("." + fn.GetFullName() + ".journal");
+    return fn.GetFullPath();
+}
+
+std::string MakeRecord(const CatalogItem& item)
+{
+    json translations = json::array();
+    for (auto& t: item.GetTranslations())
+        translations.push_back(str::to_utf8(t));
+
+    json r = {
+        { "id", item.GetId() },
+        { "msgid", item.GetStringUTF8() },
+        { "t", translations },
+        { "fuzzy", item.IsFuzzy() }
+    };
+    if (item.HasContext())
+        r["ctxt"] = item.GetContextUTF8();
+
+    return r.dump() + "\n";
+}
+
+} // anonymous namespace
+
+
+/// Identification of the catalog file the journal is for
+struct EditJournal::Stamp
+{
+    wxFileOffset size = 0;
+    int64_t mtime = 0;
+
+    static Stamp For(const wxString& filename)
+    {
+        Stamp s;
+        wxFileName fn(filename);
+        if (fn.FileExists())
+        {
+            s.size = (wxFileOffset)fn.GetSize().GetValue();
+            s.mtime = fn.GetModificationTime().GetValue().GetValue();
+        }
+        return s;
+    }
+
+    std::string ToHeader() const
+    {
+        json h = {
+            { "journal", JOURNAL_VERSION },
+            { "size", (int64_t)size },
+            { "mtime", mtime }
+        };
+        return h.dump() + "\n";
+    }
+
+    bool MatchesHeader(const std::string& line) const
+    {
+        try
+        {
+            auto h = json::parse(line);
+            return h.at("journal").get<int>() == JOURNAL_VERSION &&
+                   h.at("size").get<int64_t>() == (int64_t)size &&
+                   h.at("mtime").get<int64_t>() == mtime;
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+};
+
+
+EditJournal::EditJournal() : m_saveMark(0), m_syncTimer(this)
+{
+    Bind(wxEVT_TIMER, &EditJournal::OnSyncTimer, this);
+}
+
+
+EditJournal::~EditJournal()
+{
+    SetCatalog(nullptr);
+}
+
+
+void EditJournal::SetCatalog(const CatalogPtr& catalog)
+{
+    if (catalog && m_catalog.lock() == catalog)
+        return;
+
+    Remove();
+    m_catalog = catalog;
+    m_filename.clear();
+
+    // new files start being journaled once they are saved, see CatalogSaved()
+    if (catalog && !catalog->GetFileName().empty() && wxFileName::FileExists(catalog->GetFileName()))
+        m_filename = GetJournalFileName(catalog->GetFileName());
+}
+
+
+bool EditJournal::EnsureOpen()
+{
+    if (m_file.IsOpened())
+        return true;
+    auto catalog = m_catalog.lock();
+    if (!catalog)
+        return false;
+
+    wxLogNull null;
+    const auto stamp = Stamp::For(catalog->GetFileName());
+
+    // keep the journal left by a crashed session if it's still valid, its
+    // edits were recovered into the catalog and aren't saved yet either:
+    if (wxFileName::FileExists(m_filename))
+    {
+        wxFFile existing(m_filename, "rb");
+        char header[256] = {0};
+        if (existing.IsOpened() && existing.Read(header, sizeof(header) - 1) > 0)
+        {
+            auto eol = strchr(header, '\n');
+            if (eol && stamp.MatchesHeader(std::string(header, eol)))
+            {
+                existing.Close();
+                return m_file.Open(m_filename, wxFile::write_append);
+            }
+        }
+    }
+
+    if (!m_file.Create(m_filename, /*overwrite=*/true))
+    {
+        // e.g. read-only directory; journaling is best-effort
+        wxLogTrace("poedit.journal", "can't create journal %s", m_filename);
+        m_filename.clear();
+        return false;
+    }
+
+    auto header = stamp.ToHeader();
+    m_file.Write(header.data(), header.size());
+    return true;
+}
+
+
+void EditJournal::Write(const std::string& record)
+{
+    if (m_filename.empty() || !EnsureOpen())
+        return;
+
+    m_file.Write(record.data(), record.size());
+    if (!m_syncTimer.IsRunning())
+        m_syncTimer.StartOnce(SYNC_DELAY);
+}
+
+
+void EditJournal::ItemChanged(const CatalogItem& item)
+{
+    if (m_filename.empty())
+        return;
+    Write(MakeRecord(item));
+}
+
+
+void EditJournal::CatalogModified()
+{
+    auto catalog = m_catalog.lock();
+    if (!catalog || m_filename.empty())
+        return;
+
+    std::string records;
+    for (auto& i: catalog->items())
+    {
+        if (i->IsModified())
+            records += MakeRecord(*i);
+    }
+    if (!records.empty())
+        Write(records);
+}
+
+
+void EditJournal::SaveStarted()
+{
+    m_saveMark = m_file.IsOpened() ? m_file.Length() : 0;
+}
+
+
+void EditJournal::CatalogSaved()
+{
+    auto catalog = m_catalog.lock();
+    if (!catalog)
+        return;
+
+    // edits made while saving in the background aren't in the file yet:
+    std::string tail;
+    if (m_file.IsOpened())
+    {
+        m_file.Close();
+        wxFFile f(m_filename, "rb");
+        const wxFileOffset length = f.IsOpened() ? f.Length() : 0;
+        if (m_saveMark > 0 && length > m_saveMark && f.Seek(m_saveMark))
+        {
+            tail.resize(size_t(length - m_saveMark));
+            tail.resize(f.Read(&tail[0], tail.size()));
+        }
+    }
+
+    // the file may have been saved under a different name:
+    Remove();
+    m_filename = GetJournalFileName(catalog->GetFileName());
+    m_saveMark = 0;
+
+    if (!tail.empty())
+        Write(tail);
+}
+
+
+void EditJournal::Remove()
+{
+    m_syncTimer.Stop();
+    if (m_file.IsOpened())
+        m_file.Close();
+    if (!m_filename.empty() && wxFileName::FileExists(m_filename))
+    {
+        wxLogNull null;
+        wxRemoveFile(m_filename);
+    }
+    m_saveMark = 0;
+}
+
+
+void EditJournal::OnSyncTimer(wxTimerEvent&)
+{
+    if (m_file.IsOpened())
+        m_file.Flush();
+}
+
+
+/*static*/ int EditJournal::Recover(Catalog& catalog)
+{
+    const auto filename = GetJournalFileName(catalog.GetFileName());
+    if (catalog.GetFileName().empty() || !wxFileName::FileExists(filename))
+        return 0;
+
+    wxLogNull null;
+    wxFFile f(filename, "rb");
+    std::string data;
+    if (!f.IsOpened() || f.Length() <= 0)
+        return 0;
+    data.resize(size_t(f.Length()));
+    data.resize(f.Read(&data[0], data.size()));
+
+    size_t pos = data.find('\n');
+    if (pos == std::string::npos || !Stamp::For(catalog.GetFileName()).MatchesHeader(data.substr(0, pos)))
+        return 0;
+
+    auto& items = catalog.items();
+    std::vector<bool> recovered(items.size(), false);
+    int count = 0;
+
+    // the last record may be incomplete if the crash happened while writing it:
+    for (pos++; pos < data.size(); )
+    {
+        const size_t eol = data.find('\n', pos);
+        if (eol == std::string::npos)
+            break;
+
+        try
+        {
+            auto r = json::parse(data.begin() + pos, data.begin() + eol);
+            const int id = r.at("id").get<int>();
+            if (id < 1 || id > (int)items.size())
+                throw Exception("invalid item ID");
+            auto& item = items[id - 1];
+
+            // make sure it's the same item, to be on the safe side:
+            auto ctxt = r.find("ctxt");
+            if (item->GetStringUTF8() != r.at("msgid").get<std::string>() ||
+                item->HasContext() != (ctxt != r.end()) ||
+                (item->HasContext() && item->GetContextUTF8() != ctxt->get<std::string>()))
+            {
+                throw Exception("mismatched item");
+            }
+
+            wxArrayString translations;
+            for (auto& t: r.at("t"))
+                translations.push_back(str::to_wx(t.get<std::string>()));
+
+            item->SetTranslations(translations);
+            item->SetFuzzy(r.at("fuzzy").get<bool>());
+            item->SetModified(true);
+            if (!recovered[id - 1])
+            {
+                recovered[id - 1] = true;
+                count++;
+            }
+        }
+        catch (...)
+        {
+            wxLogTrace("poedit.journal", "skipping journal record: %s", DescribeCurrentException());
+        }
+
+        pos = eol + 1;
+    }
+
+    return count;
+}
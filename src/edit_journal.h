@@ -0,0 +1,107 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_edit_journal_h
+#define Poedit_edit_journal_h
+
+#include "catalog.h"
+
+#include <wx/event.h>
+#include <wx/file.h>
+#include <wx/timer.h>
+
+#include <cstdint>
+#include <memory>
+
+
+/**
+    Crash-safe journal of unsaved edits of a catalog.
+
+    Saving a large catalog is too expensive to be done after every edit, so
+    edited items (their translations and fuzzy flag) are instead appended
+    to a small journal file stored next to the catalog. Writes are synced to
+    disk in batches, shortly after an edit. The journal is truncated when the
+    catalog is saved and removed when it's closed, so it only survives if
+    the app crashed or was killed with unsaved changes. Recover() then
+    applies them when the file is opened again.
+
+    The journal is only valid for the exact version of the file it was
+    created for; it's ignored if the file changed since.
+ */
+class EditJournal : public wxEvtHandler
+{
+public:
+    EditJournal();
+    ~EditJournal();
+
+    /** Starts journaling edits of @a catalog, discarding the journal of the
+        previous one. Does nothing if @a catalog is already journaled. Pass
+        nullptr to stop, e.g. when the catalog is closed.
+
+        Catalogs that don't exist on disk yet are only journaled after they
+        are saved. The journal file is only created once there's something
+        to record.
+     */
+    void SetCatalog(const CatalogPtr& catalog);
+
+    /// Records current state of @a item, which was just edited
+    void ItemChanged(const CatalogItem& item);
+
+    /// Records all modified items after a bulk change of the catalog
+    void CatalogModified();
+
+    /** Must be called before saving of the catalog starts. Edits recorded
+        after this are kept by CatalogSaved(), as they aren't in the saved
+        file if it's saved in the background.
+     */
+    void SaveStarted();
+
+    /// Must be called after the catalog was successfully saved
+    void CatalogSaved();
+
+    /** Applies edits recorded in @a catalog's journal, if there is one left
+        after a crash and is still valid for the file.
+
+        Returns the number of recovered items.
+     */
+    static int Recover(Catalog& catalog);
+
+private:
+    struct Stamp;
+
+    bool EnsureOpen();
+    void Write(const std::string& record);
+    void Remove();
+    void OnSyncTimer(wxTimerEvent& event);
+
+private:
+    std::weak_ptr<Catalog> m_catalog;
+    wxString m_filename;
+    wxFile m_file;
+    wxFileOffset m_saveMark;
+    wxTimer m_syncTimer;
+};
+
+#endif // Poedit_edit_journal_h
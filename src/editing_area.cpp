@@ -30,6 +30,7 @@
 #include "customcontrols.h"
 #include "edlistctrl.h"
 #include "hidpi.h"
+#include "icons.h"
 #include "spellchecking.h"
 #include "text_control.h"
 #include "utility.h"
@@ -90,7 +91,7 @@ inline void SetCtrlFont(wxWindow *win, const wxFont& font)
 // does some basic processing of user input, e.g. to remove trailing \n
 wxString PreprocessEnteredTextForItem(CatalogItemPtr item, wxString t)
 {
-    auto& orig = item->GetString();
+    const wxString orig = item->GetString();
 
     if (!t.empty() && !orig.empty())
     {
@@ -323,8 +324,8 @@ public:
     IssueLabel(wxWindow *parent)
         : TagLabel(parent, Color::TagErrorLineFg, Color::TagErrorLineBg)
     {
-        m_iconError = wxArtProvider::GetBitmap("StatusErrorBlack");
-        m_iconWarning = wxArtProvider::GetBitmap("StatusWarningBlack");
+        m_iconError = IconsCache::GetBitmap("StatusErrorBlack");
+        m_iconWarning = IconsCache::GetBitmap("StatusWarningBlack");
         SetIcon(m_iconError);
     }
 
@@ -341,8 +342,9 @@ public:
                 SetColor(Color::TagWarningLineFg, Color::TagWarningLineBg);
                 break;
         }
-        SetLabel(issue.message);
-        SetToolTip(issue.message);
+        const wxString message = issue.GetMessage();
+        SetLabel(message);
+        SetToolTip(message);
     }
 
 private:
@@ -357,6 +359,9 @@ EditingArea::EditingArea(wxWindow *parent, PoeditListCtrl *associatedList, Mode
       m_textOrigPlural(nullptr),
       m_fuzzy(nullptr),
       m_textTrans(nullptr),
+      m_textTransSingularForm(nullptr),
+      m_spellcheckingInitialized(false),
+      m_spellcheckingEnabled(false),
       m_pluralNotebook(nullptr),
       m_labelSingular(nullptr),
       m_labelPlural(nullptr),
@@ -518,6 +523,11 @@ void EditingArea::CreateEditControls(wxBoxSizer *sizer)
         e.Skip();
     });
 
+    m_pluralNotebook->Bind(wxEVT_NOTEBOOK_PAGE_CHANGED, [=](wxBookCtrlEvent& e){
+        e.Skip();
+        OnPluralTabShown(e.GetSelection());
+    });
+
 #ifdef __WXMSW__
     m_pluralNotebook->Bind(wxEVT_NOTEBOOK_PAGE_CHANGED, [=](wxBookCtrlEvent& e){
         e.Skip();
@@ -653,10 +663,18 @@ bool EditingArea::InitSpellchecker(bool enabled, Language lang)
             rv = false;
     }
 
-    for (auto tp : m_textTransPlural)
+    m_spellcheckingInitialized = true;
+    m_spellcheckingEnabled = enabled;
+    m_spellcheckingLang = lang;
+
+    // plural forms in inactive tabs are done when they are shown:
+    m_pluralSpellcheckingDone.assign(m_textTransPlural.size(), false);
+    const int selected = m_pluralNotebook ? m_pluralNotebook->GetSelection() : wxNOT_FOUND;
+    if (selected != wxNOT_FOUND && selected < (int)m_textTransPlural.size())
     {
-        if (tp && !InitTextCtrlSpellchecker(tp, enabled, lang))
+        if (!InitTextCtrlSpellchecker(m_textTransPlural[selected], enabled, lang))
             rv = false;
+        m_pluralSpellcheckingDone[selected] = true;
     }
 
     return rv;
@@ -681,13 +699,22 @@ void EditingArea::RecreatePluralTextCtrls(CatalogPtr catalog)
     if (!m_pluralNotebook)
         return;
 
-    m_textTransPlural.clear();
-    m_pluralNotebook->DeleteAllPages();
     m_textTransSingularForm = NULL;
 
+    // Existing controls are reused, because this is called whenever the
+    // catalog is reloaded or its header edited and the number of forms
+    // rarely changes:
+    int formsCount = catalog->GetPluralFormsCount();
+    while ((int)m_textTransPlural.size() > formsCount)
+    {
+        m_pluralNotebook->DeletePage(m_textTransPlural.size() - 1);
+        m_textTransPlural.pop_back();
+    }
+    if (m_pluralSpellcheckingDone.size() > m_textTransPlural.size())
+        m_pluralSpellcheckingDone.resize(m_textTransPlural.size());
+
     auto plurals = PluralFormsExpr(catalog->Header().GetHeader("Plural-Forms").ToStdString());
 
-    int formsCount = catalog->GetPluralFormsCount();
     for (int form = 0; form < formsCount; form++)
     {
         // find example number that would use this plural form:
@@ -761,15 +788,26 @@ void EditingArea::RecreatePluralTextCtrls(CatalogPtr catalog)
         else
             desc.Printf(L"n → %s", examples);
 
-        // create text control and notebook page for it:
-        auto txt = new TranslationTextCtrl(m_pluralNotebook, wxID_ANY);
-        txt->SetWindowVariant(wxWINDOW_VARIANT_NORMAL);
+        TranslationTextCtrl *txt;
+        if (form < (int)m_textTransPlural.size())
+        {
+            txt = m_textTransPlural[form];
+            if (m_pluralNotebook->GetPageText(form) != desc)
+                m_pluralNotebook->SetPageText(form, desc);
+        }
+        else
+        {
+            // create text control and notebook page for it:
+            txt = new TranslationTextCtrl(m_pluralNotebook, wxID_ANY);
+            txt->SetWindowVariant(wxWINDOW_VARIANT_NORMAL);
 #ifndef __WXOSX__
-        txt->SetFont(m_textTrans->GetFont());
+            txt->SetFont(m_textTrans->GetFont());
 #endif
-        txt->Bind(wxEVT_TEXT, [=](wxCommandEvent& e){ e.Skip(); UpdateFromTextCtrl(); });
-        m_textTransPlural.push_back(txt);
-        m_pluralNotebook->AddPage(txt, desc);
+            txt->Bind(wxEVT_TEXT, [=](wxCommandEvent& e){ e.Skip(); UpdateFromTextCtrl(); });
+            m_textTransPlural.push_back(txt);
+            m_pluralSpellcheckingDone.push_back(false);
+            m_pluralNotebook->AddPage(txt, desc);
+        }
 
         if (examplesCnt == 1 && firstExample == 1) // == singular
             m_textTransSingularForm = txt;
@@ -779,6 +817,8 @@ void EditingArea::RecreatePluralTextCtrls(CatalogPtr catalog)
     // (like in English and most real-life uses):
     if (!m_textTransSingularForm && !m_textTransPlural.empty())
         m_textTransSingularForm = m_textTransPlural[0];
+
+    OnPluralTabShown(m_pluralNotebook->GetSelection());
 }
 
 
@@ -800,6 +840,25 @@ void EditingArea::ShowPluralFormUI(bool show)
 }
 
 
+void EditingArea::OnPluralTabShown(int index)
+{
+    // Only the visible tab is highlighted and spellchecked; the others are
+    // brought up to date when they are shown, so that navigating between
+    // items doesn't do the work for every plural form:
+    for (int i = 0; i < (int)m_textTransPlural.size(); i++)
+        m_textTransPlural[i]->DeferHighlighting(i != index);
+
+    if (index == wxNOT_FOUND || index >= (int)m_textTransPlural.size())
+        return;
+
+    if (m_spellcheckingInitialized && !m_pluralSpellcheckingDone[index])
+    {
+        InitTextCtrlSpellchecker(m_textTransPlural[index], m_spellcheckingEnabled, m_spellcheckingLang);
+        m_pluralSpellcheckingDone[index] = true;
+    }
+}
+
+
 void EditingArea::ShowPart(wxWindow *part, bool show)
 {
     part->GetContainingSizer()->Show(part, show);
@@ -890,14 +949,12 @@ void EditingArea::UpdateToTextCtrl(CatalogItemPtr item, int flags)
         {
             m_textOrigPlural->SetPlainText(item->GetPluralString());
 
-            unsigned formsCnt = (unsigned)m_textTransPlural.size();
-            for (unsigned j = 0; j < formsCnt; j++)
-                SetTranslationValue(m_textTransPlural[j], wxEmptyString, flags);
-
-            unsigned i = 0;
-            for (i = 0; i < std::min(formsCnt, item->GetNumberOfTranslations()); i++)
+            // set every form only once, each change is highlighted:
+            const unsigned formsCnt = (unsigned)m_textTransPlural.size();
+            const unsigned transCnt = item->GetNumberOfTranslations();
+            for (unsigned i = 0; i < formsCnt; i++)
             {
-                SetTranslationValue(m_textTransPlural[i], item->GetTranslation(i), flags);
+                SetTranslationValue(m_textTransPlural[i], i < transCnt ? item->GetTranslation(i) : wxString(), flags);
             }
 
             if ((flags & EditingArea::ItemChanged) && m_pluralNotebook && m_pluralNotebook->GetPageCount())
@@ -986,7 +1043,7 @@ void EditingArea::UpdateFromTextCtrl()
                 allTranslated = false;
         }
 
-        if ( str != item->GetTranslations() )
+        if ( !item->GetTranslations().IsSameAs(str) )
         {
             anyTransChanged = true;
             item->SetTranslations(str);
@@ -122,6 +122,7 @@ private:
     void SetupTextCtrlSizes();
 
     void ShowPluralFormUI(bool show);
+    void OnPluralTabShown(int index);
 
     void ShowPart(wxWindow *part, bool show);
 
@@ -142,6 +143,12 @@ private:
     std::vector<TranslationTextCtrl*> m_textTransPlural;
     TranslationTextCtrl *m_textTransSingularForm;
 
+    // Spellchecking is only initialized for plural forms when their tab is
+    // first shown; this is what it should be initialized with:
+    bool m_spellcheckingInitialized, m_spellcheckingEnabled;
+    Language m_spellcheckingLang;
+    std::vector<bool> m_pluralSpellcheckingDone;
+
     wxNotebook *m_pluralNotebook;
     wxStaticText *m_labelSingular, *m_labelPlural;
     wxStaticText *m_labelSource, *m_labelTrans;
@@ -30,6 +30,8 @@
 #include "language.h"
 #include "cat_sorting.h"
 #include "colorscheme.h"
+#include "concurrency.h"
+#include "icons.h"
 #include "unicode_helpers.h"
 #include "utility.h"
 
@@ -77,8 +79,11 @@ public:
         if (focus != -1)
         {
             auto item = list->CatalogIndexToListItem(focus);
-            list->EnsureVisible(item);
-            list->SetCurrentItem(item);
+            if (item.IsOk())
+            {
+                list->EnsureVisible(item);
+                list->SetCurrentItem(item);
+            }
         }
     }
 
@@ -164,10 +169,10 @@ class DataViewIconsAdjuster : public wxDataViewValueAdjuster
 public:
     DataViewIconsAdjuster()
     {
-        m_comment = wxArtProvider::GetIcon("ItemCommentTemplate");
-        m_commentSel = wxArtProvider::GetIcon("ItemCommentTemplate@inverted");
-        m_bookmark = wxArtProvider::GetIcon("ItemBookmarkTemplate");
-        m_bookmarkSel = wxArtProvider::GetIcon("ItemBookmarkTemplate@inverted");
+        m_comment = IconsCache::GetIcon("ItemCommentTemplate");
+        m_commentSel = IconsCache::GetIcon("ItemCommentTemplate@inverted");
+        m_bookmark = IconsCache::GetIcon("ItemBookmarkTemplate");
+        m_bookmarkSel = IconsCache::GetIcon("ItemBookmarkTemplate@inverted");
     }
 
     wxVariant MakeHighlighted(const wxVariant& value) const override
@@ -217,14 +222,57 @@ wxString TrimTextValue(const wxString& text, size_t maxChars)
 
 
 
+// Limit on cached rows; more than enough for all visible ones
+const size_t MAX_CACHED_ROWS = 2000;
+
+
+/// Invalidates the model's cache and search index in response to changes
+/// reported by the model
+class PoeditListCtrl::Model::CacheInvalidator : public wxDataViewModelNotifier
+{
+public:
+    CacheInvalidator(Model& model) : m_model(model) {}
+
+    bool ItemAdded(const wxDataViewItem&, const wxDataViewItem&) override { m_model.InvalidateCache(); return true; }
+    bool ItemDeleted(const wxDataViewItem&, const wxDataViewItem&) override { m_model.InvalidateCache(); return true; }
+    bool ItemChanged(const wxDataViewItem& item) override { OnItemChanged(item); return true; }
+    bool ValueChanged(const wxDataViewItem& item, unsigned int) override { OnItemChanged(item); return true; }
+    bool Cleared() override { m_model.InvalidateCache(); return true; }
+    void Resort() override { m_model.InvalidateCache(); }
+
+private:
+    void OnItemChanged(const wxDataViewItem& item)
+    {
+        m_model.InvalidateCache(item);
+        if (item.IsOk())
+            m_model.m_searchIndex.ItemChanged(m_model.CatalogIndex(m_model.GetRow(item)));
+    }
+
+    Model& m_model;
+};
+
+
 PoeditListCtrl::Model::Model(TextDirection appTextDir)
     : m_frozen(false),
       m_maxVisibleWidth(0),
+      m_filter(Filter::All),
       m_sourceTextDir(TextDirection::LTR),
       m_transTextDir(TextDirection::LTR),
       m_appTextDir(appTextDir)
 {
     sortOrder = SortOrder::Default();
+
+    // Added before the control's own notifier so that the cache is already
+    // invalidated when the control asks for new values:
+    AddNotifier(new CacheInvalidator(*this));
+}
+
+
+void PoeditListCtrl::Model::InvalidateCache(const wxDataViewItem& item)
+{
+    if (m_cache.empty() || !item.IsOk())
+        return;
+    m_cache.erase(CatalogIndex(GetRow(item)));
 }
 
 
@@ -236,16 +284,22 @@ void PoeditListCtrl::Model::SetVisualMode(ColorScheme::Mode visualMode)
     m_clrContextFg = ColorScheme::Get(Color::ItemContextFg, visualMode).GetAsString(wxC2S_HTML_SYNTAX);
     m_clrContextBg = ColorScheme::Get(Color::ItemContextBg, visualMode).GetAsString(wxC2S_HTML_SYNTAX);
 
-    m_iconComment = wxArtProvider::GetIcon("ItemCommentTemplate");
-    m_iconBookmark = wxArtProvider::GetIcon("ItemBookmarkTemplate");
-    m_iconError = wxArtProvider::GetIcon("StatusError");
-    m_iconWarning = wxArtProvider::GetIcon("StatusWarning");
+    m_iconComment = IconsCache::GetIcon("ItemCommentTemplate");
+    m_iconBookmark = IconsCache::GetIcon("ItemBookmarkTemplate");
+    m_iconError = IconsCache::GetIcon("StatusError");
+    m_iconWarning = IconsCache::GetIcon("StatusWarning");
+
+    // context colors are part of the markup:
+    InvalidateCache();
 }
 
 
 void PoeditListCtrl::Model::SetCatalog(CatalogPtr catalog)
 {
+    m_comparator.reset();
     m_catalog = catalog;
+    InvalidateCache();
+    m_searchIndex.SetCatalog(catalog);
 
     if (!catalog)
     {
@@ -261,7 +315,21 @@ void PoeditListCtrl::Model::SetCatalog(CatalogPtr catalog)
     // sort catalog items, create indexes mapping
     CreateSortMap();
 
-    Reset(catalog->GetCount());
+    Reset((unsigned)m_mapListToCatalog.size());
+}
+
+
+void PoeditListCtrl::Model::SetFilter(Filter filter)
+{
+    if (filter == m_filter)
+        return;
+    m_filter = filter;
+
+    if (!m_catalog)
+        return;
+
+    CreateSortMap();
+    Reset((unsigned)m_mapListToCatalog.size());
 }
 
 
@@ -269,8 +337,35 @@ void PoeditListCtrl::Model::UpdateSort()
 {
     if (!m_catalog)
         return;
+
+    // Typically, only a few items changed since the last sort (e.g. because
+    // they were edited or validated) and moving them is much cheaper:
+    if (m_comparator && m_sortedBy == sortOrder)
+    {
+        // the comparator snapshots compared texts, so a new one is needed:
+        m_comparator.reset(new CatalogItemsComparator(*m_catalog, sortOrder));
+
+        int first, last;
+        if (UpdateSortMap(first, last))
+        {
+            if (first <= last)
+            {
+                wxDataViewItemArray items;
+                items.reserve(last - first + 1);
+                for (int row = first; row <= last; row++)
+                    items.push_back(GetItem(row));
+                ItemsChanged(items);
+            }
+            return;
+        }
+    }
+    else
+    {
+        m_comparator.reset();
+    }
+
     CreateSortMap();
-    Reset(m_catalog->GetCount());
+    Reset((unsigned)m_mapListToCatalog.size());
 }
 
 
@@ -329,7 +424,7 @@ void PoeditListCtrl::Model::GetValueByRow(wxVariant& variant, unsigned row, unsi
     {
         case Col_ID:
         {
-            variant = wxString::Format("%d", d->GetId());
+            variant = GetCachedRow(row, d).id;
             break;
         }
 
@@ -359,64 +454,13 @@ void PoeditListCtrl::Model::GetValueByRow(wxVariant& variant, unsigned row, unsi
 
         case Col_Source:
         {
-            wxString orig;
-            const auto orig_str = TrimTextValue(d->GetString(), m_maxVisibleWidth);
-
-#if wxCHECK_VERSION(3,1,1)
-        #ifdef __WXMSW__
-            // Temporary workaround for https://github.com/vslavik/poedit/issues/343 and
-            // https://github.com/vslavik/poedit/issues/481 -- fall back to old style rendering:
-            if (m_appTextDir == TextDirection::LTR || m_sourceTextDir == TextDirection::RTL)
-        #endif
-            {
-                if (d->HasContext())
-                {
-                    // Work around a problem with GTK+'s coloring of markup that begins with colorizing <span>:
-                #ifdef __WXGTK__
-                    #define MARKUP(x) L"\u200B" L##x
-                #else
-                    #define MARKUP(x) x
-                #endif
-                    orig.Printf(MARKUP("<span bgcolor=\"%s\" color=\"%s\"> %s </span> %s"),
-                        m_clrContextBg, m_clrContextFg,
-                        EscapeMarkup(d->GetContext()), EscapeMarkup(orig_str));
-                }
-                else
-                {
-                    orig = EscapeMarkup(orig_str);
-                }
-            }
-        #ifdef __WXMSW__
-            else // RTL problems, fall back to worse rendering
-        #endif
-#endif
-#if !wxCHECK_VERSION(3,1,1) || defined(__WXMSW__)
-            // non-markup rendering of source column:
-            {
-                if (d->HasContext())
-                    orig.Printf("[%s] %s", d->GetContext(), orig_str);
-                else
-                    orig = orig_str;
-            }
-#endif
-
-            // Add RTL Unicode mark to render bidi texts correctly
-            if (m_appTextDir != m_sourceTextDir)
-                variant = bidi::mark_direction(orig, m_sourceTextDir);
-            else
-                variant = orig;
+            variant = GetCachedRow(row, d).source;
             break;
         }
 
         case Col_Translation:
         {
-            const auto trans = TrimTextValue(d->GetTranslation(), m_maxVisibleWidth);
-
-            // Add RTL Unicode mark to render bidi texts correctly
-            if (m_appTextDir != m_transTextDir)
-                variant = bidi::mark_direction(trans, m_transTextDir);
-            else
-                variant = trans;
+            variant = GetCachedRow(row, d).translation;
             break;
         }
 
@@ -426,6 +470,85 @@ void PoeditListCtrl::Model::GetValueByRow(wxVariant& variant, unsigned row, unsi
     };
 }
 
+const PoeditListCtrl::Model::CachedRow& PoeditListCtrl::Model::GetCachedRow(unsigned row, const CatalogItemPtr& d) const
+{
+    const int index = CatalogIndex(row);
+    auto cached = m_cache.find(index);
+    if (cached != m_cache.end())
+        return cached->second;
+
+    if (m_cache.size() >= MAX_CACHED_ROWS)
+        m_cache.clear();
+
+    CachedRow& r = m_cache[index];
+
+    r.id = wxString::Format("%d", d->GetId());
+
+    // Col_Source:
+    {
+        wxString orig;
+        const auto orig_str = TrimTextValue(d->GetString(), m_maxVisibleWidth);
+
+#if wxCHECK_VERSION(3,1,1)
+    #ifdef __WXMSW__
+        // Temporary workaround for https://github.com/vslavik/poedit/issues/343 and
+        // https://github.com/vslavik/poedit/issues/481 -- fall back to old style rendering:
+        if (m_appTextDir == TextDirection::LTR || m_sourceTextDir == TextDirection::RTL)
+    #endif
+        {
+            if (d->HasContext())
+            {
+                // Work around a problem with GTK+'s coloring of markup that begins with colorizing <span>:
+            #ifdef __WXGTK__
+                #define MARKUP(x) L"\u200B" L##x
+            #else
+                #define MARKUP(x) x
+            #endif
+                orig.Printf(MARKUP("<span bgcolor=\"%s\" color=\"%s\"> %s </span> %s"),
+                    m_clrContextBg, m_clrContextFg,
+                    EscapeMarkup(d->GetContext()), EscapeMarkup(orig_str));
+            }
+            else
+            {
+                orig = EscapeMarkup(orig_str);
+            }
+        }
+    #ifdef __WXMSW__
+        else // RTL problems, fall back to worse rendering
+    #endif
+#endif
+#if !wxCHECK_VERSION(3,1,1) || defined(__WXMSW__)
+        // non-markup rendering of source column:
+        {
+            if (d->HasContext())
+                orig.Printf("[%s] %s", d->GetContext(), orig_str);
+            else
+                orig = orig_str;
+        }
+#endif
+
+        // Add RTL Unicode mark to render bidi texts correctly
+        if (m_appTextDir != m_sourceTextDir)
+            r.source = bidi::mark_direction(orig, m_sourceTextDir);
+        else
+            r.source = orig;
+    }
+
+    // Col_Translation:
+    {
+        const auto trans = TrimTextValue(d->GetTranslation(), m_maxVisibleWidth);
+
+        // Add RTL Unicode mark to render bidi texts correctly
+        if (m_appTextDir != m_transTextDir)
+            r.translation = bidi::mark_direction(trans, m_transTextDir);
+        else
+            r.translation = trans;
+    }
+
+    return r;
+}
+
+
 bool PoeditListCtrl::Model::SetValueByRow(const wxVariant&, unsigned, unsigned)
 {
     wxFAIL_MSG("setting values in dataview not implemented");
@@ -475,23 +598,51 @@ void PoeditListCtrl::Model::CreateSortMap()
 {
     // FIXME: Use native wxDataViewCtrl sorting instead
 
-    int count = (int)m_catalog->GetCount();
+    const int catalogCount = (int)m_catalog->GetCount();
+    m_mapCatalogToList.assign(catalogCount, -1);
 
-    m_mapListToCatalog.resize(count);
-    m_mapCatalogToList.resize(count);
-
-    // First create identity mapping for the sort order.
-    for ( int i = 0; i < count; i++ )
-        m_mapListToCatalog[i] = i;
+    // First create identity mapping for the sort order, of only the items
+    // that pass the filter. Those are found with bitwise operations on the
+    // catalog's status bitmaps, which is much faster than checking every
+    // item of a large catalog.
+    typedef CatalogStatusIndex S;
+    switch (m_filter)
+    {
+        case Filter::All:
+            m_mapListToCatalog.resize(catalogCount);
+            for ( int i = 0; i < catalogCount; i++ )
+                m_mapListToCatalog[i] = i;
+            break;
+        case Filter::Unfinished:
+            m_mapListToCatalog = m_catalog->GetStatusBitmaps()->Select(S::Fuzzy | S::Error, S::Translated);
+            break;
+        case Filter::Untranslated:
+            m_mapListToCatalog = m_catalog->GetStatusBitmaps()->Select(0, S::Translated);
+            break;
+        case Filter::Fuzzy:
+            m_mapListToCatalog = m_catalog->GetStatusBitmaps()->Select(S::Fuzzy, 0);
+            break;
+        case Filter::Issues:
+            m_mapListToCatalog = m_catalog->GetStatusBitmaps()->Select(S::Error | S::Issue, 0);
+            break;
+    }
+    const int count = (int)m_mapListToCatalog.size();
 
     // m_mapListToCatalog will hold our desired sort order. Sort it in place
     // now, using the desired sort criteria.
-    CatalogItemsComparator comparator(*m_catalog, sortOrder);
-    std::sort
+    if (!m_comparator)
+        m_comparator.reset(new CatalogItemsComparator(*m_catalog, sortOrder));
+    m_sortedBy = sortOrder;
+
+    // the user is waiting for the list to be sorted:
+    dispatch::parallel_options options;
+    options.prio = dispatch::priority::interactive;
+    dispatch::parallel_sort
     (
         m_mapListToCatalog.begin(),
         m_mapListToCatalog.end(),
-        std::ref(comparator)
+        std::cref(*m_comparator),
+        options
     );
 
     // Finally, construct m_mapCatalogToList to be the inverse mapping to
@@ -501,6 +652,86 @@ void PoeditListCtrl::Model::CreateSortMap()
 }
 
 
+bool PoeditListCtrl::Model::UpdateSortMap(int& first, int& last)
+{
+    const auto& comp = *m_comparator;
+    const auto& current = m_mapListToCatalog;
+    const int count = (int)current.size();
+    if (GetCatalogCount() != (int)m_catalog->GetCount())
+        return false;
+
+    // Find items out of order w.r.t. their neighbors; this needs only
+    // count-1 comparisons instead of count*log(count) for full sorting:
+    std::vector<bool> displaced(count, false);
+    int displacedCount = 0;
+    for (int row = 1; row < count; row++)
+    {
+        if (!comp(current[row - 1], current[row]))
+        {
+            displacedCount += !displaced[row - 1] + !displaced[row];
+            displaced[row - 1] = displaced[row] = true;
+        }
+    }
+
+    first = 0;
+    last = -1;
+    if (displacedCount == 0)
+        return true;
+
+    // with too many changes, moving them would be slower than sorting:
+    if (displacedCount > count / 16)
+        return false;
+
+    std::vector<int> rest, moved;
+    rest.reserve(count - displacedCount);
+    moved.reserve(displacedCount);
+    bool gap = false;
+    for (int row = 0; row < count; row++)
+    {
+        if (displaced[row])
+        {
+            moved.push_back(current[row]);
+            gap = true;
+            continue;
+        }
+        // neighbors in the original order were already checked, only pairs
+        // brought together by removing displaced items need checking:
+        if (gap && !rest.empty() && !comp(rest.back(), current[row]))
+            return false;
+        gap = false;
+        rest.push_back(current[row]);
+    }
+
+    // Insert the displaced items at their proper places:
+    std::sort(moved.begin(), moved.end(), std::ref(comp));
+
+    std::vector<int> sorted;
+    sorted.reserve(count);
+    auto pos = rest.begin();
+    for (auto index: moved)
+    {
+        auto insertAt = std::lower_bound(pos, rest.end(), index, std::ref(comp));
+        sorted.insert(sorted.end(), pos, insertAt);
+        sorted.push_back(index);
+        pos = insertAt;
+    }
+    sorted.insert(sorted.end(), pos, rest.end());
+
+    // Only update the part that actually changed:
+    while (first < count && sorted[first] == current[first])
+        first++;
+    last = count - 1;
+    while (last > first && sorted[last] == current[last])
+        last--;
+
+    m_mapListToCatalog.swap(sorted);
+    for (int row = first; row <= last; row++)
+        m_mapCatalogToList[m_mapListToCatalog[row]] = row;
+
+    return true;
+}
+
+
 
 
 PoeditListCtrl::PoeditListCtrl(wxWindow *parent, wxWindowID id, bool dispIDs)
@@ -627,7 +858,7 @@ void PoeditListCtrl::CreateColumns()
     m_colID = m_colIcon = m_colSource = m_colTrans = nullptr;
 
 #if defined(__WXMSW__)
-    int iconWidth = wxArtProvider::GetBitmap("StatusError").GetSize().x + 6 /*wxDVC internal padding*/;
+    int iconWidth = IconsCache::GetBitmap("StatusError").GetSize().x + 6 /*wxDVC internal padding*/;
 #else
     int iconWidth = PX(16);
 #endif
@@ -778,7 +1009,7 @@ void PoeditListCtrl::CatalogChanged(const CatalogPtr& catalog)
 {
     wxWindowUpdateLocker no_updates(this);
 
-    const int oldCount = m_model->GetCount();
+    const int oldCount = m_model->GetCatalogCount();
     const int newCount = catalog ? catalog->GetCount() : 0;
     const bool isSameCatalog = (catalog == m_catalog);
     const bool sizeOrCatalogChanged = !isSameCatalog || (oldCount != newCount);
@@ -808,6 +1039,35 @@ void PoeditListCtrl::RefreshAllItems()
     for (int i = 0; i < count; i++)
         items.push_back(m_model->GetItem(i));
     m_model->ItemsChanged(items);
+
+    // any texts may have changed, including of items filtered out:
+    m_model->m_searchIndex.Rebuild();
+}
+
+
+void PoeditListCtrl::RefreshCatalogItems(size_t begin, size_t end)
+{
+    wxDataViewItemArray items;
+    items.reserve(end > begin ? end - begin : 0);
+    for (size_t i = begin; i < end; i++)
+    {
+        auto item = CatalogIndexToListItem(int(i));
+        if (item.IsOk()) // may be filtered out
+            items.push_back(item);
+    }
+    if (!items.empty())
+        m_model->ItemsChanged(items);
+}
+
+
+void PoeditListCtrl::SetFilter(Filter filter)
+{
+    if (filter == m_model->GetFilter())
+        return;
+
+    wxWindowUpdateLocker no_updates(this);
+    SelectionPreserver preserve(this);
+    m_model->SetFilter(filter);
 }
 
 
@@ -30,6 +30,8 @@
 #include <wx/dataview.h>
 #include <wx/frame.h>
 
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 class WXDLLIMPEXP_FWD_CORE wxListCtrl;
@@ -39,6 +41,7 @@ class WXDLLIMPEXP_FWD_CORE wxListEvent;
 #include "cat_sorting.h"
 #include "colorscheme.h"
 #include "language.h"
+#include "search_index.h"
 
 // list control with both columns equally wide:
 class PoeditListCtrl : public wxDataViewCtrl
@@ -131,7 +134,11 @@ class PoeditListCtrl : public wxDataViewCtrl
         {
             wxDataViewItemArray sel;
             for (auto i: selection)
-                sel.push_back(CatalogIndexToListItem(i));
+            {
+                auto item = CatalogIndexToListItem(i);
+                if (item.IsOk()) // may be filtered out
+                    sel.push_back(item);
+            }
             SetSelections(sel);
         }
 
@@ -201,9 +208,13 @@ class PoeditListCtrl : public wxDataViewCtrl
 
         void RefreshAllItems();
 
+        /// Refreshes display of catalog items [begin, end) whose texts didn't change
+        void RefreshCatalogItems(size_t begin, size_t end);
+
         void RefreshItem(const wxDataViewItem& item)
         {
-            m_model->ItemChanged(item);
+            if (item.IsOk())
+                m_model->ItemChanged(item);
         }
 
         int GetCurrentItemListIndex()
@@ -221,6 +232,28 @@ class PoeditListCtrl : public wxDataViewCtrl
         // Order used for sorting
         SortOrder& sortOrder() { return m_model->sortOrder; }
 
+        /// Subsets of the catalog's items that the list can be limited to
+        enum class Filter
+        {
+            All,
+            Unfinished,
+            Untranslated,
+            Fuzzy,
+            Issues
+        };
+
+        /** Shows only items matching @a filter.
+
+            Membership is determined when the filter is set or the catalog
+            changes; items edited in the meantime stay in the list, so that
+            they don't disappear from under the user's hands.
+         */
+        void SetFilter(Filter filter);
+        Filter GetFilter() const { return m_model->GetFilter(); }
+
+        /// Index for finding items containing some text, kept up to date by the list
+        CatalogSearchIndex& searchIndex() { return m_model->m_searchIndex; }
+
     protected:
         void DoFreeze() override;
         void DoThaw() override;
@@ -242,12 +275,23 @@ class PoeditListCtrl : public wxDataViewCtrl
             Model(TextDirection appTextDir);
             virtual ~Model() {}
 
+            /// Forgets cached display values, e.g. after a change to all items
+            void InvalidateCache() { m_cache.clear(); }
+            /// Forgets cached display values of one item
+            void InvalidateCache(const wxDataViewItem& item);
+
             /// Configure items colors & fonts; must be called after ctor.
             void SetVisualMode(ColorScheme::Mode visualMode);
 
             void SetCatalog(CatalogPtr catalog);
             void UpdateSort();
 
+            void SetFilter(Filter filter);
+            Filter GetFilter() const { return m_filter; }
+
+            /// Number of all items in the catalog, including filtered out ones
+            int GetCatalogCount() const { return (int)m_mapCatalogToList.size(); }
+
             unsigned int GetColumnCount() const override { return Col_Max; }
             wxString GetColumnType( unsigned int col ) const override;
 
@@ -280,26 +324,62 @@ class PoeditListCtrl : public wxDataViewCtrl
 
             void CreateSortMap();
 
+            /** Fixes the order after changes to a few items, by moving only
+                the items that are out of order, without sorting everything.
+                Rows in [first, last] are set to those whose items changed.
+                Returns false if the full CreateSortMap() is needed instead. */
+            bool UpdateSortMap(int& first, int& last);
+
             void Freeze() { m_frozen = true; }
             void Thaw() { m_frozen = false; }
 
-            void SetMaxVisibleWidth(int chars) { m_maxVisibleWidth = chars; }
+            void SetMaxVisibleWidth(int chars)
+            {
+                if (chars != m_maxVisibleWidth)
+                    InvalidateCache();
+                m_maxVisibleWidth = chars;
+            }
 
         public:
             CatalogPtr m_catalog;
             SortOrder sortOrder;
+            CatalogSearchIndex m_searchIndex;
+
+        private:
+            class CacheInvalidator;
+
+            // Display strings of an item, as shown in the columns
+            struct CachedRow
+            {
+                wxString id, source, translation;
+            };
+
+            const CachedRow& GetCachedRow(unsigned row, const CatalogItemPtr& d) const;
 
         private:
             bool m_frozen;
             int m_maxVisibleWidth;
+            // only items passing m_filter are mapped to rows, the others
+            // have -1 in m_mapCatalogToList
+            Filter m_filter;
             std::vector<int> m_mapListToCatalog;
             std::vector<int> m_mapCatalogToList;
 
+            // comparator and order used by the last sort:
+            std::unique_ptr<CatalogItemsComparator> m_comparator;
+            SortOrder m_sortedBy;
+
             TextDirection m_sourceTextDir, m_transTextDir, m_appTextDir;
 
             wxColour m_clrID, m_clrInvalid, m_clrFuzzy;
             wxString m_clrContextFg, m_clrContextBg;
             wxIcon m_iconComment, m_iconBookmark, m_iconError, m_iconWarning;
+
+            // Formatting the strings (markup escaping, trimming, bidi marks)
+            // is too expensive to do on every repaint, so visible rows are
+            // cached by catalog index. Any change notified through the model,
+            // e.g. ItemChanged(), invalidates the affected entries.
+            mutable std::unordered_map<int, CachedRow> m_cache;
         };
 
 
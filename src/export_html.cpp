@@ -25,19 +25,84 @@
  */
 
 #include "catalog.h"
+#include "concurrency.h"
 #include "utility.h"
 #include "str_helpers.h"
 
 #include <wx/intl.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
 namespace
 {
 
-inline std::string fmt_trans(const wxString& s)
+// Rows are rendered in chunks of this many items, possibly in parallel,
+// and written in batches of several chunks:
+const size_t ROWS_PER_CHUNK = 256;
+const size_t CHUNKS_PER_BATCH = 64;
+
+// Don't bother with threads for exports that are fast anyway:
+const size_t MIN_PARALLEL_ITEMS = 2 * ROWS_PER_CHUNK;
+
+/**
+    Appends markup-escaped @a s, with line breaks, to @a out as UTF-8.
+
+    This is done in a single pass directly into the output buffer, without
+    creating temporary strings as EscapeMarkup() and conversion would.
+ */
+void AppendTrans(std::string& out, const wxString& s)
 {
-    wxString out = EscapeMarkup(s);
-    out.Replace("\n", "\n<br>");
-    return str::to_utf8(out);
+    const wchar_t *i = s.wc_str();
+    const wchar_t *end = i + s.length();
+    for (; i < end; ++i)
+    {
+        uint32_t c = uint32_t(*i);
+        switch (c)
+        {
+            case '&':  out += "&amp;"; continue;
+            case '<':  out += "&lt;"; continue;
+            case '>':  out += "&gt;"; continue;
+            case '\n': out += "\n<br>"; continue;
+            default: break;
+        }
+
+        if (c < 0x80)
+        {
+            out += char(c);
+            continue;
+        }
+
+        if (sizeof(wchar_t) == 2 && c >= 0xD800 && c < 0xDC00 && i + 1 < end)
+        {
+            const uint32_t low = uint32_t(i[1]);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+        }
+
+        if (c < 0x800)
+        {
+            out += char(0xC0 | (c >> 6));
+            out += char(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            out += char(0xE0 | (c >> 12));
+            out += char(0x80 | ((c >> 6) & 0x3F));
+            out += char(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            out += char(0xF0 | (c >> 18));
+            out += char(0x80 | ((c >> 12) & 0x3F));
+            out += char(0x80 | ((c >> 6) & 0x3F));
+            out += char(0x80 | (c & 0x3F));
+        }
+    }
 }
 
 template<typename T1, typename T2>
@@ -49,14 +114,149 @@ inline void TableRow(std::ostream& f, const T1& col1, const T2& col2)
       << "</tr>\n";
 }
 
+
+/// Renders rows of the translations table for catalog items
+struct HTMLRowsRenderer
+{
+    bool translated;
+    std::string lang_src, lang_tra;
+
+    void Render(std::string& out, const CatalogItem& item) const
+    {
+        const bool hasComments = item.HasComment() || item.HasExtractedComments();
+
+        out += "<tr class='i";
+        if (!item.IsTranslated())
+            out += " untrans";
+        if (item.IsFuzzy())
+            out += " fuzzy";
+        if (hasComments)
+            out += " with-comments";
+        out += "'>\n";
+
+        // Source string:
+        out += "<td class='src' ";
+        out += lang_src;
+        out += ">\n";
+        if (item.HasContext())
+        {
+            out += " <span class='msgctxt'>";
+            AppendTrans(out, item.GetContext());
+            out += "</span>";
+        }
+        if (item.HasPlural())
+        {
+            out += "<ol class='plurals'>\n  <li>";
+            AppendTrans(out, item.GetString());
+            out += "</li>\n  <li>";
+            AppendTrans(out, item.GetPluralString());
+            out += "</li>\n</ol>\n";
+        }
+        else
+        {
+            AppendTrans(out, item.GetString());
+        }
+        out += "</td>\n";
+
+        // Translation:
+        if (translated)
+        {
+            out += "<td class='tra' ";
+            out += lang_tra;
+            out += ">\n";
+            if (item.HasPlural())
+            {
+                if (item.IsTranslated())
+                {
+                    out += "<ol class='plurals'>\n";
+                    for (auto& t: item.GetTranslations())
+                    {
+                        out += "  <li>";
+                        AppendTrans(out, t);
+                        out += "</li>\n";
+                    }
+                    out += "</ol>\n";
+                }
+            }
+            else
+            {
+                AppendTrans(out, item.GetTranslation());
+            }
+            out += "</td>\n";
+        }
+
+        // Notes, if present:
+        if (hasComments)
+        {
+            out += "</tr>\n"
+                   "<tr class='comments'>\n"
+                   "  <td colspan='";
+            out += translated ? "2" : "1";
+            out += "'><div>";
+            if (item.HasExtractedComments())
+            {
+                out += "<p>\n";
+                for (auto& n: item.GetExtractedComments())
+                {
+                    AppendTrans(out, n);
+                    out += "<br>\n";
+                }
+                out += "</p>\n";
+            }
+            if (item.HasComment())
+            {
+                out += "<p>\n";
+                AppendTrans(out, item.GetComment());
+                out += "</p>\n";
+            }
+            out += "</div></td>\n";
+        }
+
+        out += "</tr>\n";
+    }
+
+    /// Renders [begin, end) of @a items into @a out, reusing its capacity
+    void RenderChunk(std::string& out, const CatalogItemArray& items, size_t begin, size_t end) const
+    {
+        out.clear();
+        for (size_t i = begin; i < end; i++)
+            Render(out, *items[i]);
+    }
+};
+
 extern const char *CSS_STYLE;
 
 } // anonymous namespace
 
 void Catalog::ExportToHTML(std::ostream& f)
+{
+    ExportStatistics stats;
+    GetStatistics(&stats.all, &stats.fuzzy, nullptr, &stats.untranslated, &stats.unfinished);
+    PrecomputeTextCounts();
+    auto textStats = GetTextStatistics();
+    stats.words = (int)textStats.all.words;
+    stats.unfinishedWords = (int)textStats.unfinished.words;
+    DoExportToHTML(f, stats, 0);
+}
+
+
+void Catalog::ExportPreviewToHTML(std::ostream& f, const ExportStatistics& fileStats)
+{
+    DoExportToHTML(f, fileStats, std::max(0, fileStats.all - (int)items().size()));
+}
+
+
+void Catalog::DoExportToHTML(std::ostream& f, const ExportStatistics& stats, int omitted)
 {
     const bool translated = HasCapability(Catalog::Cap::Translations);
 
+    auto wordsSuffix = [](int words) -> std::string
+    {
+        if (words < 0)
+            return std::string();
+        return " (" + str::to_utf8(wxString::Format(wxPLURAL("%d word", "%d words", words), words)) + ")";
+    };
+
     f << "<!DOCTYPE html>\n"
          "<html>\n"
          "<head>\n"
@@ -81,11 +281,10 @@ void Catalog::ExportToHTML(std::ostream& f)
     // Statistics:
     if (translated)
     {
-        int all = 0;
-        int fuzzy = 0;
-        int untranslated = 0;
-        int unfinished = 0;
-        GetStatistics(&all, &fuzzy, nullptr, &untranslated, &unfinished);
+        const int all = stats.all;
+        const int fuzzy = stats.fuzzy;
+        const int untranslated = stats.untranslated;
+        const int unfinished = stats.unfinished;
         int percent = (all == 0 ) ? 0 : (100 * (all - unfinished) / all);
 
         f << "<div class='stats'>\n"
@@ -100,19 +299,19 @@ void Catalog::ExportToHTML(std::ostream& f)
           << "  <div class='legend'>";
         f << str::to_utf8(wxString::Format(_("Translated: %d of %d (%d %%)"), all - unfinished, all, percent));
         if (unfinished > 0)
-            f << str::to_utf8(L"  •  ") << str::to_utf8(wxString::Format(_("Remaining: %d"), unfinished));
+            f << str::to_utf8(L"  •  ") << str::to_utf8(wxString::Format(_("Remaining: %d"), unfinished)) << wordsSuffix(stats.unfinishedWords);
         f << "  </div>\n"
           << "</div>\n";
     }
     else
     {
-        int all = (int)items().size();
+        const int all = stats.all;
         f << "<div class='stats'>\n"
           << "  <div class='graph'>\n"
           << "    <div class='percent-untrans' style='width: 100%'>&nbsp;</div>\n"
           << "  </div>\n"
           << "  <div class='legend'>"
-          << str::to_utf8(wxString::Format(wxPLURAL("%d entry", "%d entries", all), all))
+          << str::to_utf8(wxString::Format(wxPLURAL("%d entry", "%d entries", all), all)) << wordsSuffix(stats.words)
           << "  </div>\n"
           << "</div>\n";
     }
@@ -147,85 +346,53 @@ void Catalog::ExportToHTML(std::ostream& f)
          "  </thead>\n"
          "  <tbody>\n";
 
-    for (auto& item: items())
-    {
-        bool hasComments = item->HasComment() || item->HasExtractedComments();
+    HTMLRowsRenderer renderer;
+    renderer.translated = translated;
+    renderer.lang_src = lang_src;
+    renderer.lang_tra = lang_tra;
 
-        std::string klass("i");
-        if (!item->IsTranslated())
-            klass += " untrans";
-        if (item->IsFuzzy())
-            klass += " fuzzy";
-        if (hasComments)
-            klass += " with-comments";
-        f << "<tr class='" << klass << "'>\n";
+    auto& all = items();
+    const size_t count = all.size();
 
-        // Source string:
-        f << "<td class='src' " << lang_src << ">\n";
-        if (item->HasContext())
-            f << " <span class='msgctxt'>" << fmt_trans(item->GetContext()) << "</span>";
-        if (item->HasPlural())
-        {
-            f << "<ol class='plurals'>\n"
-              << "  <li>" << fmt_trans(item->GetString()) << "</li>\n"
-              << "  <li>" << fmt_trans(item->GetPluralString()) << "</li>\n"
-              << "</ol>\n";
-        }
-        else
-        {
-            f << fmt_trans(item->GetString());
-        }
-        f << "</td>\n";
+    if (count < MIN_PARALLEL_ITEMS)
+    {
+        std::string buffer;
+        renderer.RenderChunk(buffer, all, 0, count);
+        f.write(buffer.data(), buffer.size());
+    }
+    else
+    {
+        // Render chunks of a batch concurrently into separate buffers, which
+        // are kept between batches, and write them out in order:
+        std::vector<std::string> buffers(CHUNKS_PER_BATCH);
+        dispatch::parallel_options options;
+        options.chunk_size = 1;
 
-        // Translation:
-        if (translated)
+        for (size_t batch = 0; batch < count; batch += ROWS_PER_CHUNK * CHUNKS_PER_BATCH)
         {
-            f << "<td class='tra' " << lang_tra << ">\n";
-            if (item->HasPlural())
+            const size_t chunks = std::min(CHUNKS_PER_BATCH, (count - batch + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK);
+            dispatch::parallel_for(0, chunks, [&](size_t c)
             {
-                if (item->IsTranslated())
-                {
-                    f << "<ol class='plurals'>\n";
-                    for (auto t: item->GetTranslations())
-                        f << "  <li>" << fmt_trans(t) << "</li>\n";
-                    f << "</ol>\n";
-                }
-            }
-            else
-            {
-                f << fmt_trans(item->GetTranslation());
-            }
-            f << "</td>\n";
-        }
+                const size_t begin = batch + c * ROWS_PER_CHUNK;
+                renderer.RenderChunk(buffers[c], all, begin, std::min(count, begin + ROWS_PER_CHUNK));
+            }, options);
 
-        // Notes, if present:
-        if (hasComments)
-        {
-            f << "</tr>\n"
-              << "<tr class='comments'>\n"
-              << "  <td colspan='" << (translated ? 2 : 1) << "'><div>";
-            if (item->HasExtractedComments())
-            {
-                f << "<p>\n";
-                for (auto& n: item->GetExtractedComments())
-                    f << fmt_trans(n) << "<br>\n";
-                f << "</p>\n";
-            }
-            if (item->HasComment())
-            {
-                f << "<p>\n"
-                  << fmt_trans(item->GetComment())
-                  << "</p>\n";
-            }
-            f << "</div></td>\n";
+            for (size_t c = 0; c < chunks; c++)
+                f.write(buffers[c].data(), buffers[c].size());
         }
-
-        f << "</tr>\n";
     }
 
     f << "</tbody>\n"
-         "</table>\n"
-         "</div>\n"
+         "</table>\n";
+
+    if (omitted > 0)
+    {
+        f << "<p class='omitted'>"
+          << str::to_utf8(wxString::Format(wxPLURAL(L"…and %d more entry.", L"…and %d more entries.", omitted), omitted))
+          << "</p>\n";
+    }
+
+    f << "</div>\n"
          "</body>\n"
          "</html>\n";
 }
@@ -365,6 +532,13 @@ tr.comments div {
 tr.comments div p:last-child { margin-bottom: 0; }
 tr.comments td { padding-top: 0; }
 
+.omitted {
+  padding-top: 10px;
+  font-size: smaller;
+  color: #aaa;
+  text-align: center;
+}
+
 .fuzzy .tra {
   color: rgb(218, 123, 0);
 }
@@ -0,0 +1,421 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE. 
+ *
+ */
+
+#include "extraction_cache.h"
+
+#include "str_helpers.h"
+#include "utility.h"
+#include "version.h"
+
+#include <wx/dir.h>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/stdpaths.h>
+#include <wx/tokenzr.h>
+#include <wx/utils.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+
+namespace
+{
+
+// Bump whenever the format of cached entries changes:
+const char *CACHE_FORMAT_VERSION = "1";
+
+// gettext wraps filenames with spaces in these (FSI and PDI, in UTF-8):
+const char *FIRST_STRONG_ISOLATE = "\xE2\x81\xA8";
+const char *POP_DIRECTIONAL_ISOLATE = "\xE2\x81\xA9";
+
+
+uint64_t HashBytes(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    // 64bit FNV-1a; fast, and good enough to detect a changed file
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// Incremental hashing of several values, separated from each other
+class Hasher
+{
+public:
+    Hasher& Add(const std::string& s)
+    {
+        m_hash = HashBytes(s.data(), s.size() + 1 /*including NUL*/, m_hash);
+        return *this;
+    }
+
+    Hasher& Add(const wxString& s) { return Add(str::to_utf8(s)); }
+
+    std::string Hex() const
+    {
+        return str::to_utf8(wxString::Format("%016llx", (unsigned long long)m_hash));
+    }
+
+private:
+    uint64_t m_hash = 14695981039346656037ULL;
+};
+
+
+wxString GetCacheDir()
+{
+    wxString cache;
+#if defined(__WXOSX__)
+    cache = wxGetHomeDir() + "/Library/Caches/net.poedit.Poedit";
+#elif defined(__UNIX__)
+    if (!wxGetEnv("XDG_CACHE_HOME", &cache))
+        cache = wxGetHomeDir() + "/.cache";
+    cache += "/poedit";
+#else
+    cache = wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "Cache";
+#endif
+    cache += wxFILE_SEP_PATH;
+    cache += "Extraction";
+    return cache;
+}
+
+
+bool ReadFile(const wxString& filename, std::string& data)
+{
+    wxFFile f(filename, "rb");
+    if (!f.IsOpened())
+        return false;
+    const auto len = f.Length();
+    if (len < 0)
+        return false;
+    data.resize(size_t(len));
+    return len == 0 || f.Read(&data[0], data.size()) == data.size();
+}
+
+
+bool WriteFileAtomically(const wxString& filename, const std::string& data)
+{
+    // write atomically, so that a concurrently running Poedit instance
+    // never sees incomplete data:
+    wxString tmp = filename + ".tmp";
+    bool written = false;
+    {
+        wxFFile f(tmp, "wb");
+        if (f.IsOpened())
+        {
+            written = data.empty() || f.Write(data.data(), data.size()) == data.size();
+            written = f.Close() && written;
+        }
+    }
+    if (!written || !wxRenameFile(tmp, filename, /*overwrite=*/true))
+    {
+        wxRemoveFile(tmp);
+        return false;
+    }
+    return true;
+}
+
+
+/// Splits POT file's content into entries, i.e. blocks separated by blank lines.
+std::vector<std::vector<std::string>> SplitIntoEntries(const std::string& pot)
+{
+    std::vector<std::vector<std::string>> entries;
+    std::vector<std::string> current;
+
+    size_t pos = 0;
+    while (pos < pot.size())
+    {
+        auto end = pot.find('\n', pos);
+        if (end == std::string::npos)
+            end = pot.size();
+        auto line = pot.substr(pos, end - pos);
+        pos = end + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (line.empty())
+        {
+            if (!current.empty())
+                entries.push_back(std::move(current));
+            current.clear();
+        }
+        else
+        {
+            current.push_back(std::move(line));
+        }
+    }
+    if (!current.empty())
+        entries.push_back(std::move(current));
+
+    return entries;
+}
+
+
+/// Parses references from a "#:" line into (reference, filename) pairs.
+std::vector<std::pair<std::string, std::string>> ParseReferences(const std::string& line)
+{
+    std::vector<std::pair<std::string, std::string>> refs;
+
+    size_t pos = 2; // skip "#:"
+    while (pos < line.size())
+    {
+        if (line[pos] == ' ' || line[pos] == '\t')
+        {
+            pos++;
+            continue;
+        }
+
+        size_t end;
+        std::string path;
+        if (line.compare(pos, 3, FIRST_STRONG_ISOLATE) == 0)
+        {
+            end = line.find(POP_DIRECTIONAL_ISOLATE, pos + 3);
+            if (end == std::string::npos)
+                return {};
+            path = line.substr(pos + 3, end - pos - 3);
+            end += 3;
+            end = std::min(line.find(' ', end), line.size());
+        }
+        else
+        {
+            end = std::min(line.find(' ', pos), line.size());
+            path = line.substr(pos, end - pos);
+            // strip line number:
+            auto colon = path.rfind(':');
+            if (colon != std::string::npos && colon + 1 < path.size() &&
+                path.find_first_not_of("0123456789", colon + 1) == std::string::npos)
+            {
+                path.erase(colon);
+            }
+        }
+
+        refs.emplace_back(line.substr(pos, end - pos), path);
+        pos = end;
+    }
+
+    return refs;
+}
+
+} // anonymous namespace
+
+
+ExtractionCache::ExtractionCache(const Extractor& extractor, const SourceCodeSpec& sourceSpec)
+    : m_basePath(sourceSpec.BasePath)
+{
+    Hasher project;
+    project.Add(std::string(CACHE_FORMAT_VERSION))
+           .Add(std::string(POEDIT_VERSION))
+           .Add(extractor.GetId())
+           .Add(wxFileName(sourceSpec.BasePath).GetAbsolutePath())
+           .Add(sourceSpec.Charset);
+    for (auto& k: sourceSpec.Keywords)
+        project.Add(k);
+    // only options, not e.g. the revision date, which changes on every save:
+    for (auto& h: sourceSpec.GetExtractionHeaders())
+        project.Add(h.first).Add(h.second);
+
+    m_projectKey = project.Hex();
+    m_dir = GetCacheDir() + wxFILE_SEP_PATH + wxString::FromUTF8(m_projectKey.c_str());
+}
+
+
+bool ExtractionCache::CanBeUsedWith(const SourceCodeSpec& sourceSpec)
+{
+    auto extraFlags = sourceSpec.XHeaders.find("X-Poedit-Flags-xgettext");
+    if (extraFlags == sourceSpec.XHeaders.end())
+        return true;
+
+    // Options that make the output something else than the concatenation
+    // of per-file results:
+    wxStringTokenizer tok(extraFlags->second, " \t", wxTOKEN_STRTOK);
+    while (tok.HasMoreTokens())
+    {
+        auto flag = tok.GetNextToken();
+        if (flag == "-s" || flag == "-F" || flag == "-j" || flag == "-x" ||
+            flag.StartsWith("--sort") ||
+            flag.StartsWith("--no-location") ||
+            flag.StartsWith("--omit-header") ||
+            flag.StartsWith("--join-existing") ||
+            flag.StartsWith("--exclude-file"))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+std::string ExtractionCache::GetKey(const wxString& file) const
+{
+    wxLogNull null;
+
+    MemoryMappedFile content(m_basePath + file);
+    if (!content.IsOk())
+        return std::string();
+
+    const auto contentHash = HashBytes(content.data(), content.size());
+
+    Hasher key;
+    key.Add(m_projectKey)
+       .Add(file)
+       .Add(std::string(reinterpret_cast<const char*>(&contentHash), sizeof(contentHash)));
+    return key.Hex();
+}
+
+
+wxString ExtractionCache::GetEntryFileName(const std::string& key) const
+{
+    return m_dir + wxFILE_SEP_PATH + wxString::FromUTF8(key.c_str()) + ".pot";
+}
+
+
+wxString ExtractionCache::Get(const std::string& key) const
+{
+    if (key.empty())
+        return wxString();
+    auto fn = GetEntryFileName(key);
+    return wxFileName::FileExists(fn) ? fn : wxString();
+}
+
+
+bool ExtractionCache::Store(const wxString& potFile, const Extractor::FilesList& files,
+                            const std::vector<std::string>& keys)
+{
+    wxLogNull null;
+
+    std::string pot;
+    if (!ReadFile(potFile, pot))
+        return false;
+
+    auto entries = SplitIntoEntries(pot);
+    if (entries.empty())
+        return false;
+
+    // the header is the first entry, with empty msgid and no references:
+    auto& header = entries.front();
+    if (std::find(header.begin(), header.end(), "msgid \"\"") == header.end())
+        return false;
+
+    std::unordered_map<std::string, size_t> fileIndex;
+    for (size_t i = 0; i < files.size(); i++)
+        fileIndex.emplace(str::to_utf8(files[i]), i);
+
+    std::vector<std::string> perFile(files.size());
+
+    for (size_t e = 1; e < entries.size(); e++)
+    {
+        auto& entry = entries[e];
+
+        // group entry's references by file, preserving their order:
+        std::vector<std::pair<size_t, std::string>> refsByFile;
+        size_t refsLine = std::string::npos;
+        for (size_t l = 0; l < entry.size(); l++)
+        {
+            if (entry[l].compare(0, 2, "#:") != 0)
+                continue;
+            if (refsLine == std::string::npos)
+                refsLine = l;
+            for (auto& r: ParseReferences(entry[l]))
+            {
+                auto idx = fileIndex.find(r.second);
+                if (idx == fileIndex.end())
+                {
+                    wxLogTrace("poedit.extractor", "cache: unknown file '%s' in references", wxString::FromUTF8(r.second.c_str()));
+                    return false;
+                }
+                auto existing = std::find_if(refsByFile.begin(), refsByFile.end(),
+                                             [&idx](const std::pair<size_t, std::string>& x){ return x.first == idx->second; });
+                if (existing == refsByFile.end())
+                    refsByFile.emplace_back(idx->second, "#: " + r.first);
+                else
+                    existing->second += " " + r.first;
+            }
+        }
+
+        // strings without references can't be assigned to any file:
+        if (refsByFile.empty())
+            return false;
+
+        for (auto& fr: refsByFile)
+        {
+            auto& out = perFile[fr.first];
+            out += '\n';
+            for (size_t l = 0; l < entry.size(); l++)
+            {
+                if (l == refsLine)
+                    out += fr.second + '\n';
+                else if (entry[l].compare(0, 2, "#:") != 0)
+                    out += entry[l] + '\n';
+            }
+        }
+    }
+
+    std::string headerText;
+    for (auto& l: header)
+        headerText += l + '\n';
+
+    if (!wxFileName::DirExists(m_dir))
+        wxFileName::Mkdir(m_dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (keys[i].empty())
+            continue;
+        // failures are harmless, the file will be simply extracted next time:
+        WriteFileAtomically(GetEntryFileName(keys[i]), headerText + perFile[i]);
+    }
+
+    return true;
+}
+
+
+void ExtractionCache::RemoveUnused(const std::vector<std::string>& keys)
+{
+    wxLogNull null;
+
+    wxDir dir(m_dir);
+    if (!dir.IsOpened())
+        return;
+
+    std::set<wxString> used;
+    for (auto& k: keys)
+        used.insert(wxString::FromUTF8(k.c_str()) + ".pot");
+
+    std::vector<wxString> unused;
+    wxString filename;
+    bool cont = dir.GetFirst(&filename, "*.pot", wxDIR_FILES);
+    while (cont)
+    {
+        if (used.find(filename) == used.end())
+            unused.push_back(filename);
+        cont = dir.GetNext(&filename);
+    }
+
+    for (auto& f: unused)
+        wxRemoveFile(m_dir + wxFILE_SEP_PATH + f);
+}
@@ -0,0 +1,84 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE. 
+ *
+ */
+
+#ifndef Poedit_extraction_cache_h
+#define Poedit_extraction_cache_h
+
+#include "extractor.h"
+
+#include <string>
+#include <vector>
+
+
+/**
+    On-disk cache of strings extracted from individual source files.
+
+    Entries are per-file POT files, stored separately for every project and
+    extractor and keyed by the file's path and a hash of its content, so that
+    only modified files need to be processed again when updating from sources.
+    The project part of the key covers everything else that affects the
+    output: the extractor, keywords, charset and extra xgettext flags.
+ */
+class ExtractionCache
+{
+public:
+    ExtractionCache(const Extractor& extractor, const SourceCodeSpec& sourceSpec);
+
+    /// Can extraction results for @a sourceSpec be split into per-file parts?
+    static bool CanBeUsedWith(const SourceCodeSpec& sourceSpec);
+
+    /** Returns key identifying the current content of @a file (relative
+        to the base path). Empty if the file can't be read.
+
+        Is thread-safe.
+     */
+    std::string GetKey(const wxString& file) const;
+
+    /** Returns filename of the cached POT for @a key or empty string if not
+        cached. Files without any strings have header-only POTs cached.
+     */
+    wxString Get(const std::string& key) const;
+
+    /** Splits @a potFile, extracted from @a files, into per-file entries
+        stored under the corresponding @a keys.
+
+        Returns false if the POT can't be split, e.g. because it lacks
+        references to source files; nothing is stored in that case.
+     */
+    bool Store(const wxString& potFile, const Extractor::FilesList& files,
+               const std::vector<std::string>& keys);
+
+    /// Removes entries not listed in @a keys, i.e. those for stale content.
+    void RemoveUnused(const std::vector<std::string>& keys);
+
+private:
+    wxString GetEntryFileName(const std::string& key) const;
+
+    wxString m_basePath;
+    wxString m_dir;
+    std::string m_projectKey;
+};
+
+#endif // Poedit_extraction_cache_h
@@ -25,11 +25,17 @@
 
 #include "extractor.h"
 
+#include "extraction_cache.h"
 #include "extractor_legacy.h"
 
-#include "gexecute.h"
+#include "catalog_po.h"
+#include "concurrency.h"
+#include "str_helpers.h"
+#include "tracing.h"
 
 #include <wx/dir.h>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
 #include <wx/filename.h>
 
 #include <algorithm>
@@ -39,43 +45,67 @@ namespace
 
 // Path matching with support for wildcards
 
-struct PathToMatch
+struct WildcardPath
 {
-    wxString path;
-    bool isWildcard;
+    explicit WildcardPath(const wxString& p)
+        : pattern(p), prefix(p.substr(0, p.find_first_of("*?")))
+    {}
 
     bool MatchesFile(const wxString& fn) const
     {
-        if (isWildcard)
-            return wxMatchWild(path, fn);
-        else
-            return fn == path || fn.StartsWith(path + "/");
+        // cheap check of the literal part first, most paths fail it:
+        return fn.StartsWith(prefix) && wxMatchWild(pattern, fn);
     }
+
+    wxString pattern;
+    wxString prefix;
 };
 
+/**
+    Set of paths (files or directories, possibly with wildcards) to match
+    against, prepared so that matching many files against many paths is
+    cheap: non-wildcard paths are looked up directly instead of being
+    compared with every file one by one.
+ */
 class PathsToMatch
 {
 public:
     PathsToMatch() {}
     explicit PathsToMatch(const wxArrayString& a)
     {
-        paths.reserve(a.size());
         for (auto& p: a)
-            paths.push_back({p, wxIsWild(p)});
+        {
+            if (wxIsWild(p))
+                wildcards.emplace_back(p);
+            else
+                paths.insert(p);
+        }
     }
 
     bool MatchesFile(const wxString& fn) const
     {
-        for (auto& p: paths)
+        if (!paths.empty())
         {
-            if (p.MatchesFile(fn))
+            // the file itself or any directory containing it:
+            if (paths.find(fn) != paths.end())
+                return true;
+            for (size_t pos = fn.find('/'); pos != wxString::npos; pos = fn.find('/', pos + 1))
+            {
+                if (paths.find(fn.substr(0, pos)) != paths.end())
+                    return true;
+            }
+        }
+        for (auto& w: wildcards)
+        {
+            if (w.MatchesFile(fn))
                 return true;
         }
         return false;
     }
 
 private:
-    std::vector<PathToMatch> paths;
+    std::set<wxString> paths;
+    std::vector<WildcardPath> wildcards;
 };
 
 inline void CheckReadPermissions(const wxString& basepath, const wxString& path)
@@ -92,23 +122,27 @@ inline bool IsVCSDir(const wxString& d)
 }
 
 
-int FindInDir(const wxString& basepath, const wxString& dirname, const PathsToMatch& excludedPaths,
-              Extractor::FilesList& output)
+/// Files and subdirectories found in one directory, relative to the base path
+struct DirContents
 {
-    if (dirname.empty())
-        return 0;
+    Extractor::FilesList files;
+    std::vector<wxString> subdirs;
+};
+
+DirContents ReadDir(const wxString& basepath, const wxString& dirname, const PathsToMatch& excludedPaths)
+{
+    DirContents contents;
 
     wxDir dir(basepath + dirname);
 
     CheckReadPermissions(basepath, dirname);
 
     if (!dir.IsOpened())
-        return 0;
+        return contents;
 
     bool cont;
     wxString filename;
-    int found = 0;
-    
+
     cont = dir.GetFirst(&filename, wxEmptyString, wxDIR_FILES);
     while (cont)
     {
@@ -120,8 +154,7 @@ int FindInDir(const wxString& basepath, const wxString& dirname, const PathsToMa
 
         CheckReadPermissions(basepath, f);
         wxLogTrace("poedit.extractor", "  - %s", f);
-        output.push_back(f);
-        found++;
+        contents.files.push_back(f);
     }
 
     cont = dir.GetFirst(&filename, wxEmptyString, wxDIR_DIRS);
@@ -133,11 +166,54 @@ int FindInDir(const wxString& basepath, const wxString& dirname, const PathsToMa
         if (IsVCSDir(filename))
             continue;
 
+        // excluded directories are pruned without looking inside:
         if (excludedPaths.MatchesFile(f))
             continue;
 
         CheckReadPermissions(basepath, f);
-        found += FindInDir(basepath, f, excludedPaths, output);
+        contents.subdirs.push_back(f);
+    }
+
+    return contents;
+}
+
+
+int FindInDir(const wxString& basepath, const wxString& dirname, const PathsToMatch& excludedPaths,
+              Extractor::FilesList& output, dispatch::progress_monitor *progress)
+{
+    if (dirname.empty())
+        return 0;
+
+    // Walk the tree one level at a time, reading all directories of the level
+    // concurrently; this matters a lot on slow (e.g. network) filesystems.
+    // The order of found files doesn't matter, they are sorted afterwards.
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    if (progress)
+        options.token = progress->token();
+
+    int found = 0;
+    std::vector<wxString> level { dirname };
+    while (!level.empty())
+    {
+        auto contents = dispatch::parallel_transform(0, level.size(), [&](size_t i)
+        {
+            auto c = ReadDir(basepath, level[i], excludedPaths);
+            if (progress)
+                progress->advance(c.files.size());
+            return c;
+        }, options);
+        if (progress && progress->is_cancelled())
+            throw ExtractionException(ExtractionError::Cancelled);
+
+        std::vector<wxString> next;
+        for (auto& c: contents)
+        {
+            found += int(c.files.size());
+            output.insert(output.end(), c.files.begin(), c.files.end());
+            next.insert(next.end(), c.subdirs.begin(), c.subdirs.end());
+        }
+        level.swap(next);
     }
 
     return found;
@@ -146,7 +222,48 @@ int FindInDir(const wxString& basepath, const wxString& dirname, const PathsToMa
 } // anonymous namespace
 
 
-Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources)
+std::map<wxString, wxString> SourceCodeSpec::GetExtractionHeaders() const
+{
+    std::map<wxString, wxString> headers;
+    for (auto& h: XHeaders)
+    {
+        // bookmarks are the only Poedit header that has nothing to do with sources:
+        if (h.first.StartsWith("X-Poedit-") && h.first != "X-Poedit-Bookmarks")
+            headers.insert(h);
+    }
+    return headers;
+}
+
+
+std::string SourceCodeSpec::GetExtractionKey() const
+{
+    // values are separated with NULs, which they can't contain:
+    std::string key;
+    auto add = [&key](const wxString& s)
+    {
+        key += str::to_utf8(s);
+        key += '\0';
+    };
+
+    add(wxFileName(BasePath).GetAbsolutePath());
+    add(Charset);
+    for (auto& list: {&SearchPaths, &ExcludedPaths, &Keywords})
+    {
+        for (auto& i: *list)
+            add(i);
+        key += '\1';
+    }
+    for (auto& h: GetExtractionHeaders())
+    {
+        add(h.first);
+        add(h.second);
+    }
+    return key;
+}
+
+
+Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources,
+                                                dispatch::progress_monitor *progress)
 {
     // TODO: Only collect files with recognized extensions
 
@@ -169,10 +286,12 @@ Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources)
             CheckReadPermissions(basepath, path);
             wxLogTrace("poedit.extractor", "  - %s", path);
             output.push_back(path);
+            if (progress)
+                progress->advance();
         }
         else if (wxFileName::DirExists(basepath + path))
         {
-            if (!FindInDir(basepath, path, excludedPaths, output))
+            if (!FindInDir(basepath, path, excludedPaths, output, progress))
             {
                 wxLogTrace("poedit.extractor", "no files found in '%s'", path);
             }
@@ -197,23 +316,36 @@ Extractor::FilesList Extractor::CollectAllFiles(const SourceCodeSpec& sources)
 
 wxString Extractor::ExtractWithAll(TempDirectory& tmpdir,
                                    const SourceCodeSpec& sourceSpec,
-                                   const std::vector<wxString>& files_)
+                                   const std::vector<wxString>& files_,
+                                   dispatch::progress_monitor *progress,
+                                   FilesList *changedFiles)
 {
+    TRACE_SCOPE("Extractor::ExtractWithAll");
+
     auto files = files_;
     wxLogTrace("poedit.extractor", "extracting from %d files", (int)files.size());
 
-    std::vector<wxString> subPots;
+    // files not recognized by any extractor are accounted for at the end:
+    if (progress)
+        progress->reset(files.size());
+
+    // Assign files to extractors first; each file is handled by the first
+    // extractor that supports it, so the sets are disjoint:
+    std::vector<std::pair<std::shared_ptr<Extractor>, FilesList>> jobs;
 
     for (auto ex: CreateAllExtractors())
     {
-        const auto ex_files = ex->FilterFiles(files);
+        if (!ex->SupportsSourceSpec(sourceSpec))
+        {
+            wxLogTrace("poedit.extractor", " .. extractor '%s' can't be used with these settings", ex->GetId());
+            continue;
+        }
+
+        auto ex_files = ex->FilterFiles(files);
         if (ex_files.empty())
             continue;
 
         wxLogTrace("poedit.extractor", " .. using extractor '%s' for %d files", ex->GetId(), (int)ex_files.size());
-        auto subPot = ex->Extract(tmpdir, sourceSpec, ex_files);
-        if (!subPot.empty())
-            subPots.push_back(subPot);
 
         if (files.size() > ex_files.size())
         {
@@ -228,11 +360,52 @@ wxString Extractor::ExtractWithAll(TempDirectory& tmpdir,
         else
         {
             files.clear();
-            break; // no more work to do
         }
+
+        jobs.emplace_back(ex, std::move(ex_files));
+        if (files.empty())
+            break; // no more work to do
+    }
+
+    // ...and then run all of them concurrently, so that mixed-language projects
+    // take as long as the slowest extractor and not the sum of all:
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    if (progress)
+        options.token = progress->token();
+
+    std::vector<FilesList> changed(jobs.size());
+    auto results = dispatch::parallel_transform(0, jobs.size(), [&](size_t i)
+    {
+        auto& ex = jobs[i].first;
+        auto& ex_files = jobs[i].second;
+        if (ex->SupportsCaching() && ExtractionCache::CanBeUsedWith(sourceSpec))
+            return ex->ExtractWithCache(tmpdir, sourceSpec, ex_files, progress, changed[i]);
+        changed[i] = ex_files;
+        return ex->Extract(tmpdir, sourceSpec, ex_files, progress);
+    }, options);
+
+    CheckCancelled(progress);
+
+    if (changedFiles)
+    {
+        changedFiles->clear();
+        for (auto& c: changed)
+            changedFiles->insert(changedFiles->end(), c.begin(), c.end());
+        std::sort(changedFiles->begin(), changedFiles->end());
+    }
+
+    // keep the order of extractors' precedence in the output:
+    std::vector<wxString> subPots;
+    for (auto& pot: results)
+    {
+        if (!pot.empty())
+            subPots.push_back(pot);
     }
 
     wxLogTrace("poedit.extractor", "extraction finished with %d unrecognized files and %d sub-POTs", (int)files.size(), (int)subPots.size());
+    if (progress)
+        progress->advance(files.size());
 
     if (subPots.empty())
     {
@@ -250,6 +423,92 @@ wxString Extractor::ExtractWithAll(TempDirectory& tmpdir,
 }
 
 
+wxString Extractor::ExtractWithCache(TempDirectory& tmpdir,
+                                     const SourceCodeSpec& sourceSpec,
+                                     const FilesList& files,
+                                     dispatch::progress_monitor *progress,
+                                     FilesList& changedFiles) const
+{
+    ExtractionCache cache(*this, sourceSpec);
+
+    // until known otherwise, everything is extracted anew:
+    changedFiles = files;
+
+    auto keys = dispatch::parallel_transform(0, files.size(), [&](size_t i)
+    {
+        return cache.GetKey(files[i]);
+    });
+
+    FilesList modified;
+    std::vector<std::string> modifiedKeys;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        // unreadable files are left for Extract() to deal with:
+        if (keys[i].empty())
+            return Extract(tmpdir, sourceSpec, files, progress);
+        if (cache.Get(keys[i]).empty())
+        {
+            modified.push_back(files[i]);
+            modifiedKeys.push_back(keys[i]);
+        }
+    }
+
+    wxLogTrace("poedit.extractor", " .. %d of %d files not in extraction cache", (int)modified.size(), (int)files.size());
+
+    if (progress)
+        progress->advance(files.size() - modified.size());
+
+    changedFiles = modified;
+
+    if (!modified.empty())
+    {
+        auto pot = Extract(tmpdir, sourceSpec, modified, progress);
+        if (pot.empty())
+            return pot;
+        if (!cache.Store(pot, modified, modifiedKeys))
+        {
+            wxLogTrace("poedit.extractor", " .. output of '%s' can't be cached", GetId());
+            changedFiles = files;
+            return modified.size() == files.size() ? pot : Extract(tmpdir, sourceSpec, files, progress);
+        }
+    }
+
+    std::vector<wxString> parts;
+    parts.reserve(files.size());
+    for (auto& k: keys)
+    {
+        auto part = cache.Get(k);
+        if (part.empty())
+        {
+            changedFiles = files;
+            return Extract(tmpdir, sourceSpec, files, progress); // removed concurrently
+        }
+        parts.push_back(part);
+    }
+
+    cache.RemoveUnused(keys);
+
+    if (parts.size() > 1)
+        return ConcatCatalogs(tmpdir, parts);
+
+    // don't let the caller modify the cache entry:
+    auto outfile = tmpdir.CreateFileName(GetId() + "_cached.pot");
+    if (!wxCopyFile(parts.front(), outfile))
+    {
+        changedFiles = files;
+        return Extract(tmpdir, sourceSpec, files, progress);
+    }
+    return outfile;
+}
+
+
+void Extractor::CheckCancelled(const dispatch::progress_monitor *progress)
+{
+    if (progress && progress->is_cancelled())
+        throw ExtractionException(ExtractionError::Cancelled);
+}
+
+
 Extractor::FilesList Extractor::FilterFiles(const FilesList& files) const
 {
     FilesList out;
@@ -324,16 +583,34 @@ wxString Extractor::ConcatCatalogs(TempDirectory& tmpdir, const std::vector<wxSt
 
     auto outfile = tmpdir.CreateFileName("concatenated.pot");
 
-    wxString list;
-    for (auto& f: files)
-        list += wxString::Format(" %s", QuoteCmdlineArg(f));
+    // Merge the catalogs in-process instead of running msgcat; entries are
+    // kept in the order of files, with duplicates merged into the first one:
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    auto catalogs = dispatch::parallel_transform(0, files.size(), [&files](size_t i)
+    {
+        return std::make_shared<POCatalog>(files[i], Catalog::CreationFlag_IgnoreHeader);
+    }, options);
+
+    auto merged = catalogs.front();
+    for (auto& cat: catalogs)
+    {
+        if (!cat->IsOk())
+        {
+            wxLogError(_("Failed to merge gettext catalogs."));
+            throw ExtractionException(ExtractionError::Unspecified);
+        }
+        if (cat != merged)
+            merged->AppendCatalog(*cat);
+    }
+    merged->FixDuplicateItems();
 
-    auto cmd = wxString::Format("msgcat --force-po -o %s %s", QuoteCmdlineArg(outfile), list);
-    bool succ = ExecuteGettext(cmd);
+    merged->Header().Charset = "UTF-8";
+    const auto data = merged->SaveToBuffer();
 
-    if (!succ)
+    wxFFile f(outfile, "wb");
+    if (data.empty() || !f.IsOpened() || f.Write(data.data(), data.size()) != data.size() || !f.Close())
     {
-        wxLogError(_("Failed command: %s"), cmd.c_str());
         wxLogError(_("Failed to merge gettext catalogs."));
         throw ExtractionException(ExtractionError::Unspecified);
     }
@@ -350,7 +627,9 @@ Extractor::ExtractorsList Extractor::CreateAllExtractors()
     // to allow customization of the behavior:
     CreateAllLegacyExtractors(all);
 
-    // Standard builtin extractors follow
+    // Standard builtin extractors follow; the in-process extractor is much
+    // faster, gettext is used for other languages or unsupported settings:
+    CreateNativeExtractors(all);
     CreateGettextExtractors(all);
 
     return all;
@@ -36,6 +36,7 @@
 
 #include "utility.h"
 
+namespace dispatch { class progress_monitor; }
 
 /// Specification of the source code to search.
 struct SourceCodeSpec
@@ -49,13 +50,26 @@ struct SourceCodeSpec
 
     // additional keys from the headers
     std::map<wxString, wxString> XHeaders;
+
+    /// Returns those XHeaders that can affect extraction, i.e. X-Poedit-* options
+    std::map<wxString, wxString> GetExtractionHeaders() const;
+
+    /**
+        Returns a key identifying what the extraction results depend on:
+        sources location, keywords, charset and GetExtractionHeaders().
+        Unlike XHeaders, it doesn't include headers describing the
+        translation itself (language, revision date etc.), so it's the
+        same for all translations of one project.
+     */
+    std::string GetExtractionKey() const;
 };
 
 enum class ExtractionError
 {
     Unspecified,
     NoSourcesFound,
-    PermissionDenied
+    PermissionDenied,
+    Cancelled
 };
 
 class ExtractionException : public std::runtime_error
@@ -95,9 +109,13 @@ public:
 
         The returned list is guaranteed to be sorted by operator<
 
+        If @a progress is given, it counts found files (without a known
+        total) and cancelling it stops the search.
+
         May throw ExtractionException.
      */
-    static FilesList CollectAllFiles(const SourceCodeSpec& sources);
+    static FilesList CollectAllFiles(const SourceCodeSpec& sources,
+                                     dispatch::progress_monitor *progress = nullptr);
 
 
     /**
@@ -106,10 +124,20 @@ public:
 
         Returns filename of the created POT file, which is stored in @a tmpdir
         or empty string on failure.
+
+        If @a progress is given, it counts processed files and cancelling it
+        stops the extraction with ExtractionError::Cancelled.
+
+        If @a changedFiles is given, it is set to the (sorted) files that
+        had to be extracted because they weren't in ExtractionCache, i.e.
+        that are new or were modified since they were last extracted. All
+        files are considered changed where the cache can't be used.
      */
     static wxString ExtractWithAll(TempDirectory& tmpdir,
                                    const SourceCodeSpec& sourceSpec,
-                                   const std::vector<wxString>& files);
+                                   const std::vector<wxString>& files,
+                                   dispatch::progress_monitor *progress = nullptr,
+                                   FilesList *changedFiles = nullptr);
 
     // Extractor helpers:
 
@@ -129,16 +157,33 @@ public:
       */
     virtual bool IsFileSupported(const wxString& file) const;
 
+    /**
+        Returns whether the extractor can handle sources with these settings,
+        e.g. the extra flags for xgettext. If it can't, it isn't used at all.
+     */
+    virtual bool SupportsSourceSpec(const SourceCodeSpec& /*sourceSpec*/) const { return true; }
+
+    /**
+        Returns whether results can be cached per source file, i.e. whether
+        the output only depends on the file's content and is the same as
+        concatenating results for individual files. See ExtractionCache.
+     */
+    virtual bool SupportsCaching() const { return false; }
+
     /**
         Extracts translations from given source files using all
         available extractors.
 
         Returns filename of the created POT file, which is stored in @a tmpdir
         or empty string on failure.
+
+        Implementations advance @a progress, if not null, as files are
+        processed and throw ExtractionError::Cancelled when it's cancelled.
      */
     virtual wxString Extract(TempDirectory& tmpdir,
                              const SourceCodeSpec& sourceSpec,
-                             const std::vector<wxString>& files) const = 0;
+                             const std::vector<wxString>& files,
+                             dispatch::progress_monitor *progress) const = 0;
 
 protected:
     Extractor() {}
@@ -155,6 +200,17 @@ protected:
     /// Concatenates catalogs using msgcat
     static wxString ConcatCatalogs(TempDirectory& tmpdir, const std::vector<wxString>& files);
 
+    /// Like Extract(), but only processes files modified since the last time;
+    /// those are put into @a changedFiles
+    wxString ExtractWithCache(TempDirectory& tmpdir,
+                              const SourceCodeSpec& sourceSpec,
+                              const FilesList& files,
+                              dispatch::progress_monitor *progress,
+                              FilesList& changedFiles) const;
+
+    /// Throws ExtractionError::Cancelled if @a progress was cancelled
+    static void CheckCancelled(const dispatch::progress_monitor *progress);
+
 private:
     std::set<wxString> m_extensions;
     std::vector<wxString> m_wildcards;
@@ -162,6 +218,7 @@ private:
 protected:
     // private factories:
     static void CreateAllLegacyExtractors(ExtractorsList& into);
+    static void CreateNativeExtractors(ExtractorsList& into);
     static void CreateGettextExtractors(ExtractorsList& into);
 };
 
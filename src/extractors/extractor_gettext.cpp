@@ -25,13 +25,20 @@
 
 #include "extractor.h"
 
+#include "concurrency.h"
 #include "gexecute.h"
 
 #include <wx/textfile.h>
 
+#include <algorithm>
+#include <thread>
+
 namespace
 {
 
+// Smallest number of files worth running a separate xgettext instance for
+const size_t MIN_FILES_PER_SHARD = 50;
+
 // This list is synced with EXTENSIONS_* macros in deps/gettext/gettext-tools/src/x-*.h files:
 const char * const GETTEXT_EXTENSIONS[] = {
     "appdata.xml",                                        // appdata - ITS
@@ -97,9 +104,55 @@ const char * const GETTEXT_EXTENSIONS[] = {
 class GettextExtractorBase : public Extractor
 {
 public:
+    bool SupportsCaching() const override { return true; }
+
     wxString Extract(TempDirectory& tmpdir,
                      const SourceCodeSpec& sourceSpec,
-                     const std::vector<wxString>& files) const override
+                     const std::vector<wxString>& files,
+                     dispatch::progress_monitor *progress) const override
+    {
+        // xgettext is single-threaded, so large file sets are split into
+        // contiguous shards processed by concurrently running xgettext
+        // instances; merging them in order keeps the output the same as if
+        // all files were processed at once:
+        const size_t shards = std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()),
+                                                           files.size() / MIN_FILES_PER_SHARD));
+        if (shards == 1)
+            return ExtractShard(tmpdir.CreateFileName("gettext_filelist.txt"), tmpdir.CreateFileName("gettext.pot"),
+                                sourceSpec, files.begin(), files.end(), progress);
+
+        wxLogTrace("poedit.extractor", "running xgettext in %d shards", (int)shards);
+
+        // TempDirectory isn't thread-safe, create the names upfront:
+        std::vector<wxString> filelists, outfiles;
+        for (size_t i = 0; i < shards; i++)
+        {
+            filelists.push_back(tmpdir.CreateFileName("gettext_filelist.txt"));
+            outfiles.push_back(tmpdir.CreateFileName("gettext.pot"));
+        }
+
+        dispatch::parallel_options options;
+        options.chunk_size = 1;
+        if (progress)
+            options.token = progress->token();
+        dispatch::parallel_for(0, shards, [&](size_t i)
+        {
+            auto begin = files.begin() + files.size() * i / shards;
+            auto end = files.begin() + files.size() * (i + 1) / shards;
+            ExtractShard(filelists[i], outfiles[i], sourceSpec, begin, end, progress);
+        }, options);
+        CheckCancelled(progress);
+
+        return ConcatCatalogs(tmpdir, outfiles);
+    }
+
+protected:
+    /// Runs xgettext on files in [@a begin, @a end), returns @a outfile
+    wxString ExtractShard(const wxString& filelistName, const wxString& outfile,
+                          const SourceCodeSpec& sourceSpec,
+                          std::vector<wxString>::const_iterator begin,
+                          std::vector<wxString>::const_iterator end,
+                          dispatch::progress_monitor *progress) const
     {
         auto basepath = sourceSpec.BasePath;
 #ifdef __WXMSW__
@@ -108,9 +161,10 @@ public:
 #endif
 
         wxTextFile filelist;
-        filelist.Create(tmpdir.CreateFileName("gettext_filelist.txt"));
-        for (auto fn: files)
+        filelist.Create(filelistName);
+        for (auto i = begin; i != end; ++i)
         {
+            auto fn = *i;
 #ifdef __WXMSW__
             // Gettext tools can't handle Unicode filenames well (due to using
             // char* arguments), so work around this by using the short names.
@@ -124,8 +178,6 @@ public:
         }
         filelist.Write(wxTextFileType_Unix, wxConvFile);
 
-        auto outfile = tmpdir.CreateFileName("gettext.pot");
-
         wxString cmdline;
         cmdline.Printf
         (
@@ -158,13 +210,17 @@ public:
         if (!extraFlags.empty())
             cmdline += " " + extraFlags;
 
-        if (!ExecuteGettext(cmdline))
+        // xgettext is terminated if cancelled:
+        const bool ok = ExecuteGettext(cmdline, progress ? &progress->token() : nullptr);
+        CheckCancelled(progress);
+        if (!ok)
             throw ExtractionException(ExtractionError::Unspecified);
 
+        if (progress)
+            progress->advance(end - begin);
         return outfile;
     }
-    
-protected:
+
     virtual wxString GetAdditionalFlags() const = 0;
 };
 
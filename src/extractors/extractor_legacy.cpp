@@ -25,6 +25,7 @@
 
 #include "extractor_legacy.h"
 
+#include "concurrency.h"
 #include "gexecute.h"
 
 #include <wx/filename.h>
@@ -32,6 +33,10 @@
 #include <wx/config.h>
 #include <wx/tokenzr.h>
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
 namespace
 {
 
@@ -71,29 +76,6 @@ inline void DoReadLegacyExtractors(wxConfigBase *cfg, F&& action)
     cfg->SetPath(oldpath);
 }
 
-// FIXME: Do this in subprocess, avoid changing CWD altogether in main process
-class CurrentWorkingDirectoryChanger
-{
-public:
-    CurrentWorkingDirectoryChanger(const wxString& path)
-    {
-        if (!path.empty() && path != ".")
-        {
-            m_old = wxGetCwd();
-            wxSetWorkingDirectory(path);
-        }
-    }
-
-    ~CurrentWorkingDirectoryChanger()
-    {
-        if (!m_old.empty())
-            wxSetWorkingDirectory(m_old);
-    }
-
-private:
-    wxString m_old;
-};
-
 } // anonymous namespace
 
 void LegacyExtractorsDB::Read(wxConfigBase *cfg)
@@ -303,35 +285,110 @@ LegacyExtractor::LegacyExtractor(const LegacyExtractorSpec& spec)
 }
 
 
-wxString LegacyExtractor::Extract(TempDirectory& tmpdir,
-                                  const SourceCodeSpec& sourceSpec,
-                                  const std::vector<wxString>& files) const
+namespace
 {
-    // cmdline's length is limited by OS/shell, this is maximal number
-    // of files we'll pass to the parser at one run:
-    const int BATCH_SIZE = 16;
 
-    std::vector<wxString> batchfiles, tempfiles;
-    size_t i, last = 0;
+// Files in the first batch, used to measure the parser's speed:
+const size_t PROBE_BATCH_SIZE = 4;
+// cmdline's length is limited by OS/shell, this is maximal number
+// of files we'll pass to the parser at one run...
+const size_t MAX_BATCH_SIZE = 64;
+// ...and the maximal total length of their names:
+const size_t MAX_BATCH_FILENAMES_LENGTH = 8000;
+// How long should one batch take, to amortize the cost of starting the parser:
+const double TARGET_BATCH_SECONDS = 0.5;
+
+typedef std::pair<size_t, size_t> BatchRange;
 
-    while (last < files.size())
+// Splits files starting at @a begin into batches of at most @a batchSize files
+std::vector<BatchRange> MakeBatches(const std::vector<wxString>& files, size_t begin, size_t batchSize)
+{
+    std::vector<BatchRange> out;
+    while (begin < files.size())
     {
-        batchfiles.clear();
-        for (i = last; i < last + BATCH_SIZE && i < files.size(); i++)
-            batchfiles.push_back(files[i]);
-        last = i;
+        size_t end = begin;
+        size_t length = 0;
+        while (end < files.size() && end - begin < batchSize)
+        {
+            length += files[end].length() + 3; // quotes and space
+            if (length > MAX_BATCH_FILENAMES_LENGTH && end > begin)
+                break;
+            end++;
+        }
+        out.emplace_back(begin, end);
+        begin = end;
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+
+wxString LegacyExtractor::Extract(TempDirectory& tmpdir,
+                                  const SourceCodeSpec& sourceSpec,
+                                  const std::vector<wxString>& files,
+                                  dispatch::progress_monitor *progress) const
+{
+    if (files.empty())
+        return wxString();
 
+    auto runBatch = [&](const BatchRange& range)
+    {
+        std::vector<wxString> batchfiles(files.begin() + range.first, files.begin() + range.second);
         wxString tempfile = tmpdir.CreateFileName(GetId() + "_extracted.pot");
 
-        CurrentWorkingDirectoryChanger cwd(sourceSpec.BasePath);
-        if (!ExecuteGettext(m_spec.BuildCommand(batchfiles, sourceSpec.Keywords, tempfile, sourceSpec.Charset)))
+        // the parser runs in the base directory, because the file paths are relative to it:
+        const bool ok = ExecuteGettext(m_spec.BuildCommand(batchfiles, sourceSpec.Keywords, tempfile, sourceSpec.Charset),
+                                       progress ? &progress->token() : nullptr,
+                                       sourceSpec.BasePath);
+        CheckCancelled(progress);
+        if (!ok)
         {
             throw ExtractionException(ExtractionError::Unspecified);
         }
 
-        tempfiles.push_back(tempfile);
-    }
+        if (progress)
+            progress->advance(batchfiles.size());
+        return tempfile;
+    };
+
+    std::vector<wxString> tempfiles;
+
+    // Run a small batch first to find out how fast the parser is...
+    const BatchRange probe(0, std::min(PROBE_BATCH_SIZE, files.size()));
+    const auto probeStart = std::chrono::steady_clock::now();
+    tempfiles.push_back(runBatch(probe));
+    const std::chrono::duration<double> probeTime = std::chrono::steady_clock::now() - probeStart;
+
+    if (probe.second == files.size())
+        return tempfiles.front();
+
+    // ...then size the batches so that they take roughly the same time, but
+    // there are still enough of them to keep all cores busy:
+    const double perFile = probeTime.count() / probe.second;
+    size_t batchSize = perFile > 0 ? size_t(TARGET_BATCH_SECONDS / perFile) : MAX_BATCH_SIZE;
+    const size_t remaining = files.size() - probe.second;
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    batchSize = std::min(batchSize, (remaining + cores - 1) / cores);
+    batchSize = std::max(size_t(1), std::min(batchSize, MAX_BATCH_SIZE));
+
+    const auto batches = MakeBatches(files, probe.second, batchSize);
+    wxLogTrace("poedit.extractor", " .. %.1f ms per file, running %d batches of %d files",
+               perFile * 1000, (int)batches.size(), (int)batchSize);
+
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    if (progress)
+        options.token = progress->token();
+
+    auto results = dispatch::parallel_transform(0, batches.size(), [&](size_t i)
+    {
+        return runBatch(batches[i]);
+    }, options);
+
+    CheckCancelled(progress);
 
+    tempfiles.insert(tempfiles.end(), results.begin(), results.end());
     return ConcatCatalogs(tmpdir, tempfiles);
 }
 
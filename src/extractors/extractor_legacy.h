@@ -134,7 +134,8 @@ public:
 
     wxString Extract(TempDirectory& tmpdir,
                      const SourceCodeSpec& sourceSpec,
-                     const std::vector<wxString>& files) const override;
+                     const std::vector<wxString>& files,
+                     dispatch::progress_monitor *progress) const override;
 
 private:
     wxString m_id;
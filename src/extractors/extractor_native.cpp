@@ -0,0 +1,1508 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "extractor.h"
+
+#include "concurrency.h"
+#include "format_placeholders.h"
+#include "str_helpers.h"
+
+#include <wx/datetime.h>
+#include <wx/file.h>
+#include <wx/log.h>
+#include <wx/strconv.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+
+enum class SourceLanguage
+{
+    C,          // C, C++ and similar
+    Python,
+    PHP,
+    JavaScript
+};
+
+const char * const C_EXTENSIONS[] = { "c", "h", "C", "c++", "cc", "cxx", "cpp", "hh", "hxx", "hpp", nullptr };
+const char * const PYTHON_EXTENSIONS[] = { "py", nullptr };
+const char * const PHP_EXTENSIONS[] = { "php", "php3", "php4", "phtml", "ctp", nullptr };
+const char * const JAVASCRIPT_EXTENSIONS[] = { "js", nullptr };
+
+// Default keywords of xgettext for the respective languages:
+const char * const C_KEYWORDS[] = {
+    "gettext", "dgettext:2", "dcgettext:2", "ngettext:1,2", "dngettext:2,3", "dcngettext:2,3", "gettext_noop",
+    "pgettext:1c,2", "dpgettext:2c,3", "dcpgettext:2c,3", "npgettext:1c,2,3", "dnpgettext:2c,3,4", "dcnpgettext:2c,3,4",
+    nullptr
+};
+const char * const PYTHON_KEYWORDS[] = {
+    "gettext", "ugettext", "dgettext:2", "ngettext:1,2", "ungettext:1,2", "dngettext:2,3", "_",
+    "pgettext:1c,2", "npgettext:1c,2,3",
+    nullptr
+};
+const char * const PHP_KEYWORDS[] = {
+    "_", "gettext", "dgettext:2", "dcgettext:2", "ngettext:1,2", "dngettext:2,3", "dcngettext:2,3",
+    nullptr
+};
+const char * const JAVASCRIPT_KEYWORDS[] = {
+    "_", "gettext", "dgettext:2", "dcgettext:2", "ngettext:1,2", "dngettext:2,3", "pgettext:1c,2", "dpgettext:2c,3",
+    nullptr
+};
+
+
+/// Arguments of a keyword function, as in xgettext's --keyword=id:1c,2,3t
+struct KeywordSpec
+{
+    KeywordSpec() : msgid(1), plural(0), context(0), total(0) {}
+
+    int msgid, plural, context, total;
+};
+
+typedef std::unordered_map<std::string, std::vector<KeywordSpec>> KeywordsMap;
+
+/// Parses xgettext-style keyword specification, returns false if invalid
+bool ParseKeyword(const std::string& kw, std::string& name, KeywordSpec& spec)
+{
+    spec = KeywordSpec();
+
+    auto colon = kw.find(':');
+    name = kw.substr(0, colon);
+    if (name.empty())
+        return false;
+    if (colon == std::string::npos)
+        return true;
+
+    int argnums = 0;
+    size_t pos = colon + 1;
+    while (pos < kw.size())
+    {
+        auto comma = kw.find(',', pos);
+        auto part = kw.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = (comma == std::string::npos) ? kw.size() : comma + 1;
+
+        if (part.empty())
+            return false;
+        if (part[0] == '"')
+            continue; // fixed extracted comment, not supported
+
+        size_t digits = 0;
+        while (digits < part.size() && part[digits] >= '0' && part[digits] <= '9')
+            digits++;
+        if (digits == 0)
+            return false;
+        const int n = std::stoi(part.substr(0, digits));
+        const auto suffix = part.substr(digits);
+
+        if (suffix == "c")
+            spec.context = n;
+        else if (suffix == "t")
+            spec.total = n;
+        else if (!suffix.empty())
+            return false;
+        else if (argnums++ == 0)
+            spec.msgid = n;
+        else
+            spec.plural = n;
+    }
+
+    return true;
+}
+
+void AddKeyword(KeywordsMap& keywords, const std::string& kw)
+{
+    std::string name;
+    KeywordSpec spec;
+    if (!ParseKeyword(kw, name, spec))
+    {
+        wxLogTrace("poedit.extractor", "ignoring invalid keyword '%s'", kw);
+        return;
+    }
+    keywords[name].push_back(spec);
+}
+
+
+/// Options for the extraction taken from SourceCodeSpec
+struct ExtractionOptions
+{
+    ExtractionOptions() : defaultKeywords(true), addComments(false), sortOutput(false), noLocation(false) {}
+
+    std::vector<std::string> keywords;
+    bool defaultKeywords;
+    bool addComments;
+    std::string commentsTag;
+    bool sortOutput;
+    bool noLocation;
+    wxString charset;
+
+    /// Returns effective keywords for given language
+    KeywordsMap GetKeywords(SourceLanguage lang) const
+    {
+        KeywordsMap map;
+        if (defaultKeywords)
+        {
+            const char * const *defaults = nullptr;
+            switch (lang)
+            {
+                case SourceLanguage::C:          defaults = C_KEYWORDS;          break;
+                case SourceLanguage::Python:     defaults = PYTHON_KEYWORDS;     break;
+                case SourceLanguage::PHP:        defaults = PHP_KEYWORDS;        break;
+                case SourceLanguage::JavaScript: defaults = JAVASCRIPT_KEYWORDS; break;
+            }
+            for (auto k = defaults; *k; k++)
+                AddKeyword(map, *k);
+        }
+        for (auto& k: keywords)
+            AddKeyword(map, k);
+        return map;
+    }
+
+    /**
+        Parses X-Poedit-Flags-xgettext value. Returns false if it contains any
+        options not supported by this extractor.
+     */
+    bool ParseXgettextFlags(const wxString& flags)
+    {
+        wxArrayString args = wxSplit(flags, ' ', '\0');
+        for (auto arg: args)
+        {
+            arg.Trim(true).Trim(false);
+            if (arg.empty())
+                continue;
+
+            wxString value;
+            if (arg == "-k" || arg == "--keyword")
+                defaultKeywords = false;
+            else if (arg.StartsWith("--keyword=", &value) || (arg.StartsWith("-k", &value) && !value.empty()))
+                keywords.push_back(str::to_utf8(value));
+            else if (arg == "--add-comments" || arg == "-c")
+                addComments = true, commentsTag.clear();
+            else if (arg.StartsWith("--add-comments=", &value) || arg.StartsWith("-c", &value))
+                addComments = true, commentsTag = str::to_utf8(value);
+            else if (arg.StartsWith("--from-code=", &value))
+                charset = value;
+            else if (arg == "-s" || arg == "--sort-output")
+                sortOutput = true;
+            else if (arg == "--no-location")
+                noLocation = true;
+            else if (arg == "-F" || arg == "--sort-by-file" || arg == "--no-wrap" || arg.StartsWith("--width=") || arg == "--force-po")
+                ; // output formatting, irrelevant for the POT that is only merged
+            else
+                return false;
+        }
+        return true;
+    }
+};
+
+
+/// Translatable message found in the source code
+struct Message
+{
+    Message() : hasContext(false) {}
+
+    bool hasContext;
+    std::string context, msgid, plural;
+    std::vector<std::string> comments;
+    std::vector<std::string> references;
+    std::string formatFlag;
+};
+
+
+/// Lexical token of the source code being scanned
+struct Token
+{
+    enum Type
+    {
+        Identifier,
+        String,     // translatable string literal (value is unescaped)
+        Comment,    // value is the comment's text, without delimiters
+        Open,       // ( [ {
+        Close,      // ) ] }
+        Comma,
+        Concat,     // string concatenation operator in languages that have one
+        Other       // anything else, including non-translatable literals
+    };
+
+    Type type;
+    std::string value;
+    int line;       // line where the token starts
+    int endLine;    // line where the token ends (for multiline comments)
+};
+
+
+inline bool IsIdentStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (unsigned char)c >= 0x80;
+}
+
+inline bool IsIdentChar(char c)
+{
+    return IsIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+inline bool IsHexDigit(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline int HexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return c - 'A' + 10;
+}
+
+void AppendUTF8(std::string& out, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        out += char(c);
+    }
+    else if (c < 0x800)
+    {
+        out += char(0xC0 | (c >> 6));
+        out += char(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+        out += char(0xE0 | (c >> 12));
+        out += char(0x80 | ((c >> 6) & 0x3F));
+        out += char(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x110000)
+    {
+        out += char(0xF0 | (c >> 18));
+        out += char(0x80 | ((c >> 12) & 0x3F));
+        out += char(0x80 | ((c >> 6) & 0x3F));
+        out += char(0x80 | (c & 0x3F));
+    }
+}
+
+
+/**
+    Splits source code into tokens relevant for finding keyword calls.
+
+    This is not a full lexer for any of the languages, it only needs to be
+    precise about strings, comments and brackets; everything else may be
+    lumped together as Token::Other.
+ */
+class Tokenizer
+{
+public:
+    Tokenizer(SourceLanguage lang, const std::string& text)
+        : m_lang(lang), m_text(text), m_pos(0), m_line(1), m_inPHPCode(lang != SourceLanguage::PHP)
+    {}
+
+    std::vector<Token> Run()
+    {
+        std::vector<Token> tokens;
+        Token t;
+        while (Next(t))
+            tokens.push_back(std::move(t));
+        return tokens;
+    }
+
+private:
+    char Peek(size_t offset = 0) const
+    {
+        return m_pos + offset < m_text.size() ? m_text[m_pos + offset] : '\0';
+    }
+
+    bool AtEnd() const { return m_pos >= m_text.size(); }
+
+    char Get()
+    {
+        char c = m_text[m_pos++];
+        if (c == '\n')
+            m_line++;
+        return c;
+    }
+
+    bool StartsWith(const char *s) const
+    {
+        return m_text.compare(m_pos, strlen(s), s) == 0;
+    }
+
+    void SkipTo(const char *s)
+    {
+        while (!AtEnd() && !StartsWith(s))
+            Get();
+    }
+
+    bool Next(Token& t);
+    void ReadLineComment(Token& t, size_t prefixLen);
+    void ReadBlockComment(Token& t);
+    void ReadQuoted(Token& t, char quote, bool triple, bool raw);
+    void ReadCppRawString(Token& t);
+    void ReadTemplateLiteral(Token& t);
+    void ReadRegex();
+    bool ReadEscape(std::string& out);
+
+    SourceLanguage m_lang;
+    const std::string& m_text;
+    size_t m_pos;
+    int m_line;
+    bool m_inPHPCode;
+    bool m_regexAllowed = true;
+};
+
+
+bool Tokenizer::Next(Token& t)
+{
+    for (;;)
+    {
+        if (!m_inPHPCode)
+        {
+            // skip HTML content until the next <?php, <?= or <? tag:
+            SkipTo("<?");
+            if (AtEnd())
+                return false;
+            m_pos += 2;
+            if (StartsWith("php"))
+                m_pos += 3;
+            else if (StartsWith("="))
+                m_pos += 1;
+            m_inPHPCode = true;
+        }
+
+        if (AtEnd())
+            return false;
+
+        const char c = Peek();
+        t.line = t.endLine = m_line;
+        t.value.clear();
+
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v')
+        {
+            Get();
+            continue;
+        }
+
+        if (m_lang == SourceLanguage::PHP && c == '?' && Peek(1) == '>')
+        {
+            m_pos += 2;
+            m_inPHPCode = false;
+            continue;
+        }
+
+        // comments:
+        if (c == '/' && Peek(1) == '/' && m_lang != SourceLanguage::Python)
+        {
+            ReadLineComment(t, 2);
+        }
+        else if (c == '/' && Peek(1) == '*' && m_lang != SourceLanguage::Python)
+        {
+            ReadBlockComment(t);
+        }
+        else if (c == '#' && (m_lang == SourceLanguage::Python || m_lang == SourceLanguage::PHP))
+        {
+            ReadLineComment(t, 1);
+        }
+        // strings:
+        else if (c == '"' || (c == '\'' && m_lang != SourceLanguage::C))
+        {
+            const bool triple = m_lang == SourceLanguage::Python && Peek(1) == c && Peek(2) == c;
+            ReadQuoted(t, c, triple, /*raw=*/m_lang == SourceLanguage::PHP && c == '\'');
+        }
+        else if (c == '`' && m_lang == SourceLanguage::JavaScript)
+        {
+            ReadTemplateLiteral(t);
+        }
+        else if (c == '\'')
+        {
+            // C character literal
+            Get();
+            while (!AtEnd() && Peek() != '\'' && Peek() != '\n')
+            {
+                if (Get() == '\\' && !AtEnd())
+                    Get();
+            }
+            if (!AtEnd() && Peek() == '\'')
+                Get();
+            t.type = Token::Other;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            while (!AtEnd() && (IsIdentChar(Peek()) || Peek() == '.' || (Peek() == '\'' && m_lang == SourceLanguage::C)))
+                Get();
+            t.type = Token::Other;
+        }
+        else if (c == '$' && m_lang == SourceLanguage::PHP)
+        {
+            // PHP variable, never a keyword
+            Get();
+            while (!AtEnd() && IsIdentChar(Peek()))
+                Get();
+            t.type = Token::Other;
+        }
+        else if (IsIdentStart(c) || (c == '$' && m_lang == SourceLanguage::JavaScript))
+        {
+            size_t start = m_pos;
+            while (!AtEnd() && (IsIdentChar(Peek()) || (Peek() == '$' && m_lang == SourceLanguage::JavaScript)))
+                Get();
+            std::string ident = m_text.substr(start, m_pos - start);
+
+            // string literal prefixes:
+            const char q = Peek();
+            if (m_lang == SourceLanguage::C && q == '"' && (ident == "L" || ident == "u" || ident == "U" || ident == "u8"))
+            {
+                ReadQuoted(t, q, false, false);
+            }
+            else if (m_lang == SourceLanguage::C && q == '"' && (ident == "R" || ident == "LR" || ident == "uR" || ident == "UR" || ident == "u8R"))
+            {
+                ReadCppRawString(t);
+            }
+            else if (m_lang == SourceLanguage::Python && (q == '"' || q == '\'') && ident.size() <= 2 &&
+                     ident.find_first_not_of("rRuUbBfF") == std::string::npos)
+            {
+                const bool raw = ident.find_first_of("rR") != std::string::npos;
+                const bool triple = Peek(1) == q && Peek(2) == q;
+                ReadQuoted(t, q, triple, raw);
+                // bytes and f-strings can't be translated:
+                if (ident.find_first_of("bBfF") != std::string::npos)
+                    t.type = Token::Other;
+            }
+            else
+            {
+                t.type = Token::Identifier;
+                t.value = std::move(ident);
+            }
+        }
+        else if (c == '(' || c == '[' || c == '{')
+        {
+            Get();
+            t.type = Token::Open;
+            t.value = c;
+        }
+        else if (c == ')' || c == ']' || c == '}')
+        {
+            Get();
+            t.type = Token::Close;
+            t.value = c;
+        }
+        else if (c == ',')
+        {
+            Get();
+            t.type = Token::Comma;
+        }
+        else if ((c == '+' && m_lang == SourceLanguage::JavaScript && Peek(1) != '+' && Peek(1) != '=') ||
+                 (c == '.' && m_lang == SourceLanguage::PHP && Peek(1) != '='))
+        {
+            Get();
+            t.type = Token::Concat;
+        }
+        else if (c == '/' && m_lang == SourceLanguage::JavaScript && m_regexAllowed)
+        {
+            ReadRegex();
+            t.type = Token::Other;
+        }
+        else
+        {
+            Get();
+            t.type = Token::Other;
+        }
+
+        t.endLine = m_line;
+
+        // In JavaScript, '/' starts a regular expression literal where an
+        // operand is expected and is the division operator after one:
+        if (t.type != Token::Comment)
+        {
+            const bool isOperand = t.type == Token::String || t.type == Token::Close ||
+                                   (t.type == Token::Identifier && t.value != "return" && t.value != "typeof") ||
+                                   (t.type == Token::Other && ((c >= '0' && c <= '9') || IsIdentStart(c) || c == '\'' || c == '`'));
+            m_regexAllowed = !isOperand;
+        }
+        return true;
+    }
+}
+
+
+void Tokenizer::ReadLineComment(Token& t, size_t prefixLen)
+{
+    m_pos += prefixLen;
+    size_t start = m_pos;
+    while (!AtEnd() && Peek() != '\n')
+    {
+        if (m_lang == SourceLanguage::PHP && StartsWith("?>"))
+            break;
+        m_pos++;
+    }
+    t.type = Token::Comment;
+    t.value = m_text.substr(start, m_pos - start);
+}
+
+
+void Tokenizer::ReadBlockComment(Token& t)
+{
+    m_pos += 2;
+    t.type = Token::Comment;
+
+    // strip leading asterisks of continuation lines, as xgettext does
+    std::string line;
+    bool lineStart = true;
+    while (!AtEnd() && !StartsWith("*/"))
+    {
+        const char c = Get();
+        if (c == '\n')
+        {
+            t.value += line;
+            t.value += '\n';
+            line.clear();
+            lineStart = true;
+            continue;
+        }
+        if (lineStart && (c == ' ' || c == '\t'))
+            continue;
+        if (lineStart && c == '*')
+        {
+            lineStart = false;
+            continue;
+        }
+        if (lineStart)
+            lineStart = false;
+        line += c;
+    }
+    t.value += line;
+    if (!AtEnd())
+        m_pos += 2;
+}
+
+
+bool Tokenizer::ReadEscape(std::string& out)
+{
+    // the backslash was already consumed
+    if (AtEnd())
+        return false;
+
+    const char c = Get();
+    switch (c)
+    {
+        case 'n':  out += '\n'; return true;
+        case 't':  out += '\t'; return true;
+        case 'r':  out += '\r'; return true;
+        case 'a':  out += '\a'; return true;
+        case 'b':  out += '\b'; return true;
+        case 'f':  out += '\f'; return true;
+        case 'v':  out += '\v'; return true;
+        case '\\': out += '\\'; return true;
+        case '"':  out += '"';  return true;
+        case '\'': out += '\''; return true;
+        case '?':  out += '?';  return true;
+        case '\n': return true; // line continuation
+        case '$':
+            if (m_lang != SourceLanguage::PHP)
+                break;
+            out += '$';
+            return true;
+        case 'x':
+        {
+            uint32_t value = 0;
+            int digits = 0;
+            // C allows any number of digits, other languages only two
+            while (!AtEnd() && IsHexDigit(Peek()) && (m_lang == SourceLanguage::C || digits < 2))
+            {
+                value = value * 16 + HexValue(Get());
+                digits++;
+            }
+            if (!digits)
+                break;
+            out += char(value & 0xFF);
+            return true;
+        }
+        case 'u':
+        case 'U':
+        {
+            if (c == 'U' && m_lang == SourceLanguage::JavaScript)
+                break;
+            const int len = (c == 'u') ? 4 : 8;
+            uint32_t value = 0;
+            for (int i = 0; i < len; i++)
+            {
+                if (AtEnd() || !IsHexDigit(Peek()))
+                    return false;
+                value = value * 16 + HexValue(Get());
+            }
+            AppendUTF8(out, value);
+            return true;
+        }
+        default:
+            if (c >= '0' && c <= '7')
+            {
+                uint32_t value = c - '0';
+                for (int i = 0; i < 2 && !AtEnd() && Peek() >= '0' && Peek() <= '7'; i++)
+                    value = value * 8 + (Get() - '0');
+                out += char(value & 0xFF);
+                return true;
+            }
+            break;
+    }
+
+    // unknown escapes are kept verbatim
+    out += '\\';
+    out += c;
+    return true;
+}
+
+
+void Tokenizer::ReadQuoted(Token& t, char quote, bool triple, bool raw)
+{
+    t.type = Token::String;
+    m_pos += triple ? 3 : 1;
+
+    for (;;)
+    {
+        if (AtEnd())
+        {
+            t.type = Token::Other; // unterminated
+            return;
+        }
+
+        if (triple ? (Peek() == quote && Peek(1) == quote && Peek(2) == quote) : Peek() == quote)
+        {
+            m_pos += triple ? 3 : 1;
+            return;
+        }
+
+        const char c = Get();
+        if (c == '\n' && !triple && m_lang != SourceLanguage::PHP)
+        {
+            t.type = Token::Other; // unterminated on this line
+            return;
+        }
+
+        if (c != '\\')
+        {
+            t.value += c;
+        }
+        else if (raw)
+        {
+            // raw strings still don't end at escaped quotes, and PHP's
+            // single-quoted strings recognize \' and \\ only
+            const char next = Peek();
+            if (m_lang == SourceLanguage::PHP && (next == '\\' || next == '\''))
+            {
+                t.value += Get();
+            }
+            else
+            {
+                t.value += c;
+                if (next == quote || next == '\\')
+                    t.value += Get();
+            }
+        }
+        else if (!ReadEscape(t.value))
+        {
+            t.type = Token::Other;
+        }
+    }
+}
+
+
+void Tokenizer::ReadCppRawString(Token& t)
+{
+    // R"delim( ... )delim"
+    t.type = Token::String;
+    Get(); // "
+    size_t start = m_pos;
+    while (!AtEnd() && Peek() != '(' && Peek() != '\n')
+        Get();
+    if (AtEnd() || Peek() != '(')
+    {
+        t.type = Token::Other;
+        return;
+    }
+    const std::string terminator = ")" + m_text.substr(start, m_pos - start) + "\"";
+    Get(); // (
+
+    auto end = m_text.find(terminator, m_pos);
+    if (end == std::string::npos)
+    {
+        t.type = Token::Other;
+        end = m_text.size();
+    }
+    else
+    {
+        t.value = m_text.substr(m_pos, end - m_pos);
+        end += terminator.size();
+    }
+    while (m_pos < end)
+        Get();
+}
+
+
+void Tokenizer::ReadTemplateLiteral(Token& t)
+{
+    // `...`, translatable only if it doesn't use ${...} substitutions
+    t.type = Token::String;
+    Get();
+    int depth = 0;
+    while (!AtEnd())
+    {
+        const char c = Get();
+        if (depth == 0)
+        {
+            if (c == '`')
+                return;
+            if (c == '\\')
+            {
+                if (!ReadEscape(t.value))
+                    t.type = Token::Other;
+            }
+            else if (c == '$' && Peek() == '{')
+            {
+                Get();
+                depth = 1;
+                t.type = Token::Other;
+            }
+            else
+            {
+                t.value += c;
+            }
+        }
+        else if (c == '{')
+        {
+            depth++;
+        }
+        else if (c == '}')
+        {
+            depth--;
+        }
+    }
+    t.type = Token::Other; // unterminated
+}
+
+
+void Tokenizer::ReadRegex()
+{
+    Get(); // /
+    bool inClass = false;
+    while (!AtEnd() && Peek() != '\n')
+    {
+        const char c = Get();
+        if (c == '\\')
+        {
+            if (!AtEnd() && Peek() != '\n')
+                Get();
+        }
+        else if (c == '[')
+        {
+            inClass = true;
+        }
+        else if (c == ']')
+        {
+            inClass = false;
+        }
+        else if (c == '/' && !inClass)
+        {
+            break;
+        }
+    }
+    while (!AtEnd() && IsIdentChar(Peek()))
+        Get(); // flags
+}
+
+
+/// Returns format flag of the message, e.g. "c-format", if it uses placeholders
+std::string DetectFormatFlag(SourceLanguage lang, const std::string& msgid)
+{
+    unsigned syntaxes = 0;
+    const char *flag = nullptr;
+    switch (lang)
+    {
+        case SourceLanguage::C:
+            syntaxes = Placeholders_C;
+            flag = "c-format";
+            break;
+        case SourceLanguage::Python:
+            syntaxes = Placeholders_C;
+            flag = "python-format";
+            break;
+        case SourceLanguage::PHP:
+            syntaxes = Placeholders_PHP;
+            flag = "php-format";
+            break;
+        case SourceLanguage::JavaScript:
+            return std::string();
+    }
+
+    if (msgid.find('%') == std::string::npos)
+        return std::string();
+
+    std::vector<wxString> placeholders;
+    ExtractPlaceholders(wxString::FromUTF8(msgid.data(), msgid.size()), syntaxes, placeholders);
+    return placeholders.empty() ? std::string() : std::string(flag);
+}
+
+
+/// Keeps only the part of the comment starting with the tag, if any
+bool FilterComment(const std::string& comment, const ExtractionOptions& options, std::string& out)
+{
+    size_t pos = 0;
+    if (!options.commentsTag.empty())
+    {
+        // the tag must be at the start of a line, ignoring whitespace:
+        size_t lineStart = 0;
+        pos = std::string::npos;
+        while (lineStart < comment.size())
+        {
+            auto first = comment.find_first_not_of(" \t", lineStart);
+            if (first != std::string::npos && comment.compare(first, options.commentsTag.size(), options.commentsTag) == 0)
+            {
+                pos = first;
+                break;
+            }
+            auto eol = comment.find('\n', lineStart);
+            if (eol == std::string::npos)
+                break;
+            lineStart = eol + 1;
+        }
+        if (pos == std::string::npos)
+            return false;
+    }
+
+    out.clear();
+    size_t lineStart = pos;
+    while (lineStart <= comment.size())
+    {
+        auto eol = comment.find('\n', lineStart);
+        auto line = comment.substr(lineStart, eol == std::string::npos ? std::string::npos : eol - lineStart);
+        auto first = line.find_first_not_of(" \t");
+        auto last = line.find_last_not_of(" \t\r");
+        if (first != std::string::npos)
+        {
+            if (!out.empty())
+                out += '\n';
+            out += line.substr(first, last - first + 1);
+        }
+        if (eol == std::string::npos)
+            break;
+        lineStart = eol + 1;
+    }
+    return !out.empty();
+}
+
+
+/**
+    Finds calls of keyword functions in tokenized source code and creates
+    messages from their literal string arguments.
+ */
+class MessagesFinder
+{
+public:
+    MessagesFinder(SourceLanguage lang, const KeywordsMap& keywords, const ExtractionOptions& options,
+                   const std::string& reference)
+        : m_lang(lang), m_keywords(keywords), m_options(options), m_reference(reference)
+    {}
+
+    std::vector<Message> Run(const std::vector<Token>& tokens);
+
+private:
+    /// State of the currently parsed argument
+    enum class ArgState
+    {
+        Empty,          // no tokens yet
+        String,         // string literal(s), possibly concatenated
+        AfterConcat,    // string followed by concatenation operator
+        Other           // not a literal string
+    };
+
+    /// Open bracket or keyword call's parentheses
+    struct Frame
+    {
+        Frame() : keyword(nullptr), closer(')'), line(0), arg(1), state(ArgState::Empty) {}
+
+        const std::vector<KeywordSpec> *keyword;
+        char closer;
+        int line;
+        std::string comment;
+        int arg;
+        ArgState state;
+        std::string value;
+        std::map<int, std::string> literals;
+    };
+
+    void EndArgument(Frame& f);
+    void EndCall(Frame& f, std::vector<Message>& out);
+    void InvalidateArgument()
+    {
+        if (!m_stack.empty())
+            m_stack.back().state = ArgState::Other;
+    }
+
+    SourceLanguage m_lang;
+    const KeywordsMap& m_keywords;
+    const ExtractionOptions& m_options;
+    std::string m_reference;
+    std::vector<Frame> m_stack;
+};
+
+
+std::vector<Message> MessagesFinder::Run(const std::vector<Token>& tokens)
+{
+    std::vector<Message> out;
+
+    // Translator comments must immediately precede the line with the keyword
+    std::string comment;
+    int commentEndLine = -1;
+    int firstLineAfterComment = -1;
+    bool previousWasComment = false;
+
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        auto& t = tokens[i];
+
+        if (t.type == Token::Comment)
+        {
+            if (previousWasComment && t.line <= commentEndLine + 1)
+            {
+                comment += '\n';
+                comment += t.value;
+            }
+            else
+            {
+                comment = t.value;
+            }
+            commentEndLine = t.endLine;
+            firstLineAfterComment = -1;
+            previousWasComment = true;
+            continue;
+        }
+
+        if (previousWasComment)
+            firstLineAfterComment = t.line;
+        previousWasComment = false;
+
+        switch (t.type)
+        {
+            case Token::Identifier:
+            {
+                auto kw = m_keywords.find(t.value);
+                if (kw != m_keywords.end() && i + 1 < tokens.size() && tokens[i+1].type == Token::Open && tokens[i+1].value == "(")
+                {
+                    InvalidateArgument();
+                    Frame f;
+                    f.keyword = &kw->second;
+                    f.line = t.line;
+                    if (m_options.addComments && !comment.empty() &&
+                        firstLineAfterComment == t.line && commentEndLine >= t.line - 1)
+                    {
+                        FilterComment(comment, m_options, f.comment);
+                    }
+                    m_stack.push_back(std::move(f));
+                    i++; // skip the (
+                }
+                else
+                {
+                    InvalidateArgument();
+                }
+                break;
+            }
+
+            case Token::String:
+            {
+                if (m_stack.empty())
+                    break;
+                auto& f = m_stack.back();
+                switch (f.state)
+                {
+                    case ArgState::Empty:
+                        f.value = t.value;
+                        f.state = ArgState::String;
+                        break;
+                    case ArgState::AfterConcat:
+                        f.value += t.value;
+                        f.state = ArgState::String;
+                        break;
+                    case ArgState::String:
+                        // adjacent literals are concatenated in C and Python
+                        if (m_lang == SourceLanguage::C || m_lang == SourceLanguage::Python)
+                            f.value += t.value;
+                        else
+                            f.state = ArgState::Other;
+                        break;
+                    case ArgState::Other:
+                        break;
+                }
+                break;
+            }
+
+            case Token::Concat:
+            {
+                if (m_stack.empty())
+                    break;
+                auto& f = m_stack.back();
+                f.state = (f.state == ArgState::String) ? ArgState::AfterConcat : ArgState::Other;
+                break;
+            }
+
+            case Token::Open:
+            {
+                InvalidateArgument();
+                Frame f;
+                f.closer = (t.value == "(") ? ')' : (t.value == "[") ? ']' : '}';
+                m_stack.push_back(std::move(f));
+                break;
+            }
+
+            case Token::Close:
+            {
+                // be tolerant of unbalanced brackets, e.g. in #ifdefs
+                while (!m_stack.empty())
+                {
+                    Frame f = std::move(m_stack.back());
+                    m_stack.pop_back();
+                    if (f.keyword)
+                        EndCall(f, out);
+                    if (f.closer == t.value[0])
+                        break;
+                }
+                break;
+            }
+
+            case Token::Comma:
+            {
+                if (!m_stack.empty() && m_stack.back().keyword)
+                {
+                    auto& f = m_stack.back();
+                    EndArgument(f);
+                    f.arg++;
+                }
+                break;
+            }
+
+            case Token::Comment:
+                break;
+
+            case Token::Other:
+            {
+                InvalidateArgument();
+                break;
+            }
+        }
+    }
+
+    // unterminated calls at the end of file are ignored
+    m_stack.clear();
+    return out;
+}
+
+
+void MessagesFinder::EndArgument(Frame& f)
+{
+    if (f.state == ArgState::String)
+        f.literals[f.arg] = std::move(f.value);
+    f.value.clear();
+    f.state = ArgState::Empty;
+}
+
+
+void MessagesFinder::EndCall(Frame& f, std::vector<Message>& out)
+{
+    const bool emptyLastArg = f.state == ArgState::Empty;
+    EndArgument(f);
+    const int argsCount = (f.arg == 1 && emptyLastArg) ? 0 : f.arg;
+
+    const KeywordSpec *spec = nullptr;
+    for (auto& s: *f.keyword)
+    {
+        if (s.total == argsCount)
+        {
+            spec = &s;
+            break;
+        }
+        if (s.total == 0 && !spec)
+            spec = &s;
+    }
+    if (!spec)
+        return;
+
+    auto msgid = f.literals.find(spec->msgid);
+    if (msgid == f.literals.end() || msgid->second.empty())
+        return;
+
+    Message m;
+    m.msgid = msgid->second;
+    if (spec->plural)
+    {
+        auto plural = f.literals.find(spec->plural);
+        if (plural == f.literals.end())
+            return;
+        m.plural = plural->second;
+    }
+    if (spec->context)
+    {
+        auto context = f.literals.find(spec->context);
+        if (context == f.literals.end())
+            return;
+        m.hasContext = true;
+        m.context = context->second;
+    }
+
+    if (!f.comment.empty())
+        m.comments.push_back(f.comment);
+    if (!m_options.noLocation)
+        m.references.push_back(m_reference + ":" + std::to_string(f.line));
+    m.formatFlag = DetectFormatFlag(m_lang, m.msgid);
+
+    out.push_back(std::move(m));
+}
+
+
+/// Escapes string for use in PO file
+std::string EscapePOString(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (auto c: s)
+    {
+        switch (c)
+        {
+            case '\\': out += "\\\\"; break;
+            case '"':  out += "\\\""; break;
+            case '\n': out += "\\n";  break;
+            case '\t': out += "\\t";  break;
+            case '\r': out += "\\r";  break;
+            case '\a': out += "\\a";  break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            case '\v': out += "\\v";  break;
+            default:   out += c;      break;
+        }
+    }
+    return out;
+}
+
+/// Writes PO keyword with a string value, split at newlines as xgettext does
+void WritePOString(std::string& out, const char *keyword, const std::string& value)
+{
+    out += keyword;
+    auto nl = value.find('\n');
+    if (nl == std::string::npos || nl == value.size() - 1)
+    {
+        out += " \"" + EscapePOString(value) + "\"\n";
+        return;
+    }
+
+    out += " \"\"\n";
+    size_t start = 0;
+    while (start < value.size())
+    {
+        auto end = value.find('\n', start);
+        end = (end == std::string::npos) ? value.size() : end + 1;
+        out += "\"" + EscapePOString(value.substr(start, end - start)) + "\"\n";
+        start = end;
+    }
+}
+
+
+/// Merges messages with the same context and msgid, the way xgettext does
+std::vector<Message> MergeMessages(std::vector<std::vector<Message>>&& perFile)
+{
+    std::vector<Message> merged;
+    std::map<std::pair<std::string, std::string>, size_t> index;
+
+    for (auto& messages: perFile)
+    {
+        for (auto& m: messages)
+        {
+            // use EOT as the separator as gettext does in MO files:
+            auto key = std::make_pair(m.hasContext ? m.context + '\x04' : std::string(), m.msgid);
+            auto found = index.find(key);
+            if (found == index.end())
+            {
+                index.emplace(key, merged.size());
+                merged.push_back(std::move(m));
+                continue;
+            }
+
+            auto& into = merged[found->second];
+            if (into.plural.empty())
+                into.plural = m.plural;
+            if (into.formatFlag.empty())
+                into.formatFlag = m.formatFlag;
+            for (auto& c: m.comments)
+            {
+                if (std::find(into.comments.begin(), into.comments.end(), c) == into.comments.end())
+                    into.comments.push_back(c);
+            }
+            into.references.insert(into.references.end(), m.references.begin(), m.references.end());
+        }
+    }
+
+    return merged;
+}
+
+
+std::string CreatePOT(const std::vector<Message>& messages)
+{
+    bool hasPlurals = false;
+    for (auto& m: messages)
+    {
+        if (!m.plural.empty())
+            hasPlurals = true;
+    }
+
+    std::string out;
+    out += "# SOME DESCRIPTIVE TITLE.\n"
+           "#, fuzzy\n"
+           "msgid \"\"\n"
+           "msgstr \"\"\n"
+           "\"Project-Id-Version: PACKAGE VERSION\\n\"\n"
+           "\"Report-Msgid-Bugs-To: \\n\"\n";
+    out += "\"POT-Creation-Date: " + str::to_utf8(wxDateTime::Now().Format("%Y-%m-%d %H:%M%z")) + "\\n\"\n";
+    out += "\"PO-Revision-Date: YEAR-MO-DA HO:MI+ZONE\\n\"\n"
+           "\"Last-Translator: FULL NAME <EMAIL@ADDRESS>\\n\"\n"
+           "\"Language-Team: LANGUAGE <LL@li.org>\\n\"\n"
+           "\"Language: \\n\"\n"
+           "\"MIME-Version: 1.0\\n\"\n"
+           "\"Content-Type: text/plain; charset=UTF-8\\n\"\n"
+           "\"Content-Transfer-Encoding: 8bit\\n\"\n";
+    if (hasPlurals)
+        out += "\"Plural-Forms: nplurals=INTEGER; plural=EXPRESSION;\\n\"\n";
+
+    for (auto& m: messages)
+    {
+        out += "\n";
+        for (auto& c: m.comments)
+        {
+            size_t start = 0;
+            while (start <= c.size())
+            {
+                auto end = c.find('\n', start);
+                out += "#. " + c.substr(start, end == std::string::npos ? std::string::npos : end - start) + "\n";
+                if (end == std::string::npos)
+                    break;
+                start = end + 1;
+            }
+        }
+        for (auto& r: m.references)
+            out += "#: " + r + "\n";
+        if (!m.formatFlag.empty())
+            out += "#, " + m.formatFlag + "\n";
+        if (m.hasContext)
+            WritePOString(out, "msgctxt", m.context);
+        WritePOString(out, "msgid", m.msgid);
+        if (m.plural.empty())
+        {
+            out += "msgstr \"\"\n";
+        }
+        else
+        {
+            WritePOString(out, "msgid_plural", m.plural);
+            out += "msgstr[0] \"\"\n"
+                   "msgstr[1] \"\"\n";
+        }
+    }
+
+    return out;
+}
+
+
+bool HasExtension(const wxString& file, const char * const *extensions)
+{
+    auto ext = file.AfterLast('.');
+    if (ext == file)
+        return false;
+#ifdef __WXMSW__
+    ext.MakeLower();
+#endif
+    for (auto e = extensions; *e; e++)
+    {
+        if (ext == *e)
+            return true;
+    }
+    return false;
+}
+
+SourceLanguage GetLanguageOfFile(const wxString& file)
+{
+    if (HasExtension(file, PYTHON_EXTENSIONS))
+        return SourceLanguage::Python;
+    if (HasExtension(file, PHP_EXTENSIONS))
+        return SourceLanguage::PHP;
+    if (HasExtension(file, JAVASCRIPT_EXTENSIONS))
+        return SourceLanguage::JavaScript;
+    return SourceLanguage::C;
+}
+
+} // anonymous namespace
+
+
+/**
+    In-process extractor for the most common languages.
+
+    Unlike the gettext extractors, it doesn't run xgettext for the files and
+    msgcat to merge the results; it scans the files directly, in parallel.
+    It only supports a subset of xgettext's options; if the catalog uses
+    any others, gettext extractors are used instead.
+ */
+class NativeExtractor : public Extractor
+{
+public:
+    NativeExtractor()
+    {
+        for (auto list: { C_EXTENSIONS, PYTHON_EXTENSIONS, PHP_EXTENSIONS, JAVASCRIPT_EXTENSIONS })
+        {
+            for (auto e = list; *e; e++)
+                RegisterExtension(*e);
+        }
+    }
+
+    wxString GetId() const override { return "native"; }
+
+    bool SupportsCaching() const override { return true; }
+
+    bool SupportsSourceSpec(const SourceCodeSpec& sourceSpec) const override
+    {
+        ExtractionOptions options;
+        return GetOptions(sourceSpec, options);
+    }
+
+    wxString Extract(TempDirectory& tmpdir,
+                     const SourceCodeSpec& sourceSpec,
+                     const std::vector<wxString>& files,
+                     dispatch::progress_monitor *progress) const override
+    {
+        ExtractionOptions options;
+        if (!GetOptions(sourceSpec, options))
+            throw ExtractionException(ExtractionError::Unspecified);
+
+        const std::map<SourceLanguage, KeywordsMap> keywords =
+        {
+            { SourceLanguage::C,          options.GetKeywords(SourceLanguage::C) },
+            { SourceLanguage::Python,     options.GetKeywords(SourceLanguage::Python) },
+            { SourceLanguage::PHP,        options.GetKeywords(SourceLanguage::PHP) },
+            { SourceLanguage::JavaScript, options.GetKeywords(SourceLanguage::JavaScript) }
+        };
+
+        const auto& basepath = sourceSpec.BasePath;
+
+        dispatch::parallel_options parallel;
+        if (progress)
+            parallel.token = progress->token();
+        auto perFile = dispatch::parallel_transform(0, files.size(), [&](size_t i)
+        {
+            auto& file = files[i];
+            const auto lang = GetLanguageOfFile(file);
+            const auto text = ReadSourceFile(basepath + file, options.charset);
+            wxLogTrace("poedit.extractor", "  - scanning %s", file);
+            auto tokens = Tokenizer(lang, text).Run();
+            auto found = MessagesFinder(lang, keywords.at(lang), options, str::to_utf8(file)).Run(tokens);
+            if (progress)
+                progress->advance();
+            return found;
+        }, parallel);
+        CheckCancelled(progress);
+
+        auto messages = MergeMessages(std::move(perFile));
+        if (options.sortOutput)
+        {
+            std::stable_sort(messages.begin(), messages.end(), [](const Message& a, const Message& b)
+            {
+                return a.msgid < b.msgid || (a.msgid == b.msgid && a.context < b.context);
+            });
+        }
+
+        const auto pot = CreatePOT(messages);
+        auto outfile = tmpdir.CreateFileName("native.pot");
+        wxFile out;
+        if (!out.Create(outfile, true) || !out.Write(pot.data(), pot.size()) || !out.Close())
+        {
+            wxLogError(_("Failed to write extracted strings."));
+            throw ExtractionException(ExtractionError::Unspecified);
+        }
+
+        wxLogTrace("poedit.extractor", "native extractor found %d strings", (int)messages.size());
+        return outfile;
+    }
+
+private:
+    static bool GetOptions(const SourceCodeSpec& sourceSpec, ExtractionOptions& options)
+    {
+        for (auto& kw: sourceSpec.Keywords)
+            options.keywords.push_back(str::to_utf8(kw));
+        options.charset = sourceSpec.Charset;
+
+        // match the flags GettextExtractorBase uses by default:
+        options.addComments = true;
+        options.commentsTag = "TRANSLATORS:";
+
+        auto extraFlags = sourceSpec.XHeaders.find("X-Poedit-Flags-xgettext");
+        if (extraFlags != sourceSpec.XHeaders.end())
+            return options.ParseXgettextFlags(extraFlags->second);
+        return true;
+    }
+
+    /// Reads file contents converted to UTF-8
+    static std::string ReadSourceFile(const wxString& filename, const wxString& charset)
+    {
+        wxFile file;
+        std::string data;
+        if (file.Open(filename))
+        {
+            auto len = file.Length();
+            if (len > 0)
+            {
+                data.resize((size_t)len);
+                if (file.Read(&data[0], data.size()) != (ssize_t)data.size())
+                    data.clear();
+            }
+        }
+        if (!file.IsOpened() || (data.empty() && file.Length() > 0))
+        {
+            wxLogError(_(L"Couldn’t read file “%s”."), filename);
+            throw ExtractionException(ExtractionError::Unspecified);
+        }
+
+        // skip UTF-8 BOM:
+        if (data.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            data.erase(0, 3);
+
+        if (!charset.empty() && charset.CmpNoCase("UTF-8") != 0 && charset.CmpNoCase("UTF8") != 0)
+        {
+            wxCSConv conv(charset);
+            if (conv.IsOk())
+            {
+                wxString converted(data.data(), conv, data.size());
+                data = str::to_utf8(converted);
+            }
+        }
+
+        return data;
+    }
+};
+
+
+void Extractor::CreateNativeExtractors(Extractor::ExtractorsList& into)
+{
+    into.push_back(std::make_shared<NativeExtractor>());
+}
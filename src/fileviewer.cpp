@@ -40,11 +40,16 @@
 #include <wx/utils.h>
 #include <wx/stc/stc.h>
 
+#include "concurrency.h"
 #include "customcontrols.h"
 #include "hidpi.h"
 #include "utility.h"
 #include "unicode_helpers.h"
 
+#include <list>
+#include <mutex>
+#include <set>
+
 namespace
 {
 
@@ -54,6 +59,85 @@ const int FRAME_STYLE = wxDEFAULT_FRAME_STYLE | wxFRAME_TOOL_WINDOW;
 const int FRAME_STYLE = wxDEFAULT_FRAME_STYLE;
 #endif
 
+/**
+    Cache of recently viewed source files' decoded content.
+
+    Files are identified by their path and modification time, so that
+    content of changed files is reloaded. May be used from any thread.
+ */
+class SourceFilesCache
+{
+public:
+    static SourceFilesCache& Get()
+    {
+        static SourceFilesCache s_instance;
+        return s_instance;
+    }
+
+    /// Returns content of @a path, loading it if needed, or nullptr on error
+    std::shared_ptr<const wxString> Load(const wxString& path)
+    {
+        const time_t mtime = wxFileModificationTime(path);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto i = m_entries.begin(); i != m_entries.end(); ++i)
+            {
+                if (i->path == path && i->mtime == mtime)
+                {
+                    m_entries.splice(m_entries.begin(), m_entries, i);
+                    return i->content;
+                }
+            }
+        }
+
+        wxFFile file;
+        wxString data;
+        if (!file.Open(path) || !file.ReadAll(&data, wxConvAuto()))
+            return nullptr;
+        auto content = std::make_shared<const wxString>(std::move(data));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.remove_if([&path](const Entry& e){ return e.path == path; });
+        m_entries.push_front({path, mtime, content});
+        Trim();
+        return content;
+    }
+
+private:
+    // Limits of the cache size; the most recently used file is always kept:
+    static const size_t MAX_FILES = 20;
+    static const size_t MAX_CHARS = 16 * 1024 * 1024;
+
+    void Trim()
+    {
+        size_t files = 0, chars = 0;
+        for (auto i = m_entries.begin(); i != m_entries.end(); ++i)
+        {
+            files++;
+            chars += i->content->length();
+            if (files > 1 && (files > MAX_FILES || chars > MAX_CHARS))
+            {
+                m_entries.erase(i, m_entries.end());
+                return;
+            }
+        }
+    }
+
+    struct Entry
+    {
+        wxString path;
+        time_t mtime;
+        std::shared_ptr<const wxString> content;
+    };
+
+    std::mutex m_mutex;
+    std::list<Entry> m_entries; // most recently used first
+};
+
+// Don't evict the shown file from SourceFilesCache by prefetching others:
+const size_t MAX_PREFETCHED_FILES = 5;
+
 } // anonymous namespace
 
 FileViewer *FileViewer::ms_instance = nullptr;
@@ -70,7 +154,8 @@ FileViewer *FileViewer::GetAndActivate()
 }
 
 FileViewer::FileViewer(wxWindow*)
-        : wxFrame(nullptr, wxID_ANY, _("Source file"), wxDefaultPosition, wxDefaultSize, FRAME_STYLE)
+        : wxFrame(nullptr, wxID_ANY, _("Source file"), wxDefaultPosition, wxDefaultSize, FRAME_STYLE),
+          m_loadGeneration(0)
 {
     SetName("fileviewer");
 
@@ -272,7 +357,7 @@ int FileViewer::GetLexer(const wxString& ext)
 }
 
 
-wxFileName FileViewer::GetFilename(wxString ref) const
+wxFileName FileViewer::GetFilename(const wxString& basePath_, wxString ref)
 {
     if ( ref.length() >= 3 &&
          ref[1] == _T(':') &&
@@ -289,7 +374,7 @@ wxFileName FileViewer::GetFilename(wxString ref) const
     if ( filename.IsRelative() )
     {
         wxFileName relative(filename);
-        wxString basePath(m_basePath);
+        wxString basePath(basePath_);
 
         // Sometimes, the path in source reference is not relative to the PO
         // file's location, but is relative to e.g. the root directory. See
@@ -338,6 +423,7 @@ void FileViewer::ShowReferences(CatalogPtr catalog, CatalogItemPtr item, int def
 
     if (m_references.empty())
     {
+        m_loadGeneration++; // ignore any file still being loaded
         ShowError(_("No references for the selected item."));
     }
     else
@@ -346,31 +432,76 @@ void FileViewer::ShowReferences(CatalogPtr catalog, CatalogItemPtr item, int def
             m_file->Append(bidi::platform_mark_direction(r));
         m_file->SetSelection(defaultReference);
         SelectReference(m_references[defaultReference]);
+        PrefetchReferences(defaultReference);
     }
 }
 
-void FileViewer::SelectReference(const wxString& ref)
+void FileViewer::PrefetchReferences(int shownReference)
 {
-    const wxFileName filename = GetFilename(ref);
-    if (!filename.IsOk())
+    // Other references of the item are likely to be looked at next, so have
+    // their files loaded in the cache. Items often reference the same file
+    // many times, which only needs to be loaded once:
+    std::set<wxString> files;
+    wxArrayString refs;
+    files.insert(Catalog::GetReferenceFile(m_references[shownReference]));
+    for (auto& r: m_references)
     {
-        ShowError(wxString::Format(_("Error opening file %s!"), ref.BeforeLast(':')));
-        m_openInEditor->Disable();
-        return;
+        if (refs.size() >= MAX_PREFETCHED_FILES)
+            break;
+        if (files.insert(Catalog::GetReferenceFile(r)).second)
+            refs.push_back(r);
     }
+    if (refs.empty())
+        return;
 
-    wxFFile file;
-    wxString data;
+    const wxString basePath(m_basePath);
+    dispatch::async(dispatch::priority::bulk, [basePath, refs]
+    {
+        wxLogNull null;
+        for (auto& r: refs)
+        {
+            const wxFileName filename = GetFilename(basePath, r);
+            if (filename.IsOk() && filename.IsFileReadable())
+                SourceFilesCache::Get().Load(filename.GetFullPath());
+        }
+    })
+    .catch_all([](dispatch::exception_ptr){});
+}
 
-    if ( !filename.IsFileReadable() ||
-         !file.Open(filename.GetFullPath()) ||
-         !file.ReadAll(&data, wxConvAuto()) )
+void FileViewer::SelectReference(const wxString& ref)
+{
+    // Both finding the file and reading it may be slow, e.g. on network
+    // mounted drives, so do it in the background:
+    const unsigned generation = ++m_loadGeneration;
+    const wxString basePath(m_basePath);
+    m_openInEditor->Disable();
+
+    dispatch::async([basePath, ref]() -> std::shared_ptr<const wxString>
     {
-        ShowError(wxString::Format(_("Error opening file %s!"), ref.BeforeLast(':')));
-        m_openInEditor->Disable();
-        return;
-    }
+        const wxFileName filename = GetFilename(basePath, ref);
+        if (!filename.IsOk() || !filename.IsFileReadable())
+            return nullptr;
+        wxLogNull null;
+        return SourceFilesCache::Get().Load(filename.GetFullPath());
+    })
+    .then_on_window(this, [=](std::shared_ptr<const wxString> data)
+    {
+        if (generation != m_loadGeneration)
+            return; // another reference was selected in the meantime
+
+        if (!data)
+        {
+            ShowError(wxString::Format(_("Error opening file %s!"), ref.BeforeLast(':')));
+            return;
+        }
+
+        ShowContent(ref, data);
+    })
+    .catch_all([](dispatch::exception_ptr){});
+}
 
+void FileViewer::ShowContent(const wxString& ref, std::shared_ptr<const wxString> data)
+{
     m_openInEditor->Enable();
 
     m_error->GetContainingSizer()->Hide(m_error);
@@ -385,9 +516,14 @@ void FileViewer::SelectReference(const wxString& ref)
     if (!linenumStr.ToLong(&linenum))
         linenum = 0;
 
-    m_text->SetReadOnly(false);
-    m_text->SetValue(data);
-    m_text->SetReadOnly(true);
+    // moving between references into the same file only needs the marker moved:
+    if (data != m_shownContent)
+    {
+        m_text->SetReadOnly(false);
+        m_text->SetValue(*data);
+        m_text->SetReadOnly(true);
+        m_shownContent = data;
+    }
 
     m_text->MarkerDeleteAll(1);
     m_text->MarkerAdd((int)linenum - 1, 1);
@@ -400,6 +536,7 @@ void FileViewer::SelectReference(const wxString& ref)
 
 void FileViewer::ShowError(const wxString& msg)
 {
+    m_openInEditor->Disable();
     m_error->SetLabel(msg);
     m_error->GetContainingSizer()->Show(m_error);
     m_text->GetContainingSizer()->Hide(m_text);
@@ -414,7 +551,7 @@ void FileViewer::OnChoice(wxCommandEvent &event)
 
 void FileViewer::OnEditFile(wxCommandEvent&)
 {
-    wxFileName filename = GetFilename(bidi::strip_control_chars(m_file->GetStringSelection()));
+    wxFileName filename = GetFilename(m_basePath, bidi::strip_control_chars(m_file->GetStringSelection()));
     if (filename.IsOk())
         wxLaunchDefaultApplication(filename.GetFullPath());
 }
@@ -30,6 +30,8 @@
 
 #include <wx/frame.h>
 
+#include <memory>
+
 class WXDLLIMPEXP_FWD_CORE wxButton;
 class WXDLLIMPEXP_FWD_CORE wxChoice;
 class WXDLLIMPEXP_FWD_CORE wxStaticText;
@@ -56,9 +58,11 @@ public:
 private:
     void SetupTextCtrl();
     int GetLexer(const wxString& extension);
-    wxFileName GetFilename(wxString ref) const;
+    static wxFileName GetFilename(const wxString& basePath, wxString ref);
 
     void SelectReference(const wxString& ref);
+    void PrefetchReferences(int shownReference);
+    void ShowContent(const wxString& ref, std::shared_ptr<const wxString> data);
     void ShowError(const wxString& msg);
 
 private:
@@ -70,6 +74,11 @@ private:
     wxStyledTextCtrl *m_text;
     wxStaticText *m_error;
 
+    // content currently shown in m_text, to avoid reloading it unnecessarily:
+    std::shared_ptr<const wxString> m_shownContent;
+    // incremented when another reference is selected while loading:
+    unsigned m_loadGeneration;
+
     void OnChoice(wxCommandEvent &event);
     void OnEditFile(wxCommandEvent &event);
 
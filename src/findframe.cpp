@@ -33,6 +33,11 @@
 #include <wx/textctrl.h>
 #include <wx/checkbox.h>
 #include <wx/notebook.h>
+#include <wx/listbox.h>
+#include <wx/log.h>
+
+#include <mutex>
+#include <regex>
 
 #ifdef __WXOSX__
 #include <AppKit/AppKit.h>
@@ -44,12 +49,15 @@
 #endif
 
 #include "catalog.h"
+#include "concurrency.h"
 #include "text_control.h"
 #include "edframe.h"
 #include "editing_area.h"
 #include "edlistctrl.h"
 #include "findframe.h"
 #include "hidpi.h"
+#include "search_index.h"
+#include "unicode_helpers.h"
 #include "utility.h"
 
 namespace
@@ -82,7 +90,8 @@ FindFrame::FindFrame(PoeditFrame *owner,
           m_listCtrl(list),
           m_editingArea(editingArea),
           m_catalog(c),
-          m_position(-1)
+          m_position(-1),
+          m_replaceAllRunning(false)
 {
     auto panel = new wxPanel(this, wxID_ANY);
     wxBoxSizer *panelsizer = new wxBoxSizer(wxVERTICAL);
@@ -119,6 +128,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     m_ignoreCase = new wxCheckBox(collPane, wxID_ANY, _("Ignore case"));
     m_wrapAround = new wxCheckBox(collPane, wxID_ANY, _("Wrap around"));
     m_wholeWords = new wxCheckBox(collPane, wxID_ANY, _("Whole words only"));
+    m_useRegex = new wxCheckBox(collPane, wxID_ANY, _("Regular expression"));
     m_findInOrig = new wxCheckBox(collPane, wxID_ANY, _("Find in source texts"));
     m_findInTrans = new wxCheckBox(collPane, wxID_ANY, _("Find in translations"));
     m_findInComments = new wxCheckBox(collPane, wxID_ANY, _("Find in comments"));
@@ -131,6 +141,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     optionsL->Add(m_ignoreCase, wxSizerFlags().Expand());
     optionsL->Add(m_wrapAround, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsL->Add(m_wholeWords, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
+    optionsL->Add(m_useRegex, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsR->Add(m_findInOrig, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsR->Add(m_findInTrans, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
     optionsR->Add(m_findInComments, wxSizerFlags().Expand().Border(wxTOP, PX(2)));
@@ -145,6 +156,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     m_btnClose = new wxButton(panel, wxID_CLOSE, _("Close"));
     m_btnReplaceAll = new wxButton(panel, wxID_ANY, MSW_OR_OTHER(_("Replace &all"), _("Replace &All")));
     m_btnReplace = new wxButton(panel, wxID_ANY, _("&Replace"));
+    m_btnFindAll = new wxButton(panel, wxID_ANY, MSW_OR_OTHER(_("Find a&ll"), _("Find A&ll")));
     m_btnPrev = new wxButton(panel, wxID_ANY, _("< &Previous"));
     m_btnNext = new wxButton(panel, wxID_ANY, _("&Next >"));
     m_btnNext->SetDefault();
@@ -155,9 +167,18 @@ FindFrame::FindFrame(PoeditFrame *owner,
     buttons->AddStretchSpacer();
     buttons->Add(m_btnReplaceAll, wxSizerFlags().PXBorder(wxRIGHT));
     buttons->Add(m_btnReplace, wxSizerFlags().PXBorder(wxRIGHT));
+    buttons->Add(m_btnFindAll, wxSizerFlags().PXBorder(wxRIGHT));
     buttons->Add(m_btnPrev, wxSizerFlags().PXBorder(wxRIGHT));
     buttons->Add(m_btnNext, wxSizerFlags());
 
+    // Find All results, hidden until used:
+    m_resultsInfo = new wxStaticText(panel, wxID_ANY, "");
+    m_results = new wxListBox(panel, wxID_ANY, wxDefaultPosition, wxSize(-1, PX(200)), 0, nullptr, wxLB_SINGLE);
+    sizer->Add(m_resultsInfo, wxSizerFlags().Expand().PXBorderAll());
+    sizer->Add(m_results, wxSizerFlags().Expand().PXBorder(wxLEFT|wxRIGHT|wxBOTTOM));
+    sizer->Hide(m_resultsInfo);
+    sizer->Hide(m_results);
+
     panel->SetSizer(panelsizer);
     auto topsizer = new wxBoxSizer(wxHORIZONTAL);
     topsizer->Add(panel, wxSizerFlags(1).Expand());
@@ -179,6 +200,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
     m_ignoreCase->SetValue(!wxConfig::Get()->ReadBool("find_case_sensitive", false));
     m_wrapAround->SetValue(wxConfig::Get()->ReadBool("find_wrap_around", true));
     m_wholeWords->SetValue(wxConfig::Get()->ReadBool("whole_words", false));
+    m_useRegex->SetValue(wxConfig::Get()->ReadBool("find_regex", false));
 
     wxAcceleratorEntry entries[] = {
 #ifndef __WXGTK__
@@ -225,7 +247,11 @@ FindFrame::FindFrame(PoeditFrame *owner,
     m_btnReplace->Bind(wxEVT_BUTTON, &FindFrame::OnReplace, this);
     m_btnReplaceAll->Bind(wxEVT_BUTTON, &FindFrame::OnReplaceAll, this);
     m_btnReplace->Bind(wxEVT_UPDATE_UI, [=](wxUpdateUIEvent& e){ e.Enable((bool)m_lastItem); });
-    m_btnReplaceAll->Bind(wxEVT_UPDATE_UI, [=](wxUpdateUIEvent& e){ e.Enable(!ms_text.empty()); });
+    m_btnReplaceAll->Bind(wxEVT_UPDATE_UI, [=](wxUpdateUIEvent& e){ e.Enable(!ms_text.empty() && !m_replaceAllRunning); });
+    m_btnFindAll->Bind(wxEVT_BUTTON, &FindFrame::OnFindAll, this);
+    m_btnFindAll->Bind(wxEVT_UPDATE_UI, [=](wxUpdateUIEvent& e){ e.Enable(!ms_text.empty()); });
+    m_results->Bind(wxEVT_LISTBOX, &FindFrame::OnResultSelected, this);
+    m_findAllTimer.Bind(wxEVT_TIMER, &FindFrame::OnFindAllTimer, this);
 
     // SetHint() needs to be called *after* binding any event handlers, for
     // compatibility with its generic implementation:
@@ -239,6 +265,7 @@ FindFrame::FindFrame(PoeditFrame *owner,
 
 FindFrame::~FindFrame()
 {
+    CancelFindAll();
     SaveWindowState(this, WinState_Pos);
 }
 
@@ -249,6 +276,12 @@ void FindFrame::Reset(const CatalogPtr& c)
     m_position = -1;
     m_lastItem.reset();
 
+    // results refer to items of the previous search:
+    CancelFindAll();
+    m_results->Clear();
+    m_resultIndexes.clear();
+    ShowResults(false);
+
     UpdateButtons();
 }
 
@@ -305,12 +338,14 @@ void FindFrame::OnModeChanged()
 
     m_btnReplace->Show(isReplace);
     m_btnReplaceAll->Show(isReplace);
+    m_btnFindAll->Show(!isReplace);
     m_replaceField->GetContainingSizer()->Show(m_replaceField, isReplace);
 
     m_findInOrig->Enable(!isReplace);
     m_findInTrans->Enable(!isReplace);
     m_findInComments->Enable(!isReplace);
     m_ignoreCase->Enable(!isReplace);
+    m_useRegex->Enable(!isReplace);
 
     Layout();
     GetSizer()->SetSizeHints(this);
@@ -334,6 +369,7 @@ void FindFrame::OnCheckbox(wxCommandEvent&)
     wxConfig::Get()->Write("find_case_sensitive", !m_ignoreCase->GetValue());
     wxConfig::Get()->Write("find_wrap_around", m_wrapAround->GetValue());
     wxConfig::Get()->Write("whole_words", m_wholeWords->GetValue());
+    wxConfig::Get()->Write("find_regex", m_useRegex->GetValue());
 }
 
 
@@ -403,41 +439,159 @@ bool FindTextInStringAndDo(S& str, const wxString& text, bool wholeWords, F&& ha
     return found;
 }
 
-bool IsTextInString(wxString str, const wxString& text,
-                    bool ignoreCase, bool wholeWords, bool ignoreAmp, bool ignoreUnderscore)
+bool ReplaceTextInString(wxString& str, const wxString& text, bool wholeWords, const wxString& replacement)
 {
-    if (ignoreCase)
-        str.MakeLower();
-    if (ignoreAmp)
-        str.Replace("&", "");
-    if (ignoreUnderscore)
-        str.Replace("_", "");
-
     return FindTextInStringAndDo(str, text, wholeWords,
-                                 [=](const wxString&,size_t,size_t){ return wxString::npos;/*just 1 hit*/ });
+                                 [=](wxString& s, size_t pos, size_t len){
+                                     s.replace(pos, len, replacement);
+                                     return pos + replacement.length();
+                                 });
 }
 
-size_t IsTextInStrings(const wxArrayString& strs, const wxString& text,
-                     bool ignoreCase, bool wholeWords, bool ignoreAmp, bool ignoreUnderscore)
+
+/**
+    Searched text together with the search options, for finding it in strings.
+
+    Const methods are safe to call from several threads at once.
+ */
+class TextMatcher
 {
-    // loop through all strings and search for the substring in them
-    for (size_t i = 0; i < strs.GetCount(); i++)
+public:
+    /// Throws std::regex_error if @a text isn't a valid regular expression.
+    TextMatcher(const wxString& text, bool ignoreCase, bool wholeWords, bool useRegex, bool mnemonicsAware)
+        : m_text(text), m_ignoreCase(ignoreCase), m_wholeWords(wholeWords), m_useRegex(useRegex)
     {
-        if (IsTextInString(strs[i], text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore))
-            return i;
+        // Only ignore mnemonics when searching if the text being searched for
+        // doesn't contain them. That's a reasonable heuristics: most of the time,
+        // ignoring them is the right thing to do and provides better results. But
+        // sometimes, people want to search for them.
+        m_ignoreAmp = mnemonicsAware && (text.Find(_T('&')) == wxNOT_FOUND);
+        m_ignoreUnderscore = mnemonicsAware && (text.Find(_T('_')) == wxNOT_FOUND);
+
+        if (useRegex)
+        {
+            auto flags = std::regex_constants::ECMAScript;
+            if (ignoreCase)
+                flags |= std::regex_constants::icase;
+            std::wstring pattern = text.ToStdWstring();
+            if (wholeWords)
+                pattern = L"\\b(?:" + pattern + L")\\b";
+            m_regex = std::wregex(pattern, flags);
+        }
+        else if (ignoreCase)
+        {
+            m_text = unicode::fold_case(m_text);
+        }
     }
 
-    return -1;
-}
+    bool IsRegex() const { return m_useRegex; }
+
+    /// Are searched strings case-folded by Prepare()?
+    bool IsCaseFolding() const { return m_ignoreCase && !m_useRegex; }
+
+    /**
+        Calls handler(str, pos, len) for occurrences in @a str, as prepared
+        by Prepare(), until it returns wxString::npos or the position after
+        which to continue. Returns true if anything was found.
+     */
+    template<typename S, typename F>
+    bool FindAndDo(S& str, F&& handler) const
+    {
+        if (!m_useRegex)
+            return FindTextInStringAndDo(str, m_text, m_wholeWords, handler);
+
+        bool found = false;
+        size_t start = 0;
+        while (start != wxString::npos && start <= str.length())
+        {
+            const wchar_t *begin = str.wc_str();
+            std::wcmatch m;
+            auto flags = start > 0 ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+            if (!std::regex_search(begin + start, begin + str.length(), m, m_regex, flags))
+                break;
+
+            const size_t pos = start + m.position(0);
+            const size_t len = m.length(0);
+            if (len == 0)
+            {
+                start = pos + 1; // don't report empty matches
+                continue;
+            }
+
+            found = true;
+            start = handler(str, pos, len);
+        }
+
+        return found;
+    }
+
+    /// Prepares a string for FindAndDo(), e.g. lowercases it if appropriate
+    wxString Prepare(wxString str, bool ignoreMnemonics) const
+    {
+        if (IsCaseFolding())
+            str = unicode::fold_case(str);
+        if (ignoreMnemonics && m_ignoreAmp)
+            str.Replace("&", "");
+        if (ignoreMnemonics && m_ignoreUnderscore)
+            str.Replace("_", "");
+        return str;
+    }
+
+    /// Is the text in @a str? Mnemonics are ignored if @a ignoreMnemonics.
+    bool IsIn(const wxString& str, bool ignoreMnemonics) const
+    {
+        auto s = Prepare(str, ignoreMnemonics);
+        return FindAndDo(s, [](const wxString&,size_t,size_t){ return wxString::npos;/*just 1 hit*/ });
+    }
+
+    /// Returns index of the first of @a strs containing the text, or -1
+    template<typename Strings>
+    size_t IsInStrings(const Strings& strs, bool ignoreMnemonics) const
+    {
+        // loop through all strings and search for the substring in them
+        for (size_t i = 0; i < strs.size(); i++)
+        {
+            if (IsIn(strs[i], ignoreMnemonics))
+                return i;
+        }
+
+        return -1;
+    }
+
+    /// Like IsIn(), but for already case-folded text; requires IsCaseFolding()
+    bool IsInFolded(const CatalogSearchIndex::FoldedText& str, bool ignoreMnemonics) const
+    {
+        auto justOne = [](const wxString&,size_t,size_t){ return wxString::npos; };
+
+        // the common cases don't need to modify the text:
+        if (!ignoreMnemonics || !str.hasMnemonics || (!m_ignoreAmp && !m_ignoreUnderscore))
+            return FindAndDo(str.text, justOne);
+        if (m_ignoreAmp && m_ignoreUnderscore)
+            return FindAndDo(str.withoutMnemonics, justOne);
+
+        auto s = str.text;
+        s.Replace(m_ignoreAmp ? "&" : "_", "");
+        return FindAndDo(s, justOne);
+    }
+
+    size_t IsInFoldedStrings(const std::vector<CatalogSearchIndex::FoldedText>& strs, bool ignoreMnemonics) const
+    {
+        for (size_t i = 0; i < strs.size(); i++)
+        {
+            if (IsInFolded(strs[i], ignoreMnemonics))
+                return i;
+        }
+
+        return -1;
+    }
+
+private:
+    wxString m_text;
+    bool m_ignoreCase, m_wholeWords, m_useRegex;
+    bool m_ignoreAmp, m_ignoreUnderscore;
+    std::wregex m_regex;
+};
 
-bool ReplaceTextInString(wxString& str, const wxString& text, bool wholeWords, const wxString& replacement)
-{
-    return FindTextInStringAndDo(str, text, wholeWords,
-                                 [=](wxString& s, size_t pos, size_t len){
-                                     s.replace(pos, len, replacement);
-                                     return pos + replacement.length();
-                                 });
-}
 
 enum FoundState
 {
@@ -449,8 +603,128 @@ enum FoundState
     Found_InExtractedComments
 };
 
+/// Parts of items to search in
+struct SearchScope
+{
+    bool inTrans, inSource, inComments;
+};
+
+/// Finds the text in @a dt, which is a CatalogItem or anything with the same accessors
+template<typename T>
+FoundState FindInItem(const T& dt, const TextMatcher& matcher, const SearchScope& scope, size_t& trans)
+{
+    if (scope.inTrans)
+    {
+        trans = matcher.IsInStrings(dt.GetTranslations(), true);
+        if (trans != (size_t)-1)
+            return Found_InTrans;
+    }
+    if (scope.inSource)
+    {
+        if (matcher.IsIn(dt.GetString(), true))
+            return Found_InOrig;
+        if (dt.HasPlural() && matcher.IsIn(dt.GetPluralString(), true))
+            return Found_InOrigPlural;
+    }
+    if (scope.inComments)
+    {
+        if (matcher.IsIn(dt.GetComment(), false))
+            return Found_InComments;
+        if (matcher.IsInStrings(dt.GetExtractedComments(), false) != (size_t)-1)
+            return Found_InExtractedComments;
+    }
+    return Found_Not;
+}
+
+/// Like FindInItem(), but uses cached case-folded texts of the item
+FoundState FindInFoldedItem(const CatalogSearchIndex::FoldedTexts& dt, bool hasPlural,
+                            const TextMatcher& matcher, const SearchScope& scope, size_t& trans)
+{
+    if (scope.inTrans)
+    {
+        trans = matcher.IsInFoldedStrings(dt.translations, true);
+        if (trans != (size_t)-1)
+            return Found_InTrans;
+    }
+    if (scope.inSource)
+    {
+        if (matcher.IsInFolded(dt.string, true))
+            return Found_InOrig;
+        if (hasPlural && matcher.IsInFolded(dt.plural, true))
+            return Found_InOrigPlural;
+    }
+    if (scope.inComments)
+    {
+        if (matcher.IsInFolded(dt.comment, false))
+            return Found_InComments;
+        if (matcher.IsInFoldedStrings(dt.extractedComments, false) != (size_t)-1)
+            return Found_InExtractedComments;
+    }
+    return Found_Not;
+}
+
+/// Copy of an item's searched texts, for searching in the background
+struct SearchedItem
+{
+    int index;
+    wxString string, plural, comment;
+    SmallStringArray translations;
+    wxArrayString extractedComments;
+
+    const wxString& GetString() const { return string; }
+    bool HasPlural() const { return !plural.empty(); }
+    const wxString& GetPluralString() const { return plural; }
+    const SmallStringArray& GetTranslations() const { return translations; }
+    const wxString& GetComment() const { return comment; }
+    const wxArrayString& GetExtractedComments() const { return extractedComments; }
+};
+
+// Number of items searched between reporting results
+const size_t FIND_ALL_BATCH = 500;
+
+// Maximum length of the text shown in Find All results
+const size_t RESULT_LABEL_LENGTH = 100;
+
+/// Creates matcher for the search, or returns nullptr if it's invalid
+std::unique_ptr<TextMatcher> CreateMatcher(int mode, const wxString& text, bool ignoreCase, bool wholeWords, bool useRegex)
+{
+    try
+    {
+        return std::unique_ptr<TextMatcher>(new TextMatcher(text,
+                                                            (mode == Mode_Find) && ignoreCase,
+                                                            wholeWords,
+                                                            (mode == Mode_Find) && useRegex,
+                                                            mode == Mode_Find));
+    }
+    catch (std::regex_error&)
+    {
+        wxLogError(_(L"“%s” is not a valid regular expression."), text);
+        return nullptr;
+    }
+}
+
+wxString MakeResultLabel(const SearchedItem& item)
+{
+    wxString label = item.string;
+    label.Replace("\n", " ");
+    if (label.length() > RESULT_LABEL_LENGTH)
+        label = label.substr(0, RESULT_LABEL_LENGTH) + L"…";
+    return wxString::Format("%d: %s", item.index + 1, label);
+}
+
 } // anonymous space
 
+
+/// Results of a Find All search, filled from a background thread
+struct FindFrame::FindAllState
+{
+    std::mutex mutex;
+    std::vector<std::pair<int, wxString>> found; // not yet shown
+    bool finished = false;
+    dispatch::cancellation_token token;
+};
+
+
 bool FindFrame::DoFind(int dir)
 {
     wxASSERT( dir == +1 || dir == -1 );
@@ -460,11 +734,10 @@ bool FindFrame::DoFind(int dir)
 
     int mode = m_mode->GetSelection();
     int cnt = m_listCtrl->GetItemCount();
-    bool inTrans = m_findInTrans->GetValue() && (m_catalog->HasCapability(Catalog::Cap::Translations));
-    bool inSource = (mode == Mode_Find) && m_findInOrig->GetValue();
-    bool inComments = (mode == Mode_Find) && m_findInComments->GetValue();
-    bool ignoreCase = (mode == Mode_Find) && m_ignoreCase->GetValue();
-    bool wholeWords = m_wholeWords->GetValue();
+    SearchScope scope;
+    scope.inTrans = m_findInTrans->GetValue() && (m_catalog->HasCapability(Catalog::Cap::Translations));
+    scope.inSource = (mode == Mode_Find) && m_findInOrig->GetValue();
+    scope.inComments = (mode == Mode_Find) && m_findInComments->GetValue();
     bool wrapAround = m_wrapAround->GetValue();
     int posOrig = m_position;
     size_t trans;
@@ -472,18 +745,24 @@ bool FindFrame::DoFind(int dir)
     FoundState found = Found_Not;
     CatalogItemPtr lastItem;
 
-    wxString textc;
-    wxString text(ms_text);
-
-    if (ignoreCase)
-        text.MakeLower();
+    auto matcher = CreateMatcher(mode, ms_text, m_ignoreCase->GetValue(), m_wholeWords->GetValue(), m_useRegex->GetValue());
+    if (!matcher)
+        return false;
 
-    // Only ignore mnemonics when searching if the text being searched for
-    // doesn't contain them. That's a reasonable heuristics: most of the time,
-    // ignoring them is the right thing to do and provides better results. But
-    // sometimes, people want to search for them.
-    const bool ignoreAmp = (mode == Mode_Find) && (text.Find(_T('&')) == wxNOT_FOUND);
-    const bool ignoreUnderscore = (mode == Mode_Find) && (text.Find(_T('_')) == wxNOT_FOUND);
+    // Only items that may contain the text need to be examined, if the index
+    // knows which ones they are:
+    std::vector<bool> isCandidate;
+    std::vector<int> candidates;
+    if (!matcher->IsRegex() && m_listCtrl->searchIndex().FindCandidates(ms_text, candidates))
+    {
+        isCandidate.assign(cnt, false);
+        for (auto index: candidates)
+        {
+            int row = m_listCtrl->CatalogIndexToList(index);
+            if (row >= 0 && row < cnt)
+                isCandidate[row] = true;
+        }
+    }
 
     int oldPosition = m_position;
     m_position = oldPosition + dir;
@@ -504,43 +783,23 @@ bool FindFrame::DoFind(int dir)
                 break;
         }
 
-        auto dt = lastItem = (*m_catalog)[m_listCtrl->ListIndexToCatalog(m_position)];
+        if (!isCandidate.empty() && !isCandidate[m_position])
+            continue;
 
-        if (inTrans)
-        {
-            trans = IsTextInStrings(dt->GetTranslations(), text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore);
-            if (trans != (size_t)-1)
-            {
-                found = Found_InTrans;
-                break;
-            }
-        }
-        if (inSource)
+        const int index = m_listCtrl->ListIndexToCatalog(m_position);
+        auto dt = lastItem = (*m_catalog)[index];
+
+        if (matcher->IsCaseFolding())
         {
-            if (IsTextInString(dt->GetString(), text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore))
-            {
-                found = Found_InOrig;
-                break;
-            }
-            if (dt->HasPlural() && IsTextInString(dt->GetPluralString(), text, ignoreCase, wholeWords, ignoreAmp, ignoreUnderscore))
-            {
-                found = Found_InOrigPlural;
-                break;
-            }
+            auto& folded = m_listCtrl->searchIndex().GetFoldedTexts(index, *dt);
+            found = FindInFoldedItem(folded, dt->HasPlural(), *matcher, scope, trans);
         }
-        if (inComments)
+        else
         {
-            if (IsTextInString(dt->GetComment(), text, ignoreCase, wholeWords, false, false))
-            {
-                found = Found_InComments;
-                break;
-            }
-            if (IsTextInStrings(dt->GetExtractedComments(), text, ignoreCase, wholeWords, false, false) != (size_t)-1)
-            {
-                found = Found_InExtractedComments;
-                break;
-            }
+            found = FindInItem(*dt, *matcher, scope, trans);
         }
+        if (found != Found_Not)
+            break;
     }
 
     if (found != Found_Not)
@@ -580,12 +839,10 @@ bool FindFrame::DoFind(int dir)
 
         if (txt)
         {
-            textc = txt->GetValue();
-            if (ignoreCase)
-                textc.MakeLower();
-            FindTextInStringAndDo
+            auto textc = matcher->Prepare(txt->GetValue(), false);
+            matcher->FindAndDo
             (
-                textc, text, wholeWords,
+                textc,
                 [=](const wxString&,size_t pos, size_t len)
                 {
                     txt->ShowFindIndicator((int)pos, (int)len);
@@ -601,6 +858,179 @@ bool FindFrame::DoFind(int dir)
     return false;
 }
 
+
+void FindFrame::OnFindAll(wxCommandEvent&)
+{
+    CancelFindAll();
+    m_results->Clear();
+    m_resultIndexes.clear();
+
+    if (!m_listCtrl || !m_catalog)
+        return;
+
+    std::shared_ptr<const TextMatcher> matcher =
+        CreateMatcher(Mode_Find, ms_text, m_ignoreCase->GetValue(), m_wholeWords->GetValue(), m_useRegex->GetValue());
+    if (!matcher)
+        return;
+
+    SearchScope scope;
+    scope.inTrans = m_findInTrans->GetValue() && (m_catalog->HasCapability(Catalog::Cap::Translations));
+    scope.inSource = m_findInOrig->GetValue();
+    scope.inComments = m_findInComments->GetValue();
+
+    // Copy texts of the items to search, in the list's order, so that the
+    // search can run in the background while the user continues working:
+    const int cnt = m_listCtrl->GetItemCount();
+    std::vector<int> candidates;
+    std::vector<bool> isCandidate;
+    if (!matcher->IsRegex() && m_listCtrl->searchIndex().FindCandidates(ms_text, candidates))
+    {
+        isCandidate.assign(m_catalog->GetCount(), false);
+        for (auto index: candidates)
+            isCandidate[index] = true;
+    }
+
+    auto snapshot = std::make_shared<std::vector<SearchedItem>>();
+    snapshot->reserve(isCandidate.empty() ? cnt : candidates.size());
+    for (int row = 0; row < cnt; row++)
+    {
+        const int index = m_listCtrl->ListIndexToCatalog(row);
+        if (index == -1 || (!isCandidate.empty() && !isCandidate[index]))
+            continue;
+        auto& dt = *(*m_catalog)[index];
+        SearchedItem item;
+        item.index = index;
+        item.string = dt.GetString();
+        if (dt.HasPlural())
+            item.plural = dt.GetPluralString();
+        if (scope.inTrans)
+            item.translations = dt.GetTranslations();
+        if (scope.inComments)
+        {
+            item.comment = dt.GetComment();
+            item.extractedComments = dt.GetExtractedComments();
+        }
+        snapshot->push_back(std::move(item));
+    }
+
+    auto state = std::make_shared<FindAllState>();
+    m_findAll = state;
+
+    m_resultsInfo->SetLabel(_(L"Searching…"));
+    ShowResults(true);
+    m_findAllTimer.Start(100);
+
+    dispatch::async([=]
+    {
+        std::vector<std::pair<int, wxString>> found;
+        size_t searched = 0;
+        for (auto& item: *snapshot)
+        {
+            if (state->token.is_cancelled())
+                return;
+
+            size_t trans;
+            if (FindInItem(item, *matcher, scope, trans) != Found_Not)
+                found.emplace_back(item.index, MakeResultLabel(item));
+
+            if (++searched % FIND_ALL_BATCH == 0 && !found.empty())
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->found.insert(state->found.end(), found.begin(), found.end());
+                found.clear();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->found.insert(state->found.end(), found.begin(), found.end());
+        state->finished = true;
+    });
+}
+
+
+void FindFrame::OnFindAllTimer(wxTimerEvent&)
+{
+    if (!m_findAll)
+    {
+        m_findAllTimer.Stop();
+        return;
+    }
+
+    std::vector<std::pair<int, wxString>> found;
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(m_findAll->mutex);
+        found.swap(m_findAll->found);
+        finished = m_findAll->finished;
+    }
+
+    if (!found.empty())
+    {
+        wxArrayString labels;
+        labels.reserve(found.size());
+        for (auto& f: found)
+        {
+            m_resultIndexes.push_back(f.first);
+            labels.push_back(f.second);
+        }
+        m_results->Append(labels);
+    }
+
+    const int count = (int)m_resultIndexes.size();
+    if (finished)
+    {
+        m_findAllTimer.Stop();
+        m_findAll.reset();
+        m_resultsInfo->SetLabel(count
+                                ? wxString::Format(wxPLURAL("%d matching string found.", "%d matching strings found.", count), count)
+                                : _("No matching strings found."));
+    }
+    else if (!found.empty())
+    {
+        m_resultsInfo->SetLabel(wxString::Format(wxPLURAL(L"%d matching string found so far…", L"%d matching strings found so far…", count), count));
+    }
+}
+
+
+void FindFrame::CancelFindAll()
+{
+    if (m_findAll)
+    {
+        m_findAll->token.cancel();
+        m_findAll.reset();
+    }
+    m_findAllTimer.Stop();
+}
+
+
+void FindFrame::ShowResults(bool show)
+{
+    auto sizer = m_results->GetContainingSizer();
+    if (sizer->IsShown(m_results) == show)
+        return;
+    sizer->Show(m_results, show);
+    sizer->Show(m_resultsInfo, show);
+    Layout();
+    GetSizer()->SetSizeHints(this);
+}
+
+
+void FindFrame::OnResultSelected(wxCommandEvent& event)
+{
+    const int sel = event.GetSelection();
+    if (!m_listCtrl || sel < 0 || sel >= (int)m_resultIndexes.size())
+        return;
+
+    const int row = m_listCtrl->CatalogIndexToList(m_resultIndexes[sel]);
+    if (row == -1)
+        return; // filtered out of the list since the search
+
+    m_position = row;
+    m_lastItem = m_listCtrl->ListIndexToCatalogItem(row);
+    m_listCtrl->EnsureVisible(m_listCtrl->ListIndexToListItem(row));
+    m_listCtrl->SelectAndFocus(row);
+}
+
 bool FindFrame::DoReplaceInItem(CatalogItemPtr item)
 {
     bool wholeWords = m_wholeWords->GetValue();
@@ -632,24 +1062,86 @@ void FindFrame::OnReplace(wxCommandEvent&)
     if (!m_lastItem)
         return;
     if (DoReplaceInItem(m_lastItem))
-    {
-        // FIXME: Only refresh affected items
-        m_listCtrl->RefreshAllItems();
-    }
+        m_listCtrl->RefreshItem(m_listCtrl->CatalogIndexToListItem(m_lastItem->GetId() - 1));
 }
 
 void FindFrame::OnReplaceAll(wxCommandEvent&)
 {
-    bool replaced = false;
-    for (auto& item: m_catalog->items())
+    if (!m_listCtrl || !m_catalog || m_replaceAllRunning)
+        return;
+
+    const bool wholeWords = m_wholeWords->GetValue();
+    const auto search = m_searchField->GetValue();
+    const auto replace = m_replaceField->GetValue();
+    auto& items = m_catalog->items();
+
+    std::vector<int> candidates;
+    if (!m_listCtrl->searchIndex().FindCandidates(search, candidates))
     {
-        if (DoReplaceInItem(item))
-            replaced = true;
+        candidates.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+            candidates[i] = int(i);
     }
 
-    if (replaced)
+    // Replacements are computed in the background on copies of the
+    // translations and then applied all at once, with a single refresh:
+    struct Replacement
+    {
+        CatalogItemPtr item;
+        SmallStringArray original, replaced;
+        bool changed;
+    };
+    auto work = std::make_shared<std::vector<Replacement>>();
+    work->reserve(candidates.size());
+    for (auto i: candidates)
+        work->push_back({items[i], items[i]->GetTranslations(), SmallStringArray(), false});
+
+    m_replaceAllRunning = true;
+    auto catalog = m_catalog;
+
+    dispatch::async([=]
     {
-        // FIXME: Only refresh affected items
+        dispatch::parallel_for(0, work->size(), [=](size_t i)
+        {
+            auto& r = (*work)[i];
+            r.replaced = r.original;
+            for (auto& t: r.replaced)
+            {
+                if (ReplaceTextInString(t, search, wholeWords, replace))
+                    r.changed = true;
+            }
+        });
+    })
+    .then_on_window(this, [=]
+    {
+        m_replaceAllRunning = false;
+        if (catalog != m_catalog || !m_listCtrl)
+            return;
+
+        bool anyChanged = false;
+        bool statsChanged = false;
+        bool currentChanged = false;
+        auto current = m_owner->GetCurrentItem();
+        for (auto& r: *work)
+        {
+            // don't overwrite edits done while replacements were computed:
+            if (!r.changed || r.item->GetTranslations() != r.original)
+                continue;
+
+            const bool wasTranslated = r.item->IsTranslated();
+            r.item->SetTranslations(r.replaced);
+            r.item->SetModified(true);
+            anyChanged = true;
+            statsChanged = statsChanged || (wasTranslated != r.item->IsTranslated());
+            currentChanged = currentChanged || (r.item == current);
+        }
+
+        if (!anyChanged)
+            return;
+
+        m_owner->MarkAsModified(statsChanged);
         m_listCtrl->RefreshAllItems();
-    }
+        if (currentChanged)
+            m_owner->UpdateToTextCtrl(EditingArea::UndoableEdit);
+    });
 }
@@ -29,11 +29,17 @@
 #include "edlistctrl.h"
 
 #include <wx/frame.h>
+#include <wx/timer.h>
 #include <wx/weakref.h>
 
+#include <memory>
+#include <vector>
+
 class WXDLLIMPEXP_FWD_CORE wxButton;
 class WXDLLIMPEXP_FWD_CORE wxCheckBox;
 class WXDLLIMPEXP_FWD_CORE wxChoice;
+class WXDLLIMPEXP_FWD_CORE wxListBox;
+class WXDLLIMPEXP_FWD_CORE wxStaticText;
 class WXDLLIMPEXP_FWD_CORE wxTextCtrl;
 
 class Catalog;
@@ -88,18 +94,36 @@ class FindFrame : public wxFrame
         bool DoFind(int dir);
         bool DoReplaceInItem(CatalogItemPtr item);
 
+        // Find All searches a copy of the items in the background and
+        // shows matching items in m_results as they are found:
+        void OnFindAll(wxCommandEvent &event);
+        void OnFindAllTimer(wxTimerEvent &event);
+        void OnResultSelected(wxCommandEvent &event);
+        void CancelFindAll();
+        void ShowResults(bool show);
+
         PoeditFrame *m_owner;
         wxChoice *m_mode;
         wxTextCtrl *m_searchField, *m_replaceField;
         wxCheckBox *m_ignoreCase, *m_wrapAround, *m_wholeWords,
-                   *m_findInOrig, *m_findInTrans, *m_findInComments;
+                   *m_findInOrig, *m_findInTrans, *m_findInComments,
+                   *m_useRegex;
 
         wxWeakRef<PoeditListCtrl> m_listCtrl;
         wxWeakRef<EditingArea> m_editingArea;
         CatalogPtr m_catalog;
         int m_position;
         CatalogItemPtr m_lastItem;
-        wxButton *m_btnClose, *m_btnReplaceAll, *m_btnReplace, *m_btnPrev, *m_btnNext;
+        wxButton *m_btnClose, *m_btnReplaceAll, *m_btnReplace, *m_btnFindAll, *m_btnPrev, *m_btnNext;
+
+        struct FindAllState;
+        std::shared_ptr<FindAllState> m_findAll;  // search in progress
+        wxTimer m_findAllTimer;
+        wxStaticText *m_resultsInfo;
+        wxListBox *m_results;
+        std::vector<int> m_resultIndexes;  // catalog indexes of m_results' items
+
+        bool m_replaceAllRunning;
 
         // NB: this is static so that last search term is remembered
         static wxString ms_text;
@@ -0,0 +1,235 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "format_placeholders.h"
+
+#include <algorithm>
+
+namespace
+{
+
+inline bool IsDigit(wchar_t c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool IsOneOf(wchar_t c, const char *chars)
+{
+    for (; *chars; ++chars)
+    {
+        if (c == (wchar_t)*chars)
+            return true;
+    }
+    return false;
+}
+
+// [0-9a-zA-Z_.-]
+inline bool IsVariableChar(wchar_t c)
+{
+    return IsDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.' || c == '-';
+}
+
+// skips optional positional argument, "(\d+\$)?"
+inline const wchar_t *SkipArgPosition(const wchar_t *i, const wchar_t *end)
+{
+    auto j = i;
+    while (j != end && IsDigit(*j))
+        ++j;
+    return (j != i && j != end && *j == '$') ? j + 1 : i;
+}
+
+inline const wchar_t *SkipDigits(const wchar_t *i, const wchar_t *end)
+{
+    while (i != end && IsDigit(*i))
+        ++i;
+    return i;
+}
+
+} // anonymous namespace
+
+
+unsigned GetPlaceholderSyntaxes(const wxString& formatFlag)
+{
+    unsigned syntaxes = Placeholders_Common;
+    if (formatFlag == "c")
+        syntaxes |= Placeholders_C;
+    else if (formatFlag == "php")
+        syntaxes |= Placeholders_PHP;
+    return syntaxes;
+}
+
+
+// c-format per http://en.cppreference.com/w/cpp/io/c/fprintf,
+//              http://pubs.opengroup.org/onlinepubs/9699919799/functions/fprintf.html
+// i.e. %(\d+\$)?[-+ #0]{0,5}(\d+|\*)?(\.(\d+|\*))?(hh|ll|[hljztL])?[%csdioxXufFeEaAgGnp]
+const wchar_t *PlaceholderTokenizer::MatchC(const wchar_t *i) const
+{
+    auto end = m_end;
+    i = SkipArgPosition(i + 1, end);
+
+    for (int flags = 0; flags < 5 && i != end && IsOneOf(*i, "-+ #0"); flags++)
+        ++i;
+
+    if (i != end && *i == '*')
+        ++i;
+    else
+        i = SkipDigits(i, end);
+
+    if (i != end && *i == '.' && i + 1 != end && (i[1] == '*' || IsDigit(i[1])))
+    {
+        ++i;
+        if (*i == '*')
+            ++i;
+        else
+            i = SkipDigits(i, end);
+    }
+
+    if (i != end && i + 1 != end && ((i[0] == 'h' && i[1] == 'h') || (i[0] == 'l' && i[1] == 'l')))
+        i += 2;
+    else if (i != end && IsOneOf(*i, "hljztL"))
+        ++i;
+
+    if (i != end && IsOneOf(*i, "%csdioxXufFeEaAgGnp"))
+        return i + 1;
+
+    return nullptr;
+}
+
+
+// php-format per http://php.net/manual/en/function.sprintf.php plus positionals,
+// i.e. %(\d+\$)?[-+]{0,2}([ 0]|'.)?-?\d*(\..?\d+)?[%bcdeEfFgGosuxX]
+const wchar_t *PlaceholderTokenizer::MatchPHP(const wchar_t *i) const
+{
+    auto end = m_end;
+    i = SkipArgPosition(i + 1, end);
+
+    for (int signs = 0; signs < 2 && i != end && (*i == '-' || *i == '+'); signs++)
+        ++i;
+
+    if (i != end && (*i == ' ' || *i == '0'))
+        ++i;
+    else if (i != end && *i == '\'' && i + 1 != end)
+        i += 2;
+
+    if (i != end && *i == '-')
+        ++i;
+
+    i = SkipDigits(i, end);
+
+    if (i != end && *i == '.')
+    {
+        // "\..?\d+", the optional character is tried first, as regex would
+        auto j = i + 1;
+        if (j != end && j + 1 != end && IsDigit(j[1]))
+            i = SkipDigits(j + 1, end);
+        else if (j != end && IsDigit(*j))
+            i = SkipDigits(j, end);
+    }
+
+    if (i != end && IsOneOf(*i, "%bcdeEfFgGosuxX"))
+        return i + 1;
+
+    return nullptr;
+}
+
+
+// %foo% (Twig), {foo} and {{foo}}, i.e.
+// (%[0-9a-zA-Z_.-]+%)|(\{[0-9a-zA-Z_.-]+\})|(\{\{[0-9a-zA-Z_.-]+\}\})
+const wchar_t *PlaceholderTokenizer::MatchCommon(const wchar_t *i) const
+{
+    auto end = m_end;
+    if (*i == '%')
+    {
+        auto j = i + 1;
+        while (j != end && IsVariableChar(*j))
+            ++j;
+        if (j != i + 1 && j != end && *j == '%')
+            return j + 1;
+    }
+    else if (*i == '{')
+    {
+        auto j = i + 1;
+        while (j != end && IsVariableChar(*j))
+            ++j;
+        if (j != i + 1 && j != end && *j == '}')
+            return j + 1;
+
+        if (i + 1 != end && i[1] == '{')
+        {
+            j = i + 2;
+            while (j != end && IsVariableChar(*j))
+                ++j;
+            if (j != i + 2 && j != end && j + 1 != end && j[0] == '}' && j[1] == '}')
+                return j + 2;
+        }
+    }
+    return nullptr;
+}
+
+
+bool PlaceholderTokenizer::Next(size_t& pos, size_t& length)
+{
+    for (; m_pos != m_end; ++m_pos)
+    {
+        const wchar_t c = *m_pos;
+        if (c != '%' && c != '{')
+            continue;
+
+        const wchar_t *matchEnd = nullptr;
+        if (c == '%' && (m_syntaxes & Placeholders_C))
+            matchEnd = MatchC(m_pos);
+        if (!matchEnd && c == '%' && (m_syntaxes & Placeholders_PHP))
+            matchEnd = MatchPHP(m_pos);
+        if (!matchEnd && (m_syntaxes & Placeholders_Common))
+            matchEnd = MatchCommon(m_pos);
+
+        if (matchEnd)
+        {
+            pos = m_pos - m_begin;
+            length = matchEnd - m_pos;
+            m_pos = matchEnd;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ExtractPlaceholders(const wxString& s, unsigned syntaxes, std::vector<wxString>& out)
+{
+    const auto buf = s.wc_str();
+    const wchar_t *begin = buf;
+    PlaceholderTokenizer tokenizer(syntaxes, begin, begin + wxWcslen(begin));
+
+    size_t pos, length;
+    while (tokenizer.Next(pos, length))
+    {
+        if (length == 2 && begin[pos + 1] == '%')
+            continue; // escaped %, not a placeholder
+        out.emplace_back(begin + pos, length);
+    }
+
+    std::sort(out.begin(), out.end());
+}
@@ -0,0 +1,96 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_format_placeholders_h
+#define Poedit_format_placeholders_h
+
+#include <wx/string.h>
+
+#include <vector>
+
+
+/// Syntaxes of placeholders recognized by PlaceholderTokenizer; can be combined
+enum PlaceholderSyntax
+{
+    Placeholders_C      = 0x01, ///< c-format, e.g. %s, %1$d or %-5.2f
+    Placeholders_PHP    = 0x02, ///< php-format, e.g. %s, %'*10d or %1$s
+    Placeholders_Common = 0x04  ///< variables expansion for %foo% (Twig), {foo} and {{foo}}
+};
+
+/// Returns syntaxes of placeholders used in strings with given format flag.
+/// Common placeholders are always included, as they are used everywhere.
+unsigned GetPlaceholderSyntaxes(const wxString& formatFlag);
+
+
+/**
+    Finds placeholders in text, without allocating any memory.
+
+    The text is scanned from the start and the leftmost placeholder of any of
+    the requested syntaxes is found at each step; when several syntaxes match
+    at the same position, C has precedence over PHP and PHP over common
+    placeholders. Escaped percent sign ("%%") is reported as a placeholder
+    too, because it is highlighted the same way.
+ */
+class PlaceholderTokenizer
+{
+public:
+    /// Ctor; the [begin, end) text must outlive the tokenizer
+    PlaceholderTokenizer(unsigned syntaxes, const wchar_t *begin, const wchar_t *end)
+        : m_syntaxes(syntaxes), m_begin(begin), m_pos(begin), m_end(end) {}
+
+    /** Finds the next placeholder; @a pos and @a length are in characters
+        relative to beginning of the text. Returns false if there's none.
+     */
+    bool Next(size_t& pos, size_t& length);
+
+private:
+    const wchar_t *MatchC(const wchar_t *i) const;
+    const wchar_t *MatchPHP(const wchar_t *i) const;
+    const wchar_t *MatchCommon(const wchar_t *i) const;
+
+    unsigned m_syntaxes;
+    const wchar_t *m_begin, *m_pos, *m_end;
+};
+
+
+/// Appends all placeholders of given syntaxes found in @a s to @a out and
+/// sorts it, omitting escaped percent signs.
+void ExtractPlaceholders(const wxString& s, unsigned syntaxes, std::vector<wxString>& out);
+
+
+/// Placeholders in an item's source text, see CatalogItem::GetSourcePlaceholders()
+struct SourcePlaceholders
+{
+    SourcePlaceholders() : syntaxes(0), found(0) {}
+
+    /// Syntaxes the item uses, see GetPlaceholderSyntaxes()
+    unsigned syntaxes;
+    /// Syntaxes actually present in the item's msgid
+    unsigned found;
+    /// Sorted placeholders of msgid and msgid_plural
+    std::vector<wxString> singular, plural;
+};
+
+#endif // Poedit_format_placeholders_h
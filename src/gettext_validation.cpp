@@ -0,0 +1,1063 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "gettext_validation.h"
+
+#include "concurrency.h"
+#include "language.h"
+#include "str_helpers.h"
+
+#include <wx/intl.h>
+#include <wx/log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cwchar>
+#include <cwctype>
+#include <functional>
+#include <map>
+
+
+namespace
+{
+
+// ----------------------------------------------------------------------
+// Format strings parsing
+// ----------------------------------------------------------------------
+
+/// Arguments referenced by a format string
+struct FormatArgs
+{
+    /// Argument number (1-based) or name -> its type; empty type
+    /// means that it isn't checked and '*' that any type is accepted
+    std::map<std::wstring, std::wstring> args;
+
+    /// Are the arguments referenced by name?
+    bool named = false;
+
+    /// Must both strings have the same number of arguments, even if the
+    /// translation is only used for some numbers (i.e. plural forms)?
+    bool fixedCount = false;
+};
+
+typedef bool (*FormatParser)(const std::wstring& s, FormatArgs& out, wxString& error);
+
+
+inline bool IsDigit(wchar_t c) { return c >= '0' && c <= '9'; }
+
+inline bool IsOneOf(wchar_t c, const wchar_t *chars)
+{
+    return c != 0 && wcschr(chars, c) != nullptr;
+}
+
+// Parses "NNN$" argument number at s[i], returns 0 if not present
+unsigned ParseArgNumber(const std::wstring& s, size_t& i)
+{
+    size_t j = i;
+    unsigned n = 0;
+    while (j < s.length() && IsDigit(s[j]))
+        n = n * 10 + (s[j++] - '0');
+    if (j > i && j < s.length() && s[j] == '$')
+    {
+        i = j + 1;
+        return n;
+    }
+    return 0;
+}
+
+inline void SkipDigits(const std::wstring& s, size_t& i)
+{
+    while (i < s.length() && IsDigit(s[i]))
+        i++;
+}
+
+
+/// Collects positional arguments and checks that they are used consistently
+class PositionalArgs
+{
+public:
+    explicit PositionalArgs(bool allowMixing) : m_allowMixing(allowMixing), m_mode(None), m_unnumbered(0) {}
+
+    // number is 1-based, 0 means "the next argument"
+    bool Add(unsigned number, const std::wstring& type, wxString& error)
+    {
+        if (number == 0)
+        {
+            if (m_mode == Numbered && !m_allowMixing)
+                return MixingError(error);
+            m_mode = Unnumbered;
+            number = ++m_unnumbered;
+        }
+        else
+        {
+            if (m_mode == Unnumbered && !m_allowMixing)
+                return MixingError(error);
+            m_mode = Numbered;
+        }
+
+        if (m_types.size() < number)
+            m_types.resize(number);
+        auto& t = m_types[number - 1];
+        if (!t.empty() && t != type)
+        {
+            error = wxString::Format(_("The string refers to argument number %u in incompatible ways."), number);
+            return false;
+        }
+        t = type;
+        return true;
+    }
+
+    // Checks that no arguments are skipped (C doesn't allow it)
+    bool CheckNoGaps(wxString& error) const
+    {
+        for (size_t i = 0; i < m_types.size(); i++)
+        {
+            if (m_types[i].empty())
+            {
+                error = wxString::Format(_("The string refers to argument number %u but ignores argument number %u."),
+                                         (unsigned)m_types.size(), unsigned(i + 1));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Store(FormatArgs& out) const
+    {
+        for (size_t i = 0; i < m_types.size(); i++)
+        {
+            if (!m_types[i].empty())
+                out.args[std::to_wstring(i + 1)] = m_types[i];
+        }
+    }
+
+private:
+    bool MixingError(wxString& error) const
+    {
+        error = _("The string refers to arguments both through absolute argument numbers and through unnumbered argument specifications.");
+        return false;
+    }
+
+    bool m_allowMixing;
+    enum { None, Unnumbered, Numbered } m_mode;
+    unsigned m_unnumbered;
+    std::vector<std::wstring> m_types;
+};
+
+
+inline wxString EndsInDirective()
+{
+    return _("The string ends in the middle of a directive.");
+}
+
+inline wxString InvalidConversion(unsigned directive, wchar_t c)
+{
+    return wxString::Format(_("In the directive number %u, the character '%c' is not a valid conversion specifier."),
+                            directive, c);
+}
+
+
+// C and Objective-C format strings, as used by printf()
+bool DoParseCFormat(const std::wstring& s, bool objc, FormatArgs& out, wxString& error)
+{
+    PositionalArgs args(/*allowMixing=*/false);
+    unsigned directive = 0;
+    const size_t len = s.length();
+
+    size_t i = 0;
+    while (i < len)
+    {
+        if (s[i++] != '%')
+            continue;
+        if (i >= len)
+        {
+            error = EndsInDirective();
+            return false;
+        }
+        if (s[i] == '%')
+        {
+            i++;
+            continue;
+        }
+
+        directive++;
+        const unsigned number = ParseArgNumber(s, i);
+
+        // flags, width and precision:
+        while (i < len && IsOneOf(s[i], L"'-+ #0I"))
+            i++;
+        for (int part = 0; part < 2; part++)
+        {
+            if (part == 1)
+            {
+                if (i >= len || s[i] != '.')
+                    break;
+                i++;
+            }
+            if (i < len && s[i] == '*')
+            {
+                i++;
+                if (!args.Add(ParseArgNumber(s, i), L"d", error))
+                    return false;
+            }
+            else
+            {
+                SkipDigits(s, i);
+            }
+        }
+
+        // size modifiers:
+        std::wstring type;
+        while (i < len && IsOneOf(s[i], L"hlLqjzZt"))
+            type += s[i++];
+
+        if (i >= len)
+        {
+            error = EndsInDirective();
+            return false;
+        }
+
+        const wchar_t c = s[i++];
+        switch (c)
+        {
+            case 'd': case 'i':
+                type += L"d";
+                break;
+            case 'o': case 'u': case 'x': case 'X':
+                type += L"u";
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                type += L"f";
+                break;
+            case 'c': case 's': case 'p': case 'n':
+                type += c;
+                break;
+            case 'C':
+                type = L"lc";
+                break;
+            case 'S':
+                type = L"ls";
+                break;
+            case 'm':
+                continue; // glibc's strerror(errno), doesn't consume arguments
+            case '<':
+            {
+                // <inttypes.h> macros such as %<PRId64>
+                auto end = s.find('>', i);
+                if (end == std::wstring::npos)
+                {
+                    error = EndsInDirective();
+                    return false;
+                }
+                type = s.substr(i, end - i);
+                i = end + 1;
+                break;
+            }
+            case '@':
+                if (objc)
+                {
+                    type = L"@";
+                    break;
+                }
+                // fall through
+            default:
+                error = InvalidConversion(directive, c);
+                return false;
+        }
+
+        if (!args.Add(number, type, error))
+            return false;
+    }
+
+    if (!args.CheckNoGaps(error))
+        return false;
+    args.Store(out);
+    return true;
+}
+
+bool ParseCFormat(const std::wstring& s, FormatArgs& out, wxString& error)
+{
+    return DoParseCFormat(s, /*objc=*/false, out, error);
+}
+
+bool ParseObjCFormat(const std::wstring& s, FormatArgs& out, wxString& error)
+{
+    return DoParseCFormat(s, /*objc=*/true, out, error);
+}
+
+
+// PHP's sprintf()
+bool ParsePHPFormat(const std::wstring& s, FormatArgs& out, wxString& error)
+{
+    PositionalArgs args(/*allowMixing=*/true);
+    unsigned directive = 0;
+    const size_t len = s.length();
+
+    size_t i = 0;
+    while (i < len)
+    {
+        if (s[i++] != '%')
+            continue;
+        if (i >= len)
+        {
+            error = EndsInDirective();
+            return false;
+        }
+        if (s[i] == '%')
+        {
+            i++;
+            continue;
+        }
+
+        directive++;
+        const unsigned number = ParseArgNumber(s, i);
+
+        // flags, including custom padding character:
+        while (i < len && IsOneOf(s[i], L"-+ 0'"))
+        {
+            if (s[i++] == '\'')
+            {
+                if (i >= len)
+                {
+                    error = EndsInDirective();
+                    return false;
+                }
+                i++;
+            }
+        }
+        SkipDigits(s, i);
+        if (i < len && s[i] == '.')
+        {
+            i++;
+            SkipDigits(s, i);
+        }
+
+        if (i >= len)
+        {
+            error = EndsInDirective();
+            return false;
+        }
+
+        std::wstring type;
+        const wchar_t c = s[i++];
+        switch (c)
+        {
+            case 'b': case 'c': case 'd': case 'o': case 'u': case 'x': case 'X':
+                type = L"i";
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+                type = L"f";
+                break;
+            case 's':
+                type = L"s";
+                break;
+            default:
+                error = InvalidConversion(directive, c);
+                return false;
+        }
+
+        if (!args.Add(number, type, error))
+            return false;
+    }
+
+    args.Store(out);
+    return true;
+}
+
+
+// Python's % operator, with either positional or named arguments
+bool ParsePythonFormat(const std::wstring& s, FormatArgs& out, wxString& error)
+{
+    unsigned directive = 0;
+    unsigned unnamed = 0;
+    const size_t len = s.length();
+
+    auto mixingError = [&error]
+    {
+        error = _("The string refers to arguments both through argument names and through unnamed argument specifications.");
+        return false;
+    };
+
+    size_t i = 0;
+    while (i < len)
+    {
+        if (s[i++] != '%')
+            continue;
+
+        directive++;
+
+        std::wstring name;
+        bool hasName = false;
+        if (i < len && s[i] == '(')
+        {
+            int depth = 1;
+            size_t start = ++i;
+            while (i < len && depth > 0)
+            {
+                if (s[i] == '(')
+                    depth++;
+                else if (s[i] == ')')
+                    depth--;
+                i++;
+            }
+            if (depth > 0)
+            {
+                error = EndsInDirective();
+                return false;
+            }
+            name = s.substr(start, i - 1 - start);
+            hasName = true;
+        }
+
+        while (i < len && IsOneOf(s[i], L"-+ #0"))
+            i++;
+        for (int part = 0; part < 2; part++)
+        {
+            if (part == 1)
+            {
+                if (i >= len || s[i] != '.')
+                    break;
+                i++;
+            }
+            if (i < len && s[i] == '*')
+            {
+                i++;
+                if (hasName || out.named)
+                    return mixingError();
+                out.args[std::to_wstring(++unnamed)] = L"i";
+            }
+            else
+            {
+                SkipDigits(s, i);
+            }
+        }
+        while (i < len && IsOneOf(s[i], L"hlL"))
+            i++;
+
+        if (i >= len)
+        {
+            error = EndsInDirective();
+            return false;
+        }
+
+        std::wstring type;
+        const wchar_t c = s[i++];
+        switch (c)
+        {
+            case '%':
+                continue; // literal percent sign
+            case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+                type = L"i";
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+                type = L"f";
+                break;
+            case 'c':
+                type = L"c";
+                break;
+            case 's': case 'r': case 'a':
+                type = L"*";
+                break;
+            default:
+                error = InvalidConversion(directive, c);
+                return false;
+        }
+
+        if (hasName)
+        {
+            if (unnamed > 0)
+                return mixingError();
+            out.named = true;
+
+            auto existing = out.args.find(name);
+            if (existing == out.args.end() || existing->second == L"*")
+            {
+                out.args[name] = type;
+            }
+            else if (type != L"*" && existing->second != type)
+            {
+                error = wxString::Format(_("The string refers to the argument named '%s' in incompatible ways."), name);
+                return false;
+            }
+        }
+        else
+        {
+            if (out.named)
+                return mixingError();
+            out.args[std::to_wstring(++unnamed)] = type;
+        }
+    }
+
+    out.fixedCount = !out.named;
+    return true;
+}
+
+
+// Python's str.format()
+bool ParsePythonBraceFormat(const std::wstring& s, FormatArgs& out, wxString& error)
+{
+    unsigned directive = 0;
+    unsigned autoNumber = 0;
+    bool manualNumbering = false;
+    const size_t len = s.length();
+
+    // parses replacement field starting after '{' at s[i], up to and including '}'
+    std::function<bool(size_t&, int)> parseField = [&](size_t& i, int nesting) -> bool
+    {
+        directive++;
+
+        size_t start = i;
+        while (i < len && (iswalnum(s[i]) || s[i] == '_'))
+            i++;
+        std::wstring name = s.substr(start, i - start);
+
+        if (name.empty())
+        {
+            if (manualNumbering)
+            {
+                error = _("The string refers to arguments both through absolute argument numbers and through unnumbered argument specifications.");
+                return false;
+            }
+            name = std::to_wstring(autoNumber++);
+        }
+        else if (IsDigit(name[0]))
+        {
+            if (autoNumber > 0)
+            {
+                error = _("The string refers to arguments both through absolute argument numbers and through unnumbered argument specifications.");
+                return false;
+            }
+            manualNumbering = true;
+        }
+        out.args[name] = std::wstring();
+
+        // attribute and index accessors, conversion:
+        while (i < len && (s[i] == '.' || s[i] == '['))
+        {
+            if (s[i] == '[')
+            {
+                auto end = s.find(']', i);
+                if (end == std::wstring::npos)
+                {
+                    error = EndsInDirective();
+                    return false;
+                }
+                i = end + 1;
+            }
+            else
+            {
+                i++;
+                while (i < len && (iswalnum(s[i]) || s[i] == '_'))
+                    i++;
+            }
+        }
+        if (i < len && s[i] == '!')
+            i += 2;
+
+        // format specification, possibly with nested fields:
+        if (i < len && s[i] == ':')
+        {
+            i++;
+            while (i < len && s[i] != '}')
+            {
+                if (s[i++] == '{')
+                {
+                    if (nesting > 0)
+                    {
+                        error = wxString::Format(_("In the directive number %u, the format specification is nested too deeply."), directive);
+                        return false;
+                    }
+                    if (!parseField(i, nesting + 1))
+                        return false;
+                }
+            }
+        }
+
+        if (i >= len)
+        {
+            error = EndsInDirective();
+            return false;
+        }
+        if (s[i] != '}')
+        {
+            error = InvalidConversion(directive, s[i]);
+            return false;
+        }
+        i++;
+        return true;
+    };
+
+    size_t i = 0;
+    while (i < len)
+    {
+        const wchar_t c = s[i++];
+        if (c == '{')
+        {
+            if (i < len && s[i] == '{')
+            {
+                i++;
+                continue;
+            }
+            if (!parseField(i, 0))
+                return false;
+        }
+        else if (c == '}')
+        {
+            if (i < len && s[i] == '}')
+            {
+                i++;
+                continue;
+            }
+            error = wxString::Format(_("The string contains a lone '}' after directive number %u."), directive);
+            return false;
+        }
+    }
+
+    out.named = true;
+    return true;
+}
+
+
+// Qt's QString::arg() placeholders
+bool ParseQtFormat(const std::wstring& s, FormatArgs& out, wxString& /*error*/)
+{
+    const size_t len = s.length();
+    size_t i = 0;
+    while (i < len)
+    {
+        if (s[i++] != '%')
+            continue;
+        if (i < len && s[i] == 'L')
+            i++;
+
+        unsigned n = 0;
+        for (int digits = 0; digits < 2 && i < len && IsDigit(s[i]); digits++)
+            n = n * 10 + (s[i++] - '0');
+        if (n > 0)
+            out.args[std::to_wstring(n)] = std::wstring();
+    }
+    return true;
+}
+
+
+FormatParser GetFormatParser(const wxString& format)
+{
+    if (format == "c")
+        return &ParseCFormat;
+    if (format == "objc")
+        return &ParseObjCFormat;
+    if (format == "php")
+        return &ParsePHPFormat;
+    if (format == "python")
+        return &ParsePythonFormat;
+    if (format == "python-brace")
+        return &ParsePythonBraceFormat;
+    if (format == "qt")
+        return &ParseQtFormat;
+    return nullptr;
+}
+
+
+inline bool AreTypesCompatible(const std::wstring& a, const std::wstring& b)
+{
+    return a == b || a == L"*" || b == L"*";
+}
+
+inline wxString DescribeArg(const FormatArgs& f, const std::wstring& arg)
+{
+    return f.named ? "'" + wxString(arg) + "'" : wxString(arg);
+}
+
+/** Checks that the translation's format string is compatible with the source.
+    If @a strict is false, the translation may omit some arguments.
+ */
+bool CheckFormatCompatibility(const FormatArgs& source, const FormatArgs& translation,
+                              const wxString& sourceLabel, const wxString& translationLabel,
+                              bool strict, wxString& error)
+{
+    if (!source.args.empty() && !translation.args.empty() && source.named != translation.named)
+    {
+        error = wxString::Format(_("'%s' and '%s' refer to arguments differently, one by name and the other by position."),
+                                 sourceLabel, translationLabel);
+        return false;
+    }
+
+    if (source.fixedCount && translation.fixedCount && source.args.size() != translation.args.size())
+    {
+        error = wxString::Format(_("Number of format specifications in '%s' and '%s' does not match."),
+                                 sourceLabel, translationLabel);
+        return false;
+    }
+
+    for (auto& a: translation.args)
+    {
+        auto s = source.args.find(a.first);
+        if (s == source.args.end())
+        {
+            error = wxString::Format(_("A format specification for argument %s, as in '%s', doesn't exist in '%s'."),
+                                     DescribeArg(translation, a.first), translationLabel, sourceLabel);
+            return false;
+        }
+        if (!AreTypesCompatible(s->second, a.second))
+        {
+            error = wxString::Format(_("Format specifications in '%s' and '%s' for argument %s are not the same."),
+                                     sourceLabel, translationLabel, DescribeArg(translation, a.first));
+            return false;
+        }
+    }
+
+    if (strict)
+    {
+        for (auto& a: source.args)
+        {
+            if (translation.args.find(a.first) == translation.args.end())
+            {
+                error = wxString::Format(_("A format specification for argument %s doesn't exist in '%s'."),
+                                         DescribeArg(source, a.first), translationLabel);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+// Checks that both strings either start/end with a newline or not
+bool CheckNewlines(const wxString& source, const wxString& translation,
+                   const wxString& sourceLabel, const wxString& translationLabel,
+                   wxString& error)
+{
+    if (source.empty() || translation.empty())
+        return true;
+
+    if ((source[0] == '\n') != (translation[0] == '\n'))
+    {
+        error = wxString::Format(_("'%s' and '%s' entries do not both begin with '\\n'."), sourceLabel, translationLabel);
+        return false;
+    }
+    if ((source.Last() == '\n') != (translation.Last() == '\n'))
+    {
+        error = wxString::Format(_("'%s' and '%s' entries do not both end with '\\n'."), sourceLabel, translationLabel);
+        return false;
+    }
+    return true;
+}
+
+
+// Parses "nplurals=N; plural=EXPR;" into its parts
+bool ParsePluralForms(const wxString& header, long& nplurals, wxString& expr, wxString& error)
+{
+    nplurals = -1;
+    expr.clear();
+
+    wxString rest = header;
+    while (!rest.empty())
+    {
+        wxString part = rest.BeforeFirst(';').Strip(wxString::both);
+        rest = rest.AfterFirst(';');
+        if (part.StartsWith("nplurals"))
+        {
+            wxString value = part.AfterFirst('=').Strip(wxString::both);
+            if (!value.ToLong(&nplurals) || nplurals <= 0)
+            {
+                error = _("Invalid nplurals value in the Plural-Forms header.");
+                return false;
+            }
+        }
+        else if (part.StartsWith("plural"))
+        {
+            // the expression may itself contain '=' (e.g. "n==1"):
+            expr = part.AfterFirst('=').Strip(wxString::both);
+        }
+    }
+
+    if (nplurals == -1)
+    {
+        error = _("Missing 'nplurals' attribute in the Plural-Forms header.");
+        return false;
+    }
+    if (expr.empty())
+    {
+        error = _("Missing 'plural' attribute in the Plural-Forms header.");
+        return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+
+// ----------------------------------------------------------------------
+// GettextValidator
+// ----------------------------------------------------------------------
+
+GettextValidator::GettextValidator(Catalog& catalog)
+    : m_catalog(catalog), m_nplurals(0)
+{
+    long nplurals;
+    wxString expr, error;
+    if (ParsePluralForms(catalog.Header().GetHeader("Plural-Forms"), nplurals, expr, error))
+    {
+        m_nplurals = (unsigned)nplurals;
+        m_strictPluralForms.resize(m_nplurals, true);
+
+        // Translations of plural forms used for just one number (typically
+        // the singular) may omit the number from format strings:
+        PluralFormsExpr calc(str::to_utf8(catalog.Header().GetHeader("Plural-Forms")), (int)nplurals);
+        if (calc)
+        {
+            std::vector<int> usage(m_nplurals, 0);
+            for (int n = 0; n < PluralFormsExpr::MAX_EXAMPLES_COUNT; n++)
+            {
+                int form = calc.evaluate_for_n(n);
+                if (form >= 0 && form < (int)m_nplurals)
+                    usage[form]++;
+            }
+            for (unsigned i = 0; i < m_nplurals; i++)
+                m_strictPluralForms[i] = usage[i] > 1;
+        }
+    }
+}
+
+
+std::vector<wxString> GettextValidator::CheckHeader() const
+{
+    std::vector<wxString> problems;
+    auto& header = m_catalog.Header();
+
+    static const char *fields_defaults[][2] = {
+        { "Project-Id-Version",         "PACKAGE VERSION" },
+        { "PO-Revision-Date",           "YEAR-MO-DA HO:MI+ZONE" },
+        { "Last-Translator",            "FULL NAME <EMAIL@ADDRESS>" },
+        { "Language-Team",              "LANGUAGE <LL@li.org>" },
+        { "Content-Type",               "text/plain; charset=CHARSET" },
+        { "Content-Transfer-Encoding",  "ENCODING" }
+    };
+    for (auto& fd: fields_defaults)
+    {
+        if (header.HasHeader(fd[0]) && header.GetHeader(fd[0]).StartsWith(fd[1]))
+            problems.push_back(wxString::Format(_("Header field '%s' still has the initial default value."), fd[0]));
+    }
+
+    if (header.HasHeader("Plural-Forms"))
+    {
+        const wxString pluralForms = header.GetHeader("Plural-Forms");
+        long nplurals;
+        wxString expr, error;
+        if (!ParsePluralForms(pluralForms, nplurals, expr, error))
+        {
+            problems.push_back(error);
+        }
+        else
+        {
+            PluralFormsExpr calc(str::to_utf8(pluralForms), (int)nplurals);
+            if (!calc)
+            {
+                problems.push_back(_("Invalid plural expression in the Plural-Forms header."));
+            }
+            else
+            {
+                int maxForm = 0;
+                for (int n = 0; n < PluralFormsExpr::MAX_EXAMPLES_COUNT; n++)
+                    maxForm = std::max(maxForm, calc.evaluate_for_n(n));
+                if (maxForm >= nplurals)
+                {
+                    problems.push_back(wxString::Format(_("Plural expression can produce values as large as %d, but nplurals = %d."),
+                                                        maxForm, (int)nplurals));
+                }
+            }
+        }
+    }
+    else
+    {
+        for (auto& i: m_catalog.items())
+        {
+            if (i->HasPlural() && i->IsTranslated())
+            {
+                problems.push_back(_("The catalog has plural form translations, but lacks a header entry with \"Plural-Forms: nplurals=INTEGER; plural=EXPRESSION;\"."));
+                break;
+            }
+        }
+    }
+
+    return problems;
+}
+
+
+bool GettextValidator::CheckItem(CatalogItem& item) const
+{
+    // msgfmt ignores these, so they can't be broken:
+    if (item.IsFuzzy() || item.GetStringUTF8().empty())
+        return false;
+
+    wxString error;
+    auto reportError = [&item, &error]
+    {
+        item.SetIssue(CatalogItem::Issue::Error, error);
+        return true;
+    };
+
+    const auto& translations = item.GetTranslations();
+
+    if (item.HasPlural() && m_nplurals > 0 && item.GetNumberOfTranslations() > m_nplurals && item.IsTranslated())
+    {
+        error = wxString::Format(_("nplurals = %u, but the entry has %u plural form translations."),
+                                 m_nplurals, item.GetNumberOfTranslations());
+        return reportError();
+    }
+
+    for (size_t i = 0; i < translations.size(); i++)
+    {
+        const auto& trans = translations[i];
+        if (trans.empty())
+            continue;
+
+        const wxString transLabel = item.HasPlural() ? wxString::Format("msgstr[%u]", (unsigned)i) : wxString("msgstr");
+        if (!CheckNewlines(item.GetString(), trans, "msgid", transLabel, error))
+            return reportError();
+        if (item.HasPlural() && !CheckNewlines(item.GetPluralString(), trans, "msgid_plural", transLabel, error))
+            return reportError();
+    }
+
+    const wxString format = item.GetFormatFlag();
+    auto parser = GetFormatParser(format);
+    if (!parser)
+        return false;
+
+    // Plural translations are compared with msgid_plural, because msgid
+    // often doesn't contain the number at all:
+    const wxString sourceLabel = item.HasPlural() ? "msgid_plural" : "msgid";
+    FormatArgs source;
+    if (!parser((item.HasPlural() ? item.GetPluralString() : item.GetString()).ToStdWstring(), source, error))
+        return false; // not a valid format string, nothing to compare with
+
+    for (size_t i = 0; i < translations.size(); i++)
+    {
+        const auto& trans = translations[i];
+        if (trans.empty())
+            continue;
+
+        const wxString transLabel = item.HasPlural() ? wxString::Format("msgstr[%u]", (unsigned)i) : wxString("msgstr");
+        FormatArgs translated;
+        if (!parser(trans.ToStdWstring(), translated, error))
+        {
+            error = wxString::Format(_("'%s' is not a valid %s format string, unlike '%s'. Reason: %s"),
+                                     transLabel, format, sourceLabel, error);
+            return reportError();
+        }
+
+        const bool strict = !item.HasPlural() || i >= m_strictPluralForms.size() || m_strictPluralForms[i];
+        if (!CheckFormatCompatibility(source, translated, sourceLabel, transLabel, strict, error))
+            return reportError();
+    }
+
+    return false;
+}
+
+
+int GettextValidator::CheckItems(size_t begin, size_t end) const
+{
+    int errors = 0;
+    auto& items = m_catalog.items();
+    for (size_t i = begin; i < end; i++)
+    {
+        if (CheckItem(*items[i]))
+            errors++;
+    }
+    return errors;
+}
+
+
+int GettextValidator::CheckDuplicates(size_t begin, size_t end) const
+{
+    int errors = 0;
+    auto& items = m_catalog.items();
+    for (size_t idx = begin; idx < end; idx++)
+    {
+        auto& i = items[idx];
+        // all but the first occurrence are duplicates:
+        int first = m_catalog.FindItemIndexBySource(*i);
+        if (first != int(idx))
+        {
+            i->SetIssue(CatalogItem::Issue::Shared(CatalogItem::Issue::Error, wxTRANSLATE(L"Duplicate message definition.")));
+            errors++;
+        }
+    }
+    return errors;
+}
+
+
+int GettextValidator::Check(const CatalogItemPtr& item) const
+{
+    if (CheckItem(*item))
+        return 1;
+
+    int first = m_catalog.FindItemIndexBySource(*item);
+    if (first != -1 && m_catalog.items()[first] != item)
+    {
+        item->SetIssue(CatalogItem::Issue::Shared(CatalogItem::Issue::Error, wxTRANSLATE(L"Duplicate message definition.")));
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int GettextValidator::Check()
+{
+    int errors = 0;
+
+    for (auto& p: CheckHeader())
+    {
+        wxLogError("%s", p);
+        errors++;
+    }
+
+    errors += Check(0, m_catalog.items().size());
+
+    return errors;
+}
+
+
+int GettextValidator::Check(size_t begin, size_t end)
+{
+    end = std::min(end, m_catalog.items().size());
+    if (begin >= end)
+        return 0;
+
+    // Items are independent of each other and so can be checked in parallel,
+    // each task touching only its own range of them:
+    dispatch::parallel_options options;
+    options.min_chunk_size = 1000;
+
+    std::atomic<int> itemErrors(0);
+    dispatch::parallel_for_chunks(begin, end, [this, &itemErrors](size_t b, size_t e)
+    {
+        itemErrors += CheckItems(b, e);
+    }, options);
+
+    return itemErrors + CheckDuplicates(begin, end);
+}
@@ -0,0 +1,83 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_gettext_validation_h
+#define Poedit_gettext_validation_h
+
+#include "catalog.h"
+
+#include <vector>
+
+
+/**
+    Native implementation of the checks done by "msgfmt -c".
+
+    Checks the catalog's header and its items directly, without saving it
+    and running gettext tools: format strings compatibility (c-format,
+    objc-format, php-format, python-format, python-brace-format and
+    qt-format), consistency of leading and trailing newlines, plural forms
+    and duplicate entries.
+ */
+class GettextValidator
+{
+public:
+    explicit GettextValidator(Catalog& catalog);
+
+    /** Checks the whole catalog, logging header problems with wxLogError
+        and setting issues on broken items. Items are checked in parallel.
+
+        @return Number of errors found.
+     */
+    int Check();
+
+    /// Checks items [begin, end) as Check() does; header isn't checked.
+    int Check(size_t begin, size_t end);
+
+    /// Checks the catalog header; returns descriptions of problems found.
+    std::vector<wxString> CheckHeader() const;
+
+    /// Checks a single item, sets its issue and returns true if it's broken.
+    bool CheckItem(CatalogItem& item) const;
+
+    /** Checks a single item of the catalog as Check() would, i.e. including
+        whether it duplicates another item; header isn't checked.
+
+        @return Number of errors found (0 or 1).
+     */
+    int Check(const CatalogItemPtr& item) const;
+
+private:
+    int CheckItems(size_t begin, size_t end) const;
+    int CheckDuplicates(size_t begin, size_t end) const;
+
+    Catalog& m_catalog;
+
+    // number of plural forms and whether the form is used for more than
+    // one number, i.e. must reference all arguments in format strings
+    unsigned m_nplurals;
+    std::vector<bool> m_strictPluralForms;
+};
+
+#endif // Poedit_gettext_validation_h
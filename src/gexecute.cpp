@@ -36,7 +36,15 @@
 #include <boost/throw_exception.hpp>
 
 #include "gexecute.h"
+#include "concurrency.h"
 #include "errors.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 
 // GCC's libstdc++ didn't have functional std::regex implementation until 4.9
 #if (defined(__GNUC__) && !defined(__clang__) && !wxCHECK_GCC_VERSION(4,9))
@@ -68,7 +76,7 @@ inline wxString GetAuxBinariesDir()
     return GetGettextPackagePath() + "/bin";
 }
 
-wxString GetPathToAuxBinary(const wxString& program)
+wxString DoGetPathToAuxBinary(const wxString& program)
 {
     wxFileName path;
     path.SetPath(GetAuxBinariesDir());
@@ -89,9 +97,92 @@ wxString GetPathToAuxBinary(const wxString& program)
         return program;
     }
 }
+
+// Looking up the binary is relatively expensive and the result never changes:
+wxString GetPathToAuxBinary(const wxString& program)
+{
+    static std::mutex mutex;
+    static std::map<wxString, wxString> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto i = cache.find(program);
+    if (i == cache.end())
+        i = cache.emplace(program, DoGetPathToAuxBinary(program)).first;
+    return i->second;
+}
 #endif // __WXOSX__ || __WXMSW__
 
 
+/// Environment for running gettext tools, prepared only once.
+const wxExecuteEnv& GetGettextEnv()
+{
+    static const wxExecuteEnv env = []{
+        wxExecuteEnv e;
+#if defined(__WXOSX__) || defined(__WXMSW__)
+        wxGetEnvMap(&e.env);
+        e.env["OUTPUT_CHARSET"] = "UTF-8";
+
+        wxString lang = wxTranslations::Get()->GetBestTranslation("gettext-tools");
+        if ( !lang.empty() )
+            e.env["LANG"] = lang;
+#endif // __WXOSX__ || __WXMSW__
+        return e;
+    }();
+    return env;
+}
+
+
+/**
+    Limits the number of concurrently running gettext processes.
+
+    Independent steps (e.g. extraction shards or compilation running
+    alongside validation) execute tools in parallel, but running many more
+    processes than there are CPU cores only makes all of them slower.
+ */
+class ProcessSlots
+{
+public:
+    static ProcessSlots& Get()
+    {
+        static ProcessSlots instance(std::max(2u, std::thread::hardware_concurrency()));
+        return instance;
+    }
+
+    class Slot
+    {
+    public:
+        Slot(ProcessSlots& owner) : m_owner(owner) { m_owner.Acquire(); }
+        ~Slot() { m_owner.Release(); }
+
+    private:
+        ProcessSlots& m_owner;
+    };
+
+private:
+    explicit ProcessSlots(unsigned count) : m_available(count) {}
+
+    void Acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_available > 0; });
+        m_available--;
+    }
+
+    void Release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_available++;
+        }
+        m_cond.notify_one();
+    }
+
+    unsigned m_available;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+
 bool ReadOutput(wxInputStream& s, wxArrayString& out)
 {
     // the stream could be already at EOF or in wxSTREAM_BROKEN_PIPE state
@@ -124,28 +215,97 @@ bool ReadOutput(wxInputStream& s, wxArrayString& out)
     return true;
 }
 
-long DoExecuteGettext(const wxString& cmdline_, wxArrayString& gstderr)
+/**
+    Terminates a running process when its operation is cancelled.
+
+    The process is executed synchronously, so this polls the token on
+    a separate thread for as long as the watcher exists.
+ */
+class ProcessWatcher
+{
+public:
+    ProcessWatcher(wxProcess& process, const dispatch::cancellation_token *cancel)
+        : m_process(process), m_cancel(cancel), m_done(false)
+    {
+        if (m_cancel)
+            m_thread = std::thread([this]{ Watch(); });
+    }
+
+    ~ProcessWatcher()
+    {
+        if (!m_thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = true;
+        }
+        m_cond.notify_one();
+        m_thread.join();
+    }
+
+private:
+    void Watch()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_cond.wait_for(lock, std::chrono::milliseconds(100), [this]{ return m_done; }))
+        {
+            if (!m_cancel->is_cancelled())
+                continue;
+            const long pid = m_process.GetPid();
+            if (pid == 0)
+                continue;  // not started yet
+            wxLogTrace("poedit.execute", "  terminating cancelled process %ld", pid);
+            wxProcess::Kill(int(pid), wxSIGTERM, wxKILL_CHILDREN);
+            return;
+        }
+    }
+
+    wxProcess& m_process;
+    const dispatch::cancellation_token *m_cancel;
+    bool m_done;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+};
+
+
+long DoExecuteGettext(const wxString& cmdline_, wxArrayString& gstderr,
+                      const dispatch::cancellation_token *cancel = nullptr,
+                      const wxString& workingDir = wxString())
 {
-    wxExecuteEnv env;
     wxString cmdline(cmdline_);
 
 #if defined(__WXOSX__) || defined(__WXMSW__)
     wxString binary = cmdline.BeforeFirst(_T(' '));
     cmdline = GetPathToAuxBinary(binary) + cmdline.Mid(binary.length());
-    wxGetEnvMap(&env.env);
-    env.env["OUTPUT_CHARSET"] = "UTF-8";
-
-    wxString lang = wxTranslations::Get()->GetBestTranslation("gettext-tools");
-	if ( !lang.empty() )
-        env.env["LANG"] = lang;
 #endif // __WXOSX__ || __WXMSW__
 
+    ProcessSlots::Slot slot(ProcessSlots::Get());
+
+    // don't bother starting the process if it was cancelled while waiting:
+    if (cancel && cancel->is_cancelled())
+        return -1;
+
     wxLogTrace("poedit.execute", "executing: %s", cmdline.c_str());
 
     wxScopedPtr<wxProcess> process(new wxProcess);
     process->Redirect();
 
-    long retcode = wxExecute(cmdline, wxEXEC_BLOCK | wxEXEC_NODISABLE | wxEXEC_NOEVENTS, process.get(), &env);
+    const wxExecuteEnv *env = &GetGettextEnv();
+    wxExecuteEnv envInDir;
+    if (!workingDir.empty() && workingDir != ".")
+    {
+        envInDir = *env;
+        envInDir.cwd = workingDir;
+        env = &envInDir;
+    }
+
+    long retcode;
+    {
+        TRACE_SCOPE("gettext process");
+        ProcessWatcher watcher(*process, cancel);
+        retcode = wxExecute(cmdline, wxEXEC_BLOCK | wxEXEC_NODISABLE | wxEXEC_NOEVENTS, process.get(), env);
+    }
     if (retcode != 0)
     {
         wxLogTrace("poedit.execute", "  execution of command failed with exit code %d: %s", (int)retcode, cmdline.c_str());
@@ -155,7 +315,7 @@ long DoExecuteGettext(const wxString& cmdline_, wxArrayString& gstderr)
     if ( std_err && !ReadOutput(*std_err, gstderr) )
         retcode = -1;
 
-    if ( retcode == -1 )
+    if ( retcode == -1 && !(cancel && cancel->is_cancelled()) )
     {
         BOOST_THROW_EXCEPTION(Exception(wxString::Format(_("Cannot execute program: %s"), cmdline.c_str())));
     }
@@ -182,10 +342,15 @@ void LogUnrecognizedError(const wxString& err)
 } // anonymous namespace
 
 
-bool ExecuteGettext(const wxString& cmdline)
+bool ExecuteGettext(const wxString& cmdline, const dispatch::cancellation_token *cancel,
+                    const wxString& workingDir)
 {
     wxArrayString gstderr;
-    long retcode = DoExecuteGettext(cmdline, gstderr);
+    long retcode = DoExecuteGettext(cmdline, gstderr, cancel, workingDir);
+
+    // errors of a terminated process are of no interest:
+    if (cancel && cancel->is_cancelled())
+        return false;
 
     wxString pending;
     for (auto& ln: gstderr)
@@ -214,6 +379,16 @@ bool ExecuteGettext(const wxString& cmdline)
 }
 
 
+dispatch::future<bool> ExecuteGettextAsync(const wxString& cmdline,
+                                           dispatch::cancellation_token cancel)
+{
+    return dispatch::async([cmdline, cancel]
+    {
+        return ExecuteGettext(cmdline, &cancel);
+    });
+}
+
+
 bool ExecuteGettextAndParseOutput(const wxString& cmdline, GettextErrors& errors)
 {
     wxArrayString gstderr;
@@ -26,6 +26,8 @@
 #ifndef _GEXECUTE_H_
 #define _GEXECUTE_H_
 
+#include "concurrency.h"
+
 #include <wx/string.h>
 #include <vector>
 
@@ -41,9 +43,25 @@ typedef std::vector<GettextError> GettextErrors;
 
 /** Executes command. Writes stderr output to \a stderrOutput if not NULL,
     and logs it with wxLogError otherwise.
+    If @a cancel is given, the program is terminated when it's cancelled.
+    If @a workingDir is given, the program is run in it; the current working
+    directory of Poedit itself is never changed.
     \return true if program exited with exit code 0, false otherwise.
  */
-extern bool ExecuteGettext(const wxString& cmdline);
+extern bool ExecuteGettext(const wxString& cmdline,
+                           const dispatch::cancellation_token *cancel = nullptr,
+                           const wxString& workingDir = wxString());
+
+/**
+    Executes command asynchronously, in the same way as ExecuteGettext(),
+    without blocking the calling thread.
+
+    Use this from the UI so that the window remains responsive, or to run
+    independent steps concurrently. The number of simultaneously running
+    processes is limited, so that they don't compete for CPU cores.
+ */
+extern dispatch::future<bool> ExecuteGettextAsync(const wxString& cmdline,
+                                                  dispatch::cancellation_token cancel = dispatch::cancellation_token());
 
 /// Like ExecuteGettext(), but stores error output parsed into per-item entries.
 extern bool ExecuteGettextAndParseOutput(const wxString& cmdline,
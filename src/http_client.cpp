@@ -27,7 +27,10 @@
 
 #include "str_helpers.h"
 
+#include <deque>
+#include <functional>
 #include <iomanip>
+#include <mutex>
 #include <sstream>
 
 #include <boost/uuid/uuid.hpp>
@@ -36,6 +39,7 @@
 
 
 multipart_form_data::multipart_form_data()
+    : m_body(std::make_shared<std::string>()), m_finalized(false)
 {
     boost::uuids::random_generator gen;
     m_boundary = boost::uuids::to_string(gen());
@@ -43,21 +47,34 @@ multipart_form_data::multipart_form_data()
 
 void multipart_form_data::add_value(const std::string& name, const std::string& value)
 {
-    m_body += "--" + m_boundary + "\r\n";
-    m_body += "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n";
-    m_body += value;
-    m_body += "\r\n";
+    auto& body = *m_body;
+    body += "--" + m_boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n";
+    body += value;
+    body += "\r\n";
 }
 
 void multipart_form_data::add_file(const std::string& name, const std::string& filename, const std::string& file_content)
 {
-    m_body += "--" + m_boundary + "\r\n";
-    m_body += "Content-Disposition: form-data; name=\"" + name + "\"; filename=\"" + filename + "\"\r\n";
-    m_body += "Content-Type: application/octet-stream\r\n";
-    m_body += "Content-Transfer-Encoding: binary\r\n";
-    m_body += "\r\n";
-    m_body += file_content;
-    m_body += "\r\n";
+    add_file(name, filename, [&file_content](std::string& out)
+    {
+        // files may be large, avoid repeated reallocations and copying:
+        out.reserve(out.size() + file_content.size() + 256);
+        out += file_content;
+    });
+}
+
+void multipart_form_data::add_file(const std::string& name, const std::string& filename,
+                                   const std::function<void(std::string& out)>& write_content)
+{
+    auto& body = *m_body;
+    body += "--" + m_boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"" + name + "\"; filename=\"" + filename + "\"\r\n";
+    body += "Content-Type: application/octet-stream\r\n";
+    body += "Content-Transfer-Encoding: binary\r\n";
+    body += "\r\n";
+    write_content(body);
+    body += "\r\n";
 }
 
 std::string multipart_form_data::content_type() const
@@ -67,7 +84,17 @@ std::string multipart_form_data::content_type() const
 
 std::string multipart_form_data::body() const
 {
-    return m_body + "--" + m_boundary + "--\r\n\r\n";
+    return *shared_body();
+}
+
+std::shared_ptr<const std::string> multipart_form_data::shared_body() const
+{
+    if (!m_finalized)
+    {
+        *m_body += "--" + m_boundary + "--\r\n\r\n";
+        m_finalized = true;
+    }
+    return m_body;
 }
 
 
@@ -123,3 +150,151 @@ std::string http_client::url_encode(const std::wstring& s, int flags)
 {
     return url_encode(str::to_utf8(s), flags);
 }
+
+
+namespace
+{
+
+// Snapshot of the body data, needed because queued requests are started after
+// the caller's http_body_data instance is gone. Shares the body buffer.
+class captured_body_data : public http_body_data
+{
+public:
+    captured_body_data(const http_body_data& data)
+        : m_contentType(data.content_type()), m_body(data.shared_body()) {}
+
+    std::string content_type() const override { return m_contentType; }
+    std::string body() const override { return *m_body; }
+    std::shared_ptr<const std::string> shared_body() const override { return m_body; }
+
+private:
+    std::string m_contentType;
+    std::shared_ptr<const std::string> m_body;
+};
+
+} // anonymous namespace
+
+
+class http_client::connection_limiter : public std::enable_shared_from_this<connection_limiter>
+{
+public:
+    connection_limiter(unsigned max_count) : m_max(max_count), m_active(0) {}
+
+    /// Runs @a start when a connection slot is available; the slot is held until the returned future is ready
+    template<typename T>
+    dispatch::future<T> run(std::function<dispatch::future<T>()> start)
+    {
+        auto self = shared_from_this();
+        auto result = std::make_shared<dispatch::promise<T>>();
+        acquire([self, result, start]
+        {
+            dispatch::future<T> f;
+            try
+            {
+                f = start();
+            }
+            catch (...)
+            {
+                dispatch::set_current_exception(result);
+                self->release();
+                return;
+            }
+            f.then([self, result](dispatch::future<T> value)
+            {
+                try
+                {
+                    result->set_value(value.get());
+                }
+                catch (...)
+                {
+                    dispatch::set_current_exception(result);
+                }
+                self->release();
+            });
+        });
+        return result->get_future();
+    }
+
+private:
+    void acquire(std::function<void()>&& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_active >= m_max)
+            {
+                m_waiting.push_back(std::move(job));
+                return;
+            }
+            m_active++;
+        }
+        job();
+    }
+
+    void release()
+    {
+        std::function<void()> next;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_waiting.empty())
+            {
+                m_active--;
+                return;
+            }
+            // pass the slot on to the oldest waiting request:
+            next = std::move(m_waiting.front());
+            m_waiting.pop_front();
+        }
+        next();
+    }
+
+    std::mutex m_mutex;
+    const unsigned m_max;
+    unsigned m_active;
+    std::deque<std::function<void()>> m_waiting;
+};
+
+
+void http_client::set_max_connections(unsigned count)
+{
+    if (count)
+        m_limiter = std::make_shared<connection_limiter>(count);
+    else
+        m_limiter.reset();
+}
+
+dispatch::future<json> http_client::get(const std::string& url)
+{
+    if (!m_limiter)
+        return do_get(url);
+    return m_limiter->run<json>([=]{ return do_get(url); });
+}
+
+dispatch::future<void> http_client::download(const std::string& url, const std::wstring& output_file)
+{
+    return download_if_modified(url, output_file, http_cache_validators()).then([](http_download_result){});
+}
+
+dispatch::future<http_download_result> http_client::download_if_modified(const std::string& url,
+                                                                          const std::wstring& output_file,
+                                                                          const http_cache_validators& validators)
+{
+    if (!m_limiter)
+        return do_download(url, output_file, validators);
+    return m_limiter->run<http_download_result>([=]{ return do_download(url, output_file, validators); });
+}
+
+dispatch::future<http_download_result> http_client::fetch_if_modified(const std::string& url,
+                                                                       const http_cache_validators& validators)
+{
+    if (!m_limiter)
+        return do_download(url, std::wstring(), validators);
+    return m_limiter->run<http_download_result>([=]{ return do_download(url, std::wstring(), validators); });
+}
+
+dispatch::future<json> http_client::post(const std::string& url, const http_body_data& data)
+{
+    if (!m_limiter)
+        return do_post(url, data);
+    auto body = std::make_shared<captured_body_data>(data);
+    return m_limiter->run<json>([=]{ return do_post(url, *body); });
+}
@@ -32,6 +32,7 @@
 #include "json.h"
 
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -50,9 +51,18 @@ public:
 
     /// Returns generated body of the request.
     virtual std::string body() const = 0;
+
+    /**
+        Returns generated body as a shared buffer.
+
+        This is what http_client sends; the default implementation copies
+        body(), derived classes holding large data can avoid the copy.
+     */
+    virtual std::shared_ptr<const std::string> shared_body() const
+        { return std::make_shared<std::string>(body()); }
 };
 
-/// Stores POSTed data (RFC 1867)
+/// Stores POSTed data (RFC 1867); can't be modified after its body was used
 class multipart_form_data : public http_body_data
 {
 public:
@@ -64,12 +74,25 @@ public:
     /// Add file upload.
     void add_file(const std::string& name, const std::string& filename, const std::string& file_content);
 
+    /**
+        Add file upload with content produced by @a write_content.
+
+        The function appends the file's content to the string passed to it,
+        which is the body itself, so large content (e.g. a serialized catalog)
+        is written directly into the request without extra copies.
+     */
+    void add_file(const std::string& name, const std::string& filename,
+                  const std::function<void(std::string& out)>& write_content);
+
     std::string content_type() const override;
     std::string body() const override;
+    std::shared_ptr<const std::string> shared_body() const override;
 
 private:
     std::string m_boundary;
-    std::string m_body;
+    // the body is finalized (the closing boundary appended) on first use:
+    std::shared_ptr<std::string> m_body;
+    mutable bool m_finalized;
 };
 
 /// Stores application/x-www-form-urlencoded data
@@ -100,8 +123,34 @@ private:
 };
 
 
+/// Validators of a downloaded resource, used for conditional requests
+struct http_cache_validators
+{
+    std::string etag;
+    std::string last_modified;
+
+    bool empty() const { return etag.empty() && last_modified.empty(); }
+};
+
+/// Outcome of http_client::download_if_modified()
+struct http_download_result
+{
+    /// False if the server responded with 304 Not Modified
+    bool modified;
+    /// Validators of the current version of the resource
+    http_cache_validators validators;
+    /// Body of the response, if modified; only for http_client::fetch_if_modified()
+    std::shared_ptr<const std::string> body;
+};
+
+
 /**
     Client for accessing HTTP REST APIs.
+
+    The client keeps connections to the server alive and reuses them for
+    subsequent requests (multiplexing them over HTTP/2 where available), so
+    a single long-lived instance should be used for each service. Requests
+    are asynchronous and independent ones can be issued concurrently.
  */
 class http_client
 {
@@ -109,8 +158,18 @@ public:
     /// Connection flags for the client.
     enum flags
     {
-        // currently no flags are used
-        default_flags = 0
+        default_flags = 0,
+
+        /**
+            Send larger POST bodies gzip-compressed (Content-Encoding: gzip).
+
+            If the server rejects a compressed request with 400 or 415 status,
+            it is transparently repeated uncompressed and compression is
+            disabled for the rest of the client's lifetime.
+
+            (Compressed responses are always accepted, regardless of flags.)
+         */
+        compress_requests = 1
     };
 
     /**
@@ -132,6 +191,15 @@ public:
     /// Sets Authorization header to be used in all requests
     void set_authorization(const std::string& auth);
 
+    /**
+        Limits the number of requests running concurrently to @a count.
+
+        Requests made while the limit is reached are queued and started as
+        soon as some of the running ones finish. 0 (the default) means no
+        limit. Should be called before making any requests.
+     */
+    void set_max_connections(unsigned count);
+
     /// Perform a GET request at the given URL
     dispatch::future<json> get(const std::string& url);
 
@@ -142,6 +210,25 @@ public:
      */
     dispatch::future<void> download(const std::string& url, const std::wstring& output_file);
 
+    /**
+        Perform a conditional GET request and store the body in a file.
+
+        The request is made with If-None-Match and If-Modified-Since headers
+        set from @a validators (if not empty). If the resource didn't change,
+        @a output_file isn't touched and the result's @c modified is false.
+     */
+    dispatch::future<http_download_result> download_if_modified(const std::string& url,
+                                                                const std::wstring& output_file,
+                                                                const http_cache_validators& validators);
+
+    /**
+        Like download_if_modified(), but keeps the body in memory, in the
+        result's @c body, instead of storing it in a file. Useful when the
+        data is only going to be parsed anyway.
+     */
+    dispatch::future<http_download_result> fetch_if_modified(const std::string& url,
+                                                             const http_cache_validators& validators);
+
     /**
         Perform a POST request with multipart/form-data formatted @a params.
      */
@@ -178,8 +265,19 @@ protected:
     virtual void on_error_response(int& /*statusCode*/, std::string& /*message*/) {};
 
 private:
+    // backend-specific implementations of the public methods, called
+    // subject to set_max_connections() limit; do_download() with empty
+    // output_file implements fetch_if_modified():
+    dispatch::future<json> do_get(const std::string& url);
+    dispatch::future<http_download_result> do_download(const std::string& url, const std::wstring& output_file,
+                                                       const http_cache_validators& validators);
+    dispatch::future<json> do_post(const std::string& url, const http_body_data& data);
+
     class impl;
     std::unique_ptr<impl> m_impl;
+
+    class connection_limiter;
+    std::shared_ptr<connection_limiter> m_limiter;
 };
 
 /// Monitor if networking is available
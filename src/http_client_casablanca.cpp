@@ -28,6 +28,7 @@
 #include "version.h"
 #include "str_helpers.h"
 
+#include <atomic>
 #include <cstdlib>
 
 #include <boost/algorithm/string/predicate.hpp>
@@ -41,9 +42,11 @@
 #include <boost/throw_exception.hpp>
 
 #include <cpprest/asyncrt_utils.h>
+#include <cpprest/containerstream.h>
 #include <cpprest/http_client.h>
 #include <cpprest/http_msg.h>
 #include <cpprest/filestream.h>
+#include <cpprest/rawptrstream.h>
 
 #ifdef _WIN32
     #include <windows.h>
@@ -99,7 +102,8 @@ public:
                     io::back_insert_device<std::vector<char>> sink(decompressed);
                     io::copy(in, sink);
 
-                    response.set_body(concurrency::streams::bytestream::open_istream(std::move(decompressed)), decompressed.size());
+                    const size_t size = decompressed.size(); // not after it was moved from
+                    response.set_body(concurrency::streams::bytestream::open_istream(std::move(decompressed)), size);
                     return response;
                 });
             }
@@ -111,6 +115,22 @@ public:
     }
 };
 
+// Only bodies at least this large are worth compressing
+const size_t MIN_COMPRESSED_SIZE = 1024;
+
+std::string gzip_compress(const std::string& data)
+{
+    namespace io = boost::iostreams;
+
+    std::string compressed;
+    io::filtering_ostream out;
+    out.push(io::gzip_compressor());
+    out.push(io::back_inserter(compressed));
+    out.write(data.data(), data.size());
+    out.reset(); // flushes the compressor
+    return compressed;
+}
+
 } // anonymous namespace
 
 
@@ -119,7 +139,8 @@ class http_client::impl
 public:
     impl(http_client& owner, const std::string& url_prefix, int flags)
         : m_owner(owner),
-          m_native(sanitize_url(url_prefix, flags), get_client_config())
+          m_native(sanitize_url(url_prefix, flags), get_client_config()),
+          m_compressRequests((flags & compress_requests) != 0)
     {
         #define make_wide_str(x) make_wide_str_(x)
         #define make_wide_str_(x) L ## x
@@ -163,35 +184,72 @@ public:
         });
     }
 
-    dispatch::future<void> download(const std::string& url, const std::wstring& output_file)
+    dispatch::future<http_download_result> download(const std::string& url, const std::wstring& output_file,
+                                                     const http_cache_validators& validators)
     {
         using namespace concurrency::streams;
-        auto fileStream = std::make_shared<ostream>();
+
+        http::http_request req(http::methods::GET);
+        req.headers().add(http::header_names::user_agent, m_userAgent);
+        req.headers().add(http::header_names::accept_language, ui_language);
+        if (!m_auth.empty())
+            req.headers().add(http::header_names::authorization, m_auth);
+        if (!validators.etag.empty())
+            req.headers().add(U("If-None-Match"), to_string_t(validators.etag));
+        if (!validators.last_modified.empty())
+            req.headers().add(U("If-Modified-Since"), to_string_t(validators.last_modified));
+        req.set_request_uri(to_string_t(url));
 
         return
-        fstream::open_ostream(to_string_t(output_file)).then([=](ostream outFile)
-        {
-            *fileStream = outFile;
-            http::http_request req(http::methods::GET);
-            req.headers().add(http::header_names::user_agent, m_userAgent);
-            req.headers().add(http::header_names::accept_language, ui_language);
-            if (!m_auth.empty())
-                req.headers().add(http::header_names::authorization, m_auth);
-            req.set_request_uri(to_string_t(url));
-            return m_native.request(req);
-        })
+        m_native.request(req)
         .then([=](http::http_response response)
         {
+            http_download_result result;
+            if (response.status_code() == http::status_codes::NotModified)
+            {
+                // don't touch the output file at all:
+                result.modified = false;
+                result.validators = validators;
+                return pplx::task_from_result(result);
+            }
+
             handle_error(response);
-            return response.body().read_to_end(fileStream->streambuf());
-        })
-        .then([=](size_t)
-        {
-            return fileStream->close();
+            result.modified = true;
+            result.validators.etag = header_value(response, U("ETag"));
+            result.validators.last_modified = header_value(response, U("Last-Modified"));
+
+            if (output_file.empty())
+            {
+                auto buffer = std::make_shared<container_buffer<std::string>>();
+                return response.body().read_to_end(*buffer).then([=](size_t)
+                {
+                    http_download_result fetched(result);
+                    fetched.body = std::make_shared<std::string>(std::move(buffer->collection()));
+                    return fetched;
+                });
+            }
+
+            // only open (and truncate) the file once there's something to write:
+            return fstream::open_ostream(to_string_t(output_file)).then([=](ostream outFile)
+            {
+                auto fileStream = std::make_shared<ostream>(outFile);
+                return response.body().read_to_end(fileStream->streambuf())
+                       .then([=](size_t){ return fileStream->close(); })
+                       .then([=]{ return result; });
+            });
         });
     }
 
     dispatch::future<::json> post(const std::string& url, const http_body_data& data)
+    {
+        auto body = data.shared_body();
+        const bool compress = m_compressRequests && body->size() >= MIN_COMPRESSED_SIZE;
+        return send_post(url, body, data.content_type(), compress);
+    }
+
+private:
+    pplx::task<::json> send_post(const std::string& url, std::shared_ptr<const std::string> body,
+                                 const std::string& content_type, bool compress)
     {
         http::http_request req(http::methods::POST);
         req.headers().add(http::header_names::accept,     L"application/json");
@@ -201,20 +259,45 @@ public:
             req.headers().add(http::header_names::authorization, m_auth);
         req.set_request_uri(to_string_t(url));
 
-        auto body = data.body();
-        req.set_body(body, data.content_type());
-        req.headers().set_content_length(body.size());
+        if (compress)
+        {
+            auto compressed = gzip_compress(*body);
+            req.headers().add(http::header_names::content_encoding, U("gzip"));
+            req.headers().set_content_length(compressed.size());
+            req.set_body(std::move(compressed), content_type);
+        }
+        else
+        {
+            // send directly from the shared buffer, it's kept alive by the continuation below:
+            using namespace concurrency::streams;
+            auto stream = rawptr_stream<uint8_t>::open_istream(reinterpret_cast<const uint8_t*>(body->data()), body->size());
+            req.set_body(stream, body->size(), to_string_t(content_type));
+        }
 
         return
         m_native.request(req)
-        .then([=](http::http_response response)
+        .then([=](http::http_response response) -> pplx::task<::json>
         {
+            auto status = response.status_code();
+            if (compress && (status == http::status_codes::BadRequest || status == http::status_codes::UnsupportedMediaType))
+            {
+                // the server doesn't understand compressed bodies, don't try again:
+                m_compressRequests = false;
+                return send_post(url, body, content_type, false);
+            }
             handle_error(response);
-            return ::json::parse(response.extract_utf8string().get());
+            return pplx::task_from_result(::json::parse(response.extract_utf8string().get()));
         });
     }
 
-private:
+    static std::string header_value(const http::http_response& r, const string_t& name)
+    {
+        string_t value;
+        if (!r.headers().match(name, value))
+            return std::string();
+        return str::to_utf8(value);
+    }
+
     // handle non-OK responses:
     void handle_error(http::http_response r)
     {
@@ -285,6 +368,7 @@ private:
     http::client::http_client m_native;
     std::wstring m_userAgent;
     std::wstring m_auth;
+    std::atomic<bool> m_compressRequests;
 };
 
 
@@ -310,17 +394,18 @@ void http_client::set_authorization(const std::string& auth)
     m_impl->set_authorization(auth);
 }
 
-dispatch::future<::json> http_client::get(const std::string& url)
+dispatch::future<::json> http_client::do_get(const std::string& url)
 {
     return m_impl->get(url);
 }
 
-dispatch::future<void> http_client::download(const std::string& url, const std::wstring& output_file)
+dispatch::future<http_download_result> http_client::do_download(const std::string& url, const std::wstring& output_file,
+                                                                 const http_cache_validators& validators)
 {
-    return m_impl->download(url, output_file);
+    return m_impl->download(url, output_file, validators);
 }
 
-dispatch::future<::json> http_client::post(const std::string& url, const http_body_data& data)
+dispatch::future<::json> http_client::do_post(const std::string& url, const http_body_data& data)
 {
     return m_impl->post(url, data);
 }
@@ -28,6 +28,10 @@
 #include "str_helpers.h"
 #include "version.h"
 
+#include <atomic>
+
+#include <zlib.h>
+
 
 class http_exception : public std::runtime_error
 {
@@ -36,11 +40,44 @@ public:
 };
 
 
+namespace
+{
+
+// Only bodies at least this large are worth compressing
+const size_t MIN_COMPRESSED_SIZE = 1024;
+
+std::string gzip_compress(const std::string& data)
+{
+    z_stream zs = {};
+    // 16 added to window bits selects gzip format instead of zlib:
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("failed to initialize compression");
+
+    std::string compressed;
+    compressed.resize(deflateBound(&zs, data.size()));
+    zs.next_in = (Bytef*)data.data();
+    zs.avail_in = (uInt)data.size();
+    zs.next_out = (Bytef*)&compressed[0];
+    zs.avail_out = (uInt)compressed.size();
+
+    const int ret = deflate(&zs, Z_FINISH);
+    compressed.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+        throw std::runtime_error("failed to compress data");
+
+    return compressed;
+}
+
+} // anonymous namespace
+
+
 class http_client::impl
 {
 public:
-    impl(http_client& owner, const std::string& url_prefix, int /*flags*/)
-        : m_owner(owner), m_authHeader(nil)
+    impl(http_client& owner, const std::string& url_prefix, int flags)
+        : m_owner(owner), m_authHeader(nil),
+          m_compressRequests((flags & compress_requests) != 0)
     {
         int majorVersion, minorVersion, patchVersion;
         NSOperatingSystemVersion macos = [[NSProcessInfo processInfo] operatingSystemVersion];
@@ -53,6 +90,8 @@ public:
         NSString *user_agent = [NSString stringWithFormat:@"Poedit/%s (Mac OS X %@)", POEDIT_VERSION, macos_str];
 
         auto config = [NSURLSessionConfiguration defaultSessionConfiguration];
+        // reuse connections as much as possible (HTTP/2 is used automatically if supported):
+        config.HTTPShouldUsePipelining = YES;
         config.HTTPAdditionalHeaders = @{
             @"User-Agent": user_agent,
             @"Accept": @"application/json"
@@ -96,22 +135,55 @@ public:
         return promise->get_future();
     }
 
-    dispatch::future<void> download(const std::string& url, const std::wstring& output_file)
+    dispatch::future<http_download_result> download(const std::string& url, const std::wstring& output_file,
+                                                     const http_cache_validators& validators)
     {
-        auto promise = std::make_shared<dispatch::promise<void>>();
+        auto promise = std::make_shared<dispatch::promise<http_download_result>>();
 
         NSString *outputPath = str::to_NS(output_file);
         auto request = build_request(@"GET", url);
+        if (!validators.empty())
+        {
+            // don't let NSURLCache answer conditional requests on its own:
+            request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+            if (!validators.etag.empty())
+                [request setValue:str::to_NS(validators.etag) forHTTPHeaderField:@"If-None-Match"];
+            if (!validators.last_modified.empty())
+                [request setValue:str::to_NS(validators.last_modified) forHTTPHeaderField:@"If-Modified-Since"];
+        }
+
+        if (output_file.empty())
+        {
+            // kept in memory, see fetch_if_modified():
+            auto task = [m_session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+                try
+                {
+                    http_download_result result;
+                    if (!handle_download_response(data, response, error, validators, result, *promise))
+                        return;
+                    result.body = std::make_shared<std::string>((const char*)data.bytes, data.length);
+                    promise->set_value(result);
+                }
+                catch (...)
+                {
+                    dispatch::set_current_exception(promise);
+                }
+            }];
+            [task resume];
+            return promise->get_future();
+        }
+
         auto task = [m_session downloadTaskWithRequest:request completionHandler:^(NSURL *location, NSURLResponse *response, NSError *error) {
             try
             {
-                if (handle_error(nil, response, error, *promise))
+                http_download_result result;
+                if (!handle_download_response(nil, response, error, validators, result, *promise))
                     return;
 
                 NSError *err = nil;
                 if (![[NSFileManager defaultManager] moveItemAtPath:[location path] toPath:outputPath error:&err])
                     throw std::runtime_error(str::to_utf8([err localizedDescription]));
-                promise->set_value();
+                promise->set_value(result);
             }
             catch (...)
             {
@@ -126,16 +198,46 @@ public:
     dispatch::future<json> post(const std::string& url, const http_body_data& body_data)
     {
         auto promise = std::make_shared<dispatch::promise<json>>();
+        auto body = body_data.shared_body();
+        const bool compress = m_compressRequests && body->size() >= MIN_COMPRESSED_SIZE;
+        send_post(url, body, body_data.content_type(), compress, promise);
+        return promise->get_future();
+    }
 
+private:
+    // NB: strings are passed by value so that the block below captures copies
+    void send_post(std::string url, std::shared_ptr<const std::string> body, std::string content_type,
+                   bool compress, std::shared_ptr<dispatch::promise<json>> promise)
+    {
         auto request = build_request(@"POST", url);
-        auto body = body_data.body();
-        [request setValue:str::to_NS(body_data.content_type()) forHTTPHeaderField:@"Content-Type"];
-        [request setValue:[NSString stringWithFormat:@"%lu", body.size()] forHTTPHeaderField:@"Content-Length"];
-        [request setHTTPBody:[NSData dataWithBytes:body.data() length:body.size()]];
+        [request setValue:str::to_NS(content_type) forHTTPHeaderField:@"Content-Type"];
+
+        NSData *bodyData;
+        if (compress)
+        {
+            auto compressed = gzip_compress(*body);
+            [request setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+            bodyData = [NSData dataWithBytes:compressed.data() length:compressed.size()];
+        }
+        else
+        {
+            // no need to copy the shared buffer, the block below keeps it alive:
+            bodyData = [NSData dataWithBytesNoCopy:(void*)body->data() length:body->size() freeWhenDone:NO];
+        }
+        [request setValue:[NSString stringWithFormat:@"%lu", (unsigned long)bodyData.length] forHTTPHeaderField:@"Content-Length"];
+        [request setHTTPBody:bodyData];
 
         auto task = [m_session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
             try
             {
+                const auto status = response ? ((NSHTTPURLResponse*)response).statusCode : 0;
+                if (compress && error == nil && (status == 400 || status == 415))
+                {
+                    // the server doesn't understand compressed bodies, don't try again:
+                    m_compressRequests = false;
+                    send_post(url, body, content_type, false, promise);
+                    return;
+                }
                 if (handle_error(data, response, error, *promise))
                     return;
                 promise->set_value(extract_json(data));
@@ -146,11 +248,8 @@ public:
             }
         }];
         [task resume];
-
-        return promise->get_future();
     }
 
-private:
     NSMutableURLRequest *build_request(NSString *method, const std::string& relative_url)
     {
         auto url = [NSURL URLWithString:str::to_NS(relative_url) relativeToURL:m_baseURL];
@@ -161,6 +260,41 @@ private:
         return request;
     }
 
+    /// Fills in @a result of a conditional download; returns false if the
+    /// promise was already fulfilled, because of an error or 304 response
+    bool handle_download_response(NSData *data, NSURLResponse *response, NSError *error,
+                                  const http_cache_validators& validators, http_download_result& result,
+                                  dispatch::promise<http_download_result>& promise)
+    {
+        if (error == nil && ((NSHTTPURLResponse*)response).statusCode == 304)
+        {
+            result.modified = false;
+            result.validators = validators;
+            promise.set_value(result);
+            return false;
+        }
+
+        if (handle_error(data, response, error, promise))
+            return false;
+
+        result.modified = true;
+        result.validators.etag = header_value(response, @"ETag");
+        result.validators.last_modified = header_value(response, @"Last-Modified");
+        return true;
+    }
+
+    static std::string header_value(NSURLResponse *response, NSString *name)
+    {
+        // allHeaderFields keys don't have canonical case, compare case-insensitively:
+        NSDictionary *headers = ((NSHTTPURLResponse*)response).allHeaderFields;
+        for (NSString *key in headers)
+        {
+            if ([key caseInsensitiveCompare:name] == NSOrderedSame)
+                return str::to_utf8((NSString*)headers[key]);
+        }
+        return std::string();
+    }
+
     template<typename T>
     bool handle_error(NSData *data, NSURLResponse *response_, NSError *error, dispatch::promise<T>& promise)
     {
@@ -218,6 +352,7 @@ private:
     NSURLSession *m_session;
     NSURL *m_baseURL;
     NSString *m_authHeader;
+    std::atomic<bool> m_compressRequests;
 };
 
 
@@ -235,17 +370,18 @@ void http_client::set_authorization(const std::string& auth)
     m_impl->set_authorization(auth);
 }
 
-dispatch::future<json> http_client::get(const std::string& url)
+dispatch::future<json> http_client::do_get(const std::string& url)
 {
     return m_impl->get(url);
 }
 
-dispatch::future<void> http_client::download(const std::string& url, const std::wstring& output_file)
+dispatch::future<http_download_result> http_client::do_download(const std::string& url, const std::wstring& output_file,
+                                                                 const http_cache_validators& validators)
 {
-    return m_impl->download(url, output_file);
+    return m_impl->download(url, output_file, validators);
 }
 
-dispatch::future<json> http_client::post(const std::string& url, const http_body_data& data)
+dispatch::future<json> http_client::do_post(const std::string& url, const http_body_data& data)
 {
     return m_impl->post(url, data);
 }
@@ -27,8 +27,11 @@
 #include <wx/stdpaths.h>
 #include <wx/image.h>
 #include <wx/rawbmp.h>
+#include <wx/thread.h>
 
+#include <map>
 #include <set>
+#include <tuple>
 
 #ifdef __WXGTK__
 #include <gtk/gtk.h>
@@ -262,3 +265,58 @@ wxBitmap PoeditArtProvider::CreateBitmap(const wxArtID& id_,
 }
 
 #endif // !__WXOSX__
+
+
+// ----------------------------------------------------------------------
+// IconsCache
+// ----------------------------------------------------------------------
+
+namespace
+{
+
+struct CachedIcon
+{
+    wxIcon icon;
+    wxBitmap bitmap;
+};
+
+// (scaling factor, color mode, ID) -> icon; std::map keeps references stable
+typedef std::map<std::tuple<double, int, wxString>, CachedIcon> IconsMap;
+IconsMap *gs_iconsCache = nullptr;
+
+CachedIcon& GetCachedIcon(const wxArtID& id)
+{
+    wxASSERT( wxThread::IsMain() );
+
+    if (!gs_iconsCache)
+        gs_iconsCache = new IconsMap;
+
+    auto key = std::make_tuple(HiDPIScalingFactor(), (int)ColorScheme::GetAppMode(), id);
+    auto i = gs_iconsCache->find(key);
+    if (i != gs_iconsCache->end())
+        return i->second;
+
+    CachedIcon c;
+    c.icon = wxArtProvider::GetIcon(id);
+    c.bitmap = wxArtProvider::GetBitmap(id);
+    return gs_iconsCache->emplace(key, c).first->second;
+}
+
+} // anonymous namespace
+
+
+const wxIcon& IconsCache::GetIcon(const wxArtID& id)
+{
+    return GetCachedIcon(id).icon;
+}
+
+const wxBitmap& IconsCache::GetBitmap(const wxArtID& id)
+{
+    return GetCachedIcon(id).bitmap;
+}
+
+void IconsCache::CleanUp()
+{
+    delete gs_iconsCache;
+    gs_iconsCache = nullptr;
+}
@@ -27,6 +27,7 @@
 #define _ICONS_H_
 
 #include <wx/artprov.h>
+#include <wx/icon.h>
 
 #if defined(__WXGTK20__)
     #define HAS_THEMES_SUPPORT
@@ -47,4 +48,24 @@ protected:
 };
 #endif
 
+
+/**
+    Process-wide cache of icons used in frequently repainted places, such as
+    status icons in the list control, so that repainting never has to go
+    through wxArtProvider.
+
+    Icons are loaded lazily on first use and kept separately for each HiDPI
+    scaling factor and color scheme mode, because both affect how they look.
+    Must only be used from the main thread.
+ */
+class IconsCache
+{
+public:
+    static const wxIcon& GetIcon(const wxArtID& id);
+    static const wxBitmap& GetBitmap(const wxArtID& id);
+
+    /// Drops all cached icons; must be called before wx is shut down
+    static void CleanUp();
+};
+
 #endif // _ICONS_H_
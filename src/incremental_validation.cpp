@@ -0,0 +1,122 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "incremental_validation.h"
+
+#include <wx/log.h>
+
+#include <algorithm>
+
+
+namespace
+{
+
+// Items validated at once by full validation. Each batch is checked in
+// parallel and large enough to be split across all cores, yet small enough
+// not to block the UI noticeably:
+const size_t VALIDATION_BATCH_SIZE = 5000;
+
+} // anonymous namespace
+
+
+void IncrementalValidator::SetCatalog(const CatalogPtr& catalog)
+{
+    if (m_catalog.lock() == catalog)
+        return;
+
+    m_catalog = catalog;
+    m_dirtyItems.clear();
+    m_fullValidationPending = false;
+    m_nextBatch = 0;
+}
+
+
+void IncrementalValidator::ItemChanged(const CatalogItemPtr& item)
+{
+    // will be checked anyway, unless its batch was already done:
+    if (m_fullValidationPending && item->GetId() > int(m_nextBatch))
+        return;
+
+    // with many items changed at once (e.g. bulk edits of a large selection),
+    // checking the whole catalog in parallel is cheaper:
+    static const size_t MAX_DIRTY_ITEMS = 100;
+    if (m_dirtyItems.size() >= MAX_DIRTY_ITEMS)
+    {
+        CatalogChanged();
+        return;
+    }
+
+    for (auto& i: m_dirtyItems)
+    {
+        if (i.lock() == item)
+            return;
+    }
+    m_dirtyItems.push_back(item);
+}
+
+
+IncrementalValidator::Result IncrementalValidator::ProcessPending()
+{
+    Result result;
+
+    auto catalog = m_catalog.lock();
+    if (!catalog)
+    {
+        m_dirtyItems.clear();
+        m_fullValidationPending = false;
+        return result;
+    }
+
+    std::vector<std::weak_ptr<CatalogItem>> dirty;
+    dirty.swap(m_dirtyItems);
+    for (auto& i: dirty)
+    {
+        auto item = i.lock();
+        if (!item)
+            continue; // removed from the catalog in the meantime
+        catalog->ValidateItem(item);
+        result.items.push_back(item);
+    }
+
+    if (m_fullValidationPending)
+    {
+        const size_t count = catalog->items().size();
+        result.batchBegin = std::min(m_nextBatch, count);
+        result.batchEnd = std::min(m_nextBatch + VALIDATION_BATCH_SIZE, count);
+        m_nextBatch = result.batchEnd;
+
+        wxLogNull null;  // don't report non-item warnings
+        catalog->ValidateItems(result.batchBegin, result.batchEnd);
+
+        if (m_nextBatch >= count)
+        {
+            m_fullValidationPending = false;
+            m_nextBatch = 0;
+            result.fullValidation = true;
+        }
+    }
+
+    return result;
+}
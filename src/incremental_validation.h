@@ -0,0 +1,100 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_incremental_validation_h
+#define Poedit_incremental_validation_h
+
+#include "catalog.h"
+
+#include <memory>
+#include <vector>
+
+
+/**
+    Keeps validation of an edited catalog up to date without re-checking
+    all of it after every change.
+
+    Edited items are only recorded as dirty and re-checked individually
+    (QA checks and format strings, see Catalog::ValidateItem()), which is
+    cheap regardless of the catalog's size. Changes that may affect any item
+    (e.g. to the header), as well as loading the catalog, schedule full
+    validation instead. Both are done from ProcessPending(), intended to be
+    called when the UI is idle.
+
+    Full validation is done in batches of items, one per ProcessPending()
+    call, so that a freshly opened catalog can be shown and used right away
+    and issues appear as they are found.
+ */
+class IncrementalValidator
+{
+public:
+    IncrementalValidator() : m_fullValidationPending(false), m_nextBatch(0) {}
+
+    /** Starts tracking @a catalog, forgetting anything pending for the previous
+        one. Does nothing if @a catalog is already tracked. */
+    void SetCatalog(const CatalogPtr& catalog);
+
+    /// Marks the item as changed, so that it is re-validated later.
+    void ItemChanged(const CatalogItemPtr& item);
+
+    /// Schedules validation of the entire catalog, restarting it if in progress.
+    void CatalogChanged()
+    {
+        m_fullValidationPending = true;
+        m_nextBatch = 0;
+        m_dirtyItems.clear();
+    }
+
+    /// Is there anything to do in ProcessPending()?
+    bool HasPendingWork() const
+        { return m_fullValidationPending || !m_dirtyItems.empty(); }
+
+    /// What ProcessPending() did
+    struct Result
+    {
+        Result() : batchBegin(0), batchEnd(0), fullValidation(false) {}
+
+        /// Range of items (indexes into Catalog::items()) validated as part
+        /// of full validation; empty if none were
+        size_t batchBegin, batchEnd;
+        /// Was full validation of the catalog completed by this batch?
+        bool fullValidation;
+        /// Items re-validated individually
+        std::vector<CatalogItemPtr> items;
+    };
+
+    /// Performs pending validation of changed items and the next batch of
+    /// full validation, if any.
+    Result ProcessPending();
+
+private:
+    std::weak_ptr<Catalog> m_catalog;
+    std::vector<std::weak_ptr<CatalogItem>> m_dirtyItems;
+    bool m_fullValidationPending;
+    // first item of full validation's next batch:
+    size_t m_nextBatch;
+};
+
+#endif // Poedit_incremental_validation_h
@@ -0,0 +1,169 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "json_bundle_writer.h"
+
+#include "catalog.h"
+
+#include <wx/ffile.h>
+
+
+namespace
+{
+
+// domain name used by Jed if none is specified
+const char *JED_DOMAIN = "messages";
+
+} // anonymous namespace
+
+
+bool JSONBundleWriter::ParseFormat(const wxString& name, Format& format)
+{
+    auto n = name.Strip(wxString::both).Lower();
+    if (n == "jed")
+        format = Format::Jed;
+    else if (n == "i18next")
+        format = Format::I18next;
+    else
+        return false;
+    return true;
+}
+
+
+JSONBundleWriter::JSONBundleWriter(Format format, const std::string& lang, const std::string& pluralForms, unsigned nplurals)
+    : m_format(format), m_nplurals(nplurals)
+{
+    switch (m_format)
+    {
+        case Format::Jed:
+        {
+            m_root = {
+                {"domain", JED_DOMAIN},
+                {"locale_data", {
+                    {JED_DOMAIN, {
+                        {"", {
+                            {"domain", JED_DOMAIN},
+                            {"lang", lang},
+                            {"plural_forms", pluralForms}
+                        }}
+                    }}
+                }}
+            };
+            break;
+        }
+
+        case Format::I18next:
+        {
+            m_root = json::object();
+            break;
+        }
+    }
+}
+
+
+json& JSONBundleWriter::Messages()
+{
+    if (m_format == Format::Jed)
+        return m_root["locale_data"][JED_DOMAIN];
+    return m_root;
+}
+
+
+void JSONBundleWriter::Add(const CatalogItem& item)
+{
+    // Same as msgfmt, skip fuzzy and untranslated entries:
+    if (item.IsFuzzy() || item.GetTranslation(0).empty())
+        return;
+
+    const unsigned forms = item.HasPlural() ? m_nplurals : 1;
+    auto& msgid = item.GetStringUTF8();
+
+    auto& messages = Messages();
+
+    switch (m_format)
+    {
+        case Format::Jed:
+        {
+            std::string key;
+            if (item.HasContext())
+            {
+                key = item.GetContextUTF8();
+                key += '\x04';
+            }
+            key += msgid;
+
+            auto translations = json::array();
+            for (unsigned i = 0; i < forms; i++)
+                translations.push_back(item.GetTranslation(i).utf8_str().data());
+            messages[key] = std::move(translations);
+            break;
+        }
+
+        case Format::I18next:
+        {
+            std::string key(msgid);
+            if (item.HasContext())
+            {
+                key += '_';
+                key += item.GetContextUTF8();
+            }
+
+            if (!item.HasPlural())
+            {
+                messages[key] = item.GetTranslation(0).utf8_str().data();
+            }
+            else if (m_nplurals == 2)
+            {
+                messages[key] = item.GetTranslation(0).utf8_str().data();
+                messages[key + "_plural"] = item.GetTranslation(1).utf8_str().data();
+            }
+            else
+            {
+                for (unsigned i = 0; i < forms; i++)
+                    messages[key + "_" + std::to_string(i)] = item.GetTranslation(i).utf8_str().data();
+            }
+            break;
+        }
+    }
+}
+
+
+std::string JSONBundleWriter::Serialize() const
+{
+    return m_root.dump();
+}
+
+
+bool JSONBundleWriter::Save(const wxString& filename) const
+{
+    const std::string data = Serialize();
+
+    wxFFile f;
+    if (!f.Open(filename, "wb"))
+        return false;
+    if (f.Write(data.data(), data.size()) != data.size())
+        return false;
+    return f.Close();
+}
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_json_bundle_writer_h
+#define Poedit_json_bundle_writer_h
+
+#include "json.h"
+
+#include <wx/string.h>
+
+#include <string>
+
+class CatalogItem;
+
+
+/**
+    Writer of JSON translation bundles, used by JavaScript i18n libraries
+    instead of MO files.
+
+    Supported formats are Jed 1.x (also used by WordPress) and i18next's
+    JSON v3, where plural forms are numbered as in the PO file.
+
+    Like MO files, bundles only contain translated, non-fuzzy strings.
+ */
+class JSONBundleWriter
+{
+public:
+    enum class Format
+    {
+        Jed,
+        I18next
+    };
+
+    /** Parses the format's name as used in the X-Poedit-JSON-Format header
+        ("jed" or "i18next"). Returns false if @a name isn't known.
+     */
+    static bool ParseFormat(const wxString& name, Format& format);
+
+    /**
+        @param lang        Language code of the translations
+        @param pluralForms Value of the Plural-Forms header
+        @param nplurals    Number of plural forms
+     */
+    JSONBundleWriter(Format format, const std::string& lang, const std::string& pluralForms, unsigned nplurals);
+
+    /// Adds an item to the bundle; untranslated and fuzzy ones are skipped
+    void Add(const CatalogItem& item);
+
+    /// Returns the JSON data
+    std::string Serialize() const;
+
+    /// Writes the JSON data into a file; returns false on failure.
+    bool Save(const wxString& filename) const;
+
+private:
+    /// The object translations are added to, inside m_root
+    json& Messages();
+
+    Format m_format;
+    unsigned m_nplurals;
+    json m_root;
+};
+
+#endif // Poedit_json_bundle_writer_h
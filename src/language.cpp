@@ -26,8 +26,11 @@
 #include "language.h"
 
 #include <cctype>
+#include <cstring>
 #include <algorithm>
+#include <map>
 #include <unordered_map>
+#include <functional>
 #include <mutex>
 #include <memory>
 
@@ -36,11 +39,17 @@
 #include <unicode/uvernum.h>
 #include <unicode/locid.h>
 #include <unicode/coll.h>
+#include <unicode/normalizer2.h>
+#include <unicode/uchar.h>
 #include <unicode/utypes.h>
 
 #include <wx/filename.h>
+#include <wx/ffile.h>
+#include <wx/log.h>
 
+#include "concurrency.h"
 #include "str_helpers.h"
+#include "utility.h"
 #include "pluralforms/pl_evaluate.h"
 
 #ifdef HAVE_CLD2
@@ -134,95 +143,330 @@ struct DisplayNamesData
     typedef std::unordered_map<std::wstring, std::string> Map;
     Map names, namesEng;
     std::vector<std::wstring> sortedNames;
-};
 
-std::once_flag of_namesList;
+    // Search index of sortedNames: searchKeys are case- and diacritics-folded
+    // sortedNames and searchIndex has all their suffixes, sorted, so that
+    // substrings can be found with binary search.
+    struct Suffix
+    {
+        uint32_t name;
+        uint32_t offset;
+    };
+    std::vector<std::wstring> searchKeys;
+    std::vector<Suffix> searchIndex;
+};
 
-const DisplayNamesData& GetDisplayNamesData()
+// Folds case and removes diacritics, so that e.g. "cesky" matches "Česky"
+std::wstring FoldForSearch(const icu::UnicodeString& s)
 {
-    static DisplayNamesData data;
+    UErrorCode err = U_ZERO_ERROR;
+    auto nfd = icu::Normalizer2::getNFDInstance(err);
+    icu::UnicodeString decomposed;
+    if (nfd && U_SUCCESS(err))
+        nfd->normalize(s, decomposed, err);
+    if (!nfd || U_FAILURE(err))
+        decomposed = s;
+
+    icu::UnicodeString folded;
+    for (int32_t i = 0; i < decomposed.length(); i = decomposed.moveIndex32(i, 1))
+    {
+        UChar32 c = decomposed.char32At(i);
+        if (u_charType(c) != U_NON_SPACING_MARK)
+            folded.append(c);
+    }
+    folded.foldCase();
+    return str::to_wstring(folded);
+}
 
-    std::call_once(of_namesList, [=]{
-        auto locEng = icu::Locale::getEnglish();
-        std::vector<icu::UnicodeString> names;
+void BuildSearchIndex(DisplayNamesData& data)
+{
+    data.searchKeys.clear();
+    data.searchIndex.clear();
+    data.searchKeys.reserve(data.sortedNames.size());
+    for (auto& n: data.sortedNames)
+        data.searchKeys.push_back(FoldForSearch(str::to_icu(n)));
 
-        int32_t count;
-        const icu::Locale *loc = icu::Locale::getAvailableLocales(count);
-        names.reserve(count);
-        for (int i = 0; i < count; i++, loc++)
+    for (uint32_t i = 0; i < data.searchKeys.size(); i++)
+    {
+        auto& key = data.searchKeys[i];
+        for (uint32_t offset = 0; offset < key.size(); offset++)
         {
-            auto language = loc->getLanguage();
-            auto script = loc->getScript();
-            auto country = loc->getCountry();
-            auto variant = loc->getVariant();
+            if (key[offset] != ' ')
+                data.searchIndex.push_back({i, offset});
+        }
+    }
 
-            // TODO: for now, ignore variants here and in FormatForRoundtrip(),
-            //       because translating them between gettext and ICU is nontrivial
-            if (variant != nullptr && *variant != '\0')
-                continue;
+    auto& keys = data.searchKeys;
+    std::sort(data.searchIndex.begin(), data.searchIndex.end(),
+              [&keys](const DisplayNamesData::Suffix& a, const DisplayNamesData::Suffix& b){
+                  return wcscmp(keys[a.name].c_str() + a.offset, keys[b.name].c_str() + b.offset) < 0;
+              });
+}
 
-            icu::UnicodeString s;
-            loc->getDisplayName(s);
-            names.push_back(s);
+void BuildDisplayNamesData(DisplayNamesData& data)
+{
+    auto locEng = icu::Locale::getEnglish();
+    std::vector<icu::UnicodeString> names;
 
-            if (strcmp(language, "zh") == 0 && *country == '\0')
-            {
-                if (strcmp(script, "Hans") == 0)
-                    country = "CN";
-                else if (strcmp(script, "Hant") == 0)
-                    country = "TW";
-            }
+    int32_t count;
+    const icu::Locale *loc = icu::Locale::getAvailableLocales(count);
+    names.reserve(count);
+    for (int i = 0; i < count; i++, loc++)
+    {
+        auto language = loc->getLanguage();
+        auto script = loc->getScript();
+        auto country = loc->getCountry();
+        auto variant = loc->getVariant();
+
+        // TODO: for now, ignore variants here and in FormatForRoundtrip(),
+        //       because translating them between gettext and ICU is nontrivial
+        if (variant != nullptr && *variant != '\0')
+            continue;
+
+        icu::UnicodeString s;
+        loc->getDisplayName(s);
+        names.push_back(s);
+
+        if (strcmp(language, "zh") == 0 && *country == '\0')
+        {
+            if (strcmp(script, "Hans") == 0)
+                country = "CN";
+            else if (strcmp(script, "Hant") == 0)
+                country = "TW";
+        }
 
-            std::string code(language);
-            if (*country != '\0')
+        std::string code(language);
+        if (*country != '\0')
+        {
+            code += '_';
+            code += country;
+        }
+        if (*script != '\0')
+        {
+            if (strcmp(script, "Latn") == 0)
             {
-                code += '_';
-                code += country;
+                code += "@latin";
             }
-            if (*script != '\0')
+            else if (strcmp(script, "Cyrl") == 0)
             {
-                if (strcmp(script, "Latn") == 0)
-                {
-                    code += "@latin";
-                }
-                else if (strcmp(script, "Cyrl") == 0)
-                {
-                    // add @cyrillic only if it's not the default already
-                    if (strcmp(language, "sr") != 0)
-                        code += "@cyrillic";
-                }
+                // add @cyrillic only if it's not the default already
+                if (strcmp(language, "sr") != 0)
+                    code += "@cyrillic";
             }
-            
-            s.foldCase();
-            data.names[str::to_wstring(s)] = code;
-
-            loc->getDisplayName(locEng, s);
-            s.foldCase();
-            data.namesEng[str::to_wstring(s)] = code;
         }
+        
+        s.foldCase();
+        data.names[str::to_wstring(s)] = code;
+
+        loc->getDisplayName(locEng, s);
+        s.foldCase();
+        data.namesEng[str::to_wstring(s)] = code;
+    }
+
+    // sort the names alphabetically for data.sortedNames:
+    UErrorCode err = U_ZERO_ERROR;
+    std::unique_ptr<icu::Collator> coll(icu::Collator::createInstance(err));
+    if (coll)
+    {
+        coll->setStrength(icu::Collator::SECONDARY); // case insensitive
+
+        std::sort(names.begin(), names.end(),
+                  [&coll](const icu::UnicodeString& a, const icu::UnicodeString& b){
+                      UErrorCode e = U_ZERO_ERROR;
+                      return coll->compare(a, b, e) == UCOL_LESS;
+                  });
+    }
+    else
+    {
+        std::sort(names.begin(), names.end());
+    }
+
+    // convert into std::wstring
+    data.sortedNames.reserve(names.size());
+    for (auto s: names)
+        data.sortedNames.push_back(str::to_wstring(s));
+
+    BuildSearchIndex(data);
+}
+
+
+// Building DisplayNamesData is slow, so it is cached on disk, separately for
+// every UI language (the names are localized); it must be rebuilt whenever
+// ICU or the format changes.
+const uint32_t NAMES_CACHE_MAGIC = 0x474e4c50; // "PLNG"
+const uint32_t NAMES_CACHE_FORMAT_VERSION = 2;
+
+wxString GetDisplayNamesCacheFile()
+{
+    return GetUserCacheDir("Languages") + wxFILE_SEP_PATH +
+           wxString::Format("%s-icu%s.cache", icu::Locale::getDefault().getName(), U_ICU_VERSION);
+}
+
+std::string SerializeDisplayNamesData(const DisplayNamesData& data)
+{
+    std::string out;
+    auto u32 = [&out](uint32_t v){ out.append(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    auto str = [&out,&u32](const std::string& s){ u32(uint32_t(s.size())); out.append(s); };
 
-        // sort the names alphabetically for data.sortedNames:
-        UErrorCode err = U_ZERO_ERROR;
-        std::unique_ptr<icu::Collator> coll(icu::Collator::createInstance(err));
-        if (coll)
+    auto map = [&](const DisplayNamesData::Map& m)
+    {
+        u32(uint32_t(m.size()));
+        for (auto& i: m)
         {
-            coll->setStrength(icu::Collator::SECONDARY); // case insensitive
+            str(str::to_utf8(i.first));
+            str(i.second);
+        }
+    };
+
+    u32(NAMES_CACHE_MAGIC);
+    u32(NAMES_CACHE_FORMAT_VERSION);
+    map(data.names);
+    map(data.namesEng);
+    u32(uint32_t(data.sortedNames.size()));
+    for (auto& n: data.sortedNames)
+        str(str::to_utf8(n));
+    // searchKeys are parallel to sortedNames:
+    for (auto& k: data.searchKeys)
+        str(str::to_utf8(k));
+    u32(uint32_t(data.searchIndex.size()));
+    for (auto& i: data.searchIndex)
+    {
+        u32(i.name);
+        u32(i.offset);
+    }
+    return out;
+}
+
+bool LoadDisplayNamesData(DisplayNamesData& data, const wxString& filename)
+{
+    if (!wxFileName::FileExists(filename))
+        return false;
+
+    wxLogNull null;
+    MemoryMappedFile file(filename);
+    if (!file.IsOk())
+        return false;
+
+    const char *pos = file.data();
+    const char *end = pos + file.size();
+    bool ok = true;
 
-            std::sort(names.begin(), names.end(),
-                      [&coll](const icu::UnicodeString& a, const icu::UnicodeString& b){
-                          UErrorCode e = U_ZERO_ERROR;
-                          return coll->compare(a, b, e) == UCOL_LESS;
-                      });
+    auto u32 = [&]() -> uint32_t
+    {
+        uint32_t v = 0;
+        if (ok && size_t(end - pos) >= sizeof(v))
+        {
+            memcpy(&v, pos, sizeof(v));
+            pos += sizeof(v);
         }
         else
         {
-            std::sort(names.begin(), names.end());
+            ok = false;
+        }
+        return v;
+    };
+    auto str = [&]() -> std::string
+    {
+        const size_t len = u32();
+        if (!ok || size_t(end - pos) < len)
+        {
+            ok = false;
+            return std::string();
+        }
+        std::string s(pos, len);
+        pos += len;
+        return s;
+    };
+    // every entry takes at least 4 bytes, don't trust bogus counts:
+    auto count = [&]() -> size_t
+    {
+        const size_t c = u32();
+        if (size_t(end - pos) / 4 < c)
+            ok = false;
+        return ok ? c : 0;
+    };
+
+    auto map = [&](DisplayNamesData::Map& m)
+    {
+        const size_t c = count();
+        m.reserve(c);
+        for (size_t i = 0; i < c && ok; i++)
+        {
+            auto name = str::to_wstring(str());
+            m.emplace(std::move(name), str());
         }
+    };
+
+    if (u32() != NAMES_CACHE_MAGIC || u32() != NAMES_CACHE_FORMAT_VERSION)
+        return false;
+
+    DisplayNamesData loaded;
+    map(loaded.names);
+    map(loaded.namesEng);
+    const size_t sortedCount = count();
+    loaded.sortedNames.reserve(sortedCount);
+    for (size_t i = 0; i < sortedCount && ok; i++)
+        loaded.sortedNames.push_back(str::to_wstring(str()));
+    loaded.searchKeys.reserve(sortedCount);
+    for (size_t i = 0; i < sortedCount && ok; i++)
+        loaded.searchKeys.push_back(str::to_wstring(str()));
+    const size_t indexCount = count();
+    loaded.searchIndex.reserve(indexCount);
+    for (size_t i = 0; i < indexCount && ok; i++)
+    {
+        const uint32_t name = u32();
+        const uint32_t offset = u32();
+        if (name >= loaded.searchKeys.size() || offset >= loaded.searchKeys[name].size())
+            ok = false;
+        loaded.searchIndex.push_back({name, offset});
+    }
+
+    if (!ok || pos != end || loaded.names.empty())
+        return false;
+
+    data = std::move(loaded);
+    return true;
+}
+
+void SaveDisplayNamesData(const DisplayNamesData& data, const wxString& filename)
+{
+    // Writing is done in the background, failures are harmless:
+    dispatch::async(dispatch::priority::bulk, [filename, out = SerializeDisplayNamesData(data)]
+    {
+        wxLogNull null;
+        wxFileName fn(filename);
+        if (!fn.DirExists())
+            wxFileName::Mkdir(fn.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+        // write atomically, another Poedit instance may be reading it:
+        wxString tmp = filename + ".tmp";
+        bool written = false;
+        {
+            wxFFile f(tmp, "wb");
+            if (f.IsOpened())
+            {
+                written = f.Write(out.data(), out.size()) == out.size();
+                written = f.Close() && written;
+            }
+        }
+        if (!written || !wxRenameFile(tmp, filename, /*overwrite=*/true))
+            wxRemoveFile(tmp);
+    });
+}
+
+std::once_flag of_namesList;
+
+const DisplayNamesData& GetDisplayNamesData()
+{
+    static DisplayNamesData data;
+
+    std::call_once(of_namesList, [=]{
+        const wxString cacheFile = GetDisplayNamesCacheFile();
+        if (LoadDisplayNamesData(data, cacheFile))
+            return;
 
-        // convert into std::wstring
-        data.sortedNames.reserve(names.size());
-        for (auto s: names)
-            data.sortedNames.push_back(str::to_wstring(s));
+        BuildDisplayNamesData(data);
+        SaveDisplayNamesData(data, cacheFile);
     });
 
     return data;
@@ -258,6 +502,45 @@ bool DoIsRTL(const Language& lang)
 #endif
 }
 
+/**
+    Thread-safe memoization of results of parsing language codes.
+
+    Bulk operations such as TM import parse the same handful of codes over
+    and over again, so it makes sense to remember the (pure) results. The
+    number of entries is bounded, because arbitrary user input or filenames
+    are parsed too.
+ */
+template<typename T>
+class ParsingCache
+{
+public:
+    template<typename F>
+    T Get(const std::wstring& s, F&& compute)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto i = m_cache.find(s);
+            if (i != m_cache.end())
+                return i->second;
+        }
+
+        // compute outside of the lock, it's OK if it's done more than once
+        T value = compute(s);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cache.size() >= MAX_SIZE)
+            m_cache.clear();
+        m_cache.emplace(s, value);
+        return value;
+    }
+
+private:
+    static const size_t MAX_SIZE = 1000;
+
+    std::mutex m_mutex;
+    std::unordered_map<std::wstring, T> m_cache;
+};
+
 } // anonymous namespace
 
 
@@ -279,7 +562,11 @@ void Language::Init(const std::string& code)
 
 bool Language::IsValidCode(const std::wstring& s)
 {
-    return regex_match(s, RE_LANG_CODE);
+    static ParsingCache<bool> s_cache;
+    return s_cache.Get(s, [](const std::wstring& code)
+    {
+        return regex_match(code, RE_LANG_CODE);
+    });
 }
 
 std::string Language::Lang() const
@@ -316,55 +603,63 @@ std::string Language::Variant() const
 
 Language Language::TryParse(const std::wstring& s)
 {
-    if (IsValidCode(s))
-        return Language(s);
+    static ParsingCache<Language> s_cache;
+    return s_cache.Get(s, [](const std::wstring& s) -> Language
+    {
+        if (IsValidCode(s))
+            return Language(s);
 
-    if (s == "zh-Hans")
-        return Language("zh_CN");
-    else if (s == "zh-Hant")
-        return Language("zh_TW");
+        if (s == "zh-Hans")
+            return Language("zh_CN");
+        else if (s == "zh-Hant")
+            return Language("zh_TW");
 
-    // Is it a standard language code?
-    if (regex_match(s, RE_LANG_CODE_PERMISSIVE))
-    {
-        std::wstring s2(s);
-        TryNormalize(s2);
-        if (IsValidCode(s2))
-            return Language(s2);
-    }
+        // Is it a standard language code?
+        if (regex_match(s, RE_LANG_CODE_PERMISSIVE))
+        {
+            std::wstring s2(s);
+            TryNormalize(s2);
+            if (IsValidCode(s2))
+                return Language(s2);
+        }
 
-    // If not, perhaps it's a human-readable name (perhaps coming from the language control)?
-    auto names = GetDisplayNamesData();
-    icu::UnicodeString s_icu = str::to_icu(s);
-    s_icu.foldCase();
-    std::wstring folded = str::to_wstring(s_icu);
-    auto i = names.names.find(folded);
-    if (i != names.names.end())
-        return Language(i->second);
+        // If not, perhaps it's a human-readable name (perhaps coming from the language control)?
+        const auto& names = GetDisplayNamesData();
+        icu::UnicodeString s_icu = str::to_icu(s);
+        s_icu.foldCase();
+        std::wstring folded = str::to_wstring(s_icu);
+        auto i = names.names.find(folded);
+        if (i != names.names.end())
+            return Language(i->second);
 
-    // Maybe it was in English?
-    i = names.namesEng.find(folded);
-    if (i != names.namesEng.end())
-        return Language(i->second);
+        // Maybe it was in English?
+        i = names.namesEng.find(folded);
+        if (i != names.namesEng.end())
+            return Language(i->second);
 
-    return Language(); // invalid
+        return Language(); // invalid
+    });
 }
 
 
 Language Language::TryParseWithValidation(const std::wstring& s)
 {
-    Language lang = Language::TryParse(s);
-    if (!lang.IsValid())
-        return Language(); // invalid
+    static ParsingCache<Language> s_cache;
+    return s_cache.Get(s, [](const std::wstring& s) -> Language
+    {
+        Language lang = Language::TryParse(s);
+        if (!lang.IsValid())
+            return Language(); // invalid
 
-    if (!IsISOLanguage(lang.Lang()))
-        return Language(); // invalid
+        if (!IsISOLanguage(lang.Lang()))
+            return Language(); // invalid
 
-    auto country = lang.Country();
-    if (!country.empty() && !IsISOCountry(country))
-        return Language(); // invalid
+        auto country = lang.Country();
+        if (!country.empty() && !IsISOCountry(country))
+            return Language(); // invalid
 
-    return lang;
+        return lang;
+    });
 }
 
 
@@ -480,6 +775,53 @@ const std::vector<std::wstring>& Language::AllFormattedNames()
 }
 
 
+std::vector<std::wstring> Language::FindFormattedNames(const std::wstring& text)
+{
+    std::vector<std::wstring> found;
+
+    const std::wstring query = FoldForSearch(str::to_icu(text));
+    if (query.empty())
+        return found;
+
+    auto& data = GetDisplayNamesData();
+    auto& keys = data.searchKeys;
+    const size_t len = query.size();
+
+    // suffixes starting with the query form a contiguous range in the index:
+    auto suffix = [&keys](const DisplayNamesData::Suffix& x){ return keys[x.name].c_str() + x.offset; };
+    auto begin = std::lower_bound(data.searchIndex.begin(), data.searchIndex.end(), query,
+                                  [&](const DisplayNamesData::Suffix& x, const std::wstring& q){ return wcsncmp(suffix(x), q.c_str(), len) < 0; });
+    auto end = std::upper_bound(begin, data.searchIndex.end(), query,
+                                [&](const std::wstring& q, const DisplayNamesData::Suffix& x){ return wcsncmp(q.c_str(), suffix(x), len) < 0; });
+
+    // rank names that start with the query first, then those with a word
+    // starting with it, then the rest; keep the sort order otherwise:
+    const int NOT_FOUND = 3;
+    std::vector<int> rank(keys.size(), NOT_FOUND);
+    for (auto i = begin; i != end; ++i)
+    {
+        int r;
+        if (i->offset == 0)
+            r = 0;
+        else if (!u_isalnum(keys[i->name][i->offset - 1]))
+            r = 1;
+        else
+            r = 2;
+        rank[i->name] = std::min(rank[i->name], r);
+    }
+
+    for (int r = 0; r < NOT_FOUND; r++)
+    {
+        for (size_t i = 0; i < rank.size(); i++)
+        {
+            if (rank[i] == r)
+                found.push_back(data.sortedNames[i]);
+        }
+    }
+    return found;
+}
+
+
 Language Language::TryGuessFromFilename(const wxString& filename)
 {
     wxFileName fn(filename);
@@ -524,9 +866,13 @@ Language Language::TryGuessFromFilename(const wxString& filename)
 }
 
 
-Language Language::TryDetectFromText(const char *buffer, size_t len, Language probableLanguage)
-{
 #ifdef HAVE_CLD2
+
+namespace
+{
+
+Language DoDetectFromText(const char *buffer, size_t len, const Language& probableLanguage)
+{
     using namespace CLD2;
 
     CLDHints hints = {NULL, NULL, UNKNOWN_ENCODING, UNKNOWN_LANGUAGE};
@@ -569,6 +915,71 @@ Language Language::TryDetectFromText(const char *buffer, size_t len, Language pr
         lang = language3[0];
 
     return Language::TryParse(LanguageCode(lang));
+}
+
+// CLD2 doesn't need much text to reliably detect the language, so in large
+// files, only evenly distributed slices of the text are used:
+const size_t DETECTION_SAMPLE_SIZE = 64 * 1024;
+const size_t DETECTION_SAMPLE_SLICES = 64;
+
+std::string SampleTextForDetection(const char *buffer, size_t len)
+{
+    const size_t sliceSize = DETECTION_SAMPLE_SIZE / DETECTION_SAMPLE_SLICES;
+    auto isContinuationByte = [=](size_t pos){ return pos < len && (buffer[pos] & 0xC0) == 0x80; };
+
+    std::string sample;
+    sample.reserve(DETECTION_SAMPLE_SIZE + DETECTION_SAMPLE_SLICES);
+    for (size_t k = 0; k < DETECTION_SAMPLE_SLICES; k++)
+    {
+        // don't cut UTF-8 sequences in half:
+        size_t start = k * (len / DETECTION_SAMPLE_SLICES);
+        while (isContinuationByte(start))
+            start++;
+        size_t end = std::min(start + sliceSize, len);
+        while (end > start && isContinuationByte(end))
+            end--;
+        sample.append(buffer + start, end - start);
+        sample.append(1, '\n');
+    }
+    return sample;
+}
+
+} // anonymous namespace
+
+#endif // HAVE_CLD2
+
+
+Language Language::TryDetectFromText(const char *buffer, size_t len, Language probableLanguage)
+{
+#ifdef HAVE_CLD2
+    std::string sample;
+    if (len > DETECTION_SAMPLE_SIZE)
+    {
+        sample = SampleTextForDetection(buffer, len);
+        buffer = sample.data();
+        len = sample.size();
+    }
+
+    // The same file is often detected repeatedly, e.g. when reopened, so
+    // remember results for recently seen texts:
+    static std::mutex s_mutex;
+    static std::map<std::pair<size_t, std::string>, Language> s_cache;
+
+    const auto key = std::make_pair(std::hash<std::string>()(std::string(buffer, len)), probableLanguage.Code());
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto i = s_cache.find(key);
+        if (i != s_cache.end())
+            return i->second;
+    }
+
+    auto lang = DoDetectFromText(buffer, len, probableLanguage);
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_cache.size() >= 100)
+        s_cache.clear();
+    s_cache.emplace(key, lang);
+    return lang;
 #else
     (void)buffer;
     (void)len;
@@ -577,6 +988,39 @@ Language Language::TryDetectFromText(const char *buffer, size_t len, Language pr
 }
 
 
+namespace
+{
+
+// Normalizes plural forms expression so that insignificant differences in
+// whitespace don't matter:
+std::string normalize_plural_forms(std::string s)
+{
+    s.erase(std::remove_if(s.begin(), s.end(), [](char c){ return c == ' ' || c == '\t'; }), s.end());
+    return s;
+}
+
+// Returns calculator for the expression, shared by all PluralFormsExpr
+// instances with the same (normalized) expression in the process:
+std::shared_ptr<PluralFormsCalculator> get_interned_calculator(const std::string& expr)
+{
+    static std::mutex s_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<PluralFormsCalculator>> s_calculators;
+
+    auto key = normalize_plural_forms(expr);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto i = s_calculators.find(key);
+    if (i != s_calculators.end())
+        return i->second;
+
+    // invalid expressions are remembered too, as nullptr
+    auto calc = PluralFormsCalculator::make(key.c_str());
+    s_calculators.emplace(std::move(key), calc);
+    return calc;
+}
+
+} // anonymous namespace
+
+
 PluralFormsExpr::PluralFormsExpr() : m_calcCreated(true)
 {
 }
@@ -611,7 +1055,7 @@ std::shared_ptr<PluralFormsCalculator> PluralFormsExpr::calc() const
     if (m_calcCreated)
         return m_calc;
     if (!m_expr.empty())
-        self->m_calc = PluralFormsCalculator::make(m_expr.c_str());
+        self->m_calc = get_interned_calculator(m_expr);
     self->m_calcCreated = true;
     return m_calc;
 }
@@ -623,28 +1067,38 @@ bool PluralFormsExpr::operator==(const PluralFormsExpr& other) const
 
     // do some normalization to avoid unnecessary complains when the only
     // differences are in whitespace for example:
-    auto expr1 = boost::erase_all_copy(m_expr, " \t");
-    auto expr2 = boost::erase_all_copy(other.m_expr, " \t");
+    auto expr1 = normalize_plural_forms(m_expr);
+    auto expr2 = normalize_plural_forms(other.m_expr);
     if (expr1 == expr2)
         return true;
 
-    // failing that, compare the expressions semantically:
+    // Failing that, compare the expressions semantically. The same pairs of
+    // expressions are compared over and over (e.g. catalog's vs language's
+    // default), so remember the results:
+    static std::mutex s_cacheMutex;
+    static std::map<std::pair<std::string, std::string>, bool> s_cache;
+    auto key = expr1 < expr2 ? std::make_pair(expr1, expr2) : std::make_pair(expr2, expr1);
+    {
+        std::lock_guard<std::mutex> lock(s_cacheMutex);
+        auto cached = s_cache.find(key);
+        if (cached != s_cache.end())
+            return cached->second;
+    }
+
     auto calc1 = calc();
     auto calc2 = other.calc();
 
+    bool same;
     if (!calc1 || !calc2)
-        return false; // at least one is invalid _and_ the strings are different due to code above
-
-    if (calc1->nplurals() != calc2->nplurals())
-        return false;
+        same = false; // at least one is invalid _and_ the strings are different due to code above
+    else if (calc1->nplurals() != calc2->nplurals())
+        same = false;
+    else
+        same = calc1->sameResultsForSmallNumbers(*calc2); // i.e. on all tested integers
 
-    for (int i = 0; i < MAX_EXAMPLES_COUNT; i++)
-    {
-        if (calc1->evaluate(i) != calc2->evaluate(i))
-            return false;
-    }
-    // both expressions are identical on all tested integers
-    return true;
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+    s_cache.emplace(std::move(key), same);
+    return same;
 }
 
 int PluralFormsExpr::evaluate_for_n(int n) const
@@ -95,6 +95,13 @@ public:
      */
     static const std::vector<std::wstring>& AllFormattedNames();
 
+    /**
+        Return formatted language names (see AllFormattedNames()) containing
+        @a text, ignoring case and diacritics. Names starting with @a text
+        come first, followed by names with a word starting with it.
+     */
+    static std::vector<std::wstring> FindFormattedNames(const std::wstring& text);
+
     /**
         Return appropriate plural form for this language.
 
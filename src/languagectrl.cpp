@@ -31,6 +31,7 @@
 #include <wx/config.h>
 #include <wx/sizer.h>
 #include <wx/stattext.h>
+#include <wx/textcompleter.h>
 
 #ifdef __WXOSX__
 
@@ -80,14 +81,17 @@
 - (NSString *)comboBox:(NSComboBox *)aComboBox completedString:(NSString *)string;
 {
     #pragma unused(aComboBox)
-    for (NSString *item in self.items) {
-        if ([item compare:string
-                  options:NSCaseInsensitiveSearch|NSDiacriticInsensitiveSearch
-                    range:NSMakeRange(0, std::min([item length], [string length]))
-                   locale:[NSLocale currentLocale]] == NSOrderedSame)
-        {
-            return item;
-        }
+    // names starting with the string, if any, come first:
+    auto found = Language::FindFormattedNames(str::to_wstring(string));
+    if (found.empty())
+        return nil;
+    NSString *item = str::to_NS(found.front());
+    if ([item compare:string
+              options:NSCaseInsensitiveSearch|NSDiacriticInsensitiveSearch
+                range:NSMakeRange(0, std::min([item length], [string length]))
+               locale:[NSLocale currentLocale]] == NSOrderedSame)
+    {
+        return item;
     }
     return nil;
 }
@@ -117,6 +121,37 @@ wxString LanguageCtrl::GetString(unsigned int n) const
     return m_impl->items->Item(n);
 }
 
+#else // !__WXOSX__
+
+namespace
+{
+
+// Completes language names using the search index, i.e. also matching
+// words in the middle of the name and ignoring diacritics
+class LanguageCompleter : public wxTextCompleter
+{
+public:
+    bool Start(const wxString& prefix) override
+    {
+        m_found = Language::FindFormattedNames(prefix.ToStdWstring());
+        m_next = 0;
+        return !m_found.empty();
+    }
+
+    wxString GetNext() override
+    {
+        if (m_next >= m_found.size())
+            return wxString();
+        return m_found[m_next++];
+    }
+
+private:
+    std::vector<std::wstring> m_found;
+    size_t m_next = 0;
+};
+
+} // anonymous namespace
+
 #endif // __WXOSX__
 
 
@@ -158,7 +193,7 @@ void LanguageCtrl::Init(Language lang)
     cb.dataSource = m_impl->dataSource;
 #else
     Set(choices);
-    AutoComplete(choices);
+    AutoComplete(new LanguageCompleter);
 #endif
 
     m_inited = true;
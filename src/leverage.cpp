@@ -0,0 +1,172 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "leverage.h"
+
+#include "str_helpers.h"
+#include "tm/transmem.h"
+#include "tracing.h"
+#include "word_count.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace
+{
+
+// Number of distinct strings searched in the TM together, see TranslationMemory::SearchBatch()
+const size_t LEVERAGE_BATCH_SIZE = 50;
+
+/// Source texts of an item, copied for processing in the background
+struct SourceText
+{
+    std::string text;
+    std::string plural;
+};
+
+} // anonymous namespace
+
+
+TMLeverage::Counts TMLeverage::GetTotal() const
+{
+    Counts total;
+    for (auto& b: bands)
+        total.Add(b);
+    total.Add(repetitions);
+    return total;
+}
+
+
+TMLeverage::Band TMLeverage::GetBand(double score)
+{
+    if (score >= 1.0)
+        return Exact;
+    else if (score >= 0.95)
+        return Fuzzy95;
+    else if (score >= 0.85)
+        return Fuzzy85;
+    else if (score >= 0.75)
+        return Fuzzy75;
+    else
+        return NoMatch;
+}
+
+
+const char *TMLeverage::GetBandId(Band band)
+{
+    switch (band)
+    {
+        case Exact:
+            return "exact";
+        case Fuzzy95:
+            return "95-99";
+        case Fuzzy85:
+            return "85-94";
+        case Fuzzy75:
+            return "75-84";
+        case NoMatch:
+        case BandsCount:
+            break;
+    }
+    return "none";
+}
+
+
+dispatch::future<TMLeverage> TMLeverage::Compute(const CatalogPtr& catalog)
+{
+    const auto srclang = catalog->GetSourceLanguage();
+    const auto lang = catalog->GetLanguage();
+
+    auto sources = std::make_shared<std::vector<SourceText>>();
+    for (auto& item: catalog->items())
+    {
+        if (item->IsTranslated() && !item->IsFuzzy())
+            continue;
+        sources->push_back({item->GetStringUTF8(), item->HasPlural() ? item->GetPluralStringUTF8() : std::string()});
+    }
+
+    return dispatch::async(dispatch::priority::bulk, [srclang, lang, sources]
+    {
+        TRACE_SCOPE("TMLeverage::Compute");
+
+        // Distinct source texts are searched for only once, with the rest of
+        // their occurrences counted as repetitions:
+        std::vector<std::wstring> unique;
+        std::vector<std::vector<size_t>> occurrences;
+        {
+            std::unordered_map<std::string, size_t> index;
+            index.reserve(sources->size());
+            for (size_t i = 0; i < sources->size(); i++)
+            {
+                auto& text = (*sources)[i].text;
+                auto r = index.emplace(text, unique.size());
+                if (r.second)
+                {
+                    unique.push_back(str::to_wstring(text));
+                    occurrences.emplace_back();
+                }
+                occurrences[r.first->second].push_back(i);
+            }
+        }
+
+        TMLeverage result;
+        std::mutex resultMutex;
+
+        // Search the TM in batches, with the workers taking them in turn, as
+        // pre-translation does:
+        dispatch::parallel_options options;
+        options.chunk_size = LEVERAGE_BATCH_SIZE;
+        options.prio = dispatch::priority::bulk;
+        dispatch::parallel_for_chunks(0, unique.size(), [&](size_t begin, size_t end)
+        {
+            const std::vector<std::wstring> texts(unique.begin() + begin, unique.begin() + end);
+            auto found = TranslationMemory::Get().SearchBatchCached(srclang, lang, texts);
+
+            TMLeverage partial;
+            for (size_t i = begin; i < end; i++)
+            {
+                auto& matches = found[i - begin];
+                const Band band = matches.empty() ? NoMatch : GetBand(matches.front().score);
+
+                auto& occ = occurrences[i];
+                const int words = (int)CountText(srclang, (*sources)[occ.front()].text).words;
+                for (size_t o = 0; o < occ.size(); o++)
+                {
+                    auto& counts = (o == 0) ? partial.bands[band] : partial.repetitions;
+                    counts.Add(words + (int)CountText(srclang, (*sources)[occ[o]].plural).words);
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(resultMutex);
+            for (int b = 0; b < BandsCount; b++)
+                result.bands[b].Add(partial.bands[b]);
+            result.repetitions.Add(partial.repetitions);
+        }, options);
+
+        return result;
+    });
+}
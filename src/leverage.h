@@ -0,0 +1,90 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_leverage_h
+#define Poedit_leverage_h
+
+#include "catalog.h"
+#include "concurrency.h"
+
+
+/**
+    Analysis of how much of a catalog's remaining work the TM already covers.
+
+    Untranslated and fuzzy items are counted in bands by the score of their
+    best TM match, with word counts of their source texts (including plural
+    forms), as is common in CAT tools when estimating work. Each distinct
+    source text is counted in a band only once; its further occurrences are
+    counted as repetitions.
+ */
+struct TMLeverage
+{
+    enum Band
+    {
+        Exact,      ///< 100% match
+        Fuzzy95,    ///< 95-99%, including matches differing only in numbers etc.
+        Fuzzy85,    ///< 85-94%
+        Fuzzy75,    ///< 75-84%
+        NoMatch,    ///< no match or a worse one
+        BandsCount
+    };
+
+    struct Counts
+    {
+        int strings = 0;
+        int words = 0;
+
+        void Add(int w) { strings++; words += w; }
+        void Add(const Counts& c) { strings += c.strings; words += c.words; }
+    };
+
+    /// Counts of distinct source texts in each band
+    Counts bands[BandsCount];
+    /// Further occurrences of already counted source texts
+    Counts repetitions;
+
+    /// Returns the total of all bands and repetitions
+    Counts GetTotal() const;
+
+    /// Returns the band a match with @a score falls into
+    static Band GetBand(double score);
+
+    /// Returns the band's non-translatable identifier, e.g. "85-94"
+    static const char *GetBandId(Band band);
+
+    /**
+        Computes the analysis of @a catalog in the background.
+
+        The items are copied on the calling thread, so the catalog may be
+        modified while the analysis runs, but this must be called on the
+        thread that modifies it. TM lookups are done in batches, reusing and
+        filling SuggestionsCache, so that it's fast even for big catalogs.
+
+        The returned future throws if the TM can't be searched.
+     */
+    static dispatch::future<TMLeverage> Compute(const CatalogPtr& catalog);
+};
+
+#endif // Poedit_leverage_h
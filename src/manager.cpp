@@ -23,6 +23,8 @@
  *
  */
 
+#include <algorithm>
+
 #include <wx/imaglist.h>
 #include <wx/config.h>
 #include <wx/textctrl.h>
@@ -40,6 +42,7 @@
 #include <wx/dir.h>
 #include <wx/imaglist.h>
 #include <wx/dirdlg.h>
+#include <wx/filename.h>
 #include <wx/log.h>
 #include <wx/artprov.h>
 #include <wx/iconbndl.h>
@@ -51,7 +54,9 @@
 #endif
 
 #include "catalog.h"
+#include "catalog_po.h"
 #include "cat_update.h"
+#include "concurrency.h"
 #include "edapp.h"
 #include "edframe.h"
 #include "hidpi.h"
@@ -59,6 +64,8 @@
 #include "progressinfo.h"
 #include "utility.h"
 
+#include <set>
+
 
 ManagerFrame *ManagerFrame::ms_instance = NULL;
 
@@ -90,6 +97,8 @@ ManagerFrame::ManagerFrame() :
 
     ms_instance = this;
 
+    wxGetApp().LoadXmlResources("manager.xrc");
+
     auto tb = wxXmlResource::Get()->LoadToolBar(this, "manager_toolbar");
     (void)tb;
 #ifdef __WXMSW__
@@ -117,6 +126,8 @@ ManagerFrame::ManagerFrame() :
     m_listCat->AssignImageList(list, wxIMAGE_LIST_SMALL);
 
     m_curPrj = -1;
+    m_statsGeneration = 0;
+    m_statsPending = 0;
 
     int last = (int)wxConfig::Get()->Read("manager_last_selected", (long)0);
 
@@ -179,76 +190,138 @@ void ManagerFrame::UpdateListPrj(int select)
 }
 
 
-static void AddCatalogToList(wxListCtrl *list, int i, int id, const wxString& file)
+namespace
 {
-    wxConfigBase *cfg = wxConfig::Get();
-    int all = 0, fuzzy = 0, untranslated = 0, badtokens = 0;
+
+struct CatalogStats
+{
+    CatalogStats() : ok(false), all(0), fuzzy(0), untranslated(0), badtokens(0), unfinishedWords(0), modtime(0) {}
+
+    bool ok;
+    int all, fuzzy, untranslated, badtokens;
+    int unfinishedWords;
     wxString lastmodified;
+    // identification of the file's version the statistics are for:
     time_t modtime;
-    wxString key;
+    wxString size;
+};
+
+wxString GetFileSizeString(const wxString& file)
+{
+    return wxFileName::GetSize(file).ToString();
+}
+
+wxString GetStatsCacheKey(int id, const wxString& file)
+{
     wxString file2(file);
     file2.Replace("/", "_");
     file2.Replace("\\", "_");
     // FIXME: move cache to cache file and out of *config* file!
+    wxString key;
     key.Printf("Manager/project_%i/FilesCache/%s/", id, file2.c_str());
+    return key;
+}
 
-    modtime = cfg->Read(key + "timestamp", (long)0);
-
-    if (modtime == wxFileModificationTime(file))
+// Reads statistics cached in the config, if they are still up to date,
+// i.e. the file's modification time and size didn't change.
+CatalogStats ReadCachedStats(const wxString& key, const wxString& file)
+{
+    wxConfigBase *cfg = wxConfig::Get();
+    CatalogStats s;
+    s.modtime = cfg->Read(key + "timestamp", (long)0);
+    s.size = cfg->Read(key + "size", wxEmptyString);
+    long unfinishedWords;
+    // stats cached by older versions don't have word counts and must be rescanned:
+    if (s.modtime == wxFileModificationTime(file) && s.size == GetFileSizeString(file) &&
+        cfg->Read(key + "unfinishedwords", &unfinishedWords))
     {
-        all = (int)cfg->Read(key + "all", (long)0);
-        fuzzy = (int)cfg->Read(key + "fuzzy", (long)0);
-        badtokens = (int)cfg->Read(key + "badtokens", (long)0);
-        untranslated = (int)cfg->Read(key + "untranslated", (long)0);
-        lastmodified = cfg->Read(key + "lastmodified", "?");
+        s.ok = true;
+        s.all = (int)cfg->Read(key + "all", (long)0);
+        s.fuzzy = (int)cfg->Read(key + "fuzzy", (long)0);
+        s.badtokens = (int)cfg->Read(key + "badtokens", (long)0);
+        s.untranslated = (int)cfg->Read(key + "untranslated", (long)0);
+        s.unfinishedWords = (int)unfinishedWords;
+        s.lastmodified = cfg->Read(key + "lastmodified", "?");
     }
-    else
+    return s;
+}
+
+void WriteCachedStats(const wxString& key, const CatalogStats& s)
+{
+    wxConfigBase *cfg = wxConfig::Get();
+    cfg->Write(key + "timestamp", (long)s.modtime);
+    cfg->Write(key + "size", s.size);
+    cfg->Write(key + "all", (long)s.all);
+    cfg->Write(key + "fuzzy", (long)s.fuzzy);
+    cfg->Write(key + "badtokens", (long)s.badtokens);
+    cfg->Write(key + "untranslated", (long)s.untranslated);
+    cfg->Write(key + "unfinishedwords", (long)s.unfinishedWords);
+    cfg->Write(key + "lastmodified", s.lastmodified);
+}
+
+void InvalidateCachedStats(const wxString& key)
+{
+    wxConfig::Get()->DeleteEntry(key + "timestamp");
+}
+
+// Scans the file to get its statistics; doesn't touch the config or UI,
+// so can be called from any thread.
+CatalogStats LoadStats(const wxString& file)
+{
+    // FIXME: *do* indicate errors in corrupted catalogs somehow
+    CatalogStats s;
+    s.modtime = wxFileModificationTime(file);
+    s.size = GetFileSizeString(file);
+
+    POCatalog::Statistics scanned;
+    if (POCatalog::ScanStatistics(file, scanned))
     {
-        // suppress error messages, we don't mind if the catalog is corrupted
-        // FIXME: *do* indicate error somehow
-        wxLogNull nullLog;
-
-        // FIXME: don't re-load the catalog if it's already loaded in the
-        //        editor, reuse loaded instance
-        auto cat = Catalog::Create(file);
-        if (cat)
-        {
-            cat->GetStatistics(&all, &fuzzy, &badtokens, &untranslated, NULL);
-            modtime = wxFileModificationTime(file);
-            lastmodified = cat->Header().RevisionDate;
-            cfg->Write(key + "timestamp", (long)modtime);
-            cfg->Write(key + "all", (long)all);
-            cfg->Write(key + "fuzzy", (long)fuzzy);
-            cfg->Write(key + "badtokens", (long)badtokens);
-            cfg->Write(key + "untranslated", (long)untranslated);
-            cfg->Write(key + "lastmodified", lastmodified);
-        }
+        s.all = scanned.all;
+        s.fuzzy = scanned.fuzzy;
+        s.untranslated = scanned.untranslated;
+        s.unfinishedWords = scanned.unfinishedWords;
+        s.lastmodified = scanned.revisionDate;
+        s.ok = true;
     }
+    return s;
+}
 
+void SetCatalogStatsInList(wxListCtrl *list, int i, const CatalogStats& s)
+{
     int icon;
-    if (fuzzy+untranslated+badtokens == 0) icon = 2;
-    else if ((double)all / (fuzzy+untranslated+badtokens) <= 3) icon = 0;
+    if (s.fuzzy+s.untranslated+s.badtokens == 0) icon = 2;
+    else if ((double)s.all / (s.fuzzy+s.untranslated+s.badtokens) <= 3) icon = 0;
     else icon = 1;
 
     wxString tmp;
-    // FIXME: don't put full filename there, remove common prefix (of all
-    //        directories in project's settings)
-    list->InsertItem(i, file, icon);
-    tmp.Printf("%i", all);
+    list->SetItemImage(i, icon);
+    tmp.Printf("%i", s.all);
     list->SetItem(i, 1, tmp);
-    tmp.Printf("%i", untranslated);
+    tmp.Printf("%i", s.untranslated);
     list->SetItem(i, 2, tmp);
-    tmp.Printf("%i", fuzzy);
+    tmp.Printf("%i", s.fuzzy);
     list->SetItem(i, 3, tmp);
-    tmp.Printf("%i", badtokens);
+    tmp.Printf("%i", s.badtokens);
     list->SetItem(i, 4, tmp);
-    list->SetItem(i, 5, lastmodified);
+    tmp.Printf("%i", s.unfinishedWords);
+    list->SetItem(i, 5, tmp);
+    list->SetItem(i, 6, s.lastmodified);
 }
 
-void ManagerFrame::UpdateListCat(int id)
+void AddCatalogToList(wxListCtrl *list, int i, const wxString& file)
 {
-    wxBusyCursor bcur;
+    // FIXME: don't put full filename there, remove common prefix (of all
+    //        directories in project's settings)
+    list->InsertItem(i, file, -1);
+    // statistics are filled in by SetCatalogStatsInList() when known:
+    for (int col = 1; col <= 6; col++)
+        list->SetItem(i, col, L"…");
+}
+
+} // anonymous namespace
 
+void ManagerFrame::UpdateListCat(int id)
+{
     if (id == -1) id = m_curPrj;
 
     wxConfigBase *cfg = wxConfig::Get();
@@ -259,11 +332,6 @@ void ManagerFrame::UpdateListCat(int id)
     wxStringTokenizer tkn(dirs, wxPATH_SEP);
 
     m_catalogs.Clear();
-    while (tkn.HasMoreTokens())
-        wxDir::GetAllFiles(tkn.GetNextToken(), &m_catalogs,
-                           "*.po", wxDIR_FILES | wxDIR_DIRS);
-
-    m_catalogs.Sort();
 
     m_listCat->Freeze();
 
@@ -273,21 +341,113 @@ void ManagerFrame::UpdateListCat(int id)
     m_listCat->InsertColumn(2, _("Untrans"));
     m_listCat->InsertColumn(3, _("Needs Work"));
     m_listCat->InsertColumn(4, _("Errors"));
-    m_listCat->InsertColumn(5, _("Last modified"));
+    m_listCat->InsertColumn(5, _("Words Left"));
+    m_listCat->InsertColumn(6, _("Last modified"));
+    AutoSizeListCatColumns();
+
+    m_listCat->Thaw();
+
+    // Both enumerating the directories (which may be slow network shares) and
+    // loading catalogs is time-consuming, so it's done in the background and
+    // the list is filled progressively as the results arrive. The config and
+    // UI are only accessed from the main thread.
+    const unsigned generation = ++m_statsGeneration;
+    m_statsPending = 0;
+
+    while (tkn.HasMoreTokens())
+    {
+        const wxString dir = tkn.GetNextToken();
+        dispatch::async([dir]
+        {
+            wxLogNull null;
+            wxArrayString files;
+            if (wxDir::Exists(dir))
+                wxDir::GetAllFiles(dir, &files, "*.po", wxDIR_FILES | wxDIR_DIRS);
+            files.Sort();
+            return files;
+        })
+        .then_on_window(this, [=](wxArrayString files)
+        {
+            // ignore results for a list that was already refreshed:
+            if (generation == m_statsGeneration)
+                AddCatalogsToList(id, files);
+        });
+    }
+}
+
+
+void ManagerFrame::AddCatalogsToList(int id, const wxArrayString& files)
+{
+    m_listCat->Freeze();
+
+    // m_catalogs is kept sorted, with the same order as rows in m_listCat:
+    for (auto& file: files)
+    {
+        auto pos = std::lower_bound(m_catalogs.begin(), m_catalogs.end(), file);
+        if (pos != m_catalogs.end() && *pos == file)
+            continue; // in more than one of the project's directories
+        const int row = int(pos - m_catalogs.begin());
+        m_catalogs.Insert(file, row);
+        AddCatalogToList(m_listCat, row, file);
+
+        const wxString key = GetStatsCacheKey(id, file);
+        auto cached = ReadCachedStats(key, file);
+        if (cached.ok)
+            SetCatalogStatsInList(m_listCat, row, cached);
+        else
+            LoadStatsInBackground(file, key);
+    }
+
+    AutoSizeListCatColumns();
 
-    // FIXME: this is time-consuming, it should be done in parallel on
-    //        multi-core/SMP systems
-    for (int i = 0; i < (int)m_catalogs.GetCount(); i++)
-        AddCatalogToList(m_listCat, i, id, m_catalogs[i]);
+    m_listCat->Thaw();
+}
 
+
+int ManagerFrame::FindCatalogRow(const wxString& file) const
+{
+    auto pos = std::lower_bound(m_catalogs.begin(), m_catalogs.end(), file);
+    if (pos == m_catalogs.end() || *pos != file)
+        return -1;
+    return int(pos - m_catalogs.begin());
+}
+
+
+void ManagerFrame::LoadStatsInBackground(const wxString& file, const wxString& key)
+{
+    const unsigned generation = m_statsGeneration;
+    m_statsPending++;
+
+    dispatch::async([file]
+    {
+        return LoadStats(file);
+    })
+    .then_on_window(this, [=](CatalogStats stats)
+    {
+        // ignore results for a list that was already refreshed:
+        if (generation != m_statsGeneration)
+            return;
+        if (stats.ok)
+            WriteCachedStats(key, stats);
+        // rows may have moved as more files were added to the list:
+        const int row = FindCatalogRow(file);
+        if (row != -1)
+            SetCatalogStatsInList(m_listCat, row, stats);
+        if (--m_statsPending == 0)
+            AutoSizeListCatColumns();
+    });
+}
+
+
+void ManagerFrame::AutoSizeListCatColumns()
+{
     m_listCat->SetColumnWidth(0, wxLIST_AUTOSIZE);
     m_listCat->SetColumnWidth(1, wxLIST_AUTOSIZE_USEHEADER);
     m_listCat->SetColumnWidth(2, wxLIST_AUTOSIZE_USEHEADER);
     m_listCat->SetColumnWidth(3, wxLIST_AUTOSIZE_USEHEADER);
     m_listCat->SetColumnWidth(4, wxLIST_AUTOSIZE_USEHEADER);
-    m_listCat->SetColumnWidth(5, wxLIST_AUTOSIZE);
-
-    m_listCat->Thaw();
+    m_listCat->SetColumnWidth(5, wxLIST_AUTOSIZE_USEHEADER);
+    m_listCat->SetColumnWidth(6, wxLIST_AUTOSIZE);
 }
 
 
@@ -371,12 +531,76 @@ void ManagerFrame::DeleteProject(int id)
     if (id == m_curPrj)
     {
         m_listCat->ClearAll();
+        m_catalogs.Clear();
+        m_statsGeneration++;
         m_curPrj = -1;
     }
 }
 
-void ManagerFrame::NotifyFileChanged(const wxString& /*catalog*/)
+/*static*/ wxArrayString ManagerFrame::GetProjectSiblings(const wxString& catalog)
 {
+    wxFileName catalogFn(catalog);
+    catalogFn.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE | wxPATH_NORM_LONG);
+    const wxString catalogPath = catalogFn.GetFullPath();
+
+    wxConfigBase *cfg = wxConfig::Get();
+    long max = cfg->Read("Manager/max_project_num", (long)0) + 1;
+    wxString key;
+
+    wxArrayString siblings;
+    std::set<wxString> known;
+    for (int i = 0; i <= max; i++)
+    {
+        key.Printf("Manager/project_%i/", i);
+        if (cfg->Read(key + "Name", wxEmptyString).empty())
+            continue;
+
+        wxArrayString dirs;
+        bool inProject = false;
+        wxStringTokenizer tkn(cfg->Read(key + "Dirs", wxEmptyString), wxPATH_SEP);
+        while (tkn.HasMoreTokens())
+        {
+            auto dir = wxFileName::DirName(tkn.GetNextToken());
+            dir.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE | wxPATH_NORM_LONG);
+            dirs.push_back(dir.GetFullPath());
+            if (catalogPath.StartsWith(dirs.back()))
+                inProject = true;
+        }
+        if (!inProject)
+            continue;
+
+        wxArrayString files;
+        for (auto& dir: dirs)
+            wxDir::GetAllFiles(dir, &files, "*.po", wxDIR_FILES | wxDIR_DIRS);
+        for (auto& f: files)
+        {
+            wxFileName fn(f);
+            fn.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE | wxPATH_NORM_LONG);
+            if (fn != catalogFn && known.insert(fn.GetFullPath()).second)
+                siblings.push_back(fn.GetFullPath());
+        }
+    }
+
+    return siblings;
+}
+
+void ManagerFrame::NotifyFileChanged(const wxString& catalog)
+{
+    // If the file is already listed, only its statistics need updating:
+    if (m_curPrj != -1)
+    {
+        const wxFileName fn(catalog);
+        for (size_t i = 0; i < m_catalogs.GetCount(); i++)
+        {
+            if (!fn.SameAs(wxFileName(m_catalogs[i])))
+                continue;
+            const wxString key = GetStatsCacheKey(m_curPrj, m_catalogs[i]);
+            InvalidateCachedStats(key);
+            LoadStatsInBackground(m_catalogs[i], key);
+            return;
+        }
+    }
+
    // VS: We must do full update even if the file 'catalog' is not in
    //     m_catalogs. The reason is simple: the user might use SaveAs
    //     function and save new file in one of directories that
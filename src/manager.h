@@ -54,6 +54,12 @@ class ManagerFrame : public wxFrame
          */
         void NotifyFileChanged(const wxString& catalog);
 
+        /** Returns all catalogs in the projects that @a catalog's directory
+            is part of, except @a catalog itself. Doesn't need an instance
+            and may be called from any thread.
+         */
+        static wxArrayString GetProjectSiblings(const wxString& catalog);
+
     private:
         ManagerFrame();
         ~ManagerFrame();
@@ -71,6 +77,13 @@ class ManagerFrame : public wxFrame
         void UpdateListPrj(int select = 0);
         /// Updates catalogs list for given project
         void UpdateListCat(int id = -1);
+        /// Adds (sorted) @a files of project @a id to the catalogs list
+        void AddCatalogsToList(int id, const wxArrayString& files);
+        /// Returns index of @a file in m_catalogs and m_listCat or -1
+        int FindCatalogRow(const wxString& file) const;
+        /// Loads statistics of @a file and fills them in the list
+        void LoadStatsInBackground(const wxString& file, const wxString& key);
+        void AutoSizeListCatColumns();
         
         DECLARE_EVENT_TABLE()
         void OnNewProject(wxCommandEvent& event);
@@ -86,6 +99,10 @@ class ManagerFrame : public wxFrame
         wxSplitterWindow *m_splitter;
         wxArrayString m_catalogs;
         int m_curPrj;
+        // identifies current content of m_listCat for background loading
+        // of statistics and the number of catalogs still being loaded:
+        unsigned m_statsGeneration;
+        size_t m_statsPending;
 
         static ManagerFrame *ms_instance;
 };
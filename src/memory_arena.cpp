@@ -0,0 +1,57 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "memory_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+
+MemoryArena::MemoryArena(size_t blockSize)
+    : m_blockSize(blockSize), m_pos(nullptr), m_available(0)
+{
+}
+
+
+void *MemoryArena::Allocate(size_t size, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto padding = (alignment - reinterpret_cast<uintptr_t>(m_pos) % alignment) % alignment;
+    if (!m_pos || padding + size > m_available)
+    {
+        // unusually large objects get a block of their own:
+        auto blockSize = std::max(m_blockSize, size + alignment);
+        m_blocks.emplace_back(new char[blockSize]);
+        m_pos = m_blocks.back().get();
+        m_available = blockSize;
+        padding = (alignment - reinterpret_cast<uintptr_t>(m_pos) % alignment) % alignment;
+    }
+
+    auto ptr = m_pos + padding;
+    m_pos = ptr + size;
+    m_available -= padding + size;
+    return ptr;
+}
@@ -0,0 +1,97 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_memory_arena_h
+#define Poedit_memory_arena_h
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/**
+    Simple bump allocator for many small objects with similar lifetime.
+
+    Objects are laid out contiguously in allocation order and the memory is
+    only released, all at once, when the arena is destroyed. Individual
+    deallocations are no-ops.
+ */
+class MemoryArena
+{
+public:
+    explicit MemoryArena(size_t blockSize = 64 * 1024);
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    /// Allocates @a size bytes aligned to @a alignment. Thread-safe.
+    void *Allocate(size_t size, size_t alignment);
+
+private:
+    std::mutex m_mutex;
+    size_t m_blockSize;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char *m_pos;
+    size_t m_available;
+};
+
+
+/**
+    Standard allocator that takes memory from a MemoryArena.
+
+    Every copy of the allocator keeps the arena alive, which makes it
+    suitable for std::allocate_shared(): the arena is freed only after all
+    objects allocated from it are destroyed.
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(std::shared_ptr<MemoryArena> arena) : m_arena(std::move(arena)) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T*>(m_arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}  // freed together with the arena
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+private:
+    std::shared_ptr<MemoryArena> m_arena;
+
+    template<typename U> friend class ArenaAllocator;
+};
+
+#endif // Poedit_memory_arena_h
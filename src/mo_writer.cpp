@@ -0,0 +1,194 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "mo_writer.h"
+
+#include <wx/ffile.h>
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+
+namespace
+{
+
+const uint32_t MO_MAGIC = 0x950412de;
+const size_t MO_HEADER_SIZE = 7 * sizeof(uint32_t);
+
+// The hash function used by gettext (hashpjw), must be compatible with it.
+// Note that it stops at the first \0, i.e. plural forms are not hashed.
+uint32_t HashString(const char *str)
+{
+    uint32_t hval = 0;
+    while (*str != '\0')
+    {
+        hval <<= 4;
+        hval += (unsigned char)*str++;
+        const uint32_t g = hval & ((uint32_t)0xf << 28);
+        if (g != 0)
+        {
+            hval ^= g >> 24;
+            hval ^= g;
+        }
+    }
+    return hval;
+}
+
+bool IsPrime(uint32_t n)
+{
+    if (n < 4)
+        return n > 1;
+    if (n % 2 == 0)
+        return false;
+    for (uint32_t d = 3; d * d <= n; d += 2)
+    {
+        if (n % d == 0)
+            return false;
+    }
+    return true;
+}
+
+uint32_t NextPrime(uint32_t n)
+{
+    n |= 1;
+    while (!IsPrime(n))
+        n += 2;
+    return n;
+}
+
+inline void Append(std::string& out, uint32_t value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} // anonymous namespace
+
+
+void MOWriter::Add(const std::string& msgid, const std::string& msgstr)
+{
+    m_messages.push_back({msgid, msgstr});
+}
+
+
+std::string MOWriter::Serialize() const
+{
+    // Originals must be sorted for binary search lookup; duplicates are not
+    // permitted (msgfmt would refuse them), keep the first one:
+    std::vector<const Message*> messages;
+    messages.reserve(m_messages.size());
+    for (auto& m: m_messages)
+        messages.push_back(&m);
+    std::stable_sort(messages.begin(), messages.end(),
+                     [](const Message *a, const Message *b){ return a->msgid < b->msgid; });
+    messages.erase(std::unique(messages.begin(), messages.end(),
+                               [](const Message *a, const Message *b){ return a->msgid == b->msgid; }),
+                   messages.end());
+
+    const uint32_t count = (uint32_t)messages.size();
+
+    // Same hash table size as msgfmt uses:
+    uint32_t hashSize = NextPrime((count * 4) / 3);
+    if (hashSize <= 2)
+        hashSize = 3;
+
+    std::vector<uint32_t> hashTable(hashSize, 0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t hval = HashString(messages[i]->msgid.c_str());
+        uint32_t idx = hval % hashSize;
+        if (hashTable[idx] != 0)
+        {
+            const uint32_t incr = 1 + (hval % (hashSize - 2));
+            do
+            {
+                if (idx >= hashSize - incr)
+                    idx -= hashSize - incr;
+                else
+                    idx += incr;
+            }
+            while (hashTable[idx] != 0);
+        }
+        hashTable[idx] = i + 1;
+    }
+
+    const uint32_t origTableOffset = (uint32_t)MO_HEADER_SIZE;
+    const uint32_t transTableOffset = origTableOffset + count * 2 * sizeof(uint32_t);
+    const uint32_t hashTableOffset = transTableOffset + count * 2 * sizeof(uint32_t);
+    const uint32_t stringsOffset = hashTableOffset + hashSize * sizeof(uint32_t);
+
+    size_t stringsSize = 0;
+    for (auto m: messages)
+        stringsSize += m->msgid.size() + 1 + m->msgstr.size() + 1;
+
+    std::string out;
+    out.reserve(stringsOffset + stringsSize);
+
+    Append(out, MO_MAGIC);
+    Append(out, 0); // revision
+    Append(out, count);
+    Append(out, origTableOffset);
+    Append(out, transTableOffset);
+    Append(out, hashSize);
+    Append(out, hashTableOffset);
+
+    // Strings table of originals first, translations after them:
+    uint32_t offset = stringsOffset;
+    for (auto m: messages)
+    {
+        Append(out, (uint32_t)m->msgid.size());
+        Append(out, offset);
+        offset += (uint32_t)m->msgid.size() + 1;
+    }
+    for (auto m: messages)
+    {
+        Append(out, (uint32_t)m->msgstr.size());
+        Append(out, offset);
+        offset += (uint32_t)m->msgstr.size() + 1;
+    }
+
+    for (auto h: hashTable)
+        Append(out, h);
+
+    for (auto m: messages)
+        out.append(m->msgid.c_str(), m->msgid.size() + 1);
+    for (auto m: messages)
+        out.append(m->msgstr.c_str(), m->msgstr.size() + 1);
+
+    return out;
+}
+
+
+bool MOWriter::Save(const wxString& filename) const
+{
+    const std::string data = Serialize();
+
+    wxFFile f;
+    if (!f.Open(filename, "wb"))
+        return false;
+    if (f.Write(data.data(), data.size()) != data.size())
+        return false;
+    return f.Close();
+}
@@ -0,0 +1,73 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_mo_writer_h
+#define Poedit_mo_writer_h
+
+#include <wx/string.h>
+
+#include <string>
+#include <vector>
+
+
+/**
+    Writer of compiled gettext message catalogs (MO files).
+
+    Produces the same output as msgfmt: sorted tables of original and
+    translated strings followed by a hash table for fast lookup.
+
+    All strings are added already encoded in the catalog's charset.
+ */
+class MOWriter
+{
+public:
+    MOWriter() {}
+
+    /**
+        Adds a message to the catalog.
+
+        @param msgid   Source string, with context prepended and separated
+                       by \x04 (if any) and with the plural form appended
+                       after \0 (if any).
+        @param msgstr  Translation; multiple plural forms are separated
+                       by \0.
+     */
+    void Add(const std::string& msgid, const std::string& msgstr);
+
+    /// Returns the binary MO data.
+    std::string Serialize() const;
+
+    /// Writes the MO data into a file; returns false on failure.
+    bool Save(const wxString& filename) const;
+
+private:
+    struct Message
+    {
+        std::string msgid, msgstr;
+    };
+    std::vector<Message> m_messages;
+};
+
+#endif // Poedit_mo_writer_h
@@ -240,15 +240,143 @@ void PluralFormsCalculator::init(PluralFormsToken::Number nplurals,
 {
     m_nplurals = nplurals;
     m_plural.reset(plural);
+
+    m_code.clear();
+    m_stackSize = 0;
+    m_lookup.clear();
+    if (!plural)
+        return;
+
+    compile(plural, 1);
+
+    // evaluate() returns values in [0, nplurals], which fit into the table
+    // as long as nplurals is sane:
+    if (m_nplurals >= 0 && m_nplurals < 256)
+    {
+        m_lookup.resize(LOOKUP_SIZE);
+        for (int n = 0; n < LOOKUP_SIZE; n++)
+            m_lookup[n] = (unsigned char)evaluateCompiled(n);
+    }
 }
 
-int PluralFormsCalculator::evaluate(int n) const
+void PluralFormsCalculator::compile(const PluralFormsNode* node, size_t depth)
 {
-    if (m_plural.get() == 0)
+    if (depth > m_stackSize)
+        m_stackSize = depth;
+
+    const PluralFormsToken& token = node->token();
+    Instruction instr;
+    instr.op = token.type();
+    instr.number = 0;
+
+    switch (token.type())
+    {
+        case PluralFormsToken::T_NUMBER:
+            instr.number = token.number();
+            break;
+        case PluralFormsToken::T_N:
+            break;
+        case PluralFormsToken::T_EQUAL:
+        case PluralFormsToken::T_NOT_EQUAL:
+        case PluralFormsToken::T_GREATER:
+        case PluralFormsToken::T_GREATER_OR_EQUAL:
+        case PluralFormsToken::T_LESS:
+        case PluralFormsToken::T_LESS_OR_EQUAL:
+        case PluralFormsToken::T_REMINDER:
+        case PluralFormsToken::T_LOGICAL_AND:
+        case PluralFormsToken::T_LOGICAL_OR:
+            compile(node->node(0), depth);
+            compile(node->node(1), depth + 1);
+            break;
+        case PluralFormsToken::T_QUESTION:
+            compile(node->node(0), depth);
+            compile(node->node(1), depth + 1);
+            compile(node->node(2), depth + 2);
+            break;
+        default:
+            // same as PluralFormsNode::evaluate()
+            instr.op = PluralFormsToken::T_NUMBER;
+            break;
+    }
+
+    m_code.push_back(instr);
+}
+
+int PluralFormsCalculator::evaluateCompiled(int n) const
+{
+    if (m_code.empty())
     {
         return 0;
     }
-    PluralFormsToken::Number number = m_plural->evaluate(n);
+
+    typedef PluralFormsToken::Number Number;
+    Number fixedStack[32];
+    std::vector<Number> dynamicStack;
+    Number *stack = fixedStack;
+    if (m_stackSize > WXSIZEOF(fixedStack))
+    {
+        dynamicStack.resize(m_stackSize);
+        stack = dynamicStack.data();
+    }
+
+    size_t top = 0; // number of values on the stack
+    for (const Instruction& i : m_code)
+    {
+        switch (i.op)
+        {
+            case PluralFormsToken::T_NUMBER:
+                stack[top++] = i.number;
+                break;
+            case PluralFormsToken::T_N:
+                stack[top++] = n;
+                break;
+            case PluralFormsToken::T_QUESTION:
+                top -= 2;
+                stack[top - 1] = stack[top - 1] ? stack[top] : stack[top + 1];
+                break;
+            default:
+            {
+                const Number b = stack[--top];
+                Number& a = stack[top - 1];
+                switch (i.op)
+                {
+                    case PluralFormsToken::T_EQUAL:
+                        a = a == b;
+                        break;
+                    case PluralFormsToken::T_NOT_EQUAL:
+                        a = a != b;
+                        break;
+                    case PluralFormsToken::T_GREATER:
+                        a = a > b;
+                        break;
+                    case PluralFormsToken::T_GREATER_OR_EQUAL:
+                        a = a >= b;
+                        break;
+                    case PluralFormsToken::T_LESS:
+                        a = a < b;
+                        break;
+                    case PluralFormsToken::T_LESS_OR_EQUAL:
+                        a = a <= b;
+                        break;
+                    case PluralFormsToken::T_REMINDER:
+                        a = (b != 0) ? a % b : 0;
+                        break;
+                    case PluralFormsToken::T_LOGICAL_AND:
+                        a = a && b;
+                        break;
+                    case PluralFormsToken::T_LOGICAL_OR:
+                        a = a || b;
+                        break;
+                    default:
+                        a = 0;
+                        break;
+                }
+                break;
+            }
+        }
+    }
+
+    Number number = stack[0];
     if (number < 0 || number > m_nplurals)
     {
         return 0;
@@ -256,6 +384,19 @@ int PluralFormsCalculator::evaluate(int n) const
     return number;
 }
 
+bool PluralFormsCalculator::sameResultsForSmallNumbers(const PluralFormsCalculator& other) const
+{
+    if (!m_lookup.empty() && !other.m_lookup.empty())
+        return m_lookup == other.m_lookup;
+
+    for (int n = 0; n < LOOKUP_SIZE; n++)
+    {
+        if (evaluate(n) != other.evaluate(n))
+            return false;
+    }
+    return true;
+}
+
 
 class PluralFormsParser
 {
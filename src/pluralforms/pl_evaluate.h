@@ -13,6 +13,7 @@
 #include <wx/string.h>
 
 #include <memory>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 // Plural forms parser
@@ -128,10 +129,21 @@ private:
 class PluralFormsCalculator
 {
 public:
-    PluralFormsCalculator() : m_nplurals(0), m_plural(0) {}
+    PluralFormsCalculator() : m_nplurals(0), m_plural(0), m_stackSize(0) {}
+
+    // results for 0 <= n < LOOKUP_SIZE are precomputed
+    static const int LOOKUP_SIZE = 1002;
 
     // input: number, returns msgstr index
-    int evaluate(int n) const;
+    int evaluate(int n) const
+    {
+        if (n >= 0 && n < (int)m_lookup.size())
+            return m_lookup[n];
+        return evaluateCompiled(n);
+    }
+
+    // returns true if both give the same results for all n < LOOKUP_SIZE
+    bool sameResultsForSmallNumbers(const PluralFormsCalculator& other) const;
 
     int nplurals() const { return m_nplurals; }
 
@@ -146,6 +158,20 @@ public:
     wxString getString() const;
 
 private:
+    // The expression is compiled into postfix form, which is much faster
+    // to evaluate than walking the tree
+    struct Instruction
+    {
+        PluralFormsToken::Type op;
+        PluralFormsToken::Number number; // T_NUMBER only
+    };
+
+    void compile(const PluralFormsNode* node, size_t depth);
+    int evaluateCompiled(int n) const;
+
     PluralFormsToken::Number m_nplurals;
     PluralFormsNodePtr m_plural;
+    std::vector<Instruction> m_code;
+    size_t m_stackSize;
+    std::vector<unsigned char> m_lookup;
 };
@@ -25,6 +25,7 @@
 
 #include "prefsdlg.h"
 
+#include <algorithm>
 #include <fstream>
 #include <memory>
 
@@ -43,6 +44,7 @@
 #include <wx/fontpicker.h>
 #include <wx/filename.h>
 #include <wx/filedlg.h>
+#include <wx/dirdlg.h>
 #include <wx/windowptr.h>
 #include <wx/sizer.h>
 #include <wx/settings.h>
@@ -59,9 +61,11 @@
 #include "edapp.h"
 #include "edframe.h"
 #include "catalog.h"
+#include "concurrency.h"
 #include "configuration.h"
 #include "crowdin_gui.h"
 #include "hidpi.h"
+#include "tm/machine_translation.h"
 #include "tm/transmem.h"
 #include "tm/tmx_io.h"
 #include "chooselang.h"
@@ -134,6 +138,8 @@ public:
             return false;
         m_suppressDataTransfer++;
         SaveValues(*wxConfig::Get());
+        // pages write some settings to wxConfig directly:
+        Config::Refresh();
         m_suppressDataTransfer--;
         return true;
     }
@@ -387,6 +393,12 @@ public:
         sizer->Add(buttonsSizer, wxSizerFlags().Expand().Border(wxLEFT|wxRIGHT, PX(30)));
         sizer->AddSpacer(PX(10));
 
+        m_useCompactTM = new wxCheckBox(this, wxID_ANY, _("Use compact index for faster lookups"));
+        sizer->Add(m_useCompactTM, wxSizerFlags().Expand());
+        auto compactExplain = new ExplanationLabel(this, _("Only exact and very similar matches are found. The index is updated in the background after the translation memory changes."));
+        sizer->Add(compactExplain, wxSizerFlags().Expand().Border(wxLEFT, PX(ExplanationLabel::CHECKBOX_INDENT)));
+        sizer->AddSpacer(PX(10));
+
         // TRANSLATORS: Followed by "match translations within the file" or "pre-translate from TM"
         m_mergeUse = new wxCheckBox(this, wxID_ANY, _("When updating from sources"));
         wxString mergeValues[] = {
@@ -412,6 +424,24 @@ public:
         sizer->Add(learnMore, wxSizerFlags().Border(wxLEFT, PX(ExplanationLabel::CHECKBOX_INDENT + LearnMoreLink::EXTRA_INDENT)));
         sizer->AddSpacer(PX(10));
 
+#ifdef HAVE_HTTP_CLIENT
+        m_useMT = new wxCheckBox(this, wxID_ANY, _("Suggest machine translations from DeepL"));
+        sizer->Add(m_useMT, wxSizerFlags().Expand());
+        sizer->AddSpacer(PX(5));
+        auto mtKeySizer = new wxBoxSizer(wxHORIZONTAL);
+        mtKeySizer->Add(new wxStaticText(this, wxID_ANY, _("API key:")), wxSizerFlags().Center());
+        mtKeySizer->AddSpacer(PX(5));
+        m_mtKey = new wxTextCtrl(this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxTE_PASSWORD);
+        mtKeySizer->Add(m_mtKey, wxSizerFlags(1).Center());
+        sizer->Add(mtKeySizer, wxSizerFlags().Expand().Border(wxLEFT, PX(ExplanationLabel::CHECKBOX_INDENT)));
+        sizer->AddSpacer(PX(3));
+        auto mtExplain = new ExplanationLabel(this, _("Machine translations are shown among suggestions and used when pre-translating strings not found in the TM. They are always marked as needing work."));
+        sizer->Add(mtExplain, wxSizerFlags().Expand().Border(wxLEFT, PX(ExplanationLabel::CHECKBOX_INDENT)));
+        sizer->AddSpacer(PX(10));
+
+        m_mtKey->Bind(wxEVT_UPDATE_UI, [=](wxUpdateUIEvent& e){ e.Enable(m_useMT->GetValue()); });
+#endif
+
 #ifdef __WXOSX__
         m_stats->SetWindowVariant(wxWINDOW_VARIANT_SMALL);
         manage->SetWindowVariant(wxWINDOW_VARIANT_SMALL);
@@ -421,6 +451,7 @@ public:
 
         m_stats->Bind(wxEVT_UPDATE_UI, &TMPageWindow::OnUpdateUI, this);
         manage->Bind(wxEVT_UPDATE_UI, &TMPageWindow::OnUpdateUI, this);
+        m_useCompactTM->Bind(wxEVT_UPDATE_UI, &TMPageWindow::OnUpdateUI, this);
 
         manage->Bind(wxEVT_BUTTON, &TMPageWindow::OnManageTM, this);
 
@@ -429,6 +460,11 @@ public:
         if (wxPreferencesEditor::ShouldApplyChangesImmediately())
         {
             m_mergeUse->Bind(wxEVT_CHECKBOX, [=](wxCommandEvent&){ TransferDataFromWindow(); });
+            m_useCompactTM->Bind(wxEVT_CHECKBOX, [=](wxCommandEvent&){ TransferDataFromWindow(); });
+#ifdef HAVE_HTTP_CLIENT
+            m_useMT->Bind(wxEVT_CHECKBOX, [=](wxCommandEvent&){ TransferDataFromWindow(); });
+            m_mtKey->Bind(wxEVT_KILL_FOCUS, [=](wxFocusEvent& e){ e.Skip(); TransferDataFromWindow(); });
+#endif
             m_mergeBehavior->Bind(wxEVT_CHOICE, [=](wxCommandEvent&){ TransferDataFromWindow(); });
             // Some settings directly affect the UI, so need a more expensive handler:
             m_useTM->Bind(wxEVT_CHECKBOX, &TMPageWindow::TransferDataFromWindowAndUpdateUI, this);
@@ -438,14 +474,26 @@ public:
     void InitValues(const wxConfigBase&) override
     {
         m_useTM->SetValue(Config::UseTM());
+        m_useCompactTM->SetValue(Config::UseCompactTM());
         auto merge = Config::MergeBehavior();
         m_mergeUse->SetValue(merge != Merge_None);
         m_mergeBehavior->SetSelection(merge == Merge_UseTM ? 1 : 0);
+#ifdef HAVE_HTTP_CLIENT
+        m_useMT->SetValue(Config::UseMachineTranslation());
+        // reading the keychain may be slow:
+        dispatch::async([]{ return MachineTranslation::Get().GetAuthKey(); })
+            .then_on_window(this, [=](std::string key)
+            {
+                m_loadedMTKey = key;
+                m_mtKey->SetValue(wxString::FromUTF8(key));
+            });
+#endif
     }
 
     void SaveValues(wxConfigBase&) override
     {
         Config::UseTM(m_useTM->GetValue());
+        Config::UseCompactTM(m_useCompactTM->GetValue());
         if (m_mergeUse->GetValue() == true)
         {
             Config::MergeBehavior(m_mergeBehavior->GetSelection() == 1 ? Merge_UseTM : Merge_FuzzyMatch);
@@ -454,6 +502,15 @@ public:
         {
             Config::MergeBehavior(Merge_None);
         }
+#ifdef HAVE_HTTP_CLIENT
+        Config::UseMachineTranslation(m_useMT->GetValue());
+        const std::string key(m_mtKey->GetValue().Strip(wxString::both).utf8_str());
+        if (key != m_loadedMTKey)
+        {
+            MachineTranslation::Get().SetAuthKey(key);
+            m_loadedMTKey = key;
+        }
+#endif
     }
 
 private:
@@ -461,6 +518,7 @@ private:
     {
         wxString sDocs("--");
         wxString sFileSize("--");
+        wxString sPairs;
         if (Config::UseTM())
         {
             try
@@ -469,6 +527,18 @@ private:
                 TranslationMemory::Get().GetStats(docs, fileSize);
                 sDocs.Printf("<b>%s</b>", wxNumberFormatter::ToString(docs));
                 sFileSize.Printf("<b>%s</b>", wxFileName::GetHumanReadableSize(fileSize, "--", 1, wxSIZE_CONV_SI));
+
+                for (auto& p: TranslationMemory::Get().GetLanguagePairStats())
+                {
+                    if (p.numDocs == 0)
+                        continue;
+                    if (!sPairs.empty())
+                        sPairs += "\n";
+                    sPairs += wxString::Format(L"%s → %s: %s (%s)",
+                                               p.srclang.DisplayName(), p.lang.LanguageDisplayName(),
+                                               wxNumberFormatter::ToString(p.numDocs),
+                                               wxFileName::GetHumanReadableSize(p.fileSize, "--", 1, wxSIZE_CONV_SI));
+                }
             }
             catch (Exception&)
             {
@@ -481,11 +551,13 @@ private:
             _("Stored translations:"),      sDocs,
             _("Database size on disk:"),    sFileSize
         ));
+        m_stats->SetToolTip(sPairs);
     }
 
     void OnManageTM(wxCommandEvent& e)
     {
         static const auto idLearn = wxNewId();
+        static const auto idLearnDir = wxNewId();
         static const auto idImportTMX = wxNewId();
         static const auto idExportTMX = wxNewId();
         static const auto idReset = wxNewId();
@@ -495,6 +567,7 @@ private:
         [menu->GetHMenu() setFont:[NSFont systemFontOfSize:13]];
 #endif
         menu->Append(idLearn, MSW_OR_OTHER(_(L"Import translation files…"), _(L"Import Translation Files…")));
+        menu->Append(idLearnDir, MSW_OR_OTHER(_(L"Import folder with translation files…"), _(L"Import Folder with Translation Files…")));
         menu->AppendSeparator();
         menu->Append(idImportTMX, MSW_OR_OTHER(_(L"Import from TMX…"), _(L"Import From TMX…")));
         menu->Append(idExportTMX, MSW_OR_OTHER(_(L"Export to TMX…"), _(L"Export To TMX…")));
@@ -503,6 +576,7 @@ private:
         menu->Append(idReset, _("Reset"));
 
         menu->Bind(wxEVT_MENU, &TMPageWindow::OnImportIntoTM, this, idLearn);
+        menu->Bind(wxEVT_MENU, &TMPageWindow::OnImportDirIntoTM, this, idLearnDir);
         menu->Bind(wxEVT_MENU, &TMPageWindow::OnImportTMX, this, idImportTMX);
         menu->Bind(wxEVT_MENU, &TMPageWindow::OnExportTMX, this, idExportTMX);
         menu->Bind(wxEVT_MENU, &TMPageWindow::OnResetTM, this, idReset);
@@ -531,30 +605,67 @@ private:
 
             wxArrayString paths;
             dlg->GetPaths(paths);
+            ImportFiles(std::vector<wxString>(paths.begin(), paths.end()));
+        });
+    }
 
-            wxProgressDialog progress(_("Translation Memory"),
-                                      _(L"Importing translations…"),
-                                      (int)paths.size() * 2 + 1,
-                                      this,
-                                      wxPD_APP_MODAL|wxPD_AUTO_HIDE|wxPD_CAN_ABORT);
-            auto tm = TranslationMemory::Get().GetWriter();
-            int step = 0;
-            for (size_t i = 0; i < paths.size(); i++)
+    void OnImportDirIntoTM(wxCommandEvent&)
+    {
+        wxWindowPtr<wxDirDialog> dlg(new wxDirDialog(
+            this,
+            _("Select folder with translation files to import"),
+            wxEmptyString,
+            wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST));
+
+        dlg->ShowWindowModalThenDo([=](int retcode){
+            if (retcode != wxID_OK)
+                return;
+
+            std::vector<wxString> files;
             {
-                auto cat = Catalog::Create(paths[i]);
-                if (!progress.Update(++step))
-                    break;
-                if (cat && cat->IsOk())
-                    tm->Insert(cat);
-                if (!progress.Update(++step))
-                    break;
+                wxBusyCursor bcur;
+                files = TranslationMemory::FindTranslationFiles(dlg->GetPath());
             }
-            progress.Pulse(_(L"Finalizing…"));
-            tm->Commit();
-            UpdateStats();
+            ImportFiles(files);
         });
     }
 
+    void ImportFiles(const std::vector<wxString>& files)
+    {
+        if (files.empty())
+            return;
+
+        wxProgressDialog progress(_("Translation Memory"),
+                                  _(L"Importing translations…"),
+                                  (int)files.size() + 1,
+                                  this,
+                                  wxPD_APP_MODAL|wxPD_AUTO_HIDE|wxPD_CAN_ABORT);
+        try
+        {
+            TranslationMemory::Get().ImportFiles(files, [&progress,&files](size_t done)
+            {
+                if (done == files.size())
+                    progress.Pulse(_(L"Finalizing…"));
+                else if (!progress.Update((int)done))
+                    return false;
+                return true;
+            });
+        }
+        catch (...)
+        {
+            wxWindowPtr<wxMessageDialog> err(new wxMessageDialog
+            (
+                    this,
+                    _("Importing translation files failed."),
+                    _("Import error"),
+                    wxOK | wxICON_ERROR
+                ));
+            err->SetExtendedMessage(DescribeCurrentException());
+            err->ShowWindowModalThenDo([err](int){});
+        }
+        UpdateStats();
+    }
+
     void OnImportTMX(wxCommandEvent&)
     {
         wxWindowPtr<wxFileDialog> dlg(new wxFileDialog
@@ -574,23 +685,31 @@ private:
             wxArrayString paths;
             dlg->GetPaths(paths);
 
+            // progress of each file is reported in permille:
             wxProgressDialog progress(_("Translation Memory"),
                                       _(L"Importing translations…"),
-                                      (int)paths.size() + 1,
+                                      (int)paths.size() * 1000,
                                       this,
                                       wxPD_APP_MODAL|wxPD_AUTO_HIDE|wxPD_CAN_ABORT);
             progress.Pulse();
+            int index = 0;
             for (auto p: paths)
             {
                 try
                 {
                     std::ifstream f;
-                    f.open(p.fn_str());
-                    TMX::ImportFromFile(f, TranslationMemory::Get());
+                    f.open(p.fn_str(), std::ios::in | std::ios::binary);
+                    TMX::ImportFromFile(f, TranslationMemory::Get(), [&progress,index](double fraction)
+                    {
+                        if (fraction < 0)
+                            return progress.Pulse();
+                        return progress.Update(index * 1000 + std::min(999, int(fraction * 1000)));
+                    });
                     f.close();
 
-                    if (!progress.Pulse())
+                    if (progress.WasCancelled())
                         break;
+                    index++;
                 }
                 catch (...)
                 {
@@ -680,10 +799,15 @@ private:
         e.Enable(m_useTM->GetValue());
     }
 
-    wxCheckBox *m_useTM;
+    wxCheckBox *m_useTM, *m_useCompactTM;
     wxCheckBox *m_mergeUse;
     wxChoice *m_mergeBehavior;
     wxStaticText *m_stats;
+#ifdef HAVE_HTTP_CLIENT
+    wxCheckBox *m_useMT;
+    wxTextCtrl *m_mtKey;
+    std::string m_loadedMTKey;
+#endif
 };
 
 class TMPage : public wxPreferencesPage
@@ -855,6 +979,7 @@ private:
     template<typename TFunctor>
     void EditExtractor(int num, TFunctor completionHandler)
     {
+        wxGetApp().LoadXmlResources("prefs.xrc");
         wxWindowPtr<wxDialog> dlg(wxXmlResource::Get()->LoadDialog(this, "edit_extractor"));
         dlg->Centre();
 
@@ -25,115 +25,446 @@
 
 #include "pretranslate.h"
 
+#include "catalog_translation_index.h"
+#include "concurrency.h"
 #include "configuration.h"
 #include "customcontrols.h"
+#include "errors.h"
 #include "hidpi.h"
+#include "manager.h"
 #include "progressinfo.h"
 #include "str_helpers.h"
+#include "tm/compact_tm.h"
+#include "tm/machine_translation.h"
 #include "tm/transmem.h"
+#include "tracing.h"
 #include "utility.h"
 
 #include <wx/button.h>
 #include <wx/checkbox.h>
 #include <wx/dialog.h>
 #include <wx/intl.h>
+#include <wx/log.h>
 #include <wx/msgdlg.h>
 #include <wx/sizer.h>
 #include <wx/windowptr.h>
 
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
+
+namespace
+{
+
+// Number of strings searched in the TM together, see TranslationMemory::SearchBatch()
+const size_t PRETRANSLATE_BATCH_SIZE = 50;
+
+/// Translations of strings from other catalogs in the same project
+typedef std::unordered_map<std::wstring, SmallStringArray> SiblingTranslations;
+
+/// Key for looking up an item in SiblingTranslations
+std::wstring GetSiblingKey(const CatalogItemPtr& item)
+{
+    // use EOT as the separator as gettext does in MO files:
+    std::wstring key;
+    if (item->HasContext())
+        key = str::to_wstring(item->GetContextUTF8()) + L'\x04';
+    key += str::to_wstring(item->GetStringUTF8());
+    if (item->HasPlural())
+        key += L'\0' + str::to_wstring(item->GetPluralStringUTF8());
+    return key;
+}
+
+/**
+    Collects all finished translations in the same language from the other
+    catalogs of the projects (as configured in the catalogs manager) that
+    @a catalog is part of.
+ */
+SiblingTranslations LoadSiblingTranslations(CatalogPtr catalog)
+{
+    SiblingTranslations translations;
+
+    const wxString filename = catalog->GetFileName();
+    if (filename.empty())
+        return translations;
+
+    const auto lang = catalog->GetLanguage();
+    const auto siblings = ManagerFrame::GetProjectSiblings(filename);
+
+    dispatch::parallel_options options;
+    options.chunk_size = 1;
+    options.prio = dispatch::priority::bulk;
+    auto loaded = dispatch::parallel_transform(0, siblings.size(), [&siblings,&lang](size_t i)
+    {
+        CatalogPtr cat;
+        try
+        {
+            cat = Catalog::Create(siblings[i]);
+            if (cat && (!cat->IsOk() || cat->GetLanguage() != lang))
+                cat.reset();
+        }
+        catch (...)
+        {
+            // unreadable siblings are simply not used
+        }
+        return cat;
+    }, options);
+
+    for (auto& cat: loaded)
+    {
+        if (!cat)
+            continue;
+        for (auto& item: cat->items())
+        {
+            if (item->IsTranslated() && !item->IsFuzzy())
+                translations.emplace(GetSiblingKey(item), item->GetTranslations());
+        }
+    }
+
+    return translations;
+}
+
+
+/// Reports progress of pre-translation, returns false to cancel it
+typedef std::function<bool(size_t done, size_t total, int matches)> PreTranslateProgress;
+
+/**
+    Does the actual pre-translation of @a range, without any UI.
+
+    Returns the number of pre-translated items.
+ */
 template<typename T>
-bool PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const T& range, int flags, int *matchesCount)
+int DoPreTranslateCatalog(CatalogPtr catalog, const T& range, int flags, const PreTranslateProgress& reportProgress)
 {
-    if (matchesCount)
-        *matchesCount = 0;
+    TRACE_SCOPE("PreTranslateCatalog");
 
     if (range.empty())
-        return false;
+        return 0;
 
     if (!Config::UseTM())
-        return false;
+        return 0;
 
-    wxBusyCursor bcur;
+    // Searches the TM selected in preferences:
+    const bool useCompactTM = Config::UseCompactTM();
+    auto searchBatch = [useCompactTM](const Language& srclang, const Language& lang, const std::vector<std::wstring>& sources)
+    {
+        if (useCompactTM)
+            return CompactTranslationMemory::Get().SearchBatch(srclang, lang, sources);
 
-    TranslationMemory& tm = TranslationMemory::Get();
+        // Reuse previously found results, e.g. by the sidebar, and search
+        // only for the rest; results are shared back in the other direction:
+        return TranslationMemory::Get().SearchBatchCached(srclang, lang, sources);
+    };
     auto srclang = catalog->GetSourceLanguage();
     auto lang = catalog->GetLanguage();
 
-    // FIXME: make this window-modal
-    // FIXME: and don't create it here, reuse upstream progress data
-    ProgressInfo progress(window, _(L"Pre-translating…"));
-    progress.UpdateMessage(_(L"Pre-translating…"));
-
-    // Function to apply fetched suggestions to a catalog item:
-    auto process_results = [=](CatalogItemPtr dt, unsigned index, const SuggestionsList& results) -> bool
+    // Function to choose the suggestion to use, if any:
+    auto choose_result = [=](const SuggestionsList& results) -> const Suggestion*
         {
             if (results.empty())
-                return false;
+                return nullptr;
             auto& res = results.front();
             if ((flags & PreTranslate_OnlyExact) && !res.IsExactMatch())
-                return false;
+                return nullptr;
 
             if ((flags & PreTranslate_OnlyGoodQuality) && res.score < 0.80)
-                return false;
+                return nullptr;
 
-            dt->SetTranslation(res.text, index);
-            dt->SetPreTranslated(true);
-            dt->SetFuzzy(!res.IsExactMatch() || (flags & PreTranslate_ExactNotFuzzy) == 0);
-            return true;
+            return &res;
         };
 
-    std::vector<dispatch::future<bool>> operations;
+    // Only "simple" English-like plurals are supported:
+    const bool usePlurals = lang.nplurals() == 2;
+
+    // Items with the same source text, which is common with msgctxt or
+    // plural forms, are looked up only once and the result used for all of
+    // them:
+    struct UniqueSource
+    {
+        std::wstring text;
+        std::vector<CatalogItemPtr> items;
+    };
+    typedef std::vector<UniqueSource> UniqueSources;
+
+    auto add_source = [](UniqueSources& sources, std::unordered_map<std::wstring, size_t>& index,
+                         std::wstring&& text, CatalogItemPtr item)
+    {
+        auto i = index.find(text);
+        if (i == index.end())
+        {
+            i = index.emplace(text, sources.size()).first;
+            sources.push_back({std::move(text), {}});
+        }
+        sources[i->second].items.push_back(item);
+    };
+
+    // Translations found by the workers, waiting to be applied to items on
+    // this thread, so that items are never modified concurrently with the UI:
+    struct FoundTranslation
+    {
+        CatalogItemPtr item;
+        unsigned index;
+        wxString text;
+        bool exact;
+    };
+    std::mutex foundMutex;
+    std::vector<FoundTranslation> found;
+
+    int matches = 0;
+    auto apply_found = [&]
+    {
+        std::vector<FoundTranslation> batch;
+        {
+            std::lock_guard<std::mutex> guard(foundMutex);
+            batch.swap(found);
+        }
+        for (auto& f: batch)
+        {
+            f.item->SetTranslation(f.text, f.index);
+            f.item->SetPreTranslated(true);
+            f.item->SetFuzzy(!f.exact || (flags & PreTranslate_ExactNotFuzzy) == 0);
+            if (f.index == 0)
+                matches++;
+        }
+    };
+
+    // Exact matches of both context and source text in other files of the
+    // same project are used directly, without searching the TM:
+    const auto siblingTranslations = LoadSiblingTranslations(catalog);
+
+    // ...and so are translations of the same text elsewhere in this catalog:
+    auto catalogTranslations = catalog->GetTranslationIndex();
+
+    UniqueSources singulars;
+    std::unordered_map<std::wstring, size_t> singularsIndex;
+    std::unordered_set<std::wstring> pluralCandidates;
     for (auto dt: range)
     {
         if (dt->IsTranslated() && !dt->IsFuzzy())
             continue;
+        if (!siblingTranslations.empty())
+        {
+            auto sibling = siblingTranslations.find(GetSiblingKey(dt));
+            if (sibling != siblingTranslations.end())
+            {
+                for (unsigned i = 0; i < sibling->second.size(); i++)
+                    found.push_back({dt, i, sibling->second[i], true});
+                continue;
+            }
+        }
+        bool inCatalog = false;
+        for (auto& m: catalogTranslations->FindOthers(*dt))
+        {
+            if (m.hasPlural != dt->HasPlural() || (m.hasPlural && m.plural != dt->GetPluralString()))
+                continue;
+            for (unsigned i = 0; i < m.translations.size(); i++)
+                found.push_back({dt, i, m.translations[i], true});
+            inCatalog = true;
+            break;
+        }
+        if (inCatalog)
+            continue;
+        add_source(singulars, singularsIndex, str::to_wstring(dt->GetStringUTF8()), dt);
+        if (usePlurals && dt->HasPlural())
+            pluralCandidates.insert(str::to_wstring(dt->GetPluralStringUTF8()));
+    }
+
+    // Result chosen for an unique source text:
+    struct Choice
+    {
+        Choice() : found(false), exact(false) {}
+        bool found;
+        wxString text;
+        bool exact;
+    };
+
+    // Search the TM in batches, which is much faster than searching for
+    // each string individually, with a fixed number of workers taking the
+    // batches in turn, so that memory use and the number of tasks don't
+    // depend on the size of the catalog:
+    auto translateBatch = [&](const UniqueSources& sources, std::vector<Choice>& choices, unsigned index)
+    {
+        return [&,index](size_t begin, size_t end)
+        {
+            std::vector<std::wstring> texts;
+            texts.reserve(end - begin);
+            for (size_t i = begin; i < end; i++)
+                texts.push_back(sources[i].text);
+            auto results = searchBatch(srclang, lang, texts);
+
+            std::vector<FoundTranslation> batchFound;
+            for (size_t i = begin; i < end; i++)
+            {
+                auto res = choose_result(results[i - begin]);
+                if (!res)
+                    continue;
+                auto& c = choices[i];
+                c.found = true;
+                c.text = res->text;
+                c.exact = res->IsExactMatch();
+                for (auto& dt: sources[i].items)
+                    batchFound.push_back({dt, index, c.text, c.exact});
+            }
+
+            std::lock_guard<std::mutex> guard(foundMutex);
+            found.insert(found.end(), batchFound.begin(), batchFound.end());
+        };
+    };
 
-        operations.push_back(dispatch::async([=,&tm]{
-            auto results = tm.Search(srclang, lang, str::to_wstring(dt->GetString()));
-            bool ok = process_results(dt, 0, results);
+    const size_t total = singulars.size() + pluralCandidates.size();
+    if (!reportProgress(0, total, 0))
+        return 0;
 
-            if (ok && dt->HasPlural())
+    size_t doneBefore = 0;
+    dispatch::parallel_options options;
+    options.chunk_size = PRETRANSLATE_BATCH_SIZE;
+    options.prio = dispatch::priority::bulk;
+    options.progress = [&](size_t done, size_t)
+    {
+        apply_found();
+        return reportProgress(doneBefore + done, total, matches);
+    };
+
+    // Cancelling stops processing of further batches; translations found
+    // by those that already finished are still used:
+    std::vector<Choice> singularChoices(singulars.size());
+    bool completed = dispatch::parallel_for_chunks(0, singulars.size(), translateBatch(singulars, singularChoices, 0), options);
+    apply_found();
+
+#ifdef HAVE_HTTP_CLIENT
+    // Machine translation of the rest is requested all at once, so that it
+    // can be sent in as few batches as possible:
+    if (completed && (flags & PreTranslate_UseMachineTranslation) && MachineTranslation::Get().IsEnabled())
+    {
+        std::vector<size_t> missing;
+        std::vector<std::wstring> texts;
+        for (size_t i = 0; i < singulars.size(); i++)
+        {
+            if (singularChoices[i].found)
+                continue;
+            missing.push_back(i);
+            texts.push_back(singulars[i].text);
+        }
+
+        if (!texts.empty())
+        {
+            try
             {
-                switch (lang.nplurals())
+                auto translations = MachineTranslation::Get().TranslateBatch(srclang, lang, texts).get();
+                for (size_t i = 0; i < missing.size() && i < translations.size(); i++)
                 {
-                    case 2:  // "simple" English-like plurals
-                    {
-                        auto results_plural = tm.Search(srclang, lang, str::to_wstring(dt->GetPluralString()));
-                        process_results(dt, 1, results_plural);
-                    }
-                    case 1:  // nothing else to do
-                    default: // not supported
-                        break;
+                    if (translations[i].empty())
+                        continue;
+                    auto& c = singularChoices[missing[i]];
+                    c.found = true;
+                    c.text = translations[i];
+                    c.exact = false;
+                    for (auto& dt: singulars[missing[i]].items)
+                        found.push_back({dt, 0, c.text, false});
                 }
             }
-
-            return ok;
-        }));
+            catch (...)
+            {
+                // the TM's results are still useful without machine translation
+                wxLogTrace("poedit.mt", "machine translation failed: %s", DescribeCurrentException());
+            }
+            apply_found();
+        }
     }
+#endif
 
-    progress.SetGaugeMax((int)operations.size());
-
-    int matches = 0;
-    time_t last_refresh = 0;
-    for (auto& op: operations)
+    // Plural forms are only translated for items whose singular was, and
+    // their sources often coincide with an already searched singular:
+    if (completed && !pluralCandidates.empty())
     {
-        if (!progress.UpdateGauge())
-            break; // TODO: cancel pending 'operations' futures
-
-        if (op.get())
+        UniqueSources plurals;
+        std::unordered_map<std::wstring, size_t> pluralsIndex;
+        for (size_t i = 0; i < singulars.size(); i++)
         {
-            matches++;
-            // Don't update the UI too often, because it is slow due to UpdateMessage()
-            // forcing repaint:
-            time_t time_now = time(NULL);
-            if (time_now != last_refresh)
+            if (!singularChoices[i].found)
+                continue;
+            for (auto& dt: singulars[i].items)
             {
-                progress.UpdateMessage(wxString::Format(wxPLURAL("Pre-translated %u string", "Pre-translated %u strings", matches), matches));
-                last_refresh = time_now;
+                if (!dt->HasPlural())
+                    continue;
+                auto text = str::to_wstring(dt->GetPluralStringUTF8());
+                auto known = singularsIndex.find(text);
+                if (known != singularsIndex.end())
+                {
+                    auto& c = singularChoices[known->second];
+                    if (c.found)
+                        found.push_back({dt, 1, c.text, c.exact});
+                }
+                else
+                {
+                    add_source(plurals, pluralsIndex, std::move(text), dt);
+                }
             }
         }
+
+        doneBefore = singulars.size();
+        std::vector<Choice> pluralChoices(plurals.size());
+        completed = dispatch::parallel_for_chunks(0, plurals.size(), translateBatch(plurals, pluralChoices, 1), options);
+        apply_found();
     }
+
+    if (completed)
+        reportProgress(total, total, matches);
+
+    return matches;
+}
+
+} // anonymous namespace
+
+
+template<typename T>
+bool PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const T& range, int flags, int *matchesCount)
+{
+    if (matchesCount)
+        *matchesCount = 0;
+
+    if (range.empty() || !Config::UseTM())
+        return false;
+
+    wxBusyCursor bcur;
+
+    // FIXME: make this window-modal
+    // FIXME: and don't create it here, reuse upstream progress data
+    ProgressInfo progress(window, _(L"Pre-translating…"));
+    progress.UpdateMessage(_(L"Pre-translating…"));
+
+    // Reporting only updates the monitor, the dialog shows it at its own pace:
+    auto monitor = std::make_shared<dispatch::progress_monitor>();
+    progress.Monitor(monitor, [](const dispatch::progress_monitor& m)
+    {
+        const unsigned matches = unsigned(m.results());
+        if (!matches)
+            return wxString();
+        return wxString::Format(wxPLURAL("Pre-translated %u string", "Pre-translated %u strings", matches), matches);
+    });
+
+    size_t reported = 0;
+    int lastMatches = 0;
+    auto reportProgress = [&](size_t done, size_t total, int matches)
+    {
+        if (done == 0)
+        {
+            monitor->reset(total);
+            return true;
+        }
+
+        monitor->advance(done - reported);
+        monitor->add_results(size_t(matches - lastMatches));
+        reported = done;
+        lastMatches = matches;
+
+        return progress.ProcessEvents();
+    };
+
+    const int matches = DoPreTranslateCatalog(catalog, range, flags, reportProgress);
+
     progress.UpdateMessage(wxString::Format(wxPLURAL("Pre-translated %u string", "Pre-translated %u strings", matches), matches));
 
     if (matchesCount)
@@ -149,6 +480,17 @@ bool PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, int flags, int *m
 }
 
 
+bool PreTranslateCatalogHeadless(CatalogPtr catalog, int flags, int *matchesCount)
+{
+    const int matches = DoPreTranslateCatalog(catalog, catalog->items(), flags,
+                                              [](size_t, size_t, int){ return true; });
+    if (matchesCount)
+        *matchesCount = matches;
+
+    return matches > 0;
+}
+
+
 void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catalog, std::function<void()> onChangesMade)
 {
     wxWindowPtr<wxDialog> dlg(new wxDialog(window, wxID_ANY, _("Pre-translate"), wxDefaultPosition, wxSize(PX(440), -1)));
@@ -224,6 +566,8 @@ void PreTranslateWithUI(wxWindow *window, PoeditListCtrl *list, CatalogPtr catal
             flags |= PreTranslate_OnlyExact;
         if (settings.exactNotFuzzy)
             flags |= PreTranslate_ExactNotFuzzy;
+        if (!settings.onlyExact && Config::UseMachineTranslation())
+            flags |= PreTranslate_UseMachineTranslation;
 
         if (list->HasMultipleSelection())
         {
@@ -39,7 +39,10 @@ enum PreTranslateFlags
 {
     PreTranslate_OnlyExact       = 0x01,
     PreTranslate_ExactNotFuzzy   = 0x02,
-    PreTranslate_OnlyGoodQuality = 0x04
+    PreTranslate_OnlyGoodQuality = 0x04,
+    /// Use machine translation for strings not found in the TM; the
+    /// function blocks while waiting for it, so only use on the main thread
+    PreTranslate_UseMachineTranslation = 0x08
 };
 
 /**
@@ -61,6 +64,18 @@ bool PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, const T& range, i
  */
 bool PreTranslateCatalog(wxWindow *window, CatalogPtr catalog, int flags, int *matchesCount);
 
+/**
+    Pre-translate all items in the catalog without showing any UI.
+
+    Unlike PreTranslateCatalog(), this may be called from any thread, e.g.
+    to process several catalogs at once.
+
+    If not nullptr, report # of pre-translated items in @a matchesCount
+
+    Returns true if any changes were made.
+ */
+bool PreTranslateCatalogHeadless(CatalogPtr catalog, int flags, int *matchesCount);
+
 /**
     Show UI for choosing pre-translation choices, then proceed with
     pre-translation unless cancelled (in which case false is returned).
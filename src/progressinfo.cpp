@@ -35,6 +35,11 @@
 #include <wx/dialog.h>
 #include <wx/button.h>
 #include <wx/config.h>
+#include <wx/timer.h>
+
+#include <algorithm>
+
+#include "edapp.h"
 
 class ProgressDlg : public wxDialog
 {
@@ -58,9 +63,11 @@ BEGIN_EVENT_TABLE(ProgressDlg, wxDialog)
 END_EVENT_TABLE()
 
 ProgressInfo::ProgressInfo(wxWindow *parent, const wxString& title)
+    : m_lastSample(0), m_sampledTotal(0)
 {
     m_cancelled = false;
     m_dlg = new ProgressDlg(&m_cancelled);
+    wxGetApp().LoadXmlResources("progress.xrc");
     wxXmlResource::Get()->LoadDialog(m_dlg, parent, "extractor_progress");
     m_dlg->SetTitle(title);
     m_dlg->Show(true);
@@ -89,6 +96,7 @@ void ProgressInfo::Show()
 
 void ProgressInfo::Done()
 {
+    Monitor(nullptr);
     if (m_disabler)
     {
         delete m_disabler;
@@ -131,6 +139,80 @@ void ProgressInfo::PulseGauge()
     XRCCTRL(*m_dlg, "progress", wxGauge)->Pulse();
 }
 
+bool ProgressInfo::ProcessEvents()
+{
+    // timer events aren't processed here, so sample the monitor explicitly:
+    if (m_monitor && wxGetLocalTimeMillis() - m_lastSample >= SAMPLING_INTERVAL)
+        SampleMonitor();
+
+    // other windows are disabled, so only the dialog gets any user input:
+    wxEventLoop::GetActive()->YieldFor(wxEVT_CATEGORY_UI | wxEVT_CATEGORY_USER_INPUT);
+
+    if (m_cancelled && m_monitor)
+        m_monitor->cancel();
+    return !m_cancelled;
+}
+
+void ProgressInfo::Monitor(std::shared_ptr<dispatch::progress_monitor> monitor,
+                           MessageFormatter formatter)
+{
+    m_monitor = monitor;
+    m_formatter = formatter;
+    m_sampledTotal = 0;
+    m_sampledMessage.clear();
+
+    if (!m_monitor)
+    {
+        m_timer.reset();
+        return;
+    }
+
+    if (!m_timer)
+    {
+        m_timer.reset(new wxTimer);
+        m_timer->Bind(wxEVT_TIMER, [=](wxTimerEvent&){ SampleMonitor(); });
+    }
+    m_timer->Start(SAMPLING_INTERVAL);
+    SampleMonitor();
+}
+
+void ProgressInfo::SampleMonitor()
+{
+    if (!m_monitor || !m_dlg)
+        return;
+
+    m_lastSample = wxGetLocalTimeMillis();
+    if (m_cancelled)
+        m_monitor->cancel();
+
+    const size_t total = m_monitor->total();
+    if (total)
+    {
+        if (total != m_sampledTotal)
+            SetGaugeMax(int(total));
+        ResetGauge(int(std::min(m_monitor->done(), total)));
+    }
+    else
+    {
+        PulseGauge();
+    }
+    m_sampledTotal = total;
+
+    if (m_formatter)
+    {
+        // unlike UpdateMessage(), this doesn't force repainting, which is slow
+        // and shouldn't be done from timer events:
+        auto msg = m_formatter(*m_monitor);
+        if (!msg.empty() && msg != m_sampledMessage)
+        {
+            m_sampledMessage = msg;
+            wxStaticText *txt = XRCCTRL(*m_dlg, "info", wxStaticText);
+            txt->SetLabel(msg);
+            txt->Refresh();
+        }
+    }
+}
+
 void ProgressInfo::UpdateMessage(const wxString& text)
 {
     wxStaticText *txt = XRCCTRL(*m_dlg, "info", wxStaticText);
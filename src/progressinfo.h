@@ -27,10 +27,18 @@
 #define _PROGRESSINFO_H_
 
 #include <wx/string.h>
+#include <wx/time.h>
+
+#include "concurrency.h"
+
+#include <exception>
+#include <functional>
+#include <memory>
 
 class WXDLLIMPEXP_FWD_CORE wxWindow;
 class WXDLLIMPEXP_FWD_CORE wxDialog;
 class WXDLLIMPEXP_FWD_CORE wxWindowDisabler;
+class WXDLLIMPEXP_FWD_BASE wxTimer;
 
 /// This class displays fancy progress dialog.
 class ProgressInfo
@@ -65,14 +73,83 @@ class ProgressInfo
 
             /// Updates informative message.
             void UpdateMessage(const wxString& text);
+
+            /** Processes pending events, so that the dialog stays responsive
+                and can be cancelled while work is done in the background.
+                \return false if user cancelled operation, true otherwise
+             */
+            bool ProcessEvents();
             
             /// Returns whether the user cancelled operation.
             bool Cancelled() const { return m_cancelled; }
-            
+
+            /// Returns text to show for the monitor's current state, or an
+            /// empty string to keep the current message
+            typedef std::function<wxString(const dispatch::progress_monitor&)> MessageFormatter;
+
+            /** Shows progress reported through @a monitor, which may be
+                updated from any thread, until Done() or until another
+                monitor (or nullptr) is set.
+
+                The monitor is sampled periodically, both when the event
+                loop runs and from ProcessEvents(), so workers only need to
+                update its counters. Cancelling the dialog cancels it.
+             */
+            void Monitor(std::shared_ptr<dispatch::progress_monitor> monitor,
+                         MessageFormatter formatter = MessageFormatter());
+
+            /**
+                Runs @a task on a background thread, so that the UI stays
+                responsive, and shows the progress of the monitor set with
+                Monitor() until it finishes.
+
+                Returns the task's result, exceptions are rethrown.
+             */
+            template<typename F>
+            auto RunInBackground(F&& task) -> decltype(task())
+            {
+                typedef decltype(task()) Result;
+
+                // futures don't preserve the type of exceptions, so pass them manually:
+                std::exception_ptr error;
+                auto result = dispatch::async([&task, &error]() -> Result
+                {
+                    try
+                    {
+                        return task();
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                        return Result();
+                    }
+                });
+
+                while (result.wait_for(boost::chrono::milliseconds(SAMPLING_INTERVAL)) != dispatch::future_status::ready)
+                    ProcessEvents();
+
+                auto value = result.get();
+                if (error)
+                    std::rethrow_exception(error);
+                return value;
+            }
+
     private:
+            // how often is the monitor's state shown, in milliseconds:
+            enum { SAMPLING_INTERVAL = 100 };
+
+            void SampleMonitor();
+
             wxDialog *m_dlg;
             bool m_cancelled;
             wxWindowDisabler *m_disabler;
+
+            std::shared_ptr<dispatch::progress_monitor> m_monitor;
+            MessageFormatter m_formatter;
+            std::unique_ptr<wxTimer> m_timer;
+            wxLongLong m_lastSample;
+            size_t m_sampledTotal;
+            wxString m_sampledMessage;
 };
 
 
@@ -58,6 +58,7 @@
 #include "propertiesdlg.h"
 
 #include "colorscheme.h"
+#include "edapp.h"
 #include "hidpi.h"
 #include "language.h"
 #include "str_helpers.h"
@@ -591,6 +592,7 @@ PropertiesDialog::PropertiesDialog(wxWindow *parent, CatalogPtr cat, bool fileEx
 {
     m_hasLang = cat->HasCapability(Catalog::Cap::LanguageSetting);
 
+    wxGetApp().LoadXmlResources("properties.xrc");
     wxXmlResource::Get()->LoadDialog(this, parent, "properties");
 
     m_gettextSettings.reset(new GettextSettings);
@@ -25,10 +25,23 @@
 
 #include "qa_checks.h"
 
+#include "concurrency.h"
+#include "configuration.h"
+#include "format_placeholders.h"
+#include "spellchecking.h"
+#include "str_helpers.h"
+
+#include <unicode/brkiter.h>
 #include <unicode/uchar.h>
 
+#include <wx/log.h>
+#include <wx/tokenzr.h>
 #include <wx/translation.h>
 
+#include <algorithm>
+#include <map>
+#include <set>
+
 
 // -------------------------------------------------------------
 // QACheck implementations
@@ -40,14 +53,14 @@ namespace QA
 class NotAllPlurals : public QACheck
 {
 public:
-    bool CheckItem(CatalogItemPtr item) override
+    IssuePtr CheckItem(const CatalogItem& item) const override
     {
-        if (!item->HasPlural())
-            return false;
+        if (!item.HasPlural())
+            return nullptr;
 
         bool foundTranslated = false;
         bool foundEmpty = false;
-        for (auto& s: item->GetTranslations())
+        for (auto& s: item.GetTranslations())
         {
             if (s.empty())
                 foundEmpty = true;
@@ -56,13 +69,12 @@ public:
         }
 
         if (foundEmpty && foundTranslated)
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _("Not all plural forms are translated."));
-            return true;
-        }
+            return Warning(wxTRANSLATE(L"Not all plural forms are translated."));
 
-        return false;
+        return nullptr;
     }
+
+    bool IsStringCheck() const override { return false; }
 };
 
 
@@ -73,25 +85,19 @@ public:
     {
     }
 
-    bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation) override
+    IssuePtr CheckString(const CatalogItem& /*item*/, const QAString& source, const QAString& translation) const override
     {
-        if (u_isupper(source[0]) && u_islower(translation[0]))
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _("The translation should start as a sentence."));
-            return true;
-        }
+        if (source.FirstIs(QAString::Upper) && translation.FirstIs(QAString::Lower))
+            return Warning(wxTRANSLATE(L"The translation should start as a sentence."));
 
-        if (u_islower(source[0]) && u_isupper(translation[0]))
+        if (source.FirstIs(QAString::Lower) && translation.FirstIs(QAString::Upper))
         {
             if (m_lang != "de")
-            {
-                item->SetIssue(CatalogItem::Issue::Warning, _("The translation should start with a lowercase character."));
-                return true;
-            }
+                return Warning(wxTRANSLATE(L"The translation should start with a lowercase character."));
             // else: German nouns start uppercased, this would cause too many false positives
         }
 
-        return false;
+        return nullptr;
     }
 
 private:
@@ -102,45 +108,27 @@ private:
 class WhitespaceMismatch : public QACheck
 {
 public:
-    bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation) override
+    IssuePtr CheckString(const CatalogItem& /*item*/, const QAString& source, const QAString& translation) const override
     {
-        if (u_isspace(source[0]) && !u_isspace(translation[0]))
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation doesn’t start with a space."));
-            return true;
-        }
+        if (source.FirstIs(QAString::Space) && !translation.FirstIs(QAString::Space))
+            return Warning(wxTRANSLATE(L"The translation doesn’t start with a space."));
 
-        if (!u_isspace(source[0]) && u_isspace(translation[0]))
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation starts with a space, but the source text doesn’t."));
-            return true;
-        }
+        if (!source.FirstIs(QAString::Space) && translation.FirstIs(QAString::Space))
+            return Warning(wxTRANSLATE(L"The translation starts with a space, but the source text doesn’t."));
 
         if (source.Last() == '\n' && translation.Last() != '\n')
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation is missing a newline at the end."));
-            return true;
-        }
+            return Warning(wxTRANSLATE(L"The translation is missing a newline at the end."));
 
         if (source.Last() != '\n' && translation.Last() == '\n')
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation ends with a newline, but the source text doesn’t."));
-            return true;
-        }
+            return Warning(wxTRANSLATE(L"The translation ends with a newline, but the source text doesn’t."));
 
-        if (u_isspace(source.Last()) && !u_isspace(translation.Last()))
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation is missing a space at the end."));
-            return true;
-        }
+        if (source.LastIs(QAString::Space) && !translation.LastIs(QAString::Space))
+            return Warning(wxTRANSLATE(L"The translation is missing a space at the end."));
 
-        if (!u_isspace(source.Last()) && u_isspace(translation.Last()))
-        {
-            item->SetIssue(CatalogItem::Issue::Warning, _(L"The translation ends with a space, but the source text doesn’t."));
-            return true;
-        }
+        if (!source.LastIs(QAString::Space) && translation.LastIs(QAString::Space))
+            return Warning(wxTRANSLATE(L"The translation ends with a space, but the source text doesn’t."));
 
-        return false;
+        return nullptr;
     }
 };
 
@@ -152,7 +140,7 @@ public:
     {
     }
 
-    bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation) override
+    IssuePtr CheckString(const CatalogItem& /*item*/, const QAString& source, const QAString& translation) const override
     {
         if (m_lang == "th" || m_lang == "lo" || m_lang == "km" || m_lang == "my")
         {
@@ -162,62 +150,59 @@ public:
             // It's better to skip them than to spam the user with bogus warnings
             // on _everything_.
             // See https://www.ccjk.com/punctuation-rule-for-bahasa-vietnamese-and-thai/
-            return false;
+            return nullptr;
         }
 
         const UChar32 s_last = source.Last();
         const UChar32 t_last = translation.Last();
-        const bool s_punct = IsPunctuation(s_last);
-        const bool t_punct = IsPunctuation(t_last);
+        const bool s_punct = source.LastIs(QAString::Punctuation);
+        const bool t_punct = translation.LastIs(QAString::Punctuation);
 
-        if (u_getIntPropertyValue(s_last, UCHAR_BIDI_PAIRED_BRACKET_TYPE) == U_BPT_CLOSE ||
-            u_getIntPropertyValue(t_last, UCHAR_BIDI_PAIRED_BRACKET_TYPE) == U_BPT_CLOSE)
+        if (source.LastIs(QAString::ClosingBracket) || translation.LastIs(QAString::ClosingBracket))
         {
             // too many reordering related false positives for brackets
             // e.g. "your {site} account" -> "váš účet na {site}"
-            if ((wchar_t)u_getBidiPairedBracket(s_last) != (wchar_t)source[0])
+            if ((wchar_t)u_getBidiPairedBracket(s_last) != (wchar_t)source.First())
             {
-                return false;
+                return nullptr;
             }
             else
             {
                 // OTOH, it's desirable to check strings fully enclosed in brackets like "(unsaved)"
-                if (source.find_first_of((wchar_t)s_last, 1) != source.size() - 1)
+                if (source.str().find_first_of((wchar_t)s_last, 1) != source.str().size() - 1)
                 {
                     // it's more complicated, possibly something like "your {foo} on {bar}"
-                    return false;
+                    return nullptr;
                 }
             }
         }
 
-        if (u_hasBinaryProperty(s_last, UCHAR_QUOTATION_MARK) || (!s_punct && u_hasBinaryProperty(t_last, UCHAR_QUOTATION_MARK)))
+        if (source.LastIs(QAString::Quote) || (!s_punct && translation.LastIs(QAString::Quote)))
         {
             // quoted fragments can move around, e.g., so ignore quotes in reporting:
             //      >> Invalid value for ‘{fieldName}’​ field
             //      >> Valor inválido para el campo ‘{fieldName}’
             // TODO: count quote characters to check if used correctly in translation; don't check position
-            return false;
+            return nullptr;
         }
 
         if (s_punct && !t_punct)
         {
-            item->SetIssue(CatalogItem::Issue::Warning,
-                           wxString::Format(_(L"The translation should end with “%s”."), wxString(wxUniChar(s_last))));
-            return true;
+            return Warning(wxTRANSLATE(L"The translation should end with “%s”."),
+                           wxString(wxUniChar(s_last)));
         }
         else if (!s_punct && t_punct)
         {
-            item->SetIssue(CatalogItem::Issue::Warning,
-                           wxString::Format(_(L"The translation should not end with “%s”."), wxString(wxUniChar(t_last))));
-            return true;
+            return Warning(wxTRANSLATE(L"The translation should not end with “%s”."),
+                           wxString(wxUniChar(t_last)));
         }
         else if (s_punct && t_punct && s_last != t_last)
         {
-            if (t_last == L'…' && source.EndsWith("..."))
+            if (t_last == L'…' && source.str().EndsWith("..."))
             {
                 // as a special case, allow translating ... (3 dots) as … (ellipsis)
             }
-            else if (u_hasBinaryProperty(s_last, UCHAR_QUOTATION_MARK) && u_hasBinaryProperty(t_last, UCHAR_QUOTATION_MARK))
+            else if (source.LastIs(QAString::Quote) && translation.LastIs(QAString::Quote))
             {
                 // don't check for correct quotes for now, accept any quotations marks as equal
             }
@@ -227,24 +212,15 @@ public:
             }
             else
             {
-                item->SetIssue(CatalogItem::Issue::Warning,
-                               wxString::Format(_(L"The translation ends with “%s”, but the source text ends with “%s”."),
-                                                wxString(wxUniChar(t_last)), wxString(wxUniChar(s_last))));
-                return true;
+                return Warning(wxTRANSLATE(L"The translation ends with “%s”, but the source text ends with “%s”."),
+                               wxString(wxUniChar(t_last)), wxString(wxUniChar(s_last)));
             }
         }
 
-        return false;
+        return nullptr;
     }
 
 private:
-    bool IsPunctuation(UChar32 c) const
-    {
-        return u_hasBinaryProperty(c, UCHAR_TERMINAL_PUNCTUATION) ||
-               u_hasBinaryProperty(c, UCHAR_QUOTATION_MARK) ||
-               c == L'…'; // somehow U+2026 ellipsis is not terminal punctuation
-    }
-
     bool IsEquivalent(UChar32 src, UChar32 trans) const
     {
         if (src == trans)
@@ -303,6 +279,153 @@ private:
 };
 
 
+class PlaceholdersMismatch : public QACheck
+{
+public:
+    IssuePtr CheckItem(const CatalogItem& item) const override
+    {
+        // source placeholders are cached in the item and shared with syntax
+        // highlighting, so that they're found using the item's format syntax:
+        auto source = item.GetSourcePlaceholders();
+        auto& translations = item.GetTranslations();
+        std::vector<wxString> trans;
+        for (size_t i = 0; i < translations.size(); i++)
+        {
+            if (translations[i].empty() || (i > 0 && !item.HasPlural()))
+                continue;
+            auto& src = (i == 0) ? source->singular : source->plural;
+            trans.clear();
+            ExtractPlaceholders(translations[i], source->syntaxes, trans);
+            if (src == trans)
+                continue;
+
+            // plural forms used for just one number may omit it, e.g. "One file" for "%d files":
+            if (item.HasPlural() && std::includes(src.begin(), src.end(), trans.begin(), trans.end()))
+                continue;
+
+            return Warning(wxTRANSLATE(L"The translation doesn’t contain the same placeholders as the source text."));
+        }
+        return nullptr;
+    }
+
+    bool IsStringCheck() const override { return false; }
+};
+
+
+class MarkupMismatch : public QACheck
+{
+public:
+    IssuePtr CheckString(const CatalogItem& /*item*/, const QAString& source, const QAString& translation) const override
+    {
+        if (source.Tags() != translation.Tags())
+            return Warning(wxTRANSLATE(L"Markup tags in the translation don’t match the source text."));
+
+        return nullptr;
+    }
+};
+
+
+class LengthRatio : public QACheck
+{
+public:
+    LengthRatio(double maxRatio)
+        : m_maxRatio(maxRatio),
+          m_issue(Warning(wxString::Format(_("The translation is more than %g times longer than the source text."), maxRatio)))
+    {
+    }
+
+    IssuePtr CheckString(const CatalogItem& /*item*/, const QAString& source, const QAString& translation) const override
+    {
+        // short strings (e.g. abbreviations) legitimately differ in length a lot
+        static const size_t MIN_SOURCE_LENGTH = 10;
+        if (source.Length() < MIN_SOURCE_LENGTH)
+            return nullptr;
+
+        if (translation.Length() > m_maxRatio * source.Length())
+            return m_issue;
+
+        return nullptr;
+    }
+
+private:
+    double m_maxRatio;
+    // the message is the same for all items, so is the issue:
+    IssuePtr m_issue;
+};
+
+
+class Spelling : public QACheck
+{
+public:
+    Spelling(const Language& lang, std::shared_ptr<WordSpellchecker> checker) : m_checker(checker)
+    {
+        UErrorCode err = U_ZERO_ERROR;
+        m_wordIter.reset(icu::BreakIterator::createWordInstance(lang.ToIcu(), err));
+        if (U_FAILURE(err))
+            m_wordIter.reset();
+    }
+
+    IssuePtr CheckString(const CatalogItem& /*item*/, const QAString& source, const QAString& translation) const override
+    {
+        if (!m_wordIter)
+            return nullptr;
+
+        // break iterators aren't thread-safe, but cloning the prototype is
+        // much cheaper than creating a new one:
+        std::unique_ptr<icu::BreakIterator> iter(m_wordIter->clone());
+        const icu::UnicodeString text(str::to_icu(translation.str()));
+        iter->setText(text);
+
+        int32_t start = iter->first();
+        for (int32_t end = iter->next(); end != icu::BreakIterator::DONE; start = end, end = iter->next())
+        {
+            // only words of letters, which excludes numbers, CJK text etc.:
+            const int32_t status = iter->getRuleStatus();
+            if (status < UBRK_WORD_LETTER || status >= UBRK_WORD_LETTER_LIMIT)
+                continue;
+
+            icu::UnicodeString w(text, start, end - start);
+            if (!ShouldCheck(w))
+                continue;
+
+            const wxString word(str::to_wx(w));
+            // names, placeholders and the like are usually the same in the source:
+            if (source.str().find(word) != wxString::npos)
+                continue;
+
+            if (!m_checker->IsCorrect(word))
+                return Warning(wxTRANSLATE(L"“%s” may be misspelled."), word);
+        }
+
+        return nullptr;
+    }
+
+private:
+    // Skips words that are likely identifiers or abbreviations rather than
+    // real words, because spellcheckers only produce false positives for them
+    static bool ShouldCheck(const icu::UnicodeString& word)
+    {
+        if (word.countChar32() < 2)
+            return false;
+
+        bool first = true;
+        for (int32_t i = 0; i < word.length(); i = word.moveIndex32(i, 1))
+        {
+            const UChar32 c = word.char32At(i);
+            if (u_isdigit(c) || c == '_')
+                return false;
+            if (!first && u_isupper(c))
+                return false; // e.g. "HTTP" or "mySetting"
+            first = false;
+        }
+        return true;
+    }
+
+    std::shared_ptr<WordSpellchecker> m_checker;
+    std::unique_ptr<icu::BreakIterator> m_wordIter;
+};
+
+
 } // namespace QA
 
 
@@ -310,30 +433,266 @@ private:
 // QACheck support code
 // -------------------------------------------------------------
 
-bool QACheck::CheckItem(CatalogItemPtr item)
+namespace
 {
-    if (!item->GetTranslation().empty() && CheckString(item, item->GetString(), item->GetTranslation()))
-        return true;
 
-    if (item->HasPlural())
+// Extracts markup tags, normalized to just their name, e.g. <a href="..."> -> <a>
+void ExtractTags(const wxString& s, std::vector<wxString>& out)
+{
+    const size_t len = s.length();
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] != '<')
+            continue;
+
+        size_t j = i + 1;
+        const bool closing = j < len && s[j] == '/';
+        if (closing)
+            j++;
+        if (j >= len || !wxIsalpha(s[j]))
+            continue;
+        const size_t nameBegin = j;
+        while (j < len && (wxIsalnum(s[j]) || s[j] == '_' || s[j] == ':' || s[j] == '-'))
+            j++;
+        const size_t nameEnd = j;
+
+        while (j < len && s[j] != '>' && s[j] != '<')
+            j++;
+        if (j >= len || s[j] != '>')
+            continue; // not a tag, e.g. "a < b"
+
+        const bool empty = !closing && s[j - 1] == '/';
+        wxString tag("<");
+        if (closing)
+            tag += '/';
+        tag += s.substr(nameBegin, nameEnd - nameBegin);
+        if (empty)
+            tag += '/';
+        tag += '>';
+        out.push_back(tag);
+        i = j;
+    }
+    std::sort(out.begin(), out.end());
+}
+
+unsigned char ClassifyCharWithICU(UChar32 c)
+{
+    unsigned char cls = 0;
+    if (u_isspace(c))
+        cls |= QAString::Space;
+    if (u_isupper(c))
+        cls |= QAString::Upper;
+    if (u_islower(c))
+        cls |= QAString::Lower;
+    if (u_hasBinaryProperty(c, UCHAR_QUOTATION_MARK))
+        cls |= QAString::Quote | QAString::Punctuation;
+    if (u_hasBinaryProperty(c, UCHAR_TERMINAL_PUNCTUATION) || c == L'…') // somehow U+2026 ellipsis is not terminal punctuation
+        cls |= QAString::Punctuation;
+    if (u_getIntPropertyValue(c, UCHAR_BIDI_PAIRED_BRACKET_TYPE) == U_BPT_CLOSE)
+        cls |= QAString::ClosingBracket;
+    return cls;
+}
+
+unsigned char ClassifyChar(UChar32 c)
+{
+    // Strings overwhelmingly start and end with ASCII characters, which are
+    // classified with a table lookup instead of several ICU property queries.
+    // The table is filled from ICU too, so the results are always the same.
+    struct AsciiTable
+    {
+        AsciiTable()
+        {
+            for (UChar32 i = 0; i < 128; i++)
+                cls[i] = ClassifyCharWithICU(i);
+        }
+        unsigned char cls[128];
+    };
+    static const AsciiTable s_ascii;
+
+    if (c >= 0 && c < 128)
+        return s_ascii.cls[c];
+    else
+        return ClassifyCharWithICU(c);
+}
+
+} // anonymous namespace
+
+
+QAString::QAString(const wxString& s)
+    : m_str(s),
+      m_length(s.length()),
+      m_first((UChar32)s[0].GetValue()),
+      m_last((UChar32)s.Last().GetValue()),
+      m_hasTags(false)
+{
+    m_firstClass = ClassifyChar(m_first);
+    m_lastClass = (m_length == 1) ? m_firstClass : ClassifyChar(m_last);
+}
+
+const std::vector<wxString>& QAString::Tags() const
+{
+    if (!m_hasTags)
     {
-        unsigned count = item->GetNumberOfTranslations();
-        for (unsigned i = 1; i < count; i++)
+        ExtractTags(m_str, m_tags);
+        m_hasTags = true;
+    }
+    return m_tags;
+}
+
+
+QACheck::IssuePtr QACheck::CheckItem(const CatalogItem& item) const
+{
+    auto& translations = item.GetTranslations();
+    if (!translations.empty() && !translations[0].empty())
+    {
+        if (auto issue = CheckString(item, QAString(item.GetString()), QAString(translations[0])))
+            return issue;
+    }
+
+    if (item.HasPlural())
+    {
+        const QAString source(item.GetPluralString());
+        for (size_t i = 1; i < translations.size(); i++)
         {
-            auto t = item->GetTranslation(i);
-            if (!t.empty() && CheckString(item, item->GetPluralString(), t))
-                return true;
+            if (translations[i].empty())
+                continue;
+            if (auto issue = CheckString(item, source, QAString(translations[i])))
+                return issue;
         }
     }
 
-    return false;
+    return nullptr;
 }
 
 
-bool QACheck::CheckString(CatalogItemPtr /*item*/, const wxString& /*source*/, const wxString& /*translation*/)
+QACheck::IssuePtr QACheck::CheckString(const CatalogItem& /*item*/, const QAString& /*source*/, const QAString& /*translation*/) const
 {
     wxFAIL_MSG("not implemented - must override CheckString OR CheckItem");
-    return false;
+    return nullptr;
+}
+
+
+QACheck::IssuePtr QACheck::Warning(const wxString& message)
+{
+    return std::make_shared<CatalogItem::Issue>(CatalogItem::Issue::Warning, message);
+}
+
+
+QACheck::IssuePtr QACheck::Warning(const wchar_t *text)
+{
+    return CatalogItem::Issue::Shared(CatalogItem::Issue::Warning, text);
+}
+
+
+QACheck::IssuePtr QACheck::Warning(const wchar_t *text, const wxString& arg)
+{
+    SmallStringArray args;
+    args.push_back(arg);
+    return std::make_shared<CatalogItem::Issue>(CatalogItem::Issue::Warning, text, std::move(args));
+}
+
+
+QACheck::IssuePtr QACheck::Warning(const wchar_t *text, const wxString& arg1, const wxString& arg2)
+{
+    SmallStringArray args;
+    args.push_back(arg1);
+    args.push_back(arg2);
+    return std::make_shared<CatalogItem::Issue>(CatalogItem::Issue::Warning, text, std::move(args));
+}
+
+
+// -------------------------------------------------------------
+// QARegistry
+// -------------------------------------------------------------
+
+QARegistry& QARegistry::Get()
+{
+    static QARegistry s_instance;
+    return s_instance;
+}
+
+
+QARegistry::QARegistry()
+{
+    // built-in checks, in the order they are run (the last issue found wins):
+    Register("plurals", [](const Language&, const wxString&){ return std::make_shared<QA::NotAllPlurals>(); }, true);
+    Register("case", [](const Language& lang, const wxString&){ return std::make_shared<QA::CaseMismatch>(lang); }, true);
+    Register("whitespace", [](const Language&, const wxString&){ return std::make_shared<QA::WhitespaceMismatch>(); }, true);
+    Register("punctuation", [](const Language& lang, const wxString&){ return std::make_shared<QA::PunctuationMismatch>(lang); }, true);
+
+    // optional checks, enabled per project:
+    Register("placeholders", [](const Language&, const wxString&){ return std::make_shared<QA::PlaceholdersMismatch>(); });
+    Register("markup", [](const Language&, const wxString&){ return std::make_shared<QA::MarkupMismatch>(); });
+    Register("length-ratio", [](const Language&, const wxString& param)
+    {
+        double ratio;
+        if (!param.ToCDouble(&ratio) || ratio <= 1.0)
+            ratio = 2.0;
+        return std::make_shared<QA::LengthRatio>(ratio);
+    });
+
+    // follows the user's spellchecking preference, unless it's disabled in the project:
+    Register("spelling", [](const Language& lang, const wxString&) -> std::shared_ptr<QACheck>
+    {
+        if (!Config::Current()->enableSpellchecking)
+            return nullptr;
+        auto checker = WordSpellchecker::GetFor(lang);
+        if (!checker)
+            return nullptr;
+        return std::make_shared<QA::Spelling>(lang, checker);
+    }, true);
+}
+
+
+void QARegistry::Register(const wxString& name, Factory factory, bool enabledByDefault)
+{
+    m_rules.push_back({name, factory, enabledByDefault});
+}
+
+
+std::vector<std::shared_ptr<QACheck>> QARegistry::CreateChecks(const Language& lang, const wxString& config) const
+{
+    std::map<wxString, wxString> enabled;
+    std::set<wxString> disabled;
+
+    wxStringTokenizer tkn(config, ",;");
+    while (tkn.HasMoreTokens())
+    {
+        wxString rule = tkn.GetNextToken().Strip(wxString::both);
+        if (rule.empty())
+            continue;
+        if (rule[0] == '-')
+        {
+            disabled.insert(rule.Mid(1).Strip(wxString::both));
+            continue;
+        }
+        wxString param;
+        wxString name = rule.BeforeFirst('=', &param);
+        enabled[name.Strip(wxString::both)] = param.Strip(wxString::both);
+    }
+
+    std::vector<std::shared_ptr<QACheck>> checks;
+    for (auto& r: m_rules)
+    {
+        auto e = enabled.find(r.name);
+        std::shared_ptr<QACheck> check;
+        if (e != enabled.end())
+        {
+            check = r.factory(lang, e->second);
+            enabled.erase(e);
+        }
+        else if (r.enabledByDefault && disabled.find(r.name) == disabled.end())
+        {
+            check = r.factory(lang, wxString());
+        }
+        if (check)
+            checks.push_back(check);
+    }
+
+    for (auto& e: enabled)
+        wxLogTrace("poedit.qa", "unknown QA rule '%s'", e.first);
+
+    return checks;
 }
 
 
@@ -341,44 +700,122 @@ bool QACheck::CheckString(CatalogItemPtr /*item*/, const wxString& /*source*/, c
 // QAChecker
 // -------------------------------------------------------------
 
-int QAChecker::Check(Catalog& catalog)
+int QAChecker::CheckItem(const CatalogItem& item, QACheck::IssuePtr& issue) const
 {
-    // TODO: parallelize this (make async tasks for chunks of the catalog)
-    //       doing it per-checker is MT-unsafe with API that calls SetIssue()!
+    if (item.GetStringUTF8().empty() || (item.HasPlural() && item.GetPluralStringUTF8().empty()))
+        return 0;
+
+    // All checks share the same analyzed strings (see QAString), so that each
+    // string is scanned only once regardless of the number of checks. The
+    // pairs of strings are the same as in QACheck::CheckItem().
+    struct StringPair
+    {
+        StringPair(const QAString& s, const wxString& t) : source(&s), translation(t) {}
+        const QAString *source;
+        QAString translation;
+    };
+
+    auto& translations = item.GetTranslations();
+    const QAString source(item.GetString());
+    std::unique_ptr<QAString> pluralSource;
+    if (item.HasPlural())
+        pluralSource.reset(new QAString(item.GetPluralString()));
+
+    std::vector<StringPair> strings;
+    strings.reserve(translations.size());
+    for (size_t i = 0; i < translations.size(); i++)
+    {
+        if (translations[i].empty())
+            continue;
+        if (i == 0)
+            strings.emplace_back(source, translations[i]);
+        else if (pluralSource)
+            strings.emplace_back(*pluralSource, translations[i]);
+    }
 
+    // all checks are run and counted, but as with SetIssue(), the last
+    // issue found is the one reported:
     int issues = 0;
+    for (auto& c: m_checks)
+    {
+        QACheck::IssuePtr found;
+        if (c->IsStringCheck())
+        {
+            for (auto& s: strings)
+            {
+                found = c->CheckString(item, *s.source, s.translation);
+                if (found)
+                    break;
+            }
+        }
+        else
+        {
+            found = c->CheckItem(item);
+        }
 
-    for (auto& i: catalog.items())
-        issues += Check(i);
+        if (found)
+        {
+            issue = found;
+            issues++;
+        }
+    }
 
     return issues;
 }
 
 
-int QAChecker::Check(CatalogItemPtr item)
+int QAChecker::Check(Catalog& catalog)
 {
-    int issues = 0;
+    return Check(catalog, 0, catalog.items().size());
+}
 
-    for (auto& c: m_checks)
+
+int QAChecker::Check(Catalog& catalog, size_t begin, size_t end)
+{
+    auto& items = catalog.items();
+    end = std::min(end, items.size());
+    const size_t count = end > begin ? end - begin : 0;
+
+    // Checks don't modify the items, so they can be checked concurrently;
+    // the issues are then applied here, on the calling thread.
+    dispatch::parallel_options options;
+    options.min_chunk_size = 1000;
+
+    std::vector<QACheck::IssuePtr> found(count);
+    auto counts = dispatch::parallel_transform(0, count, [this, &items, &found, begin](size_t i)
     {
-        if (item->GetString().empty() || (item->HasPlural() && item->GetPluralString().empty()))
-            continue;
+        return CheckItem(*items[begin + i], found[i]);
+    }, options);
 
-        if (c->CheckItem(item))
-            issues++;
+    int issues = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (counts[i])
+        {
+            issues += counts[i];
+            items[begin + i]->SetIssue(found[i]);
+        }
     }
 
     return issues;
 }
 
 
+int QAChecker::Check(CatalogItemPtr item)
+{
+    QACheck::IssuePtr issue;
+    int issues = CheckItem(*item, issue);
+    if (issues)
+        item->SetIssue(issue);
+    return issues;
+}
+
+
 std::shared_ptr<QAChecker> QAChecker::GetFor(Catalog& catalog)
 {
-    auto lang = catalog.GetLanguage();
     auto c = std::make_shared<QAChecker>();
-    c->AddCheck<QA::NotAllPlurals>();
-    c->AddCheck<QA::CaseMismatch>(lang);
-    c->AddCheck<QA::WhitespaceMismatch>();
-    c->AddCheck<QA::PunctuationMismatch>(lang);
+    auto config = catalog.Header().GetHeader("X-Poedit-QA-Rules");
+    for (auto& check: QARegistry::Get().CreateChecks(catalog.GetLanguage(), config))
+        c->AddCheck(check);
     return c;
 }
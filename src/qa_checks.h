@@ -28,9 +28,64 @@
 
 #include "catalog.h"
 
+#include <functional>
 #include <memory>
 #include <vector>
 
+#include <unicode/umachine.h>
+
+
+/**
+    String checked by QA checks, together with facts about it that the
+    checks need. It only references the string, which must outlive it.
+
+    The facts are computed lazily and only once, no matter how many checks
+    use them, so that enabling more checks doesn't mean scanning the same
+    strings over and over again. The string must not be empty.
+ */
+class QAString
+{
+public:
+    explicit QAString(const wxString& s);
+
+    /// The string itself
+    const wxString& str() const { return m_str; }
+
+    /// Length in characters
+    size_t Length() const { return m_length; }
+
+    /// First and last characters
+    UChar32 First() const { return m_first; }
+    UChar32 Last() const { return m_last; }
+
+    /// Classes of characters, as determined by ICU
+    enum CharClass
+    {
+        Space          = 0x01, ///< u_isspace()
+        Upper          = 0x02, ///< u_isupper()
+        Lower          = 0x04, ///< u_islower()
+        Punctuation    = 0x08, ///< terminal punctuation, quotation mark or ellipsis
+        Quote          = 0x10, ///< quotation mark
+        ClosingBracket = 0x20  ///< closing paired bracket
+    };
+
+    /// Classification of the first and last characters
+    bool FirstIs(CharClass c) const { return (m_firstClass & c) != 0; }
+    bool LastIs(CharClass c) const { return (m_lastClass & c) != 0; }
+
+    /// Sorted markup tags (e.g. "<b>", "</b>" or "<br/>"), without attributes
+    const std::vector<wxString>& Tags() const;
+
+private:
+    const wxString& m_str;
+    size_t m_length;
+    UChar32 m_first, m_last;
+    unsigned char m_firstClass, m_lastClass;
+
+    mutable bool m_hasTags;
+    mutable std::vector<wxString> m_tags;
+};
+
 
 /// Interface for implementing quality checks
 class QACheck
@@ -38,17 +93,79 @@ class QACheck
 public:
     virtual ~QACheck() {}
 
+    typedef std::shared_ptr<CatalogItem::Issue> IssuePtr;
+
     // Implementation has to implement one of the CheckXXX() methods,
     // it doesn't have to implement all of them.
+    //
+    // Checks don't modify the item and must be thread-safe, because
+    // QAChecker checks several items concurrently.
 
     /**
-        Checks given item for issues, possibly calling CatalogItem::SetIssue()
-        to flag it as broken. Returns true if an issue was found, false otherwise.
+        Checks given item for issues. Returns the issue found or nullptr
+        if the item is fine.
      */
-    virtual bool CheckItem(CatalogItemPtr item);
+    virtual IssuePtr CheckItem(const CatalogItem& item) const;
+
+    /// A more convenient API, checking only (non-empty) strings
+    virtual IssuePtr CheckString(const CatalogItem& item, const QAString& source, const QAString& translation) const;
 
-    /// A more convenient API, checking only strings
-    virtual bool CheckString(CatalogItemPtr item, const wxString& source, const wxString& translation);
+    /// Does the check implement CheckString() instead of CheckItem()?
+    virtual bool IsStringCheck() const { return true; }
+
+protected:
+    /// Creates warning-level issue to be returned from checks
+    static IssuePtr Warning(const wxString& message);
+
+    /** Creates warning-level issue with untranslated @a text (marked with
+        wxTRANSLATE()), which is only translated and formatted with the
+        arguments when shown. This is cheaper than formatting the message
+        in advance and issues without arguments are shared.
+     */
+    static IssuePtr Warning(const wchar_t *text);
+    static IssuePtr Warning(const wchar_t *text, const wxString& arg);
+    static IssuePtr Warning(const wchar_t *text, const wxString& arg1, const wxString& arg2);
+};
+
+
+/**
+    Registry of known QA checks ("rules").
+
+    Each rule has a name that is used to enable or disable it in a project's
+    configuration, the X-Poedit-QA-Rules header. Its value is a comma or
+    semicolon separated list of rule names, optionally with a parameter
+    ("length-ratio=1.5"). Names prefixed with "-" disable rules that are
+    otherwise enabled by default, e.g. "placeholders, markup, -case".
+ */
+class QARegistry
+{
+public:
+    /** Creates a check for given language and (possibly empty) parameter.
+        May return nullptr if the check can't be done, e.g. for lack of
+        a spellchecking dictionary.
+     */
+    typedef std::function<std::shared_ptr<QACheck>(const Language& lang, const wxString& param)> Factory;
+
+    static QARegistry& Get();
+
+    /// Registers a rule; should be done at startup, before any checking
+    void Register(const wxString& name, Factory factory, bool enabledByDefault = false);
+
+    /** Creates checks for @a lang as configured by @a config (see above),
+        in registration order.
+     */
+    std::vector<std::shared_ptr<QACheck>> CreateChecks(const Language& lang, const wxString& config) const;
+
+private:
+    QARegistry();
+
+    struct Rule
+    {
+        wxString name;
+        Factory factory;
+        bool enabledByDefault;
+    };
+    std::vector<Rule> m_rules;
 };
 
 
@@ -56,12 +173,17 @@ public:
 class QAChecker
 {
 public:
-    /// Returns checker suitable for given file
+    /// Returns checker suitable for given file, with rules configured for it
     static std::shared_ptr<QAChecker> GetFor(Catalog& catalog);
 
-    /// Checks all items. Returns # of issues found.
+    /** Checks all items, in parallel if called from the main thread,
+        and sets issues on those with problems. Returns # of issues found.
+     */
     int Check(Catalog& catalog);
 
+    /// Checks items [begin, end) of @a catalog as Check(catalog) does.
+    int Check(Catalog& catalog, size_t begin, size_t end);
+
     /// Check a single item. Returns # of issues found.
     int Check(CatalogItemPtr item);
 
@@ -78,6 +200,10 @@ public:
     void AddCheck(std::shared_ptr<QACheck> c) { m_checks.push_back(c); }
 
 protected:
+    /// Runs all checks on the item without modifying it, @a issue is set
+    /// to the issue to report. Returns # of issues found.
+    int CheckItem(const CatalogItem& item, QACheck::IssuePtr& issue) const;
+
     std::vector<std::shared_ptr<QACheck>> m_checks;
 };
 
@@ -30,6 +30,7 @@
 
 #include <sstream>
 
+#include <wx/filename.h>
 #include <wx/init.h>
 #include <wx/intl.h>
 #include <wx/string.h>
@@ -39,6 +40,7 @@
 #include <unicode/putil.h>
 
 #include "catalog.h"
+#include "catalog_po.h"
 
 #if wxUSE_GUI
     #error "compiled with GUI features of wx - not needed"
@@ -47,6 +49,44 @@
 namespace
 {
 
+// Only this many entries of PO files are shown, the rest isn't even parsed:
+const size_t PREVIEW_ENTRIES = 300;
+
+std::string CreateHTMLForFile(const wxString& path)
+{
+    std::ostringstream s;
+
+    wxString ext;
+    wxFileName::SplitPath(path, nullptr, nullptr, &ext);
+    if (POCatalog::CanLoadFile(ext))
+    {
+        POCatalog::Statistics scanned;
+        if (!POCatalog::ScanStatistics(path, scanned))
+            return std::string();
+        auto cat = POCatalog::CreatePreview(path, PREVIEW_ENTRIES);
+        if (!cat || !cat->IsOk())
+            return std::string();
+
+        Catalog::ExportStatistics stats;
+        stats.all = scanned.all;
+        stats.fuzzy = scanned.fuzzy;
+        stats.untranslated = scanned.untranslated;
+        stats.unfinished = scanned.unfinished;
+        stats.words = scanned.words;
+        stats.unfinishedWords = scanned.unfinishedWords;
+        cat->ExportPreviewToHTML(s, stats);
+    }
+    else
+    {
+        auto cat = Catalog::Create(path);
+        if (!cat || !cat->IsOk())
+            return std::string();
+        cat->ExportToHTML(s);
+    }
+
+    return s.str();
+}
+
 CFDataRef CreateHTMLDataForURL(CFURLRef url, CFStringRef contentTypeUTI)
 {
     #pragma unused(contentTypeUTI)
@@ -55,13 +95,10 @@ CFDataRef CreateHTMLDataForURL(CFURLRef url, CFStringRef contentTypeUTI)
     if (!path)
         return NULL;
 
-    auto cat = Catalog::Create(path.AsString());
-    if (!cat || !cat->IsOk())
+    std::string data = CreateHTMLForFile(path.AsString());
+    if (data.empty())
         return NULL;
 
-    std::ostringstream s;
-    cat->ExportToHTML(s);
-    std::string data = s.str();
     return CFDataCreate(NULL, (const UInt8*)data.data(), data.length());
 }
 
@@ -0,0 +1,164 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "recent_files.h"
+
+#ifndef __WXOSX__
+
+#include "concurrency.h"
+
+#include <wx/filename.h>
+#include <wx/intl.h>
+#include <wx/menu.h>
+
+#include <vector>
+
+
+RecentFilesHistory::RecentFilesHistory() : m_refreshing(false)
+{
+}
+
+
+void RecentFilesHistory::RefreshInfo()
+{
+    if (m_refreshing || GetCount() == 0)
+        return;
+    m_refreshing = true;
+
+    std::vector<wxString> files;
+    for (size_t i = 0; i < GetCount(); i++)
+        files.push_back(GetHistoryFile(i));
+
+    dispatch::async(dispatch::priority::bulk, [files]
+    {
+        std::map<wxString, FileInfo> info;
+        for (auto& f: files)
+        {
+            wxFileName fn(f);
+            FileInfo fi;
+            fi.exists = fn.FileExists();
+            if (fi.exists)
+                fi.modified = fn.GetModificationTime();
+            info[f] = fi;
+        }
+        return info;
+    })
+    .then_on_main([this](std::map<wxString, FileInfo> info)
+    {
+        m_refreshing = false;
+        for (auto& i: info)
+            m_info[i.first] = i.second;
+        UpdateMenus();
+    })
+    .catch_all([this](dispatch::exception_ptr)
+    {
+        m_refreshing = false;
+    });
+}
+
+
+void RecentFilesHistory::Load(const wxConfigBase& config)
+{
+    wxFileHistory::Load(config);
+    RefreshInfo();
+}
+
+
+void RecentFilesHistory::AddFileToHistory(const wxString& file)
+{
+    wxFileHistory::AddFileToHistory(file);
+
+    // the file was just opened or saved, so it's there:
+    FileInfo fi;
+    fi.exists = true;
+    m_info[file] = fi;
+
+    // positions of the other files in the menus changed:
+    UpdateMenus();
+}
+
+
+void RecentFilesHistory::RemoveFileFromHistory(size_t i)
+{
+    m_info.erase(GetHistoryFile(i));
+    wxFileHistory::RemoveFileFromHistory(i);
+    UpdateMenus();
+}
+
+
+void RecentFilesHistory::AddFilesToMenu()
+{
+    wxFileHistory::AddFilesToMenu();
+    UpdateMenus();
+}
+
+
+void RecentFilesHistory::AddFilesToMenu(wxMenu *menu)
+{
+    wxFileHistory::AddFilesToMenu(menu);
+    UpdateMenu(menu);
+}
+
+
+void RecentFilesHistory::UpdateMenus()
+{
+    for (auto menu: GetMenus())
+        UpdateMenu(menu);
+}
+
+
+void RecentFilesHistory::UpdateMenu(wxMenu *menu)
+{
+    for (size_t i = 0; i < GetCount(); i++)
+    {
+        auto item = menu->FindItem(GetBaseId() + (int)i);
+        if (!item)
+            continue;
+
+        auto file = GetHistoryFile(i);
+        auto info = m_info.find(file);
+        if (info == m_info.end())
+        {
+            // not known yet, assume it's there
+            item->Enable(true);
+            item->SetHelp(file);
+        }
+        else if (info->second.exists)
+        {
+            item->Enable(true);
+            if (info->second.modified.IsValid())
+                item->SetHelp(wxString::Format("%s (%s)", file, info->second.modified.FormatDate()));
+            else
+                item->SetHelp(file);
+        }
+        else
+        {
+            item->Enable(false);
+            item->SetHelp(wxString::Format(_(L"File “%s” doesn’t exist."), file));
+        }
+    }
+}
+
+#endif // !__WXOSX__
@@ -0,0 +1,77 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_recent_files_h
+#define Poedit_recent_files_h
+
+#ifndef __WXOSX__
+
+#include <wx/datetime.h>
+#include <wx/filehistory.h>
+
+#include <map>
+
+
+/**
+    File history that knows which of the recent files are still available.
+
+    Metadata of the files (existence and modification time) is fetched in
+    the background, because recent paths may point to removable media or
+    network shares that take long to respond or time out. Until it is known,
+    entries are shown as usual; unavailable files are then disabled in all
+    menus using the history.
+ */
+class RecentFilesHistory : public wxFileHistory
+{
+public:
+    struct FileInfo
+    {
+        bool exists = false;
+        wxDateTime modified;
+    };
+
+    RecentFilesHistory();
+
+    /// Starts (asynchronous) update of the files' metadata
+    void RefreshInfo();
+
+    void Load(const wxConfigBase& config) override;
+    void AddFileToHistory(const wxString& file) override;
+    void RemoveFileFromHistory(size_t i) override;
+    void AddFilesToMenu() override;
+    void AddFilesToMenu(wxMenu *menu) override;
+
+private:
+    void UpdateMenus();
+    void UpdateMenu(wxMenu *menu);
+
+    // last known state of the files, keyed by path:
+    std::map<wxString, FileInfo> m_info;
+    bool m_refreshing;
+};
+
+#endif // !__WXOSX__
+
+#endif // Poedit_recent_files_h
@@ -0,0 +1,306 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "search_index.h"
+
+#include "unicode_helpers.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace
+{
+
+// Number of items indexed at once, between processing other events
+const int ITEMS_PER_STEP = 1000;
+
+// Minimum number of edited items that make rebuilding worthwhile; more are
+// required in large catalogs, as a fraction of their size
+const size_t MIN_DIRTY_FOR_REBUILD = 1000;
+const int DIRTY_FRACTION_FOR_REBUILD = 16;
+
+/// Calls @a func for every trigram in normalized @a text
+template<typename F>
+void ForEachTrigram(const wxString& text_, F&& func)
+{
+    const wxString text = unicode::fold_case(text_);
+
+    uint64_t trigram = 0;
+    int count = 0;
+    for (wxUniChar ch: text)
+    {
+        if (ch == '&' || ch == '_')
+            continue;
+        trigram = ((trigram << 21) | (ch.GetValue() & 0x1FFFFF)) & ((uint64_t(1) << 63) - 1);
+        if (++count >= 3)
+            func(trigram);
+    }
+}
+
+void CollectTrigrams(const wxString& text, std::vector<uint64_t>& out)
+{
+    ForEachTrigram(text, [&out](uint64_t t){ out.push_back(t); });
+}
+
+/// Intersects sorted @a a with postings @a b, in place
+void Intersect(std::vector<int>& a, const std::vector<int>& b)
+{
+    auto end = std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), a.begin());
+    a.erase(end, a.end());
+}
+
+} // anonymous namespace
+
+
+void CatalogSearchIndex::Postings::Add(int index)
+{
+    unsigned delta = unsigned(index - last);
+    last = index;
+    while (delta >= 0x80)
+    {
+        data.push_back(uint8_t(delta | 0x80));
+        delta >>= 7;
+    }
+    data.push_back(uint8_t(delta));
+}
+
+
+void CatalogSearchIndex::Postings::Decode(std::vector<int>& out) const
+{
+    out.clear();
+    int index = -1;
+    unsigned delta = 0;
+    int shift = 0;
+    for (auto byte: data)
+    {
+        delta |= unsigned(byte & 0x7F) << shift;
+        if (byte & 0x80)
+        {
+            shift += 7;
+            continue;
+        }
+        index += int(delta);
+        out.push_back(index);
+        delta = 0;
+        shift = 0;
+    }
+}
+
+
+CatalogSearchIndex::CatalogSearchIndex() : m_generation(0), m_built(0), m_count(0)
+{
+}
+
+
+void CatalogSearchIndex::SetCatalog(const CatalogPtr& catalog)
+{
+    m_catalog = catalog;
+    Rebuild();
+}
+
+
+void CatalogSearchIndex::Rebuild()
+{
+    m_generation++;
+    m_postings.clear();
+    m_dirty.clear();
+    m_folded.clear();
+    m_built = 0;
+
+    auto catalog = m_catalog.lock();
+    m_count = catalog ? (int)catalog->GetCount() : 0;
+    if (m_count > 0)
+    {
+        const unsigned generation = m_generation;
+        CallAfter([=]{ BuildSome(generation); });
+    }
+}
+
+
+void CatalogSearchIndex::BuildSome(unsigned generation)
+{
+    if (generation != m_generation)
+        return;
+
+    auto catalog = m_catalog.lock();
+    if (!catalog || (int)catalog->GetCount() != m_count)
+        return; // SetCatalog() or Rebuild() will follow
+
+    const int end = std::min(m_count, m_built + ITEMS_PER_STEP);
+    for (; m_built < end; m_built++)
+        IndexItem(m_built, *(*catalog)[m_built]);
+
+    if (m_built < m_count)
+        CallAfter([=]{ BuildSome(generation); });
+}
+
+
+void CatalogSearchIndex::IndexItem(int index, const CatalogItem& item)
+{
+    std::vector<Trigram> trigrams;
+    CollectTrigrams(item.GetString(), trigrams);
+    if (item.HasPlural())
+        CollectTrigrams(item.GetPluralString(), trigrams);
+    for (auto& t: item.GetTranslations())
+        CollectTrigrams(t, trigrams);
+    CollectTrigrams(item.GetComment(), trigrams);
+    for (auto& c: item.GetExtractedComments())
+        CollectTrigrams(c, trigrams);
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    for (auto t: trigrams)
+        m_postings[t].Add(index);
+}
+
+
+void CatalogSearchIndex::ItemChanged(int index)
+{
+    if (index >= 0 && index < (int)m_folded.size())
+        m_folded[index].reset();
+
+    // items not indexed yet will be indexed with their current texts:
+    if (index < 0 || index >= m_built)
+        return;
+
+    m_dirty.push_back(index);
+
+    const size_t limit = std::max(MIN_DIRTY_FOR_REBUILD, size_t(m_count / DIRTY_FRACTION_FOR_REBUILD));
+    if (m_dirty.size() > limit)
+    {
+        SortDirty();
+        if (m_dirty.size() > limit)
+            Rebuild();
+    }
+}
+
+
+const CatalogSearchIndex::FoldedTexts& CatalogSearchIndex::GetFoldedTexts(int index, const CatalogItem& item)
+{
+    if (index >= (int)m_folded.size())
+        m_folded.resize(std::max(index + 1, m_count));
+
+    auto& cached = m_folded[index];
+    if (!cached)
+    {
+        auto fold = [](const wxString& s)
+        {
+            FoldedText f;
+            f.text = unicode::fold_case(s);
+            f.hasMnemonics = f.text.find_first_of(L"&_") != wxString::npos;
+            if (f.hasMnemonics)
+            {
+                f.withoutMnemonics = f.text;
+                f.withoutMnemonics.Replace("&", "");
+                f.withoutMnemonics.Replace("_", "");
+            }
+            return f;
+        };
+
+        cached.reset(new FoldedTexts);
+        cached->string = fold(item.GetString());
+        if (item.HasPlural())
+            cached->plural = fold(item.GetPluralString());
+        cached->comment = fold(item.GetComment());
+        for (auto& t: item.GetTranslations())
+            cached->translations.push_back(fold(t));
+        for (auto& c: item.GetExtractedComments())
+            cached->extractedComments.push_back(fold(c));
+    }
+
+    return *cached;
+}
+
+
+void CatalogSearchIndex::SortDirty()
+{
+    std::sort(m_dirty.begin(), m_dirty.end());
+    m_dirty.erase(std::unique(m_dirty.begin(), m_dirty.end()), m_dirty.end());
+}
+
+
+bool CatalogSearchIndex::IsReady() const
+{
+    auto catalog = m_catalog.lock();
+    return catalog && m_count > 0 && m_built == m_count && (int)catalog->GetCount() == m_count;
+}
+
+
+bool CatalogSearchIndex::FindCandidates(const wxString& text, std::vector<int>& candidates)
+{
+    if (!IsReady())
+        return false;
+
+    std::vector<Trigram> trigrams;
+    CollectTrigrams(text, trigrams);
+    if (trigrams.empty())
+        return false;
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    // Intersect postings of all the trigrams, starting with the shortest
+    // ones, so that the intermediate results are as small as possible:
+    std::vector<const Postings*> postings;
+    postings.reserve(trigrams.size());
+    for (auto t: trigrams)
+    {
+        auto p = m_postings.find(t);
+        if (p == m_postings.end())
+        {
+            postings.clear();
+            break;
+        }
+        postings.push_back(&p->second);
+    }
+    std::sort(postings.begin(), postings.end(),
+              [](const Postings *a, const Postings *b){ return a->data.size() < b->data.size(); });
+
+    candidates.clear();
+    if (!postings.empty())
+    {
+        postings.front()->Decode(candidates);
+        std::vector<int> decoded;
+        for (size_t i = 1; i < postings.size() && !candidates.empty(); i++)
+        {
+            postings[i]->Decode(decoded);
+            Intersect(candidates, decoded);
+        }
+    }
+
+    // edited items may contain the text now even if they didn't before:
+    if (!m_dirty.empty())
+    {
+        SortDirty();
+
+        std::vector<int> merged;
+        merged.reserve(candidates.size() + m_dirty.size());
+        std::set_union(candidates.begin(), candidates.end(), m_dirty.begin(), m_dirty.end(), std::back_inserter(merged));
+        candidates.swap(merged);
+    }
+
+    return true;
+}
@@ -0,0 +1,141 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_search_index_h
+#define Poedit_search_index_h
+
+#include "catalog.h"
+
+#include <wx/event.h>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+    Index of trigrams (triples of consecutive characters) occurring in texts
+    of a catalog's items, used to quickly find items that may contain some
+    searched text instead of examining all of them.
+
+    The index is conservative: every item containing the text is among the
+    candidates, but not every candidate contains it, so they must still be
+    checked. Indexed texts are normalized (case-folded, without '&' and '_'
+    accelerator markers), so that it works for any search options.
+
+    It is built incrementally when the UI is idle, on the main thread, which
+    avoids both blocking the UI and racing with edits. Edited items are
+    tracked as dirty and always reported as candidates, until there are
+    enough of them to rebuild the index.
+ */
+class CatalogSearchIndex : public wxEvtHandler
+{
+public:
+    CatalogSearchIndex();
+
+    /** Starts indexing @a catalog, forgetting any previous one. Pass nullptr
+        to only forget it. */
+    void SetCatalog(const CatalogPtr& catalog);
+
+    /// Must be called after the item at @a index changed
+    void ItemChanged(int index);
+
+    /// Rebuilds the index, e.g. after a change to texts of many items
+    void Rebuild();
+
+    /// Is the index complete and usable?
+    bool IsReady() const;
+
+    /** Finds items that may contain @a text in their source texts,
+        translations or comments.
+
+        On success, fills @a candidates with their indexes in the catalog,
+        in ascending order. Returns false if the index can't help, because
+        it isn't ready yet or @a text is too short; all items must be
+        searched then.
+     */
+    bool FindCandidates(const wxString& text, std::vector<int>& candidates);
+
+    /// Case-folded text, see unicode::fold_case()
+    struct FoldedText
+    {
+        wxString text;
+        // also without '&' and '_', if different from text:
+        wxString withoutMnemonics;
+        bool hasMnemonics;
+    };
+
+    /// Case-folded copies of an item's searched texts
+    struct FoldedTexts
+    {
+        FoldedText string, plural, comment;
+        std::vector<FoldedText> translations, extractedComments;
+    };
+
+    /** Returns case-folded texts of @a item at @a index, for case-insensitive
+        search without folding the same texts over and over again.
+
+        They are computed on first use and kept until the item changes.
+     */
+    const FoldedTexts& GetFoldedTexts(int index, const CatalogItem& item);
+
+private:
+    typedef uint64_t Trigram;
+
+    // item indexes, in ascending order, encoded as variable length deltas
+    struct Postings
+    {
+        Postings() : last(-1) {}
+        void Add(int index);
+        void Decode(std::vector<int>& out) const;
+
+        std::vector<uint8_t> data;
+        int last;
+    };
+
+    void BuildSome(unsigned generation);
+    void IndexItem(int index, const CatalogItem& item);
+    void SortDirty();
+
+private:
+    std::weak_ptr<Catalog> m_catalog;
+
+    // incremented on every restart, to ignore already scheduled steps:
+    unsigned m_generation;
+    // the first m_built items of the catalog were indexed:
+    int m_built;
+    int m_count;
+
+    std::unordered_map<Trigram, Postings> m_postings;
+
+    // items changed after they were indexed (unsorted, may repeat):
+    std::vector<int> m_dirty;
+
+    // cache for GetFoldedTexts(), by item index:
+    std::vector<std::unique_ptr<FoldedTexts>> m_folded;
+};
+
+#endif // Poedit_search_index_h
@@ -26,6 +26,7 @@
 #include "sidebar.h"
 
 #include "catalog.h"
+#include "catalog_translation_index.h"
 #include "customcontrols.h"
 #include "colorscheme.h"
 #include "commentdlg.h"
@@ -36,6 +37,7 @@
 #include "utility.h"
 #include "unicode_helpers.h"
 
+#include "tm/glossary.h"
 #include "tm/suggestions.h"
 #include "tm/transmem.h"
 
@@ -55,6 +57,32 @@
 #endif
 
 #include <algorithm>
+#include <set>
+
+
+namespace
+{
+
+// Adds @a hits to @a all, keeping only the best scored suggestion if
+// several of them have the same translation.
+void MergeSuggestions(SuggestionsList& all, const SuggestionsList& hits)
+{
+    for (auto& h: hits)
+    {
+        // empty entries screw up menus (treated as stock items), don't use them:
+        if (h.text.empty())
+            continue;
+
+        auto found = std::find_if(all.begin(), all.end(),
+                                  [&h](const Suggestion& x){ return x.text == h.text; });
+        if (found == all.end())
+            all.push_back(h);
+        else if (h.score > found->score)
+            *found = h;
+    }
+}
+
+} // anonymous namespace
 
 
 class SidebarSeparator : public wxWindow
@@ -125,6 +153,138 @@ void SidebarBlock::SetItem(const CatalogItemPtr& item)
 }
 
 
+/**
+    Glossary terms occurring in the source text, see Glossary.
+
+    Terms are found for all items of the catalog in the background when it
+    is shown, so that switching items doesn't need any searching.
+ */
+class GlossarySidebarBlock : public SidebarBlock
+{
+public:
+    GlossarySidebarBlock(Sidebar *parent)
+        : SidebarBlock(parent, _("Glossary:")), m_generation(0)
+    {
+        m_innerSizer->AddSpacer(PX(5));
+        m_terms = new SelectableAutoWrappingText(parent, "");
+        m_innerSizer->Add(m_terms, wxSizerFlags().Expand());
+    }
+
+    bool ShouldShowForItem(const CatalogItemPtr& item) const override
+    {
+        m_matches = FindTerms(item);
+        return !m_matches.empty();
+    }
+
+    void Update(const CatalogItemPtr&) override
+    {
+        wxString text;
+        std::set<std::wstring> shown;
+        for (auto& m: m_matches)
+        {
+            if (!shown.insert(m.term).second)
+                continue;
+            if (!text.empty())
+                text += '\n';
+            wxString translations;
+            for (auto& t: m.translations)
+            {
+                if (!translations.empty())
+                    translations += ", ";
+                translations += t;
+            }
+            text += wxString::Format(L"%s → %s", m.term, translations);
+            if (!m.note.empty())
+                text += wxString::Format(" (%s)", m.note);
+        }
+        m_terms->SetAndWrapLabel(text);
+    }
+
+private:
+    // Terms for all items of a catalog, by item index
+    struct Precomputed
+    {
+        std::weak_ptr<Catalog> catalog;
+        Language srclang, lang;
+        uint64_t version = 0;
+        std::vector<std::wstring> sources;
+        std::vector<Glossary::Matches> matches;
+        bool ready = false;
+    };
+
+    Glossary::Matches FindTerms(const CatalogItemPtr& item) const
+    {
+        if (Config::GlossaryPaths().empty())
+            return Glossary::Matches();
+
+        auto catalog = m_parent->GetCatalog();
+        auto srclang = m_parent->GetCurrentSourceLanguage();
+        auto lang = m_parent->GetCurrentLanguage();
+        auto& glossary = Glossary::Get();
+        auto version = glossary.GetCacheVersion(srclang, lang);
+
+        auto source = item->GetString().ToStdWstring();
+
+        if (m_precomputed && m_precomputed->catalog.lock() == catalog &&
+            m_precomputed->srclang == srclang && m_precomputed->lang == lang && m_precomputed->version == version)
+        {
+            const size_t index = size_t(item->GetId() - 1);
+            if (m_precomputed->ready && index < m_precomputed->sources.size() && m_precomputed->sources[index] == source)
+                return m_precomputed->matches[index];
+        }
+        else if (catalog)
+        {
+            Precompute(catalog, srclang, lang, version);
+        }
+
+        // not precomputed (yet), which is still fast enough for one item:
+        return glossary.FindTerms(srclang, lang, source);
+    }
+
+    void Precompute(const CatalogPtr& catalog, const Language& srclang, const Language& lang, uint64_t version) const
+    {
+        auto p = std::make_shared<Precomputed>();
+        p->catalog = catalog;
+        p->srclang = srclang;
+        p->lang = lang;
+        p->version = version;
+        // copied here, the items must not be accessed from other threads:
+        p->sources.reserve(catalog->items().size());
+        for (auto& i: catalog->items())
+            p->sources.push_back(i->GetString().ToStdWstring());
+
+        m_precomputed = p;
+        auto generation = ++m_generation;
+        std::weak_ptr<const GlossarySidebarBlock> weakSelf = std::dynamic_pointer_cast<const GlossarySidebarBlock>(shared_from_this());
+
+        dispatch::async(dispatch::priority::bulk, [p]
+        {
+            auto& glossary = Glossary::Get();
+            std::vector<Glossary::Matches> matches;
+            matches.reserve(p->sources.size());
+            for (auto& s: p->sources)
+                matches.push_back(glossary.FindTerms(p->srclang, p->lang, s));
+            return matches;
+        })
+        .then_on_main([weakSelf,generation,p](std::vector<Glossary::Matches> matches)
+        {
+            auto self = weakSelf.lock();
+            if (!self || self->m_generation != generation)
+                return;
+            p->matches = std::move(matches);
+            p->ready = true;
+        })
+        .catch_all([](dispatch::exception_ptr){});
+    }
+
+private:
+    SelectableAutoWrappingText *m_terms;
+    mutable Glossary::Matches m_matches;
+    mutable std::shared_ptr<Precomputed> m_precomputed;
+    mutable uint64_t m_generation;
+};
+
+
 class OldMsgidSidebarBlock : public SidebarBlock
 {
 public:
@@ -319,9 +479,16 @@ public:
         Bind(wxEVT_PAINT, &SuggestionWidget::OnPaint, this);
     }
 
-    void SetValue(int index, const Suggestion& s, Language lang, const wxString& icon, const wxString& tooltip)
+    /// Returns false if nothing visible changed and no relayout is needed
+    bool SetValue(int index, const Suggestion& s, Language lang, const wxString& icon, const wxString& tooltip)
     {
+        const bool same = index == m_index && lang == m_lang &&
+                          s.text == m_value.text && s.score == m_value.score && s.source == m_value.source;
         m_value = s;
+        if (same)
+            return false;
+        m_index = index;
+        m_lang = lang;
 
         int percent = int(100 * s.score);
         auto percentStr = wxString::Format("%d%%", percent);
@@ -366,6 +533,7 @@ public:
         InvalidateBestSize();
         SetMinSize(wxDefaultSize);
         SetMinSize(GetBestSize());
+        return true;
     }
     
     bool AcceptsFocus() const override { return false; }
@@ -484,6 +652,8 @@ private:
     Sidebar *m_sidebar;
     SuggestionsSidebarBlock *m_parentBlock;
     Suggestion m_value;
+    int m_index = -1;
+    Language m_lang;
     bool m_isHighlighted;
     StaticBitmap *m_icon;
     AutoWrappingText *m_text;
@@ -499,8 +669,12 @@ SuggestionsSidebarBlock::SuggestionsSidebarBlock(Sidebar *parent, wxMenu *menu)
       m_suggestionsMenu(menu),
       m_msgPresent(false),
       m_suggestionsSeparator(nullptr),
+      m_suggestionsSeparatorPos(-1),
+      m_layoutPending(false),
       m_pendingQueries(0),
       m_latestQueryId(0),
+      m_prefetchGeneration(0),
+      m_showingPrefetched(false),
       m_lastUpdateTime(0)
 {
     m_provider.reset(new SuggestionsProvider);
@@ -558,8 +732,21 @@ wxString SuggestionsSidebarBlock::GetIconForSuggestion(const Suggestion&) const
     return "SuggestionTMTemplate";
 }
 
-wxString SuggestionsSidebarBlock::GetTooltipForSuggestion(const Suggestion&) const
+wxString SuggestionsSidebarBlock::GetTooltipForSuggestion(const Suggestion& s) const
 {
+    switch (s.source)
+    {
+        case Suggestion::Source::SharedTM:
+            return _(L"This string was found in a shared translation memory.");
+        case Suggestion::Source::MachineTranslation:
+            return _(L"This string was suggested by machine translation.");
+        case Suggestion::Source::Glossary:
+            return _(L"This string was found in the glossary.");
+        case Suggestion::Source::CurrentFile:
+            return _(L"This string is translated elsewhere in this file.");
+        case Suggestion::Source::LocalTM:
+            break;
+    }
     return _(L"This string was found in Poedit’s translation memory.");
 }
 
@@ -588,46 +775,43 @@ void SuggestionsSidebarBlock::ReportError(SuggestionsBackend*, dispatch::excepti
 void SuggestionsSidebarBlock::ClearSuggestions()
 {
     m_suggestions.clear();
+    m_showingPrefetched = false;
     UpdateSuggestionsMenu();
     UpdateVisibility();
 }
 
 void SuggestionsSidebarBlock::UpdateSuggestions(const SuggestionsList& hits)
 {
-    wxWindowUpdateLocker lock(m_parent);
-
-    for (auto& h: hits)
-    {
-        // empty entries screw up menus (treated as stock items), don't use them:
-        if (!h.text.empty())
-            m_suggestions.push_back(h);
-    }
+    // different backends may suggest the same translation, show it only
+    // once with the best score:
+    MergeSuggestions(m_suggestions, hits);
 
     std::stable_sort(m_suggestions.begin(), m_suggestions.end());
 
-    // create any necessary controls:
+    bool changed = false;
+
+    // create any necessary controls; existing ones are reused:
     while (m_suggestions.size() > m_suggestionsWidgets.size())
     {
         auto w = new SuggestionWidget(m_parent, this, /*isFirst=*/m_suggestionsWidgets.empty());
         m_suggestionsSizer->Add(w, wxSizerFlags().Expand());
         m_suggestionsWidgets.push_back(w);
+        changed = true;
     }
-    m_innerSizer->Layout();
-
-    // update shown suggestions:
-
-    if (m_suggestionsSeparator)
-    {
-        m_suggestionsSeparator->Hide();
-        m_suggestionsSizer->Detach(m_suggestionsSeparator);
-    }
+    if (changed)
+        m_innerSizer->Layout();
 
+    // update shown suggestions, touching only widgets whose content differs:
     auto lang = m_parent->GetCurrentLanguage();
     int perfectMatches = 0;
+    int separatorPos = -1;
     for (size_t i = 0; i < m_suggestions.size(); ++i)
     {
         auto s = m_suggestions[i];
-        m_suggestionsWidgets[i]->SetValue((int)i, s, lang, GetIconForSuggestion(s), GetTooltipForSuggestion(s));
+        auto w = m_suggestionsWidgets[i];
+        // hidden widgets (e.g. after ClearSuggestions()) need UpdateVisibility() even if unchanged:
+        if (w->SetValue((int)i, s, lang, GetIconForSuggestion(s), GetTooltipForSuggestion(s)) || !w->IsShown())
+            changed = true;
 
         if (s.IsExactMatch())
         {
@@ -635,24 +819,59 @@ void SuggestionsSidebarBlock::UpdateSuggestions(const SuggestionsList& hits)
         }
         else
         {
-            if (perfectMatches > 1)
-            {
-                if (!m_suggestionsSeparator)
-                    m_suggestionsSeparator = new SidebarSeparator(m_parent);
-                m_suggestionsSeparator->Show();
-                m_suggestionsSizer->Insert(i, m_suggestionsSeparator, wxSizerFlags().Expand().Border(wxBOTTOM, MSW_OR_OTHER(PX(2), PX(4))));
-            }
+            if (perfectMatches > 1 && separatorPos == -1)
+                separatorPos = (int)i;
             perfectMatches = 0;
         }
     }
 
-    m_innerSizer->Layout();
-    UpdateVisibility();
-    m_parent->Layout();
+    if (separatorPos != m_suggestionsSeparatorPos)
+    {
+        if (m_suggestionsSeparator && m_suggestionsSeparatorPos != -1)
+        {
+            m_suggestionsSeparator->Hide();
+            m_suggestionsSizer->Detach(m_suggestionsSeparator);
+        }
+        if (separatorPos != -1)
+        {
+            if (!m_suggestionsSeparator)
+                m_suggestionsSeparator = new SidebarSeparator(m_parent);
+            m_suggestionsSeparator->Show();
+            m_suggestionsSizer->Insert(separatorPos, m_suggestionsSeparator, wxSizerFlags().Expand().Border(wxBOTTOM, MSW_OR_OTHER(PX(2), PX(4))));
+        }
+        m_suggestionsSeparatorPos = separatorPos;
+        changed = true;
+    }
+
+    if (changed)
+        ScheduleLayout();
 
     UpdateSuggestionsMenu();
 }
 
+void SuggestionsSidebarBlock::ScheduleLayout()
+{
+    // Results from several backends typically arrive in quick succession;
+    // lay out only once for all of them, when the event loop gets to it:
+    if (m_layoutPending)
+        return;
+    m_layoutPending = true;
+
+    std::weak_ptr<SuggestionsSidebarBlock> weakSelf = std::dynamic_pointer_cast<SuggestionsSidebarBlock>(shared_from_this());
+    m_parent->CallAfter([weakSelf]
+    {
+        auto self = weakSelf.lock();
+        if (!self)
+            return;
+        self->m_layoutPending = false;
+
+        wxWindowUpdateLocker lock(self->m_parent);
+        self->m_innerSizer->Layout();
+        self->UpdateVisibility();
+        self->m_parent->Layout();
+    });
+}
+
 void SuggestionsSidebarBlock::BuildSuggestionsMenu(int count)
 {
     m_suggestionMenuItems.reserve(SUGGESTIONS_MENU_ENTRIES);
@@ -731,6 +950,9 @@ void SuggestionsSidebarBlock::OnQueriesFinished()
         m_innerSizer->Show(m_iGotNothing);
         m_parent->Layout();
     }
+
+    // now that the user has what they asked for, get ready for what's next:
+    PrefetchUpcoming();
 }
 
 void SuggestionsSidebarBlock::UpdateVisibility()
@@ -767,6 +989,11 @@ void SuggestionsSidebarBlock::Show(bool show)
     }
 }
 
+bool SuggestionsSidebarBlock::IsBusy() const
+{
+    return m_pendingQueries > 0 || m_suggestionsTimer.IsRunning() || m_layoutPending;
+}
+
 bool SuggestionsSidebarBlock::ShouldShowForItem(const CatalogItemPtr&) const
 {
     return m_parent->FileHasCapability(Catalog::Cap::Translations) &&
@@ -783,6 +1010,12 @@ void SuggestionsSidebarBlock::Update(const CatalogItemPtr& item)
 
 void SuggestionsSidebarBlock::UpdateSuggestionsForItem(CatalogItemPtr item)
 {
+    // Results for the previously selected item are no longer needed, don't
+    // let their searches clog the background queue:
+    m_queryCancellation.cancel();
+    m_queryCancellation = dispatch::cancellation_token();
+    m_latestQueryId++;
+
     if (!item)
         return;
 
@@ -790,6 +1023,11 @@ void SuggestionsSidebarBlock::UpdateSuggestionsForItem(CatalogItemPtr item)
     long long delta = now - m_lastUpdateTime;
     m_lastUpdateTime = now;
 
+    // If we already have suggestions for this item, show them right away,
+    // even when throttling. They are refreshed by querying as usual below,
+    // because the TM may have been updated since they were fetched.
+    ShowPrefetched(item);
+
     if (delta < 100)
     {
         // User is probably holding arrow down and going through the list as crazy
@@ -823,7 +1061,30 @@ void SuggestionsSidebarBlock::OnDelayedShowSuggestionsForItem(wxTimerEvent&)
 void SuggestionsSidebarBlock::QueryAllProviders(const CatalogItemPtr& item)
 {
     auto thisQueryId = ++m_latestQueryId;
-    QueryProvider(TranslationMemory::Get(), item, thisQueryId);
+
+    // Translations of the same text elsewhere in the file are known right
+    // away, show them without waiting for the other backends:
+    if (auto catalog = m_parent->GetCatalog())
+    {
+        auto hits = catalog->GetTranslationIndex()->SuggestionsFor(*item);
+        if (!hits.empty())
+        {
+            if (m_showingPrefetched)
+            {
+                m_showingPrefetched = false;
+                m_suggestions.clear();
+            }
+            UpdateSuggestions(hits);
+        }
+    }
+
+    // Backends are queried in parallel and results from each of them are
+    // shown as soon as they arrive, so that slow ones don't hold up the rest:
+    for (auto& b: SuggestionsBackendRegistry::GetEnabled())
+        QueryProvider(*b.second, item, thisQueryId);
+
+    if (!m_pendingQueries)
+        OnQueriesFinished();
 }
 
 void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const CatalogItemPtr& item, uint64_t queryId)
@@ -841,13 +1102,19 @@ void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const C
         item->GetString().ToStdWstring()
     };
 
-    m_provider->SuggestTranslation(backend, std::move(query))
+    m_provider->SuggestTranslation(backend, std::move(query), m_queryCancellation)
     .then_on_main([weakSelf,queryId](SuggestionsList hits)
     {
         auto self = weakSelf.lock();
         // maybe this call is already out of date:
         if (!self || self->m_latestQueryId != queryId)
             return;
+        if (self->m_showingPrefetched)
+        {
+            // replace possibly outdated prefetched results with fresh ones:
+            self->m_showingPrefetched = false;
+            self->m_suggestions.clear();
+        }
         self->UpdateSuggestions(hits);
         if (--self->m_pendingQueries == 0)
             self->OnQueriesFinished();
@@ -864,6 +1131,120 @@ void SuggestionsSidebarBlock::QueryProvider(SuggestionsBackend& backend, const C
     });
 }
 
+void SuggestionsSidebarBlock::ShowPrefetched(const CatalogItemPtr& item)
+{
+    if (!(m_prefetchedSrcLang == m_parent->GetCurrentSourceLanguage()) ||
+        !(m_prefetchedLang == m_parent->GetCurrentLanguage()))
+    {
+        return;
+    }
+
+    auto found = m_prefetched.find(item->GetString().ToStdWstring());
+    if (found == m_prefetched.end() || found->second.pending || found->second.failed)
+        return;
+
+    // The entry is used only once, it's superseded by the query that follows:
+    auto hits = std::move(found->second.hits);
+    m_prefetched.erase(found);
+
+    if (hits.empty())
+        return;
+
+    m_suggestions.clear();
+    UpdateSuggestions(hits);
+    m_showingPrefetched = true;
+}
+
+void SuggestionsSidebarBlock::PrefetchUpcoming()
+{
+    // cancels any previous prefetching:
+    auto generation = ++m_prefetchGeneration;
+
+    auto srclang = m_parent->GetCurrentSourceLanguage();
+    auto lang = m_parent->GetCurrentLanguage();
+    if (!srclang.IsValid() || !lang.IsValid() || srclang == lang)
+        return;
+
+    if (!(srclang == m_prefetchedSrcLang) || !(lang == m_prefetchedLang))
+    {
+        m_prefetched.clear();
+        m_prefetchedOrder.clear();
+        m_prefetchedSrcLang = srclang;
+        m_prefetchedLang = lang;
+    }
+
+    PrefetchNext(generation);
+}
+
+void SuggestionsSidebarBlock::PrefetchNext(uint64_t generation)
+{
+    // Items are prefetched one at a time and with lower priority, so that
+    // prefetching keeps at most one query per backend busy and doesn't slow
+    // down queries made for the item the user actually selects.
+    for (auto& item: m_parent->GetUpcomingItems())
+    {
+        auto source = item->GetString().ToStdWstring();
+        if (source.empty() || m_prefetched.find(source) != m_prefetched.end())
+            continue;
+
+        auto backends = SuggestionsBackendRegistry::GetEnabled();
+        if (backends.empty())
+            return;
+
+        // Evict the oldest entries. The queue may contain stale keys of
+        // already used entries, erasing those is harmless:
+        while (m_prefetchedOrder.size() >= MAX_PREFETCHED)
+        {
+            m_prefetched.erase(m_prefetchedOrder.front());
+            m_prefetchedOrder.pop_front();
+        }
+        m_prefetched[source].pending = (int)backends.size();
+        m_prefetchedOrder.push_back(source);
+
+        std::weak_ptr<SuggestionsSidebarBlock> weakSelf = std::dynamic_pointer_cast<SuggestionsSidebarBlock>(shared_from_this());
+        auto onDone = [weakSelf,generation,source](const SuggestionsList *hits)
+        {
+            auto self = weakSelf.lock();
+            if (!self)
+                return;
+            auto found = self->m_prefetched.find(source);
+            if (found == self->m_prefetched.end())
+                return; // invalidated in the meantime
+
+            auto& entry = found->second;
+            if (hits)
+                MergeSuggestions(entry.hits, *hits);
+            else
+                entry.failed = true; // errors are reported for selected items only
+            if (--entry.pending > 0)
+                return;
+
+            if (entry.failed)
+                self->m_prefetched.erase(found);
+            else
+                std::stable_sort(entry.hits.begin(), entry.hits.end());
+
+            if (self->m_prefetchGeneration == generation)
+                self->PrefetchNext(generation);
+        };
+
+        for (auto& b: backends)
+        {
+            SuggestionQuery query { m_prefetchedSrcLang, m_prefetchedLang, source };
+            m_provider->SuggestTranslation(*b.second, std::move(query), dispatch::cancellation_token(), dispatch::priority::normal)
+            .then_on_main([onDone](SuggestionsList hits)
+            {
+                onDone(&hits);
+            })
+            .catch_all([onDone](dispatch::exception_ptr)
+            {
+                onDone(nullptr);
+            });
+        }
+        return;
+    }
+}
+
 
 
 Sidebar::Sidebar(wxWindow *parent, wxMenu *suggestionsMenu)
@@ -900,6 +1281,7 @@ Sidebar::Sidebar(wxWindow *parent, wxMenu *suggestionsMenu)
 
     m_topBlocksSizer->AddSpacer(PXDefaultBorder);
     AddBlock(new SuggestionsSidebarBlock(this, suggestionsMenu), Top);
+    AddBlock(new GlossarySidebarBlock(this), Bottom);
     AddBlock(new OldMsgidSidebarBlock(this), Bottom);
     AddBlock(new ExtractedCommentSidebarBlock(this), Bottom);
     AddBlock(new CommentSidebarBlock(this), Bottom);
@@ -930,6 +1312,8 @@ void Sidebar::SetSelectedItem(const CatalogPtr& catalog, const CatalogItemPtr& i
 {
     m_catalog = catalog;
     m_selectedItem = item;
+    if (!item)
+        m_upcomingItems.clear();
     RefreshContent();
 }
 
@@ -957,6 +1341,17 @@ bool Sidebar::FileHasCapability(Catalog::Cap cap) const
     return m_catalog && m_catalog->HasCapability(cap);
 }
 
+bool Sidebar::IsBusy() const
+{
+    for (auto& b: m_blocks)
+    {
+        if (b->IsBusy())
+            return true;
+    }
+    return false;
+}
+
+
 void Sidebar::RefreshContent()
 {
     if (!IsShown())
@@ -27,7 +27,10 @@
 #define Poedit_sidebar_h
 
 #include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <wx/event.h>
@@ -70,6 +73,9 @@ public:
 
     virtual bool IsGrowable() const { return false; }
 
+    /// Is the block still working on showing content for the current item?
+    virtual bool IsBusy() const { return false; }
+
 protected:
     enum Flags
     {
@@ -98,10 +104,13 @@ public:
     bool IsGrowable() const override { return true; }
     bool ShouldShowForItem(const CatalogItemPtr& item) const override;
     void Update(const CatalogItemPtr& item) override;
+    bool IsBusy() const override;
 
 protected:
     // How many entries can have shortcuts?
     static const int SUGGESTIONS_MENU_ENTRIES = 9;
+    // How many items' prefetched suggestions to keep at most?
+    static const size_t MAX_PREFETCHED = 32;
 
     virtual void UpdateVisibility();
 
@@ -114,6 +123,8 @@ protected:
     virtual void ReportError(SuggestionsBackend *backend, dispatch::exception_ptr e);
     virtual void ClearSuggestions();
     virtual void UpdateSuggestions(const SuggestionsList& hits);
+    // Lays out suggestions once the current batch of updates is processed
+    void ScheduleLayout();
     virtual void OnQueriesFinished();
 
     virtual void BuildSuggestionsMenu(int count = SUGGESTIONS_MENU_ENTRIES);
@@ -127,6 +138,12 @@ protected:
     void UpdateSuggestionsForItem(CatalogItemPtr item);
     void OnDelayedShowSuggestionsForItem(wxTimerEvent& e);
 
+    // Speculatively query suggestions for items the user is likely to
+    // go to next, see Sidebar::SetUpcomingItems()
+    void PrefetchUpcoming();
+    void PrefetchNext(uint64_t generation);
+    void ShowPrefetched(const CatalogItemPtr& item);
+
 protected:
     std::unique_ptr<SuggestionsProvider> m_provider;
 
@@ -145,9 +162,28 @@ protected:
     SuggestionsList m_suggestions;
     std::vector<SuggestionWidget*> m_suggestionsWidgets;
     wxWindow *m_suggestionsSeparator;
+    // position of the separator in m_suggestionsSizer, -1 if not shown:
+    int m_suggestionsSeparatorPos;
+    bool m_layoutPending;
     std::vector<wxMenuItem*> m_suggestionMenuItems;
     int m_pendingQueries;
     uint64_t m_latestQueryId;
+    // cancels queries for the previously selected item:
+    dispatch::cancellation_token m_queryCancellation;
+
+    // suggestions prefetched for upcoming items, keyed by source text:
+    struct PrefetchedSuggestions
+    {
+        SuggestionsList hits;
+        int pending = 0;
+        bool failed = false;
+    };
+    std::map<std::wstring, PrefetchedSuggestions> m_prefetched;
+    std::deque<std::wstring> m_prefetchedOrder;
+    Language m_prefetchedSrcLang, m_prefetchedLang;
+    uint64_t m_prefetchGeneration;
+    // true if m_suggestions came from m_prefetched and are being refreshed
+    bool m_showingPrefetched;
 
     // delayed showing of suggestions:
     long long m_lastUpdateTime;
@@ -173,8 +209,23 @@ public:
     /// Tell the sidebar there's multiple selection.
     void SetMultipleSelection();
 
+    /// How many upcoming items should be passed to SetUpcomingItems()
+    static const int UPCOMING_ITEMS_COUNT = 3;
+
+    /**
+        Set items that follow the selected one in the list.
+
+        Suggestions for them are fetched in the background once the
+        selected item's are shown, so that moving to the next item is
+        instant. Call before SetSelectedItem().
+     */
+    void SetUpcomingItems(const std::vector<CatalogItemPtr>& items) { m_upcomingItems = items; }
+    const std::vector<CatalogItemPtr>& GetUpcomingItems() const { return m_upcomingItems; }
+
     /// Returns currently selected item
     CatalogItemPtr GetSelectedItem() const { return m_selectedItem; }
+    /// Returns the catalog the selected item belongs to
+    CatalogPtr GetCatalog() const { return m_catalog; }
     Language GetCurrentSourceLanguage() const;
     Language GetCurrentLanguage() const;
     bool FileHasCapability(Catalog::Cap cap) const;
@@ -182,6 +233,9 @@ public:
     /// Refreshes displayed content
     void RefreshContent();
 
+    /// Is any block still updating for the selected item (e.g. querying suggestions)?
+    bool IsBusy() const;
+
     /// Call when catalog changes/is invalidated
     void ResetCatalog() { SetSelectedItem(nullptr, nullptr); }
 
@@ -202,6 +256,7 @@ private:
 private:
     CatalogPtr m_catalog;
     CatalogItemPtr m_selectedItem;
+    std::vector<CatalogItemPtr> m_upcomingItems;
 
     std::vector<std::shared_ptr<SidebarBlock>> m_blocks;
 
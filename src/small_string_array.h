@@ -0,0 +1,165 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_small_string_array_h
+#define Poedit_small_string_array_h
+
+#include <wx/arrstr.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+/**
+    Array of strings that stores a single element inline.
+
+    Most catalog items have exactly one translation and no or very few other
+    multi-line values, but wxArrayString allocates storage for several
+    elements as soon as the first one is added. SmallStringArray only uses
+    the heap once it holds more than one string.
+
+    Elements are always stored contiguously, so iterators are plain pointers.
+ */
+class SmallStringArray
+{
+public:
+    typedef wxString value_type;
+    typedef wxString* iterator;
+    typedef const wxString* const_iterator;
+
+    SmallStringArray() : m_hasSingle(false) {}
+    SmallStringArray(const wxArrayString& a) : m_hasSingle(false) { assign(a.begin(), a.end()); }
+
+    template<typename It>
+    void assign(It first, It last)
+    {
+        clear();
+        const size_t count = size_t(std::distance(first, last));
+        if (count > 1)
+        {
+            m_heap.assign(first, last);
+        }
+        else if (count == 1)
+        {
+            m_single = *first;
+            m_hasSingle = true;
+        }
+    }
+
+    size_t size() const { return m_heap.empty() ? (m_hasSingle ? 1 : 0) : m_heap.size(); }
+    bool empty() const { return size() == 0; }
+
+    wxString* data() { return m_heap.empty() ? &m_single : m_heap.data(); }
+    const wxString* data() const { return m_heap.empty() ? &m_single : m_heap.data(); }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + size(); }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size(); }
+
+    wxString& operator[](size_t n) { return data()[n]; }
+    const wxString& operator[](size_t n) const { return data()[n]; }
+
+    wxString& back() { return data()[size() - 1]; }
+    const wxString& back() const { return data()[size() - 1]; }
+
+    void push_back(wxString s)
+    {
+        if (!m_heap.empty())
+        {
+            m_heap.push_back(std::move(s));
+        }
+        else if (!m_hasSingle)
+        {
+            m_single = std::move(s);
+            m_hasSingle = true;
+        }
+        else
+        {
+            MoveToHeap(2);
+            m_heap.push_back(std::move(s));
+        }
+    }
+
+    void resize(size_t count)
+    {
+        if (m_heap.empty() && count <= 1)
+        {
+            if (!count)
+                m_single.clear();
+            m_hasSingle = (count == 1);
+            return;
+        }
+        if (m_heap.empty())
+            MoveToHeap(count);
+        m_heap.resize(count);
+    }
+
+    void clear()
+    {
+        std::vector<wxString>().swap(m_heap);
+        m_single.clear();
+        m_hasSingle = false;
+    }
+
+    wxArrayString ToArrayString() const
+    {
+        wxArrayString a;
+        a.reserve(size());
+        for (auto& s: *this)
+            a.push_back(s);
+        return a;
+    }
+
+    /// Heap memory used by the array itself, not including strings' content
+    size_t heap_size() const { return m_heap.capacity() * sizeof(wxString); }
+
+    template<typename T>
+    bool IsSameAs(const T& other) const
+    {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+
+private:
+    void MoveToHeap(size_t capacity)
+    {
+        m_heap.reserve(capacity);
+        if (m_hasSingle)
+            m_heap.push_back(std::move(m_single));
+        m_single.clear();
+        m_hasSingle = false;
+    }
+
+    // used when the array has exactly one element and m_heap is empty:
+    wxString m_single;
+    bool m_hasSingle;
+    std::vector<wxString> m_heap;
+};
+
+inline bool operator==(const SmallStringArray& a, const SmallStringArray& b) { return a.IsSameAs(b); }
+inline bool operator!=(const SmallStringArray& a, const SmallStringArray& b) { return !a.IsSameAs(b); }
+
+#endif // Poedit_small_string_array_h
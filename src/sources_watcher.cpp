@@ -0,0 +1,266 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "sources_watcher.h"
+
+#include "concurrency.h"
+#include "configuration.h"
+#include "extractors/extractor.h"
+#include "utility.h"
+
+#include <wx/filename.h>
+#include <wx/fswatcher.h>
+#include <wx/log.h>
+
+
+namespace
+{
+
+// Delay after the last change before re-extracting, in milliseconds
+const int EXTRACTION_DELAY = 2000;
+
+bool IsSameSpec(const std::shared_ptr<SourceCodeSpec>& a, const std::shared_ptr<SourceCodeSpec>& b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->BasePath == b->BasePath &&
+           a->SearchPaths == b->SearchPaths &&
+           a->ExcludedPaths == b->ExcludedPaths &&
+           a->Keywords == b->Keywords &&
+           a->Charset == b->Charset &&
+           a->XHeaders == b->XHeaders;
+}
+
+// Changes to translation files themselves, e.g. when saving the catalog
+// located among the sources, don't affect extracted strings:
+bool IsIrrelevantChange(const wxFileName& fn)
+{
+    const wxString ext = fn.GetExt().Lower();
+    return ext == "po" || ext == "pot" || ext == "mo";
+}
+
+} // anonymous namespace
+
+
+SourcesWatcher::SourcesWatcher() : m_timer(this), m_generation(0)
+{
+    Bind(wxEVT_TIMER, &SourcesWatcher::OnTimer, this);
+#if wxUSE_FSWATCHER
+    Bind(wxEVT_FSWATCHER, &SourcesWatcher::OnFileSystemEvent, this);
+#endif
+}
+
+
+SourcesWatcher::~SourcesWatcher()
+{
+    Stop();
+}
+
+
+void SourcesWatcher::SetCatalog(const POCatalogPtr& catalog)
+{
+#if wxUSE_FSWATCHER
+    std::shared_ptr<SourceCodeSpec> spec;
+    if (catalog && Config::WatchSourcesForChanges() && catalog->HasSourcesConfigured())
+        spec = catalog->GetSourceCodeSpec();
+
+    if (m_catalog.lock() == catalog && IsSameSpec(spec, m_spec))
+        return;
+
+    Stop();
+
+    if (!spec)
+        return;
+
+    m_catalog = catalog;
+    m_spec = spec;
+    m_watcher.reset(new wxFileSystemWatcher);
+    m_watcher->SetOwner(this);
+
+    const int events = wxFSW_EVENT_CREATE | wxFSW_EVENT_DELETE | wxFSW_EVENT_RENAME |
+                       wxFSW_EVENT_MODIFY | wxFSW_EVENT_WARNING;
+    for (auto& path: spec->SearchPaths)
+    {
+        wxFileName fn(spec->BasePath + path);
+        fn.MakeAbsolute();
+        if (wxFileName::DirExists(fn.GetFullPath()))
+        {
+            fn.AssignDir(fn.GetFullPath());
+            m_watcher->AddTree(fn, events);
+        }
+        else if (fn.FileExists())
+        {
+            // watching individual files isn't supported everywhere:
+            m_watcher->Add(wxFileName::DirName(fn.GetPath()), events);
+        }
+        else
+        {
+            wxLogTrace("poedit.watcher", "not watching nonexistent '%s'", fn.GetFullPath());
+        }
+    }
+
+    // have the POT ready even if nothing changes after opening the file:
+    m_timer.StartOnce(EXTRACTION_DELAY);
+#else
+    (void)catalog;
+#endif
+}
+
+
+POCatalogPtr SourcesWatcher::TakeStagedPOT(std::vector<wxString> *changedSources)
+{
+    auto catalog = m_catalog.lock();
+    if (!catalog || !m_stagedPOT)
+        return nullptr;
+
+    // the catalog's properties may have changed without calling SetCatalog():
+    if (!IsSameSpec(catalog->GetSourceCodeSpec(), m_spec))
+    {
+        m_stagedPOT.reset();
+        return nullptr;
+    }
+
+    wxLogTrace("poedit.watcher", "using staged POT (generation %u)", m_generation);
+
+    POCatalogPtr pot;
+    pot.swap(m_stagedPOT);
+    if (changedSources)
+        changedSources->assign(m_changedSources.begin(), m_changedSources.end());
+    m_changedSources.clear();
+    return pot;
+}
+
+
+void SourcesWatcher::Stop()
+{
+    m_timer.Stop();
+    m_watcher.reset();
+    m_catalog.reset();
+    m_spec.reset();
+    m_stagedPOT.reset();
+    m_changedSources.clear();
+    m_generation++;
+
+    // the result would be discarded anyway:
+    if (m_running)
+    {
+        m_running->cancel();
+        m_running.reset();
+    }
+}
+
+
+void SourcesWatcher::OnFileSystemEvent(wxFileSystemWatcherEvent& event)
+{
+#if wxUSE_FSWATCHER
+    if (event.GetChangeType() != wxFSW_EVENT_WARNING && IsIrrelevantChange(event.GetPath()))
+        return;
+
+    wxLogTrace("poedit.watcher", "change in '%s'", event.GetPath().GetFullPath());
+
+    m_generation++;
+    m_stagedPOT.reset();
+
+    // any running extraction is already out of date:
+    if (m_running)
+        m_running->cancel();
+
+    m_timer.StartOnce(EXTRACTION_DELAY);
+#else
+    (void)event;
+#endif
+}
+
+
+void SourcesWatcher::OnTimer(wxTimerEvent&)
+{
+    StartExtraction();
+}
+
+
+void SourcesWatcher::StartExtraction()
+{
+    // will be restarted from OnExtractionDone() if the sources changed since:
+    if (m_running || !m_spec)
+        return;
+
+    const unsigned generation = m_generation;
+    auto spec = m_spec;
+    auto monitor = std::make_shared<dispatch::progress_monitor>();
+    auto changed = std::make_shared<Extractor::FilesList>();
+    m_running = monitor;
+
+    wxLogTrace("poedit.watcher", "extracting in the background (generation %u)", generation);
+
+    dispatch::async(dispatch::priority::bulk, [spec, monitor, changed]() -> POCatalogPtr
+    {
+        // failures are reported when the user updates the catalog explicitly:
+        wxLogNull null;
+        try
+        {
+            auto files = Extractor::CollectAllFiles(*spec, monitor.get());
+            if (files.empty())
+                return nullptr;
+
+            TempDirectory tmpdir;
+            auto potFile = Extractor::ExtractWithAll(tmpdir, *spec, files, monitor.get(), changed.get());
+            if (potFile.empty())
+                return nullptr;
+
+            auto pot = std::make_shared<POCatalog>(potFile, Catalog::CreationFlag_IgnoreHeader);
+            return pot->IsOk() ? pot : nullptr;
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    })
+    .then_on_window(this, [this, generation, monitor, changed](POCatalogPtr pot)
+    {
+        if (m_running == monitor)
+        {
+            // the files are in the extraction cache now, even if this POT
+            // isn't used, so a later extraction wouldn't report them again:
+            m_changedSources.insert(changed->begin(), changed->end());
+            m_running.reset();
+            OnExtractionDone(generation, pot);
+        }
+    });
+}
+
+
+void SourcesWatcher::OnExtractionDone(unsigned generation, POCatalogPtr pot)
+{
+    if (generation != m_generation)
+    {
+        // sources changed while extracting; try again unless more changes are coming:
+        if (!m_timer.IsRunning())
+            StartExtraction();
+        return;
+    }
+
+    wxLogTrace("poedit.watcher", "staged POT ready (generation %u)", generation);
+    m_stagedPOT = pot;
+}
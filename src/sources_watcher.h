@@ -0,0 +1,107 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_sources_watcher_h
+#define Poedit_sources_watcher_h
+
+#include "catalog_po.h"
+
+#include <wx/event.h>
+#include <wx/timer.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+class WXDLLIMPEXP_FWD_BASE wxFileSystemWatcher;
+class WXDLLIMPEXP_FWD_BASE wxFileSystemWatcherEvent;
+
+struct SourceCodeSpec;
+namespace dispatch { class progress_monitor; }
+
+
+/**
+    Watches the source code of a catalog for changes and keeps an up to date
+    POT extracted from it in the background.
+
+    This makes "Update from Sources" almost instant, because only merging
+    remains to be done when the user asks for it. Changed files are only
+    re-extracted a short while after the last change, and thanks to the
+    extraction cache, only the files that actually changed are processed.
+
+    Watching is opt-in, see Config::WatchSourcesForChanges().
+ */
+class SourcesWatcher : public wxEvtHandler
+{
+public:
+    SourcesWatcher();
+    ~SourcesWatcher();
+
+    /** Starts watching sources of @a catalog, stopping watching the previous
+        one. Does nothing if @a catalog is already watched and its sources
+        configuration didn't change. Pass nullptr to stop watching.
+
+        Call this again whenever the catalog's properties or location change.
+     */
+    void SetCatalog(const POCatalogPtr& catalog);
+
+    /** Returns POT extracted from the current state of the watched sources,
+        or nullptr if there isn't one ready or it's out of date (e.g. because
+        the sources changed since or the catalog's configuration differs).
+
+        The POT is handed over to the caller and won't be returned again.
+        If @a changedSources is given, it is set to the source files that
+        were re-extracted since the previous POT was taken, for use with
+        POCatalog::UpdateFromPOT().
+     */
+    POCatalogPtr TakeStagedPOT(std::vector<wxString> *changedSources = nullptr);
+
+private:
+    void Stop();
+    void OnFileSystemEvent(wxFileSystemWatcherEvent& event);
+    void OnTimer(wxTimerEvent& event);
+    void StartExtraction();
+    void OnExtractionDone(unsigned generation, POCatalogPtr pot);
+
+private:
+    std::weak_ptr<POCatalog> m_catalog;
+    std::shared_ptr<SourceCodeSpec> m_spec;
+    std::unique_ptr<wxFileSystemWatcher> m_watcher;
+
+    // debounces bursts of changes (e.g. switching git branches):
+    wxTimer m_timer;
+
+    // incremented with every change to the sources:
+    unsigned m_generation;
+
+    // extraction running in the background, if any:
+    std::shared_ptr<dispatch::progress_monitor> m_running;
+
+    POCatalogPtr m_stagedPOT;
+    // files extracted anew by all extractions since the POT was last taken:
+    std::set<wxString> m_changedSources;
+};
+
+#endif // Poedit_sources_watcher_h
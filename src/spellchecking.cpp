@@ -37,13 +37,21 @@
 #ifdef __WXMSW__
     #include <wx/msw/wrapwin.h>
     #include <Richedit.h>
+    #include <spellcheck.h>
     #ifndef IMF_SPELLCHECKING
         #define IMF_SPELLCHECKING 0x0800
     #endif
 #endif
 
+#ifdef HAVE_ENCHANT
+    #include <enchant.h>
+#endif
+
 #include "edapp.h"
 
+#include <map>
+#include <mutex>
+
 
 #ifdef __WXGTK__
 // helper functions that finds GtkTextView of wxTextCtrl:
@@ -66,6 +74,39 @@ static GtkTextView *GetTextView(wxTextCtrl *ctrl)
 
 #if GTK_CHECK_VERSION(3,0,0)
 
+namespace
+{
+
+// GtkSpell shares one Enchant broker among all checkers and the broker isn't
+// thread-safe, so setting checkers' languages must be serialized:
+std::mutex gs_gtkspellMutex;
+
+// Unattached checkers keeping dictionaries loaded (and so cached by the
+// broker, making other checkers' switching to the language cheap):
+std::map<std::string, GtkSpellChecker*> gs_dictHolders;
+
+} // anonymous namespace
+
+dispatch::future<void> PreloadSpellcheckerDictionary(const Language& lang)
+{
+    const std::string code = lang.Code();
+    return dispatch::async([code]
+    {
+        std::lock_guard<std::mutex> lock(gs_gtkspellMutex);
+        if (gs_dictHolders.find(code) != gs_dictHolders.end())
+            return;
+
+        GtkSpellChecker *spell = gtk_spell_checker_new();
+        g_object_ref_sink(spell);
+        if (!gtk_spell_checker_set_language(spell, code.c_str(), nullptr))
+        {
+            g_object_unref(spell);
+            spell = nullptr; // remember the failure too, not to retry it
+        }
+        gs_dictHolders[code] = spell;
+    });
+}
+
 bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& lang)
 {
     GtkTextView *textview = GetTextView(text);
@@ -81,6 +122,7 @@ bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& lan
             gtk_spell_checker_attach(spell, textview);
         }
 
+        std::lock_guard<std::mutex> lock(gs_gtkspellMutex);
         return gtk_spell_checker_set_language(spell, lang.Code().c_str(), nullptr);
     }
     else
@@ -131,6 +173,21 @@ bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& lan
 
 #endif // __WXGTK__
 
+#ifdef __WXGTK__
+    #if GTK_CHECK_VERSION(3,0,0)
+        #define HAVE_SPELLCHECKER_PRELOADING
+    #endif
+#endif
+
+#ifndef HAVE_SPELLCHECKER_PRELOADING
+dispatch::future<void> PreloadSpellcheckerDictionary(const Language& /*lang*/)
+{
+    // Either the OS loads dictionaries on its own (macOS, Windows), or there's
+    // no way to load them separately from text controls (GtkSpell 2):
+    return dispatch::make_ready_future();
+}
+#endif // !HAVE_SPELLCHECKER_PRELOADING
+
 #ifdef __WXOSX__
 bool SetSpellcheckerLang(const wxString& lang)
 {
@@ -176,6 +233,227 @@ bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& /*l
 #endif // __WXMSW__
 
 
+
+// ----------------------------------------------------------------
+// WordSpellchecker
+// ----------------------------------------------------------------
+
+#if defined(__WXGTK__) && defined(HAVE_ENCHANT)
+
+// GtkSpell doesn't have API for checking words directly, so Enchant, which
+// it uses underneath, is used instead, with its own broker:
+struct WordSpellchecker::Backend
+{
+    explicit Backend(const Language& lang) : m_dict(nullptr)
+    {
+        m_broker = enchant_broker_init();
+        if (m_broker)
+            m_dict = enchant_broker_request_dict(m_broker, lang.Code().c_str());
+    }
+
+    ~Backend()
+    {
+        if (m_dict)
+            enchant_broker_free_dict(m_broker, m_dict);
+        if (m_broker)
+            enchant_broker_free(m_broker);
+    }
+
+    bool IsCorrect(const wxString& word)
+    {
+        if (!m_dict)
+            return true;
+        auto utf8 = str::to_utf8(word);
+        // Enchant dictionaries aren't guaranteed to be thread-safe:
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return enchant_dict_check(m_dict, utf8.data(), (ssize_t)utf8.size()) <= 0;
+    }
+
+    std::mutex m_mutex;
+    EnchantBroker *m_broker;
+    EnchantDict *m_dict;
+};
+
+#define HAVE_WORD_SPELLCHECKER
+
+#elif defined(__WXOSX__)
+
+struct WordSpellchecker::Backend
+{
+    explicit Backend(const Language& lang) : m_lang(nil)
+    {
+        NSArray *available = [[NSSpellChecker sharedSpellChecker] availableLanguages];
+        for (auto& code: {lang.LangAndCountry(), lang.Lang()})
+        {
+            NSString *nslang = str::to_NS(wxString(code));
+            if ([available containsObject:nslang])
+            {
+                m_lang = [nslang retain];
+                break;
+            }
+        }
+    }
+
+    ~Backend()
+    {
+        [m_lang release];
+    }
+
+    bool IsCorrect(const wxString& word)
+    {
+        if (!m_lang)
+            return true;
+        // NSSpellChecker is shared with the UI; serialize background use of it:
+        std::lock_guard<std::mutex> lock(m_mutex);
+        @autoreleasepool
+        {
+            NSRange r = [[NSSpellChecker sharedSpellChecker] checkSpellingOfString:str::to_NS(word)
+                                                                        startingAt:0
+                                                                          language:m_lang
+                                                                              wrap:NO
+                                                            inSpellDocumentWithTag:0
+                                                                         wordCount:NULL];
+            return r.length == 0;
+        }
+    }
+
+    std::mutex m_mutex;
+    NSString *m_lang;
+};
+
+#define HAVE_WORD_SPELLCHECKER
+
+#elif defined(__WXMSW__)
+
+namespace
+{
+
+// Pool threads don't initialize COM on their own
+class ComThreadInit
+{
+public:
+    ComThreadInit() { m_ok = SUCCEEDED(::CoInitializeEx(NULL, COINIT_MULTITHREADED)); }
+    ~ComThreadInit() { if (m_ok) ::CoUninitialize(); }
+private:
+    bool m_ok;
+};
+
+} // anonymous namespace
+
+// Uses the Windows 8+ spellchecking API, which is what rich edit controls use too:
+struct WordSpellchecker::Backend
+{
+    explicit Backend(const Language& lang) : m_checker(nullptr)
+    {
+        ComThreadInit com;
+        ISpellCheckerFactory *factory = nullptr;
+        if (FAILED(::CoCreateInstance(__uuidof(SpellCheckerFactory), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))))
+            return;
+
+        auto tag = str::to_wstring(lang.LanguageTag());
+        BOOL supported = FALSE;
+        if (SUCCEEDED(factory->IsSupported(tag.c_str(), &supported)) && supported)
+        {
+            if (FAILED(factory->CreateSpellChecker(tag.c_str(), &m_checker)))
+                m_checker = nullptr;
+        }
+        factory->Release();
+    }
+
+    ~Backend()
+    {
+        if (m_checker)
+            m_checker->Release();
+    }
+
+    bool IsCorrect(const wxString& word)
+    {
+        if (!m_checker)
+            return true;
+
+        ComThreadInit com;
+        IEnumSpellingError *errors = nullptr;
+        if (FAILED(m_checker->Check(word.wc_str(), &errors)))
+            return true;
+
+        ISpellingError *error = nullptr;
+        const bool correct = errors->Next(&error) != S_OK;
+        if (error)
+            error->Release();
+        errors->Release();
+        return correct;
+    }
+
+    ISpellChecker *m_checker;
+};
+
+#define HAVE_WORD_SPELLCHECKER
+
+#else
+
+struct WordSpellchecker::Backend
+{
+};
+
+#endif
+
+
+WordSpellchecker::WordSpellchecker(const Language& lang) : m_lang(lang)
+{
+}
+
+
+WordSpellchecker::~WordSpellchecker()
+{
+}
+
+
+std::shared_ptr<WordSpellchecker> WordSpellchecker::GetFor(const Language& lang)
+{
+#ifdef HAVE_WORD_SPELLCHECKER
+    if (!lang.IsValid() || !IsSpellcheckingAvailable())
+        return nullptr;
+
+    static std::mutex s_mutex;
+    static std::map<std::string, std::shared_ptr<WordSpellchecker>> s_checkers;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& c = s_checkers[lang.Code()];
+    if (!c)
+        c.reset(new WordSpellchecker(lang));
+    return c;
+#else
+    (void)lang;
+    return nullptr;
+#endif
+}
+
+
+bool WordSpellchecker::IsCorrect(const wxString& word)
+{
+#ifdef HAVE_WORD_SPELLCHECKER
+    const std::wstring key(word.ToStdWstring());
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        auto i = m_cache.find(key);
+        if (i != m_cache.end())
+            return i->second;
+    }
+
+    // loading the dictionary may take a while, so it's only done when needed:
+    std::call_once(m_backendLoaded, [=]{ m_backend.reset(new Backend(m_lang)); });
+    const bool correct = m_backend->IsCorrect(word);
+
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_cache.emplace(key, correct);
+    return correct;
+#else
+    (void)word;
+    return true;
+#endif
+}
+
+
 #ifndef __WXMSW__
 void ShowSpellcheckerHelp()
 {
@@ -34,8 +34,14 @@
 
 #include <wx/textctrl.h>
 
+#include "concurrency.h"
 #include "language.h"
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 inline bool IsSpellcheckingAvailable()
 {
 #ifdef __WXMSW__
@@ -58,6 +64,47 @@ void PrepareTextCtrlForSpellchecker(wxTextCtrl *text);
 // Init given text control to do (or not) spellchecking for given language
 bool InitTextCtrlSpellchecker(wxTextCtrl *text, bool enable, const Language& lang);
 
+// Loads spellchecking dictionary for given language in the background, if the
+// platform needs it. Once the returned future is ready, InitTextCtrlSpellchecker()
+// won't block on loading it. Dictionaries stay loaded for the rest of the session
+// and are shared by all windows.
+dispatch::future<void> PreloadSpellcheckerDictionary(const Language& lang);
+
+/**
+    Spellchecker of individual words, for checking text outside of text
+    controls, e.g. all translations of a catalog at once.
+
+    Uses the same dictionaries as text controls do (Enchant on Linux, the
+    system spellchecker on macOS and Windows) and is thread-safe. There's
+    one instance per language; because the same words repeat a lot in a
+    catalog, results are cached in it for the rest of the session.
+ */
+class WordSpellchecker
+{
+public:
+    /// Returns checker for @a lang or nullptr if batch spellchecking isn't supported
+    static std::shared_ptr<WordSpellchecker> GetFor(const Language& lang);
+
+    /** Is @a word spelled correctly? The dictionary is loaded on first use;
+        if there's none for the language, all words are considered correct.
+     */
+    bool IsCorrect(const wxString& word);
+
+    ~WordSpellchecker();
+
+    struct Backend;
+
+private:
+    explicit WordSpellchecker(const Language& lang);
+
+    Language m_lang;
+    std::once_flag m_backendLoaded;
+    std::unique_ptr<Backend> m_backend;
+
+    std::mutex m_cacheMutex;
+    std::unordered_map<std::wstring, bool> m_cache;
+};
+
 #ifndef __WXMSW__
 // Show help about how to add more dictionaries for spellchecking.
 void ShowSpellcheckerHelp();
@@ -26,10 +26,14 @@
 #ifndef Poedit_str_helpers_h
 #define Poedit_str_helpers_h
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 
 #include <boost/locale/encoding_utf.hpp>
 
+#include "simd.h"
+
 #ifdef __OBJC__
 #include <Foundation/NSString.h>
 #endif
@@ -53,29 +57,121 @@
 namespace str
 {
 
+/**
+    Returns length of the ASCII-only prefix of @a data.
+
+    Most text in catalogs (and all of the markup around it) is ASCII, so
+    conversions below skip over it quickly, 16 bytes at a time where SIMD
+    is available, and only decode the rest character by character.
+ */
+inline size_t ascii_prefix_length(const char *data, size_t length)
+{
+    size_t i = 0;
+#if defined(POEDIT_HAVE_SSE2)
+    for (; i + 16 <= length; i += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(chunk))
+            break;
+    }
+#elif defined(POEDIT_HAVE_NEON)
+    for (; i + 16 <= length; i += 16)
+    {
+        const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+        if (vmaxvq_u8(chunk) >= 0x80)
+            break;
+    }
+#else
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        if (chunk & 0x8080808080808080ULL)
+            break;
+    }
+#endif
+    while (i < length && (unsigned char)data[i] < 0x80)
+        i++;
+    return i;
+}
+
+inline size_t ascii_prefix_length(const wchar_t *data, size_t length)
+{
+    size_t i = 0;
+    // branch-free inner loop that compilers vectorize well:
+    for (; i + 8 <= length; i += 8)
+    {
+        unsigned acc = 0;
+        for (size_t j = 0; j < 8; j++)
+            acc |= unsigned(data[i + j]);
+        if (acc >= 0x80)
+            break;
+    }
+    while (i < length && unsigned(data[i]) < 0x80)
+        i++;
+    return i;
+}
+
+inline bool is_ascii(const char *data, size_t length)
+{
+    return ascii_prefix_length(data, length) == length;
+}
+
+inline bool is_ascii(const wxString& str)
+{
+#if wxUSE_UNICODE_WCHAR
+    return ascii_prefix_length(str.wx_str(), str.length()) == str.length();
+#else
+    const wxScopedCharBuffer buf = str.utf8_str();
+    return is_ascii(buf.data(), buf.length());
+#endif
+}
+
+inline std::string to_utf8(const wchar_t *str, size_t length)
+{
+    const size_t ascii = ascii_prefix_length(str, length);
+    std::string out(str, str + ascii);
+    if (ascii < length)
+        out += boost::locale::conv::utf_to_utf<char>(str + ascii, str + length);
+    return out;
+}
+
 inline std::string to_utf8(const std::wstring& str)
 {
-    return boost::locale::conv::utf_to_utf<char>(str);
+    return to_utf8(str.data(), str.length());
 }
 
 inline std::string to_utf8(const wchar_t *str)
 {
-    return boost::locale::conv::utf_to_utf<char>(str);
+    return to_utf8(str, wcslen(str));
+}
+
+inline std::wstring to_wstring(const char *utf8str, size_t length)
+{
+    const size_t ascii = ascii_prefix_length(utf8str, length);
+    std::wstring out(utf8str, utf8str + ascii);
+    if (ascii < length)
+        out += boost::locale::conv::utf_to_utf<wchar_t>(utf8str + ascii, utf8str + length);
+    return out;
 }
 
 inline std::wstring to_wstring(const std::string& utf8str)
 {
-    return boost::locale::conv::utf_to_utf<wchar_t>(utf8str);
+    return to_wstring(utf8str.data(), utf8str.length());
 }
 
 inline std::wstring to_wstring(const char *utf8str)
 {
-    return boost::locale::conv::utf_to_utf<wchar_t>(utf8str);
+    return to_wstring(utf8str, strlen(utf8str));
 }
 
 inline std::string to_utf8(const wxString& str)
 {
+#if wxUSE_UNICODE_WCHAR
+    return to_utf8(str.wx_str(), str.length());
+#else
     return std::string(str.utf8_str());
+#endif
 }
 
 inline std::wstring to_wstring(const wxString& str)
@@ -83,14 +179,74 @@ inline std::wstring to_wstring(const wxString& str)
     return str.ToStdWstring();
 }
 
+inline wxString to_wx(const char *utf8, size_t length)
+{
+    if (is_ascii(utf8, length))
+        return wxString::FromAscii(utf8, length);
+    return wxString::FromUTF8(utf8, length);
+}
+
 inline wxString to_wx(const char *utf8)
 {
-    return wxString::FromUTF8(utf8);
+    return to_wx(utf8, strlen(utf8));
 }
 
 inline wxString to_wx(const std::string& utf8)
 {
-    return wxString::FromUTF8(utf8.c_str());
+    return to_wx(utf8.data(), utf8.length());
+}
+
+/// Checks if the data is well-formed UTF-8 (no overlong forms, no surrogates).
+inline bool is_valid_utf8(const char *data, size_t length)
+{
+    auto s = reinterpret_cast<const unsigned char*>(data);
+    auto end = s + length;
+    while (s < end)
+    {
+        if (*s < 0x80)
+        {
+            s += ascii_prefix_length(reinterpret_cast<const char*>(s), size_t(end - s));
+            continue;
+        }
+
+        size_t trail;
+        unsigned c;
+        if ((*s & 0xE0) == 0xC0)
+        {
+            trail = 1;
+            c = *s & 0x1F;
+        }
+        else if ((*s & 0xF0) == 0xE0)
+        {
+            trail = 2;
+            c = *s & 0x0F;
+        }
+        else if ((*s & 0xF8) == 0xF0)
+        {
+            trail = 3;
+            c = *s & 0x07;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (size_t(end - s) <= trail)
+            return false;
+        for (size_t i = 1; i <= trail; i++)
+        {
+            if ((s[i] & 0xC0) != 0x80)
+                return false;
+            c = (c << 6) | (s[i] & 0x3F);
+        }
+
+        static const unsigned min_value[] = { 0, 0x80, 0x800, 0x10000 };
+        if (c < min_value[trail] || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+            return false;
+
+        s += trail + 1;
+    }
+    return true;
 }
 
 #if defined(__cplusplus) && defined(__OBJC__)
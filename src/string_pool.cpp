@@ -0,0 +1,120 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "string_pool.h"
+
+#include <wx/hashmap.h>
+
+#include <algorithm>
+
+
+template<>
+size_t StringPool::Table<wxString>::Hash::operator()(const std::shared_ptr<wxString>& v) const
+{
+    return wxStringHash()(*v);
+}
+
+template<>
+size_t StringPool::Table<wxArrayString>::Hash::operator()(const std::shared_ptr<wxArrayString>& v) const
+{
+    size_t h = v->size();
+    for (auto& s: *v)
+        h = h * 31 + wxStringHash()(s);
+    return h;
+}
+
+
+template<>
+size_t StringPool::Table<std::string>::Hash::operator()(const std::shared_ptr<std::string>& v) const
+{
+    return std::hash<std::string>()(*v);
+}
+
+
+template<typename T>
+void StringPool::Table<T>::Purge()
+{
+    for (auto i = values.begin(); i != values.end(); )
+    {
+        if (i->use_count() == 1)
+            i = values.erase(i);
+        else
+            ++i;
+    }
+    // amortize the cost of purging over the following insertions:
+    purgeAt = std::max(size_t(1024), 2 * values.size());
+}
+
+
+template<typename T>
+void StringPool::DoIntern(Table<T>& table, Interned<T>& value)
+{
+    if (!value.m_value)
+        return;  // empty values aren't stored at all
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto inserted = table.values.insert(value.m_value);
+    if (!inserted.second)
+        value.m_value = *inserted.first;
+    else if (table.values.size() >= table.purgeAt)
+        table.Purge();
+}
+
+
+std::shared_ptr<StringPool> StringPool::Shared()
+{
+    static std::shared_ptr<StringPool> s_pool = std::make_shared<StringPool>();
+    return s_pool;
+}
+
+
+Interned<wxString> StringPool::Intern(const wxString& value)
+{
+    Interned<wxString> v(value);
+    DoIntern(m_strings, v);
+    return v;
+}
+
+Interned<wxArrayString> StringPool::Intern(const wxArrayString& value)
+{
+    Interned<wxArrayString> v(value);
+    DoIntern(m_arrays, v);
+    return v;
+}
+
+void StringPool::Intern(Interned<wxString>& value)
+{
+    DoIntern(m_strings, value);
+}
+
+void StringPool::Intern(Interned<wxArrayString>& value)
+{
+    DoIntern(m_arrays, value);
+}
+
+void StringPool::Intern(Interned<std::string>& value)
+{
+    DoIntern(m_utf8Strings, value);
+}
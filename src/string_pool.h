@@ -0,0 +1,157 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_string_pool_h
+#define Poedit_string_pool_h
+
+#include <wx/string.h>
+#include <wx/arrstr.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+
+/**
+    Immutable value that may share its storage with other, identical values.
+
+    Values obtained from StringPool are shared by all holders; modifying
+    one (with modify()) detaches it first, so that others aren't affected.
+    Empty values don't allocate anything.
+ */
+template<typename T>
+class Interned
+{
+public:
+    Interned() {}
+    Interned(T value) { *this = std::move(value); }
+
+    Interned& operator=(T value)
+    {
+        if (value.empty())
+            m_value.reset();
+        else
+            m_value = std::make_shared<T>(std::move(value));
+        return *this;
+    }
+
+    const T& get() const { return m_value ? *m_value : EmptyValue(); }
+    operator const T&() const { return get(); }
+
+    bool empty() const { return !m_value || m_value->empty(); }
+
+    /// Number of holders sharing the value (0 if there's none), for memory accounting
+    long use_count() const { return m_value ? m_value.use_count() : 0; }
+
+    /// Returns modifiable value, detached from any other holders.
+    T& modify()
+    {
+        if (!m_value)
+            m_value = std::make_shared<T>();
+        else if (m_value.use_count() > 1)
+            m_value = std::make_shared<T>(*m_value);
+        return *m_value;
+    }
+
+private:
+    static const T& EmptyValue()
+    {
+        static const T s_empty;
+        return s_empty;
+    }
+
+    std::shared_ptr<T> m_value;
+
+    friend class StringPool;
+};
+
+
+/**
+    Pool of interned strings and string arrays.
+
+    Catalogs contain a lot of repeated metadata (flags, references, extracted
+    comments) and this lets all items with identical values share them. It is
+    safe to use from multiple threads at once.
+
+    Values no longer used by anybody but the pool are released from time
+    to time, as the pool grows.
+ */
+class StringPool
+{
+public:
+    StringPool() {}
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    /**
+        Returns the process-wide pool.
+
+        Catalogs of the same project in different languages (or the same file
+        opened again, e.g. by the manager and for editing) share their source
+        texts and metadata through it.
+     */
+    static std::shared_ptr<StringPool> Shared();
+
+    /// Returns shared instance of @a value.
+    Interned<wxString> Intern(const wxString& value);
+    Interned<wxArrayString> Intern(const wxArrayString& value);
+
+    /// Re-interns the value if it isn't in the pool yet.
+    void Intern(Interned<wxString>& value);
+    void Intern(Interned<wxArrayString>& value);
+    void Intern(Interned<std::string>& value);
+
+private:
+    template<typename T>
+    struct Table
+    {
+        struct Hash
+        {
+            size_t operator()(const std::shared_ptr<T>& v) const;
+        };
+        struct Equal
+        {
+            bool operator()(const std::shared_ptr<T>& a, const std::shared_ptr<T>& b) const
+                { return *a == *b; }
+        };
+
+        /// Removes values not used outside of the pool anymore
+        void Purge();
+
+        std::unordered_set<std::shared_ptr<T>, Hash, Equal> values;
+        size_t purgeAt = 1024;
+    };
+
+    template<typename T>
+    void DoIntern(Table<T>& table, Interned<T>& value);
+
+    std::mutex m_mutex;
+    Table<wxString> m_strings;
+    Table<wxArrayString> m_arrays;
+    Table<std::string> m_utf8Strings;
+};
+
+#endif // Poedit_string_pool_h
@@ -26,11 +26,13 @@
 #include "syntaxhighlighter.h"
 
 #include "catalog.h"
+#include "format_placeholders.h"
 #include "str_helpers.h"
 
 #include <unicode/uchar.h>
 
-#include <regex>
+#include <algorithm>
+#include <cwctype>
 
 namespace
 {
@@ -39,6 +41,13 @@ class BasicSyntaxHighlighter : public SyntaxHighlighter
 {
 public:
     void Highlight(const std::wstring& s, const CallbackType& highlight) override
+    {
+        HighlightWhole(s, highlight);
+        HighlightLine(s, highlight);
+    }
+
+    // leading and trailing whitespace of the whole text:
+    void HighlightWhole(const std::wstring& s, const CallbackType& highlight) override
     {
         if (s.empty())
             return;
@@ -66,7 +75,11 @@ public:
                 break;
             }
         }
+    }
 
+    // blocks of whitespace and escape sequences, neither of which spans lines:
+    void HighlightLine(const std::wstring& s, const CallbackType& highlight) override
+    {
         int blank_block_pos = -1;
 
         for (auto i = s.begin(); i != s.end(); ++i)
@@ -121,83 +134,239 @@ public:
             h->Highlight(s, highlight);
     }
 
+    void HighlightLine(const std::wstring& s, const CallbackType& highlight) override
+    {
+        for (auto h : m_sub)
+            h->HighlightLine(s, highlight);
+    }
+
+    void HighlightWhole(const std::wstring& s, const CallbackType& highlight) override
+    {
+        for (auto h : m_sub)
+            h->HighlightWhole(s, highlight);
+    }
+
 private:
     std::vector<std::shared_ptr<SyntaxHighlighter>> m_sub;
 };
 
 
 
-/// Match regular expressions for highlighting
-class RegexSyntaxHighlighter : public SyntaxHighlighter
+/**
+    Single-pass scanner for HTML/XML tags and entities.
+
+    Recognizes the same tokens as the regular expression
+    (<\/?[a-zA-Z0-9:-]+(\s+[-:\w]+(=([-:\w+]|"[^"]*"|'[^']*'))?)*\s*\/?>)|(&[^ ;]+;)
+    did, but without backtracking and in linear time.
+ */
+class MarkupScanner
 {
 public:
-    /// Ctor. Notice that @a re is a reference and must outlive the highlighter!
-    RegexSyntaxHighlighter(std::wregex& re, TextKind kind) : m_re(re), m_kind(kind) {}
+    MarkupScanner(const wchar_t *begin, const wchar_t *end)
+        : m_begin(begin), m_pos(begin), m_end(end),
+          m_entityFailure(nullptr), m_nextQuote{nullptr, nullptr}
+    {}
 
-    void Highlight(const std::wstring& s, const CallbackType& highlight) override
+    /// Finds the next token; returns false if there's none.
+    bool Next(size_t& pos, size_t& length)
     {
-        try
+        while (m_pos < m_end)
         {
-            std::wsregex_iterator next(s.begin(), s.end(), m_re);
-            std::wsregex_iterator end;
-            while (next != end)
+            const wchar_t *match = nullptr;
+            switch (*m_pos)
+            {
+                case '<':
+                    match = MatchTag(m_pos);
+                    break;
+                case '&':
+                    match = MatchEntity(m_pos);
+                    break;
+                default:
+                    break;
+            }
+
+            if (match)
             {
-                auto match = *next++;
-                if (match.empty())
-                    continue;
-                int pos = static_cast<int>(match.position());
-                highlight(pos, pos + static_cast<int>(match.length()), m_kind);
+                pos = m_pos - m_begin;
+                length = match - m_pos;
+                m_pos = match;
+                return true;
             }
+            ++m_pos;
         }
-        catch (std::regex_error& e)
+        return false;
+    }
+
+private:
+    static bool IsTagNameChar(wchar_t c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == ':' || c == '-';
+    }
+
+    static bool IsAttrNameChar(wchar_t c)
+    {
+        return IsTagNameChar(c) || c == '_';
+    }
+
+    static bool IsSpace(wchar_t c)
+    {
+        return iswspace(c) != 0;
+    }
+
+    // returns end of the tag starting at i, or nullptr if it isn't one
+    const wchar_t *MatchTag(const wchar_t *i)
+    {
+        ++i; // '<'
+        if (i < m_end && *i == '/')
+            ++i;
+        const wchar_t *name = i;
+        while (i < m_end && IsTagNameChar(*i))
+            ++i;
+        if (i == name)
+            return nullptr;
+
+        for (;;)
         {
-            switch (e.code())
+            const wchar_t *ws = i;
+            while (i < m_end && IsSpace(*i))
+                ++i;
+            if (i == m_end)
+                return nullptr;
+            if (!IsAttrNameChar(*i))
+                break;
+            if (i == ws)
+                return nullptr; // attributes must be separated by whitespace
+
+            while (i < m_end && IsAttrNameChar(*i))
+                ++i;
+            if (i < m_end && *i == '=')
             {
-                case std::regex_constants::error_complexity:
-                case std::regex_constants::error_stack:
-                    // MSVC version of std::regex in particular can fail to match
-                    // e.g. HTML regex with backreferences on insanely large strings;
-                    // in that case, don't highlight instead of failing outright.
-                    return;
-                default:
-                    throw;
+                if (++i == m_end)
+                    return nullptr;
+                if (*i == '"' || *i == '\'')
+                {
+                    i = FindQuote(*i, i + 1);
+                    if (!i)
+                        return nullptr;
+                    ++i;
+                }
+                else if (IsAttrNameChar(*i) || *i == '+')
+                {
+                    ++i; // unquoted values are only matched as a single character
+                }
+                else
+                {
+                    return nullptr;
+                }
             }
         }
+
+        if (*i == '/')
+            ++i;
+        if (i < m_end && *i == '>')
+            return i + 1;
+        return nullptr;
     }
 
-private:
-    std::wregex& m_re;
-    TextKind m_kind;
+    // returns end of the entity starting at i, or nullptr if it isn't one
+    const wchar_t *MatchEntity(const wchar_t *i)
+    {
+        // any '&' before previously failed one's end would fail the same way:
+        if (i < m_entityFailure)
+            return nullptr;
+
+        const wchar_t *start = i++;
+        while (i < m_end && *i != ' ' && *i != ';')
+            ++i;
+        if (i < m_end && *i == ';' && i - start > 1)
+            return i + 1;
+        m_entityFailure = i;
+        return nullptr;
+    }
+
+    // finds closing quote, remembering the result to avoid rescanning
+    // the text when an unterminated quote is found repeatedly
+    const wchar_t *FindQuote(wchar_t quote, const wchar_t *from)
+    {
+        const wchar_t *& cached = m_nextQuote[quote == '"' ? 0 : 1];
+        if (!cached || cached < from)
+            cached = std::find(from, m_end, quote);
+        return cached == m_end ? nullptr : cached;
+    }
+
+    const wchar_t *m_begin, *m_pos, *m_end;
+    const wchar_t *m_entityFailure;
+    const wchar_t *m_nextQuote[2];
 };
 
 
-std::wregex RE_HTML_MARKUP(LR"((<\/?[a-zA-Z0-9:-]+(\s+[-:\w]+(=([-:\w+]|"[^"]*"|'[^']*'))?)*\s*\/?>)|(&[^ ;]+;))",
-                           std::regex_constants::ECMAScript | std::regex_constants::optimize);
+/// Highlighter for HTML/XML markup, see MarkupScanner
+class MarkupSyntaxHighlighter : public SyntaxHighlighter
+{
+public:
+    void Highlight(const std::wstring& s, const CallbackType& highlight) override
+    {
+        MarkupScanner scanner(s.data(), s.data() + s.length());
+        size_t pos, length;
+        while (scanner.Next(pos, length))
+            highlight(int(pos), int(pos + length), TextKind::Markup);
+    }
 
-// php-format per http://php.net/manual/en/function.sprintf.php plus positionals
-std::wregex RE_PHP_FORMAT(LR"(%(\d+\$)?[-+]{0,2}([ 0]|'.)?-?\d*(\..?\d+)?[%bcdeEfFgGosuxX])",
-                          std::regex_constants::ECMAScript | std::regex_constants::optimize);
+    void HighlightLine(const std::wstring& s, const CallbackType& highlight) override
+    {
+        Highlight(s, highlight);
+    }
 
-// c-format per http://en.cppreference.com/w/cpp/io/c/fprintf,
-//              http://pubs.opengroup.org/onlinepubs/9699919799/functions/fprintf.html
-std::wregex RE_C_FORMAT(LR"(%(\d+\$)?[-+ #0]{0,5}(\d+|\*)?(\.(\d+|\*))?(hh|ll|[hljztL])?[%csdioxXufFeEaAgGnp])",
-                        std::regex_constants::ECMAScript | std::regex_constants::optimize);
+    void HighlightWhole(const std::wstring&, const CallbackType&) override {}
+
+    static bool ContainsMarkup(const std::wstring& s)
+    {
+        MarkupScanner scanner(s.data(), s.data() + s.length());
+        size_t pos, length;
+        return scanner.Next(pos, length);
+    }
+};
+
+
+/// Highlight format strings and placeholders using PlaceholderTokenizer
+class PlaceholderSyntaxHighlighter : public SyntaxHighlighter
+{
+public:
+    /// Ctor; @a syntax is one of PlaceholderSyntax values
+    PlaceholderSyntaxHighlighter(unsigned syntax) : m_syntax(syntax) {}
+
+    void Highlight(const std::wstring& s, const CallbackType& highlight) override
+    {
+        PlaceholderTokenizer tokenizer(m_syntax, s.data(), s.data() + s.length());
+        size_t pos, length;
+        while (tokenizer.Next(pos, length))
+            highlight(int(pos), int(pos + length), TextKind::Format);
+    }
+
+    void HighlightLine(const std::wstring& s, const CallbackType& highlight) override
+    {
+        Highlight(s, highlight);
+    }
+
+    void HighlightWhole(const std::wstring&, const CallbackType&) override {}
+
+private:
+    unsigned m_syntax;
+};
 
-// variables expansion for %foo% (Twig), {foo} and {{foo}}
-std::wregex RE_COMMON_PLACEHOLDERS(LR"((%[0-9a-zA-Z_.-]+%)|(\{[0-9a-zA-Z_.-]+\})|(\{\{[0-9a-zA-Z_.-]+\}\}))",
-                    std::regex_constants::ECMAScript | std::regex_constants::optimize);
 
 } // anonymous namespace
 
 
 SyntaxHighlighterPtr SyntaxHighlighter::ForItem(const CatalogItem& item)
 {
-    auto formatFlag = item.GetFormatFlag();
-    bool needsHTML = std::regex_search(str::to_wstring(item.GetString()), RE_HTML_MARKUP);
-    bool needsPlaceholders = std::regex_search(str::to_wstring(item.GetString()), RE_COMMON_PLACEHOLDERS);
+    auto placeholders = item.GetSourcePlaceholders();
+    const unsigned formatSyntax = placeholders->syntaxes & (Placeholders_C | Placeholders_PHP);
+    bool needsHTML = MarkupSyntaxHighlighter::ContainsMarkup(str::to_wstring(item.GetString()));
+    bool needsPlaceholders = (placeholders->found & Placeholders_Common) != 0;
 
     static auto basic = std::make_shared<BasicSyntaxHighlighter>();
-    if (!needsHTML && !needsPlaceholders && formatFlag.empty())
+    if (!needsHTML && !needsPlaceholders && !formatSyntax)
         return basic;
 
     auto all = std::make_shared<CompositeSyntaxHighlighter>();
@@ -205,26 +374,26 @@ SyntaxHighlighterPtr SyntaxHighlighter::ForItem(const CatalogItem& item)
     // HTML goes first, has lowest priority than special-purpose stuff like format strings:
     if (needsHTML)
     {
-        static auto html = std::make_shared<RegexSyntaxHighlighter>(RE_HTML_MARKUP, TextKind::Markup);
+        static auto html = std::make_shared<MarkupSyntaxHighlighter>();
         all->Add(html);
     }
 
     if (needsPlaceholders)
     {
         // If no format specified, heuristically apply highlighting of common variable markers
-        static auto placeholders = std::make_shared<RegexSyntaxHighlighter>(RE_COMMON_PLACEHOLDERS, TextKind::Format);
-        all->Add(placeholders);
+        static auto common = std::make_shared<PlaceholderSyntaxHighlighter>(Placeholders_Common);
+        all->Add(common);
     }
 
     // TODO: more/all languages
-    if (formatFlag == "php")
+    if (formatSyntax == Placeholders_PHP)
     {
-        static auto php_format = std::make_shared<RegexSyntaxHighlighter>(RE_PHP_FORMAT, TextKind::Format);
+        static auto php_format = std::make_shared<PlaceholderSyntaxHighlighter>(Placeholders_PHP);
         all->Add(php_format);
     }
-    else if (formatFlag == "c")
+    else if (formatSyntax == Placeholders_C)
     {
-        static auto c_format = std::make_shared<RegexSyntaxHighlighter>(RE_C_FORMAT, TextKind::Format);
+        static auto c_format = std::make_shared<PlaceholderSyntaxHighlighter>(Placeholders_C);
         all->Add(c_format);
     }
 
@@ -233,3 +402,102 @@ SyntaxHighlighterPtr SyntaxHighlighter::ForItem(const CatalogItem& item)
 
     return all;
 }
+
+
+
+void SyntaxHighlightingCache::SetHighlighter(const SyntaxHighlighterPtr& highlighter)
+{
+    if (highlighter == m_highlighter)
+        return;
+    m_highlighter = highlighter;
+    m_segments.clear();
+}
+
+
+void SyntaxHighlightingCache::Highlight(const std::wstring& s, const SyntaxHighlighter::CallbackType& highlight)
+{
+    if (!m_highlighter)
+        return;
+
+    // Split the text into lines, keeping the terminating newlines. Markup tags
+    // may span multiple lines, so don't split inside of one (i.e. after '<'
+    // without matching '>'):
+    std::vector<std::pair<size_t, size_t>> bounds;
+    {
+        size_t start = 0;
+        bool inTag = false;
+        for (size_t i = 0; i < s.length(); ++i)
+        {
+            switch (s[i])
+            {
+                case '<':
+                    inTag = true;
+                    break;
+                case '>':
+                    inTag = false;
+                    break;
+                case '\n':
+                    if (!inTag)
+                    {
+                        bounds.emplace_back(start, i + 1);
+                        start = i + 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (start < s.length())
+            bounds.emplace_back(start, s.length());
+    }
+
+    auto sameText = [&s](const Segment& seg, const std::pair<size_t, size_t>& b)
+    {
+        return seg.text.length() == b.second - b.first &&
+               s.compare(b.first, b.second - b.first, seg.text) == 0;
+    };
+
+    // Lines at the beginning and the end that didn't change since the last
+    // time keep their previous results:
+    const size_t oldCount = m_segments.size();
+    const size_t newCount = bounds.size();
+    size_t prefix = 0;
+    while (prefix < oldCount && prefix < newCount && sameText(m_segments[prefix], bounds[prefix]))
+        prefix++;
+    size_t suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix &&
+           sameText(m_segments[oldCount - 1 - suffix], bounds[newCount - 1 - suffix]))
+        suffix++;
+
+    std::vector<Segment> segments(newCount);
+    for (size_t i = 0; i < newCount; i++)
+    {
+        auto& seg = segments[i];
+        if (i < prefix)
+        {
+            seg = std::move(m_segments[i]);
+        }
+        else if (i >= newCount - suffix)
+        {
+            seg = std::move(m_segments[oldCount - (newCount - i)]);
+        }
+        else
+        {
+            seg.text = s.substr(bounds[i].first, bounds[i].second - bounds[i].first);
+            m_highlighter->HighlightLine(seg.text, [&seg](int a, int b, SyntaxHighlighter::TextKind kind)
+            {
+                seg.ranges.push_back({a, b, kind});
+            });
+        }
+    }
+    m_segments.swap(segments);
+
+    for (size_t i = 0; i < newCount; i++)
+    {
+        const int offset = int(bounds[i].first);
+        for (auto& r: m_segments[i].ranges)
+            highlight(offset + r.from, offset + r.to, r.kind);
+    }
+
+    m_highlighter->HighlightWhole(s, highlight);
+}
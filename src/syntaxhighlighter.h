@@ -29,6 +29,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 class CatalogItem;
 
@@ -66,8 +67,60 @@ public:
      */
     virtual void Highlight(const std::wstring& s, const CallbackType& highlight) = 0;
 
+    /**
+        Incremental highlighting, see SyntaxHighlightingCache.
+
+        HighlightLine() highlights only the ranges that don't depend on
+        anything outside of the line (or a few lines, see the cache). For each
+        line, it must produce the same ranges Highlight() would for the whole
+        text. HighlightWhole() then highlights the remaining ranges in the
+        whole text; they take precedence over the line ones.
+
+        By default, everything is done by HighlightWhole(), i.e. there's no
+        benefit from caching.
+     */
+    virtual void HighlightLine(const std::wstring& /*line*/, const CallbackType& /*highlight*/) {}
+    virtual void HighlightWhole(const std::wstring& s, const CallbackType& highlight)
+        { Highlight(s, highlight); }
+
     /// Return highlighter suitable for given translation item
     static SyntaxHighlighterPtr ForItem(const CatalogItem& item);
 };
 
+
+/**
+    Highlights text with a SyntaxHighlighter, remembering results for every
+    line, so that after editing the text, only the lines that changed need
+    to be highlighted again.
+
+    This matters for long texts, which are re-highlighted after every
+    keystroke in the editing area.
+ */
+class SyntaxHighlightingCache
+{
+public:
+    /// Sets highlighter to use, forgetting cached results if it's different
+    void SetHighlighter(const SyntaxHighlighterPtr& highlighter);
+
+    /// Like SyntaxHighlighter::Highlight(), but reuses results for unchanged lines
+    void Highlight(const std::wstring& s, const SyntaxHighlighter::CallbackType& highlight);
+
+private:
+    struct Range
+    {
+        int from, to;
+        SyntaxHighlighter::TextKind kind;
+    };
+
+    // a line (or several, if markup spans them) and its highlighting
+    struct Segment
+    {
+        std::wstring text;
+        std::vector<Range> ranges;
+    };
+
+    SyntaxHighlighterPtr m_highlighter;
+    std::vector<Segment> m_segments;
+};
+
 #endif // Poedit_syntaxhighlighter_h
@@ -551,7 +551,9 @@ public:
 
 
 AnyTranslatableTextCtrl::AnyTranslatableTextCtrl(wxWindow *parent, wxWindowID winid, int style)
-   : CustomizedTextCtrl(parent, winid, style)
+   : CustomizedTextCtrl(parent, winid, style),
+     m_highlightingDeferred(false),
+     m_highlightingPending(false)
 {
     ColorScheme::SetupWindowColors(this, [=]
     {
@@ -782,8 +784,22 @@ void AnyTranslatableTextCtrl::UpdateRTLStyle()
 }
 #endif // !__WXMSW__
 
+void AnyTranslatableTextCtrl::DeferHighlighting(bool defer)
+{
+    m_highlightingDeferred = defer;
+    if (!defer && m_highlightingPending)
+        HighlightText();
+}
+
 void AnyTranslatableTextCtrl::HighlightText()
 {
+    if (m_highlightingDeferred)
+    {
+        m_highlightingPending = true;
+        return;
+    }
+    m_highlightingPending = false;
+
     auto text = GetValue().ToStdWstring();
 
 #ifdef __WXOSX__
@@ -795,7 +811,7 @@ void AnyTranslatableTextCtrl::HighlightText()
 
     if (m_syntax)
     {
-        m_syntax->Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
+        m_highlighting.Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
             [layout addTemporaryAttributes:m_attrs->For(kind) forCharacterRange:NSMakeRange(a, b-a)];
         });
     }
@@ -819,7 +835,7 @@ void AnyTranslatableTextCtrl::HighlightText()
 
         if (m_syntax)
         {
-            m_syntax->Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
+            m_highlighting.Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
                 SetTOMTmpStyle(doc, a, b, m_attrs->For(kind));
             });
         }
@@ -831,7 +847,7 @@ void AnyTranslatableTextCtrl::HighlightText()
 
         if (m_syntax)
         {
-            m_syntax->Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
+            m_highlighting.Highlight(text, [=](int a, int b, SyntaxHighlighter::TextKind kind){
                 SetStyle(a, b, m_attrs->For(kind));
             });
         }
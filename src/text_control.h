@@ -107,7 +107,18 @@ public:
     ~AnyTranslatableTextCtrl();
 
     void SetLanguage(const Language& lang);
-    void SetSyntaxHighlighter(SyntaxHighlighterPtr syntax) { m_syntax = syntax; }
+    void SetSyntaxHighlighter(SyntaxHighlighterPtr syntax)
+    {
+        m_syntax = syntax;
+        m_highlighting.SetHighlighter(syntax);
+    }
+
+    /**
+        Defers syntax highlighting while @a defer is true, e.g. for controls
+        in inactive notebook tabs. Highlighting of changes made in the
+        meantime is done when it's turned off again.
+     */
+    void DeferHighlighting(bool defer);
 
     // Set and get control's text as plain/raw text, with no escaping or formatting.
     // This is the "true" representation, with e.g newlines included. The version
@@ -135,8 +146,10 @@ protected:
 
     class Attributes;
     SyntaxHighlighterPtr m_syntax;
+    SyntaxHighlightingCache m_highlighting;
     std::unique_ptr<Attributes> m_attrs;
     Language m_language;
+    bool m_highlightingDeferred, m_highlightingPending;
 };
 
 
@@ -0,0 +1,864 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "compact_tm.h"
+
+#include "fuzzy_match.h"
+#include "transmem.h"
+#include "errors.h"
+#include "str_helpers.h"
+#include "utility.h"
+
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/stdpaths.h>
+#include <wx/translation.h>
+#include <wx/utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <unordered_map>
+
+
+namespace
+{
+
+const uint32_t STORE_MAGIC = 0x4d544350; // "PCTM"
+const uint32_t STORE_FORMAT_VERSION = 1;
+
+// Number of keys in a prefix-compressed block
+const uint32_t KEYS_BLOCK_SIZE = 16;
+
+// Maximum number of suggestions returned, same as TranslationMemory
+const size_t MAX_RESULTS = 10;
+
+// Minimum similarity of near-exact matches
+const double MIN_SIMILARITY = 0.6;
+
+// Score of matches that only differ in case or whitespace
+const double NORMALIZED_MATCH_SCORE = 0.95;
+
+// Maximum number of candidates compared with the query
+const size_t MAX_CANDIDATES = 32;
+
+// Trigrams present in more than this fraction of entries don't help
+// narrowing down candidates and are ignored
+const double MAX_GRAM_FREQUENCY = 0.25;
+
+// How often to check for changes in the TM
+const std::chrono::seconds CHECK_INTERVAL{60};
+
+
+wxString GetStoreDir()
+{
+    wxString cache;
+#if defined(__WXOSX__)
+    cache = wxGetHomeDir() + "/Library/Caches/net.poedit.Poedit";
+#elif defined(__UNIX__)
+    if (!wxGetEnv("XDG_CACHE_HOME", &cache))
+        cache = wxGetHomeDir() + "/.cache";
+    cache += "/poedit";
+#else
+    cache = wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "Cache";
+#endif
+    cache += wxFILE_SEP_PATH;
+    cache += "CompactTM";
+    return cache;
+}
+
+std::wstring GetPairKey(const Language& srclang, const Language& lang)
+{
+    // same grouping as TM shards, the store covers all variants of the language
+    return srclang.WCode() + L"-" + str::to_wstring(lang.Lang());
+}
+
+wxString GetStorePath(const std::wstring& key)
+{
+    return GetStoreDir() + wxFILE_SEP_PATH + wxString(key) + ".ctm";
+}
+
+
+// Lowercases the text and collapses whitespace, so that insignificant
+// differences don't prevent exact lookups
+std::wstring Normalize(const std::wstring& text)
+{
+    std::wstring out;
+    out.reserve(text.size());
+    bool space = false;
+    for (auto c: text)
+    {
+        if (std::iswspace(c))
+        {
+            space = !out.empty();
+            continue;
+        }
+        if (space)
+        {
+            out += L' ';
+            space = false;
+        }
+        out += wchar_t(std::towlower(c));
+    }
+    return out;
+}
+
+// Splits normalized text into words, for computing similarity
+FuzzyMatcher::Tokens Tokenize(const std::wstring& normalized)
+{
+    FuzzyMatcher::Tokens tokens;
+    std::wstring word;
+    for (auto c: normalized)
+    {
+        if (std::iswalnum(c))
+        {
+            word += c;
+        }
+        else if (!word.empty())
+        {
+            tokens.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty())
+        tokens.push_back(std::move(word));
+    return tokens;
+}
+
+// Returns hashes of character trigrams of normalized text
+std::vector<uint32_t> GetTrigrams(const std::wstring& normalized)
+{
+    const std::wstring padded = L" " + normalized + L" ";
+    std::vector<uint32_t> grams;
+    for (size_t i = 0; i + 3 <= padded.size(); i++)
+    {
+        uint32_t hash = 2166136261U;
+        for (size_t j = i; j < i + 3; j++)
+        {
+            hash ^= uint32_t(padded[j]);
+            hash *= 16777619U;
+        }
+        grams.push_back(hash);
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+
+void WriteVarint(std::string& out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+uint32_t ReadVarint(const char*& p)
+{
+    uint32_t value = 0;
+    int shift = 0;
+    for (;;)
+    {
+        const uint8_t b = uint8_t(*p++);
+        value |= uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return value;
+        shift += 7;
+    }
+}
+
+template<typename T>
+void WritePOD(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void Align(std::string& out)
+{
+    out.resize((out.size() + 7) & ~size_t(7), '\0');
+}
+
+} // anonymous namespace
+
+
+// A single language pair's data
+class CompactTMStore
+{
+public:
+    /// Entry to be written into the store
+    struct BuildEntry
+    {
+        std::string key; // normalized source, UTF-8
+        std::wstring source, trans;
+        std::wstring lang;
+        time_t created;
+    };
+
+    /// Opens existing file, returns nullptr if it's missing or invalid
+    static std::shared_ptr<const CompactTMStore> Open(const wxString& path)
+    {
+        std::shared_ptr<CompactTMStore> store(new CompactTMStore(path));
+        if (!store->Parse())
+            return nullptr;
+        return store;
+    }
+
+    /// Writes the store file
+    static void Write(const wxString& path, uint64_t dataVersion, std::vector<BuildEntry>& entries);
+
+    uint64_t GetDataVersion() const { return m_header->dataVersion; }
+
+    SuggestionsList Search(const Language& srclang, const Language& lang, const std::wstring& source) const;
+
+private:
+    // On-disk layout; all sections are 8-byte aligned
+    struct StoreHeader
+    {
+        uint32_t magic;
+        uint32_t formatVersion;
+        uint64_t dataVersion;
+        uint32_t numEntries;
+        uint32_t numLangs;
+        uint32_t numBlocks;
+        uint32_t numGrams;
+        uint64_t langsOffset;     // numLangs x (uint32 length, UTF-8 code)
+        uint64_t entriesOffset;   // numEntries x EntryRecord, sorted by key
+        uint64_t blocksOffset;    // numBlocks x uint32 offset into keys
+        uint64_t keysOffset;      // prefix-compressed normalized source texts
+        uint64_t gramsOffset;     // numGrams x GramRecord, sorted by gram
+        uint64_t postingsOffset;  // delta-coded entry indexes
+        uint64_t stringsOffset;   // UTF-8 source texts and translations
+        uint64_t size;
+    };
+
+    struct EntryRecord
+    {
+        uint32_t sourceOffset, sourceLength;
+        uint32_t transOffset, transLength;
+        int64_t  created;
+        uint16_t lang;
+        uint16_t tokens;
+        uint32_t reserved;
+    };
+
+    struct GramRecord
+    {
+        uint32_t gram;
+        uint32_t postingsOffset;
+        uint32_t count;
+    };
+
+    static_assert(sizeof(EntryRecord) == 32, "unexpected padding");
+    static_assert(sizeof(GramRecord) == 12, "unexpected padding");
+
+    explicit CompactTMStore(const wxString& path) : m_file(path) {}
+
+    bool Parse();
+
+    const EntryRecord& Entry(uint32_t i) const { return m_entries[i]; }
+    std::string Key(uint32_t i) const;
+    std::wstring String(uint32_t offset, uint32_t length) const
+    {
+        return str::to_wstring(std::string(m_strings + offset, length));
+    }
+
+    // Returns index of the first entry with key >= @a key
+    uint32_t LowerBound(const std::string& key) const;
+
+    std::vector<bool> MatchingLanguages(const Language& lang) const;
+
+    Suggestion MakeSuggestion(const Language& srclang, uint32_t i, double score) const;
+
+    MemoryMappedFile m_file;
+    const StoreHeader *m_header = nullptr;
+    const EntryRecord *m_entries = nullptr;
+    const uint32_t *m_blocks = nullptr;
+    const char *m_keys = nullptr;
+    const GramRecord *m_grams = nullptr;
+    const char *m_postings = nullptr;
+    const char *m_strings = nullptr;
+    std::vector<std::wstring> m_langCodes;
+    std::vector<Language> m_langs;
+};
+
+
+bool CompactTMStore::Parse()
+{
+    if (!m_file.IsOk() || m_file.size() < sizeof(StoreHeader))
+        return false;
+
+    const char *data = m_file.data();
+    m_header = reinterpret_cast<const StoreHeader*>(data);
+    auto& h = *m_header;
+    if (h.magic != STORE_MAGIC || h.formatVersion != STORE_FORMAT_VERSION || h.size != m_file.size())
+        return false;
+    if (h.langsOffset > h.entriesOffset || h.entriesOffset > h.blocksOffset || h.blocksOffset > h.keysOffset ||
+        h.keysOffset > h.gramsOffset || h.gramsOffset > h.postingsOffset || h.postingsOffset > h.stringsOffset ||
+        h.stringsOffset > h.size)
+    {
+        return false;
+    }
+    if (h.entriesOffset + uint64_t(h.numEntries) * sizeof(EntryRecord) > h.blocksOffset ||
+        h.blocksOffset + uint64_t(h.numBlocks) * sizeof(uint32_t) > h.keysOffset ||
+        h.gramsOffset + uint64_t(h.numGrams) * sizeof(GramRecord) > h.postingsOffset ||
+        h.numBlocks != (h.numEntries + KEYS_BLOCK_SIZE - 1) / KEYS_BLOCK_SIZE)
+    {
+        return false;
+    }
+
+    m_entries = reinterpret_cast<const EntryRecord*>(data + h.entriesOffset);
+    m_blocks = reinterpret_cast<const uint32_t*>(data + h.blocksOffset);
+    m_keys = data + h.keysOffset;
+    m_grams = reinterpret_cast<const GramRecord*>(data + h.gramsOffset);
+    m_postings = data + h.postingsOffset;
+    m_strings = data + h.stringsOffset;
+
+    const char *p = data + h.langsOffset;
+    for (uint32_t i = 0; i < h.numLangs; i++)
+    {
+        uint32_t len;
+        if (p + sizeof(len) > data + h.entriesOffset)
+            return false;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if (p + len > data + h.entriesOffset)
+            return false;
+        m_langCodes.push_back(str::to_wstring(std::string(p, len)));
+        m_langs.push_back(Language::TryParse(m_langCodes.back()));
+        p += len;
+    }
+
+    return true;
+}
+
+
+void CompactTMStore::Write(const wxString& path, uint64_t dataVersion, std::vector<BuildEntry>& entries)
+{
+    std::sort(entries.begin(), entries.end(),
+              [](const BuildEntry& a, const BuildEntry& b){ return a.key < b.key; });
+
+    StoreHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = STORE_MAGIC;
+    h.formatVersion = STORE_FORMAT_VERSION;
+    h.dataVersion = dataVersion;
+    h.numEntries = uint32_t(entries.size());
+    h.numBlocks = (h.numEntries + KEYS_BLOCK_SIZE - 1) / KEYS_BLOCK_SIZE;
+
+    std::string out(sizeof(StoreHeader), '\0');
+
+    // languages:
+    std::map<std::wstring, uint16_t> langIndex;
+    for (auto& e: entries)
+        langIndex.emplace(e.lang, 0);
+    h.langsOffset = out.size();
+    h.numLangs = uint32_t(langIndex.size());
+    {
+        uint16_t idx = 0;
+        for (auto& l: langIndex)
+        {
+            l.second = idx++;
+            auto code = str::to_utf8(l.first);
+            WritePOD(out, uint32_t(code.size()));
+            out += code;
+        }
+    }
+    Align(out);
+
+    // strings, keys and trigrams:
+    std::string strings, keys;
+    std::vector<EntryRecord> records;
+    std::vector<uint32_t> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> grams;
+    records.reserve(entries.size());
+    for (uint32_t i = 0; i < entries.size(); i++)
+    {
+        auto& e = entries[i];
+
+        EntryRecord r;
+        memset(&r, 0, sizeof(r));
+        auto source = str::to_utf8(e.source);
+        auto trans = str::to_utf8(e.trans);
+        r.sourceOffset = uint32_t(strings.size());
+        r.sourceLength = uint32_t(source.size());
+        strings += source;
+        r.transOffset = uint32_t(strings.size());
+        r.transLength = uint32_t(trans.size());
+        strings += trans;
+        r.created = int64_t(e.created);
+        r.lang = langIndex[e.lang];
+
+        auto normalized = str::to_wstring(e.key);
+        r.tokens = uint16_t(std::min<size_t>(Tokenize(normalized).size(), 0xffff));
+        records.push_back(r);
+
+        // front coding: each block starts with a full key, the rest store
+        // only the suffix that differs from the previous key
+        if (i % KEYS_BLOCK_SIZE == 0)
+        {
+            blocks.push_back(uint32_t(keys.size()));
+            WriteVarint(keys, uint32_t(e.key.size()));
+            keys += e.key;
+        }
+        else
+        {
+            auto& prev = entries[i - 1].key;
+            size_t prefix = 0;
+            while (prefix < prev.size() && prefix < e.key.size() && prev[prefix] == e.key[prefix])
+                prefix++;
+            WriteVarint(keys, uint32_t(prefix));
+            WriteVarint(keys, uint32_t(e.key.size() - prefix));
+            keys.append(e.key, prefix, std::string::npos);
+        }
+
+        for (auto g: GetTrigrams(normalized))
+            grams[g].push_back(i);
+    }
+
+    if (strings.size() > UINT32_MAX || keys.size() > UINT32_MAX)
+        throw Exception(_("Translation memory is too large."));
+
+    h.entriesOffset = out.size();
+    for (auto& r: records)
+        WritePOD(out, r);
+    Align(out);
+
+    h.blocksOffset = out.size();
+    for (auto b: blocks)
+        WritePOD(out, b);
+    Align(out);
+
+    h.keysOffset = out.size();
+    out += keys;
+    Align(out);
+
+    std::vector<uint32_t> sortedGrams;
+    sortedGrams.reserve(grams.size());
+    for (auto& g: grams)
+        sortedGrams.push_back(g.first);
+    std::sort(sortedGrams.begin(), sortedGrams.end());
+
+    std::string postings;
+    std::vector<GramRecord> gramRecords;
+    for (auto g: sortedGrams)
+    {
+        auto& list = grams[g];
+        gramRecords.push_back({g, uint32_t(postings.size()), uint32_t(list.size())});
+        uint32_t last = 0;
+        for (auto i: list)
+        {
+            WriteVarint(postings, i - last);
+            last = i;
+        }
+    }
+    h.numGrams = uint32_t(gramRecords.size());
+
+    h.gramsOffset = out.size();
+    for (auto& g: gramRecords)
+        WritePOD(out, g);
+    Align(out);
+
+    h.postingsOffset = out.size();
+    out += postings;
+    Align(out);
+
+    h.stringsOffset = out.size();
+    out += strings;
+    h.size = out.size();
+    memcpy(&out[0], &h, sizeof(h));
+
+    wxLogNull null;
+    wxFileName::Mkdir(GetStoreDir(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    const wxString tmp = path + ".tmp";
+    {
+        wxFFile f(tmp, "wb");
+        bool ok = f.IsOpened() && f.Write(out.data(), out.size()) == out.size();
+        if (!f.Close() || !ok)
+        {
+            wxRemoveFile(tmp);
+            throw Exception(_("Failed to write compact translation memory."));
+        }
+    }
+    if (!wxRenameFile(tmp, path, /*overwrite=*/true))
+    {
+        wxRemoveFile(tmp);
+        throw Exception(_("Failed to write compact translation memory."));
+    }
+}
+
+
+std::string CompactTMStore::Key(uint32_t i) const
+{
+    const uint32_t block = i / KEYS_BLOCK_SIZE;
+    const char *p = m_keys + m_blocks[block];
+
+    uint32_t len = ReadVarint(p);
+    std::string key(p, len);
+    p += len;
+    for (uint32_t j = block * KEYS_BLOCK_SIZE + 1; j <= i; j++)
+    {
+        uint32_t prefix = ReadVarint(p);
+        uint32_t suffix = ReadVarint(p);
+        key.resize(prefix);
+        key.append(p, suffix);
+        p += suffix;
+    }
+    return key;
+}
+
+
+uint32_t CompactTMStore::LowerBound(const std::string& key) const
+{
+    // find the last block starting with key < @a key, then scan it:
+    uint32_t lo = 0, hi = m_header->numBlocks;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (Key(mid * KEYS_BLOCK_SIZE) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return 0;
+
+    uint32_t i = (lo - 1) * KEYS_BLOCK_SIZE;
+    const uint32_t end = std::min(i + KEYS_BLOCK_SIZE, m_header->numEntries);
+    for (; i < end; i++)
+    {
+        if (Key(i) >= key)
+            break;
+    }
+    return i;
+}
+
+
+std::vector<bool> CompactTMStore::MatchingLanguages(const Language& lang) const
+{
+    // same rules as in TranslationMemory: exact language or its variants
+    const std::wstring full = lang.WCode();
+    const std::wstring lng = str::to_wstring(lang.Lang());
+    std::vector<bool> matches;
+    for (auto& code: m_langCodes)
+    {
+        bool m = code == full ||
+                 (full == lng ? code.compare(0, lng.length() + 1, lng + L"_") == 0 : code == lng);
+        matches.push_back(m);
+    }
+    return matches;
+}
+
+
+Suggestion CompactTMStore::MakeSuggestion(const Language& srclang, uint32_t i, double score) const
+{
+    auto& e = Entry(i);
+    auto source = String(e.sourceOffset, e.sourceLength);
+    auto trans = String(e.transOffset, e.transLength);
+    Suggestion s(trans, score, int(e.created));
+    s.id = TranslationMemory::GetEntryID(srclang, m_langs[e.lang], source, trans);
+    return s;
+}
+
+
+SuggestionsList CompactTMStore::Search(const Language& srclang, const Language& lang, const std::wstring& source) const
+{
+    SuggestionsList results;
+    auto add = [&results](Suggestion&& s)
+    {
+        auto found = std::find_if(results.begin(), results.end(),
+                                  [&s](const Suggestion& x){ return x.text == s.text; });
+        if (found == results.end())
+            results.push_back(std::move(s));
+        else if (s.score > found->score)
+            *found = std::move(s);
+    };
+
+    const auto langs = MatchingLanguages(lang);
+    const std::wstring normalized = Normalize(source);
+    const std::string key = str::to_utf8(normalized);
+    const uint32_t numEntries = m_header->numEntries;
+
+    // Exact and normalized matches are stored next to each other:
+    for (uint32_t i = LowerBound(key); i < numEntries && Key(i) == key; i++)
+    {
+        auto& e = Entry(i);
+        if (!langs[e.lang])
+            continue;
+        const bool exact = String(e.sourceOffset, e.sourceLength) == source;
+        add(MakeSuggestion(srclang, i, exact ? 1.0 : NORMALIZED_MATCH_SCORE));
+    }
+
+    if (!results.empty() && std::any_of(results.begin(), results.end(), [](const Suggestion& s){ return s.IsExactMatch(); }))
+    {
+        results.erase(std::remove_if(results.begin(), results.end(), [](const Suggestion& s){ return !s.IsExactMatch(); }),
+                      results.end());
+        std::stable_sort(results.begin(), results.end());
+        return results;
+    }
+
+    // Otherwise look for near matches among entries sharing many trigrams:
+    auto queryGrams = GetTrigrams(normalized);
+    const uint32_t maxPostings = std::max<uint32_t>(16, uint32_t(numEntries * MAX_GRAM_FREQUENCY));
+    std::unordered_map<uint32_t, uint32_t> shared;
+    uint32_t usedGrams = 0;
+    for (auto g: queryGrams)
+    {
+        auto rec = std::lower_bound(m_grams, m_grams + m_header->numGrams, g,
+                                    [](const GramRecord& r, uint32_t v){ return r.gram < v; });
+        if (rec == m_grams + m_header->numGrams || rec->gram != g || rec->count > maxPostings)
+            continue;
+        usedGrams++;
+        const char *p = m_postings + rec->postingsOffset;
+        uint32_t i = 0;
+        for (uint32_t n = 0; n < rec->count; n++)
+        {
+            i += ReadVarint(p);
+            shared[i]++;
+        }
+    }
+
+    const uint32_t minShared = std::max<uint32_t>(1, (usedGrams + 1) / 2);
+    std::vector<std::pair<uint32_t, uint32_t>> candidates; // (shared count, entry)
+    for (auto& c: shared)
+    {
+        if (c.second >= minShared && langs[Entry(c.first).lang])
+            candidates.emplace_back(c.second, c.first);
+    }
+    const size_t count = std::min(candidates.size(), MAX_CANDIDATES);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                      std::greater<std::pair<uint32_t, uint32_t>>());
+    candidates.resize(count);
+
+    const auto queryTokens = Tokenize(normalized);
+    const FuzzyMatcher matcher(queryTokens);
+    for (auto& c: candidates)
+    {
+        // cheap upper bound on similarity first:
+        const double len1 = double(queryTokens.size());
+        const double len2 = double(Entry(c.second).tokens);
+        if (std::max(len1, len2) > 0 && 1.0 - std::abs(len1 - len2) / std::max(len1, len2) < MIN_SIMILARITY)
+            continue;
+
+        double score = matcher.Similarity(Tokenize(str::to_wstring(Key(c.second))), MIN_SIMILARITY);
+        if (score < MIN_SIMILARITY)
+            continue;
+        // identical words, but not normalized text, e.g. different punctuation:
+        score = std::min(score, NORMALIZED_MATCH_SCORE);
+        add(MakeSuggestion(srclang, c.second, score));
+    }
+
+    std::stable_sort(results.begin(), results.end());
+    if (results.size() > MAX_RESULTS)
+        results.resize(MAX_RESULTS);
+    return results;
+}
+
+
+// ----------------------------------------------------------------
+// CompactTranslationMemory
+// ----------------------------------------------------------------
+
+CompactTranslationMemory *CompactTranslationMemory::ms_instance = nullptr;
+
+CompactTranslationMemory& CompactTranslationMemory::Get()
+{
+    static std::once_flag initializationFlag;
+    std::call_once(initializationFlag, []() {
+        ms_instance = new CompactTranslationMemory;
+    });
+    return *ms_instance;
+}
+
+void CompactTranslationMemory::CleanUp()
+{
+    if (ms_instance)
+    {
+        delete ms_instance;
+        ms_instance = nullptr;
+    }
+}
+
+CompactTranslationMemory::CompactTranslationMemory() {}
+
+CompactTranslationMemory::~CompactTranslationMemory()
+{
+    // updates use TranslationMemory, wait for them to finish:
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_updatesDone.wait(lock, [this]{ return m_runningUpdates == 0; });
+}
+
+
+std::shared_ptr<const CompactTMStore> CompactTranslationMemory::GetStore(const Language& srclang, const Language& lang)
+{
+    const auto key = GetPairKey(srclang, lang);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto i = m_pairs.find(key);
+    if (i == m_pairs.end())
+    {
+        i = m_pairs.emplace(key, PairState()).first;
+        i->second.store = CompactTMStore::Open(GetStorePath(key));
+    }
+
+    auto& state = i->second;
+    auto now = std::chrono::steady_clock::now();
+    if (!state.checking && (state.lastCheck == std::chrono::steady_clock::time_point() || now >= state.lastCheck + CHECK_INTERVAL))
+    {
+        state.checking = true;
+        state.lastCheck = now;
+        m_runningUpdates++;
+        dispatch::async(dispatch::priority::bulk, [=]{
+            try
+            {
+                Update(srclang, lang);
+            }
+            catch (...)
+            {
+                // keep using the current store, if any
+            }
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_pairs[key].checking = false;
+            if (--m_runningUpdates == 0)
+                m_updatesDone.notify_all();
+        });
+    }
+
+    return state.store;
+}
+
+
+void CompactTranslationMemory::Update(const Language& srclang, const Language& lang)
+{
+    const auto key = GetPairKey(srclang, lang);
+    std::shared_ptr<const CompactTMStore> current;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        current = m_pairs[key].store;
+    }
+
+    auto& tm = TranslationMemory::Get();
+    const uint64_t version = tm.GetDataVersion(srclang, lang);
+    if (current && current->GetDataVersion() == version)
+        return;
+
+    // collect all entries of this language (including variants) from the TM:
+    class Collector : public TranslationMemory::IOInterface
+    {
+    public:
+        Collector(const std::string& lang) : m_lang(lang) {}
+
+        void Insert(const Language&, const Language& lang,
+                    const std::wstring& source, const std::wstring& trans,
+                    time_t creationTime) override
+        {
+            if (lang.Lang() != m_lang)
+                return;
+            entries.push_back({str::to_utf8(Normalize(source)), source, trans, lang.WCode(), creationTime});
+        }
+
+        std::vector<CompactTMStore::BuildEntry> entries;
+
+    private:
+        std::string m_lang;
+    };
+
+    Collector collector(lang.Lang());
+    tm.ExportData(collector, srclang, Language());
+
+    const auto path = GetStorePath(key);
+    CompactTMStore::Write(path, version, collector.entries);
+    auto store = CompactTMStore::Open(path);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_pairs[key].store = store;
+}
+
+
+SuggestionsList CompactTranslationMemory::Filter(SuggestionsList&& results) const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_deleted.empty())
+        return std::move(results);
+    results.erase(std::remove_if(results.begin(), results.end(),
+                                 [this](const Suggestion& s){ return m_deleted.count(s.id) != 0; }),
+                  results.end());
+    return std::move(results);
+}
+
+
+SuggestionsList CompactTranslationMemory::Search(const Language& srclang,
+                                                 const Language& lang,
+                                                 const std::wstring& source,
+                                                 const dispatch::cancellation_token& token)
+{
+    auto store = GetStore(srclang, lang);
+    if (!store)
+        return TranslationMemory::Get().Search(srclang, lang, source, token);
+    return Filter(store->Search(srclang, lang, source));
+}
+
+
+std::vector<SuggestionsList> CompactTranslationMemory::SearchBatch(const Language& srclang,
+                                                                   const Language& lang,
+                                                                   const std::vector<std::wstring>& sources)
+{
+    auto store = GetStore(srclang, lang);
+    if (!store)
+        return TranslationMemory::Get().SearchBatch(srclang, lang, sources);
+
+    std::vector<SuggestionsList> results;
+    results.reserve(sources.size());
+    for (auto& s: sources)
+        results.push_back(Filter(store->Search(srclang, lang, s)));
+    return results;
+}
+
+
+dispatch::future<SuggestionsList> CompactTranslationMemory::SuggestTranslation(const SuggestionQuery&& q,
+                                                                              const dispatch::cancellation_token& token)
+{
+    try
+    {
+        return dispatch::make_ready_future(Search(q.srclang, q.lang, q.source, token));
+    }
+    catch (...)
+    {
+        return dispatch::make_exceptional_future_from_current<SuggestionsList>();
+    }
+}
+
+
+void CompactTranslationMemory::Delete(const std::string& id)
+{
+    TranslationMemory::Get().Delete(id);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_deleted.insert(id);
+}
@@ -0,0 +1,114 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_compact_tm_h
+#define Poedit_compact_tm_h
+
+#include "suggestions.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+class CompactTMStore;
+
+
+/**
+    Lightweight alternative to TranslationMemory for exact and near-exact
+    lookups, e.g. for pre-translation.
+
+    For each language pair, the content of TranslationMemory is kept in a
+    compact read-only file that is memory-mapped, so it's available instantly
+    without opening Lucene indexes. The file contains normalized source texts
+    sorted and prefix-compressed, for exact lookups, and an inverted index of
+    their character trigrams, for finding near matches.
+
+    The files are derived data in the cache directory. They are checked
+    against the TM in the background and rebuilt if it changed, so they may
+    be slightly out of date for a while. Until the file for a language pair
+    is built, TranslationMemory is searched instead.
+
+    All methods may throw Exception.
+ */
+class CompactTranslationMemory : public SuggestionsBackend
+{
+public:
+    /// Return singleton instance.
+    static CompactTranslationMemory& Get();
+
+    /// Destroys the singleton, must be called (only) on app shutdown.
+    static void CleanUp();
+
+    /// Searches for exact and near-exact matches, see TranslationMemory::Search()
+    SuggestionsList Search(const Language& srclang,
+                           const Language& lang,
+                           const std::wstring& source,
+                           const dispatch::cancellation_token& token = dispatch::cancellation_token());
+
+    /// Searches for multiple strings at once, see TranslationMemory::SearchBatch()
+    std::vector<SuggestionsList> SearchBatch(const Language& srclang,
+                                             const Language& lang,
+                                             const std::vector<std::wstring>& sources);
+
+    /// SuggestionsBackend API implementation:
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token) override;
+
+    /// Deletes from the TM; the entry is hidden immediately
+    void Delete(const std::string& id) override;
+
+private:
+    CompactTranslationMemory();
+    ~CompactTranslationMemory();
+
+    struct PairState
+    {
+        std::shared_ptr<const CompactTMStore> store;
+        std::chrono::steady_clock::time_point lastCheck;
+        bool checking = false;
+    };
+
+    /// Returns the store for the pair, scheduling its update if needed
+    std::shared_ptr<const CompactTMStore> GetStore(const Language& srclang, const Language& lang);
+
+    void Update(const Language& srclang, const Language& lang);
+
+    SuggestionsList Filter(SuggestionsList&& results) const;
+
+    std::map<std::wstring, PairState> m_pairs;
+    std::set<std::string> m_deleted;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_updatesDone;
+    int m_runningUpdates = 0;
+
+    static CompactTranslationMemory *ms_instance;
+};
+
+#endif // Poedit_compact_tm_h
@@ -0,0 +1,177 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "fuzzy_match.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+
+// Max. query length handled by the bit-parallel algorithm
+const size_t MAX_BIT_PARALLEL_LENGTH = 64;
+
+// ID of candidate terms not present in the query
+const int UNKNOWN_TERM = -1;
+
+} // anonymous namespace
+
+
+FuzzyMatcher::FuzzyMatcher(const Tokens& query)
+{
+    m_query.reserve(query.size());
+    for (auto& t: query)
+    {
+        auto i = m_ids.emplace(t, int(m_ids.size()));
+        m_query.push_back(i.first->second);
+    }
+
+    if (m_query.size() <= MAX_BIT_PARALLEL_LENGTH)
+    {
+        m_positions.resize(m_ids.size(), 0);
+        for (size_t i = 0; i < m_query.size(); i++)
+            m_positions[m_query[i]] |= uint64_t(1) << i;
+    }
+}
+
+
+double FuzzyMatcher::Similarity(const Tokens& candidate, double minSimilarity) const
+{
+    const int len1 = int(m_query.size());
+    const int len2 = int(candidate.size());
+    const int maxLen = std::max(len1, len2);
+    if (maxLen == 0)
+        return 1.0;
+
+    // Largest distance that still meets minSimilarity, with a bit of tolerance
+    // for rounding errors:
+    const int maxDistance = int(std::floor((1.0 - minSimilarity) * maxLen + 1e-9));
+    if (std::abs(len1 - len2) > maxDistance)
+        return 0.0;
+
+    std::vector<int> ids;
+    ids.reserve(candidate.size());
+    for (auto& t: candidate)
+    {
+        auto i = m_ids.find(t);
+        ids.push_back(i != m_ids.end() ? i->second : UNKNOWN_TERM);
+    }
+
+    const int distance = m_positions.empty()
+                         ? DistanceBanded(ids, maxDistance)
+                         : DistanceBitParallel(ids, maxDistance);
+    if (distance > maxDistance)
+        return 0.0;
+
+    return 1.0 - double(distance) / maxLen;
+}
+
+
+int FuzzyMatcher::DistanceBitParallel(const std::vector<int>& candidate, int maxDistance) const
+{
+    // Myers' algorithm in Hyyrö's formulation for Levenshtein distance, see
+    // "A Bit-Vector Algorithm for Computing Levenshtein and Damerau Edit
+    // Distances" (Hyyrö, 2003). Bits of the vectors represent vertical
+    // differences in the current column of the dynamic programming matrix.
+    const int len1 = int(m_query.size());
+    if (len1 == 0)
+        return int(candidate.size());
+
+    const uint64_t last = uint64_t(1) << (len1 - 1);
+    uint64_t pv = ~uint64_t(0);
+    uint64_t mv = 0;
+    int distance = len1;
+
+    int remaining = int(candidate.size());
+    for (auto id: candidate)
+    {
+        const uint64_t eq = (id == UNKNOWN_TERM) ? 0 : m_positions[id];
+        const uint64_t xv = eq | mv;
+        const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+
+        if (ph & last)
+            distance++;
+        else if (mh & last)
+            distance--;
+
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        // each remaining term can lower the distance by at most 1:
+        if (distance - --remaining > maxDistance)
+            return maxDistance + 1;
+    }
+
+    return distance;
+}
+
+
+int FuzzyMatcher::DistanceBanded(const std::vector<int>& candidate, int maxDistance) const
+{
+    // Classic dynamic programming, used for very long queries only. Only
+    // cells within maxDistance of the diagonal can be part of a path that
+    // meets the bound, so the rest is skipped.
+    const int len1 = int(m_query.size());
+    const int len2 = int(candidate.size());
+    const int outside = maxDistance + 1;
+
+    std::vector<int> prev(len1 + 1), cur(len1 + 1);
+    for (int i = 0; i <= len1; i++)
+        prev[i] = std::min(i, outside);
+
+    for (int j = 1; j <= len2; j++)
+    {
+        const int from = std::max(1, j - maxDistance);
+        const int to = std::min(len1, j + maxDistance);
+
+        cur[0] = std::min(j, outside);
+        if (from > 1)
+            cur[from - 1] = outside;
+
+        int rowMin = cur[0];
+        for (int i = from; i <= to; i++)
+        {
+            const int subst = prev[i - 1] + (m_query[i - 1] == candidate[j - 1] ? 0 : 1);
+            const int del = prev[i] + 1;
+            const int ins = cur[i - 1] + 1;
+            cur[i] = std::min(outside, std::min(subst, std::min(del, ins)));
+            rowMin = std::min(rowMin, cur[i]);
+        }
+        if (to < len1)
+            cur[to + 1] = outside;
+
+        if (rowMin > maxDistance)
+            return outside;
+        std::swap(prev, cur);
+    }
+
+    return prev[len1];
+}
@@ -0,0 +1,75 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_fuzzy_match_h
+#define Poedit_fuzzy_match_h
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+    Computes similarity of TM candidates to a query as edit distance
+    between their sequences of terms.
+
+    The result is 1 - distance / max(length1, length2), i.e. the fraction
+    of terms that don't need to be inserted, removed or replaced to turn
+    one text into the other. Unlike search engine scores, this is stable
+    and comparable across queries, so it can be shown as a match percentage.
+
+    The query is preprocessed once and then compared with any number of
+    candidates. For queries of up to 64 terms, bit-parallel algorithm is
+    used that processes all of the query's terms at once for each term of
+    the candidate.
+ */
+class FuzzyMatcher
+{
+public:
+    typedef std::vector<std::wstring> Tokens;
+
+    /// Prepares matching against @a query terms
+    explicit FuzzyMatcher(const Tokens& query);
+
+    /**
+        Returns similarity of @a candidate to the query in the 0..1 range.
+
+        Computation is bounded by @a minSimilarity: 0.0 is returned as soon
+        as it's clear that the candidate can't reach it.
+     */
+    double Similarity(const Tokens& candidate, double minSimilarity = 0.0) const;
+
+private:
+    int DistanceBitParallel(const std::vector<int>& candidate, int maxDistance) const;
+    int DistanceBanded(const std::vector<int>& candidate, int maxDistance) const;
+
+    std::unordered_map<std::wstring, int> m_ids;
+    std::vector<int> m_query;
+    // for each term ID, bitmask of its positions in the query
+    std::vector<uint64_t> m_positions;
+};
+
+#endif // Poedit_fuzzy_match_h
@@ -0,0 +1,612 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "glossary.h"
+
+#include "configuration.h"
+#include "errors.h"
+#include "pugixml.h"
+#include "unicode_helpers.h"
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/translation.h>
+
+#include <unicode/uchar.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+
+
+/// A glossary entry: a concept with its terms in several languages
+struct Glossary::Entry
+{
+    // (language code, term) pairs:
+    std::vector<std::pair<std::string, std::wstring>> terms;
+    std::wstring note;
+};
+
+
+/**
+    Aho-Corasick automaton for finding all occurrences of many terms in
+    a text at once.
+
+    States are nodes of the trie of all terms; transitions are kept in
+    a single hash table keyed by (state, character), which is compact even
+    for large alphabets.
+ */
+class Glossary::TermMatcher
+{
+public:
+    TermMatcher() : m_nodes(1) {}
+
+    /// Adds @a term, reported as @a value when found; call before Build()
+    void Add(const std::wstring& term, int value)
+    {
+        int node = 0;
+        for (auto c: term)
+        {
+            auto next = Child(node, c);
+            if (next < 0)
+            {
+                next = (int)m_nodes.size();
+                m_nodes.emplace_back();
+                m_nodes.back().depth = m_nodes[node].depth + 1;
+                m_edges.emplace(Key(node, c), next);
+            }
+            node = next;
+        }
+        m_nodes[node].value = value;
+    }
+
+    /// Computes failure links once all terms were added
+    void Build()
+    {
+        std::vector<std::vector<std::pair<wchar_t, int>>> children(m_nodes.size());
+        for (auto& e: m_edges)
+            children[size_t(e.first >> 32)].emplace_back(wchar_t(e.first & 0xFFFFFFFF), e.second);
+
+        // breadth-first, so that links always point to already processed nodes:
+        std::deque<int> queue;
+        for (auto& c: children[0])
+            queue.push_back(c.second);
+
+        while (!queue.empty())
+        {
+            const int node = queue.front();
+            queue.pop_front();
+
+            for (auto& c: children[node])
+            {
+                const int child = c.second;
+                int fail = m_nodes[node].fail;
+                for (;;)
+                {
+                    auto next = Child(fail, c.first);
+                    if (next >= 0)
+                    {
+                        m_nodes[child].fail = next;
+                        break;
+                    }
+                    if (fail == 0)
+                        break;
+                    fail = m_nodes[fail].fail;
+                }
+
+                auto& f = m_nodes[m_nodes[child].fail];
+                m_nodes[child].output = (f.value >= 0) ? m_nodes[child].fail : f.output;
+                queue.push_back(child);
+            }
+        }
+    }
+
+    /// Calls @a onMatch(end, length, value) for every occurrence of a term in @a text
+    template<typename F>
+    void Find(const std::wstring& text, F&& onMatch) const
+    {
+        int state = 0;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            const wchar_t c = text[i];
+            for (;;)
+            {
+                auto next = Child(state, c);
+                if (next >= 0)
+                {
+                    state = next;
+                    break;
+                }
+                if (state == 0)
+                    break;
+                state = m_nodes[state].fail;
+            }
+
+            for (int o = (m_nodes[state].value >= 0) ? state : m_nodes[state].output; o > 0; o = m_nodes[o].output)
+                onMatch(i + 1, (size_t)m_nodes[o].depth, m_nodes[o].value);
+        }
+    }
+
+private:
+    struct Node
+    {
+        Node() : fail(0), output(-1), value(-1), depth(0) {}
+
+        int fail;   // longest proper suffix that is in the trie
+        int output; // longest proper suffix that is a term, or -1
+        int value;  // value of the term ending here, or -1
+        int depth;
+    };
+
+    static uint64_t Key(int node, wchar_t c) { return (uint64_t(node) << 32) | uint32_t(c); }
+
+    int Child(int node, wchar_t c) const
+    {
+        auto i = m_edges.find(Key(node, c));
+        return i == m_edges.end() ? -1 : i->second;
+    }
+
+    std::vector<Node> m_nodes;
+    std::unordered_map<uint64_t, int> m_edges;
+};
+
+
+/// Terms for a single language pair
+struct Glossary::PairIndex
+{
+    struct Term
+    {
+        std::wstring term;
+        std::vector<std::wstring> translations;
+        std::wstring note;
+    };
+
+    std::vector<Term> terms;
+    // index into terms by case-folded term:
+    std::unordered_map<std::wstring, int> byFolded;
+    TermMatcher matcher;
+};
+
+
+namespace
+{
+
+std::wstring FoldCase(const std::wstring& s)
+{
+    return unicode::fold_case(s).ToStdWstring();
+}
+
+std::wstring Trim(const std::wstring& s)
+{
+    auto begin = s.find_first_not_of(L" \t\r\n");
+    if (begin == std::wstring::npos)
+        return std::wstring();
+    auto end = s.find_last_not_of(L" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+inline bool IsWordChar(wchar_t c)
+{
+    return c == L'_' || u_isalnum((UChar32)c);
+}
+
+// Terms in scripts that don't separate words with spaces may be anywhere:
+inline bool NeedsWordBoundary(wchar_t c)
+{
+    return c < 0x2E80 && IsWordChar(c);
+}
+
+bool LanguageMatches(const std::string& code, const Language& lang)
+{
+    if (code == lang.Code())
+        return true;
+    auto l = Language::TryParse(code);
+    if (!l.IsValid())
+        return false;
+    // generic terms (e.g. "pt") apply to all variants of the language:
+    return l == lang || (l.Country().empty() && l.Variant().empty() && l.Lang() == lang.Lang());
+}
+
+
+void CollectText(pugi::xml_node node, std::string& text)
+{
+    for (auto child: node.children())
+    {
+        if (child.type() == pugi::node_pcdata || child.type() == pugi::node_cdata)
+            text += child.value();
+        else if (child.type() == pugi::node_element)
+            CollectText(child, text);
+    }
+}
+
+/// Returns text of the element, including any inline markup's
+std::wstring CollectText(pugi::xml_node node)
+{
+    std::string text;
+    CollectText(node, text);
+    return pugi::as_wide(text);
+}
+
+template<typename F>
+void ForEachElement(pugi::xml_node node, const char *name, const char *altName, F&& func)
+{
+    for (auto child: node.children())
+    {
+        if (child.type() != pugi::node_element)
+            continue;
+        if (strcmp(child.name(), name) == 0 || strcmp(child.name(), altName) == 0)
+            func(child);
+        else
+            ForEachElement(child, name, altName, func);
+    }
+}
+
+/// Loads TBX files, both TBX 2 (<termEntry>) and TBX 3 (<conceptEntry>)
+void LoadTBX(const wxString& path, std::vector<std::shared_ptr<const Glossary::Entry>>& entries)
+{
+    pugi::xml_document doc;
+    auto result = doc.load_file(path.wc_str());
+    if (!result)
+        throw Exception(wxString::Format(_("The glossary file is malformed: %s"), result.description()));
+
+    ForEachElement(doc, "termEntry", "conceptEntry", [&entries](pugi::xml_node node)
+    {
+        auto e = std::make_shared<Glossary::Entry>();
+        for (auto child: node.children())
+        {
+            const char *name = child.name();
+            if (e->note.empty() && (strcmp(name, "descrip") == 0 || strcmp(name, "note") == 0))
+                e->note = Trim(CollectText(child));
+            if (strcmp(name, "descripGrp") == 0)
+            {
+                if (e->note.empty())
+                    e->note = Trim(CollectText(child.child("descrip")));
+                continue;
+            }
+            if (strcmp(name, "langSet") != 0 && strcmp(name, "langSec") != 0)
+                continue;
+
+            std::string lang = child.attribute("xml:lang").as_string();
+            if (lang.empty())
+                lang = child.attribute("lang").as_string();
+            if (lang.empty())
+                continue;
+            ForEachElement(child, "term", "term", [&e,&lang](pugi::xml_node term)
+            {
+                auto text = Trim(CollectText(term));
+                if (!text.empty())
+                    e->terms.emplace_back(lang, text);
+            });
+        }
+        if (e->terms.size() > 1)
+            entries.push_back(e);
+    });
+}
+
+
+std::vector<std::vector<std::wstring>> ParseCSV(const std::wstring& data, wchar_t delimiter)
+{
+    std::vector<std::vector<std::wstring>> rows;
+    std::vector<std::wstring> row;
+    std::wstring cell;
+    bool quoted = false;
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        const wchar_t c = data[i];
+        if (quoted)
+        {
+            if (c != L'"')
+                cell += c;
+            else if (i + 1 < data.size() && data[i + 1] == L'"')
+                cell += data[++i];
+            else
+                quoted = false;
+        }
+        else if (c == L'"' && cell.empty())
+        {
+            quoted = true;
+        }
+        else if (c == delimiter)
+        {
+            row.push_back(std::move(cell));
+            cell.clear();
+        }
+        else if (c == L'\n')
+        {
+            row.push_back(std::move(cell));
+            cell.clear();
+            rows.push_back(std::move(row));
+            row.clear();
+        }
+        else if (c != L'\r')
+        {
+            cell += c;
+        }
+    }
+
+    if (!cell.empty() || !row.empty())
+    {
+        row.push_back(std::move(cell));
+        rows.push_back(std::move(row));
+    }
+
+    return rows;
+}
+
+/// Loads CSV or tab-separated files with language codes in the first row
+void LoadCSV(const wxString& path, std::vector<std::shared_ptr<const Glossary::Entry>>& entries)
+{
+    wxFFile file;
+    wxString content;
+    if (!file.Open(path, "rb") || !file.ReadAll(&content, wxConvUTF8))
+        throw Exception(_("error reading the file"));
+
+    std::wstring data = content.ToStdWstring();
+    if (!data.empty() && data[0] == L'\xFEFF')
+        data.erase(0, 1);
+
+    // use the most common of the possible separators in the header:
+    const auto header = data.substr(0, data.find(L'\n'));
+    wchar_t delimiter = L',';
+    for (auto d: {L'\t', L';'})
+    {
+        if (std::count(header.begin(), header.end(), d) > std::count(header.begin(), header.end(), delimiter))
+            delimiter = d;
+    }
+
+    auto rows = ParseCSV(data, delimiter);
+    if (rows.empty())
+        return;
+
+    std::vector<std::string> languages;
+    int noteColumn = -1;
+    int languagesCount = 0;
+    for (size_t i = 0; i < rows[0].size(); i++)
+    {
+        auto name = Trim(rows[0][i]);
+        auto lower = FoldCase(name);
+        if (lower == L"note" || lower == L"notes" || lower == L"description" || lower == L"comment" || lower == L"definition")
+        {
+            noteColumn = (int)i;
+            languages.emplace_back();
+            continue;
+        }
+        languages.push_back(Language::TryParse(name).IsValid() ? std::string(name.begin(), name.end()) : std::string());
+        if (!languages.back().empty())
+            languagesCount++;
+    }
+
+    if (languagesCount < 2)
+        throw Exception(_(L"The glossary file doesn’t have language codes in its header row."));
+
+    for (size_t r = 1; r < rows.size(); r++)
+    {
+        auto& row = rows[r];
+        auto e = std::make_shared<Glossary::Entry>();
+        for (size_t i = 0; i < row.size() && i < languages.size(); i++)
+        {
+            if ((int)i == noteColumn)
+                e->note = Trim(row[i]);
+            else if (!languages[i].empty())
+            {
+                auto term = Trim(row[i]);
+                if (!term.empty())
+                    e->terms.emplace_back(languages[i], term);
+            }
+        }
+        if (e->terms.size() > 1)
+            entries.push_back(e);
+    }
+}
+
+} // anonymous namespace
+
+
+Glossary *Glossary::ms_instance = nullptr;
+
+Glossary& Glossary::Get()
+{
+    static std::once_flag initializationFlag;
+    std::call_once(initializationFlag, []() {
+        ms_instance = new Glossary;
+    });
+    return *ms_instance;
+}
+
+void Glossary::CleanUp()
+{
+    if (ms_instance)
+    {
+        delete ms_instance;
+        ms_instance = nullptr;
+    }
+}
+
+Glossary::Glossary() : m_loaded(false), m_version(1)
+{
+}
+
+Glossary::~Glossary()
+{
+}
+
+
+void Glossary::Reload()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_loaded = false;
+    m_entries.clear();
+    m_indexes.clear();
+    m_version++;
+}
+
+
+void Glossary::EnsureLoaded()
+{
+    if (m_loaded)
+        return;
+    m_loaded = true;
+
+    for (auto& path: Config::GlossaryPaths())
+    {
+        try
+        {
+            auto ext = wxFileName(path).GetExt().Lower();
+            if (ext == "tbx" || ext == "xml")
+                LoadTBX(path, m_entries);
+            else
+                LoadCSV(path, m_entries);
+        }
+        catch (...)
+        {
+            wxLogWarning(_(L"Couldn’t load glossary %s: %s"), path, DescribeCurrentException());
+        }
+    }
+
+    wxLogTrace("poedit.glossary", "loaded %d glossary entries", (int)m_entries.size());
+}
+
+
+std::shared_ptr<const Glossary::PairIndex> Glossary::GetIndex(const Language& srclang, const Language& lang)
+{
+    if (!srclang.IsValid() || !lang.IsValid() || srclang == lang)
+        return nullptr;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    EnsureLoaded();
+
+    const auto key = srclang.Code() + "|" + lang.Code();
+    auto found = m_indexes.find(key);
+    if (found != m_indexes.end())
+        return found->second;
+
+    auto index = std::make_shared<PairIndex>();
+    for (auto& e: m_entries)
+    {
+        std::vector<std::wstring> sources, translations;
+        for (auto& t: e->terms)
+        {
+            if (LanguageMatches(t.first, srclang))
+                sources.push_back(t.second);
+            else if (LanguageMatches(t.first, lang))
+                translations.push_back(t.second);
+        }
+        if (translations.empty())
+            continue;
+
+        for (auto& s: sources)
+        {
+            auto folded = FoldCase(s);
+            auto i = index->byFolded.find(folded);
+            if (i == index->byFolded.end())
+            {
+                i = index->byFolded.emplace(folded, (int)index->terms.size()).first;
+                index->terms.push_back({s, {}, e->note});
+            }
+            auto& term = index->terms[i->second];
+            for (auto& t: translations)
+            {
+                if (std::find(term.translations.begin(), term.translations.end(), t) == term.translations.end())
+                    term.translations.push_back(t);
+            }
+        }
+    }
+
+    std::shared_ptr<const PairIndex> result;
+    if (!index->terms.empty())
+    {
+        for (auto& t: index->byFolded)
+            index->matcher.Add(t.first, t.second);
+        index->matcher.Build();
+        result = index;
+    }
+
+    m_indexes.emplace(key, result);
+    return result;
+}
+
+
+bool Glossary::HasTermsFor(const Language& srclang, const Language& lang)
+{
+    return GetIndex(srclang, lang) != nullptr;
+}
+
+
+Glossary::Matches Glossary::FindTerms(const Language& srclang, const Language& lang, const std::wstring& text)
+{
+    Matches matches;
+
+    auto index = GetIndex(srclang, lang);
+    if (!index)
+        return matches;
+
+    // folding preserves length, so positions apply to the original text:
+    index->matcher.Find(FoldCase(text), [&](size_t end, size_t length, int value)
+    {
+        const size_t start = end - length;
+        if (start > 0 && NeedsWordBoundary(text[start]) && IsWordChar(text[start - 1]))
+            return;
+        if (end < text.size() && NeedsWordBoundary(text[end - 1]) && IsWordChar(text[end]))
+            return;
+        auto& t = index->terms[value];
+        matches.push_back({start, length, t.term, t.translations, t.note});
+    });
+
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b)
+    {
+        return a.pos < b.pos || (a.pos == b.pos && a.length > b.length);
+    });
+    return matches;
+}
+
+
+dispatch::future<SuggestionsList> Glossary::SuggestTranslation(const SuggestionQuery&& q,
+                                                               const dispatch::cancellation_token&)
+{
+    SuggestionsList results;
+
+    auto index = GetIndex(q.srclang, q.lang);
+    if (index)
+    {
+        auto found = index->byFolded.find(FoldCase(Trim(q.source)));
+        if (found != index->byFolded.end())
+        {
+            for (auto& t: index->terms[found->second].translations)
+                results.emplace_back(t, 1.0, 0, Suggestion::Source::Glossary);
+        }
+    }
+
+    return dispatch::make_ready_future(std::move(results));
+}
+
+
+uint64_t Glossary::GetCacheVersion(const Language&, const Language&)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_version;
+}
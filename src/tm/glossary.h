@@ -0,0 +1,121 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_glossary_h
+#define Poedit_glossary_h
+
+#include "suggestions.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+    Terminology glossaries, loaded from the files in Config::GlossaryPaths().
+
+    Both TBX files and CSV (or tab-separated) files with language codes in
+    the header row are supported; a "note" or "description" column provides
+    a note for the term.
+
+    For each language pair, all source language terms are compiled into
+    a single Aho-Corasick automaton, which finds all terms occurring in
+    a text in one pass over it, regardless of the number of terms. Matching
+    is case-insensitive and respects word boundaries.
+
+    As a SuggestionsBackend, it suggests translations of texts that are
+    glossary terms in their entirety.
+
+    @note The class is thread-safe.
+ */
+class Glossary : public SuggestionsBackend
+{
+public:
+    /// Return singleton instance.
+    static Glossary& Get();
+
+    /// Destroys the singleton, must be called (only) on app shutdown.
+    static void CleanUp();
+
+    /// A term found in a text
+    struct Match
+    {
+        /// Position and length of the term in the searched text
+        size_t pos, length;
+        /// The term as written in the glossary
+        std::wstring term;
+        /// Its translations into the target language
+        std::vector<std::wstring> translations;
+        /// Optional note about the term
+        std::wstring note;
+    };
+
+    typedef std::vector<Match> Matches;
+
+    /// Is there a glossary with terms for the languages?
+    bool HasTermsFor(const Language& srclang, const Language& lang);
+
+    /**
+        Finds all glossary terms in @a text.
+
+        Matches are sorted by position, longer ones first if several terms
+        start at the same position. They may overlap.
+     */
+    Matches FindTerms(const Language& srclang, const Language& lang, const std::wstring& text);
+
+    /// Reloads glossaries, e.g. after Config::GlossaryPaths() changed
+    void Reload();
+
+    /// SuggestionsBackend API implementation:
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token) override;
+    void Delete(const std::string&) override {}
+    uint64_t GetCacheVersion(const Language& srclang, const Language& lang) override;
+
+    class TermMatcher;
+
+private:
+    Glossary();
+    ~Glossary();
+
+    struct Entry;
+    struct PairIndex;
+
+    void EnsureLoaded();
+    std::shared_ptr<const PairIndex> GetIndex(const Language& srclang, const Language& lang);
+
+    std::mutex m_mutex;
+    bool m_loaded;
+    // incremented on every reload, never 0:
+    uint64_t m_version;
+    std::vector<std::shared_ptr<const Entry>> m_entries;
+    std::map<std::string, std::shared_ptr<const PairIndex>> m_indexes;
+
+    static Glossary *ms_instance;
+};
+
+#endif // Poedit_glossary_h
@@ -0,0 +1,186 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "harvest_digest.h"
+
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/ffile.h>
+#include <wx/log.h>
+#include <wx/stdpaths.h>
+#include <wx/utils.h>
+
+#include <algorithm>
+
+namespace
+{
+
+const uint32_t DIGEST_MAGIC = 0x48544f50; // "POTH"
+const uint32_t DIGEST_FORMAT_VERSION = 1;
+
+
+// 64bit FNV-1a
+class Hasher
+{
+public:
+    void Add(const std::wstring& s)
+    {
+        for (auto c: s)
+        {
+            m_hash ^= uint64_t(c);
+            m_hash *= 1099511628211ULL;
+        }
+        // separator, so that ("ab", "c") and ("a", "bc") differ:
+        m_hash *= 1099511628211ULL;
+    }
+
+    void Add(const char *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            m_hash ^= static_cast<unsigned char>(data[i]);
+            m_hash *= 1099511628211ULL;
+        }
+    }
+
+    uint64_t Get() const { return m_hash; }
+
+private:
+    uint64_t m_hash = 14695981039346656037ULL;
+};
+
+
+wxString GetDigestsDir()
+{
+    wxString cache;
+#if defined(__WXOSX__)
+    cache = wxGetHomeDir() + "/Library/Caches/net.poedit.Poedit";
+#elif defined(__UNIX__)
+    if (!wxGetEnv("XDG_CACHE_HOME", &cache))
+        cache = wxGetHomeDir() + "/.cache";
+    cache += "/poedit";
+#else
+    cache = wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "Cache";
+#endif
+    cache += wxFILE_SEP_PATH;
+    cache += "Harvested";
+    return cache;
+}
+
+} // anonymous namespace
+
+
+HarvestDigest::HarvestDigest(const wxString& filename)
+{
+    if (filename.empty())
+        return;
+
+    const wxScopedCharBuffer path = wxFileName(filename).GetAbsolutePath().utf8_str();
+    Hasher h;
+    h.Add(path.data(), path.length());
+    m_path = wxString::Format("%s%c%016llx.digest",
+                              GetDigestsDir(), wxFILE_SEP_PATH, (unsigned long long)h.Get());
+
+    if (!wxFileName::FileExists(m_path))
+        return;
+
+    wxLogNull null;
+    wxFFile f(m_path, "rb");
+    if (!f.IsOpened())
+        return;
+
+    uint32_t header[2];
+    uint64_t count;
+    if (f.Read(header, sizeof(header)) != sizeof(header) ||
+        header[0] != DIGEST_MAGIC || header[1] != DIGEST_FORMAT_VERSION ||
+        f.Read(&count, sizeof(count)) != sizeof(count) ||
+        count * sizeof(uint64_t) != uint64_t(f.Length()) - sizeof(header) - sizeof(count))
+    {
+        return;
+    }
+
+    m_digests.resize(count);
+    if (count && f.Read(m_digests.data(), count * sizeof(uint64_t)) != count * sizeof(uint64_t))
+        m_digests.clear();
+}
+
+
+uint64_t HarvestDigest::Compute(const Language& srclang, const Language& lang,
+                                const std::wstring& source, const std::wstring& trans)
+{
+    Hasher h;
+    h.Add(srclang.WCode());
+    h.Add(lang.WCode());
+    h.Add(source);
+    h.Add(trans);
+    return h.Get();
+}
+
+
+bool HarvestDigest::Contains(uint64_t digest) const
+{
+    return std::binary_search(m_digests.begin(), m_digests.end(), digest);
+}
+
+
+void HarvestDigest::Save(std::vector<uint64_t> digests) const
+{
+    if (m_path.empty())
+        return;
+
+    std::sort(digests.begin(), digests.end());
+    digests.erase(std::unique(digests.begin(), digests.end()), digests.end());
+
+    wxLogNull null;
+    wxFileName::Mkdir(GetDigestsDir(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+    const wxString tmp = m_path + ".tmp";
+    {
+        wxFFile f(tmp, "wb");
+        if (!f.IsOpened())
+            return;
+        const uint32_t header[2] = { DIGEST_MAGIC, DIGEST_FORMAT_VERSION };
+        const uint64_t count = digests.size();
+        bool ok = f.Write(header, sizeof(header)) == sizeof(header) &&
+                  f.Write(&count, sizeof(count)) == sizeof(count) &&
+                  f.Write(digests.data(), count * sizeof(uint64_t)) == count * sizeof(uint64_t);
+        if (!f.Close() || !ok)
+        {
+            wxRemoveFile(tmp);
+            return;
+        }
+    }
+    if (!wxRenameFile(tmp, m_path, /*overwrite=*/true))
+        wxRemoveFile(tmp);
+}
+
+
+void HarvestDigest::ClearAll()
+{
+    wxLogNull null;
+    const wxString dir = GetDigestsDir();
+    if (wxFileName::DirExists(dir))
+        wxFileName::Rmdir(dir, wxPATH_RMDIR_RECURSIVE);
+}
@@ -0,0 +1,76 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_harvest_digest_h
+#define Poedit_harvest_digest_h
+
+#include "language.h"
+
+#include <wx/string.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+    Persistent record of translations harvested from a file into the TM.
+
+    It stores 64bit digests of all (source language, language, source text,
+    translation) tuples that were stored in the TM from the file last time,
+    so that harvesting the same file again only needs to write new or changed
+    translations into the TM.
+
+    The digests are kept in the cache directory. Losing them is harmless:
+    everything is harvested again the next time.
+ */
+class HarvestDigest
+{
+public:
+    /// Loads digest for translations from @a filename; empty if there's none
+    explicit HarvestDigest(const wxString& filename);
+
+    /// Computes digest of a single translation
+    static uint64_t Compute(const Language& srclang, const Language& lang,
+                            const std::wstring& source, const std::wstring& trans);
+
+    /// Was the translation with given digest already harvested?
+    bool Contains(uint64_t digest) const;
+
+    /**
+        Replaces the stored digest with @a digests, i.e. all translations
+        currently in the file. Does nothing for files without a name.
+     */
+    void Save(std::vector<uint64_t> digests) const;
+
+    /// Removes all stored digests, must be called when the TM is emptied
+    static void ClearAll();
+
+private:
+    wxString m_path;
+    std::vector<uint64_t> m_digests;
+};
+
+#endif // Poedit_harvest_digest_h
@@ -0,0 +1,502 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_HTTP_CLIENT
+
+#include "machine_translation.h"
+
+#include "configuration.h"
+#include "errors.h"
+#include "http_client.h"
+#include "keychain/keytar.h"
+#include "str_helpers.h"
+#include "utility.h"
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/translation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+
+namespace
+{
+
+// Identifies the engine in cache keys
+const char *ENGINE = "deepl";
+
+// Maximum number of texts sent in a single request, as allowed by the API
+const size_t MAX_BATCH_SIZE = 50;
+
+// Average and burst number of requests per second
+const double REQUESTS_PER_SECOND = 2.0;
+const double REQUESTS_BURST = 5.0;
+
+const unsigned MAX_CONNECTIONS = 2;
+
+// Number of cached translations above which old ones are discarded
+const size_t MAX_CACHED = 100000;
+
+std::string ToUpper(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](char c){ return (char)toupper((unsigned char)c); });
+    return s;
+}
+
+std::string SourceLangCode(const Language& lang)
+{
+    return ToUpper(lang.Lang());
+}
+
+std::string TargetLangCode(const Language& lang)
+{
+    // some languages must be translated into a specific variant:
+    auto code = ToUpper(lang.Lang());
+    auto country = lang.Country();
+    if (code == "EN")
+        return country == "GB" ? "EN-GB" : "EN-US";
+    if (code == "PT")
+        return country == "BR" ? "PT-BR" : "PT-PT";
+    return code;
+}
+
+// Keys for the free API, which has its own endpoint, end with ":fx"
+bool IsFreeKey(const std::string& key)
+{
+    return key.size() > 3 && key.compare(key.size() - 3, 3, ":fx") == 0;
+}
+
+} // anonymous namespace
+
+
+/**
+    Limits the rate of requests: tokens are added to the bucket at a fixed
+    rate up to its capacity, and each request takes one.
+
+    A caller that finds the bucket empty takes the token in advance and
+    waits for the time it takes to refill it, so that waiting callers are
+    served in order.
+ */
+class MachineTranslation::TokenBucket
+{
+public:
+    TokenBucket(double rate, double capacity)
+        : m_rate(rate), m_capacity(capacity), m_tokens(capacity), m_last(std::chrono::steady_clock::now())
+    {}
+
+    /// Takes a token, blocking until it is available
+    void Acquire()
+    {
+        std::chrono::duration<double> wait(0);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto now = std::chrono::steady_clock::now();
+            m_tokens = std::min(m_capacity, m_tokens + std::chrono::duration<double>(now - m_last).count() * m_rate);
+            m_last = now;
+            m_tokens -= 1.0;
+            if (m_tokens < 0)
+                wait = std::chrono::duration<double>(-m_tokens / m_rate);
+        }
+        if (wait.count() > 0)
+            std::this_thread::sleep_for(wait);
+    }
+
+private:
+    std::mutex m_mutex;
+    const double m_rate, m_capacity;
+    double m_tokens;
+    std::chrono::steady_clock::time_point m_last;
+};
+
+
+/**
+    Persistent cache of translations.
+
+    Stored as a file with one JSON object per line, to which new
+    translations are appended; it is loaded on first use.
+ */
+class MachineTranslation::Cache
+{
+public:
+    Cache() : m_loaded(false)
+    {
+        m_filename = GetUserCacheDir("MachineTranslation") + wxFILE_SEP_PATH + "translations.jsonl";
+    }
+
+    static std::string MakeKey(const Language& srclang, const Language& lang, const std::wstring& source)
+    {
+        return std::string(ENGINE) + "/" + srclang.Code() + "/" + lang.Code() + "/" + str::to_utf8(source);
+    }
+
+    bool Get(const std::string& key, std::wstring& translation)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        EnsureLoaded();
+        auto i = m_data.find(key);
+        if (i == m_data.end())
+            return false;
+        translation = str::to_wstring(i->second);
+        return true;
+    }
+
+    void Put(const std::vector<std::pair<std::string, std::wstring>>& entries)
+    {
+        if (entries.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        EnsureLoaded();
+
+        std::string lines;
+        for (auto& e: entries)
+        {
+            auto text = str::to_utf8(e.second);
+            m_data[e.first] = text;
+            lines += json({{"k", e.first}, {"t", text}}).dump();
+            lines += '\n';
+        }
+
+        auto dir = wxFileName(m_filename).GetPath();
+        if (!wxFileName::DirExists(dir))
+            wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        wxFFile f;
+        if (f.Open(m_filename, "ab"))
+            f.Write(lines.data(), lines.size());
+    }
+
+private:
+    void EnsureLoaded()
+    {
+        if (m_loaded)
+            return;
+        m_loaded = true;
+
+        wxFFile f;
+        wxString content;
+        if (!wxFileName::FileExists(m_filename) || !f.Open(m_filename, "rb") || !f.ReadAll(&content, wxConvUTF8))
+            return;
+        f.Close();
+
+        const std::string data(content.utf8_str());
+        std::vector<std::pair<std::string, std::string>> entries;
+        size_t start = 0;
+        while (start < data.size())
+        {
+            auto end = data.find('\n', start);
+            if (end == std::string::npos)
+                end = data.size();
+            try
+            {
+                auto j = json::parse(data.begin() + start, data.begin() + end);
+                entries.emplace_back(j.at("k").get<std::string>(), j.at("t").get<std::string>());
+            }
+            catch (...)
+            {
+                // broken lines (e.g. after a crash while writing) are skipped
+            }
+            start = end + 1;
+        }
+
+        // keep only the newer half once the cache grows too big:
+        const bool compact = entries.size() > MAX_CACHED;
+        if (compact)
+            entries.erase(entries.begin(), entries.end() - MAX_CACHED / 2);
+
+        for (auto& e: entries)
+            m_data[e.first] = e.second;
+
+        if (compact)
+        {
+            std::string lines;
+            for (auto& e: entries)
+            {
+                lines += json({{"k", e.first}, {"t", e.second}}).dump();
+                lines += '\n';
+            }
+            if (f.Open(m_filename, "wb"))
+                f.Write(lines.data(), lines.size());
+        }
+    }
+
+    std::mutex m_mutex;
+    wxString m_filename;
+    bool m_loaded;
+    std::unordered_map<std::string, std::string> m_data;
+};
+
+
+class MachineTranslation::deepl_http_client : public http_client
+{
+public:
+    deepl_http_client(const std::string& key)
+        : http_client(IsFreeKey(key) ? "https://api-free.deepl.com" : "https://api.deepl.com")
+    {
+        set_authorization("DeepL-Auth-Key " + key);
+        set_max_connections(MAX_CONNECTIONS);
+    }
+
+protected:
+    std::string parse_json_error(const json& response) const override
+    {
+        return response.value("message", "");
+    }
+
+    void on_error_response(int& statusCode, std::string& message) override
+    {
+        if (statusCode == 403/*Forbidden*/)
+            message = _("The DeepL API key is not valid.").utf8_str();
+        else if (statusCode == 456/*Quota exceeded*/)
+            message = _("The DeepL translation quota was exceeded.").utf8_str();
+        else if (statusCode == 429/*Too Many Requests*/)
+            message = _("Too many requests to DeepL, please try again later.").utf8_str();
+    }
+};
+
+
+MachineTranslation *MachineTranslation::ms_instance = nullptr;
+
+MachineTranslation& MachineTranslation::Get()
+{
+    static std::once_flag initializationFlag;
+    std::call_once(initializationFlag, []() {
+        ms_instance = new MachineTranslation;
+    });
+    return *ms_instance;
+}
+
+void MachineTranslation::CleanUp()
+{
+    if (ms_instance)
+    {
+        delete ms_instance;
+        ms_instance = nullptr;
+    }
+}
+
+MachineTranslation::MachineTranslation()
+    : m_keyLoaded(false),
+      m_rateLimit(new TokenBucket(REQUESTS_PER_SECOND, REQUESTS_BURST)),
+      m_cache(new Cache)
+{
+}
+
+MachineTranslation::~MachineTranslation()
+{
+}
+
+
+bool MachineTranslation::IsEnabled()
+{
+    if (!Config::UseMachineTranslation())
+        return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // until the key is read, assume there is one; queries read it if needed:
+    return !m_keyLoaded || !m_key.empty();
+}
+
+
+void MachineTranslation::SetAuthKey(const std::string& key)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_key = key;
+        m_keyLoaded = true;
+        m_client.reset();
+    }
+
+    if (key.empty())
+        keytar::DeletePassword("DeepL", "");
+    else
+        keytar::AddPassword("DeepL", "", key);
+}
+
+
+std::string MachineTranslation::GetAuthKey()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_keyLoaded)
+            return m_key;
+    }
+
+    // don't hold the lock while reading the keychain, it may be slow:
+    std::string key;
+    if (!keytar::GetPassword("DeepL", "", &key))
+        key.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // SetAuthKey() called in the meantime takes precedence:
+    if (!m_keyLoaded)
+    {
+        m_key = key;
+        m_keyLoaded = true;
+    }
+    return m_key;
+}
+
+
+std::shared_ptr<MachineTranslation::deepl_http_client> MachineTranslation::GetClient()
+{
+    auto key = GetAuthKey();
+    if (key.empty())
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_client)
+        m_client = std::make_shared<deepl_http_client>(key);
+    return m_client;
+}
+
+
+dispatch::future<std::vector<std::wstring>> MachineTranslation::TranslateBatch(const Language& srclang,
+                                                                               const Language& lang,
+                                                                               const std::vector<std::wstring>& sources)
+{
+    struct State
+    {
+        std::vector<std::wstring> results;
+        std::mutex mutex;
+        size_t pending = 0;
+        bool translated = false;
+        dispatch::exception_ptr error;
+        dispatch::promise<std::vector<std::wstring>> promise;
+    };
+
+    auto state = std::make_shared<State>();
+    state->results.resize(sources.size());
+    auto future = state->promise.get_future();
+
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (!sources[i].empty() && !m_cache->Get(Cache::MakeKey(srclang, lang, sources[i]), state->results[i]))
+            missing.push_back(i);
+    }
+
+    if (missing.empty())
+    {
+        state->promise.set_value(std::move(state->results));
+        return future;
+    }
+
+    state->pending = (missing.size() + MAX_BATCH_SIZE - 1) / MAX_BATCH_SIZE;
+
+    auto finished = [state](dispatch::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (error && !state->error)
+            state->error = error;
+        if (--state->pending > 0)
+            return;
+        // partial results are more useful than an error, e.g. for pre-translation:
+        if (state->error && !state->translated)
+            state->promise.set_exception(state->error);
+        else
+            state->promise.set_value(std::move(state->results));
+    };
+
+    // Getting the client may need the keychain, and waiting for rate limits
+    // blocks, so requests are made from a background thread:
+    dispatch::async(dispatch::priority::normal, [=]
+    {
+        std::shared_ptr<deepl_http_client> client;
+        try
+        {
+            client = GetClient();
+            if (!client)
+                throw Exception(_("DeepL API key is not set."));
+        }
+        catch (...)
+        {
+            auto error = dispatch::current_exception();
+            for (size_t b = 0; b < missing.size(); b += MAX_BATCH_SIZE)
+                finished(error);
+            return;
+        }
+
+        for (size_t b = 0; b < missing.size(); b += MAX_BATCH_SIZE)
+        {
+            std::vector<size_t> batch(missing.begin() + b, missing.begin() + std::min(b + MAX_BATCH_SIZE, missing.size()));
+
+            urlencoded_data data;
+            data.add_value("source_lang", SourceLangCode(srclang));
+            data.add_value("target_lang", TargetLangCode(lang));
+            for (auto i: batch)
+                data.add_value("text", str::to_utf8(sources[i]));
+
+            m_rateLimit->Acquire();
+
+            client->post("/v2/translate", data)
+            .then([=](dispatch::future<json> response)
+            {
+                try
+                {
+                    auto r = response.get();
+                    auto& translations = r.at("translations");
+                    std::vector<std::pair<std::string, std::wstring>> cached;
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        for (size_t j = 0; j < batch.size() && j < translations.size(); j++)
+                        {
+                            auto text = str::to_wstring(translations[j].value("text", ""));
+                            if (text.empty())
+                                continue;
+                            state->results[batch[j]] = text;
+                            state->translated = true;
+                            cached.emplace_back(Cache::MakeKey(srclang, lang, sources[batch[j]]), text);
+                        }
+                    }
+                    m_cache->Put(cached);
+                    finished(dispatch::exception_ptr());
+                }
+                catch (...)
+                {
+                    finished(dispatch::current_exception());
+                }
+            });
+        }
+    });
+
+    return future;
+}
+
+
+dispatch::future<SuggestionsList> MachineTranslation::SuggestTranslation(const SuggestionQuery&& q,
+                                                                         const dispatch::cancellation_token&)
+{
+    return TranslateBatch(q.srclang, q.lang, {q.source})
+        .then([](std::vector<std::wstring> results)
+        {
+            SuggestionsList list;
+            if (!results.empty() && !results.front().empty())
+                list.emplace_back(results.front(), 0.0, 0, Suggestion::Source::MachineTranslation);
+            return list;
+        });
+}
+
+#endif // HAVE_HTTP_CLIENT
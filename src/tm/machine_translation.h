@@ -0,0 +1,114 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_machine_translation_h
+#define Poedit_machine_translation_h
+
+#ifdef HAVE_HTTP_CLIENT
+
+#include "suggestions.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+    Machine translation suggestions, provided by the DeepL API.
+
+    Requests are batched: many source strings are sent in a single HTTP
+    request when translating in bulk, e.g. during pre-translation, and the
+    number of requests per second is limited with a token bucket so that
+    the service's rate limits aren't exceeded.
+
+    Results are cached persistently in the cache directory, keyed by
+    engine, languages and source text, so that the same text is never
+    translated twice.
+
+    The API key is stored in the keychain; it is read in the background on
+    first use.
+
+    @note The class is thread-safe.
+ */
+class MachineTranslation : public SuggestionsBackend
+{
+public:
+    /// Return singleton instance.
+    static MachineTranslation& Get();
+
+    /// Destroys the singleton, must be called (only) on app shutdown.
+    static void CleanUp();
+
+    /// Is machine translation enabled in preferences and is there an API key?
+    bool IsEnabled();
+
+    /// Sets the API key and stores it in the keychain; empty removes it
+    void SetAuthKey(const std::string& key);
+
+    /// Returns the API key, reading it from the keychain if needed (slow)
+    std::string GetAuthKey();
+
+    /**
+        Translates @a sources, using as few HTTP requests as possible. Cached
+        translations are used without contacting the service.
+
+        The returned vector has the same size as @a sources; texts that
+        couldn't be translated have empty translations.
+     */
+    dispatch::future<std::vector<std::wstring>> TranslateBatch(const Language& srclang,
+                                                               const Language& lang,
+                                                               const std::vector<std::wstring>& sources);
+
+    /// SuggestionsBackend API implementation:
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token) override;
+    void Delete(const std::string&) override {}
+
+    class TokenBucket;
+    class Cache;
+
+private:
+    MachineTranslation();
+    ~MachineTranslation();
+
+    class deepl_http_client;
+
+    std::shared_ptr<deepl_http_client> GetClient();
+
+    std::mutex m_mutex;
+    bool m_keyLoaded;
+    std::string m_key;
+    std::shared_ptr<deepl_http_client> m_client;
+
+    std::unique_ptr<TokenBucket> m_rateLimit;
+    std::unique_ptr<Cache> m_cache;
+
+    static MachineTranslation *ms_instance;
+};
+
+#endif // HAVE_HTTP_CLIENT
+
+#endif // Poedit_machine_translation_h
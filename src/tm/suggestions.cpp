@@ -25,27 +25,153 @@
 
 #include "suggestions.h"
 
+#include "compact_tm.h"
 #include "concurrency.h"
+#include "configuration.h"
+#include "glossary.h"
+#include "machine_translation.h"
+#include "tracing.h"
 #include "transmem.h"
 
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+
+namespace
+{
+
+struct RegisteredBackend
+{
+    Suggestion::Source source;
+    SuggestionsBackendRegistry::BackendGetter getter;
+    SuggestionsBackendRegistry::EnabledCheck isEnabled;
+};
+
+struct RegistryData
+{
+    RegistryData()
+    {
+        // Poedit's own TM, possibly accelerated by the compact index:
+        backends.push_back(
+        {
+            Suggestion::Source::LocalTM,
+            []() -> SuggestionsBackend&
+            {
+                if (Config::UseCompactTM())
+                    return CompactTranslationMemory::Get();
+                else
+                    return TranslationMemory::Get();
+            },
+            []{ return Config::UseTM(); }
+        });
+
+        // terminology, if any glossaries are configured:
+        backends.push_back(
+        {
+            Suggestion::Source::Glossary,
+            []() -> SuggestionsBackend& { return Glossary::Get(); },
+            []{ return !Config::GlossaryPaths().empty(); }
+        });
+
+#ifdef HAVE_HTTP_CLIENT
+        backends.push_back(
+        {
+            Suggestion::Source::MachineTranslation,
+            []() -> SuggestionsBackend& { return MachineTranslation::Get(); },
+            []{ return MachineTranslation::Get().IsEnabled(); }
+        });
+#endif
+    }
+
+    std::mutex mutex;
+    std::vector<RegisteredBackend> backends;
+};
+
+RegistryData& GetRegistry()
+{
+    static RegistryData s_data;
+    return s_data;
+}
+
+
+// Number of queries whose results are kept in SuggestionsCache
+const size_t MAX_CACHED_QUERIES = 2000;
+
+struct CacheData
+{
+    struct Key
+    {
+        SuggestionsBackend *backend;
+        uint64_t version;
+        std::string srclang, lang;
+        std::wstring source;
+
+        bool operator<(const Key& other) const
+        {
+            return std::tie(backend, version, srclang, lang, source) <
+                   std::tie(other.backend, other.version, other.srclang, other.lang, other.source);
+        }
+    };
+
+    typedef std::list<std::pair<Key, SuggestionsList>> LRUList;
+
+    std::mutex mutex;
+    // most recently used entries are at the front:
+    LRUList entries;
+    std::map<Key, LRUList::iterator> index;
+};
+
+CacheData& GetCache()
+{
+    static CacheData s_data;
+    return s_data;
+}
+
+} // anonymous namespace
+
 
 class SuggestionsProviderImpl
 {
 public:
     SuggestionsProviderImpl() {}
 
-    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q)
+    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token,
+                                                         dispatch::priority priority)
     {
         auto bck = &backend;
-        return dispatch::async([=]{
-            // don't bother asking the backend if the language or query is invalid:
-            if (!q.srclang.IsValid() || !q.lang.IsValid() || q.srclang == q.lang || q.source.empty())
+        return dispatch::async(priority, [=]{
+            // don't bother asking the backend if the language or query is invalid
+            // or if the query became obsolete while waiting in the queue:
+            if (!q.srclang.IsValid() || !q.lang.IsValid() || q.srclang == q.lang || q.source.empty() ||
+                token.is_cancelled())
             {
                 return dispatch::make_ready_future(SuggestionsList());
             }
 
+            // use cached results if the backend's data didn't change since:
+            const uint64_t version = bck->GetCacheVersion(q.srclang, q.lang);
+            if (version)
+            {
+                SuggestionsList cached;
+                if (SuggestionsCache::Get(*bck, version, q.srclang, q.lang, q.source, cached))
+                    return dispatch::make_ready_future(std::move(cached));
+            }
+
             // query the backend:
-            return bck->SuggestTranslation(std::move(q));
+            auto srclang = q.srclang;
+            auto lang = q.lang;
+            auto source = q.source;
+            return bck->SuggestTranslation(std::move(q), token).then([=](SuggestionsList results)
+            {
+                // results of cancelled queries may be incomplete, don't keep them:
+                if (version && !token.is_cancelled())
+                    SuggestionsCache::Put(*bck, version, srclang, lang, source, results);
+                return results;
+            });
         });
     }
 };
@@ -60,9 +186,11 @@ SuggestionsProvider::~SuggestionsProvider()
 {
 }
 
-dispatch::future<SuggestionsList> SuggestionsProvider::SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q)
+dispatch::future<SuggestionsList> SuggestionsProvider::SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q,
+                                                                          const dispatch::cancellation_token& token,
+                                                                          dispatch::priority priority)
 {
-    return m_impl->SuggestTranslation(backend, std::move(q));
+    return m_impl->SuggestTranslation(backend, std::move(q), token, priority);
 }
 
 void SuggestionsProvider::Delete(const Suggestion& s)
@@ -70,10 +198,136 @@ void SuggestionsProvider::Delete(const Suggestion& s)
     if (s.id.empty())
         return;
 
-    switch (s.source)
+    auto backend = SuggestionsBackendRegistry::Get(s.source);
+    if (backend)
+        backend->Delete(s.id);
+
+    // the backend may not reflect the deletion in its version right away:
+    SuggestionsCache::Clear();
+}
+
+
+
+bool SuggestionsCache::Get(SuggestionsBackend& backend, uint64_t version,
+                           const Language& srclang, const Language& lang,
+                           const std::wstring& source,
+                           SuggestionsList& results)
+{
+    auto& c = GetCache();
+    std::lock_guard<std::mutex> guard(c.mutex);
+
+    auto found = c.index.find({&backend, version, srclang.Code(), lang.Code(), source});
+    if (found == c.index.end())
+    {
+        TRACE_COUNT("SuggestionsCache misses");
+        return false;
+    }
+
+    TRACE_COUNT("SuggestionsCache hits");
+    c.entries.splice(c.entries.begin(), c.entries, found->second);
+    results = found->second->second;
+    return true;
+}
+
+void SuggestionsCache::Put(SuggestionsBackend& backend, uint64_t version,
+                           const Language& srclang, const Language& lang,
+                           const std::wstring& source,
+                           const SuggestionsList& results)
+{
+    auto& c = GetCache();
+    std::lock_guard<std::mutex> guard(c.mutex);
+
+    CacheData::Key key {&backend, version, srclang.Code(), lang.Code(), source};
+    auto found = c.index.find(key);
+    if (found != c.index.end())
+    {
+        found->second->second = results;
+        c.entries.splice(c.entries.begin(), c.entries, found->second);
+        return;
+    }
+
+    c.entries.emplace_front(key, results);
+    c.index.emplace(key, c.entries.begin());
+
+    // Evict least recently used entries; those for outdated versions are
+    // never used again, so they go away this way too:
+    while (c.entries.size() > MAX_CACHED_QUERIES)
+    {
+        c.index.erase(c.entries.back().first);
+        c.entries.pop_back();
+    }
+}
+
+void SuggestionsCache::Clear()
+{
+    auto& c = GetCache();
+    std::lock_guard<std::mutex> guard(c.mutex);
+    c.index.clear();
+    c.entries.clear();
+}
+
+
+
+void SuggestionsBackendRegistry::Register(Suggestion::Source source,
+                                          BackendGetter getter,
+                                          EnabledCheck isEnabled)
+{
+    auto& r = GetRegistry();
+    std::lock_guard<std::mutex> guard(r.mutex);
+
+    for (auto& b: r.backends)
+    {
+        if (b.source == source)
+        {
+            b.getter = getter;
+            b.isEnabled = isEnabled;
+            return;
+        }
+    }
+    r.backends.push_back({source, getter, isEnabled});
+}
+
+void SuggestionsBackendRegistry::Unregister(Suggestion::Source source)
+{
+    auto& r = GetRegistry();
+    std::lock_guard<std::mutex> guard(r.mutex);
+
+    r.backends.erase(std::remove_if(r.backends.begin(), r.backends.end(),
+                                    [source](const RegisteredBackend& b){ return b.source == source; }),
+                     r.backends.end());
+}
+
+std::vector<SuggestionsBackendRegistry::Entry> SuggestionsBackendRegistry::GetEnabled()
+{
+    std::vector<RegisteredBackend> backends;
+    {
+        auto& r = GetRegistry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        backends = r.backends;
+    }
+
+    // don't call into backends with the lock held, getters may be expensive:
+    std::vector<Entry> enabled;
+    for (auto& b: backends)
+    {
+        if (b.isEnabled && !b.isEnabled())
+            continue;
+        enabled.emplace_back(b.source, &b.getter());
+    }
+    return enabled;
+}
+
+SuggestionsBackend *SuggestionsBackendRegistry::Get(Suggestion::Source source)
+{
+    BackendGetter getter;
     {
-        case Suggestion::Source::LocalTM:
-            TranslationMemory::Get().Delete(s.id);
-            break;
+        auto& r = GetRegistry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        for (auto& b: r.backends)
+        {
+            if (b.source == source)
+                getter = b.getter;
+        }
     }
+    return getter ? &getter() : nullptr;
 }
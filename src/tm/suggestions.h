@@ -27,9 +27,12 @@
 #define Poedit_suggestions_h
 
 #include <cmath>
+#include <cstdint>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "concurrency.h"
@@ -56,7 +59,11 @@ struct Suggestion
     /// Possible types of suggestion sources
     enum class Source
     {
-        LocalTM
+        LocalTM,            ///< Poedit's own translation memory
+        SharedTM,           ///< read-only shared translation memory
+        MachineTranslation, ///< machine translation service
+        Glossary,           ///< terminology glossary
+        CurrentFile         ///< other items of the edited file
     };
 
     /// Ctor
@@ -124,10 +131,22 @@ public:
 
         @param backend    Suggestions backend to use, e.g. TranslationMemory::Get().
         @param q          Source text and its metadata.
+        @param token      Allows cancelling the query when its results are
+                          no longer needed. Results of cancelled queries
+                          are incomplete and should be ignored.
+        @param priority   Priority of the query; queries the user isn't
+                          waiting for (e.g. prefetching) should use lower one.
      */
-    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q);
+    dispatch::future<SuggestionsList> SuggestTranslation(SuggestionsBackend& backend, const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token = dispatch::cancellation_token(),
+                                                         dispatch::priority priority = dispatch::priority::interactive);
 
-    /// Mark a suggestion as good. Called when a suggestion is used.
+    /**
+        Delete the suggestion from the backend it came from.
+
+        Does nothing for suggestions without ID or from backends that
+        don't support deleting, such as shared TMs.
+     */
     static void Delete(const Suggestion& s);
 
 private:
@@ -165,11 +184,116 @@ public:
         list as its argument.
         
         @param q     Source text and its metadata.
+        @param token Cancellation token. Implementations should check it
+                     between expensive steps and return early (with
+                     whatever they have) once it is cancelled.
      */
-    virtual dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q) = 0;
+    virtual dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                                 const dispatch::cancellation_token& token) = 0;
 
     /// Delete suggestion with given ID from the database
     virtual void Delete(const std::string& id) = 0;
+
+    /**
+        Returns a number that changes whenever results of queries for given
+        languages may change.
+
+        SuggestionsProvider caches results for as long as the version stays
+        the same. The default implementation returns 0, which means that the
+        backend's results must not be cached.
+
+        @note Must be cheap, it's called for every query.
+     */
+    virtual uint64_t GetCacheVersion(const Language& /*srclang*/, const Language& /*lang*/) { return 0; }
+};
+
+
+/**
+    Bounded LRU cache of suggestions, keyed by backend and query.
+
+    The cache is shared by all users, so that e.g. the sidebar benefits from
+    suggestions fetched during pre-translation. Entries are tagged with the
+    backend's SuggestionsBackend::GetCacheVersion() and don't survive its
+    change.
+
+    SuggestionsProvider uses it transparently, other code searching backends
+    directly (e.g. in batches) may use it explicitly.
+
+    @note The cache is thread-safe.
+ */
+class SuggestionsCache
+{
+public:
+    /**
+        Look up cached suggestions.
+
+        @param version  Current GetCacheVersion() value for the languages,
+                        must not be 0.
+     */
+    static bool Get(SuggestionsBackend& backend, uint64_t version,
+                    const Language& srclang, const Language& lang,
+                    const std::wstring& source,
+                    SuggestionsList& results);
+
+    /**
+        Store suggestions in the cache.
+
+        @param version  GetCacheVersion() value obtained @em before the
+                        backend was queried for @a results.
+     */
+    static void Put(SuggestionsBackend& backend, uint64_t version,
+                    const Language& srclang, const Language& lang,
+                    const std::wstring& source,
+                    const SuggestionsList& results);
+
+    /// Remove all cached results.
+    static void Clear();
+};
+
+
+/**
+    Registry of suggestion backends used by the UI.
+
+    All enabled backends are queried in parallel, each of them independently
+    of the others, and their results are shown as soon as they arrive.
+    Poedit's local TM is always registered for Suggestion::Source::LocalTM.
+
+    Backends are identified by the kind of suggestions they provide, there's
+    at most one backend per Suggestion::Source value.
+
+    @note The registry is thread-safe.
+ */
+class SuggestionsBackendRegistry
+{
+public:
+    /// Returns the backend; called lazily, only when it is needed.
+    typedef std::function<SuggestionsBackend&()> BackendGetter;
+    /// Returns whether the backend should be queried at the moment.
+    typedef std::function<bool()> EnabledCheck;
+
+    typedef std::pair<Suggestion::Source, SuggestionsBackend*> Entry;
+
+    /**
+        Register a backend, replacing any previously registered one for
+        the same @a source.
+
+        @param source     Kind of suggestions provided by the backend.
+        @param getter     Function returning the backend.
+        @param isEnabled  Optional check if the backend is enabled; it is
+                          always enabled if not provided.
+     */
+    static void Register(Suggestion::Source source,
+                         BackendGetter getter,
+                         EnabledCheck isEnabled = EnabledCheck());
+
+    /// Remove backend registered for @a source, if any.
+    static void Unregister(Suggestion::Source source);
+
+    /// Returns all currently enabled backends, in registration order.
+    static std::vector<Entry> GetEnabled();
+
+    /// Returns the backend for @a source or nullptr if there's none.
+    static SuggestionsBackend *Get(Suggestion::Source source);
 };
 
 #endif // Poedit_suggestions_h
@@ -33,6 +33,11 @@
 
 #include <wx/translation.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+
 #include "errors.h"
 #include "pugixml.h"
 #include "version.h"
@@ -72,114 +77,421 @@ std::wstring extract_seg(xml_node node)
     return pugi::as_wide(text);
 }
 
-} // anonymous namespace
+// Defaults for all translation units, read from TMX <header>
+struct ImportDefaults
+{
+    std::string srclang;
+    std::string date;
+};
 
+void read_header(xml_node header, ImportDefaults& defaults)
+{
+    defaults.srclang = header.attribute("srclang").value();
+    if (defaults.srclang == "*all*")
+        defaults.srclang.clear();
+    defaults.date = extract_date(header);
+}
 
-void TMX::ImportFromFile(std::istream& file, TranslationMemory& tm)
+// Imports translations from a single <tu> element, returns their count
+int import_tu(xml_node tu, const ImportDefaults& defaults, TranslationMemory::IOInterface& writer)
 {
-    xml_document doc;
-    auto result = doc.load(file);
-    if (!result)
-        throw std::runtime_error(result.description());
+    int counter = 0;
 
-    auto root = doc.child("tmx");
-    if (!root)
-        throw Exception(_("The TMX file is malformed."));
+    auto tuDate = extract_date(tu, defaults.date);
+    std::string tuSrclang = tu.attribute("srclang").value();
+    if (tuSrclang.empty())
+        tuSrclang = defaults.srclang;
 
-    std::string defaultSrclang;
-    std::string defaultDate;
-    auto header = root.child("header");
-    if (header)
+    std::wstring source;
+    for (auto tuv: tu.children("tuv"))
     {
-        defaultSrclang = header.attribute("srclang").value();
-        if (defaultSrclang == "*all*")
-            defaultSrclang.clear();
-        defaultDate = extract_date(header);
+        if (extract_lang(tuv) == tuSrclang)
+        {
+            source = extract_seg(tuv);
+            break;
+        }
     }
+    if (source.empty())
+        return 0;
 
-    int counter = 0;
-    auto body = root.child("body");
-    if (!body)
-        throw Exception(_("The TMX file is malformed."));
+    for (auto tuv: tu.children("tuv"))
+    {
+        auto tuvLang = extract_lang(tuv);
+        if (tuvLang == tuSrclang)
+            continue;
+
+        auto srclang = Language::TryParse(tuSrclang);
+        auto lang = Language::TryParse(tuvLang);
+        if (!srclang.IsValid() || !lang.IsValid())
+            continue;
+
+        auto trans = extract_seg(tuv);
+        if (trans.empty())
+            continue;
+
+        time_t creationTime = 0;
+        auto tuvDate = extract_date(tu, tuDate);
+        if (!tuvDate.empty())
+        {
+            struct tm t {};
+            std::istringstream s(tuvDate.c_str());
+            s >> std::get_time(&t, "%Y%m%dT%H%M%SZ"); // YYYYMMDDThhmmssZ
+            if (!s.fail())
+                creationTime = timegm(&t);
+        }
+
+        writer.Insert(srclang, lang, source, trans, creationTime);
+        counter++;
+    }
 
-    tm.ImportData([=,&counter,&body](auto& writer)
+    return counter;
+}
+
+
+/**
+    Reads TMX file incrementally, one <header> or <tu> element at a time.
+
+    Only the (small) elements of interest are extracted from the stream and
+    then parsed individually, so that memory use doesn't depend on the size
+    of the file. This requires the file to be in UTF-8 (or ASCII-compatible)
+    encoding, see IsSupportedEncoding().
+ */
+class TMXStreamReader
+{
+public:
+    static const size_t CHUNK_SIZE = 1024 * 1024;
+
+    explicit TMXStreamReader(std::istream& file) : m_file(file), m_pos(0), m_consumed(0), m_size(0)
+    {
+        // determine the size for progress reporting, if the stream permits it:
+        auto start = file.tellg();
+        if (start != std::streampos(-1) && file.seekg(0, std::ios::end))
+        {
+            auto end = file.tellg();
+            if (end != std::streampos(-1))
+                m_size = size_t(end - start);
+        }
+        file.clear();
+        file.seekg(start);
+
+        Fill();
+    }
+
+    /// Checks if the file starts like a TMX file would
+    bool HasRoot() const { return m_buffer.find("<tmx") != std::string::npos; }
+
+    /// Returns false for UTF-16/32 or legacy 8-bit encodings
+    bool IsSupportedEncoding() const
     {
-        for (auto tu: body.children("tu"))
+        if (m_buffer.size() >= 2 && (m_buffer[0] == 0 || m_buffer[1] == 0 ||
+                                     (uint8_t)m_buffer[0] == 0xFF || (uint8_t)m_buffer[0] == 0xFE))
         {
-            auto tuDate = extract_date(tu, defaultDate);
-            std::string tuSrclang = tu.attribute("srclang").value();
-            if (tuSrclang.empty())
-                tuSrclang = defaultSrclang;
+            return false;
+        }
 
-            std::wstring source;
-            for (auto tuv: tu.children("tuv"))
+        const size_t bom = (m_buffer.compare(0, 3, "\xEF\xBB\xBF") == 0) ? 3 : 0;
+        if (m_buffer.compare(bom, 5, "<?xml") == 0)
+        {
+            auto prolog = m_buffer.substr(bom, m_buffer.find("?>"));
+            std::transform(prolog.begin(), prolog.end(), prolog.begin(), ::tolower);
+            auto enc = prolog.find("encoding");
+            if (enc != std::string::npos && prolog.find("utf-8", enc) == std::string::npos)
+                return false;
+        }
+
+        return true;
+    }
+
+    /// Reads the rest of the file (including what was already buffered) into memory
+    std::string ReadAll()
+    {
+        std::string all(m_buffer, m_pos);
+        all.append(std::istreambuf_iterator<char>(m_file), std::istreambuf_iterator<char>());
+        m_buffer.clear();
+        m_pos = 0;
+        return all;
+    }
+
+    /**
+        Finds the next <header> or <tu> element, puts its name into @a name
+        and its complete XML into @a xml. Returns false at the end of file.
+     */
+    bool NextElement(std::string& name, std::string& xml)
+    {
+        for (;;)
+        {
+            size_t start, end;
+            if (Scan(name, start, end))
             {
-                if (extract_lang(tuv) == tuSrclang)
-                {
-                    source = extract_seg(tuv);
-                    break;
-                }
+                xml.assign(m_buffer, start, end - start);
+                m_pos = end;
+                return true;
+            }
+            if (!Fill())
+                return false;
+        }
+    }
+
+    /// Returns fraction of the file processed so far, if known, or -1
+    double GetProgress() const
+    {
+        return m_size ? double(m_consumed + m_pos) / m_size : -1.0;
+    }
+
+private:
+    static const size_t npos = std::string::npos;
+
+    // Reads more data into the buffer, discarding already processed content
+    bool Fill()
+    {
+        m_buffer.erase(0, m_pos);
+        m_consumed += m_pos;
+        m_pos = 0;
+
+        const size_t old = m_buffer.size();
+        m_buffer.resize(old + CHUNK_SIZE);
+        m_file.read(&m_buffer[old], CHUNK_SIZE);
+        m_buffer.resize(old + size_t(m_file.gcount()));
+        return m_buffer.size() > old;
+    }
+
+    // Finds next '<' that starts markup of interest, i.e. neither a comment,
+    // CDATA section nor processing instruction. Returns npos if more data is
+    // needed and sets @a resume to where scanning should resume then.
+    size_t FindMarkup(size_t i, size_t& resume) const
+    {
+        for (;;)
+        {
+            i = m_buffer.find('<', i);
+            resume = (i == npos) ? m_buffer.size() : i;
+            if (i == npos)
+                return npos;
+
+            const char *terminator = nullptr;
+            if (m_buffer.compare(i, 4, "<!--") == 0)
+                terminator = "-->";
+            else if (m_buffer.compare(i, 9, "<![CDATA[") == 0)
+                terminator = "]]>";
+            else if (m_buffer.compare(i, 2, "<?") == 0 || m_buffer.compare(i, 2, "<!") == 0)
+                terminator = ">";
+            else if (m_buffer.size() - i < 9)
+                return npos; // may be a prefix of the above
+            else
+                return i;
+
+            i = m_buffer.find(terminator, i);
+            if (i == npos)
+                return npos;
+        }
+    }
+
+    // Returns the length of element name at @a i if it is one of the interesting
+    // ones, 0 if it isn't, npos if more data is needed
+    size_t MatchName(size_t i, std::string& name) const
+    {
+        for (auto n: {"header", "tu"})
+        {
+            const size_t len = strlen(n);
+            if (m_buffer.size() < i + len + 1)
+                return npos;
+            if (m_buffer.compare(i, len, n) != 0)
+                continue;
+            auto next = m_buffer[i + len];
+            if (next == '>' || next == '/' || isspace((unsigned char)next))
+            {
+                name = n;
+                return len;
             }
-            if (source.empty())
+        }
+        return 0;
+    }
+
+    bool Scan(std::string& name, size_t& start, size_t& end)
+    {
+        size_t i = m_pos;
+        size_t resume;
+        for (;;)
+        {
+            i = FindMarkup(i, resume);
+            if (i == npos)
+                break;
+            resume = i;
+
+            auto len = MatchName(i + 1, name);
+            if (len == npos)
+                break;
+            if (len == 0)
+            {
+                i++;
                 continue;
+            }
 
-            for (auto tuv: tu.children("tuv"))
+            // find the end of the start tag, skipping attribute values:
+            size_t gt = i + 1 + len;
+            char quote = 0;
+            for (; gt < m_buffer.size(); gt++)
             {
-                auto tuvLang = extract_lang(tuv);
-                if (tuvLang == tuSrclang)
-                    continue;
-
-                auto srclang = Language::TryParse(tuSrclang);
-                auto lang = Language::TryParse(tuvLang);
-                if (!srclang.IsValid() || !lang.IsValid())
-                    continue;
-
-                auto trans = extract_seg(tuv);
-                if (trans.empty())
-                    continue;
-
-                time_t creationTime = 0;
-                auto tuvDate = extract_date(tu, tuDate);
-                if (!tuvDate.empty())
+                char c = m_buffer[gt];
+                if (quote)
                 {
-                    struct tm t {};
-                    std::istringstream s(tuvDate.c_str());
-                    s >> std::get_time(&t, "%Y%m%dT%H%M%SZ"); // YYYYMMDDThhmmssZ
-                    if (!s.fail())
-                        creationTime = timegm(&t);
+                    if (c == quote)
+                        quote = 0;
                 }
+                else if (c == '"' || c == '\'')
+                    quote = c;
+                else if (c == '>')
+                    break;
+            }
+            if (gt == m_buffer.size())
+                break;
 
-                writer.Insert(srclang, lang, source, trans, creationTime);
-                counter++;
+            if (m_buffer[gt - 1] == '/')
+            {
+                start = i;
+                end = gt + 1;
+                return true;
             }
+
+            // find the matching end tag; elements we look for can't be nested:
+            const std::string endTag = "</" + name;
+            for (size_t j = gt + 1;;)
+            {
+                size_t unused;
+                j = FindMarkup(j, unused);
+                if (j == npos)
+                    break;
+                if (m_buffer.size() < j + endTag.length() + 1)
+                    break;
+                auto next = m_buffer[j + endTag.length()];
+                if (m_buffer.compare(j, endTag.length(), endTag) == 0 && (next == '>' || isspace((unsigned char)next)))
+                {
+                    auto close = m_buffer.find('>', j);
+                    if (close == npos)
+                        break;
+                    start = i;
+                    end = close + 1;
+                    return true;
+                }
+                j++;
+            }
+            break;
         }
-    });
 
-    if (counter == 0)
-        throw Exception(_("No translations were found in the TMX file."));
-}
+        // Not found in the buffered data. Skip what was already scanned, but
+        // keep any partially read element:
+        m_pos = resume;
+        return false;
+    }
 
+    std::istream& m_file;
+    std::string m_buffer;
+    size_t m_pos;
+    size_t m_consumed;
+    size_t m_size;
+};
 
+} // anonymous namespace
 
 
-void TMX::ExportToFile(TranslationMemory& tm, std::ostream& file)
+void TMX::ImportFromFile(std::istream& file, TranslationMemory& tm, const ProgressCallback& progress)
 {
+    TMXStreamReader reader(file);
+    if (!reader.HasRoot())
+        throw Exception(_("The TMX file is malformed."));
+
+    int counter = 0;
+    bool cancelled = false;
+
+    if (!reader.IsSupportedEncoding())
+    {
+        // Non-UTF-8 files are rare enough to not bother with streaming them,
+        // let pugixml handle the encoding:
+        auto data = reader.ReadAll();
+        xml_document doc;
+        auto result = doc.load_buffer(data.data(), data.size());
+        if (!result)
+            throw std::runtime_error(result.description());
+
+        auto root = doc.child("tmx");
+        auto body = root.child("body");
+        if (!root || !body)
+            throw Exception(_("The TMX file is malformed."));
+
+        ImportDefaults defaults;
+        auto header = root.child("header");
+        if (header)
+            read_header(header, defaults);
+
+        tm.ImportData([&](auto& writer)
+        {
+            for (auto tu: body.children("tu"))
+                counter += import_tu(tu, defaults, writer);
+        });
+    }
+    else
+    {
+        tm.ImportData([&](auto& writer)
+        {
+            ImportDefaults defaults;
+            std::string name, xml;
+            xml_document element;
+            double lastProgress = 0.0;
+            size_t elements = 0;
+
+            while (reader.NextElement(name, xml))
+            {
+                auto result = element.load_buffer(xml.data(), xml.size(), parse_default, encoding_utf8);
+                if (!result)
+                    throw std::runtime_error(result.description());
+
+                if (name == "header")
+                    read_header(element.first_child(), defaults);
+                else
+                    counter += import_tu(element.first_child(), defaults, writer);
+
+                if (progress)
+                {
+                    // don't report progress too often, it's relatively expensive:
+                    double p = reader.GetProgress();
+                    if (p < 0 ? (++elements % 1000 == 0) : (p - lastProgress > 0.001))
+                    {
+                        lastProgress = p;
+                        if (!progress(p))
+                        {
+                            cancelled = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    if (counter == 0 && !cancelled)
+        throw Exception(_("No translations were found in the TMX file."));
+}
+
+
+void TMX::ExportToFile(TranslationMemory& tm, std::ostream& file,
+                       const Language& srclang, const Language& lang)
+{
+    // Writes TMX directly to the output, in chunks, without building the
+    // document in memory first. The output is identical to what pugixml would
+    // produce for the same document.
     class Exporter : public TranslationMemory::IOInterface
     {
     public:
-        Exporter()
+        static const size_t CHUNK_SIZE = 64 * 1024;
+
+        Exporter(std::ostream& file) : m_file(file)
         {
-            auto root = m_doc.append_child("tmx");
-            root.append_attribute("version") = "1.4";
-            auto header = root.append_child("header");
-            header.append_attribute("creationtool") = "Poedit";
-            header.append_attribute("creationtoolversion") = POEDIT_VERSION;
-            header.append_attribute("datatype") = "PlainText";
-            header.append_attribute("segtype") = "sentence";
-            header.append_attribute("adminlang") = "en";
-            header.append_attribute("srclang") = "en"; // reasonable default for gettext
-            header.append_attribute("o-tmf") = "PoeditTM";
-            m_body = root.append_child("body");
+            m_buffer.reserve(CHUNK_SIZE + 4096);
+            m_buffer += "<?xml version=\"1.0\"?>\n"
+                        "<tmx version=\"1.4\">\n"
+                        "\t<header creationtool=\"Poedit\" creationtoolversion=\"" POEDIT_VERSION "\" "
+                        "datatype=\"PlainText\" segtype=\"sentence\" adminlang=\"en\" "
+                        "srclang=\"en\" o-tmf=\"PoeditTM\" />\n" // reasonable default for gettext
+                        "\t<body>\n";
         }
 
         void Insert(const Language& srclang,
@@ -188,43 +500,105 @@ void TMX::ExportToFile(TranslationMemory& tm, std::ostream& file)
                     const std::wstring& trans,
                     time_t creationTime) override
         {
-            auto tu = m_body.append_child("tu");
             auto srctag = srclang.LanguageTag();
+
+            m_buffer += "\t\t<tu";
             if (srctag != "en")
-                tu.append_attribute("srclang") = srctag.c_str();
+                AppendAttribute("srclang", srctag);
 
             if (creationTime > 0)
             {
                 struct tm t;
                 wxGmtime_r(&creationTime, &t);
-                std::ostringstream s;
-                s << std::put_time(&t, "%Y%m%dT%H%M%SZ"); // YYYYMMDDThhmmssZ
-                tu.append_attribute("creationdate") = s.str().c_str();
+                char date[32];
+                strftime(date, sizeof(date), "%Y%m%dT%H%M%SZ", &t); // YYYYMMDDThhmmssZ
+                AppendAttribute("creationdate", date);
             }
+            m_buffer += ">\n";
 
+            AppendTUV(srctag, source);
+            AppendTUV(lang.LanguageTag(), trans);
+
+            m_buffer += "\t\t</tu>\n";
+
+            if (m_buffer.size() >= CHUNK_SIZE)
+                Flush();
+        }
+
+        void Finish()
+        {
+            m_buffer += "\t</body>\n"
+                        "</tmx>\n";
+            Flush();
+        }
+
+    private:
+        void AppendTUV(const std::string& langTag, const std::wstring& text)
+        {
+            m_buffer += "\t\t\t<tuv";
+            AppendAttribute("xml:lang", langTag);
+            m_buffer += ">\n\t\t\t\t<seg>";
+            AppendEscaped(pugi::as_utf8(text), false);
+            m_buffer += "</seg>\n\t\t\t</tuv>\n";
+        }
+
+        void AppendAttribute(const char *name, const std::string& value)
+        {
+            m_buffer += ' ';
+            m_buffer += name;
+            m_buffer += "=\"";
+            AppendEscaped(value, true);
+            m_buffer += '"';
+        }
+
+        void AppendEscaped(const std::string& s, bool attribute)
+        {
+            for (auto c: s)
             {
-                auto tuv = tu.append_child("tuv");
-                tuv.append_attribute("xml:lang") = srctag.c_str();
-                tuv.append_child("seg").text() = pugi::as_utf8(source).c_str();
-            }
-            {
-                auto tuv = tu.append_child("tuv");
-                tuv.append_attribute("xml:lang") = lang.LanguageTag().c_str();
-                tuv.append_child("seg").text() = pugi::as_utf8(trans).c_str();
+                switch (c)
+                {
+                    case '&':
+                        m_buffer += "&amp;";
+                        break;
+                    case '<':
+                        m_buffer += "&lt;";
+                        break;
+                    case '>':
+                        m_buffer += "&gt;";
+                        break;
+                    case '\r':
+                        m_buffer += "&#13;"; // would be normalized by parsers otherwise
+                        break;
+                    case '"':
+                    case '\n':
+                    case '\t':
+                        if (!attribute)
+                            m_buffer += c;
+                        else if (c == '"')
+                            m_buffer += "&quot;";
+                        else
+                            m_buffer += (c == '\n') ? "&#10;" : "&#9;";
+                        break;
+                    default:
+                        m_buffer += c;
+                        break;
+                }
             }
         }
 
-        void Save(std::ostream& f)
+        void Flush()
         {
-            m_doc.save(f);
+            m_file.write(m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+            if (!m_file)
+                throw Exception(_("Failed to write the TMX file."));
         }
 
-    private:
-        xml_document m_doc;
-        xml_node m_body;
+        std::ostream& m_file;
+        std::string m_buffer;
     };
 
-    Exporter e;
-    tm.ExportData(e);
-    e.Save(file);
+    Exporter e(file);
+    tm.ExportData(e, srclang, lang);
+    e.Finish();
 }
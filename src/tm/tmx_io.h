@@ -29,15 +29,40 @@
 #include "language.h"
 #include "transmem.h"
 
+#include <functional>
 #include <iostream>
 
 
 namespace TMX
 {
 
-void ImportFromFile(std::istream& file, TranslationMemory& tm);
+/**
+    Progress callback for ImportFromFile().
 
-void ExportToFile(TranslationMemory& tm, std::ostream& file);
+    Called with the fraction of the file processed so far, or -1 if it can't
+    be determined. Returns false to cancel the import.
+ */
+typedef std::function<bool(double)> ProgressCallback;
+
+/**
+    Imports translations from TMX file into the TM.
+
+    The file is processed incrementally (unless it's in a legacy encoding),
+    so even very large files can be imported. If cancelled through
+    @a progress, translations imported so far are kept.
+ */
+void ImportFromFile(std::istream& file, TranslationMemory& tm,
+                    const ProgressCallback& progress = ProgressCallback());
+
+/**
+    Exports the content of the TM into TMX file.
+
+    Data are written to @a file as they are read from the TM. If @a srclang
+    or @a lang are valid, only entries with these languages are exported.
+ */
+void ExportToFile(TranslationMemory& tm, std::ostream& file,
+                  const Language& srclang = Language(),
+                  const Language& lang = Language());
 
 } // namespace TMX
 
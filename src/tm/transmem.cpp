@@ -25,41 +25,65 @@
 
 #include "transmem.h"
 
+#include "fuzzy_match.h"
+#include "harvest_digest.h"
 #include "catalog.h"
+#include "configuration.h"
 #include "errors.h"
+#include "format_placeholders.h"
 #include "str_helpers.h"
+#include "tracing.h"
 #include "utility.h"
 
 #include <wx/stdpaths.h>
 #include <wx/utils.h>
 #include <wx/dir.h>
 #include <wx/filename.h>
+#include <wx/ffile.h>
+#include <wx/log.h>
+#include <wx/tokenzr.h>
 #include <wx/translation.h>
 
 #include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/name_generator.hpp>
 #include <boost/uuid/string_generator.hpp>
+#include <boost/functional/hash.hpp>
 
 #include <Lucene.h>
 #include <LuceneException.h>
+#include <ConcurrentMergeScheduler.h>
 #include <MMapDirectory.h>
-#include <SerialMergeScheduler.h>
 #include <SimpleFSDirectory.h>
 #include <StandardAnalyzer.h>
 #include <IndexWriter.h>
+#include <LogByteSizeMergePolicy.h>
 #include <IndexSearcher.h>
 #include <IndexReader.h>
 #include <Document.h>
+#include <MapFieldSelector.h>
 #include <Field.h>
 #include <DateField.h>
 #include <PrefixQuery.h>
 #include <StringUtils.h>
+#include <TermDocs.h>
 #include <TermQuery.h>
 #include <BooleanQuery.h>
+#include <CachingWrapperFilter.h>
+#include <QueryWrapperFilter.h>
 #include <PhraseQuery.h>
 #include <Term.h>
 #include <ScoreDoc.h>
@@ -104,19 +128,68 @@ namespace
 // class, see
 // http://blog.mikemccandless.com/2011/09/lucenes-searchermanager-simplifies.html
 // http://blog.mikemccandless.com/2011/11/near-real-time-readers-with-lucenes.html
+//
+// The reader is reopened on a background thread when requested (after changes
+// to the index) and the new snapshot is swapped in atomically, so acquiring
+// the searcher never has to wait for reopening.
 class SearcherManager
 {
+private:
+    // Reader and its searchers; the reader's (Lucene) reference is released
+    // when the last user of the snapshot is gone.
+    //
+    // Searches run concurrently from background threads. Instead of sharing
+    // a single IndexSearcher, which serializes some of their work, every
+    // thread is assigned one of a pool of searchers over the same reader.
+    struct Snapshot
+    {
+        explicit Snapshot(IndexReaderPtr r) : reader(r)
+        {
+            const size_t count = std::max(1U, std::thread::hardware_concurrency());
+            searchers.reserve(count);
+            for (size_t i = 0; i < count; i++)
+                searchers.push_back(newLucene<IndexSearcher>(r));
+        }
+
+        ~Snapshot()
+        {
+            searchers.clear();
+            try
+            {
+                reader->decRef();
+            }
+            catch (LuceneException&) {}
+        }
+
+        IndexSearcherPtr SearcherForCurrentThread() const
+        {
+            static std::atomic<size_t> s_nextSlot(0);
+            static thread_local size_t s_slot = s_nextSlot++;
+            return searchers[s_slot % searchers.size()];
+        }
+
+        IndexReaderPtr                reader;
+        std::vector<IndexSearcherPtr> searchers;
+    };
+
 public:
-    SearcherManager(IndexWriterPtr writer)
+    SearcherManager(IndexWriterPtr writer) : SearcherManager(writer->getReader()) {}
+
+    // Manages an index opened without a writer, e.g. read-only one
+    explicit SearcherManager(IndexReaderPtr reader) : m_stop(false), m_refreshRequested(false)
     {
-        m_reader = writer->getReader();
-        m_searcher = newLucene<IndexSearcher>(m_reader);
+        m_current = std::make_shared<Snapshot>(reader);
+        m_thread = std::thread([this]{ RefreshLoop(); });
     }
 
     ~SearcherManager()
     {
-        m_searcher.reset();
-        m_reader->decRef();
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread.join();
     }
 
     // Safe, properly ref-counting (in Lucene way, not just shared_ptr) holder.
@@ -126,8 +199,7 @@ public:
     public:
         typedef boost::shared_ptr<T> TPtr;
 
-        SafeRef(SafeRef&& other) : m_mng(other.m_mng) { std::swap(m_ptr, other.m_ptr); }
-        ~SafeRef() { if (m_ptr) m_mng.DecRef(m_ptr); }
+        SafeRef(SafeRef&& other) = default;
 
         TPtr ptr() { return m_ptr; }
         T* operator->() const { return m_ptr.get(); }
@@ -137,163 +209,140 @@ public:
 
     private:
         friend class SearcherManager;
-        explicit SafeRef(SearcherManager& m, TPtr ptr) : m_mng(m), m_ptr(ptr) {}
+        explicit SafeRef(std::shared_ptr<Snapshot> s, TPtr ptr) : m_snapshot(s), m_ptr(ptr) {}
 
-        SearcherManager& m_mng;
+        std::shared_ptr<Snapshot> m_snapshot;
         boost::shared_ptr<T> m_ptr;
     };
 
     SafeRef<IndexReader> Reader()
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        ReloadReaderIfNeeded();
-        m_reader->incRef();
-        return SafeRef<IndexReader>(*this, m_reader);
+        auto s = std::atomic_load(&m_current);
+        return SafeRef<IndexReader>(s, s->reader);
     }
 
     SafeRef<IndexSearcher> Searcher()
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        ReloadReaderIfNeeded();
-        m_searcher->getIndexReader()->incRef();
-        return SafeRef<IndexSearcher>(*this, m_searcher);
+        auto s = std::atomic_load(&m_current);
+        return SafeRef<IndexSearcher>(s, s->SearcherForCurrentThread());
     }
 
-private:
-    void ReloadReaderIfNeeded()
+    // Asks for reopening the reader in the background, to make recent changes
+    // to the index visible to searches. Repeated requests are coalesced.
+    void RequestRefresh()
     {
-        // contract: m_mutex is locked when this function is called
-        if (m_reader->isCurrent())
-            return; // nothing to do
-
-        auto newReader = m_reader->reopen();
-        auto newSearcher = newLucene<IndexSearcher>(newReader);
-
-        m_reader->decRef();
-
-        m_reader = newReader;
-        m_searcher = newSearcher;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_refreshRequested = true;
+        }
+        m_cond.notify_one();
     }
 
-    void DecRef(IndexReaderPtr& r)
-    {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        r->decRef();
-    }
-    void DecRef(IndexSearcherPtr& s)
+private:
+    void RefreshLoop()
     {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        s->getIndexReader()->decRef();
-    }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_cond.wait(lock, [this]{ return m_stop || m_refreshRequested; });
+            if (m_stop)
+                return;
+            m_refreshRequested = false;
 
-    IndexReaderPtr   m_reader;
-    IndexSearcherPtr m_searcher;
-    std::mutex       m_mutex;
-};
+            lock.unlock();
+            try
+            {
+                auto current = std::atomic_load(&m_current);
+                if (!current->reader->isCurrent())
+                {
+                    auto newReader = current->reader->reopen();
+                    if (newReader != current->reader)
+                        std::atomic_store(&m_current, std::make_shared<Snapshot>(newReader));
+                }
+            }
+            catch (LuceneException&)
+            {
+                // keep using the current snapshot, try again on next request
+            }
+            lock.lock();
+        }
+    }
 
+    std::shared_ptr<Snapshot> m_current;
 
-} // anonymous namespace
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    bool                    m_stop, m_refreshRequested;
+    std::thread             m_thread;
+};
 
-// ----------------------------------------------------------------
-// TranslationMemoryImpl
-// ----------------------------------------------------------------
 
-class TranslationMemoryImpl
+// Restricts search to given pair of languages, including variants of the
+// translation's language.
+//
+// The restriction is done with a filter rather than by adding clauses to the
+// queries, so that only documents in the right language pair are scored. The
+// filter caches bitsets of matching documents for each index reader (segment),
+// so it is cheap to reuse and is recomputed only when the reader is reopened.
+class LanguageQueries
 {
 public:
-#ifdef __WXMSW__
-    typedef SimpleFSDirectory DirectoryType;
-#else
-    typedef MMapDirectory DirectoryType;
-#endif
-
-    TranslationMemoryImpl() { Init(); }
-
-    ~TranslationMemoryImpl()
+    LanguageQueries(const Language& srclang, const Language& lang)
+        : m_srclang(srclang.WCode()),
+          m_fullLang(lang.WCode()),
+          m_shortLang(StringUtils::toUnicode(lang.Lang()))
     {
-        m_mng.reset();
-        m_writer->close();
-    }
-
-    SuggestionsList Search(const Language& srclang, const Language& lang,
-                           const std::wstring& source);
+        auto srclangQ = newLucene<TermQuery>(newLucene<Term>(L"srclang", m_srclang));
 
-    void ExportData(TranslationMemory::IOInterface& destination);
-    void ImportData(std::function<void(TranslationMemory::IOInterface&)> source);
+        QueryPtr langPrimary = newLucene<TermQuery>(newLucene<Term>(L"lang", m_fullLang));
+        QueryPtr langSecondary;
+        if (m_fullLang == m_shortLang)
+        {
+            // for e.g. 'cs', search also 'cs_*' (e.g. 'cs_CZ')
+            langSecondary = newLucene<PrefixQuery>(newLucene<Term>(L"lang", m_shortLang + L"_"));
+        }
+        else
+        {
+            // search short variants of the language too
+            langSecondary = newLucene<TermQuery>(newLucene<Term>(L"lang", m_shortLang));
+        }
+        auto langQ = newLucene<BooleanQuery>();
+        langQ->add(langPrimary, BooleanClause::SHOULD);
+        langQ->add(langSecondary, BooleanClause::SHOULD);
 
-    std::shared_ptr<TranslationMemory::Writer> GetWriter() { return m_writerAPI; }
+        auto pairQ = newLucene<BooleanQuery>();
+        pairQ->add(srclangQ, BooleanClause::MUST);
+        pairQ->add(langQ, BooleanClause::MUST);
+        filter = newLucene<CachingWrapperFilter>(newLucene<QueryWrapperFilter>(pairQ));
 
-    void GetStats(long& numDocs, long& fileSize);
+        // Filters don't affect scoring, so prefer exact language over its
+        // variants with an optional clause:
+        preferredLang = newLucene<TermQuery>(newLucene<Term>(L"lang", m_fullLang));
+        preferredLang->setBoost(0.15);
+    }
 
-    static std::wstring GetDatabaseDir();
+    // Checks if the document would be matched by the queries
+    bool Matches(DocumentPtr doc) const
+    {
+        if (doc->get(L"srclang") != m_srclang)
+            return false;
+        auto lang = doc->get(L"lang");
+        if (lang == m_fullLang)
+            return true;
+        if (m_fullLang == m_shortLang)
+            return lang.compare(0, m_shortLang.length() + 1, m_shortLang + L"_") == 0;
+        else
+            return lang == m_shortLang;
+    }
 
-private:
-    void Init();
+    FilterPtr filter;
+    QueryPtr preferredLang;
 
 private:
-    AnalyzerPtr      m_analyzer;
-    IndexWriterPtr   m_writer;
-    std::shared_ptr<SearcherManager> m_mng;
-
-    std::shared_ptr<TranslationMemory::Writer> m_writerAPI;
+    Lucene::String m_srclang, m_fullLang, m_shortLang;
 };
 
 
-std::wstring TranslationMemoryImpl::GetDatabaseDir()
-{
-    wxString data;
-#if defined(__UNIX__) && !defined(__WXOSX__)
-    if ( !wxGetEnv("XDG_DATA_HOME", &data) )
-        data = wxGetHomeDir() + "/.local/share";
-    data += "/poedit";
-#else
-    data = wxStandardPaths::Get().GetUserDataDir();
-#endif
-
-    // ensure the parent directory exists:
-    wxFileName::Mkdir(data, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
-
-    data += wxFILE_SEP_PATH;
-    data += "TranslationMemory";
-
-    return data.ToStdWstring();
-}
-
-
-namespace
-{
-
-static const int DEFAULT_MAXHITS = 10;
-
-// Normalized score that must be met for a suggestion to be shown. This is
-// an empirical guess of what constitues good matches.
-static const double QUALITY_THRESHOLD = 0.6;
-
-// Maximum allowed difference in phrase length, in #terms.
-static const int MAX_ALLOWED_LENGTH_DIFFERENCE = 2;
-
-
-void AddOrUpdateResult(SuggestionsList& all, Suggestion&& r)
-{
-    // Sometimes multiple hits may have the same translation, but different score
-    // because the source text may differ while the translation doesn't. E.g.
-    //   "Open File" (Mac) -> "Otevřít soubor"
-    //   "Open file" (Win) -> "Otevřít soubor"
-    // So we can't keep the first score, but need to update it if a better match
-    // with the same translation is found during the search.
-    auto found = std::find_if(all.begin(), all.end(),
-                              [&r](const Suggestion& x){ return x.text == r.text; });
-    if (found == all.end())
-    {
-        all.push_back(std::move(r));
-    }
-    else
-    {
-        if (r.score > found->score)
-            *found = r;
-    }
-}
-
 // Return translation (or source) text field.
 //
 // Older versions of Poedit used to store C-like escaped text (e.g. "\n" instead
@@ -313,251 +362,2193 @@ std::wstring get_text_field(DocumentPtr doc, const std::wstring& field)
 }
 
 
-template<typename T>
-void PerformSearchWithBlock(IndexSearcherPtr searcher,
-                            QueryPtr srclang, QueryPtr lang,
-                            const std::wstring& exactSourceText,
-                            QueryPtr query,
-                            double scoreThreshold,
-                            double scoreScaling,
-                            T callback)
+// In-memory index of exact matches, keyed by hash of (srclang, lang, source)
+// and mapping it to UUIDs of TM entries with that source text. This allows
+// answering exact matches with a simple lookup, without Lucene queries.
+//
+// The index is only a hint: it may contain stale entries (e.g. after
+// rollback) or hash collisions, so hits must be verified against the actual
+// documents, and misses must fall back to normal search.
+class ExactMatchIndex
 {
-    auto fullQuery = newLucene<BooleanQuery>();
-    fullQuery->add(srclang, BooleanClause::MUST);
-    fullQuery->add(lang, BooleanClause::MUST);
-    fullQuery->add(query, BooleanClause::MUST);
+public:
+    typedef boost::uuids::uuid UUID;
 
-    auto hits = searcher->search(fullQuery, DEFAULT_MAXHITS);
+    ExactMatchIndex() : m_ready(false) {}
 
-    for (int i = 0; i < hits->scoreDocs.size(); i++)
+    static uint64_t Key(const std::wstring& srclang, const std::wstring& lang, const std::wstring& source)
     {
-        const auto& scoreDoc = hits->scoreDocs[i];
-        auto score = scoreDoc->score / hits->maxScore;
-        if (score < scoreThreshold)
-            continue;
-
-        auto doc = searcher->doc(scoreDoc->doc);
-        auto src = get_text_field(doc, L"source");
-        if (src == exactSourceText)
-        {
-            score = 1.0;
-        }
-        else
+        // FNV-1a hash of the fields, separated with NULs:
+        uint64_t hash = 14695981039346656037ULL;
+        auto add = [&hash](const std::wstring& s)
         {
-            if (score == 1.0)
+            for (auto c: s)
             {
-                score = 0.95; // can't score non-exact thing as 100%:
-
-                // Check against too small queries having perfect hit in a large stored text.
-                // Do this by penalizing too large difference in lengths of the source strings.
-                double len1 = exactSourceText.size();
-                double len2 = src.size();
-                score *= 1.0 - 0.4 * (std::abs(len1 - len2) / std::max(len1, len2));
+                hash ^= uint64_t(c);
+                hash *= 1099511628211ULL;
             }
+            hash *= 1099511628211ULL;
+        };
+        add(srclang);
+        add(lang);
+        add(source);
+        return hash;
+    }
+
+    /// Is the index fully populated from database and usable?
+    bool IsReady() const { return m_ready; }
 
-            score *= scoreScaling;
+    /// Populates the index from existing database content
+    void Build(IndexReaderPtr reader)
+    {
+        boost::uuids::string_generator parseUUID;
+        const int32_t maxDoc = reader->maxDoc();
+        for (int32_t i = 0; i < maxDoc; i++)
+        {
+            if (reader->isDeleted(i))
+                continue;
+            auto doc = reader->document(i);
+            Add(Key(doc->get(L"srclang"), doc->get(L"lang"), get_text_field(doc, L"source")),
+                parseUUID(doc->get(L"uuid")));
         }
+        m_ready = true;
+    }
 
-        callback(doc, score);
+    void Add(uint64_t key, const UUID& id)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_keys.emplace(id, key).second)
+            m_entries.emplace(key, id);
     }
-}
 
-void PerformSearch(IndexSearcherPtr searcher,
-                   QueryPtr srclang, QueryPtr lang,
-                   const std::wstring& exactSourceText,
-                   QueryPtr query,
-                   SuggestionsList& results,
-                   double scoreThreshold,
-                   double scoreScaling)
-{
-    PerformSearchWithBlock
-    (
-        searcher, srclang, lang, exactSourceText, query,
-        scoreThreshold, scoreScaling,
-        [&results](DocumentPtr doc, double score)
+    void Remove(const UUID& id)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto k = m_keys.find(id);
+        if (k == m_keys.end())
+            return;
+        auto range = m_entries.equal_range(k->second);
+        for (auto i = range.first; i != range.second; ++i)
         {
-            auto t = get_text_field(doc, L"trans");
-            time_t ts = DateField::stringToTime(doc->get(L"created"));
-            Suggestion r {t, score, int(ts)};
-            r.id = StringUtils::toUTF8(doc->get(L"uuid"));
-            AddOrUpdateResult(results, std::move(r));
+            if (i->second == id)
+            {
+                m_entries.erase(i);
+                break;
+            }
         }
-    );
+        m_keys.erase(k);
+    }
 
-    std::stable_sort(results.begin(), results.end());
+    void Clear()
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_entries.clear();
+        m_keys.clear();
+    }
+
+    std::vector<UUID> Find(uint64_t key) const
+    {
+        std::vector<UUID> found;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto range = m_entries.equal_range(key);
+        for (auto i = range.first; i != range.second; ++i)
+            found.push_back(i->second);
+        return found;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::atomic<bool> m_ready;
+    std::unordered_multimap<uint64_t, UUID> m_entries;
+    std::unordered_map<UUID, uint64_t, boost::hash<UUID>> m_keys;
+};
+
+
+// Returns identifier of the source text, stored in the "srcid" field for fast
+// lookup of exact matches. (The "source" field is analyzed and can't be used
+// for that.)
+std::wstring GetSourceId(const std::wstring& source)
+{
+    static const boost::uuids::uuid s_namespace =
+      boost::uuids::string_generator()("b3c5e71a-7d0c-4c2e-9a0f-2f6d8e4b1c93");
+    boost::uuids::name_generator gen(s_namespace);
+    return boost::uuids::to_wstring(gen(source));
 }
 
-} // anonymous namespace
 
-SuggestionsList TranslationMemoryImpl::Search(const Language& srclang,
-                                              const Language& lang,
-                                              const std::wstring& source)
+// Source text with numbers and placeholders replaced by markers, so that
+// strings differing only in them can be looked up exactly, using the
+// "normid" field. Doesn't handle %% and markup, which are kept as-is.
+struct NormalizedSource
 {
-    try
-    {
-        // TODO: query by srclang too!
-        auto srclangQ = newLucene<TermQuery>(newLucene<Term>(L"srclang", srclang.WCode()));
+    static const wchar_t PLACEHOLDER_MARKER = L'\uE000';
+    static const wchar_t NUMBER_MARKER = L'\uE001';
 
-        const Lucene::String fullLang = lang.WCode();
-        const Lucene::String shortLang = StringUtils::toUnicode(lang.Lang());
+    struct Part
+    {
+        size_t pos, length;
+    };
 
-        QueryPtr langPrimary = newLucene<TermQuery>(newLucene<Term>(L"lang", fullLang));
-        QueryPtr langSecondary;
-        if (fullLang == shortLang)
-        {
-            // for e.g. 'cs', search also 'cs_*' (e.g. 'cs_CZ')
-            langSecondary = newLucene<PrefixQuery>(newLucene<Term>(L"lang", shortLang + L"_"));
-        }
-        else
+    explicit NormalizedSource(const std::wstring& s) : source(s)
+    {
+        text.reserve(s.length());
+        size_t last = 0, pos, len;
+        PlaceholderTokenizer tkn(Placeholders_C | Placeholders_PHP | Placeholders_Common, s.data(), s.data() + s.length());
+        while (tkn.Next(pos, len))
         {
-            // search short variants of the language too
-            langSecondary = newLucene<TermQuery>(newLucene<Term>(L"lang", shortLang));
+            AddNumbers(last, pos);
+            if (len == 2 && s[pos] == '%' && s[pos + 1] == '%')
+                text.append(s, pos, len);
+            else
+                Add(PLACEHOLDER_MARKER, pos, len);
+            last = pos + len;
         }
-        langSecondary->setBoost(0.85);
-        auto langQ = newLucene<BooleanQuery>();
-        langQ->add(langPrimary, BooleanClause::SHOULD);
-        langQ->add(langSecondary, BooleanClause::SHOULD);
+        AddNumbers(last, s.length());
+    }
 
-        SuggestionsList results;
+    /// Does the text have anything to abstract away?
+    bool IsNormalized() const { return !parts.empty(); }
 
-        const Lucene::String sourceField(L"source");
-        auto boolQ = newLucene<BooleanQuery>();
-        auto phraseQ = newLucene<PhraseQuery>();
+    std::wstring Value(size_t i) const { return source.substr(parts[i].pos, parts[i].length); }
 
-        auto stream = m_analyzer->tokenStream(sourceField, newLucene<StringReader>(source));
-        int sourceTokensCount = 0;
-        int sourceTokenPosition = -1;
-        while (stream->incrementToken())
+    /**
+        Rewrites @a trans, a translation of this text, for @a other with the
+        same normalized form, by replacing its numbers and placeholders with
+        the corresponding ones of @a other. Returns false if some of those
+        that differ can't be found in the translation, e.g. because it uses
+        different form of a number.
+     */
+    bool Remap(const NormalizedSource& other, std::wstring& trans) const
+    {
+        NormalizedSource t(trans);
+        std::vector<bool> used(parts.size(), false);
+        std::wstring out;
+        size_t last = 0;
+        for (size_t i = 0; i < t.parts.size(); i++)
         {
-            sourceTokensCount++;
-            auto word = stream->getAttribute<TermAttribute>()->term();
-            sourceTokenPosition += stream->getAttribute<PositionIncrementAttribute>()->getPositionIncrement();
-            auto term = newLucene<Term>(sourceField, word);
-            boolQ->add(newLucene<TermQuery>(term), BooleanClause::SHOULD);
-            phraseQ->add(term, sourceTokenPosition);
+            auto value = t.Value(i);
+            out.append(trans, last, t.parts[i].pos - last);
+            last = t.parts[i].pos + t.parts[i].length;
+
+            size_t j = 0;
+            while (j < parts.size() && (used[j] || Value(j) != value))
+                j++;
+            if (j < parts.size())
+            {
+                used[j] = true;
+                out += other.Value(j);
+            }
+            else
+            {
+                out += value;
+            }
         }
+        out.append(trans, last, std::wstring::npos);
 
-        auto searcher = m_mng->Searcher();
+        for (size_t j = 0; j < parts.size(); j++)
+        {
+            if (!used[j] && Value(j) != other.Value(j))
+                return false;
+        }
 
-        // Try exact phrase first:
-        PerformSearch(searcher.ptr(), srclangQ, langQ, source, phraseQ, results,
-                      QUALITY_THRESHOLD, /*scoreScaling=*/1.0);
-        if (!results.empty())
-            return results;
+        trans.swap(out);
+        return true;
+    }
 
-        // Then, if no matches were found, permit being a bit sloppy:
-        phraseQ->setSlop(1);
-        PerformSearch(searcher.ptr(), srclangQ, langQ, source, phraseQ, results,
-                      QUALITY_THRESHOLD, /*scoreScaling=*/0.9);
+    const std::wstring& source;
+    std::wstring text;
+    std::vector<Part> parts;
 
-        if (!results.empty())
-            return results;
+private:
+    void Add(wchar_t marker, size_t pos, size_t len)
+    {
+        text += marker;
+        parts.push_back({pos, len});
+    }
 
-        // As the last resort, try terms search. This will almost certainly
-        // produce low-quality results, but hopefully better than nothing.
-        boolQ->setMinimumNumberShouldMatch(std::max(1, boolQ->getClauses().size() - MAX_ALLOWED_LENGTH_DIFFERENCE));
-        PerformSearchWithBlock
-        (
-            searcher.ptr(), srclangQ, langQ, source, boolQ,
-            QUALITY_THRESHOLD, /*scoreScaling=*/0.8,
-            [=,&results](DocumentPtr doc, double score)
+    void AddNumbers(size_t from, size_t to)
+    {
+        size_t i = from;
+        while (i < to)
+        {
+            if (source[i] >= '0' && source[i] <= '9')
             {
-                auto s = get_text_field(doc, sourceField);
-                auto t = get_text_field(doc, L"trans");
-                auto stream2 = m_analyzer->tokenStream(sourceField, newLucene<StringReader>(s));
-                int tokensCount2 = 0;
-                while (stream2->incrementToken())
-                    tokensCount2++;
-
-                if (std::abs(tokensCount2 - sourceTokensCount) <= MAX_ALLOWED_LENGTH_DIFFERENCE)
-                {
-                    time_t ts = DateField::stringToTime(doc->get(L"created"));
-                    Suggestion r {t, score, int(ts)};
-                    r.id = StringUtils::toUTF8(doc->get(L"uuid"));
-                    AddOrUpdateResult(results, std::move(r));
+                size_t end = i + 1;
+                while (end < to && source[end] >= '0' && source[end] <= '9')
+                    end++;
+                Add(NUMBER_MARKER, i, end - i);
+                i = end;
+            }
+            else
+            {
+                text += source[i++];
+            }
+        }
+    }
+};
+
+// Opens the index directory at @a path. Memory-mapped access keeps search
+// latency low; files are mapped lazily when opened by readers, so it doesn't
+// slow down startup. Indexes that are never written to are mapped even if
+// it's disabled, as only segment merging is affected by it.
+DirectoryPtr OpenDirectory(const std::wstring& path, bool readOnly)
+{
+    if (readOnly || Config::UseMemoryMappedTM())
+        return newLucene<MMapDirectory>(path);
+    else
+        return newLucene<SimpleFSDirectory>(path);
+}
+
+// Name of the file with list of shards, in the database directory
+const char *SHARDS_MANIFEST = "shards.txt";
+
+// Name of the shard's directory
+std::wstring GetShardKey(const std::wstring& srclang, const std::wstring& lang)
+{
+    return srclang + L"-" + lang;
+}
+
+std::wstring GetShardKey(const Language& srclang, const Language& lang)
+{
+    return GetShardKey(srclang.WCode(), StringUtils::toUnicode(lang.Lang()));
+}
+
+// Reads list of (srclang, lang) pairs of shards in the database directory
+std::vector<std::pair<std::wstring, std::wstring>> ReadShardsManifest(const std::wstring& root)
+{
+    std::vector<std::pair<std::wstring, std::wstring>> shards;
+
+    wxLogNull null;
+    wxFFile f(wxString(root) + wxFILE_SEP_PATH + SHARDS_MANIFEST, "rb");
+    wxString manifest;
+    if (!f.IsOpened() || !f.ReadAll(&manifest, wxConvUTF8))
+        return shards;
+
+    wxStringTokenizer tkn(manifest, "\n");
+    while (tkn.HasMoreTokens())
+    {
+        auto line = tkn.GetNextToken();
+        auto srclang = line.BeforeFirst('\t');
+        auto lang = line.AfterFirst('\t');
+        if (!srclang.empty() && !lang.empty())
+            shards.emplace_back(srclang.ToStdWstring(), lang.ToStdWstring());
+    }
+    return shards;
+}
+
+
+// Part of the TM with translations from one source language into one target
+// language, including its variants (e.g. both "pt" and "pt_BR"), stored in
+// a separate Lucene index.
+class Shard
+{
+public:
+    // Merges run on background threads, so that commits done after saving
+    // a file don't wait for them; this many of them can run at once:
+    static const int MAX_MERGE_THREADS = 1;
+    // Segments bigger than this (in MB) are only merged by maintenance when
+    // idle (see TranslationMemoryMaintenance), not as part of adding data:
+    static constexpr double MAX_MERGE_MB = 64.0;
+
+    Shard(const std::wstring& path, const std::wstring& srclang, const std::wstring& lang, AnalyzerPtr analyzer)
+        : m_path(path), m_srclang(srclang), m_lang(lang)
+    {
+        wxFileName::Mkdir(path, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        auto dir = OpenDirectory(path, /*readOnly=*/false);
+
+        m_writer = newLucene<IndexWriter>(dir, analyzer, IndexWriter::MaxFieldLengthLIMITED);
+
+        auto scheduler = newLucene<ConcurrentMergeScheduler>();
+        scheduler->setMaxThreadCount(MAX_MERGE_THREADS);
+        m_writer->setMergeScheduler(scheduler);
+        auto policy = newLucene<LogByteSizeMergePolicy>(m_writer);
+        policy->setMaxMergeMB(MAX_MERGE_MB);
+        m_writer->setMergePolicy(policy);
+
+        // get the associated realtime reader & searcher:
+        m_mng = std::make_shared<SearcherManager>(m_writer);
+
+        // Reading the entire index takes a while, so populate the exact
+        // matches index in the background, using normal search until then:
+        m_exactIndex = std::make_shared<ExactMatchIndex>();
+        auto mng = m_mng;
+        auto exactIndex = m_exactIndex;
+        m_exactIndexBuild = dispatch::async(dispatch::priority::bulk, [mng, exactIndex]
+        {
+            try
+            {
+                auto reader = mng->Reader();
+                exactIndex->Build(reader.ptr());
+            }
+            catch (std::exception&)
+            {
+                // keep the index unused
+            }
+        });
+    }
+
+    ~Shard()
+    {
+        try
+        {
+            m_exactIndexBuild.get();
+        }
+        catch (...) {}
+
+        m_mng.reset();
+        try
+        {
+            m_writer->close();
+        }
+        catch (LuceneException&) {}
+    }
+
+    /// Directory with the shard's index
+    const std::wstring& Path() const { return m_path; }
+
+    /// Source language code of all entries
+    const std::wstring& SrcLang() const { return m_srclang; }
+    /// Target language of all entries, without the country or variant
+    const std::wstring& Lang() const { return m_lang; }
+
+    IndexWriterPtr Writer() const { return m_writer; }
+    SearcherManager& Manager() const { return *m_mng; }
+    ExactMatchIndex& ExactIndex() const { return *m_exactIndex; }
+
+    /// Blocks until the exact matches index is populated (or failed to be)
+    void WaitForExactIndex() const { m_exactIndexBuild.wait(); }
+
+private:
+    std::wstring m_path, m_srclang, m_lang;
+    IndexWriterPtr m_writer;
+    std::shared_ptr<SearcherManager> m_mng;
+    std::shared_ptr<ExactMatchIndex> m_exactIndex;
+    dispatch::future<void> m_exactIndexBuild;
+};
+
+typedef std::shared_ptr<Shard> ShardPtr;
+
+
+// All shards of the TM. They are only opened when first needed, and the list
+// of existing shards is kept in a small manifest file in the database
+// directory, so that it's known without opening or listing them.
+class ShardSet
+{
+public:
+    ShardSet(const std::wstring& root, AnalyzerPtr analyzer) : m_root(root), m_analyzer(analyzer)
+    {
+        wxFileName::Mkdir(m_root, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+        for (auto& pair: ReadShardsManifest(m_root))
+            m_shards[GetShardKey(pair.first, pair.second)] = Entry{pair.first, pair.second, nullptr};
+    }
+
+    /**
+        Returns the shard for given language pair, opening it if necessary.
+
+        If the shard doesn't exist yet, it's created if @a create is true,
+        otherwise nullptr is returned.
+     */
+    ShardPtr Get(const Language& srclang, const Language& lang, bool create)
+    {
+        const std::wstring srclangCode = srclang.WCode();
+        const std::wstring langCode = StringUtils::toUnicode(lang.Lang());
+        const std::wstring key = GetShardKey(srclangCode, langCode);
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto i = m_shards.find(key);
+        if (i == m_shards.end())
+        {
+            if (!create)
+                return nullptr;
+            i = m_shards.emplace(key, Entry{srclangCode, langCode, nullptr}).first;
+            SaveManifest();
+        }
+        return Open(key, i->second);
+    }
+
+    /// Returns shards that are currently open
+    std::vector<ShardPtr> GetOpened()
+    {
+        std::vector<ShardPtr> all;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        for (auto& i: m_shards)
+        {
+            if (i.second.shard)
+                all.push_back(i.second.shard);
+        }
+        return all;
+    }
+
+    /// Returns all shards, opening them if necessary
+    std::vector<ShardPtr> GetAll()
+    {
+        std::vector<ShardPtr> all;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        for (auto& i: m_shards)
+            all.push_back(Open(i.first, i.second));
+        return all;
+    }
+
+    /// Closes all shards; they are reopened if used again
+    void CloseAll()
+    {
+        decltype(m_shards) shards;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            for (auto& i: m_shards)
+                shards[i.first].shard = std::move(i.second.shard);
+        }
+        // destroyed (and closed) here, outside of the lock
+    }
+
+private:
+    struct Entry
+    {
+        std::wstring srclang, lang;
+        ShardPtr shard;
+    };
+
+    wxString ManifestPath() const
+    {
+        return wxString(m_root) + wxFILE_SEP_PATH + SHARDS_MANIFEST;
+    }
+
+    ShardPtr Open(const std::wstring& key, Entry& e)
+    {
+        if (!e.shard)
+        {
+            try
+            {
+                e.shard = std::make_shared<Shard>(m_root + wxFILE_SEP_PATH + key, e.srclang, e.lang, m_analyzer);
+            }
+            CATCH_AND_RETHROW_EXCEPTION
+        }
+        return e.shard;
+    }
+
+    void SaveManifest()
+    {
+        wxString manifest;
+        for (auto& i: m_shards)
+            manifest << i.second.srclang << '\t' << i.second.lang << '\n';
+
+        const wxString path = ManifestPath();
+        const wxString tmp = path + ".tmp";
+        bool ok;
+        {
+            wxFFile f(tmp, "wb");
+            ok = f.IsOpened() && f.Write(manifest, wxConvUTF8);
+            ok = f.Close() && ok;
+        }
+        if (!ok || !wxRenameFile(tmp, path, /*overwrite=*/true))
+        {
+            wxRemoveFile(tmp);
+            throw Exception(_("Failed to write translation memory manifest."));
+        }
+    }
+
+    std::wstring m_root;
+    AnalyzerPtr m_analyzer;
+    std::map<std::wstring, Entry> m_shards;
+    std::mutex m_mutex;
+};
+
+
+// Read-only TM database in a shared location, e.g. one built for a whole team
+// on a network drive, searched in addition to the local TM.
+//
+// It may be either sharded database created by this version of Poedit, or an
+// older unsharded one. The indexes are opened in place, without copying, on
+// first use. Because they may be rebuilt at any time, they are reopened at
+// most every REFRESH_INTERVAL if they changed.
+class SharedTM
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit SharedTM(const std::wstring& root) : m_root(root) {}
+
+    /// Returns searcher manager for given languages or nullptr if there's no such data
+    std::shared_ptr<SearcherManager> Get(const Language& srclang, const Language& lang)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto now = Clock::now();
+        if (m_lastRefresh == Clock::time_point() || now >= m_lastRefresh + REFRESH_INTERVAL)
+        {
+            m_lastRefresh = now;
+            m_keys.clear();
+            m_sharded = wxFileName::FileExists(wxString(m_root) + wxFILE_SEP_PATH + SHARDS_MANIFEST);
+            for (auto& pair: ReadShardsManifest(m_root))
+                m_keys.insert(GetShardKey(pair.first, pair.second));
+            for (auto& i: m_indexes)
+            {
+                if (i.second)
+                    i.second->RequestRefresh();
+            }
+            m_failed.clear();
+        }
+
+        const std::wstring key = m_sharded ? GetShardKey(srclang, lang) : std::wstring();
+        if (m_sharded && !m_keys.count(key))
+            return nullptr;
+        if (m_failed.count(key))
+            return nullptr;
+
+        auto& mng = m_indexes[key];
+        if (!mng)
+        {
+            try
+            {
+                const std::wstring path = m_sharded ? m_root + wxFILE_SEP_PATH + key : m_root;
+                auto dir = OpenDirectory(path, /*readOnly=*/true);
+                mng = std::make_shared<SearcherManager>(IndexReader::open(dir, /*readOnly=*/true));
+            }
+            catch (LuceneException& e)
+            {
+                // don't retry until next refresh
+                wxLogTrace("poedit.tm", "failed to open shared TM %s: %s", m_root, e.getError());
+                m_failed.insert(key);
+            }
+        }
+        return mng;
+    }
+
+private:
+    static constexpr std::chrono::minutes REFRESH_INTERVAL{10};
+
+    std::wstring m_root;
+    bool m_sharded = false;
+    std::set<std::wstring> m_keys, m_failed;
+    std::map<std::wstring, std::shared_ptr<SearcherManager>> m_indexes;
+    Clock::time_point m_lastRefresh;
+    std::mutex m_mutex;
+};
+
+constexpr std::chrono::minutes SharedTM::REFRESH_INTERVAL;
+
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------
+// TranslationMemoryImpl
+// ----------------------------------------------------------------
+
+class TranslationMemoryWriteQueue;
+class TranslationMemoryMaintenance;
+
+class TranslationMemoryImpl
+{
+public:
+    TranslationMemoryImpl() { Init(); }
+
+    ~TranslationMemoryImpl()
+    {
+        // flushes and commits pending changes:
+        m_writeQueue.reset();
+
+        m_maintenance.reset();
+        m_shards->CloseAll();
+    }
+
+    SuggestionsList Search(const Language& srclang, const Language& lang,
+                           const std::wstring& source,
+                           const dispatch::cancellation_token& token);
+
+    std::vector<SuggestionsList> SearchBatch(const Language& srclang, const Language& lang,
+                                             const std::vector<std::wstring>& sources);
+
+    void Warmup(const Language& srclang, const Language& lang);
+
+    void ExportData(TranslationMemory::IOInterface& destination,
+                    const Language& srclang, const Language& lang);
+    void ImportData(std::function<void(TranslationMemory::IOInterface&)> source);
+    void Compact();
+
+    std::shared_ptr<TranslationMemory::Writer> GetWriter() { return m_writerAPI; }
+
+    std::shared_ptr<TranslationMemoryWriteQueue> GetWriteQueue() { return m_writeQueue; }
+
+    void GetStats(long& numDocs, long& fileSize);
+    std::vector<TranslationMemory::LanguagePairStats> GetLanguagePairStats();
+    uint64_t GetDataVersion(const Language& srclang, const Language& lang);
+    uint64_t GetCacheVersion(const Language& srclang, const Language& lang);
+
+    static std::wstring GetDatabaseDir();
+
+private:
+    void Init();
+
+    /// Moves data from the single index used by older versions into shards
+    void MigrateUnshardedIndex();
+
+    SuggestionsList DoSearch(IndexSearcherPtr searcher, const LanguageQueries& languages,
+                             const std::wstring& source,
+                             const dispatch::cancellation_token& token = dispatch::cancellation_token());
+
+    std::shared_ptr<const LanguageQueries> GetLanguageQueries(const Language& srclang, const Language& lang);
+
+    bool FindExactMatches(const Shard& shard, IndexReaderPtr reader,
+                          const Language& srclang, const Language& lang,
+                          const std::wstring& source,
+                          SuggestionsList& results);
+
+    /// Finds translations of texts that only differ from @a source in numbers and placeholders
+    bool FindNormalizedMatches(IndexReaderPtr reader, const LanguageQueries& languages,
+                               const std::wstring& source,
+                               SuggestionsList& results);
+
+    void SearchBatchInShard(const Shard& shard, const LanguageQueries& languages,
+                            const Language& srclang, const Language& lang,
+                            std::map<std::wstring, SuggestionsList>& unique);
+
+    /// Adds results from shared TMs to @a results
+    void SearchSharedTMs(const Language& srclang, const Language& lang,
+                         const LanguageQueries& languages,
+                         const std::wstring& source,
+                         SuggestionsList& results,
+                         const dispatch::cancellation_token& token = dispatch::cancellation_token());
+
+private:
+    AnalyzerPtr      m_analyzer;
+    std::shared_ptr<ShardSet> m_shards;
+    std::vector<std::shared_ptr<SharedTM>> m_sharedTMs;
+
+    std::map<std::wstring, std::shared_ptr<const LanguageQueries>> m_languageQueries;
+    std::mutex m_languageQueriesMutex;
+
+    std::shared_ptr<TranslationMemoryMaintenance> m_maintenance;
+    std::shared_ptr<TranslationMemory::Writer> m_writerAPI;
+    std::shared_ptr<TranslationMemoryWriteQueue> m_writeQueue;
+};
+
+
+// custom database location set with TranslationMemory::UseDatabaseDir()
+static std::wstring gs_databaseDirOverride;
+
+std::wstring TranslationMemoryImpl::GetDatabaseDir()
+{
+    if (!gs_databaseDirOverride.empty())
+        return gs_databaseDirOverride;
+
+    wxString data;
+#if defined(__UNIX__) && !defined(__WXOSX__)
+    if ( !wxGetEnv("XDG_DATA_HOME", &data) )
+        data = wxGetHomeDir() + "/.local/share";
+    data += "/poedit";
+#else
+    data = wxStandardPaths::Get().GetUserDataDir();
+#endif
+
+    // ensure the parent directory exists:
+    wxFileName::Mkdir(data, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+    data += wxFILE_SEP_PATH;
+    data += "TranslationMemory";
+
+    return data.ToStdWstring();
+}
+
+
+namespace
+{
+
+static const int DEFAULT_MAXHITS = 10;
+
+// Similarity that must be met for a suggestion to be shown. This is
+// an empirical guess of what constitues good matches.
+static const double QUALITY_THRESHOLD = 0.6;
+
+// Score of matches that only differ in what isn't indexed, e.g. case or
+// punctuation; can't score non-exact thing as 100%.
+static const double NEAR_EXACT_SCORE = 0.95;
+
+// Maximum allowed difference in phrase length, in #terms.
+static const int MAX_ALLOWED_LENGTH_DIFFERENCE = 2;
+
+
+void AddOrUpdateResult(SuggestionsList& all, Suggestion&& r)
+{
+    // Sometimes multiple hits may have the same translation, but different score
+    // because the source text may differ while the translation doesn't. E.g.
+    //   "Open File" (Mac) -> "Otevřít soubor"
+    //   "Open file" (Win) -> "Otevřít soubor"
+    // So we can't keep the first score, but need to update it if a better match
+    // with the same translation is found during the search.
+    auto found = std::find_if(all.begin(), all.end(),
+                              [&r](const Suggestion& x){ return x.text == r.text; });
+    if (found == all.end())
+    {
+        all.push_back(std::move(r));
+    }
+    else
+    {
+        if (r.score > found->score)
+            *found = r;
+    }
+}
+
+// Returns the number of terms the source text is indexed as
+int CountTokens(AnalyzerPtr analyzer, const std::wstring& source)
+{
+    auto stream = analyzer->tokenStream(L"source", newLucene<StringReader>(source));
+    int count = 0;
+    while (stream->incrementToken())
+        count++;
+    return count;
+}
+
+// Returns the terms the source text is indexed as
+FuzzyMatcher::Tokens AnalyzeTokens(AnalyzerPtr analyzer, const std::wstring& source)
+{
+    FuzzyMatcher::Tokens tokens;
+    auto stream = analyzer->tokenStream(L"source", newLucene<StringReader>(source));
+    while (stream->incrementToken())
+        tokens.push_back(stream->getAttribute<TermAttribute>()->term());
+    return tokens;
+}
+
+// Creates a selector for loading only the given stored fields of documents
+FieldSelectorPtr SelectFields(std::initializer_list<const wchar_t*> fields)
+{
+    auto names = Collection<String>::newInstance();
+    for (auto f: fields)
+        names.add(f);
+    return newLucene<MapFieldSelector>(names);
+}
+
+// Fields needed to compare a hit's source text with the searched one
+// ("v" is needed by get_text_field()):
+const FieldSelectorPtr& SourceFieldsSelector()
+{
+    static const FieldSelectorPtr selector = SelectFields({L"v", L"source"});
+    return selector;
+}
+
+// Fields needed by MakeSuggestion() and the search callbacks
+const FieldSelectorPtr& SuggestionFieldsSelector()
+{
+    static const FieldSelectorPtr selector = SelectFields({L"v", L"source", L"trans", L"created", L"uuid", L"tokens"});
+    return selector;
+}
+
+Suggestion MakeSuggestion(DocumentPtr doc, double score)
+{
+    auto t = get_text_field(doc, L"trans");
+    time_t ts = DateField::stringToTime(doc->get(L"created"));
+    Suggestion r {t, score, int(ts)};
+    r.id = StringUtils::toUTF8(doc->get(L"uuid"));
+    return r;
+}
+
+
+// Re-ranks the hits of @a query by their similarity to the searched text and
+// calls @a callback for those that meet @a scoreThreshold. The query is only
+// used to find candidates, its scores aren't comparable between queries.
+template<typename T>
+void PerformSearchWithBlock(IndexSearcherPtr searcher,
+                            AnalyzerPtr analyzer,
+                            const LanguageQueries& languages,
+                            const std::wstring& exactSourceText,
+                            const FuzzyMatcher& matcher,
+                            QueryPtr query,
+                            double scoreThreshold,
+                            T callback)
+{
+    auto fullQuery = newLucene<BooleanQuery>();
+    fullQuery->add(query, BooleanClause::MUST);
+    fullQuery->add(languages.preferredLang, BooleanClause::SHOULD);
+
+    auto hits = searcher->search(fullQuery, languages.filter, DEFAULT_MAXHITS);
+
+    for (int i = 0; i < hits->scoreDocs.size(); i++)
+    {
+        // Most candidates are rejected, so only load what is needed to
+        // decide that and the rest for those that are accepted:
+        const int32_t docId = hits->scoreDocs[i]->doc;
+        auto src = get_text_field(searcher->doc(docId, SourceFieldsSelector()), L"source");
+
+        double score;
+        if (src == exactSourceText)
+        {
+            score = 1.0;
+        }
+        else
+        {
+            score = matcher.Similarity(AnalyzeTokens(analyzer, src), scoreThreshold);
+            if (score == 1.0)
+                score = NEAR_EXACT_SCORE;
+        }
+
+        if (score < scoreThreshold)
+            continue;
+
+        callback(searcher->doc(docId, SuggestionFieldsSelector()), score);
+    }
+}
+
+void PerformSearch(IndexSearcherPtr searcher,
+                   AnalyzerPtr analyzer,
+                   const LanguageQueries& languages,
+                   const std::wstring& exactSourceText,
+                   const FuzzyMatcher& matcher,
+                   QueryPtr query,
+                   SuggestionsList& results,
+                   double scoreThreshold)
+{
+    PerformSearchWithBlock
+    (
+        searcher, analyzer, languages, exactSourceText, matcher, query,
+        scoreThreshold,
+        [&results](DocumentPtr doc, double score)
+        {
+            AddOrUpdateResult(results, MakeSuggestion(doc, score));
+        }
+    );
+
+    std::stable_sort(results.begin(), results.end());
+}
+
+} // anonymous namespace
+
+SuggestionsList TranslationMemoryImpl::Search(const Language& srclang,
+                                              const Language& lang,
+                                              const std::wstring& source,
+                                              const dispatch::cancellation_token& token)
+{
+    TRACE_SCOPE("TranslationMemory::Search");
+
+    try
+    {
+        auto languages = GetLanguageQueries(srclang, lang);
+
+        SuggestionsList results;
+        auto shard = m_shards->Get(srclang, lang, /*create=*/false);
+        if (shard)
+        {
+            auto searcher = shard->Manager().Searcher();
+            auto reader = searcher->getIndexReader();
+            if (!FindExactMatches(*shard, reader, srclang, lang, source, results) &&
+                !FindNormalizedMatches(reader, *languages, source, results))
+            {
+                results = DoSearch(searcher.ptr(), *languages, source, token);
+            }
+        }
+
+        if (!m_sharedTMs.empty() && !token.is_cancelled())
+        {
+            SearchSharedTMs(srclang, lang, *languages, source, results, token);
+            std::stable_sort(results.begin(), results.end());
+        }
+
+        return results;
+    }
+    catch (LuceneException&)
+    {
+        return SuggestionsList();
+    }
+}
+
+
+void TranslationMemoryImpl::Warmup(const Language& srclang, const Language& lang)
+{
+    TRACE_SCOPE("TranslationMemory::Warmup");
+
+    try
+    {
+        GetLanguageQueries(srclang, lang);
+
+        auto shard = m_shards->Get(srclang, lang, /*create=*/false);
+        if (!shard)
+            return;
+
+        shard->WaitForExactIndex();
+
+        // Looking up any term reads the terms index of all segments into
+        // memory, which would otherwise be done by the first search:
+        auto searcher = shard->Manager().Searcher();
+        searcher->getIndexReader()->docFreq(newLucene<Term>(L"srclang", srclang.WCode()));
+    }
+    catch (LuceneException&)
+    {
+        // errors are reported by searches
+    }
+}
+
+
+void TranslationMemoryImpl::SearchSharedTMs(const Language& srclang, const Language& lang,
+                                            const LanguageQueries& languages,
+                                            const std::wstring& source,
+                                            SuggestionsList& results,
+                                            const dispatch::cancellation_token& token)
+{
+    for (auto& shared: m_sharedTMs)
+    {
+        if (token.is_cancelled())
+            return;
+        auto mng = shared->Get(srclang, lang);
+        if (!mng)
+            continue;
+        auto searcher = mng->Searcher();
+        for (auto& r: DoSearch(searcher.ptr(), languages, source, token))
+        {
+            // shared TMs are read-only, their entries can't be deleted:
+            r.source = Suggestion::Source::SharedTM;
+            r.id.clear();
+            AddOrUpdateResult(results, std::move(r));
+        }
+    }
+}
+
+
+std::vector<SuggestionsList> TranslationMemoryImpl::SearchBatch(const Language& srclang,
+                                                                const Language& lang,
+                                                                const std::vector<std::wstring>& sources)
+{
+    TRACE_SCOPE("TranslationMemory::SearchBatch");
+
+    std::vector<SuggestionsList> results(sources.size());
+
+    try
+    {
+        auto languages = GetLanguageQueries(srclang, lang);
+
+        // Identical strings are common in pre-translated files (e.g. in different
+        // contexts), so search for each of them only once:
+        std::map<std::wstring, SuggestionsList> unique;
+        for (auto& s: sources)
+            unique.emplace(s, SuggestionsList());
+
+        auto shard = m_shards->Get(srclang, lang, /*create=*/false);
+        if (shard)
+            SearchBatchInShard(*shard, *languages, srclang, lang, unique);
+
+        // Shared TMs are only needed if there was no exact match locally:
+        if (!m_sharedTMs.empty())
+        {
+            for (auto& u: unique)
+            {
+                if (!u.second.empty() && u.second.front().score == 1.0)
+                    continue;
+                SearchSharedTMs(srclang, lang, *languages, u.first, u.second);
+                std::stable_sort(u.second.begin(), u.second.end());
+            }
+        }
+
+        for (size_t i = 0; i < sources.size(); i++)
+            results[i] = unique[sources[i]];
+    }
+    catch (LuceneException&)
+    {
+        // return whatever was found
+    }
+
+    return results;
+}
+
+
+void TranslationMemoryImpl::SearchBatchInShard(const Shard& shard, const LanguageQueries& languages,
+                                               const Language& srclang, const Language& lang,
+                                               std::map<std::wstring, SuggestionsList>& unique)
+{
+    auto searcher = shard.Manager().Searcher();
+    auto reader = searcher->getIndexReader();
+
+    // The exact-matches index has everything once it's built, otherwise
+    // resolve exact matches for all strings in a single pass over the
+    // "srcid" term, visiting the terms in the index order:
+    std::vector<std::pair<std::wstring, std::map<std::wstring, SuggestionsList>::value_type*>> lookup;
+    lookup.reserve(unique.size());
+    const bool useIndex = shard.ExactIndex().IsReady();
+    for (auto& u: unique)
+    {
+        if (FindExactMatches(shard, reader, srclang, lang, u.first, u.second))
+            continue;
+        if (!useIndex)
+            lookup.emplace_back(GetSourceId(u.first), &u);
+    }
+    std::sort(lookup.begin(), lookup.end(),
+              [](const decltype(lookup)::value_type& a, const decltype(lookup)::value_type& b){ return a.first < b.first; });
+
+    auto termDocs = reader->termDocs();
+    for (auto& l: lookup)
+    {
+        termDocs->seek(newLucene<Term>(L"srcid", l.first));
+        while (termDocs->next())
+        {
+            auto doc = reader->document(termDocs->doc());
+            if (!languages.Matches(doc) || get_text_field(doc, L"source") != l.second->first)
+                continue;
+            AddOrUpdateResult(l.second->second, MakeSuggestion(doc, 1.0));
+        }
+    }
+    termDocs->close();
+
+    // Only search the rest, as well as data from older versions without
+    // the "srcid" field, the slow way:
+    for (auto& l: lookup)
+    {
+        auto& found = l.second->second;
+        if (!found.empty())
+            std::stable_sort(found.begin(), found.end());
+    }
+    for (auto& u: unique)
+    {
+        if (u.second.empty() && !FindNormalizedMatches(reader, languages, u.first, u.second))
+            u.second = DoSearch(searcher.ptr(), languages, u.first);
+    }
+}
+
+
+bool TranslationMemoryImpl::FindNormalizedMatches(IndexReaderPtr reader, const LanguageQueries& languages,
+                                                  const std::wstring& source,
+                                                  SuggestionsList& results)
+{
+    NormalizedSource normalized(source);
+    if (!normalized.IsNormalized())
+        return false;
+
+    auto termDocs = reader->termDocs();
+    termDocs->seek(newLucene<Term>(L"normid", GetSourceId(normalized.text)));
+    while (termDocs->next())
+    {
+        auto doc = reader->document(termDocs->doc());
+        if (!languages.Matches(doc))
+            continue;
+
+        const auto hitSource = get_text_field(doc, L"source");
+        NormalizedSource hit(hitSource);
+        if (hit.text != normalized.text)
+            continue; // hash collision
+
+        auto trans = get_text_field(doc, L"trans");
+        if (!hit.Remap(normalized, trans))
+            continue;
+
+        auto s = MakeSuggestion(doc, NEAR_EXACT_SCORE);
+        s.text = trans;
+        AddOrUpdateResult(results, std::move(s));
+    }
+    termDocs->close();
+
+    std::stable_sort(results.begin(), results.end());
+    return !results.empty();
+}
+
+
+std::shared_ptr<const LanguageQueries> TranslationMemoryImpl::GetLanguageQueries(const Language& srclang, const Language& lang)
+{
+    // Reuse filters, because their cached bitsets are what makes them fast:
+    const std::wstring key = srclang.WCode() + L"|" + lang.WCode();
+    std::lock_guard<std::mutex> guard(m_languageQueriesMutex);
+    auto& q = m_languageQueries[key];
+    if (!q)
+        q = std::make_shared<LanguageQueries>(srclang, lang);
+    return q;
+}
+
+
+bool TranslationMemoryImpl::FindExactMatches(const Shard& shard, IndexReaderPtr reader,
+                                             const Language& srclang, const Language& lang,
+                                             const std::wstring& source,
+                                             SuggestionsList& results)
+{
+    const auto srclangCode = srclang.WCode();
+    const auto langCode = lang.WCode();
+    auto ids = shard.ExactIndex().Find(ExactMatchIndex::Key(srclangCode, langCode, source));
+    if (ids.empty())
+        return false;
+
+    auto termDocs = reader->termDocs();
+    for (auto& id: ids)
+    {
+        termDocs->seek(newLucene<Term>(L"uuid", boost::uuids::to_wstring(id)));
+        while (termDocs->next())
+        {
+            // verify the hit, the index may be stale:
+            auto doc = reader->document(termDocs->doc());
+            if (get_text_field(doc, L"source") != source ||
+                doc->get(L"srclang") != srclangCode ||
+                doc->get(L"lang") != langCode)
+            {
+                continue;
+            }
+            AddOrUpdateResult(results, MakeSuggestion(doc, 1.0));
+        }
+    }
+    termDocs->close();
+
+    std::stable_sort(results.begin(), results.end());
+    return !results.empty();
+}
+
+
+SuggestionsList TranslationMemoryImpl::DoSearch(IndexSearcherPtr searcher,
+                                                const LanguageQueries& languages,
+                                                const std::wstring& source,
+                                                const dispatch::cancellation_token& token)
+{
+    try
+    {
+        SuggestionsList results;
+
+        const Lucene::String sourceField(L"source");
+        auto boolQ = newLucene<BooleanQuery>();
+        auto phraseQ = newLucene<PhraseQuery>();
+
+        FuzzyMatcher::Tokens sourceTokens;
+        auto stream = m_analyzer->tokenStream(sourceField, newLucene<StringReader>(source));
+        int sourceTokenPosition = -1;
+        while (stream->incrementToken())
+        {
+            auto word = stream->getAttribute<TermAttribute>()->term();
+            sourceTokens.push_back(word);
+            sourceTokenPosition += stream->getAttribute<PositionIncrementAttribute>()->getPositionIncrement();
+            auto term = newLucene<Term>(sourceField, word);
+            boolQ->add(newLucene<TermQuery>(term), BooleanClause::SHOULD);
+            phraseQ->add(term, sourceTokenPosition);
+        }
+        const int sourceTokensCount = int(sourceTokens.size());
+        const FuzzyMatcher matcher(sourceTokens);
+
+        // Try exact phrase first:
+        PerformSearch(searcher, m_analyzer, languages, source, matcher, phraseQ, results,
+                      QUALITY_THRESHOLD);
+        if (!results.empty() || token.is_cancelled())
+            return results;
+
+        // Then, if no matches were found, permit being a bit sloppy:
+        phraseQ->setSlop(1);
+        PerformSearch(searcher, m_analyzer, languages, source, matcher, phraseQ, results,
+                      QUALITY_THRESHOLD);
+
+        if (!results.empty() || token.is_cancelled())
+            return results;
+
+        // As the last resort, try terms search. This will almost certainly
+        // produce low-quality results, but hopefully better than nothing.
+        boolQ->setMinimumNumberShouldMatch(std::max(1, boolQ->getClauses().size() - MAX_ALLOWED_LENGTH_DIFFERENCE));
+        PerformSearchWithBlock
+        (
+            searcher, m_analyzer, languages, source, matcher, boolQ,
+            QUALITY_THRESHOLD,
+            [=,&results](DocumentPtr doc, double score)
+            {
+                // the count is stored with documents, only data from older
+                // versions need to be analyzed again:
+                int tokensCount2;
+                auto storedCount = doc->get(L"tokens");
+                if (!storedCount.empty())
+                    tokensCount2 = StringUtils::toInt(storedCount);
+                else
+                    tokensCount2 = CountTokens(m_analyzer, get_text_field(doc, sourceField));
+
+                if (std::abs(tokensCount2 - sourceTokensCount) <= MAX_ALLOWED_LENGTH_DIFFERENCE)
+                    AddOrUpdateResult(results, MakeSuggestion(doc, score));
+            }
+        );
+
+        std::stable_sort(results.begin(), results.end());
+        return results;
+    }
+    catch (LuceneException&)
+    {
+        return SuggestionsList();
+    }
+}
+
+
+namespace
+{
+
+// Number of documents read by a single task when exporting
+const int32_t EXPORT_BLOCK_SIZE = 5000;
+
+struct ExportedEntry
+{
+    Language srclang, lang;
+    std::wstring source, trans;
+    time_t created;
+};
+
+// Reads documents [from, to) of the segment, skipping deleted ones and
+// those not matching the (optional) language filter
+std::vector<ExportedEntry> FetchExportBlock(IndexReaderPtr segment, int32_t from, int32_t to,
+                                            const std::wstring& srclangFilter, const std::wstring& langFilter)
+{
+    std::vector<ExportedEntry> entries;
+    entries.reserve(to - from);
+
+    // parsing language codes is relatively expensive and there are few of them:
+    std::map<std::wstring, Language> languages;
+    auto parseLang = [&languages](const std::wstring& code) -> const Language&
+    {
+        auto i = languages.find(code);
+        if (i == languages.end())
+            i = languages.emplace(code, Language::TryParse(code)).first;
+        return i->second;
+    };
+
+    for (int32_t i = from; i < to; i++)
+    {
+        if (segment->isDeleted(i))
+            continue;
+        auto doc = segment->document(i);
+
+        auto srclang = doc->get(L"srclang");
+        auto lang = doc->get(L"lang");
+        if ((!srclangFilter.empty() && srclang != srclangFilter) || (!langFilter.empty() && lang != langFilter))
+            continue;
+
+        entries.push_back({parseLang(srclang),
+                           parseLang(lang),
+                           get_text_field(doc, L"source"),
+                           get_text_field(doc, L"trans"),
+                           DateField::stringToTime(doc->get(L"created"))});
+    }
+
+    return entries;
+}
+
+} // anonymous namespace
+
+
+void TranslationMemoryImpl::ExportData(TranslationMemory::IOInterface& destination,
+                                       const Language& srclang, const Language& lang)
+{
+    try
+    {
+        const std::wstring srclangFilter = srclang.IsValid() ? srclang.WCode() : std::wstring();
+        const std::wstring langFilter = lang.IsValid() ? lang.WCode() : std::wstring();
+        const std::wstring shardLangFilter = lang.IsValid() ? StringUtils::toUnicode(lang.Lang()) : std::wstring();
+
+        std::vector<SearcherManager::SafeRef<IndexReader>> readers;
+        for (auto& shard: m_shards->GetAll())
+        {
+            if ((!srclangFilter.empty() && shard->SrcLang() != srclangFilter) ||
+                (!shardLangFilter.empty() && shard->Lang() != shardLangFilter))
+            {
+                continue;
+            }
+            readers.push_back(shard->Manager().Reader());
+        }
+
+        // Split the shards into blocks of documents within segments, which are
+        // read in parallel, but passed to the destination sequentially, in order:
+        struct Block
+        {
+            IndexReaderPtr segment;
+            int32_t from, to;
+        };
+        std::vector<Block> blocks;
+
+        for (auto& reader: readers)
+        {
+            auto segments = reader->getSequentialSubReaders();
+            if (!segments)
+            {
+                segments = Collection<IndexReaderPtr>::newInstance();
+                segments.add(reader.ptr());
+            }
+            for (auto segment: segments)
+            {
+                const int32_t maxDoc = segment->maxDoc();
+                for (int32_t from = 0; from < maxDoc; from += EXPORT_BLOCK_SIZE)
+                    blocks.push_back({segment, from, std::min(from + EXPORT_BLOCK_SIZE, maxDoc)});
+            }
+        }
+
+        // fetch only a few blocks ahead, to keep memory use bounded:
+        const size_t maxPending = std::max(2u, std::thread::hardware_concurrency());
+        std::deque<dispatch::future<std::vector<ExportedEntry>>> pending;
+        size_t next = 0;
+        auto schedule = [&]
+        {
+            while (next < blocks.size() && pending.size() < maxPending)
+            {
+                auto b = blocks[next++];
+                pending.push_back(dispatch::async([=]{
+                    return FetchExportBlock(b.segment, b.from, b.to, srclangFilter, langFilter);
+                }));
+            }
+        };
+
+        try
+        {
+            schedule();
+            while (!pending.empty())
+            {
+                auto entries = pending.front().get();
+                pending.pop_front();
+                schedule();
+
+                for (auto& e: entries)
+                    destination.Insert(e.srclang, e.lang, e.source, e.trans, e.created);
+            }
+        }
+        catch (...)
+        {
+            // don't release the reader while it's still being used:
+            for (auto& f: pending)
+            {
+                try { f.get(); } catch (...) {}
+            }
+            throw;
+        }
+    }
+    CATCH_AND_RETHROW_EXCEPTION
+}
+
+
+void TranslationMemoryImpl::GetStats(long& numDocs, long& fileSize)
+{
+    try
+    {
+        numDocs = 0;
+        for (auto& shard: m_shards->GetAll())
+            numDocs += shard->Manager().Reader()->numDocs();
+        fileSize = wxDir::GetTotalSize(GetDatabaseDir()).GetValue();
+    }
+    CATCH_AND_RETHROW_EXCEPTION
+}
+
+
+uint64_t TranslationMemoryImpl::GetDataVersion(const Language& srclang, const Language& lang)
+{
+    try
+    {
+        auto shard = m_shards->Get(srclang, lang, /*create=*/false);
+        if (!shard)
+            return 0;
+        return uint64_t(shard->Manager().Reader()->getVersion());
+    }
+    CATCH_AND_RETHROW_EXCEPTION
+}
+
+
+uint64_t TranslationMemoryImpl::GetCacheVersion(const Language& srclang, const Language& lang)
+{
+    try
+    {
+        // search results depend on shared TMs too:
+        uint64_t version = GetDataVersion(srclang, lang);
+        for (auto& shared: m_sharedTMs)
+        {
+            auto mng = shared->Get(srclang, lang);
+            if (mng)
+                version = (version * 1000003) ^ uint64_t(mng->Reader()->getVersion());
+        }
+        return version;
+    }
+    catch (...)
+    {
+        // don't cache anything if we can't tell
+        return 0;
+    }
+}
+
+
+std::vector<TranslationMemory::LanguagePairStats> TranslationMemoryImpl::GetLanguagePairStats()
+{
+    std::vector<TranslationMemory::LanguagePairStats> stats;
+    try
+    {
+        for (auto& shard: m_shards->GetAll())
+        {
+            auto reader = shard->Manager().Reader();
+            TranslationMemory::LanguagePairStats s;
+            s.srclang = Language::TryParse(shard->SrcLang());
+            s.lang = Language::TryParse(shard->Lang());
+            s.numDocs = reader->numDocs();
+            s.numDeletedDocs = reader->maxDoc() - reader->numDocs();
+            s.fileSize = wxDir::GetTotalSize(shard->Path()).GetValue();
+            stats.push_back(s);
+        }
+    }
+    CATCH_AND_RETHROW_EXCEPTION
+    return stats;
+}
+
+// ----------------------------------------------------------------
+// TranslationMemoryMaintenance
+// ----------------------------------------------------------------
+
+// Keeps the open shards compact, in the background, when the TM is idle.
+//
+// Translations are never modified in place: editing a translation adds a new
+// entry and deleting marks documents as deleted, so the indexes accumulate
+// superseded entries and segments full of dead documents. Once no changes
+// were made for IDLE_DELAY, the maintenance
+//
+//  - removes older translations of the same source text, keeping only the
+//    most recent one (once per shard and session, as it reads everything);
+//  - merges away deleted documents if there's too many of them;
+//  - merges segments if there's too many of them.
+//
+// Only shards that are open are maintained, because those are the ones that
+// could have changed.
+class TranslationMemoryMaintenance
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    TranslationMemoryMaintenance(std::shared_ptr<ShardSet> shards)
+        : m_shards(shards), m_stop(false), m_pending(true), m_lastActivity(Clock::now())
+    {
+        m_thread = std::thread([this]{ Run(); });
+    }
+
+    ~TranslationMemoryMaintenance()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread.join();
+    }
+
+    /// Postpones maintenance, must be called whenever the TM is modified
+    void NotifyActivity()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lastActivity = Clock::now();
+        m_pending = true;
+    }
+
+    /// Mutex held while maintenance runs, lock it to prevent it temporarily
+    std::mutex& RunMutex() { return m_runMutex; }
+
+    /// Maintains all shards, including those not open, right away
+    void RunNow()
+    {
+        std::lock_guard<std::mutex> running(m_runMutex);
+        Clock::time_point started;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            started = m_lastActivity;
+            m_pending = false;
+        }
+        for (auto& shard: m_shards->GetAll())
+        {
+            if (!MaintainShard(*shard, started))
+                break;
+        }
+    }
+
+private:
+    // Wait this long after the last change...
+    static constexpr std::chrono::minutes IDLE_DELAY{2};
+    // ...then compact shards with more than this fraction of deleted documents...
+    static constexpr double MAX_DELETED_RATIO = 0.1;
+    // ...or more than this many segments:
+    static constexpr int MAX_SEGMENTS = 10;
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            if (m_stop)
+                return;
+            if (!m_pending)
+            {
+                m_cond.wait(lock);
+                continue;
+            }
+            auto due = m_lastActivity + IDLE_DELAY;
+            if (Clock::now() < due)
+            {
+                m_cond.wait_until(lock, due);
+                continue;
+            }
+
+            m_pending = false;
+            auto started = m_lastActivity;
+            lock.unlock();
+            bool completed = true;
+            {
+                std::lock_guard<std::mutex> running(m_runMutex);
+                for (auto& shard: m_shards->GetOpened())
+                {
+                    if (!MaintainShard(*shard, started))
+                    {
+                        completed = false;
+                        break;
+                    }
+                }
+            }
+            lock.lock();
+            if (!completed)
+                m_pending = true;
+        }
+    }
+
+    // Returns false if interrupted by new changes or shutdown
+    bool IsInterrupted(Clock::time_point started)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stop || m_lastActivity != started;
+    }
+
+    bool MaintainShard(Shard& shard, Clock::time_point started)
+    {
+        try
+        {
+            auto writer = shard.Writer();
+            bool changed = false;
+
+            const std::wstring key = GetShardKey(shard.SrcLang(), shard.Lang());
+            if (m_pruned.insert(key).second)
+            {
+                changed = PruneSuperseded(shard) > 0;
+                if (IsInterrupted(started))
+                {
+                    writer->commit();
+                    shard.Manager().RequestRefresh();
+                    return false;
                 }
             }
-        );
-
-        std::stable_sort(results.begin(), results.end());
-        return results;
+
+            int32_t maxDoc, numDocs, numSegments;
+            {
+                auto reader = shard.Manager().Reader();
+                maxDoc = reader->maxDoc();
+                numDocs = reader->numDocs();
+                auto segments = reader->getSequentialSubReaders();
+                numSegments = segments ? segments.size() : 1;
+            }
+            // account for documents deleted just now, not visible to the reader yet:
+            if (changed)
+                numDocs = writer->numDocs();
+
+            if (maxDoc > 0 && double(maxDoc - numDocs) / maxDoc > MAX_DELETED_RATIO)
+            {
+                writer->expungeDeletes();
+                changed = true;
+            }
+            if (IsInterrupted(started))
+                return false;
+
+            if (numSegments > MAX_SEGMENTS)
+            {
+                writer->optimize(MAX_SEGMENTS);
+                changed = true;
+            }
+
+            if (changed)
+            {
+                writer->commit();
+                shard.Manager().RequestRefresh();
+            }
+            return !IsInterrupted(started);
+        }
+        catch (LuceneException& e)
+        {
+            wxLogTrace("poedit.tm", "maintenance failed: %s", e.getError());
+            return true; // don't retry again and again
+        }
+    }
+
+    // Deletes all but the most recent translations for each source text.
+    // Returns the number of deleted entries.
+    int PruneSuperseded(Shard& shard)
+    {
+        auto reader = shard.Manager().Reader();
+
+        // Group documents by hash of (srclang, lang, source), remembering
+        // the creation time and document number:
+        std::unordered_map<uint64_t, std::vector<std::pair<time_t, int32_t>>> groups;
+        const int32_t maxDoc = reader->maxDoc();
+        for (int32_t i = 0; i < maxDoc; i++)
+        {
+            if (reader->isDeleted(i))
+                continue;
+            auto doc = reader->document(i);
+            auto key = ExactMatchIndex::Key(doc->get(L"srclang"), doc->get(L"lang"), get_text_field(doc, L"source"));
+            groups[key].emplace_back(DateField::stringToTime(doc->get(L"created")), i);
+        }
+
+        auto writer = shard.Writer();
+        int deleted = 0;
+        for (auto& g: groups)
+        {
+            auto& entries = g.second;
+            if (entries.size() < 2)
+                continue;
+            std::sort(entries.begin(), entries.end(), std::greater<std::pair<time_t, int32_t>>());
+
+            auto newest = reader->document(entries.front().second);
+            const auto newestTime = entries.front().first;
+            const auto srclang = newest->get(L"srclang");
+            const auto lang = newest->get(L"lang");
+            const auto source = get_text_field(newest, L"source");
+            for (size_t i = 1; i < entries.size(); i++)
+            {
+                // keep entries created at the same time, e.g. imported together
+                if (entries[i].first == newestTime)
+                    continue;
+                // verify the hash match:
+                auto doc = reader->document(entries[i].second);
+                if (doc->get(L"srclang") != srclang || doc->get(L"lang") != lang || get_text_field(doc, L"source") != source)
+                    continue;
+
+                auto uuid = doc->get(L"uuid");
+                writer->deleteDocuments(newLucene<Term>(L"uuid", uuid));
+                shard.ExactIndex().Remove(boost::uuids::string_generator()(uuid));
+                deleted++;
+            }
+        }
+
+        return deleted;
+    }
+
+    std::shared_ptr<ShardSet> m_shards;
+    std::set<std::wstring> m_pruned;
+
+    std::mutex m_mutex, m_runMutex;
+    std::condition_variable m_cond;
+    bool m_stop, m_pending;
+    Clock::time_point m_lastActivity;
+    std::thread m_thread;
+};
+
+constexpr std::chrono::minutes TranslationMemoryMaintenance::IDLE_DELAY;
+constexpr double TranslationMemoryMaintenance::MAX_DELETED_RATIO;
+constexpr int TranslationMemoryMaintenance::MAX_SEGMENTS;
+
+// ----------------------------------------------------------------
+// TranslationMemoryWriterImpl
+// ----------------------------------------------------------------
+
+class TranslationMemoryWriterImpl : public TranslationMemory::Writer
+{
+public:
+    TranslationMemoryWriterImpl(std::shared_ptr<ShardSet> shards,
+                                std::shared_ptr<TranslationMemoryMaintenance> maintenance)
+        : m_shards(shards), m_maintenance(maintenance) {}
+
+    ~TranslationMemoryWriterImpl() {}
+
+    // Only shards that are open can have uncommitted changes, so the
+    // operations below don't need to touch the others.
+
+    void Commit() override
+    {
+        for (auto& shard: m_shards->GetOpened())
+        {
+            try
+            {
+                shard->Writer()->commit();
+            }
+            CATCH_AND_RETHROW_EXCEPTION
+
+            shard->Manager().RequestRefresh();
+        }
+    }
+
+    /// Makes changes written so far visible to searches soon, without committing them
+    void Refresh()
+    {
+        for (auto& shard: m_shards->GetOpened())
+            shard->Manager().RequestRefresh();
+    }
+
+    void Rollback() override
+    {
+        for (auto& shard: m_shards->GetOpened())
+        {
+            try
+            {
+                shard->Writer()->rollback();
+            }
+            CATCH_AND_RETHROW_EXCEPTION
+
+            shard->Manager().RequestRefresh();
+        }
+    }
+
+    void Insert(const Language& srclang, const Language& lang,
+                const std::wstring& source, const std::wstring& trans,
+                time_t creationTime) override
+    {
+        if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
+            return;
+
+        m_maintenance->NotifyActivity();
+        auto shard = m_shards->Get(srclang, lang, /*create=*/true);
+        boost::uuids::uuid uuid;
+        try
+        {
+            auto writer = shard->Writer();
+            auto doc = CreateDocument(writer->getAnalyzer(), srclang, lang, source, trans, creationTime, uuid);
+            if (!doc)
+                return;
+            writer->updateDocument(newLucene<Term>(L"uuid", boost::uuids::to_wstring(uuid)), doc);
+        }
+        CATCH_AND_RETHROW_EXCEPTION
+
+        shard->ExactIndex().Add(ExactMatchIndex::Key(srclang.WCode(), lang.WCode(), source), uuid);
+    }
+
+    /// Computes unique ID for the translation
+    static boost::uuids::uuid ComputeUUID(const Language& srclang, const Language& lang,
+                                          const std::wstring& source, const std::wstring& trans)
+    {
+        static const boost::uuids::uuid s_namespace =
+          boost::uuids::string_generator()("6e3f73c5-333f-4171-9d43-954c372a8a02");
+        boost::uuids::name_generator gen(s_namespace);
+
+        std::wstring itemId(srclang.WCode());
+        itemId += lang.WCode();
+        itemId += source;
+        itemId += trans;
+
+        return gen(itemId);
+    }
+
+    /**
+        Creates TM document for given translation and computes its unique ID.
+        Returns nullptr if the translation can't be stored.
+     */
+    static DocumentPtr CreateDocument(AnalyzerPtr analyzer,
+                                      const Language& srclang, const Language& lang,
+                                      const std::wstring& source, const std::wstring& trans,
+                                      time_t creationTime,
+                                      boost::uuids::uuid& uuid)
+    {
+        if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
+            return nullptr;
+
+        if (creationTime == 0)
+            creationTime = time(NULL);
+
+        uuid = ComputeUUID(srclang, lang, source, trans);
+
+        // Then create the document:
+        auto doc = newLucene<Document>();
+
+        doc->add(newLucene<Field>(L"uuid", boost::uuids::to_wstring(uuid),
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        doc->add(newLucene<Field>(L"v", L"1",
+                                  Field::STORE_YES, Field::INDEX_NO));
+        doc->add(newLucene<Field>(L"created", DateField::timeToString(creationTime),
+                                  Field::STORE_YES, Field::INDEX_NO));
+        doc->add(newLucene<Field>(L"srclang", srclang.WCode(),
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        doc->add(newLucene<Field>(L"lang", lang.WCode(),
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        doc->add(newLucene<Field>(L"source", source,
+                                  Field::STORE_YES, Field::INDEX_ANALYZED));
+        doc->add(newLucene<Field>(L"srcid", GetSourceId(source),
+                                  Field::STORE_NO, Field::INDEX_NOT_ANALYZED));
+        NormalizedSource normalized(source);
+        if (normalized.IsNormalized())
+        {
+            doc->add(newLucene<Field>(L"normid", GetSourceId(normalized.text),
+                                      Field::STORE_NO, Field::INDEX_NOT_ANALYZED));
+        }
+        // stored for comparing lengths of fuzzy matches without analyzing them:
+        doc->add(newLucene<Field>(L"tokens", StringUtils::toString(CountTokens(analyzer, source)),
+                                  Field::STORE_YES, Field::INDEX_NO));
+        doc->add(newLucene<Field>(L"trans", trans,
+                                  Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+        return doc;
+    }
+
+    void Insert(const Language& srclang, const Language& lang,
+                const std::wstring& source, const std::wstring& trans) override
+    {
+        Insert(srclang, lang, source, trans, 0);
+    }
+
+    void Insert(const Language& srclang, const Language& lang, const CatalogItemPtr& item) override
+    {
+        if (!lang.IsValid() || !srclang.IsValid())
+            return;
+
+        ForEachStorableTranslation(lang, item, [&](std::wstring&& source, std::wstring&& trans)
+        {
+            Insert(srclang, lang, source, trans);
+        });
+    }
+
+    /// Calls @a func(source, trans) for every translation in the item that should be stored in the TM
+    template<typename F>
+    static void ForEachStorableTranslation(const Language& lang, const CatalogItemPtr& item, F&& func)
+    {
+        // ignore translations with errors in them
+        if (item->HasError())
+            return;
+
+        // ignore untranslated or unfinished translations
+        if (item->IsFuzzy() || !item->IsTranslated())
+            return;
+
+        // always store at least the singular translation
+        func(str::to_wstring(item->GetStringUTF8()), str::to_wstring(item->GetTranslation()));
+
+        // for plurals, try to support at least the simpler cases, with nplurals <= 2
+        if (item->HasPlural())
+        {
+            switch (lang.nplurals())
+            {
+                case 1:
+                    // e.g. Chinese, Japanese; store translation for both singular and plural
+                    func(str::to_wstring(item->GetPluralStringUTF8()), str::to_wstring(item->GetTranslation()));
+                    break;
+                case 2:
+                    // e.g. Germanic or Romanic languages, same 2 forms as English
+                    func(str::to_wstring(item->GetPluralStringUTF8()), str::to_wstring(item->GetTranslation(1)));
+                    break;
+                default:
+                    // not supported, only singular stored above
+                    break;
+            }
+        }
+    }
+
+    void Insert(const CatalogPtr& cat) override
+    {
+        auto srclang = cat->GetSourceLanguage();
+        auto lang = cat->GetLanguage();
+        if (!lang.IsValid() || !srclang.IsValid())
+            return;
+
+        if (lang == srclang)
+            return;
+
+        // Only store translations that weren't harvested from the file already:
+        HarvestDigest harvested(cat->GetFileName());
+        std::vector<uint64_t> digests;
+        digests.reserve(cat->items().size());
+
+        for (auto& item: cat->items())
+        {
+            // Note that dt.IsModified() is intentionally not checked - we
+            // want to save old entries in the TM too, so that we harvest as
+            // much useful translations as we can.
+            ForEachStorableTranslation(lang, item, [&](std::wstring&& source, std::wstring&& trans)
+            {
+                auto digest = HarvestDigest::Compute(srclang, lang, source, trans);
+                digests.push_back(digest);
+                if (!harvested.Contains(digest))
+                    Insert(srclang, lang, source, trans);
+            });
+        }
+
+        harvested.Save(std::move(digests));
+    }
+
+    void Delete(const std::string& uuid) override
+    {
+        m_maintenance->NotifyActivity();
+        // IDs come from search results, so the entry is in one of the open shards:
+        for (auto& shard: m_shards->GetOpened())
+        {
+            try
+            {
+                shard->Writer()->deleteDocuments(newLucene<Term>(L"uuid", StringUtils::toUnicode(uuid)));
+                shard->ExactIndex().Remove(boost::uuids::string_generator()(uuid));
+            }
+            CATCH_AND_RETHROW_EXCEPTION
+        }
+    }
+
+    void DeleteAll() override
+    {
+        m_maintenance->NotifyActivity();
+        for (auto& shard: m_shards->GetAll())
+        {
+            try
+            {
+                shard->Writer()->deleteAll();
+                shard->ExactIndex().Clear();
+            }
+            CATCH_AND_RETHROW_EXCEPTION
+        }
+        HarvestDigest::ClearAll();
+    }
+
+private:
+    std::shared_ptr<ShardSet> m_shards;
+    std::shared_ptr<TranslationMemoryMaintenance> m_maintenance;
+};
+
+
+// ----------------------------------------------------------------
+// TranslationMemoryWriteQueue
+// ----------------------------------------------------------------
+
+// Write-behind queue for TM updates from the editor.
+//
+// Translations are queued cheaply and written to the index on a background
+// thread. Committing is expensive, so it's only done once no changes arrived
+// for IDLE_DELAY, or at most every COMMIT_INTERVAL if they keep coming, and
+// on shutdown. Translations already harvested from the file (see HarvestDigest)
+// or written during this session are skipped, because saving a file would
+// otherwise write all of them again.
+class TranslationMemoryWriteQueue
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    TranslationMemoryWriteQueue(std::shared_ptr<TranslationMemoryWriterImpl> writer)
+        : m_writer(writer), m_stop(false)
+    {
+        m_thread = std::thread([this]{ Run(); });
+    }
+
+    ~TranslationMemoryWriteQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread.join();
+    }
+
+    void Add(const Language& srclang, const Language& lang, const CatalogItemPtr& item)
+    {
+        std::vector<Entry> entries;
+        Collect(srclang, lang, item, entries);
+        Enqueue(entries);
+    }
+
+    void Add(const CatalogPtr& cat)
+    {
+        auto srclang = cat->GetSourceLanguage();
+        auto lang = cat->GetLanguage();
+        if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
+            return;
+
+        // Skip translations already harvested from the file; the digest
+        // is only updated once the new ones are committed.
+        auto harvested = std::make_shared<HarvestDigest>(cat->GetFileName());
+        std::vector<uint64_t> digests;
+        std::vector<Entry> entries;
+        for (auto& item: cat->items())
+        {
+            TranslationMemoryWriterImpl::ForEachStorableTranslation(lang, item, [&](std::wstring&& source, std::wstring&& trans)
+            {
+                auto digest = HarvestDigest::Compute(srclang, lang, source, trans);
+                digests.push_back(digest);
+                if (harvested->Contains(digest))
+                    return;
+                auto uuid = TranslationMemoryWriterImpl::ComputeUUID(srclang, lang, source, trans);
+                entries.push_back({uuid, srclang, lang, std::move(source), std::move(trans)});
+            });
+        }
+
+        Enqueue(entries);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingDigests.emplace_back(harvested, std::move(digests));
+        m_lastChange = Clock::now();
+        m_cond.notify_one();
+    }
+
+private:
+    typedef boost::uuids::uuid UUID;
+
+    struct Entry
+    {
+        UUID uuid;
+        Language srclang, lang;
+        std::wstring source, trans;
+    };
+
+    // Commit this long after the last change...
+    static constexpr std::chrono::seconds IDLE_DELAY{5};
+    // ...but at least this often if changes keep coming
+    static constexpr std::chrono::seconds COMMIT_INTERVAL{60};
+
+    static void Collect(const Language& srclang, const Language& lang, const CatalogItemPtr& item, std::vector<Entry>& entries)
+    {
+        if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
+            return;
+
+        TranslationMemoryWriterImpl::ForEachStorableTranslation(lang, item, [&](std::wstring&& source, std::wstring&& trans)
+        {
+            auto uuid = TranslationMemoryWriterImpl::ComputeUUID(srclang, lang, source, trans);
+            entries.push_back({uuid, srclang, lang, std::move(source), std::move(trans)});
+        });
+    }
+
+    void Enqueue(std::vector<Entry>& entries)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            bool added = false;
+            for (auto& e: entries)
+            {
+                if (m_written.count(e.uuid))
+                    continue;
+                m_pending[e.uuid] = std::move(e);
+                added = true;
+            }
+            if (!added)
+                return;
+            m_lastChange = Clock::now();
+        }
+        m_cond.notify_one();
+    }
+
+    void Run()
+    {
+        bool dirty = false;
+        bool failed = false;
+        auto lastCommit = Clock::now();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            if (!m_pendingDigests.empty())
+            {
+                // digests can only be stored after committing what they describe:
+                dirty = true;
+            }
+
+            if (!m_pending.empty())
+            {
+                decltype(m_pending) batch;
+                batch.swap(m_pending);
+                lock.unlock();
+                bool ok = Write(batch);
+                lock.lock();
+                if (ok)
+                {
+                    // make the translations available for suggestions before committing:
+                    m_writer->Refresh();
+                    for (auto& e: batch)
+                        m_written.insert(e.first);
+                }
+                else
+                {
+                    failed = true;
+                }
+                dirty = true;
+                continue;
+            }
+
+            if (dirty)
+            {
+                auto now = Clock::now();
+                if (m_stop || now >= m_lastChange + IDLE_DELAY || now >= lastCommit + COMMIT_INTERVAL)
+                {
+                    decltype(m_pendingDigests) digests;
+                    digests.swap(m_pendingDigests);
+                    lock.unlock();
+                    if (Commit() && !failed)
+                    {
+                        for (auto& d: digests)
+                            d.first->Save(std::move(d.second));
+                    }
+                    lock.lock();
+                    failed = false;
+                    dirty = false;
+                    lastCommit = Clock::now();
+                    continue;
+                }
+                m_cond.wait_until(lock, std::min(m_lastChange + IDLE_DELAY, lastCommit + COMMIT_INTERVAL));
+            }
+            else if (m_stop)
+            {
+                break;
+            }
+            else
+            {
+                m_cond.wait(lock);
+            }
+        }
     }
-    catch (LuceneException&)
+
+    bool Write(const std::unordered_map<UUID, Entry, boost::hash<UUID>>& batch)
     {
-        return SuggestionsList();
+        try
+        {
+            for (auto& e: batch)
+                m_writer->Insert(e.second.srclang, e.second.lang, e.second.source, e.second.trans);
+            return true;
+        }
+        catch (const Exception& e)
+        {
+            wxLogWarning(_("Failed to update translation memory: %s"), e.What());
+        }
+        catch (...)
+        {
+            wxLogWarning(_("Failed to update translation memory: %s"), "unknown error");
+        }
+        return false;
     }
-}
 
-
-void TranslationMemoryImpl::ExportData(TranslationMemory::IOInterface& destination)
-{
-    try
+    bool Commit()
     {
-        auto reader = m_mng->Reader();
-        int32_t numDocs = reader->numDocs();
-        for (int32_t i = 0; i < numDocs; i++)
+        try
         {
-            auto doc = reader->document(i);
-            destination.Insert
-            (
-            	Language::TryParse(doc->get(L"srclang")),
-                Language::TryParse(doc->get(L"lang")),
-                get_text_field(doc, L"source"),
-                get_text_field(doc, L"trans"),
-                DateField::stringToTime(doc->get(L"created"))
-            );
+            m_writer->Commit();
+            return true;
+        }
+        catch (const Exception& e)
+        {
+            wxLogWarning(_("Failed to update translation memory: %s"), e.What());
+        }
+        catch (...)
+        {
+            wxLogWarning(_("Failed to update translation memory: %s"), "unknown error");
         }
+        return false;
     }
-    CATCH_AND_RETHROW_EXCEPTION
-}
 
+    std::shared_ptr<TranslationMemoryWriterImpl> m_writer;
 
-void TranslationMemoryImpl::ImportData(std::function<void(TranslationMemory::IOInterface&)> source)
-{
-    auto writer = TranslationMemory::Get().GetWriter();
-    source(*writer);
-    writer->Commit();
-}
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop;
+    Clock::time_point m_lastChange;
+    std::unordered_map<UUID, Entry, boost::hash<UUID>> m_pending;
+    std::unordered_set<UUID, boost::hash<UUID>> m_written;
+    std::vector<std::pair<std::shared_ptr<HarvestDigest>, std::vector<uint64_t>>> m_pendingDigests;
 
+    std::thread m_thread;
+};
+
+constexpr std::chrono::seconds TranslationMemoryWriteQueue::IDLE_DELAY;
+constexpr std::chrono::seconds TranslationMemoryWriteQueue::COMMIT_INTERVAL;
 
-void TranslationMemoryImpl::GetStats(long& numDocs, long& fileSize)
-{
-    try
-    {
-        auto reader = m_mng->Reader();
-        numDocs = reader->numDocs();
-        fileSize = wxDir::GetTotalSize(GetDatabaseDir()).GetValue();
-    }
-    CATCH_AND_RETHROW_EXCEPTION
-}
 
 // ----------------------------------------------------------------
-// TranslationMemoryWriterImpl
+// TranslationMemoryBulkImporter
 // ----------------------------------------------------------------
 
-class TranslationMemoryWriterImpl : public TranslationMemory::Writer
+// Writer used for importing large amounts of data at once, e.g. from TMX.
+//
+// The IndexWriters of affected shards are temporarily tuned for throughput:
+// they buffer a lot more documents in RAM before flushing them to disk and
+// merge segments in the background. Duplicate entries are skipped in memory
+// and when importing into an empty shard, documents are just added, instead
+// of updating them (which implies deleting existing documents with the same
+// UUID first).
+class TranslationMemoryBulkImporter : public TranslationMemory::IOInterface
 {
 public:
-    TranslationMemoryWriterImpl(IndexWriterPtr writer) : m_writer(writer) {}
-
-    ~TranslationMemoryWriterImpl() {}
+    // RAM buffer size used by each shard during import, in MB
+    static constexpr double RAM_BUFFER_SIZE = 64.0;
 
-    void Commit() override
-    {
-        try
-        {
-            m_writer->commit();
-        }
-        CATCH_AND_RETHROW_EXCEPTION
-    }
+    TranslationMemoryBulkImporter(std::shared_ptr<ShardSet> shards) : m_shards(shards) {}
 
-    void Rollback() override
+    ~TranslationMemoryBulkImporter()
     {
-        try
+        for (auto& t: m_targets)
         {
-            m_writer->rollback();
+            try
+            {
+                t.second.RestoreSettings();
+            }
+            catch (...) {}
         }
-        CATCH_AND_RETHROW_EXCEPTION
     }
 
     void Insert(const Language& srclang, const Language& lang,
@@ -567,144 +2558,197 @@ public:
         if (!lang.IsValid() || !srclang.IsValid() || lang == srclang)
             return;
 
-        if (creationTime == 0)
-            creationTime = time(NULL);
-
-        // Compute unique ID for the translation:
-
-        static const boost::uuids::uuid s_namespace =
-          boost::uuids::string_generator()("6e3f73c5-333f-4171-9d43-954c372a8a02");
-        boost::uuids::name_generator gen(s_namespace);
-
-        std::wstring itemId(srclang.WCode());
-        itemId += lang.WCode();
-        itemId += source;
-        itemId += trans;
-
-        const std::wstring itemUUID = boost::uuids::to_wstring(gen(itemId));
-
+        auto& target = GetTarget(srclang, lang);
+        boost::uuids::uuid uuid;
         try
         {
-            // Then add a new document:
-            auto doc = newLucene<Document>();
-
-            doc->add(newLucene<Field>(L"uuid", itemUUID,
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(L"v", L"1",
-                                      Field::STORE_YES, Field::INDEX_NO));
-            doc->add(newLucene<Field>(L"created", DateField::timeToString(creationTime),
-                                      Field::STORE_YES, Field::INDEX_NO));
-            doc->add(newLucene<Field>(L"srclang", srclang.WCode(),
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(L"lang", lang.WCode(),
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(L"source", source,
-                                      Field::STORE_YES, Field::INDEX_ANALYZED));
-            doc->add(newLucene<Field>(L"trans", trans,
-                                      Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-
-            m_writer->updateDocument(newLucene<Term>(L"uuid", itemUUID), doc);
+            auto doc = TranslationMemoryWriterImpl::CreateDocument(target.analyzer, srclang, lang, source, trans, creationTime, uuid);
+            if (!doc)
+                return;
+            if (!m_seen.insert(uuid).second)
+                return; // already imported
+
+            if (target.isEmpty)
+                target.writer->addDocument(doc);
+            else
+                target.writer->updateDocument(newLucene<Term>(L"uuid", boost::uuids::to_wstring(uuid)), doc);
         }
         CATCH_AND_RETHROW_EXCEPTION
-    }
 
-    void Insert(const Language& srclang, const Language& lang,
-                const std::wstring& source, const std::wstring& trans) override
-    {
-        Insert(srclang, lang, source, trans, 0);
+        target.shard->ExactIndex().Add(ExactMatchIndex::Key(srclang.WCode(), lang.WCode(), source), uuid);
     }
 
-    void Insert(const Language& srclang, const Language& lang, const CatalogItemPtr& item) override
+    /// Optimizes the shards and commits imported data
+    void Finish()
     {
-        if (!lang.IsValid() || !srclang.IsValid())
-            return;
-
-        // ignore translations with errors in them
-        if (item->HasError())
-            return;
-
-        // ignore untranslated or unfinished translations
-        if (item->IsFuzzy() || !item->IsTranslated())
-            return;
-
-        // always store at least the singular translation
-        Insert(srclang, lang, str::to_wstring(item->GetString()), str::to_wstring(item->GetTranslation()));
-
-        // for plurals, try to support at least the simpler cases, with nplurals <= 2
-        if (item->HasPlural())
+        for (auto& t: m_targets)
         {
-            switch (lang.nplurals())
+            try
             {
-                case 1:
-                    // e.g. Chinese, Japanese; store translation for both singular and plural
-                    Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation()));
-                    break;
-                case 2:
-                    // e.g. Germanic or Romanic languages, same 2 forms as English
-                    Insert(srclang, lang, str::to_wstring(item->GetPluralString()), str::to_wstring(item->GetTranslation(1)));
-                    break;
-                default:
-                    // not supported, only singular stored above
-                    break;
+                t.second.RestoreSettings();
+                t.second.writer->optimize();
+                t.second.writer->commit();
             }
+            CATCH_AND_RETHROW_EXCEPTION
+
+            t.second.shard->Manager().RequestRefresh();
         }
     }
 
-    void Insert(const CatalogPtr& cat) override
+private:
+    // Import state of a single shard
+    struct Target
     {
-        auto srclang = cat->GetSourceLanguage();
-        auto lang = cat->GetLanguage();
-        if (!lang.IsValid() || !srclang.IsValid())
-            return;
+        explicit Target(ShardPtr s)
+            : shard(s), writer(s->Writer()), analyzer(writer->getAnalyzer()), restored(false)
+        {
+            isEmpty = writer->numDocs() == 0;
+            originalRAMBufferSize = writer->getRAMBufferSizeMB();
+            writer->setRAMBufferSizeMB(RAM_BUFFER_SIZE);
+        }
 
-        for (auto& item: cat->items())
+        void RestoreSettings()
         {
-            // Note that dt.IsModified() is intentionally not checked - we
-            // want to save old entries in the TM too, so that we harvest as
-            // much useful translations as we can.
-            Insert(srclang, lang, item);
+            if (restored)
+                return;
+            restored = true;
+            writer->waitForMerges();
+            writer->setRAMBufferSizeMB(originalRAMBufferSize);
         }
-    }
 
-    void Delete(const std::string& uuid) override
+        ShardPtr shard;
+        IndexWriterPtr writer;
+        AnalyzerPtr analyzer;
+        bool isEmpty, restored;
+        double originalRAMBufferSize;
+    };
+
+    Target& GetTarget(const Language& srclang, const Language& lang)
     {
-        try
+        // imported data tend to be in a single language pair, so cache the last one:
+        const std::wstring key = srclang.WCode() + L"|" + lang.WCode();
+        if (m_last && key == m_lastKey)
+            return *m_last;
+
+        auto shard = m_shards->Get(srclang, lang, /*create=*/true);
+        auto i = m_targets.find(shard.get());
+        if (i == m_targets.end())
         {
-            m_writer->deleteDocuments(newLucene<Term>(L"uuid", StringUtils::toUnicode(uuid)));
+            try
+            {
+                i = m_targets.emplace(shard.get(), Target(shard)).first;
+            }
+            CATCH_AND_RETHROW_EXCEPTION
         }
-        CATCH_AND_RETHROW_EXCEPTION
+
+        m_lastKey = key;
+        m_last = &i->second;
+        return i->second;
     }
 
-    void DeleteAll() override
+    std::shared_ptr<ShardSet> m_shards;
+    std::map<Shard*, Target> m_targets;
+    std::wstring m_lastKey;
+    Target *m_last = nullptr;
+    std::unordered_set<boost::uuids::uuid, boost::hash<boost::uuids::uuid>> m_seen;
+};
+
+
+void TranslationMemoryImpl::ImportData(std::function<void(TranslationMemory::IOInterface&)> source)
+{
+    // don't compact the data while they are being imported:
+    std::lock_guard<std::mutex> lock(m_maintenance->RunMutex());
+    m_maintenance->NotifyActivity();
+
+    TranslationMemoryBulkImporter importer(m_shards);
+    source(importer);
+    importer.Finish();
+}
+
+
+void TranslationMemoryImpl::Compact()
+{
+    m_maintenance->RunNow();
+}
+
+
+void TranslationMemoryImpl::MigrateUnshardedIndex()
+{
+    const std::wstring root = GetDatabaseDir();
+    try
     {
-        try
+        auto dir = OpenDirectory(root, /*readOnly=*/false);
+        if (!IndexReader::indexExists(dir))
+            return;
+
+        // Nothing can be using the data yet, so simply copy the documents
+        // into their shards:
+        ImportData([=](TranslationMemory::IOInterface& dest)
         {
-            m_writer->deleteAll();
-        }
-        CATCH_AND_RETHROW_EXCEPTION
+            auto reader = IndexReader::open(dir, /*readOnly=*/true);
+            std::map<std::wstring, Language> languages;
+            auto parseLang = [&languages](const std::wstring& code) -> const Language&
+            {
+                auto i = languages.find(code);
+                if (i == languages.end())
+                    i = languages.emplace(code, Language::TryParse(code)).first;
+                return i->second;
+            };
+
+            const int32_t maxDoc = reader->maxDoc();
+            for (int32_t i = 0; i < maxDoc; i++)
+            {
+                if (reader->isDeleted(i))
+                    continue;
+                auto doc = reader->document(i);
+                dest.Insert(parseLang(doc->get(L"srclang")),
+                            parseLang(doc->get(L"lang")),
+                            get_text_field(doc, L"source"),
+                            get_text_field(doc, L"trans"),
+                            DateField::stringToTime(doc->get(L"created")));
+            }
+            reader->close();
+        });
+        dir->close();
     }
+    CATCH_AND_RETHROW_EXCEPTION
 
-private:
-    IndexWriterPtr m_writer;
-};
+    // Everything is committed into shards now, remove the old index's files.
+    // If this is interrupted, the migration is just repeated next time.
+    wxLogNull null;
+    wxArrayString files;
+    wxDir::GetAllFiles(root, &files, wxEmptyString, wxDIR_FILES | wxDIR_HIDDEN);
+    for (auto& f: files)
+    {
+        if (wxFileName(f).GetFullName() != SHARDS_MANIFEST)
+            wxRemoveFile(f);
+    }
+}
 
 
 void TranslationMemoryImpl::Init()
 {
     try
     {
-        auto dir = newLucene<DirectoryType>(GetDatabaseDir());
         m_analyzer = newLucene<StandardAnalyzer>(LuceneVersion::LUCENE_CURRENT);
 
-        m_writer = newLucene<IndexWriter>(dir, m_analyzer, IndexWriter::MaxFieldLengthLIMITED);
-        m_writer->setMergeScheduler(newLucene<SerialMergeScheduler>());
+        // shards are opened lazily, when first searched or written to:
+        m_shards = std::make_shared<ShardSet>(GetDatabaseDir(), m_analyzer);
 
-        // get the associated realtime reader & searcher:
-        m_mng.reset(new SearcherManager(m_writer));
+        if (gs_databaseDirOverride.empty())
+        {
+            for (auto& path: Config::SharedTMPaths())
+                m_sharedTMs.push_back(std::make_shared<SharedTM>(path));
+        }
 
-        m_writerAPI = std::make_shared<TranslationMemoryWriterImpl>(m_writer);
+        m_maintenance = std::make_shared<TranslationMemoryMaintenance>(m_shards);
+        auto writerImpl = std::make_shared<TranslationMemoryWriterImpl>(m_shards, m_maintenance);
+        m_writerAPI = writerImpl;
+        m_writeQueue = std::make_shared<TranslationMemoryWriteQueue>(writerImpl);
     }
     CATCH_AND_RETHROW_EXCEPTION
+
+    MigrateUnshardedIndex();
 }
 
 
@@ -733,6 +2777,12 @@ void TranslationMemory::CleanUp()
     }
 }
 
+void TranslationMemory::UseDatabaseDir(const std::wstring& dir)
+{
+    wxASSERT_MSG( !ms_instance, "must be called before the TM is used" );
+    gs_databaseDirOverride = dir;
+}
+
 TranslationMemory::TranslationMemory() : m_impl(nullptr)
 {
     try
@@ -754,18 +2804,69 @@ TranslationMemory::~TranslationMemory() { delete m_impl; }
 
 SuggestionsList TranslationMemory::Search(const Language& srclang,
                                           const Language& lang,
-                                          const std::wstring& source)
+                                          const std::wstring& source,
+                                          const dispatch::cancellation_token& token)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->Search(srclang, lang, source, token);
+}
+
+std::vector<SuggestionsList> TranslationMemory::SearchBatch(const Language& srclang,
+                                                            const Language& lang,
+                                                            const std::vector<std::wstring>& sources)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->SearchBatch(srclang, lang, sources);
+}
+
+std::vector<SuggestionsList> TranslationMemory::SearchBatchCached(const Language& srclang,
+                                                                  const Language& lang,
+                                                                  const std::vector<std::wstring>& sources)
+{
+    const uint64_t version = GetCacheVersion(srclang, lang);
+    if (!version)
+        return SearchBatch(srclang, lang, sources);
+
+    std::vector<SuggestionsList> results(sources.size());
+    std::vector<std::wstring> missing;
+    std::vector<size_t> missingIndexes;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (!SuggestionsCache::Get(*this, version, srclang, lang, sources[i], results[i]))
+        {
+            missing.push_back(sources[i]);
+            missingIndexes.push_back(i);
+        }
+    }
+
+    if (!missing.empty())
+    {
+        auto found = SearchBatch(srclang, lang, missing);
+        for (size_t i = 0; i < missing.size(); i++)
+        {
+            SuggestionsCache::Put(*this, version, srclang, lang, missing[i], found[i]);
+            results[missingIndexes[i]] = std::move(found[i]);
+        }
+    }
+
+    return results;
+}
+
+void TranslationMemory::Warmup(const Language& srclang, const Language& lang)
 {
     if (!m_impl)
         std::rethrow_exception(m_error);
-    return m_impl->Search(srclang, lang, source);
+    m_impl->Warmup(srclang, lang);
 }
 
-dispatch::future<SuggestionsList> TranslationMemory::SuggestTranslation(const SuggestionQuery&& q)
+dispatch::future<SuggestionsList> TranslationMemory::SuggestTranslation(const SuggestionQuery&& q,
+                                                                       const dispatch::cancellation_token& token)
 {
     try
     {
-        return dispatch::make_ready_future(Search(q.srclang, q.lang, q.source));
+        return dispatch::make_ready_future(Search(q.srclang, q.lang, q.source, token));
     }
     catch (...)
     {
@@ -780,11 +2881,12 @@ void TranslationMemory::Delete(const std::string& id)
     tm->Commit();
 }
 
-void TranslationMemory::ExportData(IOInterface& destination)
+void TranslationMemory::ExportData(IOInterface& destination,
+                                   const Language& srclang, const Language& lang)
 {
     if (!m_impl)
         std::rethrow_exception(m_error);
-    return m_impl->ExportData(destination);
+    return m_impl->ExportData(destination, srclang, lang);
 }
 
 void TranslationMemory::ImportData(std::function<void(IOInterface&)> source)
@@ -794,6 +2896,126 @@ void TranslationMemory::ImportData(std::function<void(IOInterface&)> source)
     return m_impl->ImportData(source);
 }
 
+size_t TranslationMemory::ImportFiles(const std::vector<wxString>& files,
+                                      std::function<bool(size_t)> progress,
+                                      std::vector<wxString> *failed)
+{
+    struct FileTranslations
+    {
+        bool ok = false;
+        Language srclang, lang;
+        std::vector<std::pair<std::wstring, std::wstring>> translations;
+        std::shared_ptr<HarvestDigest> harvested;
+        std::vector<uint64_t> digests;
+    };
+
+    auto extract = [&files](size_t i)
+    {
+        FileTranslations r;
+        try
+        {
+            auto cat = Catalog::Create(files[i]);
+            if (!cat || !cat->IsOk())
+                return r;
+            r.ok = true;
+            r.srclang = cat->GetSourceLanguage();
+            r.lang = cat->GetLanguage();
+            if (!r.lang.IsValid() || !r.srclang.IsValid() || r.lang == r.srclang)
+                return r;
+
+            r.harvested = std::make_shared<HarvestDigest>(cat->GetFileName());
+            for (auto& item: cat->items())
+            {
+                TranslationMemoryWriterImpl::ForEachStorableTranslation(r.lang, item, [&](std::wstring&& source, std::wstring&& trans)
+                {
+                    auto digest = HarvestDigest::Compute(r.srclang, r.lang, source, trans);
+                    r.digests.push_back(digest);
+                    if (!r.harvested->Contains(digest))
+                        r.translations.emplace_back(std::move(source), std::move(trans));
+                });
+            }
+        }
+        catch (...)
+        {
+            wxLogTrace("poedit.tm", "failed to import %s: %s", files[i], DescribeCurrentException());
+            r.ok = false;
+        }
+        return r;
+    };
+
+    // digests are only updated once the imported data are committed:
+    std::vector<std::pair<std::shared_ptr<HarvestDigest>, std::vector<uint64_t>>> harvested;
+    size_t imported = 0;
+
+    ImportData([&](IOInterface& dest)
+    {
+        // Files are processed in batches, so that progress can be reported
+        // and not all of them are kept in memory at once:
+        const size_t batchSize = 4 * std::max(1U, std::thread::hardware_concurrency());
+        dispatch::parallel_options options;
+        options.chunk_size = 1;
+
+        for (size_t begin = 0; begin < files.size(); begin += batchSize)
+        {
+            const size_t end = std::min(files.size(), begin + batchSize);
+            auto batch = dispatch::parallel_transform(begin, end, extract, options);
+
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                auto& r = batch[i];
+                if (!r.ok)
+                {
+                    if (failed)
+                        failed->push_back(files[begin + i]);
+                    continue;
+                }
+                for (auto& t: r.translations)
+                    dest.Insert(r.srclang, r.lang, t.first, t.second, 0);
+                if (r.harvested)
+                    harvested.emplace_back(r.harvested, std::move(r.digests));
+                imported++;
+            }
+
+            if (progress && !progress(end))
+                break;
+        }
+    });
+
+    for (auto& h: harvested)
+        h.first->Save(std::move(h.second));
+
+    return imported;
+}
+
+std::vector<wxString> TranslationMemory::FindTranslationFiles(const wxString& dir)
+{
+    wxArrayString all;
+    wxDir::GetAllFiles(dir, &all, wxEmptyString, wxDIR_FILES | wxDIR_DIRS);
+
+    std::vector<wxString> files;
+    for (auto& f: all)
+    {
+        if (Catalog::CanLoadFile(wxFileName(f).GetExt()))
+            files.push_back(f);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+void TranslationMemory::InsertLater(const Language& srclang, const Language& lang, const CatalogItemPtr& item)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    m_impl->GetWriteQueue()->Add(srclang, lang, item);
+}
+
+void TranslationMemory::InsertLater(const CatalogPtr& cat)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    m_impl->GetWriteQueue()->Add(cat);
+}
+
 std::shared_ptr<TranslationMemory::Writer> TranslationMemory::GetWriter()
 {
     if (!m_impl)
@@ -813,6 +3035,7 @@ void TranslationMemory::DeleteAllAndReset()
     {
         // Lucene database is corrupted, best we can do is delete it completely
         wxFileName::Rmdir(TranslationMemoryImpl::GetDatabaseDir(), wxPATH_RMDIR_RECURSIVE);
+        HarvestDigest::ClearAll();
 
         // recreate implementation object
         TranslationMemoryImpl *impl = new TranslationMemoryImpl;
@@ -822,6 +3045,40 @@ void TranslationMemory::DeleteAllAndReset()
     }
 }
 
+uint64_t TranslationMemory::GetDataVersion(const Language& srclang, const Language& lang)
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->GetDataVersion(srclang, lang);
+}
+
+uint64_t TranslationMemory::GetCacheVersion(const Language& srclang, const Language& lang)
+{
+    if (!m_impl)
+        return 0;
+    return m_impl->GetCacheVersion(srclang, lang);
+}
+
+std::string TranslationMemory::GetEntryID(const Language& srclang, const Language& lang,
+                                          const std::wstring& source, const std::wstring& trans)
+{
+    return boost::uuids::to_string(TranslationMemoryWriterImpl::ComputeUUID(srclang, lang, source, trans));
+}
+
+std::vector<TranslationMemory::LanguagePairStats> TranslationMemory::GetLanguagePairStats()
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    return m_impl->GetLanguagePairStats();
+}
+
+void TranslationMemory::Compact()
+{
+    if (!m_impl)
+        std::rethrow_exception(m_error);
+    m_impl->Compact();
+}
+
 void TranslationMemory::GetStats(long& numDocs, long& fileSize)
 {
     if (!m_impl)
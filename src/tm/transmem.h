@@ -39,6 +39,10 @@ class TranslationMemoryImpl;
 
 /** 
     Lucene-based translation memory.
+
+    Besides the user's own TM, read-only TMs in shared locations (see
+    Config::SharedTMPaths()) are searched too, if configured. They are
+    read in place and never modified.
     
     All methods may throw Exception.
  */
@@ -51,23 +55,74 @@ public:
     /// Destroys the singleton, must be called (only) on app shutdown.
     static void CleanUp();
 
+    /**
+        Makes the TM use @a dir for its data instead of the user's database,
+        without any shared TMs. Must be called before the first Get() call.
+
+        This is for benchmarks, which must not touch the user's data.
+     */
+    static void UseDatabaseDir(const std::wstring& dir);
+
     /**
         Search translation memory for similar strings.
         
         @param srclang Language of the source text.
         @param lang    Language of the desired translation.
         @param source  Source text.
+        @param token   Cancellation token; if cancelled, the search stops
+                       early and returns what was found so far.
 
         @return List of hits that were found, possibly empty.
      */
     SuggestionsList Search(const Language& srclang,
                            const Language& lang,
-                           const std::wstring& source);
+                           const std::wstring& source,
+                           const dispatch::cancellation_token& token = dispatch::cancellation_token());
+
+    /**
+        Search translation memory for many strings at once.
+
+        This is considerably faster than calling Search() for each of them,
+        because identical strings are only searched once and exact matches
+        are looked up together, with slower fuzzy search used only for
+        strings without them.
+
+        @param srclang Language of the source texts.
+        @param lang    Language of the desired translations.
+        @param sources Source texts.
+
+        @return Lists of hits for each of @a sources, in the same order.
+                If an exact match was found, only exact matches are included.
+     */
+    std::vector<SuggestionsList> SearchBatch(const Language& srclang,
+                                             const Language& lang,
+                                             const std::vector<std::wstring>& sources);
+
+    /**
+        Like SearchBatch(), but reuses results already in SuggestionsCache,
+        e.g. found by the sidebar, and only searches for the rest. Newly
+        found results are put into the cache.
+     */
+    std::vector<SuggestionsList> SearchBatchCached(const Language& srclang,
+                                                   const Language& lang,
+                                                   const std::vector<std::wstring>& sources);
+
+    /**
+        Prepares the TM for searching with given language pair, so that the
+        first queries aren't slowed down by cold caches: opens the pair's
+        index, waits until its exact matches are indexed in memory and reads
+        the terms dictionary's index.
+
+        This is slow and blocking; call it on a low priority background thread.
+     */
+    void Warmup(const Language& srclang, const Language& lang);
 
     /// SuggestionsBackend API implementation:
-    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q) override;
+    dispatch::future<SuggestionsList> SuggestTranslation(const SuggestionQuery&& q,
+                                                         const dispatch::cancellation_token& token) override;
 
     void Delete(const std::string& id) override;
+    uint64_t GetCacheVersion(const Language& srclang, const Language& lang) override;
 
     /// Abstract interface to processing TM entries
     class IOInterface
@@ -83,11 +138,19 @@ public:
     };
 
     /**
-        Exports all database entries by pushing them to the provided output interface.
+        Exports database entries by pushing them to the provided output interface.
+
+        Entries are read in parallel, but @a destination is only called from
+        the calling thread.
+
+        @param srclang If valid, only export entries with this source language.
+        @param lang    If valid, only export entries with this language.
 
         May throw on error.
      */
-    void ExportData(IOInterface& destination);
+    void ExportData(IOInterface& destination,
+                    const Language& srclang = Language(),
+                    const Language& lang = Language());
 
     /**
         Imports data provided by the function into the database. The function
@@ -97,6 +160,25 @@ public:
      */
     void ImportData(std::function<void(IOInterface&)> source);
 
+    /**
+        Imports translations from translation files into the database, using
+        ImportData(). Files are loaded and their translations extracted in
+        parallel; as with Writer::Insert(const CatalogPtr&), translations
+        already harvested from a file are skipped.
+
+        @param progress Called on the calling thread with the number of
+                        processed files; return false to stop importing.
+        @param failed   If not null, receives files that couldn't be loaded.
+
+        Returns the number of imported files. May throw on error.
+     */
+    size_t ImportFiles(const std::vector<wxString>& files,
+                       std::function<bool(size_t)> progress = std::function<bool(size_t)>(),
+                       std::vector<wxString> *failed = nullptr);
+
+    /// Returns all translation files Poedit can load in @a dir or its subdirectories
+    static std::vector<wxString> FindTranslationFiles(const wxString& dir);
+
 
     /**
         Performs updates to the translation memory.
@@ -172,12 +254,62 @@ public:
     /// Returns the shared writer instance
     std::shared_ptr<Writer> GetWriter();
 
+    /**
+        Queues translations from the item for insertion into the TM.
+
+        Unlike Writer::Insert(), this is cheap and doesn't wait for Lucene:
+        the translations are written on a background thread and committed
+        automatically shortly after changes stop coming. Translations already
+        written by this function during the session are skipped.
+
+        Failures are only logged as warnings.
+     */
+    void InsertLater(const Language& srclang, const Language& lang, const CatalogItemPtr& item);
+
+    /// Queues all translations from the catalog, see InsertLater() above.
+    void InsertLater(const CatalogPtr& cat);
+
     /// Resets the database to pristine state, removing all data
     void DeleteAllAndReset();
 
     /// Returns statistics about the TM
     void GetStats(long& numDocs, long& fileSize);
 
+    /**
+        Returns a number that changes whenever data for the language pair
+        (including variants of @a lang) change, or 0 if there's no data.
+     */
+    uint64_t GetDataVersion(const Language& srclang, const Language& lang);
+
+    /// Returns ID of the entry with given content, as used by Delete()
+    static std::string GetEntryID(const Language& srclang, const Language& lang,
+                                  const std::wstring& source, const std::wstring& trans);
+
+    /// Statistics about translations between a pair of languages
+    struct LanguagePairStats
+    {
+        Language srclang;
+        Language lang;          ///< Without country or variant, covering all of them
+        long numDocs;           ///< Number of stored translations
+        long numDeletedDocs;    ///< Deleted entries still taking space until compacted
+        long fileSize;          ///< Size of the data on disk
+    };
+
+    /**
+        Returns statistics about every language pair in the TM.
+
+        The TM is maintained automatically in the background when idle:
+        superseded translations are removed and the data compacted.
+     */
+    std::vector<LanguagePairStats> GetLanguagePairStats();
+
+    /**
+        Does the maintenance described above for all language pairs right
+        away, instead of waiting for the TM to be idle, and waits for it
+        to finish.
+     */
+    void Compact();
+
 private:
     TranslationMemory();
     ~TranslationMemory();
@@ -0,0 +1,230 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "tracing.h"
+
+#include <wx/ffile.h>
+#include <wx/intl.h>
+#include <wx/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+std::atomic<bool> Tracing::ms_enabled(false);
+
+const double Tracing::HISTOGRAM_LIMITS_MS[HISTOGRAM_BUCKETS - 1] = { 1, 5, 10, 50, 100, 500, 1000 };
+
+namespace
+{
+
+// times are relative to the program's start:
+const Tracing::Clock::time_point gs_origin = Tracing::Clock::now();
+
+struct TraceEvent
+{
+    const char *name;
+    int thread;
+    long long start, duration; // in microseconds
+};
+
+struct NameLess
+{
+    bool operator()(const char *a, const char *b) const { return strcmp(a, b) < 0; }
+};
+
+struct TraceData
+{
+    std::mutex mutex;
+    bool writeEvents = false;
+    bool collectStatistics = false;
+
+    wxString filename;
+    std::vector<TraceEvent> events;
+    std::map<std::thread::id, int> threads;
+
+    // keyed by name's content, the same literal may have several copies:
+    std::map<const char*, Tracing::ScopeStatistics, NameLess> scopes;
+    std::map<const char*, long, NameLess> counters;
+};
+
+TraceData& GetTraceData()
+{
+    static TraceData s_data;
+    return s_data;
+}
+
+inline long long ToMicroseconds(Tracing::Clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+void AppendJSONString(std::string& out, const char *s)
+{
+    out += '"';
+    for (; *s; ++s)
+    {
+        const char c = *s;
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c < 0x20)
+            continue;
+        out += c;
+    }
+    out += '"';
+}
+
+} // anonymous namespace
+
+
+void Tracing::Enable(const wxString& filename)
+{
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.filename = filename;
+    data.events.reserve(4096);
+    data.writeEvents = true;
+    ms_enabled = true;
+}
+
+
+void Tracing::EnableStatistics()
+{
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.collectStatistics = true;
+    ms_enabled = true;
+}
+
+
+void Tracing::Record(const char *name, Clock::time_point start)
+{
+    if (!IsEnabled())
+        return;
+    const auto end = Clock::now();
+
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+
+    if (data.writeEvents)
+    {
+        // use small sequential numbers to identify threads in the output:
+        auto t = data.threads.emplace(std::this_thread::get_id(), int(data.threads.size() + 1)).first;
+
+        data.events.push_back({name, t->second, ToMicroseconds(start - gs_origin), ToMicroseconds(end - start)});
+    }
+
+    if (data.collectStatistics)
+    {
+        auto i = data.scopes.find(name);
+        if (i == data.scopes.end())
+        {
+            ScopeStatistics empty{name, 0, 0, 0, 0, {}};
+            i = data.scopes.emplace(name, empty).first;
+        }
+        auto& st = i->second;
+        const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        st.count++;
+        st.totalMs += ms;
+        st.lastMs = ms;
+        st.maxMs = std::max(st.maxMs, ms);
+
+        int bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && ms > HISTOGRAM_LIMITS_MS[bucket])
+            bucket++;
+        st.histogram[bucket]++;
+    }
+}
+
+
+void Tracing::DoCount(const char *name, long delta)
+{
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    if (data.collectStatistics)
+        data.counters[name] += delta;
+}
+
+
+std::vector<Tracing::ScopeStatistics> Tracing::GetScopeStatistics()
+{
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    std::vector<ScopeStatistics> out;
+    out.reserve(data.scopes.size());
+    for (auto& i: data.scopes)
+        out.push_back(i.second);
+    return out;
+}
+
+
+std::vector<std::pair<std::string, long>> Tracing::GetCounters()
+{
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    return std::vector<std::pair<std::string, long>>(data.counters.begin(), data.counters.end());
+}
+
+
+void Tracing::Finish()
+{
+    if (!IsEnabled())
+        return;
+
+    auto& data = GetTraceData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    if (!data.writeEvents)
+        return;
+    data.writeEvents = false;
+    ms_enabled = data.collectStatistics;
+
+    std::string out;
+    out.reserve(data.events.size() * 80 + 64);
+    out += "{\"traceEvents\":[\n";
+    bool first = true;
+    for (auto& e: data.events)
+    {
+        if (!first)
+            out += ",\n";
+        first = false;
+        out += "{\"name\":";
+        AppendJSONString(out, e.name);
+        out += ",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(e.thread) +
+               ",\"ts\":" + std::to_string(e.start) +
+               ",\"dur\":" + std::to_string(e.duration) + "}";
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    wxFFile f(data.filename, "wb");
+    if (!f.IsOpened() || f.Write(out.data(), out.size()) != out.size() || !f.Close())
+        wxLogError(_("Failed to write trace to %s."), data.filename);
+
+    data.events.clear();
+}
@@ -0,0 +1,156 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_tracing_h
+#define Poedit_tracing_h
+
+#include <wx/string.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+    Lightweight tracing of where time is spent.
+
+    Tracing is disabled by default, in which case scoped timers only check
+    a flag. When enabled with the --trace command line switch, durations of
+    the instrumented scopes are collected in memory and written on exit as
+    a JSON file in Chrome's trace event format, viewable in chrome://tracing
+    or https://ui.perfetto.dev.
+
+    Use the TRACE_SCOPE() macro to instrument code:
+
+        void POCatalog::Save(...)
+        {
+            TRACE_SCOPE("POCatalog::Save");
+            ...
+        }
+
+    Names must be string literals (or otherwise outlive the tracing).
+
+    Alternatively (or in addition to that), aggregated statistics of the
+    scopes and counters of events (see TRACE_COUNT()) can be kept in memory
+    for the diagnostics window, see EnableStatistics().
+ */
+class Tracing
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// Starts collecting events, to be written into @a filename by Finish()
+    static void Enable(const wxString& filename);
+
+    /// Starts keeping statistics returned by GetScopeStatistics() and GetCounters()
+    static void EnableStatistics();
+
+    static bool IsEnabled() { return ms_enabled.load(std::memory_order_relaxed); }
+
+    /// Records an event that started at @a start and ends now
+    static void Record(const char *name, Clock::time_point start);
+
+    /// Increments counter @a name, if statistics are enabled
+    static void Count(const char *name, long delta = 1)
+    {
+        if (IsEnabled())
+            DoCount(name, delta);
+    }
+
+    /// Writes collected events (if enabled) and stops tracing
+    static void Finish();
+
+    /// Number of buckets in ScopeStatistics::histogram
+    static const int HISTOGRAM_BUCKETS = 8;
+    /// Upper limits of all histogram buckets but the last one, in milliseconds
+    static const double HISTOGRAM_LIMITS_MS[HISTOGRAM_BUCKETS - 1];
+
+    /// Aggregated durations of a traced scope
+    struct ScopeStatistics
+    {
+        std::string name;
+        long count;
+        double totalMs, lastMs, maxMs;
+        /// Number of durations in every bucket, see HISTOGRAM_LIMITS_MS
+        std::array<long, HISTOGRAM_BUCKETS> histogram;
+    };
+
+    /// Returns statistics collected since EnableStatistics(), sorted by name
+    static std::vector<ScopeStatistics> GetScopeStatistics();
+
+    /// Returns values of counters, sorted by name
+    static std::vector<std::pair<std::string, long>> GetCounters();
+
+private:
+    static void DoCount(const char *name, long delta);
+
+    static std::atomic<bool> ms_enabled;
+};
+
+
+/// Records duration of the enclosing scope, see Tracing
+class ScopedTrace
+{
+public:
+    explicit ScopedTrace(const char *name)
+        : m_name(Tracing::IsEnabled() ? name : nullptr)
+    {
+        if (m_name)
+            m_start = Tracing::Clock::now();
+    }
+
+    /// Always measures, for code that runs before tracing can be enabled
+    ScopedTrace(const char *name, Tracing::Clock::time_point start)
+        : m_name(name), m_start(start)
+    {
+    }
+
+    ~ScopedTrace()
+    {
+        if (m_name)
+            Tracing::Record(m_name, m_start);
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    const char *m_name;
+    Tracing::Clock::time_point m_start;
+};
+
+#define TRACE_SCOPE_CONCAT2(a, b) a ## b
+#define TRACE_SCOPE_CONCAT(a, b)  TRACE_SCOPE_CONCAT2(a, b)
+
+/// Traces the rest of the current scope under @a name
+#define TRACE_SCOPE(name)  ScopedTrace TRACE_SCOPE_CONCAT(traceScope_, __LINE__)(name)
+
+/// Counts an occurrence of event @a name, see Tracing::Count()
+#define TRACE_COUNT(name)  Tracing::Count(name)
+
+#endif // Poedit_tracing_h
@@ -28,6 +28,7 @@
 #include "str_helpers.h"
 
 #include <unicode/ubidi.h>
+#include <unicode/uchar.h>
 
 namespace bidi
 {
@@ -140,3 +141,27 @@ wxString mark_direction(const wxString& text, TextDirection dir)
 }
 
 } // namespace bidi
+
+
+namespace unicode
+{
+
+wxString fold_case(const wxString& text)
+{
+    wxString out(text);
+    for (auto i = out.begin(); i != out.end(); ++i)
+    {
+        const UChar32 c = (UChar32)(*i).GetValue();
+#if SIZEOF_WCHAR_T == 2
+        // leave surrogates alone, folding can't change length
+        if (U_IS_SURROGATE(c))
+            continue;
+#endif
+        const UChar32 folded = u_foldCase(c, U_FOLD_CASE_DEFAULT);
+        if (folded != c)
+            *i = wxUniChar((wxUint32)folded);
+    }
+    return out;
+}
+
+} // namespace unicode
@@ -108,4 +108,19 @@ inline wxString platform_mark_direction(const wxString& text)
 
 } // namespace bidi
 
+
+namespace unicode
+{
+
+/**
+    Case-folds the text for case-insensitive comparisons, using ICU's simple
+    case folding of individual characters.
+
+    Unlike full case folding (e.g. "ß" to "ss"), this preserves the length
+    of the text, so that positions of found matches apply to the original.
+ */
+wxString fold_case(const wxString& text);
+
+} // namespace unicode
+
 #endif // Poedit_unicode_helpers_h
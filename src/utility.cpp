@@ -28,8 +28,11 @@
 #include <stdio.h>
 
 #include <wx/filename.h>
+#include <wx/file.h>
 #include <wx/log.h>
 #include <wx/config.h>
+#include <wx/stdpaths.h>
+#include <wx/utils.h>
 
 #if wxUSE_GUI
     #include <wx/display.h>
@@ -41,8 +44,13 @@
 #ifdef __UNIX__
     #include <sys/types.h>
     #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
     #include <unistd.h>
 #endif
+#ifdef __WXMSW__
+    #include <wx/msw/wrapwin.h>
+#endif
 
 #include "str_helpers.h"
 
@@ -165,7 +173,11 @@ wxString TempDirectory::CreateFileName(const wxString& suffix)
 {
     wxASSERT( !m_dir.empty() );
 
-    int counter = m_counters[suffix]++;
+    int counter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        counter = m_counters[suffix]++;
+    }
 
     wxString s = wxString::Format("%s%c%s%s",
                                   m_dir.c_str(), wxFILE_SEP_PATH,
@@ -288,6 +300,136 @@ TempOutputFileFor::~TempOutputFileFor()
 #endif
 }
 
+
+// ----------------------------------------------------------------------
+// GetUserCacheDir
+// ----------------------------------------------------------------------
+
+wxString GetUserCacheDir(const wxString& subdir)
+{
+    wxString cache;
+#if defined(__WXOSX__)
+    cache = wxGetHomeDir() + "/Library/Caches/net.poedit.Poedit";
+#elif defined(__UNIX__)
+    if (!wxGetEnv("XDG_CACHE_HOME", &cache))
+        cache = wxGetHomeDir() + "/.cache";
+    cache += "/poedit";
+#else
+    cache = wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "Cache";
+#endif
+    cache += wxFILE_SEP_PATH;
+    cache += subdir;
+    return cache;
+}
+
+
+// ----------------------------------------------------------------------
+// MemoryMappedFile
+// ----------------------------------------------------------------------
+
+MemoryMappedFile::MemoryMappedFile(const wxString& filename)
+    : m_ok(false), m_data(nullptr), m_size(0), m_mapped(false)
+#ifdef __WXMSW__
+      , m_mappingHandle(nullptr)
+#endif
+{
+    m_ok = Map(filename) || Read(filename);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    if (!m_mapped)
+        return;
+
+#ifdef __WXMSW__
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mappingHandle);
+#else
+    munmap(const_cast<char*>(m_data), m_size);
+#endif
+}
+
+bool MemoryMappedFile::Map(const wxString& filename)
+{
+#if defined(__WXMSW__)
+    HANDLE file = CreateFileW(filename.wc_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || size.QuadPart > SIZE_MAX)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    // the mapping keeps the file open, we don't need the handle anymore:
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_mappingHandle = mapping;
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_mapped = true;
+    return true;
+#elif defined(__UNIX__)
+    int fd = open(filename.fn_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const char*>(data);
+    m_size = (size_t)st.st_size;
+    m_mapped = true;
+    return true;
+#else
+    (void)filename;
+    return false;
+#endif
+}
+
+bool MemoryMappedFile::Read(const wxString& filename)
+{
+    wxFile file;
+    if (!file.Open(filename, wxFile::read))
+        return false;
+
+    auto length = file.Length();
+    if (length == wxInvalidOffset)
+        return false;
+
+    m_buffer.resize((size_t)length);
+    if (length > 0 && file.Read(&m_buffer[0], (size_t)length) != (ssize_t)length)
+        return false;
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+}
+
+
 #ifdef __WXMSW__
 wxString CliSafeFileName(const wxString& fn)
 {
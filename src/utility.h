@@ -32,7 +32,13 @@
     #endif
 #endif
 
+#include <algorithm>
 #include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "simd.h"
 
 #include <wx/arrstr.h>
 #include <wx/filename.h>
@@ -90,26 +96,121 @@ wxString EscapeMarkup(const wxString& str);
 
 // Encoding and decoding a string with C escape sequences:
 
-template<typename T>
-inline void EscapeCStringInplace(T& str)
+namespace detail
+{
+
+// Returns the escape letter for characters encoded as \x, or 0 if not escaped
+inline char CEscapeFor(wchar_t c)
+{
+    switch (c)
+    {
+        case '"':  return '"';
+        case '\a': return 'a';
+        case '\b': return 'b';
+        case '\f': return 'f';
+        case '\n': return 'n';
+        case '\r': return 'r';
+        case '\t': return 't';
+        case '\v': return 'v';
+        case '\\': return '\\';
+        default:   return 0;
+    }
+}
+
+// Finds the first character at or after @a from that needs escaping. Most
+// strings don't have any, so blocks of characters are checked at once for
+// anything that may need escaping (control characters, quotes, backslashes)
+// and only candidate blocks are examined closely.
+template<typename CharT>
+inline size_t FindCharToEscape(const CharT *s, size_t length, size_t from = 0)
 {
-    for (typename T::iterator i = str.begin(); i != str.end(); ++i)
+    size_t i = from;
+#ifdef POEDIT_HAVE_SSE2
+    if (sizeof(CharT) == 1)
     {
-        switch ((wchar_t)*i)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i maxControl = _mm_set1_epi8(0x1F);
+        for (; i + 16 <= length; i += 16)
         {
-            case '"' :           i = ++str.insert(i, '\\'); break;
-            case '\a': *i = 'a'; i = ++str.insert(i, '\\'); break;
-            case '\b': *i = 'b'; i = ++str.insert(i, '\\'); break;
-            case '\f': *i = 'f'; i = ++str.insert(i, '\\'); break;
-            case '\n': *i = 'n'; i = ++str.insert(i, '\\'); break;
-            case '\r': *i = 'r'; i = ++str.insert(i, '\\'); break;
-            case '\t': *i = 't'; i = ++str.insert(i, '\\'); break;
-            case '\v': *i = 'v'; i = ++str.insert(i, '\\'); break;
-            case '\\':           i = ++str.insert(i, '\\'); break;
-            default:
-                break;
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            const __m128i candidates = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                                 _mm_cmpeq_epi8(chunk, backslash)),
+                                                    _mm_cmpeq_epi8(_mm_min_epu8(chunk, maxControl), chunk));
+            if (!_mm_movemask_epi8(candidates))
+                continue;
+            for (size_t j = i; j < i + 16; j++)
+            {
+                if (CEscapeFor(wchar_t((unsigned char)s[j])))
+                    return j;
+            }
+        }
+    }
+#endif
+    for (; i + 8 <= length; i += 8)
+    {
+        // branch-free, so that compilers can vectorize it:
+        bool candidate = false;
+        for (size_t j = i; j < i + 8; j++)
+        {
+            const unsigned c = (unsigned)(typename std::make_unsigned<CharT>::type)s[j];
+            candidate |= (c < 0x20) | (c == '"') | (c == '\\');
+        }
+        if (!candidate)
+            continue;
+        for (size_t j = i; j < i + 8; j++)
+        {
+            if (CEscapeFor(wchar_t((typename std::make_unsigned<CharT>::type)s[j])))
+                return j;
         }
     }
+    for (; i < length; i++)
+    {
+        if (CEscapeFor(wchar_t((typename std::make_unsigned<CharT>::type)s[i])))
+            return i;
+    }
+    return length;
+}
+
+template<typename CharT>
+inline void EscapeCStringInplaceImpl(std::basic_string<CharT>& str)
+{
+    const CharT *s = str.data();
+    const size_t length = str.length();
+    size_t pos = FindCharToEscape(s, length);
+    if (pos == length)
+        return; // the common case, nothing to do
+
+    std::basic_string<CharT> out;
+    out.reserve(length + length / 8 + 2);
+    size_t runStart = 0;
+    while (pos < length)
+    {
+        out.append(s + runStart, pos - runStart);
+        out += CharT('\\');
+        out += CharT(CEscapeFor(wchar_t((typename std::make_unsigned<CharT>::type)s[pos])));
+        runStart = pos + 1;
+        pos = FindCharToEscape(s, length, runStart);
+    }
+    out.append(s + runStart, length - runStart);
+    str.swap(out);
+}
+
+} // namespace detail
+
+inline void EscapeCStringInplace(std::string& str) { detail::EscapeCStringInplaceImpl(str); }
+inline void EscapeCStringInplace(std::wstring& str) { detail::EscapeCStringInplaceImpl(str); }
+
+inline void EscapeCStringInplace(wxString& str)
+{
+#if wxUSE_UNICODE_WCHAR
+    const wxStringCharType *s = str.wx_str();
+    if (detail::FindCharToEscape(s, str.length()) == str.length())
+        return;
+#endif
+    std::wstring w(str.ToStdWstring());
+    EscapeCStringInplace(w);
+    str = w;
 }
 
 template<typename T>
@@ -123,50 +224,50 @@ inline T EscapeCString(const T& str)
 template<typename T>
 inline T UnescapeCString(const T& str)
 {
-    if (str.find('\\') == T::npos)
+    size_t backslash = str.find('\\');
+    if (backslash == T::npos)
         return str;
 
     T out;
     out.reserve(str.length());
-    for (auto i = str.begin(); i != str.end(); ++i)
+    size_t runStart = 0;
+    while (backslash != T::npos)
     {
-        wchar_t c = *i;
-        if (c == '\\')
+        // copy everything up to the escape sequence at once:
+        out.append(str, runStart, backslash - runStart);
+        if (backslash + 1 == str.length())
         {
-            if (++i != str.end())
-            {
-                switch ((wchar_t)*i)
-                {
-                    case 'a': out += '\a'; break;
-                    case 'b': out += '\b'; break;
-                    case 'f': out += '\f'; break;
-                    case 'n': out += '\n'; break;
-                    case 'r': out += '\r'; break;
-                    case 't': out += '\t'; break;
-                    case 'v': out += '\v'; break;
-                    case '\\':
-                    case '"':
-                    case '\'':
-                    case '?':
-                        out += *i;
-                        break;
-                    default:
-                        out += c;
-                        out += *i;
-                        break;
-                }
-            }
-            else
-            {
-                out += c;
-                break;
-            }
+            out += '\\';
+            runStart = str.length();
+            break;
         }
-        else
+
+        const auto e = str[backslash + 1];
+        switch ((wchar_t)e)
         {
-            out += c;
+            case 'a': out += '\a'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'v': out += '\v'; break;
+            case '\\':
+            case '"':
+            case '\'':
+            case '?':
+                out += e;
+                break;
+            default:
+                out += '\\';
+                out += e;
+                break;
         }
+        runStart = backslash + 2;
+        backslash = str.find('\\', runStart);
     }
+    if (runStart < str.length())
+        out.append(str, runStart, T::npos);
     return out;
 }
 
@@ -218,7 +319,7 @@ public:
 
     bool IsOk() const { return !m_dir.empty(); }
 
-    // creates new file name in that directory
+    // creates new file name in that directory; safe to call from any thread
     wxString CreateFileName(const wxString& suffix);
 
     /// Clears the temp directory (only safe if none of the files are open). Called by dtor.
@@ -228,6 +329,7 @@ public:
     static void KeepFiles(bool keep = true) { ms_keepFiles = keep; }
 
 private:
+    std::mutex m_mutex;
     std::map<wxString, int> m_counters;
     wxString m_dir;
 
@@ -272,6 +374,58 @@ inline wxString CliSafeFileName(const wxString& fn) { return fn; }
 #endif
 
 
+/**
+    Returns the @a subdir subdirectory of the directory for (disposable)
+    cached data. The directory may not exist yet.
+
+    Follows platform conventions: ~/Library/Caches on macOS, XDG_CACHE_HOME
+    on Unix and the Cache directory in user data directory elsewhere.
+ */
+wxString GetUserCacheDir(const wxString& subdir);
+
+
+// ----------------------------------------------------------------------
+// Read-only file mapping
+// ----------------------------------------------------------------------
+
+/**
+    Read-only view of a file's entire content.
+
+    The file is memory-mapped where possible; if that fails (or the file is
+    empty), its content is read into memory instead, so data() is always
+    usable when IsOk() returns true.
+
+    The data must not be used after the object is destroyed.
+ */
+class MemoryMappedFile
+{
+public:
+    explicit MemoryMappedFile(const wxString& filename);
+    ~MemoryMappedFile();
+
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    bool IsOk() const { return m_ok; }
+
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    bool Map(const wxString& filename);
+    bool Read(const wxString& filename);
+
+    bool m_ok;
+    const char *m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::string m_buffer;
+#ifdef __WXMSW__
+    void *m_mappingHandle;
+#endif
+};
+
+
 // ----------------------------------------------------------------------
 // Helpers for persisting windows' state
 // ----------------------------------------------------------------------
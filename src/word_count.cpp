@@ -0,0 +1,88 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "word_count.h"
+
+#include <unicode/brkiter.h>
+#include <unicode/uchar.h>
+
+#include <map>
+#include <memory>
+
+
+namespace
+{
+
+/// Returns word break iterator for @a lang, or nullptr if ICU can't create any
+icu::BreakIterator *GetWordIterator(const Language& lang)
+{
+    // break iterators aren't thread-safe and creating one is expensive, so
+    // each thread keeps its own for the languages it needs:
+    static thread_local std::map<std::string, std::unique_ptr<icu::BreakIterator>> s_iters;
+
+    const std::string key = lang.IsValid() ? lang.IcuLocaleName() : std::string();
+    auto i = s_iters.find(key);
+    if (i != s_iters.end())
+        return i->second.get();
+
+    UErrorCode err = U_ZERO_ERROR;
+    std::unique_ptr<icu::BreakIterator> iter(icu::BreakIterator::createWordInstance(lang.IsValid() ? lang.ToIcu() : icu::Locale::getRoot(), err));
+    if (U_FAILURE(err))
+        iter.reset();
+    return (s_iters[key] = std::move(iter)).get();
+}
+
+} // anonymous namespace
+
+
+TextCounts CountText(const Language& lang, const char *text, size_t length)
+{
+    TextCounts counts;
+    if (!length)
+        return counts;
+
+    const auto utext = icu::UnicodeString::fromUTF8(icu::StringPiece(text, (int32_t)length));
+
+    for (int32_t i = 0; i < utext.length(); i = utext.moveIndex32(i, 1))
+    {
+        if (!u_isUWhiteSpace(utext.char32At(i)))
+            counts.chars++;
+    }
+
+    auto iter = GetWordIterator(lang);
+    if (!iter)
+        return counts;
+
+    // setText() doesn't copy the text, it must be kept alive while iterating
+    iter->setText(utext);
+    iter->first();
+    for (int32_t end = iter->next(); end != icu::BreakIterator::DONE; end = iter->next())
+    {
+        if (iter->getRuleStatus() >= UBRK_WORD_NONE_LIMIT)
+            counts.words++;
+    }
+
+    return counts;
+}
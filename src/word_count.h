@@ -0,0 +1,65 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_word_count_h
+#define Poedit_word_count_h
+
+#include "language.h"
+
+#include <cstdint>
+#include <string>
+
+
+/// Numbers of words and characters in a text, see CountText()
+struct TextCounts
+{
+    uint32_t words = 0;
+    uint32_t chars = 0;
+
+    TextCounts& operator+=(const TextCounts& other)
+    {
+        words += other.words;
+        chars += other.chars;
+        return *this;
+    }
+};
+
+/**
+    Counts words and characters in UTF-8 @a text in language @a lang.
+
+    Words are found with ICU's word break iterator for the language, so that
+    punctuation and whitespace isn't counted and text in languages that
+    don't separate words with spaces is split into words too. Characters
+    are Unicode code points other than whitespace.
+
+    Break iterators are cached per language and thread, so this is cheap to
+    call repeatedly. May be called from any thread.
+ */
+TextCounts CountText(const Language& lang, const char *text, size_t length);
+
+inline TextCounts CountText(const Language& lang, const std::string& text)
+    { return CountText(lang, text.data(), text.size()); }
+
+#endif // Poedit_word_count_h
@@ -0,0 +1,307 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "xml_stream.h"
+
+#include "errors.h"
+#include "pugixml.h"
+
+#include <wx/intl.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+
+const size_t CHUNK_SIZE = 1024 * 1024;
+
+inline bool is_name_char(char c)
+{
+    return c != '>' && c != '/' && c != ' ' && c != '\t' && c != '\r' && c != '\n';
+}
+
+[[noreturn]] void throw_truncated()
+{
+    throw Exception(_("unexpected end of file"));
+}
+
+} // anonymous namespace
+
+
+XMLStreamScanner::XMLStreamScanner(const wxString& filename)
+    : m_bufOffset(0), m_pos(0)
+{
+    if (!m_file.Open(filename, "rb"))
+        throw Exception(wxString::Format(_(L"Couldn’t open file %s."), filename));
+}
+
+
+bool XMLStreamScanner::Fill()
+{
+    if (m_file.Eof())
+        return false;
+
+    const size_t oldSize = m_buf.size();
+    m_buf.resize(oldSize + CHUNK_SIZE);
+    const size_t read = m_file.Read(&m_buf[oldSize], CHUNK_SIZE);
+    m_buf.resize(oldSize + read);
+    if (m_file.Error())
+        throw Exception(_("error reading the file"));
+    return read > 0;
+}
+
+
+bool XMLStreamScanner::Ensure(size_t index)
+{
+    while (index >= m_buf.size())
+    {
+        if (!Fill())
+            return false;
+    }
+    return true;
+}
+
+
+size_t XMLStreamScanner::Find(const char *what, size_t from)
+{
+    const size_t len = strlen(what);
+    for (;;)
+    {
+        auto pos = m_buf.find(what, from);
+        if (pos != std::string::npos)
+            return pos;
+        // the match could start in the unsearched tail once more data is read:
+        if (m_buf.size() >= len)
+            from = std::max(from, m_buf.size() - len + 1);
+        if (!Fill())
+            return std::string::npos;
+    }
+}
+
+
+bool XMLStreamScanner::Next(Tag& tag)
+{
+    // Drop what was already processed; it's kept in the buffer until now
+    // so that ReadElement() can capture the last returned start tag:
+    if (m_pos > CHUNK_SIZE)
+    {
+        m_buf.erase(0, m_pos);
+        m_bufOffset += m_pos;
+        m_pos = 0;
+    }
+
+    return ReadTag(tag);
+}
+
+
+bool XMLStreamScanner::ReadTag(Tag& tag)
+{
+    for (;;)
+    {
+        size_t lt = Find("<", m_pos);
+        if (lt == std::string::npos)
+        {
+            m_pos = m_buf.size();
+            return false;
+        }
+
+        if (!Ensure(lt + 1))
+            throw_truncated();
+        const char c = m_buf[lt + 1];
+
+        if (c == '!' || c == '?')
+        {
+            const char *terminator;
+            if (c == '?')
+                terminator = "?>";
+            else if (Ensure(lt + 3) && m_buf.compare(lt + 2, 2, "--") == 0)
+                terminator = "-->";
+            else if (Ensure(lt + 8) && m_buf.compare(lt + 2, 7, "[CDATA[") == 0)
+                terminator = "]]>";
+            else
+                terminator = ">"; // DOCTYPE or similar declaration
+
+            size_t end = Find(terminator, lt + 2);
+            if (end != std::string::npos && *terminator == '>')
+            {
+                // DOCTYPE may have an internal subset in [...] with '>' in it:
+                auto subset = m_buf.find('[', lt + 2);
+                if (subset != std::string::npos && subset < end)
+                    end = Find("]", subset);
+                if (end != std::string::npos)
+                    end = Find(">", end);
+            }
+            if (end == std::string::npos)
+                throw_truncated();
+            m_pos = end + strlen(terminator);
+            continue;
+        }
+
+        // a tag; find its end, ignoring '>' in quoted attribute values:
+        size_t i = lt + 1;
+        char quote = 0;
+        for (;; ++i)
+        {
+            if (!Ensure(i))
+                throw_truncated();
+            const char ch = m_buf[i];
+            if (quote)
+            {
+                if (ch == quote)
+                    quote = 0;
+            }
+            else if (ch == '"' || ch == '\'')
+            {
+                quote = ch;
+            }
+            else if (ch == '>')
+            {
+                break;
+            }
+        }
+
+        const size_t nameStart = (c == '/') ? lt + 2 : lt + 1;
+        size_t nameEnd = nameStart;
+        while (nameEnd < i && is_name_char(m_buf[nameEnd]))
+            ++nameEnd;
+
+        if (c == '/')
+            tag.kind = Tag::End;
+        else if (m_buf[i - 1] == '/')
+            tag.kind = Tag::Empty;
+        else
+            tag.kind = Tag::Start;
+        tag.name.assign(m_buf, nameStart, nameEnd - nameStart);
+        tag.offset = m_bufOffset + lt;
+        tag.markup.assign(m_buf, lt, i + 1 - lt);
+
+        m_pos = i + 1;
+        return true;
+    }
+}
+
+
+std::string XMLStreamScanner::ReadElement(const Tag& start)
+{
+    wxASSERT( start.offset >= m_bufOffset );
+    const size_t begin = size_t(start.offset - m_bufOffset);
+
+    if (start.kind == Tag::Empty)
+        return start.markup;
+
+    // The buffer isn't compacted by ReadTag(), so it keeps the whole element:
+    int depth = 1;
+    Tag tag;
+    while (depth > 0)
+    {
+        if (!ReadTag(tag))
+            throw_truncated();
+        if (tag.name != start.name)
+            continue;
+        if (tag.kind == Tag::Start)
+            depth++;
+        else if (tag.kind == Tag::End)
+            depth--;
+    }
+
+    return m_buf.substr(begin, m_pos - begin);
+}
+
+
+bool XMLStreamScanner::ParseAttributes(const std::string& tagMarkup, std::vector<std::pair<std::string, std::string>>& attrs)
+{
+    std::string markup(tagMarkup);
+    if (markup.size() >= 2 && markup[markup.size() - 2] != '/')
+        markup.insert(markup.size() - 1, "/");
+
+    pugi::xml_document doc;
+    if (!doc.load_buffer(markup.data(), markup.size(), pugi::parse_default | pugi::parse_fragment, pugi::encoding_utf8))
+        return false;
+
+    auto node = doc.first_child();
+    for (auto a: node.attributes())
+        attrs.emplace_back(a.name(), a.value());
+    return true;
+}
+
+
+void XMLStreamCopyWithSplices(const wxString& filename, const std::vector<XMLStreamSplice>& splices, std::ostream& out)
+{
+    wxFFile file;
+    if (!file.Open(filename, "rb"))
+        throw Exception(wxString::Format(_(L"Couldn’t open file %s."), filename));
+
+    std::vector<char> buf(CHUNK_SIZE);
+    uint64_t pos = 0;
+
+    auto copyUpTo = [&](uint64_t end)
+    {
+        while (pos < end)
+        {
+            const size_t len = size_t(std::min<uint64_t>(CHUNK_SIZE, end - pos));
+            const size_t read = file.Read(buf.data(), len);
+            if (read != len)
+                throw Exception(_("error reading the file"));
+            out.write(buf.data(), read);
+            pos += read;
+        }
+    };
+
+    for (auto& s: splices)
+    {
+        wxASSERT( s.offset >= pos );
+        copyUpTo(s.offset);
+        out.write(s.replacement.data(), s.replacement.size());
+        if (!file.Seek(wxFileOffset(s.offset + s.length)))
+            throw Exception(_("error reading the file"));
+        pos = s.offset + s.length;
+    }
+
+    // copy the rest:
+    for (;;)
+    {
+        const size_t read = file.Read(buf.data(), buf.size());
+        if (file.Error())
+            throw Exception(_("error reading the file"));
+        if (!read)
+            break;
+        out.write(buf.data(), read);
+    }
+}
+
+
+std::string XMLStreamReadRange(const wxString& filename, uint64_t offset, size_t length)
+{
+    wxFFile file;
+    if (!file.Open(filename, "rb"))
+        throw Exception(wxString::Format(_(L"Couldn’t open file %s."), filename));
+
+    std::string s(length, '\0');
+    if (!file.Seek(wxFileOffset(offset)) || file.Read(&s[0], length) != length)
+        throw Exception(_("error reading the file"));
+    return s;
+}
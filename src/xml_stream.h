@@ -0,0 +1,116 @@
+/*
+ *  This file is part of Poedit (https://poedit.net)
+ *
+ *  Copyright (C) 2020 Vaclav Slavik
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Poedit_xml_stream_h
+#define Poedit_xml_stream_h
+
+#include <wx/ffile.h>
+#include <wx/string.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/**
+    Sequential scanner of (possibly huge) XML files.
+
+    Unlike loading the file into a DOM, only a small window of the file is
+    kept in memory. The scanner reports start and end tags with their byte
+    offsets in the file and can capture the complete markup of an element
+    the caller is interested in, which can then be parsed on its own.
+
+    This isn't a validating parser: comments, CDATA sections, processing
+    instructions and DOCTYPE are skipped and everything else is only
+    tokenized as much as needed to find tags.
+
+    Throws Exception if the file can't be read or is truncated.
+ */
+class XMLStreamScanner
+{
+public:
+    struct Tag
+    {
+        enum Kind { Start, End, Empty };
+
+        Kind kind;
+        std::string name;
+        /// Offset of the tag's '<' in the file
+        uint64_t offset;
+        /// Markup of the tag itself, from '<' to '>'
+        std::string markup;
+    };
+
+    explicit XMLStreamScanner(const wxString& filename);
+
+    /// Finds the next tag; returns false at the end of the file.
+    bool Next(Tag& tag);
+
+    /**
+        Reads the rest of the element whose start tag @a start was just
+        returned by Next() and returns its complete markup, from the start
+        tag to the end tag (inclusive). For Tag::Empty, this is the tag.
+     */
+    std::string ReadElement(const Tag& start);
+
+    /// Parses attributes of a start tag's markup into (name, value) pairs
+    static bool ParseAttributes(const std::string& tagMarkup, std::vector<std::pair<std::string, std::string>>& attrs);
+
+private:
+    bool Fill();
+    bool Ensure(size_t index);
+    size_t Find(const char *what, size_t from);
+    bool ReadTag(Tag& tag);
+
+    wxFFile m_file;
+    std::string m_buf;
+    // file offset of m_buf's beginning, current position in m_buf:
+    uint64_t m_bufOffset;
+    size_t m_pos;
+};
+
+
+/// A replacement of the [offset, offset+length) range of a file with new content
+struct XMLStreamSplice
+{
+    uint64_t offset;
+    uint64_t length;
+    std::string replacement;
+};
+
+/**
+    Writes content of @a filename to @a out, with @a splices (sorted by
+    offset and not overlapping) applied. Copies the rest of the file in
+    chunks, without reading it into memory at once.
+
+    Throws Exception on read errors.
+ */
+void XMLStreamCopyWithSplices(const wxString& filename, const std::vector<XMLStreamSplice>& splices, std::ostream& out);
+
+/// Reads @a length bytes at @a offset of @a filename; throws Exception on failure
+std::string XMLStreamReadRange(const wxString& filename, uint64_t offset, size_t length);
+
+#endif // Poedit_xml_stream_h